@@ -0,0 +1,259 @@
+// Tests for the cross-folder agenda (todo_agenda.c).
+//
+// Pages of upcoming, overdue and all-task agendas, with repeating tasks,
+// are checked against a list built by visiting every task. Lists are read
+// back from data files in both encodings and must not be loaded by the
+// agenda; some are loaded partway through to show a task. A file saved
+// after the lists change is read afresh.
+//
+//   gcc -std=c99 -Wall -pthread -I. -o test_agenda tests/test_agenda.c todo_agenda.c todo_core.c todo_format.c
+//       todo_slots.c todo_sort.c todo_recur.c todo_lz.c todo_journal.c todo_thread.c todo_date.c
+//       todo_trace.c todo_strings.c todo_tags.c todo_bitmap.c
+//   ./test_agenda
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "todo_agenda.h"
+#include "todo_core.h"
+#include "todo_date.h"
+#include "todo_format.h"
+#include "todo_recur.h"
+#include "todo_test.h"
+
+#define FOLDERS 5
+#define TASKS_PER_FOLDER 300
+#define MAX_ITEMS 20000
+
+static int compare_items(const void *a, const void *b) {
+    const TodoAgendaItem *x = (const TodoAgendaItem *)a;
+    const TodoAgendaItem *y = (const TodoAgendaItem *)b;
+
+    if (x->deadline != y->deadline) return x->deadline < y->deadline ? -1 : 1;
+    if (x->folder != y->folder) return x->folder - y->folder;
+    return x->task - y->task;
+}
+
+// Every task and occurrence in the range, in agenda order
+static size_t expected_items(const TodoStore *store, const TodoAgendaQuery *query, TodoAgendaItem *items) {
+    size_t count = 0;
+
+    for (int f = 0; f < store->folder_count; f++) {
+        const Folder *folder = &store->folders[f];
+
+        for (int row = 0; row < folder->task_count; row++) {
+            const Task *task = store_task(store, folder, row);
+            const TodoRecurrence *rule = store_task_rule(store, task);
+            int32_t days[512];
+            size_t occurrences = 0;
+
+            if (query->incomplete_only && task->completed) continue;
+            if (task->deadline_day >= query->from && task->deadline_day < query->to) {
+                items[count].folder = f;
+                items[count].task = row;
+                items[count++].deadline = task->deadline_day;
+            }
+            if (rule != NULL && !task->completed && task->deadline_day != DATE_NONE) {
+                int32_t from = query->from > task->deadline_day ? query->from : task->deadline_day + 1;
+
+                if (from < query->to) occurrences = recur_expand(rule, from, query->to, days, 512);
+            }
+            for (size_t i = 0; i < occurrences; i++) {
+                items[count].folder = f;
+                items[count].task = row;
+                items[count++].deadline = days[i];
+            }
+        }
+    }
+    qsort(items, count, sizeof(TodoAgendaItem), compare_items);
+    return count;
+}
+
+static void fill_store(TodoStore *store, int32_t today) {
+    TodoTaskInput inputs[TASKS_PER_FOLDER];
+    char texts[TASKS_PER_FOLDER][32];
+
+    for (int f = 0; f < FOLDERS; f++) {
+        char name[24];
+
+        snprintf(name, sizeof(name), "List %d", f);
+        store_create_folder(store, 0, name);
+        for (int i = 0; i < TASKS_PER_FOLDER; i++) {
+            TodoTaskInput *input = &inputs[i];
+            unsigned r = next_random();
+
+            snprintf(texts[i], sizeof(texts[i]), "task %d.%d", f, i);
+            memset(input, 0, sizeof(*input));
+            input->description = texts[i];
+            input->length = strlen(texts[i]);
+            input->deadline_day = r % 10 == 0 ? DATE_NONE : today - 90 + (int32_t)(r % 180);
+            input->completed = r % 7 < 2;
+            input->tags = "";
+            if (input->deadline_day != DATE_NONE && r % 13 == 0) {
+                input->repeat.unit = (uint8_t)(RECUR_DAILY + r % 3);
+                input->repeat.interval = (uint16_t)(1 + r % 3);
+                input->repeat.start = input->deadline_day;
+                input->repeat.until = r % 2 ? DATE_NONE : input->deadline_day + 120;
+            }
+        }
+        store_add_tasks(store, f, inputs, TASKS_PER_FOLDER);
+    }
+}
+
+// Read the agenda page by page, loading a folder when asked partway
+static size_t read_agenda(TodoStore *store, const TodoAgendaQuery *query, int load_at_page,
+                          TodoAgendaItem *items) {
+    TodoAgenda agenda;
+    size_t count = 0;
+    size_t got;
+    int page = 0;
+
+    if (!agenda_begin(&agenda, store, query)) return (size_t)-1;
+    while ((got = agenda_next_page(&agenda, items + count, 7)) > 0) {
+        count += got;
+        if (++page == load_at_page) store_materialize(store, items[count - 1].folder);
+    }
+    agenda_end(&agenda);
+    return count;
+}
+
+static int check_file(const TodoStore *original, int32_t today, int encoding) {
+    static TodoStore store;
+    static TodoAgendaItem found[MAX_ITEMS], expected[MAX_ITEMS];
+    const char *path = "test_agenda.dat";
+    TodoAgendaQuery queries[4];
+    TodoDataFile *file;
+
+    queries[0] = agenda_upcoming(today, 14);
+    queries[1] = agenda_overdue(today);
+    queries[2] = agenda_upcoming(today - 200, 400);
+    queries[2].incomplete_only = 0;
+    queries[3] = agenda_upcoming(today + 30, 0);     // Empty range
+
+    CHECK(todofmt_write(path, original, encoding) == TODOFMT_OK);
+    CHECK(todofmt_open(path, &file) == TODOFMT_OK);
+    store_init(&store);
+    store_attach(&store, file);
+
+    for (int q = 0; q < 4; q++) {
+        size_t want = expected_items(original, &queries[q], expected);
+        size_t count = read_agenda(&store, &queries[q], 0, found);
+
+        CHECK(count == want);
+        CHECK(memcmp(found, expected, count * sizeof(TodoAgendaItem)) == 0);
+        for (int f = 0; f < store.folder_count; f++) {
+            CHECK(!store.folders[f].loaded);
+        }
+    }
+
+    // Loading a folder to show a task keeps the cursor valid, and the
+    // rows it gave are the loaded rows
+    for (int q = 0; q < 3; q++) {
+        size_t want = expected_items(original, &queries[q], expected);
+        size_t count = read_agenda(&store, &queries[q], 2 + q, found);
+
+        CHECK(count == want);
+        CHECK(memcmp(found, expected, count * sizeof(TodoAgendaItem)) == 0);
+    }
+    for (size_t i = 0; i < 50; i++) {
+        const Folder *folder = &store.folders[found[i].folder];
+        const Task *task;
+
+        CHECK(store_materialize(&store, found[i].folder));
+        task = store_task(&store, folder, found[i].task);
+        CHECK(task->deadline_day == found[i].deadline || store_task_rule(&store, task) != NULL);
+    }
+    store_release(&store);
+    remove(path);
+    return 0;
+}
+
+static int test_agenda_over_files(void) {
+    static TodoStore original;
+    int32_t today = date_from_civil(2024, 2, 20);
+
+    store_init(&original);
+    fill_store(&original, today);
+    if (check_file(&original, today, TODOFMT_PLAIN) != 0) return 1;
+    if (check_file(&original, today, TODOFMT_COLUMNAR) != 0) return 1;
+    store_release(&original);
+    return 0;
+}
+
+// Each data file keeps the sections it read for the next query; a file
+// saved after the lists changed must be read afresh
+static int test_agenda_after_save(void) {
+    static TodoStore original, store;
+    static TodoAgendaItem found[MAX_ITEMS], expected[MAX_ITEMS];
+    const char *path = "test_agenda.dat";
+    int32_t today = date_from_civil(2024, 6, 1);
+    TodoAgendaQuery query = agenda_upcoming(today - 30, 60);
+    TodoDataFile *file;
+
+    store_init(&original);
+    fill_store(&original, today);
+    for (int encoding = TODOFMT_PLAIN; encoding <= TODOFMT_COLUMNAR; encoding++) {
+        size_t want = expected_items(&original, &query, expected);
+
+        CHECK(todofmt_write(path, &original, encoding) == TODOFMT_OK);
+        CHECK(todofmt_open(path, &file) == TODOFMT_OK);
+        store_init(&store);
+        store_attach(&store, file);
+        for (int run = 0; run < 2; run++) {
+            CHECK(read_agenda(&store, &query, 0, found) == want);
+            CHECK(memcmp(found, expected, want * sizeof(TodoAgendaItem)) == 0);
+        }
+
+        for (int f = 0; f < FOLDERS; f++) {
+            CHECK(store_complete_task(&original, f, 0));
+            CHECK(store_add_task(&original, f, "new", today + f));
+        }
+        want = expected_items(&original, &query, expected);
+        CHECK(todofmt_write(path, &original, encoding) == TODOFMT_OK);
+        CHECK(todofmt_open(path, &file) == TODOFMT_OK);
+        store_attach(&store, file);
+        CHECK(read_agenda(&store, &query, 0, found) == want);
+        CHECK(memcmp(found, expected, want * sizeof(TodoAgendaItem)) == 0);
+        for (int f = 0; f < store.folder_count; f++) {
+            CHECK(!store.folders[f].loaded);
+        }
+        store_release(&store);
+    }
+    store_release(&original);
+    remove(path);
+    return 0;
+}
+
+// Folders in memory only, after tasks are completed, added and deleted
+static int test_agenda_loaded(void) {
+    static TodoStore store;
+    static TodoAgendaItem found[MAX_ITEMS], expected[MAX_ITEMS];
+    int32_t today = date_from_civil(2025, 12, 30);
+    TodoAgendaQuery query = agenda_upcoming(today, 40);
+    size_t want;
+
+    store_init(&store);
+    fill_store(&store, today);
+    CHECK(store_complete_task(&store, 0, 0));
+    CHECK(store_add_task(&store, 1, "new", today + 3));
+    CHECK(store_delete_task(&store, 2, 5));
+    want = expected_items(&store, &query, expected);
+    CHECK(read_agenda(&store, &query, 0, found) == want);
+    CHECK(memcmp(found, expected, want * sizeof(TodoAgendaItem)) == 0);
+    store_release(&store);
+    return 0;
+}
+
+int main(void) {
+    seed_random(777);
+    RUN(test_agenda_over_files);
+    RUN(test_agenda_after_save);
+    RUN(test_agenda_loaded);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,293 @@
+// Tests for batched task changes (todo_batch.c).
+//
+// Random batches of adds, completions, reopens, deletions, retags and
+// moves across three lists are committed with one entry made to fail, in
+// turn at every position. Nothing may change: the lists, their rows and
+// handles, the listeners and the undo history are as they were. The same
+// kind of batch without the failure applies and is undone as one step.
+// Changes the batch refuses when they are queued leave it as it was.
+//
+//   gcc -std=c99 -Wall -pthread -I. -o test_batch tests/test_batch.c todo_batch.c todo_history.c todo_core.c
+//       todo_format.c todo_slots.c todo_sort.c todo_recur.c todo_lz.c todo_journal.c todo_thread.c
+//       todo_date.c todo_trace.c todo_strings.c todo_tags.c todo_bitmap.c
+//   ./test_batch
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "todo_batch.h"
+#include "todo_core.h"
+#include "todo_date.h"
+#include "todo_history.h"
+#include "todo_journal.h"
+#include "todo_test.h"
+
+#define FOLDERS 3
+#define TASKS_PER_FOLDER 40
+#define ROUNDS 60
+#define MAX_CHANGES 12
+
+static const char *tag_sets[] = { "", "home", "home work", "work" };
+static const TodoRecurrence no_rule;
+
+static TodoStore store;
+static int notifications;
+static int described;       // Tasks given a description so far
+
+typedef struct {
+    int calls;
+    int fail_entry;     // Entry to spoil, -1 for none
+} Applier;
+
+static void count_change(void *context, const TodoStoreChange *change) {
+    (void)context;
+    (void)change;
+    notifications++;
+}
+
+// Apply entries as one batch, with entry fail_entry no longer matching the
+// store: its task is gone, or its list is for an add
+static int apply_entries(void *context, const TodoJournalEntry *entries, int count) {
+    static TodoJournalEntry copy[MAX_CHANGES * 2];
+    Applier *applier = (Applier *)context;
+
+    applier->calls++;
+    if (applier->fail_entry < 0 || count > MAX_CHANGES * 2) {
+        return count == 1 ? journal_apply(&store, entries) : journal_apply_batch(&store, entries, count);
+    }
+    memcpy(copy, entries, (size_t)count * sizeof(TodoJournalEntry));
+    if (copy[applier->fail_entry].op == JOURNAL_ADD_TASK || copy[applier->fail_entry].op == JOURNAL_RESTORE_TASK) {
+        copy[applier->fail_entry].folder_id = 999;
+    } else {
+        copy[applier->fail_entry].text[0] = "no such task";
+    }
+    return journal_apply_batch(&store, copy, count);
+}
+
+// Every list and task, in order, as text; with handles, the tasks must also
+// be the same ones
+static char *dump_store(int handles) {
+    size_t size = 0, capacity = 4096;
+    char *text = (char *)malloc(capacity);
+    char line[JOURNAL_SCHEDULE_LENGTH + 512];
+
+    text[0] = '\0';
+    for (int f = 0; f < store.folder_count; f++) {
+        const Folder *folder = &store.folders[f];
+        int length;
+
+        for (int i = -1; i < folder->task_count; i++) {
+            if (i < 0) {
+                length = snprintf(line, sizeof(line), "list %u %s\n", (unsigned)folder->id,
+                                  store_text(&store, folder->name));
+            } else {
+                const Task *task = store_task(&store, folder, i);
+                const TodoRecurrence *rule = store_task_rule(&store, task);
+                char schedule[JOURNAL_SCHEDULE_LENGTH];
+
+                journal_format_schedule(task->deadline_day, rule ? rule : &no_rule, task->priority,
+                                        store_text(&store, task->tags), schedule);
+                length = snprintf(line, sizeof(line), "  %08x %s|%s|%d\n", handles ? (unsigned)folder->rows[i] : 0u,
+                                  store_text(&store, task->description), schedule, task->completed);
+            }
+            while (size + (size_t)length + 1 > capacity) {
+                capacity *= 2;
+                text = (char *)realloc(text, capacity);
+            }
+            memcpy(text + size, line, (size_t)length + 1);
+            size += (size_t)length;
+        }
+    }
+    return text;
+}
+
+// Undo finds a task by its description and deadline, so every task gets
+// its own
+static const char *next_description(char text[32]) {
+    snprintf(text, 32, "Task %d", described++);
+    return text;
+}
+
+static void fill_store(int32_t today) {
+    for (int f = 0; f < FOLDERS; f++) {
+        char name[24];
+
+        snprintf(name, sizeof(name), "List %d", f);
+        store_create_folder(&store, 0, name);
+        for (int i = 0; i < TASKS_PER_FOLDER; i++) {
+            char text[32];
+            TodoRecurrence rule = no_rule;
+            int32_t deadline = next_random() % 5 == 0 ? DATE_NONE : today - 10 + (int32_t)(next_random() % 30);
+
+            if (deadline != DATE_NONE && next_random() % 6 == 0) {
+                rule.unit = RECUR_WEEKLY;
+                rule.interval = 1;
+                rule.start = deadline;
+                rule.until = DATE_NONE;
+            }
+            // A repeating task is only completed once its rule runs out
+            store_insert_task(&store, f, -1, next_description(text), deadline,
+                              rule.unit == RECUR_NONE && next_random() % 3 == 0, (int)(next_random() % 4),
+                              tag_sets[next_random() % 4], &rule);
+        }
+    }
+}
+
+// Up to MAX_CHANGES random changes, each to a task the batch has not
+// changed yet
+static TodoBatch *random_batch(int32_t today) {
+    TodoBatch *batch = batch_begin(&store);
+    uint8_t used[FOLDERS][TASKS_PER_FOLDER * 4];
+    int changes = 1 + (int)(next_random() % MAX_CHANGES);
+
+    if (batch == NULL) return NULL;
+    memset(used, 0, sizeof(used));
+    for (int i = 0; i < changes; i++) {
+        int index = (int)(next_random() % FOLDERS);
+        int task_count = store.folders[index].task_count;
+        unsigned kind = next_random() % 6;
+        char text[32];
+        int row;
+
+        if (kind == 0 || task_count == 0 || task_count > TASKS_PER_FOLDER * 4) {
+            batch_add_task(batch, index, next_description(text), today + (int32_t)(next_random() % 9),
+                           (int)(next_random() % 4), tag_sets[next_random() % 4], NULL);
+            continue;
+        }
+        row = (int)(next_random() % (unsigned)task_count);
+        if (used[index][row]) continue;
+        used[index][row] = 1;
+        if (kind == 1) {
+            batch_complete_task(batch, index, row);
+        } else if (kind == 2) {
+            batch_reopen_task(batch, index, row);
+        } else if (kind == 3) {
+            batch_delete_task(batch, index, row);
+        } else if (kind == 4) {
+            batch_tag_task(batch, index, row, tag_sets[next_random() % 4]);
+        } else {
+            batch_move_task(batch, index, row, (index + 1 + (int)(next_random() % (FOLDERS - 1))) % FOLDERS);
+        }
+    }
+    return batch;
+}
+
+static int test_failing_entry(void) {
+    int32_t today = date_from_civil(2024, 9, 2);
+    TodoHistory *history = history_create(HISTORY_DEFAULT_BUDGET);
+    Applier applier;
+
+    CHECK(history != NULL);
+    store_init(&store);
+    fill_store(today);
+    CHECK(store_listen(&store, count_change, NULL));
+
+    for (int round = 0; round < ROUNDS; round++) {
+        char *before = dump_store(1);
+        char *contents = dump_store(0);
+        char *after;
+        int steps = history_undo_count(history);
+        TodoBatch *batch = random_batch(today);
+        int count;
+
+        CHECK(batch != NULL);
+        count = batch_count(batch);
+        if (count == 0) {
+            batch_abort(batch);
+            free(before);
+            free(contents);
+            continue;
+        }
+
+        // One entry fails, at each position in turn across the rounds
+        applier.calls = 0;
+        applier.fail_entry = round % count;
+        notifications = 0;
+        CHECK(!batch_commit(batch, history, apply_entries, &applier));
+        CHECK(applier.calls == 1);
+        after = dump_store(1);
+        CHECK(strcmp(before, after) == 0);
+        free(after);
+        CHECK(notifications == 0);
+        CHECK(history_undo_count(history) == steps);
+
+        // Without the failure a batch goes through as one undo step, which
+        // puts back what the tasks were
+        batch = random_batch(today);
+        CHECK(batch != NULL);
+        applier.fail_entry = -1;
+        count = batch_count(batch);
+        CHECK(batch_commit(batch, history, apply_entries, &applier));
+        CHECK(history_undo_count(history) == steps + (count > 0));
+        if (count > 0 && round % 2 == 0) {
+            CHECK(history_undo(history, apply_entries, &applier));
+            after = dump_store(0);
+            CHECK(strcmp(contents, after) == 0);
+            free(after);
+        }
+        free(before);
+        free(contents);
+    }
+    history_destroy(history);
+    store_release(&store);
+    return 0;
+}
+
+static int test_refused_changes(void) {
+    int32_t today = date_from_civil(2025, 4, 14);
+    TodoRecurrence bad_rule = no_rule;
+    TodoBatch *batch;
+    char *before, *after;
+
+    store_init(&store);
+    fill_store(today);
+    before = dump_store(1);
+    batch = batch_begin(&store);
+    CHECK(batch != NULL);
+
+    // Rows outside their list, lists that do not exist, and bad schedules
+    // or tags queue nothing
+    CHECK(!batch_complete_task(batch, 0, TASKS_PER_FOLDER));
+    CHECK(!batch_delete_task(batch, FOLDERS, 0));
+    CHECK(!batch_move_task(batch, 0, 0, 0));
+    CHECK(!batch_move_task(batch, 0, 0, FOLDERS));
+    CHECK(!batch_add_task(batch, -1, "x", DATE_NONE, PRIORITY_NONE, NULL, NULL));
+    CHECK(!batch_add_task(batch, 0, "x", DATE_NONE, PRIORITY_HIGH + 1, NULL, NULL));
+    CHECK(!batch_tag_task(batch, 0, 0, "work home"));
+    bad_rule.unit = RECUR_DAILY;
+    CHECK(!batch_add_task(batch, 0, "x", today, PRIORITY_NONE, NULL, &bad_rule));
+    CHECK(batch_count(batch) == 0);
+
+    // A task changes once per batch
+    CHECK(batch_delete_task(batch, 1, 5));
+    CHECK(!batch_complete_task(batch, 1, 5));
+    CHECK(!batch_move_task(batch, 1, 5, 2));
+    CHECK(!batch_tag_task(batch, 1, 5, "home"));
+    CHECK(batch_count(batch) == 1);
+    CHECK(batch_add_task(batch, 2, "kept", today, PRIORITY_LOW, "work", NULL));
+    CHECK(batch_count(batch) == 2);
+    after = dump_store(1);
+    CHECK(strcmp(before, after) == 0);
+    free(after);
+
+    // What was queued applies
+    CHECK(batch_commit(batch, NULL, NULL, NULL));
+    CHECK(store.folders[1].task_count == TASKS_PER_FOLDER - 1);
+    CHECK(store.folders[2].task_count == TASKS_PER_FOLDER + 1);
+    free(before);
+    store_release(&store);
+    return 0;
+}
+
+int main(void) {
+    seed_random(24);
+    RUN(test_failing_entry);
+    RUN(test_refused_changes);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,117 @@
+// Tests for the task store (todo_core.c).
+//
+// Adding tasks in bulk must leave a list exactly as adding them one by one
+// would, and a bulk add with an invalid task must add none of them.
+//
+//   gcc -std=c99 -Wall -pthread -I. -o test_core tests/test_core.c todo_core.c todo_format.c todo_slots.c
+//       todo_sort.c todo_recur.c todo_lz.c todo_journal.c todo_thread.c todo_date.c todo_trace.c
+//       todo_strings.c todo_tags.c todo_bitmap.c
+//   ./test_core
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "todo_core.h"
+#include "todo_date.h"
+#include "todo_test.h"
+
+#define TASKS 500
+
+static const char *descriptions[] = { "Call mum", "Pay rent", "Report", "Gym" };
+static const char *tag_sets[] = { "", "home", "home work" };
+
+static void make_inputs(TodoTaskInput *inputs, int count, int32_t today) {
+    for (int i = 0; i < count; i++) {
+        TodoTaskInput *input = &inputs[i];
+
+        memset(input, 0, sizeof(*input));
+        input->description = descriptions[next_random() % 4];
+        input->length = strlen(input->description);
+        input->deadline_day = next_random() % 5 == 0 ? DATE_NONE : today + (int32_t)(next_random() % 20);
+        input->completed = next_random() % 4 == 0;
+        input->priority = (int)(next_random() % 4);
+        input->tags = tag_sets[next_random() % 3];
+        input->tags_length = strlen(input->tags);
+    }
+}
+
+static int same_lists(const TodoStore *a, const TodoStore *b, int index) {
+    const Folder *x = &a->folders[index];
+    const Folder *y = &b->folders[index];
+
+    CHECK(x->task_count == y->task_count);
+    for (int i = 0; i < x->task_count; i++) {
+        const Task *p = store_task(a, x, i);
+        const Task *q = store_task(b, y, i);
+
+        CHECK(strcmp(store_text(a, p->description), store_text(b, q->description)) == 0);
+        CHECK(strcmp(store_text(a, p->tags), store_text(b, q->tags)) == 0);
+        CHECK(p->deadline_day == q->deadline_day && p->completed == q->completed && p->priority == q->priority);
+    }
+    return 0;
+}
+
+static int test_bulk_matches_single(void) {
+    static TodoStore bulk, single;
+    static TodoTaskInput inputs[TASKS];
+    int32_t today = date_from_civil(2024, 5, 1);
+
+    make_inputs(inputs, TASKS, today);
+    store_init(&bulk);
+    store_init(&single);
+    CHECK(store_create_folder(&bulk, 0, "List") == 0 && store_create_folder(&single, 0, "List") == 0);
+    CHECK(store_add_tasks(&bulk, 0, inputs, TASKS / 2) == TASKS / 2);
+    CHECK(store_add_tasks(&bulk, 0, inputs + TASKS / 2, TASKS - TASKS / 2) == TASKS - TASKS / 2);
+    for (int i = 0; i < TASKS; i++) {
+        CHECK(store_insert_task(&single, 0, -1, inputs[i].description, inputs[i].deadline_day, inputs[i].completed,
+                                inputs[i].priority, inputs[i].tags, NULL));
+    }
+    if (same_lists(&bulk, &single, 0) != 0) return 1;
+    store_release(&bulk);
+    store_release(&single);
+    return 0;
+}
+
+// One bad task anywhere in the input: nothing is added, and nothing leaks
+// into the string pool or the slots
+static int test_invalid_adds_nothing(void) {
+    static TodoStore store;
+    static TodoTaskInput inputs[TASKS];
+    int32_t today = date_from_civil(2024, 5, 1);
+    TodoTaskInput good;
+
+    store_init(&store);
+    CHECK(store_create_folder(&store, 0, "List") == 0);
+    make_inputs(inputs, TASKS, today);
+    good = inputs[TASKS - 1];
+
+    inputs[TASKS - 1].priority = PRIORITY_HIGH + 1;
+    CHECK(store_add_tasks(&store, 0, inputs, TASKS) == 0);
+    inputs[TASKS - 1] = good;
+    inputs[0].tags = "Not Canonical";
+    inputs[0].tags_length = strlen(inputs[0].tags);
+    CHECK(store_add_tasks(&store, 0, inputs, TASKS) == 0);
+    inputs[0] = good;
+    inputs[7].repeat.unit = RECUR_DAILY;
+    inputs[7].repeat.interval = 0;
+    CHECK(store_add_tasks(&store, 0, inputs, TASKS) == 0);
+    CHECK(store.folders[0].task_count == 0 && store.tasks.used == 0);
+
+    inputs[7] = good;
+    CHECK(store_add_tasks(&store, 0, inputs, TASKS) == TASKS);
+    CHECK(store.folders[0].task_count == TASKS);
+    store_release(&store);
+    return 0;
+}
+
+int main(void) {
+    seed_random(99);
+    RUN(test_bulk_matches_single);
+    RUN(test_invalid_adds_nothing);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,297 @@
+// Tests for the data file (todo_format.c) and the text codec (todo_lz.c).
+//
+// The checksum must match one taken a bit at a time, at every length and
+// alignment and when continued across calls. Blocks of every shape must
+// come back from the codec byte for byte, and damaged blocks must fail
+// without reading or writing out of bounds. Lists written in either
+// section encoding, with text spanning several compressed pieces, must
+// load back exactly, and a damaged columnar section must be refused.
+//
+//   gcc -std=c99 -Wall -pthread -I. -o test_format tests/test_format.c todo_core.c todo_format.c
+//       todo_slots.c todo_sort.c todo_recur.c todo_lz.c todo_journal.c todo_thread.c todo_date.c
+//       todo_trace.c todo_strings.c todo_tags.c todo_bitmap.c
+//   ./test_format
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "todo_core.h"
+#include "todo_date.h"
+#include "todo_format.h"
+#include "todo_lz.h"
+#include "todo_recur.h"
+#include "todo_test.h"
+
+#define BLOCK_SIZE (300 * 1024)
+
+// CRC32C one bit at a time
+static uint32_t crc_by_bits(uint32_t crc, const unsigned char *bytes, size_t size) {
+    crc = ~crc;
+    while (size-- > 0) {
+        crc ^= *bytes++;
+        for (int bit = 0; bit < 8; bit++) crc = crc & 1 ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+    }
+    return ~crc;
+}
+
+static int test_crc(void) {
+    static unsigned char bytes[100000];
+
+    for (size_t i = 0; i < sizeof(bytes); i++) bytes[i] = (unsigned char)next_random();
+    CHECK(todofmt_crc32c(0, "123456789", 9) == 0xE3069283);
+    for (int round = 0; round < 2000; round++) {
+        size_t offset = next_random() % 16;
+        size_t size = round < 64 ? (size_t)round : next_random() % (sizeof(bytes) - 16);
+        size_t split = size > 0 ? next_random() % size : 0;
+        uint32_t expected = crc_by_bits(0, bytes + offset, size);
+
+        CHECK(todofmt_crc32c(0, bytes + offset, size) == expected);
+        CHECK(todofmt_crc32c(todofmt_crc32c(0, bytes + offset, split), bytes + offset + split, size - split) ==
+              expected);
+    }
+    return 0;
+}
+
+// Blocks made of repeats at every distance, up to past the window, mixed
+// with noise
+static size_t make_block(unsigned char *block, int shape) {
+    size_t size = shape == 0 ? 0 : shape == 1 ? 1 : shape == 2 ? 7 : BLOCK_SIZE;
+
+    for (size_t i = 0; i < size; i++) {
+        switch (shape) {
+            case 3:     // Noise
+                block[i] = (unsigned char)next_random();
+                break;
+            case 4:     // One byte over and over
+                block[i] = 'a';
+                break;
+            case 5:     // Words from a small vocabulary
+                block[i] = (unsigned char)"Pay rent Call mum Write the report "[(i * 7 + i / 35) % 35];
+                break;
+            case 6: {   // Copies from far back, some beyond the window
+                size_t back = next_random() % 2 ? 70000 : 1 + next_random() % 65535;
+
+                block[i] = i >= back && next_random() % 16 ? block[i - back] : (unsigned char)next_random();
+                break;
+            }
+            default:
+                block[i] = (unsigned char)('0' + i % 10);
+        }
+    }
+    return size;
+}
+
+static int test_lz_round_trip(void) {
+    static unsigned char block[BLOCK_SIZE], packed[BLOCK_SIZE + BLOCK_SIZE / 8 + 64], unpacked[BLOCK_SIZE];
+
+    for (int shape = 0; shape <= 6; shape++) {
+        size_t size = make_block(block, shape);
+        size_t packed_size = lz_compress(block, size, packed, sizeof(packed));
+
+        CHECK(lz_bound(size) <= sizeof(packed));
+        CHECK(packed_size > 0 && packed_size <= lz_bound(size));
+        CHECK(lz_decompress(packed, packed_size, unpacked, size));
+        CHECK(memcmp(block, unpacked, size) == 0);
+        if (shape == 4 || shape == 5) CHECK(packed_size < size / 20);
+        // The decoded size must match exactly
+        if (size > 0) {
+            CHECK(!lz_decompress(packed, packed_size, unpacked, size - 1));
+        }
+        CHECK(!lz_decompress(packed, packed_size, unpacked, size + 1));
+    }
+    // Too little room to compress into
+    make_block(block, 3);
+    CHECK(lz_compress(block, BLOCK_SIZE, packed, BLOCK_SIZE / 2) == 0);
+    return 0;
+}
+
+// Cut blocks are refused; scrambled blocks are refused or decode to
+// something, but never touch memory outside the buffers (run under
+// AddressSanitizer)
+static int test_lz_damaged(void) {
+    static unsigned char block[BLOCK_SIZE], packed[BLOCK_SIZE + BLOCK_SIZE / 8 + 64], unpacked[BLOCK_SIZE];
+    size_t size = make_block(block, 6);
+    size_t packed_size = lz_compress(block, size, packed, sizeof(packed));
+
+    CHECK(packed_size > 0);
+    for (int round = 0; round < 50; round++) {
+        CHECK(!lz_decompress(packed, next_random() % packed_size, unpacked, size));
+    }
+    for (int round = 0; round < 200; round++) {
+        unsigned char *copy = (unsigned char *)malloc(packed_size);
+        size_t cut = round % 4 == 0 ? next_random() % packed_size : packed_size;
+
+        CHECK(copy != NULL);
+        memcpy(copy, packed, packed_size);
+        for (int flips = 0; flips < 1 + round % 5; flips++) {
+            copy[next_random() % packed_size] ^= (unsigned char)(1 + next_random() % 255);
+        }
+        lz_decompress(copy, cut, unpacked, size);
+        free(copy);
+    }
+    return 0;
+}
+
+// Lists with every kind of task, and text well past one compressed piece
+static void fill_store(TodoStore *store, int32_t today) {
+    static const char *words[] = { "report", "rent", "Überweisung", "日本語", "gym", "x" };
+    static const char *tag_sets[] = { "", "home", "home work", "ärger" };
+    char text[600];
+
+    store_create_folder(store, 0, "Empty");
+    for (int f = 0; f < 3; f++) {
+        char name[24];
+
+        snprintf(name, sizeof(name), "List %d", f);
+        store_create_folder(store, 0, name);
+        for (int i = 0; i < 1500; i++) {
+            TodoRecurrence rule;
+            size_t length = 0;
+            int words_in = 1 + (int)(next_random() % (i % 10 == 0 ? 60 : 8));
+
+            for (int w = 0; w < words_in && length + 32 < sizeof(text); w++) {
+                length += (size_t)snprintf(text + length, sizeof(text) - length, "%s%s", w ? " " : "",
+                                           words[next_random() % 6]);
+            }
+            memset(&rule, 0, sizeof(rule));
+            if (i % 9 == 0) {
+                rule.unit = (uint8_t)(RECUR_DAILY + i % 3);
+                rule.interval = (uint16_t)(1 + i % 4);
+                rule.start = today + i % 30;
+                rule.until = i % 2 ? DATE_NONE : today + 400;
+            }
+            store_insert_task(store, f + 1, -1, text, i % 7 == 0 ? DATE_NONE : rule.unit ? rule.start : today - 200 + i % 400,
+                              i % 5 == 0 && !rule.unit, i % 4, tag_sets[i % 4], rule.unit ? &rule : NULL);
+        }
+    }
+}
+
+static int same_store(TodoStore *a, TodoStore *b) {
+    CHECK(a->folder_count == b->folder_count);
+    for (int f = 0; f < a->folder_count; f++) {
+        const Folder *x = &a->folders[f];
+        const Folder *y = &b->folders[f];
+
+        CHECK(store_materialize(b, f));
+        CHECK(x->id == y->id && x->task_count == y->task_count);
+        CHECK(strcmp(store_text(a, x->name), store_text(b, y->name)) == 0);
+        for (int i = 0; i < x->task_count; i++) {
+            const Task *p = store_task(a, x, i);
+            const Task *q = store_task(b, y, i);
+            const TodoRecurrence *r = store_task_rule(a, p);
+            const TodoRecurrence *s = store_task_rule(b, q);
+
+            CHECK(strcmp(store_text(a, p->description), store_text(b, q->description)) == 0);
+            CHECK(strcmp(store_text(a, p->tags), store_text(b, q->tags)) == 0);
+            CHECK(p->deadline_day == q->deadline_day && p->completed == q->completed && p->priority == q->priority);
+            CHECK(p->sequence == q->sequence);
+            CHECK((r == NULL) == (s == NULL));
+            CHECK(r == NULL || memcmp(r, s, sizeof(*r)) == 0);
+        }
+    }
+    return 0;
+}
+
+static long file_size(const char *path) {
+    FILE *file = fopen(path, "rb");
+    long size = -1;
+
+    if (file != NULL && fseek(file, 0, SEEK_END) == 0) size = ftell(file);
+    if (file != NULL) fclose(file);
+    return size;
+}
+
+static int test_round_trip(void) {
+    static TodoStore original, loaded;
+    const char *paths[2] = { "test_format_plain.dat", "test_format_columnar.dat" };
+    int32_t today = date_from_civil(2024, 2, 29);
+
+    store_init(&original);
+    fill_store(&original, today);
+    for (int encoding = TODOFMT_PLAIN; encoding <= TODOFMT_COLUMNAR; encoding++) {
+        TodoDataFile *file;
+        TodoSectionColumns columns;
+
+        CHECK(todofmt_write(paths[encoding], &original, encoding) == TODOFMT_OK);
+        CHECK(todofmt_open(paths[encoding], &file) == TODOFMT_OK);
+        CHECK(todofmt_verify(file, 2) == 0);
+        if (encoding == TODOFMT_COLUMNAR) {
+            const TodoFolderEntry *entry = todofmt_folder_entry(file, 1);
+
+            // Each list's text is more than one compressed piece
+            CHECK(entry->encoding == TODOFMT_COLUMNAR);
+            CHECK(todofmt_decode_columns(file, entry, &columns));
+        CHECK(columns.count == 1500 && columns.text_size > TODOFMT_TEXT_BLOCK);
+            todofmt_free_columns(&columns);
+        }
+        store_init(&loaded);
+        store_attach(&loaded, file);
+        if (same_store(&original, &loaded) != 0) return 1;
+        store_release(&loaded);
+    }
+    CHECK(file_size(paths[TODOFMT_COLUMNAR]) < file_size(paths[TODOFMT_PLAIN]) / 2);
+
+    store_release(&original);
+    remove(paths[0]);
+    remove(paths[1]);
+    return 0;
+}
+
+// A flipped byte in a columnar section is caught before the list loads,
+// and the other lists still load
+static int test_damaged_section(void) {
+    static TodoStore original, loaded;
+    const char *path = "test_format_damaged.dat";
+    int32_t today = date_from_civil(2023, 3, 1);
+    TodoDataFile *file;
+    uint64_t flip;
+    unsigned char *data;
+    long size;
+    FILE *stream;
+
+    store_init(&original);
+    fill_store(&original, today);
+    CHECK(todofmt_write(path, &original, TODOFMT_COLUMNAR) == TODOFMT_OK);
+    size = file_size(path);
+    data = (unsigned char *)malloc((size_t)size);
+    CHECK(data != NULL);
+    stream = fopen(path, "rb");
+    CHECK(stream != NULL && fread(data, 1, (size_t)size, stream) == (size_t)size);
+    fclose(stream);
+
+    CHECK(todofmt_open_memory(data, (size_t)size, &file) == TODOFMT_OK);
+    flip = todofmt_folder_entry(file, 2)->section_offset + todofmt_folder_entry(file, 2)->section_size / 2;
+    todofmt_close(file);
+    data[flip] ^= 0x40;
+
+    CHECK(todofmt_open_memory(data, (size_t)size, &file) == TODOFMT_OK);
+    CHECK(!todofmt_section_ok(file, 2));
+    CHECK(todofmt_section_ok(file, 1));
+    CHECK(todofmt_damaged_count(file) == 1);
+    store_init(&loaded);
+    store_attach(&loaded, file);
+    CHECK(!store_materialize(&loaded, 2) || loaded.folders[2].task_count == 0);
+    CHECK(store_materialize(&loaded, 3) && loaded.folders[3].task_count == 1500);
+    store_release(&loaded);
+
+    free(data);
+    store_release(&original);
+    remove(path);
+    return 0;
+}
+
+int main(void) {
+    seed_random(2718);
+    RUN(test_crc);
+    RUN(test_lz_round_trip);
+    RUN(test_lz_damaged);
+    RUN(test_round_trip);
+    RUN(test_damaged_section);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,438 @@
+// Tests for the undo/redo history (todo_history.c).
+//
+// Random changes of every kind, one at a time and in batches, are made the
+// way the program makes them, with the whole store written out after each.
+// Undoing them one by one or many at once, and redoing them, must give back
+// each of those states exactly. Changes whose inverse fails partway must
+// leave the store as it was.
+//
+//   gcc -std=c99 -Wall -pthread -I. -o test_history tests/test_history.c todo_history.c todo_batch.c
+//       todo_core.c todo_format.c todo_slots.c todo_sort.c todo_recur.c todo_lz.c todo_journal.c
+//       todo_thread.c todo_date.c todo_trace.c todo_strings.c todo_tags.c todo_bitmap.c
+//   ./test_history
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "todo_batch.h"
+#include "todo_core.h"
+#include "todo_date.h"
+#include "todo_history.h"
+#include "todo_journal.h"
+#include "todo_recur.h"
+#include "todo_test.h"
+
+#define CHANGES 400
+#define SHORT_LIST 8
+
+static const char *descriptions[] = { "Call mum", "Pay rent", "Report", "Gym", "Read" };
+static const char *tag_sets[] = { "", "home", "home work", "work" };
+static const TodoRecurrence no_rule;
+
+static TodoStore store;
+
+typedef struct {
+    int calls;
+    long entries;
+    int fail_at;        // Fail the call with this number, 0 for none
+} Applier;
+
+static Applier applier;
+
+static int apply_entries(void *context, const TodoJournalEntry *entries, int count) {
+    Applier *state = (Applier *)context;
+
+    state->calls++;
+    state->entries += count;
+    if (state->calls == state->fail_at) return 0;
+    return count == 1 ? journal_apply(&store, entries) : journal_apply_batch(&store, entries, count);
+}
+
+// Every list and task, in order, as text
+static char *dump_store(void) {
+    size_t size = 0, capacity = 4096;
+    char *text = (char *)malloc(capacity);
+    char line[JOURNAL_SCHEDULE_LENGTH + 512];
+
+    text[0] = '\0';
+    for (int f = 0; f < store.folder_count; f++) {
+        Folder *folder = &store.folders[f];
+        int length;
+
+        store_materialize(&store, f);
+        for (int i = -1; i < folder->task_count; i++) {
+            if (i < 0) {
+                length = snprintf(line, sizeof(line), "list %u %s\n", (unsigned)folder->id,
+                                  store_text(&store, folder->name));
+            } else {
+                const Task *task = store_task(&store, folder, i);
+                const TodoRecurrence *rule = store_task_rule(&store, task);
+                char schedule[JOURNAL_SCHEDULE_LENGTH];
+
+                journal_format_schedule(task->deadline_day, rule ? rule : &no_rule, task->priority,
+                                        store_text(&store, task->tags), schedule);
+                length = snprintf(line, sizeof(line), "  %s|%s|%d\n", store_text(&store, task->description), schedule,
+                                  task->completed);
+            }
+            while (size + (size_t)length + 1 > capacity) {
+                capacity *= 2;
+                text = (char *)realloc(text, capacity);
+            }
+            memcpy(text + size, line, (size_t)length + 1);
+            size += (size_t)length;
+        }
+    }
+    return text;
+}
+
+// As the program's RecordChange() does it
+static int record(TodoHistory *history, int op, uint32_t folder_id, int task_index, const char *text,
+                  const char *deadline) {
+    TodoJournalEntry entry;
+    TodoHistoryCommand *command = NULL;
+
+    entry.op = op;
+    entry.folder_id = folder_id;
+    entry.task_index = task_index;
+    entry.text[0] = text;
+    entry.text[1] = deadline;
+    if (!history_add(&command, &store, &entry)) return 0;
+    history_prepare(history, &store, command);
+    if (!apply_entries(&applier, &entry, 1)) {
+        history_free_command(command);
+        return 0;
+    }
+    history_push(history, command);
+    return 1;
+}
+
+static int random_open_task(const Folder *folder) {
+    for (int tries = 0; tries < 8 && folder->task_count > 0; tries++) {
+        int row = (int)(next_random() % (unsigned)folder->task_count);
+
+        if (!store_task(&store, folder, row)->completed) return row;
+    }
+    return -1;
+}
+
+// One random change made through the history. With short_lists, no list
+// comes or goes and none grows past SHORT_LIST tasks.
+static int random_change(TodoHistory *history, int32_t today, int short_lists) {
+    unsigned kind = next_random() % 100;
+    int index = (int)(next_random() % (unsigned)store.folder_count);
+    Folder *folder = &store.folders[index];
+    char schedule[JOURNAL_SCHEDULE_LENGTH];
+    char deadline[DATE_TEXT_LENGTH];
+    int row;
+
+    store_materialize(&store, index);
+    if (kind < 5 && store.folder_count < 6 && !short_lists) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "List %u", (unsigned)store.next_folder_id);
+        return record(history, JOURNAL_CREATE_LIST, store.next_folder_id, -1, name, NULL);
+    }
+    if (kind < 8 && store.folder_count > 2 && !short_lists) {
+        return record(history, JOURNAL_DELETE_LIST, folder->id, -1, NULL, NULL);
+    }
+    if (kind < 20) {
+        TodoBatch *batch = batch_begin(&store);
+        int changes = 1 + (int)(next_random() % 6);
+
+        if (batch == NULL) return 0;
+        for (int i = 0; i < changes && folder->task_count > 0; i++) {
+            row = (int)(next_random() % (unsigned)folder->task_count);
+            if (next_random() % 2) {
+                batch_complete_task(batch, index, row);
+            } else {
+                batch_delete_task(batch, index, row);
+            }
+        }
+        batch_add_task(batch, index, descriptions[next_random() % 5], today + (int32_t)(next_random() % 5),
+                       PRIORITY_NONE, "", NULL);
+        return batch_commit(batch, history, apply_entries, &applier);
+    }
+    if (folder->task_count == 0 || (kind < 55 && (!short_lists || folder->task_count < SHORT_LIST))) {
+        TodoRecurrence rule = no_rule;
+        int32_t day = next_random() % 6 == 0 ? DATE_NONE : today + (int32_t)(next_random() % 10);
+
+        if (day != DATE_NONE && next_random() % 4 == 0) {
+            rule.unit = RECUR_WEEKLY;
+            rule.interval = 1;
+            rule.start = day;
+            rule.until = DATE_NONE;
+        }
+        journal_format_schedule(day, &rule, (int)(next_random() % 4), tag_sets[next_random() % 4], schedule);
+        return record(history, JOURNAL_ADD_TASK, folder->id, -1, descriptions[next_random() % 5], schedule);
+    }
+    if (kind < 70) {
+        row = random_open_task(folder);
+        if (row < 0) return 1;
+        date_format(store_task(&store, folder, row)->deadline_day, deadline);
+        return record(history, JOURNAL_COMPLETE_TASK, folder->id, row,
+                      store_text(&store, store_task(&store, folder, row)->description), deadline);
+    }
+    row = (int)(next_random() % (unsigned)folder->task_count);
+    if (kind < 80) {
+        const Task *task = store_task(&store, folder, row);
+
+        journal_format_schedule(task->deadline_day, &no_rule, PRIORITY_NONE, tag_sets[next_random() % 4], schedule);
+        return record(history, JOURNAL_TAG_TASK, folder->id, row, store_text(&store, task->description), schedule);
+    }
+    date_format(store_task(&store, folder, row)->deadline_day, deadline);
+    return record(history, JOURNAL_DELETE_TASK, folder->id, row,
+                  store_text(&store, store_task(&store, folder, row)->description), deadline);
+}
+
+static void free_states(char **states, int count) {
+    for (int i = 0; i < count; i++) {
+        free(states[i]);
+    }
+}
+
+// Make CHANGES changes, keeping the state after each in states[1..]
+static int make_changes(TodoHistory *history, char **states, int32_t today, int short_lists) {
+    store_init(&store);
+    CHECK(store_create_folder(&store, 0, "Home") >= 0);
+    CHECK(store_create_folder(&store, 0, "Work") >= 0);
+    states[0] = dump_store();
+    for (int i = 1; i <= CHANGES; i++) {
+        int calls = applier.calls;
+
+        // Some picks have nothing to change
+        while (applier.calls == calls) {
+            CHECK(random_change(history, today, short_lists));
+        }
+        states[i] = dump_store();
+    }
+    return 0;
+}
+
+// Undo everything one step at a time, then redo it all
+static int test_undo_redo_each(void) {
+    static char *states[CHANGES + 1];
+    TodoHistory *history = history_create(64 * 1024 * 1024);
+    int32_t today = date_from_civil(2024, 2, 27);
+
+    CHECK(history != NULL);
+    if (make_changes(history, states, today, 0) != 0) return 1;
+    CHECK(history_undo_count(history) == CHANGES);
+    for (int i = CHANGES; i > 0; i--) {
+        char *state;
+
+        CHECK(history_undo(history, apply_entries, &applier));
+        state = dump_store();
+        if (strcmp(state, states[i - 1]) != 0) {
+            fprintf(stderr, "undo to step %d:\n%s\nexpected:\n%s\n", i - 1, state, states[i - 1]);
+            free(state);
+            return 1;
+        }
+        free(state);
+    }
+    CHECK(!history_can_undo(history));
+    for (int i = 1; i <= CHANGES; i++) {
+        char *state;
+
+        CHECK(history_redo(history, apply_entries, &applier));
+        state = dump_store();
+        CHECK(strcmp(state, states[i]) == 0);
+        free(state);
+    }
+    CHECK(!history_can_redo(history));
+
+    history_destroy(history);
+    store_release(&store);
+    free_states(states, CHANGES + 1);
+    return 0;
+}
+
+// Undoing many steps at once lands on the right state. The lists stay
+// short, so the long jumps restore snapshots.
+static int test_undo_many(void) {
+    static char *states[CHANGES + 1];
+    static const int jumps[] = { 3, 150, 1, 70, 100 };
+    TodoHistory *history = history_create(64 * 1024 * 1024);
+    int32_t today = date_from_civil(2023, 12, 30);
+    int step = CHANGES;
+
+    CHECK(history != NULL);
+    if (make_changes(history, states, today, 1) != 0) return 1;
+    for (size_t j = 0; j < sizeof(jumps) / sizeof(jumps[0]); j++) {
+        char *state;
+
+        CHECK(history_undo_many(history, &store, jumps[j], apply_entries, &applier));
+        step -= jumps[j];
+        CHECK(history_undo_count(history) == step);
+        state = dump_store();
+        CHECK(strcmp(state, states[step]) == 0);
+        free(state);
+        if (j == 1) {
+            // Redo from a restored snapshot, then come back
+            CHECK(history_redo(history, apply_entries, &applier));
+            state = dump_store();
+            CHECK(strcmp(state, states[step + 1]) == 0);
+            free(state);
+            CHECK(history_undo(history, apply_entries, &applier));
+        }
+    }
+
+    // A new change after undoing drops the redo steps
+    while (history_can_redo(history)) {
+        CHECK(random_change(history, today, 1));
+    }
+    CHECK(history_undo_count(history) == step + 1);
+    CHECK(history_undo_many(history, &store, 1000, apply_entries, &applier));
+    CHECK(history_undo_count(history) == 0);
+    {
+        char *state = dump_store();
+
+        CHECK(strcmp(state, states[0]) == 0);
+        free(state);
+    }
+
+    history_destroy(history);
+    store_release(&store);
+    free_states(states, CHANGES + 1);
+    return 0;
+}
+
+// Old steps and snapshots are forgotten to stay in the budget; the rest
+// still undo to the right states
+static int test_budget(void) {
+    static char *states[CHANGES + 1];
+    TodoHistory *history = history_create(48 * 1024);
+    int32_t today = date_from_civil(2024, 1, 31);
+    int kept;
+    char *state;
+
+    CHECK(history != NULL);
+    if (make_changes(history, states, today, 1) != 0) return 1;
+    kept = history_undo_count(history);
+    CHECK(kept > HISTORY_SNAPSHOT_INTERVAL && kept < CHANGES);
+    CHECK(history_memory(history) <= 48 * 1024);
+    CHECK(history_undo_many(history, &store, kept - 5, apply_entries, &applier));
+    state = dump_store();
+    CHECK(strcmp(state, states[CHANGES - kept + 5]) == 0);
+    free(state);
+    CHECK(history_undo_many(history, &store, 5, apply_entries, &applier));
+    CHECK(!history_can_undo(history));
+    state = dump_store();
+    CHECK(strcmp(state, states[CHANGES - kept]) == 0);
+    free(state);
+
+    history_destroy(history);
+    store_release(&store);
+    free_states(states, CHANGES + 1);
+    return 0;
+}
+
+// Many changes to a short list: undoing them all puts the list back from
+// the oldest snapshot instead of replaying each step
+static int test_snapshot_saves_replay(void) {
+    TodoHistory *history = history_create(64 * 1024 * 1024);
+    int32_t today = date_from_civil(2024, 6, 1);
+    char deadline[DATE_TEXT_LENGTH];
+    char *before, *after;
+    long entries;
+
+    CHECK(history != NULL);
+    store_init(&store);
+    CHECK(store_create_folder(&store, 0, "Long") >= 0);
+    for (int i = 0; i < 10; i++) {
+        CHECK(store_add_task(&store, 0, descriptions[i % 5], today + i % 7));
+    }
+    before = dump_store();
+    for (int i = 0; i < 5 * HISTORY_SNAPSHOT_INTERVAL; i++) {
+        const Folder *folder = &store.folders[0];
+        int row = i % folder->task_count;
+
+        date_format(store_task(&store, folder, row)->deadline_day, deadline);
+        if (i % 2) {
+            CHECK(record(history, JOURNAL_DELETE_TASK, folder->id, row,
+                         store_text(&store, store_task(&store, folder, row)->description), deadline));
+        } else {
+            CHECK(record(history, JOURNAL_ADD_TASK, folder->id, -1, "Extra", deadline));
+        }
+    }
+    entries = applier.entries;
+    CHECK(history_undo_many(history, &store, history_undo_count(history), apply_entries, &applier));
+    after = dump_store();
+    CHECK(strcmp(before, after) == 0);
+    // The snapshot after the first interval puts the list back in about 20
+    // entries; only the steps before it are replayed one by one
+    CHECK(applier.entries - entries <= HISTORY_SNAPSHOT_INTERVAL + 30);
+    free(before);
+    free(after);
+
+    history_destroy(history);
+    store_release(&store);
+    return 0;
+}
+
+// Undoing a list deletion whose tasks cannot be put back leaves no
+// half-restored list behind, and a retry restores it once
+static int test_failed_undo_rolls_back(void) {
+    TodoHistory *history = history_create(HISTORY_DEFAULT_BUDGET);
+    int32_t today = date_from_civil(2024, 2, 29);
+    char schedule[JOURNAL_SCHEDULE_LENGTH];
+    char *kept, *deleted, *state;
+    uint32_t id;
+
+    CHECK(history != NULL);
+    store_init(&store);
+    CHECK(store_create_folder(&store, 0, "Keep") >= 0);
+    CHECK(store_create_folder(&store, 0, "Errands") >= 0);
+    id = store.folders[1].id;
+    for (int i = 0; i < 6; i++) {
+        journal_format_schedule(today + i, &no_rule, i % 4, tag_sets[i % 4], schedule);
+        CHECK(record(history, JOURNAL_ADD_TASK, id, -1, descriptions[i % 5], schedule));
+    }
+    kept = dump_store();
+    CHECK(record(history, JOURNAL_DELETE_LIST, id, -1, NULL, NULL));
+    deleted = dump_store();
+
+    // The list comes back, then putting its tasks back fails
+    applier.fail_at = applier.calls + 2;
+    CHECK(!history_undo(history, apply_entries, &applier));
+    applier.fail_at = 0;
+    state = dump_store();
+    CHECK(strcmp(state, deleted) == 0);
+    CHECK(history_can_undo(history) && !history_can_redo(history));
+    free(state);
+
+    CHECK(history_undo(history, apply_entries, &applier));
+    state = dump_store();
+    CHECK(strcmp(state, kept) == 0);
+    CHECK(store.folder_count == 2);
+    free(state);
+
+    // Redo fails on the deletion, and nothing changes
+    applier.fail_at = applier.calls + 1;
+    CHECK(!history_redo(history, apply_entries, &applier));
+    applier.fail_at = 0;
+    state = dump_store();
+    CHECK(strcmp(state, kept) == 0);
+    free(state);
+
+    free(kept);
+    free(deleted);
+    history_destroy(history);
+    store_release(&store);
+    return 0;
+}
+
+int main(void) {
+    seed_random(4242);
+    RUN(test_undo_redo_each);
+    RUN(test_undo_many);
+    RUN(test_budget);
+    RUN(test_snapshot_saves_replay);
+    RUN(test_failed_undo_rolls_back);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,302 @@
+// Tests for CSV and JSON Lines import and export (todo_io.c).
+//
+// Hand-written files, each starting with a byte order mark, hold rows with
+// quoted commas, doubled quotes, line breaks inside quotes, escapes,
+// surrogate pairs, CRLF endings and blank lines, next to bad rows of
+// every kind. The good rows must come in as written and each bad row must
+// be reported once, at the line it starts on, and skipped. A store of
+// awkward text, repeating tasks, priorities and tags is exported in both
+// formats and read back, on the caller's thread and on workers, over more
+// than one chunk; it must come back the same.
+//
+//   gcc -std=c99 -Wall -pthread -I. -o test_io tests/test_io.c todo_io.c todo_core.c todo_format.c
+//       todo_slots.c todo_sort.c todo_recur.c todo_lz.c todo_journal.c todo_thread.c todo_date.c
+//       todo_trace.c todo_strings.c todo_tags.c todo_bitmap.c
+//   ./test_io
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "todo_core.h"
+#include "todo_date.h"
+#include "todo_io.h"
+#include "todo_recur.h"
+#include "todo_test.h"
+
+#define MAX_ERRORS 32
+#define BIG_TASKS 40000     // Past IO_CHUNK_SIZE once exported
+
+typedef struct {
+    uint64_t lines[MAX_ERRORS];
+    int errors[MAX_ERRORS];
+    int count;
+} Errors;
+
+static void note_error(void *context, uint64_t line, int error) {
+    Errors *errors = (Errors *)context;
+
+    if (errors->count < MAX_ERRORS) {
+        errors->lines[errors->count] = line;
+        errors->errors[errors->count] = error;
+    }
+    errors->count++;
+}
+
+// Import text into store through a temporary file
+static int import_text(TodoStore *store, const char *text, size_t length, int format, int threads,
+                       const char *default_list, Errors *errors, TodoImportReport *report) {
+    TodoImportOptions options;
+    FILE *file = tmpfile();
+    int status;
+
+    if (file == NULL || fwrite(text, 1, length, file) != length) return -1;
+    rewind(file);
+    memset(&options, 0, sizeof(options));
+    memset(errors, 0, sizeof(*errors));
+    options.format = format;
+    options.threads = threads;
+    options.default_list = default_list;
+    options.on_error = note_error;
+    options.context = errors;
+    status = io_import(store, file, &options, report);
+    fclose(file);
+    return status;
+}
+
+// The task of the named list with this description, or NULL
+static const Task *find_task(const TodoStore *store, const char *list, const char *description) {
+    for (int f = 0; f < store->folder_count; f++) {
+        const Folder *folder = &store->folders[f];
+
+        if (strcmp(store_text(store, folder->name), list) != 0) continue;
+        for (int row = 0; row < folder->task_count; row++) {
+            const Task *task = store_task(store, folder, row);
+
+            if (strcmp(store_text(store, task->description), description) == 0) return task;
+        }
+    }
+    return NULL;
+}
+
+static int expect_errors(const Errors *errors, const uint64_t *lines, const int *kinds, int count) {
+    CHECK(errors->count == count);
+    for (int i = 0; i < count; i++) {
+        if (errors->lines[i] != lines[i] || errors->errors[i] != kinds[i]) {
+            fprintf(stderr, "error %d: line %llu, %s\n", i, (unsigned long long)errors->lines[i],
+                    io_row_error_text(errors->errors[i]));
+            return 1;
+        }
+    }
+    return 0;
+}
+
+static int test_csv_rows(void) {
+    static TodoStore store;
+    static const char text[] =
+        "\xEF\xBB\xBF" "priority,Task,extra,List,due,done,tags\r\n"             // 1
+        "high,\"Buy milk, eggs\",x,Home,2024-03-01,no,\"#Work, @home\"\r\n"      // 2
+        ",\"Say \"\"hi\"\"\",,Home,,yes,\r\n"                                    // 3
+        "\r\n"                                                                   // 4
+        "low,\"Two\nlines\",,Work,2024-03-02,0\r\n"                              // 5, 6
+        ",\"closed\"then text,,Home,,,\r\n"                                      // 7
+        ",Bad date,,Home,2024-02-30,,\r\n"                                       // 8
+        ",Bad done,,Home,,maybe,\r\n"                                            // 9
+        ",,,Home,,,\r\n"                                                         // 10
+        "urgent,Bad priority,,Home,,,\r\n"                                       // 11
+        ",Bad tags,,Home,,,a!b\r\n"                                              // 12
+        ",Bad \xFF text,,Home,,,\r\n"                                            // 13
+        ",No list,,,,,\r\n"                                                      // 14
+        ",\"Unterminated,,Home,,,\r\n";                                          // 15
+    static const uint64_t lines[] = { 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+    static const int kinds[] = { IO_ROW_MALFORMED, IO_ROW_DEADLINE, IO_ROW_COMPLETED, IO_ROW_NO_DESCRIPTION,
+                                 IO_ROW_PRIORITY, IO_ROW_TAGS, IO_ROW_ENCODING, IO_ROW_NO_LIST, IO_ROW_MALFORMED };
+    Errors errors;
+    TodoImportReport report;
+    const Task *task;
+
+    for (int threads = 0; threads <= 2; threads += 2) {
+        store_init(&store);
+        CHECK(import_text(&store, text, sizeof(text) - 1, IO_CSV, threads, NULL, &errors, &report) == IO_OK);
+        if (expect_errors(&errors, lines, kinds, 9) != 0) return 1;
+        CHECK(report.rows == 12 && report.imported == 3 && report.rejected == 9 && report.lists_created == 2);
+        CHECK(report.bytes == sizeof(text) - 1);
+
+        task = find_task(&store, "Home", "Buy milk, eggs");
+        CHECK(task != NULL && task->priority == PRIORITY_HIGH && !task->completed);
+        CHECK(task->deadline_day == date_from_civil(2024, 3, 1));
+        CHECK(strcmp(store_text(&store, task->tags), "home work") == 0);
+        task = find_task(&store, "Home", "Say \"hi\"");
+        CHECK(task != NULL && task->completed && task->deadline_day == DATE_NONE);
+        task = find_task(&store, "Work", "Two\nlines");
+        CHECK(task != NULL && task->priority == PRIORITY_LOW && task->deadline_day == date_from_civil(2024, 3, 2));
+        store_release(&store);
+    }
+
+    // Without a description column there is nothing to import
+    store_init(&store);
+    CHECK(import_text(&store, "list,deadline\nHome,2024-01-01\n", 30, IO_CSV, 0, NULL, &errors, &report) ==
+          IO_ERR_HEADER);
+    CHECK(store.folder_count == 0);
+    store_release(&store);
+    return 0;
+}
+
+static int test_jsonl_rows(void) {
+    static TodoStore store;
+    static const char text[] =
+        "\xEF\xBB\xBF{\"list\":\"Home\",\"description\":\"Quote \\\" and \\\\ slash\",\"deadline\":\"2024-04-01\","
+        "\"completed\":true,\"priority\":2}\n"                                               // 1
+        "{\"list\":\"Home\",\"task\":\"caf\\u00e9 \\ud83d\\ude00\",\"done\":false,"
+        "\"extra\":{\"nested\":[1,2,{\"a\":\"}\"}]},\"tags\":\"b a\"}\r\n"                    // 2
+        "{\"list\":\"Home\",\"description\":\"lone \\ud800 surrogate\",\"deadline\":null}\n" // 3
+        "\n"                                                                                 // 4
+        "{\"list\":\"Home\",\"description\":\"missing brace\"\n"                             // 5
+        "{\"list\":\"Home\",\"description\":\"trailing\"} junk\n"                            // 6
+        "{\"list\":\"Home\",\"description\":\"bad \\q escape\"}\n"                           // 7
+        "{\"list\":\"Home\",\"description\":\"bad date\",\"deadline\":\"2024-13-01\"}\n"     // 8
+        "{\"description\":\"no list\"}\n";                                                   // 9
+    static const uint64_t lines[] = { 5, 6, 7, 8, 9 };
+    static const int kinds[] = { IO_ROW_MALFORMED, IO_ROW_MALFORMED, IO_ROW_MALFORMED, IO_ROW_DEADLINE,
+                                 IO_ROW_NO_LIST };
+    Errors errors;
+    TodoImportReport report;
+    const Task *task;
+
+    for (int threads = 0; threads <= 2; threads += 2) {
+        store_init(&store);
+        CHECK(import_text(&store, text, sizeof(text) - 1, IO_JSONL, threads, NULL, &errors, &report) == IO_OK);
+        if (expect_errors(&errors, lines, kinds, 5) != 0) return 1;
+        CHECK(report.rows == 8 && report.imported == 3 && report.lists_created == 1);
+
+        task = find_task(&store, "Home", "Quote \" and \\ slash");
+        CHECK(task != NULL && task->completed && task->priority == PRIORITY_MEDIUM);
+        CHECK(task->deadline_day == date_from_civil(2024, 4, 1));
+        task = find_task(&store, "Home", "caf\xC3\xA9 \xF0\x9F\x98\x80");
+        CHECK(task != NULL && !task->completed && strcmp(store_text(&store, task->tags), "a b") == 0);
+        task = find_task(&store, "Home", "lone \xEF\xBF\xBD surrogate");
+        CHECK(task != NULL && task->deadline_day == DATE_NONE);
+        store_release(&store);
+    }
+
+    // Rows without a list go to the default one when there is one
+    store_init(&store);
+    CHECK(import_text(&store, text, sizeof(text) - 1, IO_JSONL, 0, "Inbox", &errors, &report) == IO_OK);
+    CHECK(errors.count == 4 && report.imported == 4 && find_task(&store, "Inbox", "no list") != NULL);
+    store_release(&store);
+    return 0;
+}
+
+static const char *const awkward[] = {
+    "plain", "comma, inside", "\"quoted\"", "say \"\"twice\"\"", "line\nbreak", "crlf\r\nbreak",
+    " leading space", "trailing space ", "tab\there", "back\\slash", "\x01 control", "caf\xC3\xA9",
+    "\xF0\x9F\x98\x80 emoji", "{\"json\": [1]}", "#not a tag"
+};
+static const char *const tag_sets[] = { "", "home", "home work", "zeta \xC3\xA4rger" };
+
+static void fill_store(TodoStore *store, int tasks_per_list) {
+    static const char *const names[] = { "Home", "Work, mostly", "\"Quoted\" list", "Caf\xC3\xA9" };
+    int32_t today = date_from_civil(2024, 6, 1);
+    size_t kinds = sizeof(awkward) / sizeof(awkward[0]);
+
+    for (int f = 0; f < 4; f++) {
+        store_create_folder(store, 0, names[f]);
+        for (int i = 0; i < tasks_per_list; i++) {
+            char description[96];
+            TodoRecurrence rule;
+            int32_t deadline = next_random() % 4 == 0 ? DATE_NONE : today - 100 + (int32_t)(next_random() % 200);
+
+            memset(&rule, 0, sizeof(rule));
+            if (deadline != DATE_NONE && next_random() % 5 == 0) {
+                rule.unit = (uint8_t)(RECUR_DAILY + next_random() % 3);
+                rule.interval = (uint16_t)(1 + next_random() % 4);
+                rule.start = deadline;
+                rule.until = next_random() % 2 ? DATE_NONE : deadline + 90;
+            }
+            snprintf(description, sizeof(description), "%s %d", awkward[next_random() % kinds], i);
+            store_insert_task(store, f, -1, description, deadline, rule.unit == RECUR_NONE && next_random() % 3 == 0,
+                              (int)(next_random() % 4), tag_sets[next_random() % 4], rule.unit ? &rule : NULL);
+        }
+    }
+}
+
+static int same_task(const TodoStore *a, const Task *x, const TodoStore *b, const Task *y) {
+    const TodoRecurrence *r = store_task_rule(a, x);
+    const TodoRecurrence *s = store_task_rule(b, y);
+
+    CHECK(strcmp(store_text(a, x->description), store_text(b, y->description)) == 0);
+    CHECK(x->deadline_day == y->deadline_day && x->completed == y->completed && x->priority == y->priority);
+    CHECK(strcmp(store_text(a, x->tags), store_text(b, y->tags)) == 0);
+    CHECK((r == NULL) == (s == NULL));
+    if (r != NULL) {
+        CHECK(r->unit == s->unit && r->interval == s->interval && r->start == s->start && r->until == s->until);
+    }
+    return 0;
+}
+
+static int test_round_trip(void) {
+    static TodoStore original, imported;
+    int sizes[2] = { 40, BIG_TASKS / 4 };
+
+    for (int s = 0; s < 2; s++) {
+        store_init(&original);
+        fill_store(&original, sizes[s]);
+        for (int format = IO_CSV; format <= IO_JSONL; format++) {
+            FILE *file = tmpfile();
+            uint64_t rows;
+
+            CHECK(file != NULL);
+            CHECK(io_export(&original, file, format, &rows) == IO_OK && rows == (uint64_t)(4 * sizes[s]));
+            CHECK(s == 0 || ftell(file) > IO_CHUNK_SIZE);
+            for (int threads = 0; threads <= 3; threads += 3) {
+                TodoImportOptions options;
+                TodoImportReport report;
+                Errors errors;
+
+                rewind(file);
+                memset(&options, 0, sizeof(options));
+                memset(&errors, 0, sizeof(errors));
+                options.format = format;
+                options.threads = threads;
+                options.on_error = note_error;
+                options.context = &errors;
+                store_init(&imported);
+                CHECK(io_import(&imported, file, &options, &report) == IO_OK);
+                CHECK(errors.count == 0 && report.imported == rows && report.lists_created == 4);
+
+                CHECK(imported.folder_count == original.folder_count);
+                for (int f = 0; f < original.folder_count; f++) {
+                    const Folder *a = &original.folders[f];
+                    const Folder *b = &imported.folders[f];
+
+                    CHECK(strcmp(store_text(&original, a->name), store_text(&imported, b->name)) == 0);
+                    CHECK(a->task_count == b->task_count);
+                    for (int row = 0; row < a->task_count; row++) {
+                        if (same_task(&original, store_task(&original, a, row), &imported,
+                                      store_task(&imported, b, row)) != 0) {
+                            fprintf(stderr, "format %d, %d threads, list %d, row %d\n", format, threads, f, row);
+                            return 1;
+                        }
+                    }
+                }
+                store_release(&imported);
+            }
+            fclose(file);
+        }
+        store_release(&original);
+    }
+    return 0;
+}
+
+int main(void) {
+    seed_random(14);
+    RUN(test_csv_rows);
+    RUN(test_jsonl_rows);
+    RUN(test_round_trip);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,719 @@
+// Tests for the operation journal (todo_journal.c).
+//
+// The writer thread runs on a fake clock that only moves when the test
+// moves it, so it can be checked when each write happens: queued records
+// wait for edits to pause for JOURNAL_QUIET_MS, but never longer than
+// JOURNAL_MAX_DELAY_MS, and go out in one write. A failed write is retried
+// JOURNAL_RETRY_MS later without losing or repeating a record. Once the
+// log passes JOURNAL_COMPACT_BYTES it is folded into a new checkpoint,
+// written to a temporary file and renamed over the data file, which then
+// holds every task the log did. A change that does not apply is not
+// logged. Records carry a CRC32C, and logs of older, CRC-32 records still
+// replay.
+//
+// A log of random changes, single and batched, replays to the store that
+// made it. Cut short at every byte, or with a byte changed, it replays up
+// to the last whole record, leaving out a batch that lost any member;
+// loading it cuts the file there, so the next record follows on.
+//
+//   gcc -std=c99 -Wall -pthread -I. -o test_journal tests/test_journal.c todo_journal.c todo_batch.c
+//       todo_history.c todo_core.c todo_format.c todo_slots.c todo_sort.c todo_recur.c todo_lz.c
+//       todo_thread.c todo_date.c todo_trace.c todo_strings.c todo_tags.c todo_bitmap.c
+//   ./test_journal
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/resource.h>
+#endif
+
+#include "todo_batch.h"
+#include "todo_core.h"
+#include "todo_date.h"
+#include "todo_format.h"
+#include "todo_journal.h"
+#include "todo_test.h"
+#include "todo_thread.h"
+
+#define DATA_PATH "test_journal.dat"
+#define LOG_PATH "test_journal.jnl"
+#define SEGMENT_PATH "test_journal.jnl.1"
+#define COMPACT_PATH "test_journal.dat.compact"
+#define LIST_ID 7
+
+// The writer reads the clock from its own thread
+static TodoMutex clock_lock;
+static uint64_t fake_now;
+
+static uint64_t fake_clock(void *context) {
+    uint64_t now;
+
+    (void)context;
+    todo_mutex_lock(&clock_lock);
+    now = fake_now;
+    todo_mutex_unlock(&clock_lock);
+    return now;
+}
+
+static void set_clock(TodoJournal *journal, uint64_t now) {
+    todo_mutex_lock(&clock_lock);
+    fake_now = now;
+    todo_mutex_unlock(&clock_lock);
+    journal_wake(journal);
+}
+
+static void pause_ms(uint64_t ms) {
+    TodoMutex mutex;
+    TodoCond cond;
+
+    todo_mutex_init(&mutex);
+    todo_cond_init(&cond);
+    todo_mutex_lock(&mutex);
+    todo_cond_wait(&cond, &mutex, ms);
+    todo_mutex_unlock(&mutex);
+    todo_cond_destroy(&cond);
+    todo_mutex_destroy(&mutex);
+}
+
+// -1 for a file that does not exist
+static long file_size(const char *path) {
+    FILE *file = fopen(path, "rb");
+    long size;
+
+    if (file == NULL) return -1;
+    size = fseek(file, 0, SEEK_END) == 0 ? ftell(file) : -1;
+    fclose(file);
+    return size;
+}
+
+// Give the writer five seconds to bring the log to size
+static int log_reaches(long size) {
+    for (int i = 0; i < 500 && file_size(LOG_PATH) != size; i++) pause_ms(10);
+    return file_size(LOG_PATH) == size;
+}
+
+// Give the writer a moment, in which it must not write
+static int log_stays(long size) {
+    pause_ms(50);
+    return file_size(LOG_PATH) == size;
+}
+
+static void remove_files(void) {
+    remove(DATA_PATH);
+    remove(LOG_PATH);
+    remove(SEGMENT_PATH);
+    remove(COMPACT_PATH);
+}
+
+// A journal on no saved data, at time now, holding one empty list
+static TodoJournal *open_journal(TodoStore *store, uint64_t now) {
+    TodoJournal *journal;
+    TodoJournalEntry entry = { JOURNAL_CREATE_LIST, LIST_ID, -1, { "List", NULL } };
+
+    remove_files();
+    store_init(store);
+    fake_now = now;
+    journal = journal_create(DATA_PATH);
+    if (journal == NULL) return NULL;
+    journal_set_clock(journal, fake_clock, NULL);
+    if (journal_load(journal, store) != TODOFMT_ERR_MISSING || !journal_record(journal, store, &entry) ||
+        journal_sync(journal) != TODOFMT_OK) {
+        journal_destroy(journal, store);
+        return NULL;
+    }
+    return journal;
+}
+
+// Record adding a task to the list; returns its record's size, 0 if it failed
+static long add_task(TodoJournal *journal, TodoStore *store, const char *text) {
+    TodoJournalEntry entry = { JOURNAL_ADD_TASK, LIST_ID, -1, { text, "" } };
+
+    if (!journal_record(journal, store, &entry)) return 0;
+    return (long)(sizeof(TodoJournalRecord) + strlen(text));
+}
+
+// The log replayed on its own holds the list with tasks tasks
+static int log_holds(int tasks) {
+    static TodoStore replayed;
+    uint64_t valid_size;
+
+    store_init(&replayed);
+    CHECK(journal_replay(LOG_PATH, &replayed, &valid_size) == tasks + 1);
+    CHECK((long)valid_size == file_size(LOG_PATH));
+    CHECK(replayed.folder_count == 1 && replayed.folders[0].task_count == tasks);
+    store_release(&replayed);
+    return 0;
+}
+
+static int test_quiet_delay(void) {
+    static TodoStore store;
+    TodoJournal *journal = open_journal(&store, 1000);
+    long written, queued;
+
+    CHECK(journal != NULL);
+    written = file_size(LOG_PATH);
+    CHECK(written > 0);
+
+    // Each edit restarts the pause, and the records wait for it
+    queued = add_task(journal, &store, "first");
+    CHECK(log_stays(written));
+    set_clock(journal, 1000 + JOURNAL_QUIET_MS - 1);
+    CHECK(log_stays(written));
+    queued += add_task(journal, &store, "second");
+    set_clock(journal, 1000 + JOURNAL_QUIET_MS);
+    CHECK(log_stays(written));
+    set_clock(journal, 1000 + 2 * JOURNAL_QUIET_MS - 2);
+    CHECK(log_stays(written));
+
+    // Then both go out together
+    set_clock(journal, 1000 + 2 * JOURNAL_QUIET_MS - 1);
+    CHECK(log_reaches(written + queued));
+    CHECK(journal_status(journal) == TODOFMT_OK);
+    CHECK(file_size(DATA_PATH) == -1);
+    if (log_holds(2) != 0) return 1;
+
+    journal_destroy(journal, &store);
+    store_release(&store);
+    remove_files();
+    return 0;
+}
+
+static int test_max_delay(void) {
+    static TodoStore store;
+    const uint64_t start = 5000;
+    TodoJournal *journal = open_journal(&store, start);
+    long written, queued = 0;
+    int tasks = 0;
+
+    CHECK(journal != NULL);
+    written = file_size(LOG_PATH);
+
+    // Edits that never pause are written JOURNAL_MAX_DELAY_MS after the first
+    for (uint64_t now = start; now < start + JOURNAL_MAX_DELAY_MS; now += JOURNAL_QUIET_MS - 50) {
+        set_clock(journal, now);
+        queued += add_task(journal, &store, "busy");
+        tasks++;
+        CHECK(log_stays(written));
+    }
+    set_clock(journal, start + JOURNAL_MAX_DELAY_MS - 1);
+    CHECK(log_stays(written));
+    set_clock(journal, start + JOURNAL_MAX_DELAY_MS);
+    CHECK(log_reaches(written + queued));
+    if (log_holds(tasks) != 0) return 1;
+
+    journal_destroy(journal, &store);
+    store_release(&store);
+    remove_files();
+    return 0;
+}
+
+// A change that does not apply returns 0 and leaves nothing in the log,
+// and the records after it are numbered as if it had never been tried
+static int test_failed_change(void) {
+    static TodoStore store;
+    TodoJournal *journal = open_journal(&store, 1000);
+    TodoJournalEntry missing = { JOURNAL_COMPLETE_TASK, LIST_ID, 3, { "missing", "" } };
+    TodoJournalEntry batch[2] = {
+        { JOURNAL_ADD_TASK, LIST_ID, -1, { "batched", "" } },
+        { JOURNAL_DELETE_TASK, LIST_ID + 1, 0, { "missing", "" } },
+    };
+    uint64_t seq;
+    long written, queued;
+
+    CHECK(journal != NULL);
+    written = file_size(LOG_PATH);
+    seq = store.journal_seq;
+    queued = add_task(journal, &store, "kept");
+    CHECK(queued > 0);
+    CHECK(!journal_record(journal, &store, &missing));
+    CHECK(!journal_record_batch(journal, &store, batch, 2));
+    CHECK(store.journal_seq == seq + 1 && store.folders[0].task_count == 1);
+    queued += add_task(journal, &store, "also kept");
+    CHECK(journal_sync(journal) == TODOFMT_OK);
+    CHECK(file_size(LOG_PATH) == written + queued);
+    if (log_holds(2) != 0) return 1;
+
+    journal_destroy(journal, &store);
+    store_release(&store);
+    remove_files();
+    return 0;
+}
+
+// Records are written as JOURNAL_RECORD_VERSION with a CRC32C, and a log
+// of version 0 records, checksummed with CRC-32, still replays
+static int test_record_versions(void) {
+    static TodoStore store, replayed;
+    TodoJournal *journal = open_journal(&store, 1000);
+    TodoJournalRecord record;
+    unsigned char bytes[256];
+    long size;
+    FILE *file;
+
+    CHECK(journal != NULL);
+    journal_destroy(journal, &store);
+    store_release(&store);
+    size = file_size(LOG_PATH);
+    CHECK(size > 0 && size <= (long)sizeof(bytes));
+    file = fopen(LOG_PATH, "rb");
+    CHECK(file != NULL && fread(bytes, 1, (size_t)size, file) == (size_t)size);
+    fclose(file);
+    memcpy(&record, bytes, sizeof(record));
+    CHECK(record.size == (uint32_t)size);
+    CHECK(record.op == ((uint32_t)JOURNAL_CREATE_LIST | (uint32_t)JOURNAL_RECORD_VERSION << 24));
+    memset(bytes + offsetof(TodoJournalRecord, checksum), 0, sizeof(record.checksum));
+    CHECK(todofmt_crc32c(0, bytes, record.size) == record.checksum);
+
+    // The same record as an older version wrote it
+    record.op = JOURNAL_CREATE_LIST;
+    record.checksum = 0;
+    memcpy(bytes, &record, sizeof(record));
+    record.checksum = journal_record_checksum(bytes, record.size);
+    CHECK(record.checksum != todofmt_crc32c(0, bytes, record.size));
+    memcpy(bytes, &record, sizeof(record));
+    file = fopen(LOG_PATH, "wb");
+    CHECK(file != NULL && fwrite(bytes, 1, record.size, file) == record.size);
+    fclose(file);
+    store_init(&replayed);
+    CHECK(journal_replay(LOG_PATH, &replayed, NULL) == 1);
+    CHECK(replayed.folder_count == 1 && replayed.folders[0].id == LIST_ID);
+    store_release(&replayed);
+
+    // Not with the other checksum
+    record.checksum = 0;
+    memcpy(bytes, &record, sizeof(record));
+    record.checksum = todofmt_crc32c(0, bytes, record.size);
+    memcpy(bytes, &record, sizeof(record));
+    file = fopen(LOG_PATH, "wb");
+    CHECK(file != NULL && fwrite(bytes, 1, record.size, file) == record.size);
+    fclose(file);
+    store_init(&replayed);
+    CHECK(journal_replay(LOG_PATH, &replayed, NULL) == 0 && replayed.folder_count == 0);
+    store_release(&replayed);
+    remove_files();
+    return 0;
+}
+
+#ifndef _WIN32
+// A write that fails, here for the file size limit, stays queued and is
+// tried again JOURNAL_RETRY_MS later, along with what was queued since
+static int test_retry(void) {
+    static TodoStore store;
+    TodoJournal *journal = open_journal(&store, 1000);
+    struct rlimit limit, saved;
+    long written, queued;
+    uint64_t failed_at = 1000 + JOURNAL_QUIET_MS;
+
+    CHECK(journal != NULL);
+    written = file_size(LOG_PATH);
+    CHECK(getrlimit(RLIMIT_FSIZE, &saved) == 0);
+    signal(SIGXFSZ, SIG_IGN);
+    limit = saved;
+    limit.rlim_cur = (rlim_t)written;
+    CHECK(setrlimit(RLIMIT_FSIZE, &limit) == 0);
+
+    queued = add_task(journal, &store, "refused");
+    set_clock(journal, failed_at);
+    for (int i = 0; i < 500 && journal_status(journal) == TODOFMT_OK; i++) pause_ms(10);
+    CHECK(setrlimit(RLIMIT_FSIZE, &saved) == 0);
+    CHECK(journal_status(journal) == TODOFMT_ERR_IO);
+    CHECK(file_size(LOG_PATH) == written);
+
+    set_clock(journal, failed_at + 100);
+    queued += add_task(journal, &store, "queued behind it");
+    set_clock(journal, failed_at + JOURNAL_RETRY_MS - 1);
+    CHECK(log_stays(written));
+    CHECK(journal_status(journal) == TODOFMT_ERR_IO);
+
+    set_clock(journal, failed_at + JOURNAL_RETRY_MS);
+    CHECK(log_reaches(written + queued));
+    for (int i = 0; i < 500 && journal_status(journal) != TODOFMT_OK; i++) pause_ms(10);
+    CHECK(journal_status(journal) == TODOFMT_OK);
+    if (log_holds(2) != 0) return 1;
+
+    journal_destroy(journal, &store);
+    store_release(&store);
+    remove_files();
+    return 0;
+}
+#endif
+
+static char *read_file(const char *path, long *size) {
+    FILE *file = fopen(path, "rb");
+    char *bytes;
+
+    *size = file_size(path);
+    if (file == NULL || *size < 0) {
+        if (file) fclose(file);
+        return NULL;
+    }
+    bytes = (char *)malloc((size_t)*size + 1);
+    if (bytes != NULL && fread(bytes, 1, (size_t)*size, file) != (size_t)*size) {
+        free(bytes);
+        bytes = NULL;
+    }
+    fclose(file);
+    return bytes;
+}
+
+// The data file holds the list with the live store's tasks, in order
+static int checkpoint_matches(const char *path, const TodoStore *store) {
+    static TodoStore saved;
+    TodoDataFile *file;
+    const Folder *live = &store->folders[0];
+    const Folder *folder;
+
+    CHECK(todofmt_open(path, &file) == TODOFMT_OK);
+    store_init(&saved);
+    store_attach(&saved, file);
+    CHECK(saved.folder_count == 1 && saved.folders[0].id == LIST_ID && store_materialize(&saved, 0));
+    folder = &saved.folders[0];
+    CHECK(folder->task_count == live->task_count);
+    for (int row = 0; row < folder->task_count; row++) {
+        const Task *task = store_task(&saved, folder, row);
+        const Task *expected = store_task(store, live, row);
+
+        CHECK(strcmp(store_text(&saved, task->description), store_text(store, expected->description)) == 0);
+        CHECK(task->deadline_day == expected->deadline_day && task->completed == expected->completed);
+    }
+    store_release(&saved);
+    return 0;
+}
+
+static int test_compaction(void) {
+    static TodoStore store;
+    TodoJournal *journal = open_journal(&store, 1000);
+    uint64_t now = 1000;
+    long written, before_size, after_size;
+    char text[200];
+    char *before, *after;
+    int tasks = 0;
+
+    CHECK(journal != NULL);
+    memset(text, 'x', sizeof(text) - 1);
+    text[sizeof(text) - 1] = '\0';
+
+    // Below JOURNAL_COMPACT_BYTES the log only grows
+    written = file_size(LOG_PATH);
+    while (written + 4 * (long)(sizeof(TodoJournalRecord) + strlen(text)) < JOURNAL_COMPACT_BYTES) {
+        for (int i = 0; i < 4; i++, tasks++) written += add_task(journal, &store, text);
+        now += JOURNAL_QUIET_MS;
+        set_clock(journal, now);
+        CHECK(log_reaches(written));
+    }
+    CHECK(file_size(DATA_PATH) == -1 && file_size(SEGMENT_PATH) == -1);
+
+    // The write that takes it past moves the log aside as the segment and
+    // folds it into a checkpoint, installed when the store next polls
+    for (int i = 0; i < 8; i++, tasks++) add_task(journal, &store, text);
+    now += JOURNAL_QUIET_MS;
+    set_clock(journal, now);
+    for (int i = 0; i < 500 && store.backing == NULL; i++) {
+        pause_ms(10);
+        journal_poll(journal, &store);
+    }
+    CHECK(store.backing != NULL);
+    CHECK(file_size(LOG_PATH) == 0);
+    CHECK(file_size(SEGMENT_PATH) == -1 && file_size(COMPACT_PATH) == -1);
+    CHECK(store.folders[0].task_count == tasks);
+    if (checkpoint_matches(DATA_PATH, &store) != 0) return 1;
+
+    // Compaction writes only its output file; the data file is replaced
+    // by a rename afterwards
+    written = add_task(journal, &store, "after the checkpoint");
+    CHECK(journal_sync(journal) == TODOFMT_OK && file_size(LOG_PATH) == written);
+    before = read_file(DATA_PATH, &before_size);
+    CHECK(before != NULL);
+    CHECK(journal_compact(DATA_PATH, LOG_PATH, COMPACT_PATH, TODOFMT_PLAIN) == TODOFMT_OK);
+    after = read_file(DATA_PATH, &after_size);
+    CHECK(after != NULL && after_size == before_size && memcmp(before, after, (size_t)before_size) == 0);
+    free(before);
+    free(after);
+    if (checkpoint_matches(COMPACT_PATH, &store) != 0) return 1;
+
+    journal_destroy(journal, &store);
+    store_release(&store);
+    remove_files();
+    return 0;
+}
+
+// Both stores hold the same lists with the same tasks, in order
+static int same_stores(const TodoStore *a, const TodoStore *b) {
+    CHECK(a->folder_count == b->folder_count);
+    for (int f = 0; f < a->folder_count; f++) {
+        const Folder *x = &a->folders[f];
+        const Folder *y = &b->folders[f];
+
+        CHECK(x->id == y->id && strcmp(store_text(a, x->name), store_text(b, y->name)) == 0);
+        CHECK(x->task_count == y->task_count);
+        for (int row = 0; row < x->task_count; row++) {
+            const Task *s = store_task(a, x, row);
+            const Task *t = store_task(b, y, row);
+
+            CHECK(strcmp(store_text(a, s->description), store_text(b, t->description)) == 0);
+            CHECK(s->deadline_day == t->deadline_day && s->completed == t->completed);
+            CHECK(s->priority == t->priority);
+            CHECK(strcmp(store_text(a, s->tags), store_text(b, t->tags)) == 0);
+        }
+    }
+    return 0;
+}
+
+typedef struct {
+    TodoJournal *journal;
+    TodoStore *store;
+} JournalTarget;
+
+static int record_batch(void *context, const TodoJournalEntry *entries, int count) {
+    JournalTarget *target = (JournalTarget *)context;
+
+    return journal_record_batch(target->journal, target->store, entries, count);
+}
+
+static const char *const random_tags[] = { "", "home", "work", "home work" };
+
+static int32_t random_deadline(void) {
+    return next_random() % 4 == 0 ? DATE_NONE : date_from_civil(2025, 1, 1) + (int32_t)(next_random() % 60);
+}
+
+// Record adding a task with a random deadline, priority and tags
+static int add_random_task(TodoJournal *journal, TodoStore *store, uint32_t folder_id) {
+    static const TodoRecurrence no_rule;
+    char text[32], schedule[JOURNAL_SCHEDULE_LENGTH];
+    TodoJournalEntry entry = { JOURNAL_ADD_TASK, folder_id, -1, { text, schedule } };
+
+    snprintf(text, sizeof(text), "task %u", next_random() % 1000);
+    journal_format_schedule(random_deadline(), &no_rule, (int)(next_random() % 4), random_tags[next_random() % 4],
+                            schedule);
+    return journal_record(journal, store, &entry);
+}
+
+// Record completing or deleting the task at row, found by its text
+static int change_task(TodoJournal *journal, TodoStore *store, int index, int row, int op) {
+    const Folder *folder = &store->folders[index];
+    const Task *task = store_task(store, folder, row);
+    char deadline[DATE_TEXT_LENGTH];
+    TodoJournalEntry entry = { op, folder->id, row, { store_text(store, task->description), deadline } };
+
+    date_format(task->deadline_day, deadline);
+    return journal_record(journal, store, &entry);
+}
+
+// Up to six changes to the two lists, committed as one batch
+static int random_batch(TodoJournal *journal, TodoStore *store) {
+    JournalTarget target = { journal, store };
+    TodoBatch *batch = batch_begin(store);
+    int changes = 1 + (int)(next_random() % 6);
+    int used[2][6];
+    int used_count[2] = { 0, 0 };
+
+    if (batch == NULL) return 0;
+    for (int i = 0; i < changes; i++) {
+        int index = (int)(next_random() % 2);
+        int task_count = store->folders[index].task_count;
+        unsigned kind = next_random() % 6;
+        int row, seen = 0;
+
+        if (kind == 0 || task_count == 0) {
+            batch_add_task(batch, index, "batched", random_deadline(), PRIORITY_NONE, "work", NULL);
+            continue;
+        }
+        // A task is changed once per batch
+        row = (int)(next_random() % (unsigned)task_count);
+        for (int u = 0; u < used_count[index]; u++) seen |= used[index][u] == row;
+        if (seen) continue;
+        used[index][used_count[index]++] = row;
+        if (kind == 1) {
+            batch_complete_task(batch, index, row);
+        } else if (kind == 2) {
+            batch_reopen_task(batch, index, row);
+        } else if (kind == 3) {
+            batch_delete_task(batch, index, row);
+        } else if (kind == 4) {
+            batch_tag_task(batch, index, row, random_tags[next_random() % 4]);
+        } else {
+            batch_move_task(batch, index, row, 1 - index);
+        }
+    }
+    return batch_commit(batch, NULL, record_batch, &target);
+}
+
+// Random changes to two lists, one at a time and in batches, replay from
+// the log alone to the store that made them
+static int test_replay(void) {
+    static TodoStore store, replayed;
+    TodoJournal *journal = open_journal(&store, 1000);
+    TodoJournalEntry second = { JOURNAL_CREATE_LIST, LIST_ID + 1, -1, { "Second", NULL } };
+    uint64_t valid_size;
+
+    CHECK(journal != NULL);
+    CHECK(journal_record(journal, &store, &second));
+    for (int step = 0; step < 300; step++) {
+        unsigned kind = next_random() % 8;
+        int index = (int)(next_random() % 2);
+        int task_count = store.folders[index].task_count;
+        int row = task_count > 0 ? (int)(next_random() % (unsigned)task_count) : -1;
+
+        if (kind < 3 || row < 0) {
+            CHECK(add_random_task(journal, &store, store.folders[index].id));
+        } else if (kind < 5) {
+            if (!store_task(&store, &store.folders[index], row)->completed) {
+                CHECK(change_task(journal, &store, index, row, JOURNAL_COMPLETE_TASK));
+            }
+        } else if (kind < 6) {
+            CHECK(change_task(journal, &store, index, row, JOURNAL_DELETE_TASK));
+        } else {
+            CHECK(random_batch(journal, &store));
+        }
+    }
+    CHECK(journal_sync(journal) == TODOFMT_OK);
+    CHECK(file_size(DATA_PATH) == -1);
+
+    store_init(&replayed);
+    CHECK(journal_replay(LOG_PATH, &replayed, &valid_size) > 0);
+    CHECK((long)valid_size == file_size(LOG_PATH));
+    if (same_stores(&store, &replayed) != 0) return 1;
+    store_release(&replayed);
+
+    journal_destroy(journal, &store);
+    store_release(&store);
+    remove_files();
+    return 0;
+}
+
+static int write_file(const char *path, const char *bytes, long size) {
+    FILE *file = fopen(path, "wb");
+    int written;
+
+    if (file == NULL) return 0;
+    written = fwrite(bytes, 1, (size_t)size, file) == (size_t)size;
+    return fclose(file) == 0 && written;
+}
+
+// The log ends after each of count whole pieces: the list, three tasks, a
+// batch of two changes and one more task
+#define PIECES 6
+
+static const long records_after[PIECES] = { 1, 2, 3, 4, 6, 7 };
+static const int tasks_after[PIECES] = { 0, 1, 2, 3, 4, 5 };
+static const int completed_after[PIECES] = { 0, 0, 0, 0, 1, 1 };
+
+static int completed_tasks(const TodoStore *store) {
+    int completed = 0;
+
+    for (int row = 0; row < store->folders[0].task_count; row++) {
+        completed += store_task(store, &store->folders[0], row)->completed;
+    }
+    return completed;
+}
+
+// Replay the first size bytes of log, which end inside or after piece
+// whole, then load them behind a checkpoint of that replay, which must cut
+// the log to the whole pieces and append after them
+static int check_cut(const char *log, long size, const long ends[PIECES], int whole) {
+    static TodoStore replayed, loaded;
+    TodoJournal *journal;
+    uint64_t valid_size;
+    long appended;
+
+    remove_files();
+    CHECK(write_file(LOG_PATH, log, size));
+    store_init(&replayed);
+    CHECK(journal_replay(LOG_PATH, &replayed, &valid_size) >= 0);
+    CHECK((long)valid_size == ends[whole]);
+    CHECK(replayed.folder_count == 1 && replayed.folders[0].task_count == tasks_after[whole]);
+    CHECK(completed_tasks(&replayed) == completed_after[whole]);
+
+    // With every whole record in the checkpoint, loading replays nothing
+    // and so has nothing to compact
+    CHECK(todofmt_write(DATA_PATH, &replayed, TODOFMT_PLAIN) == TODOFMT_OK);
+    store_release(&replayed);
+    store_init(&loaded);
+    journal = journal_create(DATA_PATH);
+    CHECK(journal != NULL);
+    journal_set_clock(journal, fake_clock, NULL);
+    CHECK(journal_load(journal, &loaded) == TODOFMT_OK);
+    CHECK(file_size(LOG_PATH) == ends[whole]);
+    appended = add_task(journal, &loaded, "after the cut");
+    CHECK(appended > 0 && journal_sync(journal) == TODOFMT_OK);
+    CHECK(file_size(LOG_PATH) == ends[whole] + appended);
+    journal_destroy(journal, &loaded);
+    store_release(&loaded);
+
+    store_init(&replayed);
+    CHECK(journal_replay(LOG_PATH, &replayed, &valid_size) == records_after[whole] + 1);
+    CHECK((long)valid_size == ends[whole] + appended);
+    CHECK(replayed.folders[0].task_count == tasks_after[whole] + 1);
+    store_release(&replayed);
+    return 0;
+}
+
+static int test_torn_tail(void) {
+    static TodoStore store;
+    TodoJournal *journal = open_journal(&store, 1000);
+    TodoJournalEntry batch[2] = {
+        { JOURNAL_COMPLETE_TASK, LIST_ID, 0, { NULL, "" } },
+        { JOURNAL_ADD_TASK, LIST_ID, -1, { "four", "" } },
+    };
+    long ends[PIECES], size;
+    char *log;
+    int whole = 0;
+
+    CHECK(journal != NULL);
+    ends[0] = file_size(LOG_PATH);
+    ends[1] = ends[0] + add_task(journal, &store, "one");
+    ends[2] = ends[1] + add_task(journal, &store, "two");
+    ends[3] = ends[2] + add_task(journal, &store, "three");
+    batch[0].text[0] = store_text(&store, store_task(&store, &store.folders[0], 0)->description);
+    CHECK(journal_record_batch(journal, &store, batch, 2));
+    ends[4] = ends[3] + (long)(3 * sizeof(TodoJournalRecord) + strlen(batch[0].text[0]) + strlen("four"));
+    ends[5] = ends[4] + add_task(journal, &store, "five");
+    CHECK(journal_sync(journal) == TODOFMT_OK);
+    journal_destroy(journal, &store);
+    store_release(&store);
+    log = read_file(LOG_PATH, &size);
+    CHECK(log != NULL && size == ends[PIECES - 1]);
+
+    // Cut at every byte: a torn record, or any part of the batch, is left out
+    for (long cut = ends[0]; cut <= size; cut++) {
+        while (whole + 1 < PIECES && ends[whole + 1] <= cut) whole++;
+        if (check_cut(log, cut, ends, whole) != 0) {
+            fprintf(stderr, "cut at %ld\n", cut);
+            return 1;
+        }
+    }
+
+    // A changed byte ends the log at the record before it, here one in the
+    // batch's first member and then one in the second task
+    log[ends[3] + sizeof(TodoJournalRecord) + 12] ^= 0x20;
+    if (check_cut(log, size, ends, 3) != 0) return 1;
+    log[ends[1] + 10] ^= 0x01;
+    if (check_cut(log, size, ends, 1) != 0) return 1;
+
+    free(log);
+    remove_files();
+    return 0;
+}
+
+int main(void) {
+    seed_random(2);
+    todo_mutex_init(&clock_lock);
+    RUN(test_quiet_delay);
+    RUN(test_max_delay);
+    RUN(test_failed_change);
+    RUN(test_record_versions);
+#ifndef _WIN32
+    RUN(test_retry);
+#endif
+    RUN(test_compaction);
+    RUN(test_replay);
+    RUN(test_torn_tail);
+    todo_mutex_destroy(&clock_lock);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,288 @@
+// Tests for compiled task queries (todo_query.c).
+//
+// Queries over every field, with and, or, not and grouping, are run over
+// the query index and checked against a scan that tests each task in turn,
+// over all folders and each one, on two different days, and again after
+// tasks are completed, retagged, added and deleted. Malformed queries must
+// be refused.
+//
+//   gcc -std=c99 -Wall -pthread -I. -o test_query tests/test_query.c todo_query.c todo_core.c todo_format.c
+//       todo_slots.c todo_sort.c todo_recur.c todo_lz.c todo_journal.c todo_thread.c todo_date.c
+//       todo_trace.c todo_strings.c todo_tags.c todo_bitmap.c
+//   ./test_query
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "todo_core.h"
+#include "todo_date.h"
+#include "todo_query.h"
+#include "todo_slots.h"
+#include "todo_tags.h"
+#include "todo_test.h"
+
+#define TASKS_PER_FOLDER 2500
+
+// A task as the scan sees it
+typedef struct {
+    const char *folder;
+    const char *text;
+    const char *tags;
+    size_t tags_length;
+    int32_t deadline;
+    int done;
+    int repeats;
+    int priority;
+    int32_t today;
+} TaskView;
+
+static int contains(const char *text, const char *part) {
+    size_t length = strlen(part);
+
+    for (; *text != '\0'; text++) {
+        size_t i = 0;
+
+        while (i < length && tolower((unsigned char)text[i]) == tolower((unsigned char)part[i])) i++;
+        if (i == length) return 1;
+    }
+    return length == 0;
+}
+
+static int same_name(const char *a, const char *b) {
+    return strlen(a) == strlen(b) && contains(a, b);
+}
+
+static int has_tag(const TaskView *t, const char *name) {
+    return tags_contains(t->tags, t->tags_length, name, strlen(name));
+}
+
+static int dated(const TaskView *t) {
+    return t->deadline != DATE_NONE;
+}
+
+static int example(const TaskView *t) {
+    return same_name(t->folder, "Ops") && dated(t) && t->deadline < t->today + 7 && !t->done &&
+           contains(t->text, "deploy");
+}
+
+static int overdue(const TaskView *t) {
+    return !t->done && dated(t) && t->deadline < t->today;
+}
+
+static int undated_or_high(const TaskView *t) {
+    return !dated(t) || t->priority == PRIORITY_HIGH;
+}
+
+static int not_tomorrow(const TaskView *t) {
+    return t->deadline != t->today + 1;
+}
+
+static int this_week_at_work(const TaskView *t) {
+    return dated(t) && t->deadline >= t->today && t->deadline <= t->today + 6 && (has_tag(t, "work") ||
+           has_tag(t, "urgent")) && !has_tag(t, "waiting");
+}
+
+static int ops_lists_repeating(const TaskView *t) {
+    return contains(t->folder, "ops") && t->repeats;
+}
+
+static int fixed_range(const TaskView *t) {
+    return dated(t) && t->deadline > date_from_civil(2024, 2, 28) && t->deadline <= date_from_civil(2024, 3, 31) &&
+           t->priority >= PRIORITY_LOW && t->priority != PRIORITY_MEDIUM;
+}
+
+static int text_words(const TaskView *t) {
+    return (contains(t->text, "Call mum") || contains(t->text, "RENT")) && !same_name(t->folder, "Home");
+}
+
+static int not_grouped(const TaskView *t) {
+    return !(t->done || (dated(t) && t->deadline <= t->today - 3)) && !contains(t->text, "report");
+}
+
+static int everything_open(const TaskView *t) {
+    return !t->done;
+}
+
+static int umlaut_tag(const TaskView *t) {
+    return has_tag(t, "ärger") && contains(t->text, "Überweisung");
+}
+
+static int nothing(const TaskView *t) {
+    (void)t;
+    return 0;
+}
+
+static const struct {
+    const char *text;
+    int (*matches)(const TaskView *task);
+} queries[] = {
+    { "folder:\"Ops\" and due < today+7 and not done and text~\"deploy\"", example },
+    { "overdue", overdue },
+    { "due = none | priority = high", undated_or_high },
+    { "due != tomorrow", not_tomorrow },
+    { "due >= today due <= today+6 (#work or @urgent) -#waiting", this_week_at_work },
+    { "folder~ops and repeats", ops_lists_repeating },
+    { "due > 2024-02-28 & due <= 2024-03-31 & priority >= low & priority != 2", fixed_range },
+    { "(text:\"call MUM\" or text~rent) and not list:home", text_words },
+    { "not (done or due <= today-3) !text~report", not_grouped },
+    { "open", everything_open },
+    { "#ärger text~Überweisung", umlaut_tag },
+    { "folder:Nowhere or due < 1000-01-01", nothing },
+};
+
+static const char *const folder_names[] = { "Ops", "Home", "Ops Team", "ops" };
+static const char *const descriptions[] = {
+    "deploy the site", "Deploy API", "Call mum", "pay rent", "Write the report", "Überweisung prüfen", "gym"
+};
+static const char *const tag_sets[] = { "", "work", "home", "urgent work", "waiting work", "ärger", "today urgent" };
+
+static void random_task(TodoStore *store, int folder, int32_t today) {
+    unsigned r = next_random();
+    int32_t deadline = r % 6 == 0 ? DATE_NONE : today - 40 + (int32_t)(next_random() % 80);
+    TodoRecurrence rule;
+
+    memset(&rule, 0, sizeof(rule));
+    if (deadline != DATE_NONE && r % 11 == 0) {
+        rule.unit = RECUR_WEEKLY;
+        rule.interval = 1;
+        rule.start = deadline;
+        rule.until = DATE_NONE;
+    }
+    store_insert_task(store, folder, -1, descriptions[next_random() % 7], deadline, !rule.unit && r % 4 == 0,
+                      (int)(next_random() % 4), tag_sets[next_random() % 7], rule.unit ? &rule : NULL);
+}
+
+static int compare_handles(const void *a, const void *b) {
+    uint32_t x = SLOTS_INDEX(*(const uint32_t *)a);
+    uint32_t y = SLOTS_INDEX(*(const uint32_t *)b);
+
+    return x < y ? -1 : x > y;
+}
+
+static int check_queries(const TodoStore *store, const TodoQueryIndex *index, int32_t today) {
+    static uint32_t expected[16 * TASKS_PER_FOLDER];
+    TodoQueryResult result;
+
+    memset(&result, 0, sizeof(result));
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        TodoQuery *query;
+
+        CHECK(query_compile(queries[q].text, &query) == QUERY_OK);
+        for (int scope = -1; scope < store->folder_count; scope++) {
+            size_t want = 0;
+
+            for (int f = 0; f < store->folder_count; f++) {
+                const Folder *folder = &store->folders[f];
+
+                if (scope >= 0 && f != scope) continue;
+                for (int row = 0; row < folder->task_count; row++) {
+                    const Task *task = store_task(store, folder, row);
+                    TaskView view;
+
+                    view.folder = store_text(store, folder->name);
+                    view.text = store_text(store, task->description);
+                    view.tags = store_text(store, task->tags);
+                    view.tags_length = task->tags.length;
+                    view.deadline = task->deadline_day;
+                    view.done = task->completed;
+                    view.repeats = task->rule != 0;
+                    view.priority = task->priority;
+                    view.today = today;
+                    if (queries[q].matches(&view)) expected[want++] = task->id;
+                }
+            }
+            qsort(expected, want, sizeof(uint32_t), compare_handles);
+            CHECK(query_run(index, query, scope < 0 ? 0 : store->folders[scope].id, today, &result));
+            if (result.count != want || memcmp(result.tasks, expected, want * sizeof(uint32_t)) != 0) {
+                fprintf(stderr, "query \"%s\", folder %d: %zu tasks, expected %zu\n", queries[q].text, scope,
+                        result.count, want);
+                return 1;
+            }
+            for (size_t i = 0; i < result.count && scope >= 0; i++) {
+                CHECK(query_task_folder(index, result.tasks[i]) == store->folders[scope].id);
+            }
+        }
+        query_free(query);
+    }
+    query_result_free(&result);
+    return 0;
+}
+
+static int test_queries(void) {
+    static TodoStore store;
+    int32_t today = date_from_civil(2024, 3, 1);
+    TodoQueryIndex *index;
+
+    store_init(&store);
+    for (int f = 0; f < 4; f++) {
+        CHECK(store_create_folder(&store, 0, folder_names[f]) == f);
+        for (int i = 0; i < TASKS_PER_FOLDER; i++) random_task(&store, f, today);
+    }
+    index = query_create(&store);
+    CHECK(index != NULL);
+    if (check_queries(&store, index, today) != 0) return 1;
+    if (check_queries(&store, index, today + 10) != 0) return 1;
+
+    // The index follows every change to the store
+    for (int i = 0; i < 3000; i++) {
+        int f = (int)(next_random() % 4);
+        int count = store.folders[f].task_count;
+        int row = count ? (int)(next_random() % (unsigned)count) : 0;
+        unsigned pick = next_random() % 5;
+
+        if (pick == 0 && count) {
+            store_complete_task(&store, f, row);
+        } else if (pick == 1 && count) {
+            store_reopen_task(&store, f, row, -1);
+        } else if (pick == 2 && count) {
+            CHECK(store_tag_task(&store, f, row, tag_sets[next_random() % 7]));
+        } else if (pick == 3 && count) {
+            CHECK(store_delete_task(&store, f, row));
+        } else {
+            random_task(&store, f, today);
+        }
+    }
+    if (check_queries(&store, index, today) != 0) return 1;
+    CHECK(store_delete_folder(&store, 0));
+    if (check_queries(&store, index, today) != 0) return 1;
+
+    query_destroy(index);
+    store_release(&store);
+    return 0;
+}
+
+static int test_malformed(void) {
+    static const char *const bad[] = {
+        "", "(done", "done)", "done or", "and done", "due < someday", "due < today+", "due ~ today",
+        "due < none", "priority > 5", "priority = urgent", "folder < Ops", "text < x", "folder:\"Ops",
+        "#", "not", "colour:red", "due < 2024-02-30",
+    };
+    TodoQuery *query;
+
+    for (size_t i = 0; i < sizeof(bad) / sizeof(bad[0]); i++) {
+        if (query_compile(bad[i], &query) != QUERY_ERR_SYNTAX) {
+            fprintf(stderr, "query \"%s\" compiled\n", bad[i]);
+            return 1;
+        }
+        CHECK(query == NULL);
+    }
+    CHECK(query_compile("due < today+7 and open", &query) == QUERY_OK);
+    CHECK(query_length(query) == 4);
+    query_free(query);
+    CHECK(query_is_query("due<today") && query_is_query("folder:Ops") && !query_is_query("pay rent"));
+    return 0;
+}
+
+int main(void) {
+    seed_random(1234);
+    RUN(test_malformed);
+    RUN(test_queries);
+    printf("ok\n");
+    return 0;
+}
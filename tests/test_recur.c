@@ -0,0 +1,234 @@
+// Tests for recurrence rules (todo_recur.c).
+//
+// Monthly rules must clamp to the end of short months and come back to the
+// start day after, in leap and common years alike. For random rules,
+// next, previous, first and expand are checked against occurrences listed
+// one by one from the calendar, and rules must survive a trip through text.
+//
+//   gcc -std=c99 -Wall -I. -o test_recur tests/test_recur.c todo_recur.c todo_date.c
+//   ./test_recur
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <string.h>
+
+#include "todo_date.h"
+#include "todo_recur.h"
+#include "todo_test.h"
+
+#define MAX_OCCURRENCES 4000
+
+static TodoRecurrence make_rule(int unit, int interval, int32_t start, int32_t until) {
+    TodoRecurrence rule;
+
+    memset(&rule, 0, sizeof(rule));
+    rule.unit = (uint8_t)unit;
+    rule.interval = (uint16_t)interval;
+    rule.start = start;
+    rule.until = until;
+    return rule;
+}
+
+static int leap(int year) {
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+static int month_length(int year, int month) {
+    static const int lengths[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+
+    return month == 2 && leap(year) ? 29 : lengths[month - 1];
+}
+
+// Every occurrence, counted out month by month or day by day
+static size_t list_occurrences(const TodoRecurrence *rule, int32_t *days, size_t max) {
+    int start_year, start_month, start_day;
+    size_t count = 0;
+
+    date_to_civil(rule->start, &start_year, &start_month, &start_day);
+    for (int64_t k = 0; count < max; k++) {
+        int64_t day;
+
+        if (rule->unit == RECUR_MONTHLY) {
+            int64_t months = (int64_t)start_month - 1 + k * rule->interval;
+            int year = start_year + (int)(months / 12);
+            int month = (int)(months % 12) + 1;
+            int day_of_month = start_day;
+
+            if (year > DATE_MAX_YEAR) break;
+            if (day_of_month > month_length(year, month)) day_of_month = month_length(year, month);
+            day = date_from_civil(year, month, day_of_month);
+        } else {
+            day = rule->start + k * rule->interval * (rule->unit == RECUR_WEEKLY ? 7 : 1);
+        }
+        if (day > DATE_LAST_DAY || (rule->until != DATE_NONE && day > rule->until)) break;
+        days[count++] = (int32_t)day;
+    }
+    return count;
+}
+
+static int32_t civil(const char *text) {
+    int32_t day = DATE_NONE;
+
+    date_parse(text, &day);
+    return day;
+}
+
+static int test_calendar(void) {
+    CHECK(date_is_leap_year(2024) && date_is_leap_year(2000) && date_is_leap_year(1600));
+    CHECK(!date_is_leap_year(2023) && !date_is_leap_year(1900) && !date_is_leap_year(2100));
+    CHECK(date_days_in_month(2024, 2) == 29 && date_days_in_month(2023, 2) == 28);
+    CHECK(date_days_in_month(2100, 2) == 28 && date_days_in_month(2000, 2) == 29);
+    CHECK(civil("2024-02-29") + 1 == civil("2024-03-01"));
+    CHECK(civil("2023-02-28") + 1 == civil("2023-03-01"));
+    CHECK(civil("2023-02-29") == DATE_NONE && civil("1900-02-29") == DATE_NONE);
+    return 0;
+}
+
+static int check_sequence(const TodoRecurrence *rule, const char *const *expected, size_t count) {
+    int32_t days[16];
+
+    CHECK(recur_expand(rule, rule->start, DATE_LAST_DAY, days, 16) == count);
+    for (size_t i = 0; i < count; i++) {
+        CHECK(days[i] == civil(expected[i]));
+        CHECK(i == 0 || recur_next(rule, days[i - 1]) == days[i]);
+        CHECK(i == 0 || recur_previous(rule, days[i]) == days[i - 1]);
+    }
+    return 0;
+}
+
+static int test_month_ends(void) {
+    static const char *const from_january_31[] = {
+        "2024-01-31", "2024-02-29", "2024-03-31", "2024-04-30", "2024-05-31", "2024-06-30"
+    };
+    static const char *const from_january_31_common[] = {
+        "2023-01-31", "2023-02-28", "2023-03-31", "2023-04-30"
+    };
+    static const char *const leap_day_yearly[] = {
+        "2024-02-29", "2025-02-28", "2026-02-28", "2027-02-28", "2028-02-29", "2029-02-28"
+    };
+    static const char *const quarterly_from_november_30[] = {
+        "2099-11-30", "2100-02-28", "2100-05-30", "2100-08-30", "2100-11-30", "2101-02-28"
+    };
+    static const char *const weekly_over_leap_day[] = {
+        "2024-02-22", "2024-02-29", "2024-03-07"
+    };
+    TodoRecurrence rule;
+
+    rule = make_rule(RECUR_MONTHLY, 1, civil("2024-01-31"), civil("2024-06-30"));
+    if (check_sequence(&rule, from_january_31, 6) != 0) return 1;
+    rule = make_rule(RECUR_MONTHLY, 1, civil("2023-01-31"), civil("2023-04-30"));
+    if (check_sequence(&rule, from_january_31_common, 4) != 0) return 1;
+    rule = make_rule(RECUR_MONTHLY, 12, civil("2024-02-29"), civil("2029-12-31"));
+    if (check_sequence(&rule, leap_day_yearly, 6) != 0) return 1;
+    rule = make_rule(RECUR_MONTHLY, 3, civil("2099-11-30"), civil("2101-03-01"));
+    if (check_sequence(&rule, quarterly_from_november_30, 6) != 0) return 1;
+    rule = make_rule(RECUR_WEEKLY, 1, civil("2024-02-22"), civil("2024-03-13"));
+    if (check_sequence(&rule, weekly_over_leap_day, 3) != 0) return 1;
+
+    // Between a clamped occurrence and the next one
+    rule = make_rule(RECUR_MONTHLY, 1, civil("2024-01-31"), DATE_NONE);
+    CHECK(recur_first(&rule, civil("2024-02-01")) == civil("2024-02-29"));
+    CHECK(recur_next(&rule, civil("2024-02-29")) == civil("2024-03-31"));
+    CHECK(recur_previous(&rule, civil("2024-03-30")) == civil("2024-02-29"));
+    CHECK(recur_previous(&rule, civil("2024-01-31")) == DATE_NONE);
+
+    // The calendar ends
+    rule = make_rule(RECUR_MONTHLY, 1, civil("9999-10-31"), DATE_NONE);
+    CHECK(recur_next(&rule, civil("9999-11-30")) == civil("9999-12-31"));
+    CHECK(recur_next(&rule, civil("9999-12-31")) == DATE_NONE);
+    return 0;
+}
+
+static int test_against_listing(void) {
+    static int32_t days[MAX_OCCURRENCES], expanded[MAX_OCCURRENCES];
+
+    for (int round = 0; round < 400; round++) {
+        int unit = RECUR_DAILY + (int)(next_random() % 3);
+        int interval = 1 + (int)(next_random() % (round % 4 == 0 ? RECUR_MAX_INTERVAL : 14));
+        int32_t start = date_from_civil(1990 + (int)(next_random() % 60), 1 + (int)(next_random() % 12),
+                                        25 + (int)(next_random() % 4));
+        int32_t until = round % 3 == 0 ? DATE_NONE : start + (int32_t)(next_random() % 6000);
+        TodoRecurrence rule = make_rule(unit, interval, start, until);
+        size_t count = list_occurrences(&rule, days, MAX_OCCURRENCES);
+        int32_t span_end = count < MAX_OCCURRENCES ? days[count - 1] + 100 : days[count - 1] + 1;
+
+        CHECK(recur_valid(&rule) && count > 0);
+        CHECK(recur_expand(&rule, start - 50, span_end, expanded, MAX_OCCURRENCES) == count);
+        CHECK(memcmp(days, expanded, count * sizeof(int32_t)) == 0);
+        for (int probe = 0; probe < 50; probe++) {
+            int32_t day = start - 40 + (int32_t)(next_random() % (unsigned)(span_end - start + 40));
+            size_t after = 0;
+
+            while (after < count && days[after] <= day) after++;
+            if (after < count || count < MAX_OCCURRENCES) {
+                CHECK(recur_next(&rule, day) == (after < count ? days[after] : DATE_NONE));
+                CHECK(recur_first(&rule, day) ==
+                      (after > 0 && days[after - 1] == day ? day : after < count ? days[after] : DATE_NONE));
+            }
+            if (after > 0 && days[after - 1] == day) after--;
+            CHECK(recur_previous(&rule, day) == (after > 0 ? days[after - 1] : DATE_NONE));
+        }
+    }
+    return 0;
+}
+
+static int test_text(void) {
+    int32_t due = civil("2024-02-29");
+    TodoRecurrence rule, parsed;
+    char text[RECUR_TEXT_LENGTH], schedule[RECUR_SCHEDULE_LENGTH];
+    int32_t deadline;
+
+    for (int round = 0; round < 300; round++) {
+        int unit = RECUR_DAILY + (int)(next_random() % 3);
+        int32_t start = due - (int32_t)(next_random() % 800);
+        int32_t until = round % 2 ? DATE_NONE : due + (int32_t)(next_random() % 800);
+        int32_t deadline_day;
+
+        rule = make_rule(unit, 1 + (int)(next_random() % (round % 5 ? 6 : RECUR_MAX_INTERVAL)), start, until);
+        deadline_day = recur_first(&rule, start + (int32_t)(next_random() % 900));
+        if (deadline_day == DATE_NONE) continue;
+        recur_format(&rule, deadline_day, text);
+        CHECK(recur_parse(text, deadline_day, &parsed));
+        CHECK(memcmp(&rule, &parsed, sizeof(rule)) == 0);
+        recur_format_schedule(deadline_day, &rule, schedule);
+        CHECK(recur_parse_schedule(schedule, &deadline, &parsed));
+        CHECK(deadline == deadline_day && memcmp(&rule, &parsed, sizeof(rule)) == 0);
+    }
+
+    CHECK(recur_parse("Every 3 Months from 2023-11-30", due, &parsed));
+    CHECK(parsed.unit == RECUR_MONTHLY && parsed.interval == 3 && parsed.start == civil("2023-11-30"));
+    CHECK(recur_parse("every month", due, &parsed) && parsed.interval == 1);
+    CHECK(recur_parse("  ", due, &parsed) && parsed.unit == RECUR_NONE);
+    CHECK(recur_parse_schedule("", &deadline, &parsed) && deadline == DATE_NONE && parsed.unit == RECUR_NONE);
+
+    // The deadline must be an occurrence: February 29 is one for rules kept
+    // on the 29th to the 31st, not for one kept on the 28th
+    CHECK(recur_parse("monthly from 2024-01-30", due, &parsed));
+    CHECK(recur_parse("monthly from 2024-01-31", due, &parsed));
+    CHECK(!recur_parse("monthly from 2024-01-28", due, &parsed));
+    CHECK(!recur_parse("weekly from 2024-02-23", due, &parsed));
+    CHECK(!recur_parse("daily from 2024-03-01", due, &parsed));
+    CHECK(!recur_parse("daily until 2024-02-28", due, &parsed));
+    CHECK(!recur_parse("daily", DATE_NONE, &parsed));
+    CHECK(!recur_parse("every 0 days", due, &parsed));
+    CHECK(!recur_parse("every 1000 days", due, &parsed));
+    CHECK(!recur_parse("every 2 day", due, &parsed));
+    CHECK(!recur_parse("daily from 2024-02-30", due, &parsed));
+    CHECK(!recur_parse("daily until 2024-03-01 until 2024-03-02", due, &parsed));
+    CHECK(!recur_parse("fortnightly", due, &parsed));
+    CHECK(!recur_parse_schedule("2023-02-29 daily", &deadline, &parsed));
+    return 0;
+}
+
+int main(void) {
+    seed_random(31);
+    RUN(test_calendar);
+    RUN(test_month_ends);
+    RUN(test_against_listing);
+    RUN(test_text);
+    printf("ok\n");
+    return 0;
+}
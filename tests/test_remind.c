@@ -0,0 +1,158 @@
+// Tests for deadline reminders (todo_remind.c).
+//
+// Reminders for lists that were never loaded are scheduled from the data
+// file's deadline columns; they must fire at the same times, for the same
+// deadlines, as those of the same lists fully loaded, name rows holding
+// that deadline, and give way to the tasks' own reminders when a list
+// loads, is changed or is deleted.
+//
+//   gcc -std=c99 -Wall -pthread -I. -o test_remind tests/test_remind.c todo_remind.c todo_core.c todo_format.c
+//       todo_slots.c todo_sort.c todo_recur.c todo_lz.c todo_journal.c todo_thread.c todo_date.c
+//       todo_trace.c todo_strings.c todo_tags.c todo_bitmap.c
+//   ./test_remind
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "todo_core.h"
+#include "todo_date.h"
+#include "todo_format.h"
+#include "todo_remind.h"
+#include "todo_test.h"
+
+#define FOLDERS 5
+#define TASKS_PER_FOLDER 500
+#define DAY_MS 86400000ull
+
+static uint64_t fake_now;
+
+static uint64_t fake_clock(void *context) {
+    (void)context;
+    return fake_now;
+}
+
+typedef struct {
+    TodoReminder reminders[FOLDERS * TASKS_PER_FOLDER * 2];
+    size_t count;
+} Fired;
+
+static void on_fired(void *context, const TodoReminder *reminder) {
+    Fired *fired = (Fired *)context;
+
+    fired->reminders[fired->count++] = *reminder;
+}
+
+static int compare_fired(const void *a, const void *b) {
+    const TodoReminder *x = (const TodoReminder *)a;
+    const TodoReminder *y = (const TodoReminder *)b;
+
+    if (x->when != y->when) return x->when < y->when ? -1 : 1;
+    if (x->folder_id != y->folder_id) return x->folder_id < y->folder_id ? -1 : 1;
+    if (x->deadline != y->deadline) return x->deadline < y->deadline ? -1 : 1;
+    return x->days_before - y->days_before;
+}
+
+// Both runs fired the same reminders, apart from how they name the task
+static int same_fired(Fired *a, Fired *b) {
+    CHECK(a->count == b->count);
+    qsort(a->reminders, a->count, sizeof(TodoReminder), compare_fired);
+    qsort(b->reminders, b->count, sizeof(TodoReminder), compare_fired);
+    for (size_t i = 0; i < a->count; i++) CHECK(compare_fired(&a->reminders[i], &b->reminders[i]) == 0);
+    return 0;
+}
+
+static int test_unloaded_lists(void) {
+    static TodoStore original, lazy, full;
+    static Fired from_sections, from_tasks;
+    const char *path = "test_remind.dat";
+    const int days_before[2] = { 1, 0 };
+    int32_t today = date_from_civil(2024, 2, 28);
+
+    store_init(&original);
+    for (int f = 0; f < FOLDERS; f++) {
+        CHECK(store_create_folder(&original, 0, "List") == f);
+        for (int i = 0; i < TASKS_PER_FOLDER; i++) {
+            int32_t deadline = next_random() % 5 == 0 ? DATE_NONE : today - 5 + (int32_t)(next_random() % 30);
+
+            CHECK(store_insert_task(&original, f, -1, "Task", deadline, next_random() % 3 == 0, 0, "", NULL));
+        }
+    }
+
+    for (int encoding = TODOFMT_PLAIN; encoding <= TODOFMT_COLUMNAR; encoding++) {
+        TodoDataFile *lazy_file, *full_file;
+        TodoReminders *lazy_reminders, *full_reminders;
+
+        from_sections.count = from_tasks.count = 0;
+        fake_now = (uint64_t)today * DAY_MS + 10 * 3600000ull;
+        CHECK(todofmt_write(path, &original, encoding) == TODOFMT_OK);
+        CHECK(todofmt_open(path, &lazy_file) == TODOFMT_OK && todofmt_open(path, &full_file) == TODOFMT_OK);
+        store_init(&lazy);
+        store_init(&full);
+        store_attach(&lazy, lazy_file);
+        store_attach(&full, full_file);
+        for (int f = 0; f < full.folder_count; f++) CHECK(store_materialize(&full, f));
+
+        lazy_reminders = remind_create(on_fired, &from_sections);
+        full_reminders = remind_create(on_fired, &from_tasks);
+        CHECK(lazy_reminders != NULL && full_reminders != NULL);
+        remind_set_clock(lazy_reminders, fake_clock, NULL);
+        remind_set_clock(full_reminders, fake_clock, NULL);
+        CHECK(remind_follow(lazy_reminders, &lazy, days_before, 2, REMIND_DEFAULT_MINUTE));
+        CHECK(remind_follow(full_reminders, &full, days_before, 2, REMIND_DEFAULT_MINUTE));
+        CHECK(remind_pending(lazy_reminders) == remind_pending(full_reminders));
+        CHECK(remind_pending(lazy_reminders) > 1000);
+        for (int f = 0; f < lazy.folder_count; f++) CHECK(!lazy.folders[f].loaded);
+
+        fake_now += 3 * DAY_MS;
+        CHECK(remind_run(lazy_reminders, fake_now) > 0);
+        remind_run(full_reminders, fake_now);
+        for (size_t i = 0; i < from_sections.count; i++) {
+            const TodoReminder *reminder = &from_sections.reminders[i];
+            int folder = store_find_folder(&lazy, reminder->folder_id);
+            TodoSectionDeadlines section;
+
+            CHECK(reminder->task_id == 0 && folder >= 0);
+            CHECK(todofmt_section_deadlines(lazy.backing, (uint32_t)lazy.folders[folder].source_index, &section));
+            CHECK(reminder->row >= 0 && (size_t)reminder->row < section.count);
+            CHECK(section.deadlines[reminder->row] == reminder->deadline && !section.completed[reminder->row]);
+            todofmt_free_deadlines(&section);
+        }
+        if (same_fired(&from_sections, &from_tasks) != 0) return 1;
+
+        // Loading, changing and deleting lists swaps the section reminders
+        // for the tasks' own
+        CHECK(store_materialize(&lazy, 1) && store_materialize(&lazy, 3));
+        CHECK(remind_pending(lazy_reminders) == remind_pending(full_reminders));
+        CHECK(store_delete_folder(&lazy, 0) && store_delete_folder(&full, 0));
+        CHECK(remind_pending(lazy_reminders) == remind_pending(full_reminders));
+        CHECK(store_complete_task(&lazy, 0, 0) && store_complete_task(&full, 0, 0));
+        CHECK(remind_pending(lazy_reminders) == remind_pending(full_reminders));
+
+        from_sections.count = from_tasks.count = 0;
+        fake_now += 40 * DAY_MS;
+        remind_run(lazy_reminders, fake_now);
+        remind_run(full_reminders, fake_now);
+        CHECK(remind_pending(lazy_reminders) == 0 && remind_pending(full_reminders) == 0);
+        if (same_fired(&from_sections, &from_tasks) != 0) return 1;
+
+        remind_destroy(lazy_reminders);
+        remind_destroy(full_reminders);
+        store_release(&lazy);
+        store_release(&full);
+    }
+    store_release(&original);
+    remove(path);
+    return 0;
+}
+
+int main(void) {
+    seed_random(7);
+    RUN(test_unloaded_lists);
+    printf("ok\n");
+    return 0;
+}
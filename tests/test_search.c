@@ -0,0 +1,260 @@
+// Tests for the trigram search index (todo_search.c).
+//
+// Queries of every length, in both modes, limited to one list or not, are
+// checked against a scan of the store, while tasks and lists come and go
+// and while lists are loaded from a data file one at a time.
+//
+//   gcc -std=c99 -Wall -pthread -I. -o test_search tests/test_search.c todo_core.c todo_format.c
+//       todo_slots.c todo_sort.c todo_recur.c todo_lz.c todo_journal.c todo_thread.c todo_date.c
+//       todo_trace.c todo_strings.c todo_tags.c todo_bitmap.c todo_search.c
+//   ./test_search
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "todo_core.h"
+#include "todo_date.h"
+#include "todo_format.h"
+#include "todo_search.h"
+#include "todo_test.h"
+
+#define MAX_HITS 4096
+
+static const char *words[] = {
+    "Report", "rep", "a", "ab", "BA", "car", "cart", "x", "Rent", "éclair", "7up", "re-port"
+};
+
+static const char *queries[] = {
+    "r", "R", "re", "rep", "repo", "report", "a", "ab", "ba", "car", "ar", "rt", "x", "é", "éc",
+    "7", "-p", "re-", "zz", "nothing here"
+};
+
+static void random_text(char *text, size_t size) {
+    int count = 1 + (int)(next_random() % 4);
+
+    text[0] = '\0';
+    for (int i = 0; i < count; i++) {
+        if (i > 0) strncat(text, next_random() % 3 ? " " : ",", size - strlen(text) - 1);
+        strncat(text, words[next_random() % (sizeof(words) / sizeof(words[0]))], size - strlen(text) - 1);
+    }
+}
+
+static unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+static int is_word_byte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c >= 0x80;
+}
+
+// The match rule, written out plainly
+static int expect_match(const char *text, const char *query, int mode) {
+    size_t length = strlen(text);
+    size_t query_length = strlen(query);
+
+    for (size_t i = 0; i + query_length <= length; i++) {
+        size_t j = 0;
+
+        if (mode == SEARCH_PREFIX && (!is_word_byte(fold((unsigned char)text[i])) ||
+                                      (i > 0 && is_word_byte(fold((unsigned char)text[i - 1]))))) {
+            continue;
+        }
+        while (j < query_length && fold((unsigned char)text[i + j]) == fold((unsigned char)query[j])) j++;
+        if (j == query_length) return 1;
+    }
+    return 0;
+}
+
+static int compare_hits(const void *a, const void *b) {
+    const TodoSearchHit *x = (const TodoSearchHit *)a;
+    const TodoSearchHit *y = (const TodoSearchHit *)b;
+
+    if (x->folder_id != y->folder_id) return (x->folder_id > y->folder_id) - (x->folder_id < y->folder_id);
+    return (x->task_id > y->task_id) - (x->task_id < y->task_id);
+}
+
+// Matches of every loaded task and every list name, sorted
+static size_t scan_store(const TodoStore *store, const char *query, int mode, uint32_t folder_id,
+                         TodoSearchHit *hits) {
+    size_t count = 0;
+
+    for (int f = 0; f < store->folder_count; f++) {
+        const Folder *folder = &store->folders[f];
+
+        if (folder_id != 0 && folder->id != folder_id) continue;
+        if (expect_match(store_text(store, folder->name), query, mode)) {
+            hits[count].folder_id = folder->id;
+            hits[count++].task_id = 0;
+        }
+        for (int i = 0; folder->loaded && i < folder->task_count; i++) {
+            const Task *task = store_task(store, folder, i);
+
+            if (expect_match(store_text(store, task->description), query, mode)) {
+                hits[count].folder_id = folder->id;
+                hits[count++].task_id = task->id;
+            }
+        }
+    }
+    qsort(hits, count, sizeof(TodoSearchHit), compare_hits);
+    return count;
+}
+
+// Every query in both modes, over everything and over each list
+static int check_queries(const TodoStore *store, const TodoSearchIndex *index) {
+    static TodoSearchHit found[MAX_HITS], expected[MAX_HITS];
+
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++) {
+        for (int mode = SEARCH_SUBSTRING; mode <= SEARCH_PREFIX; mode++) {
+            // One text at a time, without the index
+            for (int f = 0; f < store->folder_count; f++) {
+                for (int i = 0; store->folders[f].loaded && i < store->folders[f].task_count; i++) {
+                    const Task *task = store_task(store, &store->folders[f], i);
+                    const char *text = store_text(store, task->description);
+
+                    CHECK(search_text_matches(text, task->description.length, queries[q], mode) ==
+                          expect_match(text, queries[q], mode));
+                }
+            }
+            for (int f = -1; f < store->folder_count; f++) {
+                uint32_t folder_id = f < 0 ? 0 : store->folders[f].id;
+                size_t count = search_query(index, queries[q], mode, folder_id, found, MAX_HITS);
+                size_t want = scan_store(store, queries[q], mode, folder_id, expected);
+
+                qsort(found, count, sizeof(TodoSearchHit), compare_hits);
+                if (count != want || memcmp(found, expected, count * sizeof(TodoSearchHit)) != 0) {
+                    fprintf(stderr, "query \"%s\" mode %d folder %u: %zu hits, expected %zu\n",
+                            queries[q], mode, (unsigned)folder_id, count, want);
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
+
+static int test_basic_matches(void) {
+    static TodoStore store;
+    TodoSearchIndex *index;
+    TodoSearchHit hits[8];
+    int errands, work;
+
+    store_init(&store);
+    errands = store_create_folder(&store, 0, "Errands");
+    work = store_create_folder(&store, 0, "Work");
+    CHECK(errands >= 0 && work >= 0);
+    CHECK(store_add_task(&store, errands, "Buy groceries", DATE_NONE));
+    CHECK(store_add_task(&store, work, "Write the REPORT", DATE_NONE));
+    CHECK(store_add_task(&store, work, "Call about the car", DATE_NONE));
+    index = search_create(&store);
+    CHECK(index != NULL);
+
+    CHECK(search_query(index, "report", SEARCH_SUBSTRING, 0, hits, 8) == 1);
+    CHECK(hits[0].folder_id == store.folders[work].id);
+    CHECK(search_query(index, "epor", SEARCH_PREFIX, 0, hits, 8) == 0);
+    CHECK(search_query(index, "rep", SEARCH_PREFIX, 0, hits, 8) == 1);
+    CHECK(search_query(index, "work", SEARCH_SUBSTRING, 0, hits, 8) == 1 && hits[0].task_id == 0);
+    CHECK(search_query(index, "r", SEARCH_SUBSTRING, store.folders[errands].id, hits, 8) == 2);
+    CHECK(search_query(index, "gro", SEARCH_SUBSTRING, store.folders[work].id, hits, 8) == 0);
+    CHECK(search_query(index, "a", SEARCH_SUBSTRING, 0, hits, 2) == 2);     // Cut at max_hits
+    CHECK(search_query(index, "", SEARCH_SUBSTRING, 0, hits, 8) == 0);
+    CHECK(search_document_count(index) == 5);
+
+    search_destroy(index);
+    store_release(&store);
+    return 0;
+}
+
+// Random edits with every query checked after each round
+static int test_against_scan(void) {
+    static TodoStore store;
+    TodoSearchIndex *index;
+    char text[128];
+
+    store_init(&store);
+    for (int f = 0; f < 4; f++) {
+        random_text(text, sizeof(text));
+        CHECK(store_create_folder(&store, 0, text) >= 0);
+    }
+    index = search_create(&store);
+    CHECK(index != NULL);
+
+    for (int round = 0; round < 40; round++) {
+        for (int i = 0; i < 60; i++) {
+            int f = (int)(next_random() % (unsigned)store.folder_count);
+
+            random_text(text, sizeof(text));
+            CHECK(store_add_task(&store, f, text, DATE_NONE));
+        }
+        for (int i = 0; i < 25; i++) {
+            int f = (int)(next_random() % (unsigned)store.folder_count);
+
+            if (store.folders[f].task_count == 0) continue;
+            CHECK(store_delete_task(&store, f, (int)(next_random() % (unsigned)store.folders[f].task_count)));
+        }
+        if (round % 10 == 9) {
+            // A list goes and another takes its place
+            CHECK(store_delete_folder(&store, (int)(next_random() % (unsigned)store.folder_count)));
+            random_text(text, sizeof(text));
+            CHECK(store_create_folder(&store, 0, text) >= 0);
+        }
+        if (check_queries(&store, index) != 0) return 1;
+    }
+
+    search_destroy(index);
+    store_release(&store);
+    return 0;
+}
+
+// Tasks become searchable as their list is loaded from the data file
+static int test_lazy_lists(void) {
+    static TodoStore store, loaded;
+    TodoSearchIndex *index;
+    TodoDataFile *file;
+    TodoSearchHit hits[MAX_HITS];
+    const char *path = "test_search.dat";
+    char text[128];
+
+    store_init(&store);
+    for (int f = 0; f < 3; f++) {
+        snprintf(text, sizeof(text), "List %d", f);
+        CHECK(store_create_folder(&store, 0, text) >= 0);
+        for (int i = 0; i < 200; i++) {
+            random_text(text, sizeof(text));
+            CHECK(store_add_task(&store, f, text, DATE_NONE));
+        }
+    }
+    CHECK(todofmt_write(path, &store, TODOFMT_PLAIN) == TODOFMT_OK);
+    CHECK(todofmt_open(path, &file) == TODOFMT_OK);
+    store_init(&loaded);
+    store_attach(&loaded, file);
+    index = search_create(&loaded);
+    CHECK(index != NULL);
+
+    CHECK(search_query(index, "r", SEARCH_SUBSTRING, loaded.folders[1].id, hits, MAX_HITS) == 0);
+    CHECK(search_query(index, "list", SEARCH_SUBSTRING, loaded.folders[1].id, hits, MAX_HITS) == 1);
+    CHECK(store_materialize(&loaded, 1));
+    if (check_queries(&loaded, index) != 0) return 1;
+    CHECK(search_query(index, "r", SEARCH_SUBSTRING, loaded.folders[0].id, hits, MAX_HITS) == 0);
+    CHECK(store_materialize(&loaded, 0) && store_materialize(&loaded, 2));
+    if (check_queries(&loaded, index) != 0) return 1;
+
+    search_destroy(index);
+    store_release(&loaded);
+    store_release(&store);
+    remove(path);
+    return 0;
+}
+
+int main(void) {
+    seed_random(12345);
+    RUN(test_basic_matches);
+    RUN(test_against_scan);
+    RUN(test_lazy_lists);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,153 @@
+// Tests for the slot map (todo_slots.c).
+//
+// Items are allocated and released at random across several chunks and
+// checked against a list of what should be live: every live handle finds
+// its item, at the address it was given and with what was written to it,
+// and every handle to a released item finds nothing, even once its slot
+// holds another item. Released slots are handed out again newest first,
+// zeroed and with a new generation, before the map grows. A slot reused
+// 255 times comes back to its first handle.
+//
+//   gcc -std=c99 -Wall -I. -o test_slots tests/test_slots.c todo_slots.c
+//   ./test_slots
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "todo_slots.h"
+#include "todo_test.h"
+
+#define STEPS 200000
+#define MAX_LIVE 5000       // Past four chunks
+#define MAX_STALE 4096
+
+// An odd size, so items are padded
+typedef struct {
+    uint32_t handle;
+    uint32_t value;
+    unsigned char bytes[5];
+} Item;
+
+typedef struct {
+    uint32_t handle;
+    Item *item;
+} Live;
+
+static Live live[MAX_LIVE];
+static uint32_t stale[MAX_STALE];
+
+static int item_zeroed(const Item *item) {
+    static const Item zero;
+
+    return memcmp(item, &zero, sizeof(Item)) == 0;
+}
+
+static int test_random_handles(void) {
+    TodoSlotMap map;
+    int live_count = 0, stale_count = 0;
+    uint32_t value = 0;
+
+    slots_init(&map, sizeof(Item));
+    for (int step = 0; step < STEPS; step++) {
+        // Grow past four chunks, then hover around half of that, so no
+        // slot is reused 255 times while its old handle is remembered
+        unsigned grow = step < STEPS / 4 ? 70u : live_count < MAX_LIVE / 2 ? 55u : 45u;
+
+        if (live_count < MAX_LIVE && (live_count == 0 || next_random() % 100 < grow)) {
+            uint32_t handle;
+            uint32_t used = map.used;
+            uint32_t reused = map.free_head;
+            Item *item = (Item *)slots_alloc(&map, &handle);
+
+            CHECK(item != NULL && handle != 0);
+            CHECK(item_zeroed(item));
+            CHECK(((uintptr_t)item & 7) == 0);
+            if (reused != 0) {
+                // The newest tombstone, with the map no bigger
+                CHECK(SLOTS_INDEX(handle) == reused - 1 && map.used == used);
+            } else {
+                CHECK(SLOTS_INDEX(handle) == used && map.used == used + 1);
+            }
+            item->handle = handle;
+            item->value = ++value;
+            memset(item->bytes, (int)(value & 0xFF), sizeof(item->bytes));
+            live[live_count].handle = handle;
+            live[live_count++].item = item;
+        } else {
+            int victim = (int)(next_random() % (unsigned)live_count);
+            uint32_t handle = live[victim].handle;
+
+            slots_release(&map, handle);
+            CHECK(slots_get(&map, handle) == NULL);
+            slots_release(&map, handle);    // Twice does nothing
+            CHECK(map.free_head == SLOTS_INDEX(handle) + 1);
+            live[victim] = live[--live_count];
+            stale[stale_count++ % MAX_STALE] = handle;
+        }
+        CHECK(map.live == (uint32_t)live_count);
+
+        if (step % 1000 == 0 || step == STEPS - 1) {
+            for (int i = 0; i < live_count; i++) {
+                Item *item = (Item *)slots_get(&map, live[i].handle);
+
+                CHECK(item == live[i].item && item->handle == live[i].handle);
+                CHECK(item->bytes[4] == (unsigned char)(item->value & 0xFF));
+            }
+            // Fewer than 255 reuses ago, so no stale handle can resolve
+            for (int i = 0; i < stale_count && i < MAX_STALE; i++) {
+                CHECK(slots_get(&map, stale[i]) == NULL);
+            }
+        }
+    }
+    CHECK(map.used > 4 * SLOTS_CHUNK && map.chunk_count == (map.used + SLOTS_CHUNK - 1) / SLOTS_CHUNK);
+
+    // Handles that were never handed out
+    CHECK(slots_get(&map, 0) == NULL);
+    CHECK(slots_get(&map, 1u << SLOTS_INDEX_BITS | map.used) == NULL);
+    CHECK(slots_get(&map, SLOTS_MAX - 1) == NULL);
+    slots_free(&map);
+    CHECK(map.used == 0 && map.live == 0 && slots_get(&map, live[0].handle) == NULL);
+    return 0;
+}
+
+static int test_generation_wrap(void) {
+    TodoSlotMap map;
+    uint32_t first, handle, previous;
+    Item *item;
+
+    slots_init(&map, sizeof(Item));
+    CHECK(slots_alloc(&map, &first) != NULL);
+    CHECK(first >> SLOTS_INDEX_BITS == 1);
+    previous = first;
+    for (int reuse = 1; reuse < 255; reuse++) {
+        slots_release(&map, previous);
+        item = (Item *)slots_alloc(&map, &handle);
+        CHECK(item != NULL && item_zeroed(item));
+        CHECK(SLOTS_INDEX(handle) == SLOTS_INDEX(first));
+        CHECK(handle >> SLOTS_INDEX_BITS == (uint32_t)reuse + 1);
+        CHECK(slots_get(&map, previous) == NULL && slots_get(&map, first) == NULL);
+        item->value = (uint32_t)reuse;
+        previous = handle;
+    }
+
+    // Generation 255 goes back to 1, never 0
+    slots_release(&map, previous);
+    CHECK(slots_alloc(&map, &handle) != NULL);
+    CHECK(handle == first && slots_get(&map, previous) == NULL);
+    CHECK(map.used == 1 && map.live == 1);
+    slots_free(&map);
+    return 0;
+}
+
+int main(void) {
+    seed_random(17);
+    RUN(test_random_handles);
+    RUN(test_generation_wrap);
+    printf("ok\n");
+    return 0;
+}
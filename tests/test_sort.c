@@ -0,0 +1,273 @@
+// Tests for multi-key task orders (todo_sort.c).
+//
+// Random tasks, with many ties and deadlines past either end of the
+// calendar, are put in every preset order and in random valid ones with
+// sort_key() and sort_radix(), and must come out exactly as a comparator
+// applying the criteria one by one, with ties kept in their old order,
+// puts them. Bare keys that share some of their bytes check the skipped
+// passes, and sort_rows() is checked on a filtered folder of a store.
+//
+//   gcc -std=c99 -Wall -pthread -I. -o test_sort tests/test_sort.c todo_sort.c todo_core.c todo_format.c
+//       todo_slots.c todo_recur.c todo_lz.c todo_journal.c todo_thread.c todo_date.c todo_trace.c
+//       todo_strings.c todo_tags.c todo_bitmap.c
+//   ./test_sort
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "todo_core.h"
+#include "todo_date.h"
+#include "todo_sort.h"
+#include "todo_test.h"
+
+#define TASKS 20000
+#define ROUNDS 40
+
+static Task tasks[TASKS];
+static uint64_t keys[TASKS];
+static uint32_t items[TASKS];
+static uint32_t expected[TASKS];
+static uint64_t original[TASKS];
+
+// What the comparator sorts by, set before each qsort()
+static TodoSortOrder comparing;
+static const Task *compared;
+static const uint64_t *compared_keys;
+
+static uint32_t random32(void) {
+    return next_random() << 16 ^ next_random();
+}
+
+// The deadline as the order sees it: none first, days before the
+// calendar tied with its first day
+static int64_t deadline_rank(int32_t day) {
+    if (day == DATE_NONE) return INT64_MIN;
+    return day < DATE_FIRST_DAY ? DATE_FIRST_DAY : day;
+}
+
+static int compare_criterion(int key, const Task *a, const Task *b) {
+    int64_t x = 0, y = 0;
+
+    switch (key) {
+        case SORT_OPEN_FIRST: x = a->completed != 0; y = b->completed != 0; break;
+        case SORT_PRIORITY: x = -a->priority; y = -b->priority; break;
+        case SORT_DEADLINE: x = deadline_rank(a->deadline_day); y = deadline_rank(b->deadline_day); break;
+        case SORT_OLDEST: x = a->sequence; y = b->sequence; break;
+        case SORT_NEWEST: x = -(int64_t)a->sequence; y = -(int64_t)b->sequence; break;
+    }
+    return x < y ? -1 : x > y;
+}
+
+// Criteria in turn, then the old position, so qsort() keeps ties in order
+static int compare_by_order(const void *left, const void *right) {
+    uint32_t a = *(const uint32_t *)left, b = *(const uint32_t *)right;
+
+    for (int i = 0; i < comparing.count; i++) {
+        int result = compare_criterion(comparing.keys[i], &compared[a], &compared[b]);
+
+        if (result != 0) return result;
+    }
+    return a < b ? -1 : a > b;
+}
+
+static int compare_keys(const void *left, const void *right) {
+    uint32_t a = *(const uint32_t *)left, b = *(const uint32_t *)right;
+
+    if (compared_keys[a] != compared_keys[b]) return compared_keys[a] < compared_keys[b] ? -1 : 1;
+    return a < b ? -1 : a > b;
+}
+
+// Few distinct values per field, so most criteria tie often
+static void random_tasks(int count) {
+    int32_t today = date_from_civil(2024, 7, 1);
+
+    for (int i = 0; i < count; i++) {
+        Task *task = &tasks[i];
+        unsigned r = next_random() % 20;
+
+        memset(task, 0, sizeof(*task));
+        task->completed = next_random() % 3 == 0;
+        task->priority = (int)(next_random() % 4);
+        if (r < 4) {
+            task->deadline_day = DATE_NONE;
+        } else if (r == 4) {
+            task->deadline_day = DATE_FIRST_DAY - (int32_t)(next_random() % 3);  // Clamped
+        } else if (r == 5) {
+            task->deadline_day = date_from_civil(DATE_MAX_YEAR, 12, 31) - (int32_t)(next_random() % 2);
+        } else {
+            task->deadline_day = today + (int32_t)(next_random() % 60) - 30;
+        }
+        switch (next_random() % 3) {
+            case 0: task->sequence = next_random() % 50; break;
+            case 1: task->sequence = UINT32_MAX - next_random() % 3; break;
+            default: task->sequence = random32(); break;
+        }
+    }
+}
+
+// Sort the first count tasks by order both ways and compare
+static int check_order(const TodoSortOrder *order, int count) {
+    CHECK(sort_order_valid(order));
+    for (int i = 0; i < count; i++) {
+        keys[i] = sort_key(order, &tasks[i]);
+        items[i] = (uint32_t)i;
+        expected[i] = (uint32_t)i;
+    }
+    comparing = *order;
+    compared = tasks;
+    qsort(expected, (size_t)count, sizeof(uint32_t), compare_by_order);
+    CHECK(sort_radix(keys, items, (size_t)count));
+
+    for (int i = 0; i < count; i++) {
+        if (items[i] != expected[i]) {
+            fprintf(stderr, "%d keys (%d %d %d %d), %d tasks: row %d is task %u, not %u\n", order->count,
+                    order->keys[0], order->keys[1], order->keys[2], order->keys[3], count, i, items[i], expected[i]);
+            return 1;
+        }
+        CHECK(keys[i] == sort_key(order, &tasks[items[i]]));
+    }
+    return 0;
+}
+
+static int test_orders(void) {
+    TodoSortOrder order;
+
+    for (int round = 0; round < ROUNDS; round++) {
+        int count = round % 4 == 0 ? (int)(next_random() % 5) : TASKS / (1 + round % 7);
+
+        random_tasks(count);
+        for (int preset = 0; preset < SORT_PRESET_COUNT; preset++) {
+            order = sort_preset(preset);
+            if (check_order(&order, count) != 0) return 1;
+        }
+        order = sort_folder_order();
+        if (check_order(&order, count) != 0) return 1;
+
+        // Random orders, some of which repeat a criterion
+        for (int tries = 0; tries < 6; tries++) {
+            memset(&order, 0, sizeof(order));
+            order.count = 1 + (int)(next_random() % SORT_MAX_KEYS);
+            for (int k = 0; k < order.count; k++) {
+                order.keys[k] = SORT_OPEN_FIRST + (int)(next_random() % 5);
+            }
+            if (sort_order_valid(&order) && check_order(&order, count) != 0) return 1;
+        }
+    }
+
+    // Unknown criteria, too many of them, or more than 64 bits
+    memset(&order, 0, sizeof(order));
+    order.count = 1;
+    order.keys[0] = SORT_NEWEST + 1;
+    CHECK(!sort_order_valid(&order));
+    order.count = SORT_MAX_KEYS + 1;
+    CHECK(!sort_order_valid(&order));
+    order.count = 3;
+    order.keys[0] = SORT_OLDEST;
+    order.keys[1] = SORT_NEWEST;
+    order.keys[2] = SORT_OPEN_FIRST;
+    CHECK(!sort_order_valid(&order));
+    order.count = 2;
+    CHECK(sort_order_valid(&order));
+    return 0;
+}
+
+// Keys that differ only in some of their bytes, so the other passes are
+// skipped, sorted against qsort()
+static int test_shared_digits(void) {
+    for (int round = 0; round < ROUNDS; round++) {
+        uint64_t mask = 0, base = (uint64_t)random32() << 32 | random32();
+        int count = 1 + (int)(next_random() % TASKS);
+
+        for (int digit = 0; digit < 8; digit++) {
+            if (next_random() % 3 == 0) mask |= (uint64_t)0xFF << (digit * 8);
+        }
+        for (int i = 0; i < count; i++) {
+            uint64_t bits = (uint64_t)random32() << 32 | random32();
+
+            // Narrow values in the varying bytes too, for ties
+            if (next_random() % 2) bits %= 7;
+            keys[i] = (base & ~mask) | (bits & mask);
+            original[i] = keys[i];
+            items[i] = (uint32_t)i;
+            expected[i] = (uint32_t)i;
+        }
+        compared_keys = original;
+        qsort(expected, (size_t)count, sizeof(uint32_t), compare_keys);
+        CHECK(sort_radix(keys, items, (size_t)count));
+        for (int i = 0; i < count; i++) {
+            CHECK(items[i] == expected[i] && keys[i] == original[expected[i]]);
+        }
+    }
+    CHECK(sort_radix(keys, items, 0));
+    return 0;
+}
+
+static int test_sort_rows(void) {
+    static TodoStore store;
+    static int rows[TASKS];
+    const Folder *folder;
+    TodoSortOrder order;
+    int32_t today = date_from_civil(2024, 7, 1);
+    int count = 0;
+
+    store_init(&store);
+    store_create_folder(&store, 0, "Rows");
+    for (int i = 0; i < 3000; i++) {
+        char description[32];
+        int32_t deadline = next_random() % 5 == 0 ? DATE_NONE : today + (int32_t)(next_random() % 40);
+
+        snprintf(description, sizeof(description), "task %d", i);
+        CHECK(store_insert_task(&store, 0, -1, description, deadline, next_random() % 3 == 0,
+                                (int)(next_random() % 4), "", NULL));
+    }
+    folder = &store.folders[0];
+
+    // The folder itself is kept in the folder order
+    for (int i = 0; i < folder->task_count; i++) {
+        tasks[i] = *store_task(&store, folder, i);
+    }
+    order = sort_folder_order();
+    if (check_order(&order, folder->task_count) != 0) return 1;
+    for (int i = 0; i < folder->task_count; i++) CHECK(items[i] == (uint32_t)i);
+
+    // A filter's rows, in each preset order
+    for (int i = 0; i < folder->task_count; i++) {
+        if (next_random() % 3 != 0) rows[count++] = i;
+    }
+    for (int preset = 0; preset < SORT_PRESET_COUNT; preset++) {
+        order = sort_preset(preset);
+        for (int i = 0; i < count; i++) {
+            tasks[i] = *store_task(&store, folder, rows[i]);
+            expected[i] = (uint32_t)i;
+        }
+        comparing = order;
+        compared = tasks;
+        qsort(expected, (size_t)count, sizeof(uint32_t), compare_by_order);
+        for (int i = 0; i < count; i++) expected[i] = (uint32_t)rows[expected[i]];
+        CHECK(sort_rows(&store, folder, &order, rows, count));
+        for (int i = 0; i < count; i++) CHECK(rows[i] == (int)expected[i]);
+    }
+
+    // An order that is not valid leaves the rows alone
+    order.count = 1;
+    order.keys[0] = 0;
+    memcpy(items, rows, (size_t)count * sizeof(int));
+    CHECK(!sort_rows(&store, folder, &order, rows, count));
+    CHECK(memcmp(items, rows, (size_t)count * sizeof(int)) == 0);
+    store_release(&store);
+    return 0;
+}
+
+int main(void) {
+    seed_random(20);
+    RUN(test_orders);
+    RUN(test_shared_digits);
+    RUN(test_sort_rows);
+    printf("ok\n");
+    return 0;
+}
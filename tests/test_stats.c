@@ -0,0 +1,250 @@
+// Tests for the folder and overall counts (todo_stats.c).
+//
+// Lists are read back from a data file in both encodings, so most start
+// out counted from their sections, and then changed at random: tasks are
+// added, completed, reopened, deleted and moved one at a time and in
+// batches, lists come and go and are loaded, and the day moves back and
+// forth. After every step each list's counts and the overall ones must
+// match a count made by visiting every task.
+//
+//   gcc -std=c99 -Wall -pthread -I. -o test_stats tests/test_stats.c todo_stats.c todo_due.c todo_batch.c
+//       todo_history.c todo_core.c todo_format.c todo_slots.c todo_sort.c todo_recur.c todo_lz.c
+//       todo_journal.c todo_thread.c todo_date.c todo_trace.c todo_strings.c todo_tags.c todo_bitmap.c
+//   ./test_stats
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "todo_batch.h"
+#include "todo_core.h"
+#include "todo_date.h"
+#include "todo_format.h"
+#include "todo_stats.h"
+#include "todo_test.h"
+
+#define FOLDERS 8
+#define TASKS_PER_FOLDER 60
+#define STEPS 1500
+
+static void count_one(TodoFolderStats *counts, int32_t deadline, int completed, int32_t today) {
+    counts->tasks++;
+    if (completed) {
+        counts->completed++;
+        return;
+    }
+    counts->open++;
+    if (deadline == DATE_NONE) return;
+    if (deadline < today) counts->overdue++;
+    if (deadline == today) counts->due_today++;
+    if (counts->next_deadline == DATE_NONE || deadline < counts->next_deadline) counts->next_deadline = deadline;
+}
+
+// A folder's counts, from its tasks or, if it is not loaded, its section
+static int recount(const TodoStore *store, int index, int32_t today, TodoFolderStats *counts) {
+    const Folder *folder = &store->folders[index];
+
+    memset(counts, 0, sizeof(*counts));
+    counts->next_deadline = DATE_NONE;
+    counts->loaded = 1;
+    if (folder->loaded) {
+        for (int row = 0; row < folder->task_count; row++) {
+            const Task *task = store_task(store, folder, row);
+
+            count_one(counts, task->deadline_day, task->completed, today);
+        }
+    } else {
+        TodoSectionDeadlines section;
+
+        CHECK(todofmt_section_deadlines(store->backing, (uint32_t)folder->source_index, &section));
+        for (uint32_t i = 0; i < section.count; i++) {
+            count_one(counts, section.deadlines[i], section.completed[i], today);
+        }
+        todofmt_free_deadlines(&section);
+    }
+    return 0;
+}
+
+static int same_counts(const TodoFolderStats *a, const TodoFolderStats *b) {
+    CHECK(a->tasks == b->tasks);
+    CHECK(a->open == b->open && a->completed == b->completed);
+    CHECK(a->overdue == b->overdue && a->due_today == b->due_today);
+    CHECK(a->next_deadline == b->next_deadline);
+    CHECK(a->loaded == b->loaded);
+    return 0;
+}
+
+// Every folder's counts and the total against a count of every task
+static int check_counts(TodoStats *stats, const TodoStore *store, int32_t today) {
+    TodoFolderStats total, counts;
+
+    memset(&total, 0, sizeof(total));
+    total.next_deadline = DATE_NONE;
+    total.loaded = 1;
+    CHECK(stats_folder(stats, store->folder_count) == NULL);
+    for (int f = 0; f < store->folder_count; f++) {
+        if (recount(store, f, today, &counts) != 0) return 1;
+        if (same_counts(stats_folder(stats, f), &counts) != 0) return 1;
+        total.tasks += counts.tasks;
+        total.open += counts.open;
+        total.completed += counts.completed;
+        total.overdue += counts.overdue;
+        total.due_today += counts.due_today;
+        total.loaded &= counts.loaded;
+        if (counts.next_deadline != DATE_NONE &&
+            (total.next_deadline == DATE_NONE || counts.next_deadline < total.next_deadline)) {
+            total.next_deadline = counts.next_deadline;
+        }
+    }
+    return same_counts(stats_total(stats), &total);
+}
+
+static int32_t random_deadline(int32_t today) {
+    return next_random() % 6 == 0 ? DATE_NONE : today - 10 + (int32_t)(next_random() % 20);
+}
+
+static void fill_store(TodoStore *store, int32_t today) {
+    for (int f = 0; f < FOLDERS; f++) {
+        store_create_folder(store, 0, "List");
+        for (int i = 0; i < TASKS_PER_FOLDER; i++) {
+            TodoRecurrence rule;
+            int32_t deadline = random_deadline(today);
+
+            memset(&rule, 0, sizeof(rule));
+            if (deadline != DATE_NONE && next_random() % 8 == 0) {
+                rule.unit = RECUR_DAILY;
+                rule.interval = (uint16_t)(1 + next_random() % 3);
+                rule.start = deadline;
+                rule.until = DATE_NONE;
+            }
+            store_insert_task(store, f, -1, "Task", deadline, next_random() % 4 == 0, 0, "",
+                              rule.unit ? &rule : NULL);
+        }
+    }
+}
+
+// A loaded folder, loading one if there is none; -1 if there are no folders
+static int random_loaded_folder(TodoStore *store) {
+    int index;
+
+    if (store->folder_count == 0) return -1;
+    index = (int)(next_random() % (unsigned)store->folder_count);
+    for (int i = 0; i < store->folder_count; i++) {
+        if (store->folders[(index + i) % store->folder_count].loaded) return (index + i) % store->folder_count;
+    }
+    return store_materialize(store, index) ? index : -1;
+}
+
+// Up to eight changes across loaded folders, committed as one batch; at
+// least one folder is loaded, so none is loaded while it is queued
+static int random_batch(TodoStore *store, int32_t today) {
+    TodoBatch *batch = batch_begin(store);
+    int changes = 1 + (int)(next_random() % 8);
+    int used[FOLDERS * 2][8];
+    int used_count[FOLDERS * 2];
+
+    if (batch == NULL) return 0;
+    memset(used_count, 0, sizeof(used_count));
+    for (int i = 0; i < changes; i++) {
+        int index = random_loaded_folder(store);
+        const Folder *folder = &store->folders[index];
+        unsigned kind = next_random() % 5;
+        int row, seen = 0;
+
+        if (kind == 0 || folder->task_count == 0) {
+            batch_add_task(batch, index, "Batched", random_deadline(today), PRIORITY_NONE, "", NULL);
+            continue;
+        }
+        // A task is changed once per batch
+        row = (int)(next_random() % (unsigned)folder->task_count);
+        for (int u = 0; u < used_count[index]; u++) seen |= used[index][u] == row;
+        if (seen) continue;
+        used[index][used_count[index]++] = row;
+        if (kind == 1) {
+            batch_complete_task(batch, index, row);
+        } else if (kind == 2) {
+            batch_reopen_task(batch, index, row);
+        } else if (kind == 3) {
+            batch_delete_task(batch, index, row);
+        } else {
+            batch_move_task(batch, index, row, random_loaded_folder(store));
+        }
+    }
+    return batch_commit(batch, NULL, NULL, NULL);
+}
+
+// One random change to the store or the day
+static void random_step(TodoStore *store, TodoStats *stats, int32_t *today) {
+    unsigned kind = next_random() % 100;
+    int index = random_loaded_folder(store);
+    const Folder *folder = index >= 0 ? &store->folders[index] : NULL;
+    int row = folder != NULL && folder->task_count > 0 ? (int)(next_random() % (unsigned)folder->task_count) : -1;
+
+    if (kind < 8) {
+        *today += (int32_t)(next_random() % 7) - 3;
+        stats_set_today(stats, *today);
+    } else if (kind < 14 && store->folder_count > 0) {
+        store_materialize(store, (int)(next_random() % (unsigned)store->folder_count));
+    } else if (kind < 16 && store->folder_count < FOLDERS * 2) {
+        store_create_folder(store, 0, "New");
+    } else if (kind < 18 && store->folder_count > 2) {
+        store_delete_folder(store, (int)(next_random() % (unsigned)store->folder_count));
+    } else if (kind < 30 && index >= 0) {
+        random_batch(store, *today);
+    } else if (kind < 50 && index >= 0) {
+        store_insert_task(store, index, -1, "Added", random_deadline(*today), next_random() % 5 == 0, 0, "", NULL);
+    } else if (kind < 70 && row >= 0) {
+        store_complete_task(store, index, row);
+    } else if (kind < 80 && row >= 0) {
+        store_reopen_task(store, index, row, -1);
+    } else if (row >= 0) {
+        store_delete_task(store, index, row);
+    }
+}
+
+static int test_random_changes(void) {
+    static TodoStore original, store;
+    const char *path = "test_stats.dat";
+    int32_t start = date_from_civil(2024, 3, 10);
+
+    store_init(&original);
+    fill_store(&original, start);
+    for (int encoding = TODOFMT_PLAIN; encoding <= TODOFMT_COLUMNAR; encoding++) {
+        TodoDataFile *file;
+        TodoStats *stats;
+        int32_t today = start;
+
+        CHECK(todofmt_write(path, &original, encoding) == TODOFMT_OK);
+        CHECK(todofmt_open(path, &file) == TODOFMT_OK);
+        store_init(&store);
+        store_attach(&store, file);
+        stats = stats_create(&store, today);
+        CHECK(stats != NULL);
+        if (check_counts(stats, &store, today) != 0) return 1;
+        CHECK(!store.folders[0].loaded && stats_total(stats)->loaded);
+
+        for (int step = 0; step < STEPS; step++) {
+            random_step(&store, stats, &today);
+            if (check_counts(stats, &store, today) != 0) {
+                fprintf(stderr, "after step %d\n", step);
+                return 1;
+            }
+        }
+        stats_destroy(stats);
+        store_release(&store);
+    }
+    store_release(&original);
+    remove(path);
+    return 0;
+}
+
+int main(void) {
+    seed_random(23);
+    RUN(test_random_changes);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,280 @@
+// Tests for the interned string pool (todo_strings.c).
+//
+// Strings, many of them equal and some cut at the length limit inside a
+// character, are interned and released at random against a list of the
+// references held. Each reference must read back its text, equal strings
+// must share one copy, and the live byte count must be what the held
+// strings take. Once the pool turns wasteful it is rebuilt from the held
+// references the way its owners do it, which must keep every text, free
+// every dead byte and leave released strings unfindable. A store's pool is
+// compacted after most of its tasks go, keeping every list and task.
+//
+//   gcc -std=c99 -Wall -pthread -I. -o test_strings tests/test_strings.c todo_strings.c todo_core.c
+//       todo_format.c todo_slots.c todo_sort.c todo_recur.c todo_lz.c todo_journal.c todo_thread.c
+//       todo_date.c todo_trace.c todo_tags.c todo_bitmap.c
+//   ./test_strings
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "todo_core.h"
+#include "todo_date.h"
+#include "todo_strings.h"
+#include "todo_test.h"
+
+#define STEPS 60000
+#define MAX_HELD 4000
+#define VARIANTS 300        // Distinct short strings, so many are equal
+
+typedef struct {
+    TodoString string;
+    char *text;             // What it must read as
+} Held;
+
+static Held held[MAX_HELD];
+
+// Short text for variant, or a long one of multi-byte characters
+static char *make_text(unsigned variant, size_t *length) {
+    char *text;
+
+    if (variant % 97 == 0) {
+        // "é" repeated past the limit, so it is cut between characters
+        *length = STRPOOL_MAX_LENGTH + 3;
+        text = (char *)malloc(*length + 1);
+        for (size_t i = 0; i + 1 < *length; i += 2) {
+            text[i] = (char)0xC3;
+            text[i + 1] = (char)0xA9;
+        }
+        text[*length - 1] = 'x';
+        text[*length] = '\0';
+        return text;
+    }
+    text = (char *)malloc(64);
+    *length = (size_t)snprintf(text, 64, "task %u %.*s", variant, (int)(variant % 40),
+                               "........................................");
+    return text;
+}
+
+// Bytes the distinct held strings take, terminators included
+static uint32_t held_bytes(int count) {
+    uint32_t bytes = 0;
+
+    for (int i = 0; i < count; i++) {
+        int first = 1;
+
+        if (held[i].string.length == 0) continue;
+        for (int j = 0; j < i && first; j++) first = strcmp(held[j].text, held[i].text) != 0;
+        if (first) bytes += held[i].string.length + 1;
+    }
+    return bytes;
+}
+
+// Every reference reads back its text, equal texts share one copy, and
+// each can be found again
+static int check_held(const TodoStringPool *pool, int count) {
+    for (int i = 0; i < count; i++) {
+        TodoString found;
+
+        CHECK(strcmp(strpool_text(pool, held[i].string), held[i].text) == 0);
+        CHECK(strlen(held[i].text) == held[i].string.length);
+        CHECK(strpool_find(pool, held[i].text, strlen(held[i].text), &found));
+        CHECK(found.offset == held[i].string.offset && found.length == held[i].string.length);
+    }
+    CHECK(pool->live == held_bytes(count));
+    return 0;
+}
+
+// Rebuild the pool from the held references, as the store and the views do
+static int compact(TodoStringPool *pool, int count) {
+    TodoStringPool compacted;
+
+    strpool_init(&compacted);
+    CHECK(strpool_reserve(&compacted, pool->live, pool->slot_count));
+    for (int i = 0; i < count; i++) {
+        CHECK(strpool_intern(&compacted, strpool_text(pool, held[i].string), held[i].string.length,
+                             &held[i].string));
+    }
+    strpool_free(pool);
+    *pool = compacted;
+    return 0;
+}
+
+static int test_compaction_round_trip(void) {
+    TodoStringPool pool;
+    int count = 0, compactions = 0;
+    char *released[64];
+    int released_count = 0;
+
+    strpool_init(&pool);
+    for (int step = 0; step < STEPS; step++) {
+        unsigned r = next_random();
+
+        if (count < MAX_HELD && (count == 0 || r % 100 < (step < STEPS / 2 ? 55u : 45u))) {
+            size_t length;
+            char *text = make_text(next_random() % VARIANTS, &length);
+
+            if (next_random() % 8 == 0 && count > 0) {
+                // From a string already in the pool, which may move as it grows
+                const Held *source = &held[next_random() % (unsigned)count];
+
+                free(text);
+                text = strdup(source->text);
+                CHECK(strpool_intern(&pool, strpool_text(&pool, source->string), source->string.length,
+                                     &held[count].string));
+            } else {
+                CHECK(strpool_intern(&pool, text, length, &held[count].string));
+                text[utf8_fit(text, length, STRPOOL_MAX_LENGTH)] = '\0';
+            }
+            CHECK(utf8_valid(strpool_text(&pool, held[count].string), held[count].string.length));
+            held[count++].text = text;
+        } else {
+            int victim = (int)(next_random() % (unsigned)count);
+
+            strpool_release(&pool, held[victim].string);
+            if (released_count < 64) {
+                released[released_count++] = held[victim].text;
+            } else {
+                free(held[victim].text);
+            }
+            held[victim] = held[--count];
+        }
+
+        if (strpool_wasteful(&pool)) {
+            uint32_t live = pool.live;
+
+            if (compact(&pool, count) != 0) return 1;
+            compactions++;
+            CHECK(pool.size == live && pool.live == live && !strpool_wasteful(&pool));
+            if (check_held(&pool, count) != 0) return 1;
+
+            // Strings released before are gone unless something holds them
+            for (int i = 0; i < released_count; i++) {
+                TodoString found;
+                int is_held = 0;
+
+                for (int j = 0; j < count && !is_held; j++) is_held = strcmp(held[j].text, released[i]) == 0;
+                CHECK(strpool_find(&pool, released[i], strlen(released[i]), &found) == is_held);
+                free(released[i]);
+            }
+            released_count = 0;
+        } else if (step % 5000 == 0) {
+            if (check_held(&pool, count) != 0) return 1;
+        }
+    }
+    CHECK(compactions > 0);
+    if (check_held(&pool, count) != 0) return 1;
+
+    for (int i = 0; i < count; i++) free(held[i].text);
+    for (int i = 0; i < released_count; i++) free(released[i]);
+    strpool_free(&pool);
+    return 0;
+}
+
+static int test_utf8(void) {
+    CHECK(utf8_valid("plain", 5));
+    CHECK(utf8_valid("\xC3\xA9\xE2\x82\xAC\xF0\x9F\x98\x80", 9));
+    CHECK(!utf8_valid("\xC0\xAF", 2));          // Overlong
+    CHECK(!utf8_valid("\xED\xA0\x80", 3));      // Surrogate
+    CHECK(!utf8_valid("\xF4\x90\x80\x80", 4));  // Past U+10FFFF
+    CHECK(!utf8_valid("\xE2\x82", 2));          // Cut short
+    CHECK(utf8_fit("\xC3\xA9\xC3\xA9", 4, 3) == 2);
+    CHECK(utf8_fit("\xC3\xA9\xC3\xA9", 4, 4) == 4);
+    CHECK(utf8_fit("abc", 3, 2) == 2);
+    return 0;
+}
+
+// Every list and task's text, in order
+static char *dump_store(const TodoStore *store) {
+    size_t size = 0, capacity = 4096;
+    char *text = (char *)malloc(capacity);
+
+    text[0] = '\0';
+    for (int f = 0; f < store->folder_count; f++) {
+        const Folder *folder = &store->folders[f];
+
+        for (int i = -1; i < folder->task_count; i++) {
+            const char *parts[2];
+            size_t length;
+
+            if (i < 0) {
+                parts[0] = store_text(store, folder->name);
+                parts[1] = "";
+            } else {
+                const Task *task = store_task(store, folder, i);
+
+                parts[0] = store_text(store, task->description);
+                parts[1] = store_text(store, task->tags);
+            }
+            length = strlen(parts[0]) + strlen(parts[1]) + 3;
+            while (size + length + 1 > capacity) {
+                capacity *= 2;
+                text = (char *)realloc(text, capacity);
+            }
+            size += (size_t)sprintf(text + size, "%s|%s\n", parts[0], parts[1]);
+        }
+    }
+    return text;
+}
+
+static int test_store_compaction(void) {
+    static TodoStore store;
+    static const char *tag_sets[] = { "", "home", "home work", "zeta ärger" };
+    int32_t today = date_from_civil(2024, 5, 5);
+    char description[96];
+    char *before, *after;
+    uint32_t kept_ids[64];
+    int kept = 0;
+
+    store_init(&store);
+    for (int f = 0; f < 3; f++) {
+        snprintf(description, sizeof(description), "Liste %d über", f);
+        store_create_folder(&store, 0, description);
+        for (int i = 0; i < 3000; i++) {
+            // Long and mostly distinct, so deleting them leaves dead bytes
+            snprintf(description, sizeof(description), "Aufgabe %d.%d – %s", f, i % 1000,
+                     "ein ziemlich langer Text, damit sich etwas ansammelt");
+            store_insert_task(&store, f, -1, description, today + i % 50, i % 3 == 0, PRIORITY_NONE,
+                              tag_sets[i % 4], NULL);
+        }
+    }
+
+    // Most tasks go; the store compacts its pool on its own along the way
+    for (int f = 0; f < 3; f++) {
+        while (store.folders[f].task_count > 20) {
+            CHECK(store_delete_task(&store, f, (int)(next_random() % (unsigned)store.folders[f].task_count)));
+        }
+        for (int i = 0; i < store.folders[f].task_count && kept < 64; i++) kept_ids[kept++] = store.folders[f].rows[i];
+    }
+    CHECK(!strpool_wasteful(&store.strings));
+
+    // And compacting again on request keeps every text, id and row
+    before = dump_store(&store);
+    store_compact_strings(&store);
+    after = dump_store(&store);
+    CHECK(strcmp(before, after) == 0);
+    CHECK(store.strings.size == store.strings.live);
+    kept = 0;
+    for (int f = 0; f < 3; f++) {
+        for (int i = 0; i < store.folders[f].task_count && kept < 64; i++) {
+            CHECK(store.folders[f].rows[i] == kept_ids[kept++]);
+        }
+    }
+    free(before);
+    free(after);
+    store_release(&store);
+    return 0;
+}
+
+int main(void) {
+    seed_random(10);
+    RUN(test_compaction_round_trip);
+    RUN(test_utf8);
+    RUN(test_store_compaction);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,355 @@
+// Tests for the tag index (todo_tags.c) and its bitmaps (todo_bitmap.c).
+//
+// Bitmaps with sparse and full containers, across several keys, are
+// checked against a plain array of flags after every kind of change and
+// set operation. Tag filters, run over the index and on each task alone,
+// are checked against a scan of every task, before and after tasks are
+// completed, retagged, added and deleted.
+//
+//   gcc -std=c99 -Wall -pthread -I. -o test_tags tests/test_tags.c todo_tags.c todo_bitmap.c todo_core.c
+//       todo_format.c todo_slots.c todo_sort.c todo_recur.c todo_lz.c todo_journal.c todo_thread.c
+//       todo_date.c todo_trace.c todo_strings.c
+//   ./test_tags
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "todo_bitmap.h"
+#include "todo_core.h"
+#include "todo_slots.h"
+#include "todo_tags.h"
+#include "todo_test.h"
+
+#define KEYS 6
+#define UNIVERSE (KEYS * 65536)
+#define FOLDERS 3
+#define TASKS_PER_FOLDER 3000
+
+static const uint32_t keys[KEYS] = { 0, 1, 2, 7, 300, 65535 };
+
+// Bitmap values and their places in the flag arrays
+static uint32_t value_at(uint32_t place) {
+    return keys[place >> 16] << 16 | (place & 0xFFFF);
+}
+
+static uint32_t random_place(int mode) {
+    switch (mode) {
+        case 0:     // Sparse, over every key
+            return next_random() % UNIVERSE;
+        case 1:     // Dense in one key
+            return 65536 + next_random() % 20000;
+        default:    // Runs at the ends of the range
+            return next_random() % 2 ? next_random() % 9000 : UNIVERSE - 1 - next_random() % 9000;
+    }
+}
+
+static int same_as_flags(const TodoBitmap *bitmap, const unsigned char *flags) {
+    static uint32_t values[UNIVERSE];
+    size_t count = bitmap_values(bitmap, values, UNIVERSE);
+    size_t next = 0;
+
+    CHECK(bitmap_count(bitmap) == count);
+    for (uint32_t place = 0; place < UNIVERSE; place++) {
+        if (!flags[place]) continue;
+        CHECK(next < count && values[next++] == value_at(place));
+    }
+    CHECK(next == count);
+    for (int probe = 0; probe < 2000; probe++) {
+        uint32_t place = next_random() % UNIVERSE;
+
+        CHECK(bitmap_contains(bitmap, value_at(place)) == flags[place]);
+    }
+    CHECK(!bitmap_contains(bitmap, 3u << 16) && !bitmap_contains(bitmap, 0xFFFEFFFFu));
+    return 0;
+}
+
+static void fill(TodoBitmap *bitmap, unsigned char *flags, int mode, int count) {
+    memset(flags, 0, UNIVERSE);
+    bitmap_free(bitmap);
+    for (int i = 0; i < count; i++) {
+        uint32_t place = random_place(mode);
+
+        bitmap_add(bitmap, value_at(place));
+        flags[place] = 1;
+    }
+}
+
+static int test_bitmap_changes(void) {
+    static unsigned char flags[UNIVERSE];
+    TodoBitmap bitmap, copy;
+
+    bitmap_init(&bitmap);
+    bitmap_init(&copy);
+    for (int mode = 0; mode < 3; mode++) {
+        fill(&bitmap, flags, mode, mode == 0 ? 3000 : 40000);
+        if (same_as_flags(&bitmap, flags) != 0) return 1;
+
+        // Adding twice and removing what is absent change nothing
+        for (uint32_t place = 0; place < UNIVERSE; place += 997) {
+            if (flags[place]) CHECK(bitmap_add(&bitmap, value_at(place)));
+            else bitmap_remove(&bitmap, value_at(place));
+        }
+        if (same_as_flags(&bitmap, flags) != 0) return 1;
+
+        // Thin a full container out below the array limit, then fill it again
+        for (int i = 0; i < 60000; i++) {
+            uint32_t place = random_place(mode);
+
+            bitmap_remove(&bitmap, value_at(place));
+            flags[place] = 0;
+        }
+        if (same_as_flags(&bitmap, flags) != 0) return 1;
+        for (int i = 0; i < 20000; i++) {
+            uint32_t place = random_place(mode);
+
+            CHECK(bitmap_add(&bitmap, value_at(place)));
+            flags[place] = 1;
+        }
+        if (same_as_flags(&bitmap, flags) != 0) return 1;
+
+        CHECK(bitmap_copy(&copy, &bitmap));
+        bitmap_free(&bitmap);
+        CHECK(bitmap_count(&bitmap) == 0 && bitmap_memory(&bitmap) == 0);
+        if (same_as_flags(&copy, flags) != 0) return 1;
+        CHECK(bitmap_copy(&bitmap, &copy));
+    }
+    bitmap_free(&bitmap);
+    bitmap_free(&copy);
+    return 0;
+}
+
+static int test_bitmap_operations(void) {
+    static unsigned char a_flags[UNIVERSE], b_flags[UNIVERSE], expected[UNIVERSE];
+    static const int sizes[] = { 0, 1, 300, 4096, 4097, 30000 };
+    TodoBitmap a, b, out;
+
+    bitmap_init(&a);
+    bitmap_init(&b);
+    bitmap_init(&out);
+    for (int round = 0; round < 36; round++) {
+        fill(&a, a_flags, round % 3, sizes[round % 6]);
+        fill(&b, b_flags, round / 3 % 3, sizes[round / 6]);
+
+        // out is reused, so it holds the last result going in
+        CHECK(bitmap_and(&out, &a, &b));
+        for (uint32_t place = 0; place < UNIVERSE; place++) expected[place] = a_flags[place] & b_flags[place];
+        if (same_as_flags(&out, expected) != 0) return 1;
+        CHECK(bitmap_or(&out, &a, &b));
+        for (uint32_t place = 0; place < UNIVERSE; place++) expected[place] = a_flags[place] | b_flags[place];
+        if (same_as_flags(&out, expected) != 0) return 1;
+        CHECK(bitmap_andnot(&out, &a, &b));
+        for (uint32_t place = 0; place < UNIVERSE; place++) expected[place] = a_flags[place] & !b_flags[place];
+        if (same_as_flags(&out, expected) != 0) return 1;
+        CHECK(bitmap_andnot(&out, &a, &a) && bitmap_count(&out) == 0);
+    }
+    bitmap_free(&a);
+    bitmap_free(&b);
+    bitmap_free(&out);
+    return 0;
+}
+
+typedef int (*TagPredicate)(const char *tags, size_t length, int completed);
+
+static int has(const char *tags, size_t length, const char *name) {
+    return tags_contains(tags, length, name, strlen(name));
+}
+
+static int work(const char *t, size_t n, int done) {
+    (void)done;
+    return has(t, n, "work");
+}
+
+static int work_not_waiting(const char *t, size_t n, int done) {
+    (void)done;
+    return has(t, n, "work") && !has(t, n, "waiting");
+}
+
+static int work_urgent_or_today_open(const char *t, size_t n, int done) {
+    return has(t, n, "work") && !has(t, n, "waiting") && (has(t, n, "urgent") || has(t, n, "today")) && !done;
+}
+
+static int done_or_home(const char *t, size_t n, int done) {
+    return done || has(t, n, "home");
+}
+
+static int not_both(const char *t, size_t n, int done) {
+    (void)done;
+    return !(has(t, n, "home") && has(t, n, "work"));
+}
+
+static int neither(const char *t, size_t n, int done) {
+    (void)done;
+    return !has(t, n, "home") && !has(t, n, "work");
+}
+
+static int umlaut_or_open(const char *t, size_t n, int done) {
+    return has(t, n, "ärger") || !done;
+}
+
+static int unused_tag(const char *t, size_t n, int done) {
+    (void)t;
+    (void)n;
+    (void)done;
+    return 0;
+}
+
+static const struct {
+    const char *text;
+    TagPredicate matches;
+} filters[] = {
+    { "#work", work },
+    { "@WORK", work },
+    { "#work -#waiting", work_not_waiting },
+    { "#work -#waiting (#urgent or @today) open", work_urgent_or_today_open },
+    { "#work and not #waiting & (#urgent | #today) and OPEN", work_urgent_or_today_open },
+    { "done | #home", done_or_home },
+    { "not (#home #work)", not_both },
+    { "!#home & !#work", neither },
+    { "#ärger or open", umlaut_or_open },
+    { "#nobody", unused_tag },
+};
+
+static const char *const tag_sets[] = {
+    "", "home", "work", "home work", "urgent work", "today waiting work", "ärger", "home today urgent"
+};
+
+// The filter against a look at every task, over all folders and each one
+static int check_filters(TodoStore *store, const TodoTagIndex *index) {
+    static uint32_t found[FOLDERS * TASKS_PER_FOLDER * 2], expected[FOLDERS * TASKS_PER_FOLDER * 2];
+    TodoBitmap matches;
+
+    bitmap_init(&matches);
+    for (size_t i = 0; i < sizeof(filters) / sizeof(filters[0]); i++) {
+        TodoTagFilter *filter;
+
+        CHECK(tags_parse(filters[i].text, &filter) == TAGS_OK);
+        for (int scope = -1; scope < store->folder_count; scope++) {
+            size_t count = 0, want = 0;
+
+            for (int f = 0; f < store->folder_count; f++) {
+                const Folder *folder = &store->folders[f];
+
+                if (scope >= 0 && f != scope) continue;
+                for (int row = 0; row < folder->task_count; row++) {
+                    const Task *task = store_task(store, folder, row);
+
+                    int matches = filters[i].matches(store_text(store, task->tags), task->tags.length,
+                                                     task->completed);
+
+                    CHECK(tags_filter_matches(filter, store_text(store, task->tags), task->tags.length,
+                                              task->completed) == matches);
+                    if (matches) expected[want++] = SLOTS_INDEX(task->id);
+                }
+            }
+            for (size_t a = 1; a < want; a++) {
+                uint32_t value = expected[a];
+                size_t b = a;
+
+                for (; b > 0 && expected[b - 1] > value; b--) expected[b] = expected[b - 1];
+                expected[b] = value;
+            }
+            CHECK(tags_filter(index, filter, scope < 0 ? 0 : store->folders[scope].id, &matches));
+            count = bitmap_values(&matches, found, sizeof(found) / sizeof(found[0]));
+            if (count != want || memcmp(found, expected, count * sizeof(uint32_t)) != 0) {
+                fprintf(stderr, "filter \"%s\", folder %d: %zu tasks, expected %zu\n", filters[i].text, scope,
+                        count, want);
+                return 1;
+            }
+        }
+        tags_free_filter(filter);
+    }
+    bitmap_free(&matches);
+    return 0;
+}
+
+static int test_filters(void) {
+    static TodoStore store;
+    TodoTagIndex *index;
+    TodoTagFilter *filter;
+
+    store_init(&store);
+    for (int f = 0; f < FOLDERS; f++) {
+        char name[24];
+
+        snprintf(name, sizeof(name), "List %d", f);
+        CHECK(store_create_folder(&store, 0, name) == f);
+        for (int i = 0; i < TASKS_PER_FOLDER; i++) {
+            // Lists lean toward different tags, so some postings fill
+            // their containers and some stay sparse
+            int set = f == 1 && i % 3 ? 3 : (int)(next_random() % 8);
+
+            CHECK(store_insert_task(&store, f, -1, "task", DATE_NONE, next_random() % 3 == 0, PRIORITY_NONE,
+                                    tag_sets[set], NULL));
+        }
+    }
+    index = tags_create(&store);
+    CHECK(index != NULL);
+    CHECK(tags_count(index) == 6);
+    CHECK(bitmap_count(tags_tasks(index, "home")) > BITMAP_ARRAY_MAX);
+    CHECK(tags_tasks(index, "nobody") == NULL);
+    if (check_filters(&store, index) != 0) return 1;
+
+    // The index follows every change to the store
+    for (int i = 0; i < 2000; i++) {
+        int f = (int)(next_random() % FOLDERS);
+        int row = store.folders[f].task_count ? (int)(next_random() % (unsigned)store.folders[f].task_count) : 0;
+        unsigned pick = next_random() % 5;
+
+        if (pick == 0 && store.folders[f].task_count) {
+            store_complete_task(&store, f, row);
+        } else if (pick == 1 && store.folders[f].task_count) {
+            store_reopen_task(&store, f, row, -1);
+        } else if (pick == 2 && store.folders[f].task_count) {
+            CHECK(store_tag_task(&store, f, row, tag_sets[next_random() % 8]));
+        } else if (pick == 3 && store.folders[f].task_count) {
+            CHECK(store_delete_task(&store, f, row));
+        } else {
+            CHECK(store_insert_task(&store, f, -1, "new", DATE_NONE, 0, PRIORITY_NONE, tag_sets[next_random() % 8],
+                                    NULL));
+        }
+    }
+    if (check_filters(&store, index) != 0) return 1;
+    CHECK(store_delete_folder(&store, 1));
+    if (check_filters(&store, index) != 0) return 1;
+
+    CHECK(tags_parse("#work (", &filter) == TAGS_ERR_SYNTAX);
+    CHECK(tags_parse("#work or", &filter) == TAGS_ERR_SYNTAX);
+    CHECK(tags_parse("#work )", &filter) == TAGS_ERR_SYNTAX);
+    CHECK(tags_parse("work", &filter) == TAGS_ERR_SYNTAX);
+    CHECK(tags_parse("#", &filter) == TAGS_ERR_SYNTAX);
+    CHECK(tags_is_filter("#work") && tags_is_filter(" (-@home)") && !tags_is_filter("pay rent"));
+
+    tags_destroy(index);
+    store_release(&store);
+    return 0;
+}
+
+static int test_canonical(void) {
+    char out[TAGS_TEXT_LENGTH];
+
+    CHECK(tags_normalize("#Work, @home  work\thome", out) && strcmp(out, "home work") == 0);
+    CHECK(tags_normalize("", out) && out[0] == '\0');
+    CHECK(tags_normalize("zeta ärger alpha", out) && strcmp(out, "alpha zeta ärger") == 0);
+    CHECK(!tags_normalize("bad(tag)", out));
+    CHECK(tags_valid("", 0) && tags_valid("home work", 9));
+    CHECK(!tags_valid("work home", 9) && !tags_valid("home  work", 10) && !tags_valid("Home", 4));
+    CHECK(!tags_valid("home home", 9) && !tags_valid(" home", 5) && !tags_valid("home ", 5));
+    CHECK(tags_contains("home work", 9, "work", 4) && !tags_contains("homework", 8, "work", 4));
+    CHECK(!tags_contains("home work", 9, "hom", 3));
+    return 0;
+}
+
+int main(void) {
+    seed_random(4242);
+    RUN(test_bitmap_changes);
+    RUN(test_bitmap_operations);
+    RUN(test_canonical);
+    RUN(test_filters);
+    printf("ok\n");
+    return 0;
+}
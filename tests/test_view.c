@@ -0,0 +1,350 @@
+// Tests for the list view model (todo_view.c).
+//
+// A task list and a folder list follow the store through its change
+// notifications while tasks are added, completed, reopened, deleted and
+// retagged, one at a time and in batches, and lists come and go. The ops
+// each change queues are applied to a stand-in for the listbox, which
+// paints a window of rows and keeps what it painted. After every change
+// it must have as many rows as the data, and every row it painted and
+// was not told to repaint must still read as the data formats now. A
+// change queues only the rows it touches: one insert for an add, nothing
+// for a row never shown, nothing for a row whose text stays the same.
+//
+//   gcc -std=c99 -Wall -pthread -I. -o test_view tests/test_view.c todo_view.c todo_due.c todo_stats.c
+//       todo_batch.c todo_history.c todo_core.c todo_format.c todo_slots.c todo_sort.c todo_recur.c
+//       todo_lz.c todo_journal.c todo_thread.c todo_date.c todo_trace.c todo_strings.c todo_tags.c
+//       todo_bitmap.c
+//   ./test_view
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "todo_batch.h"
+#include "todo_core.h"
+#include "todo_date.h"
+#include "todo_due.h"
+#include "todo_test.h"
+#include "todo_view.h"
+
+#define FOLDERS 3
+#define TASKS_PER_FOLDER 50
+#define STEPS 3000
+#define WINDOW 20           // Rows the listbox paints at a time
+
+static const char *descriptions[] = { "Call mum", "Pay rent", "Report", "Gym", "Read" };
+static const char *tag_sets[] = { "", "home", "home work", "work" };
+
+static TodoStore store;
+static int32_t today;
+
+// What the listbox shows: the text of each row it painted, NULL for a row
+// it has yet to paint
+typedef struct {
+    char **rows;
+    int count;
+    int capacity;
+    int top;                // First row of the painted window
+} Listbox;
+
+static void format_task_row(void *context, int row, char *text) {
+    const Task *task = store_task(&store, &store.folders[*(const int *)context], row);
+
+    view_format_task(&store, task, due_state(task, today), text);
+}
+
+static void format_folder_row(void *context, int row, char *text) {
+    (void)context;
+    view_format_folder(&store, &store.folders[row], NULL, text);
+}
+
+typedef struct {
+    TodoView *tasks;
+    TodoView *folders;
+    int folder;             // Whose tasks are shown
+} Follower;
+
+static void follow(void *context, const TodoStoreChange *change) {
+    Follower *follower = (Follower *)context;
+
+    view_follow_tasks(follower->tasks, change, follower->folder);
+    view_follow_folders(follower->folders, change);
+}
+
+static void listbox_clear(Listbox *listbox) {
+    for (int i = 0; i < listbox->count; i++) free(listbox->rows[i]);
+    listbox->count = 0;
+}
+
+static void listbox_insert(Listbox *listbox, int row) {
+    if (listbox->count == listbox->capacity) {
+        listbox->capacity = listbox->capacity ? listbox->capacity * 2 : 64;
+        listbox->rows = (char **)realloc(listbox->rows, (size_t)listbox->capacity * sizeof(char *));
+    }
+    memmove(&listbox->rows[row + 1], &listbox->rows[row], (size_t)(listbox->count - row) * sizeof(char *));
+    listbox->rows[row] = NULL;
+    listbox->count++;
+}
+
+static void listbox_remove(Listbox *listbox, int row) {
+    free(listbox->rows[row]);
+    memmove(&listbox->rows[row], &listbox->rows[row + 1], (size_t)(listbox->count - row - 1) * sizeof(char *));
+    listbox->count--;
+}
+
+// Apply the view's ops, or its rows in full after a rebuild, as the GUI
+// does, then paint the window
+static int listbox_sync(Listbox *listbox, TodoView *view) {
+    if (view->rebuilt) {
+        listbox_clear(listbox);
+        for (int i = 0; i < view->count; i++) listbox_insert(listbox, i);
+    } else {
+        for (int i = 0; i < view->op_count; i++) {
+            const TodoViewOp *op = &view->ops[i];
+
+            if (op->op == VIEW_OP_INSERT) {
+                CHECK(op->row >= 0 && op->row <= listbox->count);
+                listbox_insert(listbox, op->row);
+            } else {
+                CHECK(op->row >= 0 && op->row < listbox->count);
+                if (op->op == VIEW_OP_REMOVE) {
+                    listbox_remove(listbox, op->row);
+                } else {
+                    free(listbox->rows[op->row]);
+                    listbox->rows[op->row] = NULL;
+                }
+            }
+        }
+    }
+    view_clear_ops(view);
+    CHECK(listbox->count == view->count);
+
+    if (listbox->top >= listbox->count) listbox->top = 0;
+    for (int i = listbox->top; i < listbox->count && i < listbox->top + WINDOW; i++) {
+        if (listbox->rows[i] == NULL) listbox->rows[i] = strdup(view_row_text(view, i));
+    }
+    return 0;
+}
+
+// Every painted row reads as the data formats it now, and the widest
+// formatted row is the one the view tracks
+static int listbox_matches(Listbox *listbox, TodoView *view, int rows) {
+    int widest = 0;
+
+    CHECK(listbox->count == rows && view->count == rows);
+    for (int i = 0; i < rows; i++) {
+        char text[VIEW_TEXT_LENGTH];
+
+        if (listbox->rows[i] != NULL) {
+            view->format(view->context, i, text);
+            CHECK(strcmp(listbox->rows[i], text) == 0);
+        }
+        if (view->rows[i].width != VIEW_UNFORMATTED) {
+            CHECK(view->rows[i].width == (int)strlen(strpool_text(&view->strings, view->rows[i].text)));
+            if (view->rows[i].width > widest) widest = view->rows[i].width;
+        }
+    }
+    CHECK(view->max_width == widest);
+    return 0;
+}
+
+static void fill_store(void) {
+    for (int f = 0; f < FOLDERS; f++) {
+        char name[24];
+
+        snprintf(name, sizeof(name), "List %d", f);
+        store_create_folder(&store, 0, name);
+        for (int i = 0; i < TASKS_PER_FOLDER; i++) {
+            int32_t deadline = next_random() % 5 == 0 ? DATE_NONE : today - 10 + (int32_t)(next_random() % 30);
+
+            store_insert_task(&store, f, -1, descriptions[next_random() % 5], deadline, next_random() % 3 == 0,
+                              (int)(next_random() % 4), tag_sets[next_random() % 4], NULL);
+        }
+    }
+}
+
+// Up to six changes to random tasks, committed as one batch
+static void random_batch(void) {
+    TodoBatch *batch = batch_begin(&store);
+    int changes = 1 + (int)(next_random() % 6);
+
+    if (batch == NULL) return;
+    for (int i = 0; i < changes; i++) {
+        int index = (int)(next_random() % (unsigned)store.folder_count);
+        int task_count = store.folders[index].task_count;
+        int row = task_count > 0 ? (int)(next_random() % (unsigned)task_count) : -1;
+        unsigned kind = next_random() % 5;
+
+        // Changes to a task the batch already changes are refused
+        if (kind == 0 || row < 0) {
+            batch_add_task(batch, index, "Batched", today + (int32_t)(next_random() % 9), PRIORITY_NONE, "", NULL);
+        } else if (kind == 1) {
+            batch_complete_task(batch, index, row);
+        } else if (kind == 2) {
+            batch_delete_task(batch, index, row);
+        } else if (kind == 3) {
+            batch_tag_task(batch, index, row, tag_sets[next_random() % 4]);
+        } else if (store.folder_count > 1) {
+            batch_move_task(batch, index, row, (index + 1) % store.folder_count);
+        }
+    }
+    batch_commit(batch, NULL, NULL, NULL);
+}
+
+// One random change to the store, the shown folder or the painted windows
+static void random_step(Follower *follower, Listbox *task_box) {
+    unsigned kind = next_random() % 100;
+    int index = (int)(next_random() % (unsigned)store.folder_count);
+    int task_count = store.folders[index].task_count;
+    int row = task_count > 0 ? (int)(next_random() % (unsigned)task_count) : -1;
+
+    if (kind < 5) {
+        task_box->top = (int)(next_random() % (unsigned)(store.folders[follower->folder].task_count + 1));
+    } else if (kind < 7) {
+        follower->folder = index;
+        view_rebuild(follower->tasks, task_count);
+    } else if (kind < 9 && store.folder_count < FOLDERS * 2) {
+        store_create_folder(&store, 0, "New");
+    } else if (kind < 11 && store.folder_count > 2 && index != follower->folder) {
+        store_delete_folder(&store, index);
+        if (index < follower->folder) follower->folder--;
+    } else if (kind < 25) {
+        random_batch();
+    } else if (kind < 45 || row < 0) {
+        store_insert_task(&store, index, -1, descriptions[next_random() % 5], today + (int32_t)(next_random() % 20) - 5,
+                          0, (int)(next_random() % 4), tag_sets[next_random() % 4], NULL);
+    } else if (kind < 60) {
+        store_complete_task(&store, index, row);
+    } else if (kind < 70) {
+        store_reopen_task(&store, index, row, -1);
+    } else if (kind < 80) {
+        store_tag_task(&store, index, row, tag_sets[next_random() % 4]);
+    } else {
+        store_delete_task(&store, index, row);
+    }
+}
+
+static int test_random_changes(void) {
+    static TodoView tasks, folders;
+    Listbox task_box, folder_box;
+    Follower follower;
+
+    today = date_from_civil(2024, 11, 4);
+    store_init(&store);
+    fill_store();
+    follower.tasks = &tasks;
+    follower.folders = &folders;
+    follower.folder = 0;
+    view_init(&tasks, format_task_row, NULL, &follower.folder);
+    view_init(&folders, format_folder_row, NULL, NULL);
+    memset(&task_box, 0, sizeof(task_box));
+    memset(&folder_box, 0, sizeof(folder_box));
+    CHECK(store_listen(&store, follow, &follower));
+    CHECK(view_rebuild(&tasks, store.folders[0].task_count));
+    CHECK(view_rebuild(&folders, store.folder_count));
+
+    for (int step = 0; step < STEPS; step++) {
+        random_step(&follower, &task_box);
+        CHECK(!tasks.stale && !folders.stale);
+        if (listbox_sync(&task_box, &tasks) != 0 || listbox_sync(&folder_box, &folders) != 0 ||
+            listbox_matches(&task_box, &tasks, store.folders[follower.folder].task_count) != 0 ||
+            listbox_matches(&folder_box, &folders, store.folder_count) != 0) {
+            fprintf(stderr, "after step %d\n", step);
+            return 1;
+        }
+    }
+
+    store_unlisten(&store, follow, &follower);
+    listbox_clear(&task_box);
+    listbox_clear(&folder_box);
+    free(task_box.rows);
+    free(folder_box.rows);
+    view_free(&tasks);
+    view_free(&folders);
+    store_release(&store);
+    return 0;
+}
+
+static int row_of(const Folder *folder, uint32_t task_id) {
+    for (int row = 0; row < folder->task_count; row++) {
+        if (folder->rows[row] == task_id) return row;
+    }
+    return -1;
+}
+
+// The ops single changes queue to a list whose rows are all painted
+static int test_minimal_ops(void) {
+    static TodoView view;
+    int folder = 0;
+    int row;
+    const Task *task;
+
+    today = date_from_civil(2025, 2, 10);
+    store_init(&store);
+    store_create_folder(&store, 0, "List");
+    for (int i = 0; i < 10; i++) {
+        store_insert_task(&store, 0, -1, descriptions[i % 5], today + i, 0, PRIORITY_NONE, "", NULL);
+    }
+    view_init(&view, format_task_row, NULL, &folder);
+    CHECK(view_rebuild(&view, 10));
+    view_clear_ops(&view);
+
+    // Rows never painted are formatted when shown, so changing them
+    // queues nothing
+    CHECK(store_tag_task(&store, 0, 3, "home"));
+    view_update(&view, 3);
+    CHECK(view.op_count == 0);
+    for (int i = 0; i < view.count; i++) view_row_text(&view, i);
+
+    // An add is one insert where the task went
+    CHECK(store_insert_task(&store, 0, -1, "Middle", today + 4, 0, PRIORITY_NONE, "", NULL));
+        CHECK(view_insert(&view, 5));
+    CHECK(strcmp(store_text(&store, store_task(&store, &store.folders[0], 5)->description), "Middle") == 0);
+    CHECK(view.op_count == 1 && view.ops[0].op == VIEW_OP_INSERT && view.ops[0].row == 5);
+    view_clear_ops(&view);
+    view_row_text(&view, 5);
+
+    // A retag keeps its row and repaints it; the same tags again change
+    // nothing that shows
+    CHECK(store_tag_task(&store, 0, 2, "work"));
+    CHECK(view_update(&view, 2));
+    CHECK(view.op_count == 1 && view.ops[0].op == VIEW_OP_UPDATE && view.ops[0].row == 2);
+    view_clear_ops(&view);
+    CHECK(store_tag_task(&store, 0, 2, "work"));
+    CHECK(view_update(&view, 2));
+    CHECK(view.op_count == 0);
+
+    // A completed task moves to the end: one remove and one insert
+    task = store_task(&store, &store.folders[0], 0);
+    CHECK(store_complete_task(&store, 0, 0));
+    row = row_of(&store.folders[0], task->id);
+    CHECK(row == view.count - 1);
+    CHECK(view_move(&view, 0, row));
+    CHECK(view.op_count == 2);
+    CHECK(view.ops[0].op == VIEW_OP_REMOVE && view.ops[0].row == 0);
+    CHECK(view.ops[1].op == VIEW_OP_INSERT && view.ops[1].row == row);
+    view_clear_ops(&view);
+
+    // A delete is one remove
+    CHECK(store_delete_task(&store, 0, 4));
+    CHECK(view_remove(&view, 4));
+    CHECK(view.op_count == 1 && view.ops[0].op == VIEW_OP_REMOVE && view.ops[0].row == 4);
+    view_clear_ops(&view);
+    CHECK(view.count == store.folders[0].task_count);
+
+    view_free(&view);
+    store_release(&store);
+    return 0;
+}
+
+int main(void) {
+    seed_random(6);
+    RUN(test_random_changes);
+    RUN(test_minimal_ops);
+    printf("ok\n");
+    return 0;
+}
@@ -0,0 +1,42 @@
+#ifndef TODO_TEST_H
+#define TODO_TEST_H
+
+// Checks shared by the headless tests in this directory.
+//
+// Each test is a standalone program over the core modules. It prints "ok"
+// and exits with 0, or names the first check that failed and exits with 1.
+// Checks return from the function they are in, so each test case is a
+// function returning 0 on success.
+
+#include <stdio.h>
+
+// Repeatable pseudo-random numbers from a linear congruential generator;
+// each test seeds it once at the start of main()
+static unsigned random_state = 1;
+
+static inline void seed_random(unsigned seed) {
+    random_state = seed;
+}
+
+static inline unsigned next_random(void) {
+    random_state = random_state * 1103515245u + 12345u;
+    return random_state >> 8;
+}
+
+#define CHECK(condition) do {                                                   \
+        if (!(condition)) {                                                     \
+            fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,   \
+                    #condition);                                                \
+            return 1;                                                           \
+        }                                                                       \
+    } while (0)
+
+// Run a test case function; the first failure ends the program
+#define RUN(test) do {                                                          \
+        if ((test)() != 0) {                                                    \
+            fprintf(stderr, "%s failed\n", #test);                              \
+            return 1;                                                           \
+        }                                                                       \
+    } while (0)
+
+#endif
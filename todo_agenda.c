@@ -0,0 +1,234 @@
+#include "todo_agenda.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+TodoAgendaQuery agenda_upcoming(int32_t today, int days) {
+    TodoAgendaQuery query;
+
+    query.from = today;
+    query.to = today + days;
+    query.incomplete_only = 1;
+    return query;
+}
+
+TodoAgendaQuery agenda_overdue(int32_t today) {
+    TodoAgendaQuery query;
+
+    query.from = DATE_NONE + 1;     // Tasks without a deadline are never overdue
+    query.to = today;
+    query.incomplete_only = 1;
+    return query;
+}
+
+// Deadline of a row, from the store or from the folder's section
+static int32_t deadline_at(const TodoAgenda *agenda, int folder, const TodoDeadlineView *section, int pos) {
+    if (section != NULL) return todofmt_view_deadline(section, (uint32_t)pos);
+    return store_task(agenda->store, &agenda->store->folders[folder], pos)->deadline_day;
+}
+
+// First position in [low, high) whose deadline is not below day
+static int lower_bound(const TodoAgenda *agenda, int folder, const TodoDeadlineView *section, int low, int high,
+                       int32_t day) {
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (deadline_at(agenda, folder, section, mid) < day) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Heap order: deadline, then folder, then position within the folder
+static int run_before(const TodoAgendaRun *a, const TodoAgendaRun *b) {
+    if (a->deadline != b->deadline) return a->deadline < b->deadline;
+    if (a->folder != b->folder) return a->folder < b->folder;
+    return a->pos < b->pos;
+}
+
+static void sift_down(TodoAgenda *agenda, int index) {
+    TodoAgendaRun *heap = agenda->heap;
+
+    for (;;) {
+        int smallest = index;
+        int left = 2 * index + 1;
+        int right = left + 1;
+        TodoAgendaRun swap;
+
+        if (left < agenda->heap_size && run_before(&heap[left], &heap[smallest])) smallest = left;
+        if (right < agenda->heap_size && run_before(&heap[right], &heap[smallest])) smallest = right;
+        if (smallest == index) return;
+        swap = heap[index];
+        heap[index] = heap[smallest];
+        heap[smallest] = swap;
+        index = smallest;
+    }
+}
+
+// Add the part of tasks [low, high) that falls in the query range
+static void add_run(TodoAgenda *agenda, int folder, const TodoDeadlineView *section, int low, int high,
+                    int32_t from) {
+    int start = lower_bound(agenda, folder, section, low, high, from);
+    TodoAgendaRun *run;
+
+    if (start == high || deadline_at(agenda, folder, section, start) >= agenda->to) return;
+    run = &agenda->heap[agenda->heap_size++];
+    run->deadline = deadline_at(agenda, folder, section, start);
+    run->folder = folder;
+    run->pos = start;
+    run->end = high;
+    run->rule = NULL;
+    run->section = section;
+}
+
+// Add the occurrences of an open repeating task at row after the one it
+// is due on that fall in the query range
+static void add_occurrences(TodoAgenda *agenda, int folder, int row, int32_t deadline, int completed,
+                            const TodoRecurrence *rule, int32_t from) {
+    TodoAgendaRun *run;
+    int32_t first;
+
+    if (rule == NULL || row < 0 || completed || deadline == DATE_NONE) return;
+    first = recur_first(rule, from > deadline ? from : deadline + 1);
+    if (first == DATE_NONE || first >= agenda->to) return;
+    run = &agenda->heap[agenda->heap_size++];
+    run->deadline = first;
+    run->folder = folder;
+    run->pos = row;
+    run->end = row + 1;
+    run->rule = rule;
+    run->section = NULL;
+}
+
+// The deadlines of a folder that is not loaded, which the data file keeps
+// from one query to the next. A damaged section reads as empty, as the
+// folder would load; one out of order is loaded, since loading sorts it.
+static const TodoDeadlineView *read_section(TodoStore *store, int index) {
+    Folder *folder = &store->folders[index];
+    const TodoDeadlineView *section;
+
+    if (folder->loaded || store->backing == NULL || folder->source_index < 0) return NULL;
+    section = todofmt_deadline_view(store->backing, (uint32_t)folder->source_index);
+    if (section != NULL && !section->in_order) {
+        store_materialize(store, index);
+        return NULL;
+    }
+    return section;
+}
+
+// Rows [0, count) of a folder hold its open tasks first; find where the
+// completed ones start
+static int completed_start(const TodoAgenda *agenda, int index, int count) {
+    const Folder *folder = &agenda->store->folders[index];
+    const TodoDeadlineView *section = agenda->sections[index];
+    int split = 0;
+
+    for (int high = count; split < high;) {
+        int mid = split + (high - split) / 2;
+        int completed = section != NULL ? todofmt_view_completed(section, (uint32_t)mid)
+                                        : store_task(agenda->store, folder, mid)->completed;
+
+        if (!completed) {
+            split = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return split;
+}
+
+int agenda_begin(TodoAgenda *agenda, TodoStore *store, const TodoAgendaQuery *query) {
+    int needed = store->folder_count * (query->incomplete_only ? 1 : 2);
+
+    memset(agenda, 0, sizeof(*agenda));
+    agenda->store = store;
+    agenda->to = query->to;
+    if (query->from >= query->to) return 1;
+
+    agenda->sections = (const TodoDeadlineView **)calloc((size_t)(store->folder_count > 0 ? store->folder_count : 1),
+                                                         sizeof(TodoDeadlineView *));
+    if (agenda->sections == NULL) return 0;
+    for (int i = 0; i < store->folder_count; i++) {
+        agenda->sections[i] = read_section(store, i);
+        if (store->folders[i].loaded) {
+            needed += store->folders[i].recurring_count;
+        } else if (agenda->sections[i] != NULL) {
+            needed += (int)agenda->sections[i]->rule_count;
+        }
+    }
+    agenda->heap = (TodoAgendaRun *)malloc((size_t)(needed > 0 ? needed : 1) * sizeof(TodoAgendaRun));
+    if (agenda->heap == NULL) {
+        agenda_end(agenda);
+        return 0;
+    }
+
+    for (int i = 0; i < store->folder_count; i++) {
+        const Folder *folder = &store->folders[i];
+        const TodoDeadlineView *section = agenda->sections[i];
+        int count = folder->loaded ? folder->task_count : section != NULL ? (int)section->count : 0;
+        int split = completed_start(agenda, i, count);
+
+        add_run(agenda, i, section, 0, split, query->from);
+        if (!query->incomplete_only) {
+            add_run(agenda, i, section, split, count, query->from);
+        }
+        if (folder->loaded) {
+            for (int r = 0; r < folder->recurring_count; r++) {
+                const Task *task = store_find_task(store, folder->recurring[r]);
+
+                if (task == NULL) continue;
+                add_occurrences(agenda, i, store_task_row(store, i, task->id), task->deadline_day, task->completed,
+                                store_task_rule(store, task), query->from);
+            }
+        } else if (section != NULL) {
+            for (uint32_t r = 0; r < section->rule_count; r++) {
+                uint32_t row = section->rules[r].task;
+
+                add_occurrences(agenda, i, (int)row, todofmt_view_deadline(section, row),
+                                todofmt_view_completed(section, row), &section->rules[r].rule, query->from);
+            }
+        }
+    }
+
+    for (int i = agenda->heap_size / 2 - 1; i >= 0; i--) {
+        sift_down(agenda, i);
+    }
+    return 1;
+}
+
+size_t agenda_next_page(TodoAgenda *agenda, TodoAgendaItem *items, size_t max) {
+    size_t count = 0;
+
+    while (count < max && agenda->heap_size > 0) {
+        TodoAgendaRun *top = &agenda->heap[0];
+        items[count].folder = top->folder;
+        items[count].task = top->pos;
+        items[count].deadline = top->deadline;
+        count++;
+
+        // Advance the run, or drop it once it leaves the range
+        if (top->rule != NULL) {
+            top->deadline = recur_next(top->rule, top->deadline);
+            if (top->deadline == DATE_NONE) top->deadline = agenda->to;
+        } else if (++top->pos < top->end) {
+            top->deadline = deadline_at(agenda, top->folder, top->section, top->pos);
+        } else {
+            top->deadline = agenda->to;
+        }
+        if (top->deadline >= agenda->to) {
+            agenda->heap[0] = agenda->heap[--agenda->heap_size];
+        }
+        sift_down(agenda, 0);
+    }
+    return count;
+}
+
+void agenda_end(TodoAgenda *agenda) {
+    free(agenda->sections);
+    free(agenda->heap);
+    agenda->sections = NULL;
+    agenda->heap = NULL;
+    agenda->heap_size = 0;
+}
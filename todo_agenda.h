@@ -0,0 +1,72 @@
+#ifndef TODO_AGENDA_H
+#define TODO_AGENDA_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "todo_core.h"
+#include "todo_format.h"
+
+// Cross-folder agenda. Every folder is already ordered by completion and
+// then deadline, so its incomplete and its completed tasks each form a run
+// sorted by deadline. A query binary-searches the start of each run, so
+// beginning one costs a search per folder, and merges the runs with a
+// min-heap, producing tasks in deadline order one page at a time; past
+// those searches no task beyond the requested page is visited.
+//
+// An open repeating task is stored once, due on its next occurrence. Its
+// later occurrences are expanded from its rule as the cursor reaches them,
+// each as one more run, so they cost nothing outside the page and only
+// repeating tasks are looked at to find them.
+//
+// Folders that are not loaded are not loaded for the agenda: their runs
+// are searched in their data file section (see todofmt_deadline_view()),
+// whose rows are in the order the folder gets once loaded. The data file
+// keeps what it read of each section for the next query. Loading a folder
+// to show a task from a page therefore keeps the cursor valid; any other
+// change to the store, or a new data file, ends it.
+
+typedef struct {
+    int32_t from;           // Deadlines in [from, to)
+    int32_t to;
+    int incomplete_only;
+} TodoAgendaQuery;
+
+// A task, or for a repeating task one of its occurrences: the same row
+// comes back once per occurrence, with deadline telling them apart
+typedef struct {
+    int folder;
+    int task;
+    int32_t deadline;
+} TodoAgendaItem;
+
+typedef struct {
+    int32_t deadline;       // Deadline of the task at pos
+    int folder;
+    int pos;
+    int end;
+    const TodoRecurrence *rule;     // Occurrences of the repeating task at pos, else NULL
+    const TodoDeadlineView *section;    // The section of a folder not loaded, else NULL
+} TodoAgendaRun;
+
+typedef struct {
+    const TodoStore *store;
+    int32_t to;
+    TodoAgendaRun *heap;
+    int heap_size;
+    const TodoDeadlineView **sections;  // Per folder; NULL for loaded ones
+} TodoAgenda;
+
+// Incomplete tasks due in [today, today + days)
+TodoAgendaQuery agenda_upcoming(int32_t today, int days);
+// Incomplete tasks whose deadline has passed
+TodoAgendaQuery agenda_overdue(int32_t today);
+
+// Position a cursor at the first matching task. A folder is only loaded
+// when its section is not in display order, as in a converted file.
+int agenda_begin(TodoAgenda *agenda, TodoStore *store, const TodoAgendaQuery *query);
+// Store up to max items in deadline order; returns how many, 0 at the end.
+// An item's row is only in the store once its folder is loaded.
+size_t agenda_next_page(TodoAgenda *agenda, TodoAgendaItem *items, size_t max);
+void agenda_end(TodoAgenda *agenda);
+
+#endif
@@ -0,0 +1,325 @@
+#include "todo_batch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define NO_TEXT SIZE_MAX
+
+// What an entry changes: a folder index, and the task's handle or 0 for an
+// add
+typedef struct {
+    int index;
+    uint32_t task_id;
+} BatchTarget;
+
+struct TodoBatch {
+    TodoStore *store;
+    TodoJournalEntry *entries;  // Text pointers are set by batch_entries()
+    size_t (*offsets)[2];       // Of each entry's text in text, NO_TEXT for none
+    BatchTarget *targets;       // Of each entry
+    int count;
+    int capacity;
+    char *text;                 // Every entry's text, terminated
+    size_t text_size;
+    size_t text_capacity;
+    int *changed;               // Per task slot: 1 + the entry that changes it, 0 for none
+    uint32_t slot_count;        // Slots in changed
+};
+
+static const TodoRecurrence no_rule;
+
+TodoBatch *batch_begin(TodoStore *store) {
+    TodoBatch *batch = (TodoBatch *)calloc(1, sizeof(TodoBatch));
+
+    if (batch == NULL) return NULL;
+    batch->store = store;
+    batch->slot_count = store->tasks.used + 1;
+    batch->changed = (int *)calloc(batch->slot_count, sizeof(int));
+    if (batch->changed == NULL) {
+        free(batch);
+        return NULL;
+    }
+    return batch;
+}
+
+void batch_abort(TodoBatch *batch) {
+    if (batch == NULL) return;
+    free(batch->entries);
+    free(batch->offsets);
+    free(batch->targets);
+    free(batch->text);
+    free(batch->changed);
+    free(batch);
+}
+
+// Copy text to the end of the batch's text; returns 0 when out of memory
+static int keep_text(TodoBatch *batch, const char *text, size_t *offset) {
+    size_t length;
+
+    *offset = NO_TEXT;
+    if (text == NULL) return 1;
+    length = strlen(text) + 1;
+    if (batch->text_size + length > batch->text_capacity) {
+        size_t capacity = batch->text_capacity ? batch->text_capacity : 1024;
+        char *grown;
+
+        while (capacity < batch->text_size + length) capacity *= 2;
+        grown = (char *)realloc(batch->text, capacity);
+        if (grown == NULL) return 0;
+        batch->text = grown;
+        batch->text_capacity = capacity;
+    }
+    memcpy(batch->text + batch->text_size, text, length);
+    *offset = batch->text_size;
+    batch->text_size += length;
+    return 1;
+}
+
+// Queue one journal entry. On failure the batch is left as it was.
+static int queue_entry(TodoBatch *batch, int op, int index, uint32_t task_id, int task_index, const char *text,
+                       const char *schedule) {
+    TodoJournalEntry *entry;
+    size_t text_size = batch->text_size;
+
+    if (batch->count == batch->capacity) {
+        int capacity = batch->capacity ? batch->capacity * 2 : 16;
+        TodoJournalEntry *entries = (TodoJournalEntry *)realloc(batch->entries,
+                                                                (size_t)capacity * sizeof(TodoJournalEntry));
+        size_t (*offsets)[2];
+        BatchTarget *targets;
+
+        if (entries == NULL) return 0;
+        batch->entries = entries;
+        offsets = (size_t (*)[2])realloc(batch->offsets, (size_t)capacity * sizeof(*offsets));
+        if (offsets == NULL) return 0;
+        batch->offsets = offsets;
+        targets = (BatchTarget *)realloc(batch->targets, (size_t)capacity * sizeof(BatchTarget));
+        if (targets == NULL) return 0;
+        batch->targets = targets;
+        batch->capacity = capacity;
+    }
+    if (!keep_text(batch, text, &batch->offsets[batch->count][0]) ||
+        !keep_text(batch, schedule, &batch->offsets[batch->count][1])) {
+        batch->text_size = text_size;
+        return 0;
+    }
+
+    batch->targets[batch->count].index = index;
+    batch->targets[batch->count].task_id = task_id;
+    entry = &batch->entries[batch->count++];
+    entry->op = op;
+    entry->folder_id = batch->store->folders[index].id;
+    entry->task_index = task_index;
+    entry->text[0] = NULL;
+    entry->text[1] = NULL;
+    return 1;
+}
+
+// Handle of the task at a row the batch has not changed yet, or 0
+static uint32_t claim_task(const TodoBatch *batch, int index, int task) {
+    const TodoStore *store = batch->store;
+    uint32_t task_id;
+
+    if (index < 0 || index >= store->folder_count || !store->folders[index].loaded) return 0;
+    if (task < 0 || task >= store->folders[index].task_count) return 0;
+    task_id = store->folders[index].rows[task];
+    return batch->changed[SLOTS_INDEX(task_id)] ? 0 : task_id;
+}
+
+// The task's description and deadline are what replay finds it by
+static int queue_task_entry(TodoBatch *batch, int op, int index, uint32_t task_id, int row) {
+    const Task *task = store_find_task(batch->store, task_id);
+    char deadline[DATE_TEXT_LENGTH];
+
+    date_format(task->deadline_day, deadline);
+    if (!queue_entry(batch, op, index, task_id, row, store_text(batch->store, task->description), deadline)) {
+        return 0;
+    }
+    batch->changed[SLOTS_INDEX(task_id)] = batch->count;
+    return 1;
+}
+
+int batch_add_task(TodoBatch *batch, int index, const char *description, int32_t deadline_day, int priority,
+                   const char *tags, const TodoRecurrence *repeat) {
+    char schedule[JOURNAL_SCHEDULE_LENGTH];
+
+    if (index < 0 || index >= batch->store->folder_count || !batch->store->folders[index].loaded) return 0;
+    if (priority < PRIORITY_NONE || priority > PRIORITY_HIGH || !date_valid(deadline_day)) return 0;
+    if (repeat != NULL && !recur_valid(repeat)) return 0;
+    if (tags != NULL && tags[0] != '\0' && !tags_valid(tags, strlen(tags))) return 0;
+    journal_format_schedule(deadline_day, repeat ? repeat : &no_rule, priority, tags, schedule);
+    return queue_entry(batch, JOURNAL_ADD_TASK, index, 0, -1, description, schedule);
+}
+
+int batch_complete_task(TodoBatch *batch, int index, int task) {
+    uint32_t task_id = claim_task(batch, index, task);
+
+    if (task_id == 0) return 0;
+    if (store_find_task(batch->store, task_id)->completed) return 1;
+    return queue_task_entry(batch, JOURNAL_COMPLETE_TASK, index, task_id, task);
+}
+
+// A reopened task goes back where the folder's order puts it
+int batch_reopen_task(TodoBatch *batch, int index, int task) {
+    uint32_t task_id = claim_task(batch, index, task);
+    const Task *reopened;
+    const TodoRecurrence *rule;
+
+    if (task_id == 0) return 0;
+    reopened = store_find_task(batch->store, task_id);
+    rule = store_task_rule(batch->store, reopened);
+    if (!reopened->completed && (rule == NULL || recur_previous(rule, reopened->deadline_day) == DATE_NONE)) return 1;
+    return queue_task_entry(batch, JOURNAL_REOPEN_TASK, index, task_id, -1);
+}
+
+int batch_delete_task(TodoBatch *batch, int index, int task) {
+    uint32_t task_id = claim_task(batch, index, task);
+
+    if (task_id == 0) return 0;
+    return queue_task_entry(batch, JOURNAL_DELETE_TASK, index, task_id, task);
+}
+
+int batch_tag_task(TodoBatch *batch, int index, int task, const char *tags) {
+    char schedule[JOURNAL_SCHEDULE_LENGTH];
+    uint32_t task_id = claim_task(batch, index, task);
+    const Task *tagged;
+
+    if (task_id == 0 || tags == NULL || (tags[0] != '\0' && !tags_valid(tags, strlen(tags)))) return 0;
+    tagged = store_find_task(batch->store, task_id);
+    // Only the deadline and the tags of the schedule are read back
+    journal_format_schedule(tagged->deadline_day, &no_rule, PRIORITY_NONE, tags, schedule);
+    if (!queue_entry(batch, JOURNAL_TAG_TASK, index, task_id, task, store_text(batch->store, tagged->description),
+                     schedule)) {
+        return 0;
+    }
+    batch->changed[SLOTS_INDEX(task_id)] = batch->count;
+    return 1;
+}
+
+// Deleted from its folder and added to the other one as it is, as undo
+// would restore it
+int batch_move_task(TodoBatch *batch, int index, int task, int to_index) {
+    char schedule[JOURNAL_SCHEDULE_LENGTH];
+    const TodoStore *store = batch->store;
+    uint32_t task_id = claim_task(batch, index, task);
+    const Task *moved;
+    const TodoRecurrence *rule;
+
+    if (task_id == 0 || to_index < 0 || to_index >= store->folder_count || to_index == index ||
+        !store->folders[to_index].loaded) {
+        return 0;
+    }
+    moved = store_find_task(store, task_id);
+    rule = store_task_rule(store, moved);
+    journal_format_schedule(moved->deadline_day, rule ? rule : &no_rule, moved->priority,
+                            store_text(store, moved->tags), schedule);
+    if (!queue_entry(batch, moved->completed ? JOURNAL_RESTORE_TASK : JOURNAL_ADD_TASK, to_index, 0, -1,
+                     store_text(store, moved->description), schedule)) {
+        return 0;
+    }
+    if (!queue_task_entry(batch, JOURNAL_DELETE_TASK, index, task_id, task)) {
+        batch->count--;
+        return 0;
+    }
+    return 1;
+}
+
+const TodoJournalEntry *batch_entries(TodoBatch *batch) {
+    for (int i = 0; i < batch->count; i++) {
+        for (int part = 0; part < 2; part++) {
+            size_t offset = batch->offsets[i][part];
+            batch->entries[i].text[part] = offset == NO_TEXT ? NULL : batch->text + offset;
+        }
+    }
+    return batch->entries;
+}
+
+int batch_count(const TodoBatch *batch) {
+    return batch->count;
+}
+
+// Folders final_rows() looks through
+enum {
+    SCAN_KEPT = 1,      // Holds tasks the batch changed but kept
+    SCAN_ADDED = 2      // Holds tasks the batch added
+};
+
+// The rows each entry's task ended up in once the batch has applied, from
+// one pass over each folder that holds one of them. Kept tasks are known
+// by their handles; the store numbers the tasks a batch adds in entry order
+// from sequence, so only folders with adds read their tasks.
+static int *final_rows(const TodoBatch *batch, uint32_t sequence) {
+    const TodoStore *store = batch->store;
+    int *rows = (int *)malloc((size_t)batch->count * sizeof(int));
+    int *added = (int *)malloc((size_t)batch->count * sizeof(int));
+    uint8_t *scan = (uint8_t *)calloc((size_t)store->folder_count + 1, 1);
+    int adds = 0;
+
+    if (rows == NULL || added == NULL || scan == NULL) {
+        free(rows);
+        rows = NULL;
+        goto done;
+    }
+    for (int i = 0; i < batch->count; i++) {
+        const BatchTarget *target = &batch->targets[i];
+
+        rows[i] = -1;
+        if (target->task_id == 0) {
+            added[adds++] = i;
+            scan[target->index] |= SCAN_ADDED;
+        } else if (batch->entries[i].op != JOURNAL_DELETE_TASK) {
+            scan[target->index] |= SCAN_KEPT;
+        }
+    }
+    for (int index = 0; index < store->folder_count; index++) {
+        const Folder *folder = &store->folders[index];
+
+        for (int row = 0; scan[index] && row < folder->task_count; row++) {
+            uint32_t task_id = folder->rows[row];
+            uint32_t slot = SLOTS_INDEX(task_id);
+
+            if (slot < batch->slot_count && batch->changed[slot] > 0 &&
+                batch->targets[batch->changed[slot] - 1].task_id == task_id) {
+                rows[batch->changed[slot] - 1] = row;
+            } else if (scan[index] & SCAN_ADDED) {
+                uint32_t offset = store_task(store, folder, row)->sequence - sequence;
+
+                if (offset < (uint32_t)adds) rows[added[offset]] = row;
+            }
+        }
+    }
+
+done:
+    free(added);
+    free(scan);
+    return rows;
+}
+
+int batch_commit(TodoBatch *batch, TodoHistory *history, TodoHistoryApply apply, void *context) {
+    const TodoJournalEntry *entries = batch_entries(batch);
+    TodoHistoryCommand *command = NULL;
+    uint32_t sequence = batch->store->next_sequence;
+    int ok;
+
+    // Out of memory, the batch still goes through but cannot be undone
+    if (history != NULL && batch->count > 0 && !history_add_batch(&command, batch->store, entries, batch->count)) {
+        command = NULL;
+    }
+    if (history != NULL) history_prepare(history, batch->store, command);
+    if (apply != NULL) {
+        ok = apply(context, entries, batch->count);
+    } else {
+        ok = journal_apply_batch(batch->store, entries, batch->count);
+    }
+    if (ok && command != NULL) {
+        int *rows = final_rows(batch, sequence);
+
+        if (rows != NULL) history_place_batch(command, rows);
+        free(rows);
+        history_push(history, command);
+    } else {
+        history_free_command(command);
+    }
+    batch_abort(batch);
+    return ok;
+}
@@ -0,0 +1,51 @@
+#ifndef TODO_BATCH_H
+#define TODO_BATCH_H
+
+#include <stdint.h>
+#include "todo_core.h"
+#include "todo_history.h"
+#include "todo_journal.h"
+
+// Batched task changes.
+//
+// Adds, completions, deletions, retags and moves of many tasks, in any
+// folders, are queued and committed together as one journal batch
+// (journal_record_batch()): the records go to the writer in one piece,
+// each touched folder is merged back into order once, listeners hear about
+// final rows only, and the whole batch is a single undo step. Either every
+// change applies or none does.
+//
+// Each change reads the store as it is when queued, so the store, and with
+// it every row, must not change between batch_begin() and batch_commit(). A task can be changed
+// once per batch.
+
+typedef struct TodoBatch TodoBatch;
+
+TodoBatch *batch_begin(TodoStore *store);
+
+// index is a loaded folder's index and task the row of one of its tasks.
+// Each returns 0 if the change cannot be queued, leaving the batch as it
+// was. repeat may be NULL for a task that does not repeat; tags must be
+// canonical, or NULL for none.
+int batch_add_task(TodoBatch *batch, int index, const char *description, int32_t deadline_day, int priority,
+                   const char *tags, const TodoRecurrence *repeat);
+// A task that is already completed, or has nothing to reopen, is left
+// alone and counts as queued
+int batch_complete_task(TodoBatch *batch, int index, int task);
+int batch_reopen_task(TodoBatch *batch, int index, int task);
+int batch_delete_task(TodoBatch *batch, int index, int task);
+int batch_tag_task(TodoBatch *batch, int index, int task, const char *tags);
+// Into another folder, keeping its state, schedule, priority and tags
+int batch_move_task(TodoBatch *batch, int index, int task, int to_index);
+
+// Journal entries queued so far; valid until the next change to the batch
+const TodoJournalEntry *batch_entries(TodoBatch *batch);
+int batch_count(const TodoBatch *batch);
+
+// Apply the batch through apply, normally journal_record_batch(), or with
+// journal_apply_batch() if apply is NULL, push it onto history as one undo
+// step unless history is NULL, and free it
+int batch_commit(TodoBatch *batch, TodoHistory *history, TodoHistoryApply apply, void *context);
+void batch_abort(TodoBatch *batch);
+
+#endif
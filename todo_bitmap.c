@@ -0,0 +1,538 @@
+#include "todo_bitmap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+// A map that falls back below this many values is turned back into an
+// array; the gap to BITMAP_ARRAY_MAX keeps a set that hovers around the
+// limit from converting on every change
+#define BITMAP_SHRINK_AT (BITMAP_ARRAY_MAX / 2)
+
+static uint32_t popcount(uint64_t word) {
+#if defined(__GNUC__)
+    return (uint32_t)__builtin_popcountll(word);
+#else
+    word = word - ((word >> 1) & 0x5555555555555555ull);
+    word = (word & 0x3333333333333333ull) + ((word >> 2) & 0x3333333333333333ull);
+    word = (word + (word >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+    return (uint32_t)((word * 0x0101010101010101ull) >> 56);
+#endif
+}
+
+static int lowest_bit(uint64_t word) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    int bit = 0;
+
+    while (!(word & 1)) {
+        word >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+void bitmap_init(TodoBitmap *bitmap) {
+    memset(bitmap, 0, sizeof(*bitmap));
+}
+
+static void free_container(TodoBitmapContainer *container) {
+    free(container->values);
+    free(container->bits);
+    memset(container, 0, sizeof(*container));
+}
+
+void bitmap_free(TodoBitmap *bitmap) {
+    for (uint32_t i = 0; i < bitmap->count; i++) {
+        free_container(&bitmap->containers[i]);
+    }
+    free(bitmap->containers);
+    bitmap_init(bitmap);
+}
+
+// Index of the container for key, or where it would go
+static int find_key(const TodoBitmap *bitmap, uint16_t key, uint32_t *at) {
+    uint32_t low = 0, high = bitmap->count;
+
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+
+        if (bitmap->containers[middle].key < key) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *at = low;
+    return low < bitmap->count && bitmap->containers[low].key == key;
+}
+
+static int find_value(const uint16_t *values, uint32_t count, uint16_t value, uint32_t *at) {
+    uint32_t low = 0, high = count;
+
+    while (low < high) {
+        uint32_t middle = low + (high - low) / 2;
+
+        if (values[middle] < value) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
+    }
+    *at = low;
+    return low < count && values[low] == value;
+}
+
+static int reserve_containers(TodoBitmap *bitmap, uint32_t needed) {
+    TodoBitmapContainer *grown;
+    uint32_t capacity;
+
+    if (needed <= bitmap->capacity) return 1;
+    capacity = bitmap->capacity ? bitmap->capacity * 2 : 4;
+    while (capacity < needed) capacity *= 2;
+    grown = (TodoBitmapContainer *)realloc(bitmap->containers, capacity * sizeof(TodoBitmapContainer));
+    if (grown == NULL) return 0;
+    bitmap->containers = grown;
+    bitmap->capacity = capacity;
+    return 1;
+}
+
+static void remove_container(TodoBitmap *bitmap, uint32_t at) {
+    free_container(&bitmap->containers[at]);
+    memmove(&bitmap->containers[at], &bitmap->containers[at + 1],
+            (bitmap->count - at - 1) * sizeof(TodoBitmapContainer));
+    bitmap->count--;
+}
+
+// Switch an array container to a map
+static int make_dense(TodoBitmapContainer *container) {
+    uint64_t *bits = (uint64_t *)calloc(BITMAP_WORDS, sizeof(uint64_t));
+
+    if (bits == NULL) return 0;
+    for (uint32_t i = 0; i < container->count; i++) {
+        bits[container->values[i] >> 6] |= 1ull << (container->values[i] & 63);
+    }
+    free(container->values);
+    container->values = NULL;
+    container->capacity = 0;
+    container->bits = bits;
+    container->dense = 1;
+    return 1;
+}
+
+// Switch a map container to an array of exactly its values
+static int make_sparse(TodoBitmapContainer *container) {
+    uint16_t *values = (uint16_t *)malloc((container->count > 0 ? container->count : 1) * sizeof(uint16_t));
+    uint32_t n = 0;
+
+    if (values == NULL) return 0;
+    for (uint32_t word = 0; word < BITMAP_WORDS; word++) {
+        for (uint64_t bits = container->bits[word]; bits != 0; bits &= bits - 1) {
+            values[n++] = (uint16_t)(word * 64 + lowest_bit(bits));
+        }
+    }
+    free(container->bits);
+    container->bits = NULL;
+    container->values = values;
+    container->capacity = container->count;
+    container->dense = 0;
+    return 1;
+}
+
+int bitmap_add(TodoBitmap *bitmap, uint32_t value) {
+    uint16_t key = (uint16_t)(value >> 16);
+    uint16_t low = (uint16_t)value;
+    TodoBitmapContainer *container;
+    uint32_t at, slot;
+
+    if (!find_key(bitmap, key, &at)) {
+        if (!reserve_containers(bitmap, bitmap->count + 1)) return 0;
+        memmove(&bitmap->containers[at + 1], &bitmap->containers[at],
+                (bitmap->count - at) * sizeof(TodoBitmapContainer));
+        memset(&bitmap->containers[at], 0, sizeof(TodoBitmapContainer));
+        bitmap->containers[at].key = key;
+        bitmap->count++;
+    }
+    container = &bitmap->containers[at];
+
+    if (!container->dense) {
+        if (find_value(container->values, container->count, low, &slot)) return 1;
+        if (container->count < BITMAP_ARRAY_MAX) {
+            if (container->count == container->capacity) {
+                uint32_t capacity = container->capacity ? container->capacity * 2 : 4;
+                uint16_t *grown;
+
+                if (capacity > BITMAP_ARRAY_MAX) capacity = BITMAP_ARRAY_MAX;
+                grown = (uint16_t *)realloc(container->values, capacity * sizeof(uint16_t));
+                if (grown == NULL) {
+                    if (container->count == 0) remove_container(bitmap, at);
+                    return 0;
+                }
+                container->values = grown;
+                container->capacity = capacity;
+            }
+            memmove(&container->values[slot + 1], &container->values[slot],
+                    (container->count - slot) * sizeof(uint16_t));
+            container->values[slot] = low;
+            container->count++;
+            return 1;
+        }
+        if (!make_dense(container)) return 0;
+    }
+
+    if (!(container->bits[low >> 6] & (1ull << (low & 63)))) {
+        container->bits[low >> 6] |= 1ull << (low & 63);
+        container->count++;
+    }
+    return 1;
+}
+
+void bitmap_remove(TodoBitmap *bitmap, uint32_t value) {
+    uint16_t low = (uint16_t)value;
+    TodoBitmapContainer *container;
+    uint32_t at, slot;
+
+    if (!find_key(bitmap, (uint16_t)(value >> 16), &at)) return;
+    container = &bitmap->containers[at];
+
+    if (container->dense) {
+        if (!(container->bits[low >> 6] & (1ull << (low & 63)))) return;
+        container->bits[low >> 6] &= ~(1ull << (low & 63));
+        container->count--;
+        // Staying a map is fine if the array cannot be allocated
+        if (container->count > 0 && container->count <= BITMAP_SHRINK_AT) make_sparse(container);
+    } else {
+        if (!find_value(container->values, container->count, low, &slot)) return;
+        memmove(&container->values[slot], &container->values[slot + 1],
+                (container->count - slot - 1) * sizeof(uint16_t));
+        container->count--;
+    }
+    if (container->count == 0) remove_container(bitmap, at);
+}
+
+int bitmap_contains(const TodoBitmap *bitmap, uint32_t value) {
+    uint16_t low = (uint16_t)value;
+    const TodoBitmapContainer *container;
+    uint32_t at, slot;
+
+    if (!find_key(bitmap, (uint16_t)(value >> 16), &at)) return 0;
+    container = &bitmap->containers[at];
+    if (container->dense) return (container->bits[low >> 6] >> (low & 63)) & 1;
+    return find_value(container->values, container->count, low, &slot);
+}
+
+uint64_t bitmap_count(const TodoBitmap *bitmap) {
+    uint64_t count = 0;
+
+    for (uint32_t i = 0; i < bitmap->count; i++) {
+        count += bitmap->containers[i].count;
+    }
+    return count;
+}
+
+static int copy_container(TodoBitmapContainer *out, const TodoBitmapContainer *from) {
+    *out = *from;
+    out->values = NULL;
+    out->bits = NULL;
+    if (from->dense) {
+        out->bits = (uint64_t *)malloc(BITMAP_WORDS * sizeof(uint64_t));
+        if (out->bits == NULL) return 0;
+        memcpy(out->bits, from->bits, BITMAP_WORDS * sizeof(uint64_t));
+    } else {
+        out->capacity = from->count;
+        out->values = (uint16_t *)malloc((from->count > 0 ? from->count : 1) * sizeof(uint16_t));
+        if (out->values == NULL) return 0;
+        memcpy(out->values, from->values, from->count * sizeof(uint16_t));
+    }
+    return 1;
+}
+
+// Take over a finished container; empty ones are dropped
+static int append_container(TodoBitmap *bitmap, TodoBitmapContainer *container) {
+    if (container->count == 0) {
+        free_container(container);
+        return 1;
+    }
+    if (!reserve_containers(bitmap, bitmap->count + 1)) {
+        free_container(container);
+        return 0;
+    }
+    bitmap->containers[bitmap->count++] = *container;
+    return 1;
+}
+
+int bitmap_copy(TodoBitmap *out, const TodoBitmap *from) {
+    TodoBitmap result;
+
+    bitmap_free(out);
+    bitmap_init(&result);
+    if (!reserve_containers(&result, from->count)) return 0;
+    for (uint32_t i = 0; i < from->count; i++) {
+        TodoBitmapContainer copy;
+
+        if (!copy_container(&copy, &from->containers[i]) || !append_container(&result, &copy)) {
+            free_container(&copy);
+            bitmap_free(&result);
+            return 0;
+        }
+    }
+    *out = result;
+    return 1;
+}
+
+// Containers being built: an array of up to capacity values, or a map
+static int start_array(TodoBitmapContainer *out, uint16_t key, uint32_t capacity) {
+    memset(out, 0, sizeof(*out));
+    out->key = key;
+    out->capacity = capacity;
+    out->values = (uint16_t *)malloc((capacity > 0 ? capacity : 1) * sizeof(uint16_t));
+    return out->values != NULL;
+}
+
+static int start_map(TodoBitmapContainer *out, uint16_t key, const TodoBitmapContainer *from) {
+    memset(out, 0, sizeof(*out));
+    out->key = key;
+    out->dense = 1;
+    if (from != NULL && from->dense) {
+        out->bits = (uint64_t *)malloc(BITMAP_WORDS * sizeof(uint64_t));
+        if (out->bits != NULL) memcpy(out->bits, from->bits, BITMAP_WORDS * sizeof(uint64_t));
+        return out->bits != NULL;
+    }
+    out->bits = (uint64_t *)calloc(BITMAP_WORDS, sizeof(uint64_t));
+    if (out->bits == NULL) return 0;
+    for (uint32_t i = 0; from != NULL && i < from->count; i++) {
+        out->bits[from->values[i] >> 6] |= 1ull << (from->values[i] & 63);
+    }
+    return 1;
+}
+
+// Count a map built word by word and make it an array if that is smaller
+static int finish_map(TodoBitmapContainer *out) {
+    out->count = 0;
+    for (uint32_t word = 0; word < BITMAP_WORDS; word++) {
+        out->count += popcount(out->bits[word]);
+    }
+    if (out->count > 0 && out->count <= BITMAP_ARRAY_MAX) return make_sparse(out);
+    return 1;
+}
+
+static int and_container(TodoBitmapContainer *out, const TodoBitmapContainer *a, const TodoBitmapContainer *b) {
+    if (a->dense && b->dense) {
+        if (!start_map(out, a->key, NULL)) return 0;
+        for (uint32_t word = 0; word < BITMAP_WORDS; word++) {
+            out->bits[word] = a->bits[word] & b->bits[word];
+        }
+        return finish_map(out);
+    }
+    if (a->dense || b->dense) {
+        const TodoBitmapContainer *array = a->dense ? b : a;
+        const TodoBitmapContainer *map = a->dense ? a : b;
+
+        if (!start_array(out, a->key, array->count)) return 0;
+        for (uint32_t i = 0; i < array->count; i++) {
+            uint16_t value = array->values[i];
+            if ((map->bits[value >> 6] >> (value & 63)) & 1) out->values[out->count++] = value;
+        }
+        return 1;
+    }
+
+    if (!start_array(out, a->key, a->count < b->count ? a->count : b->count)) return 0;
+    if (a->count > 32 * b->count || b->count > 32 * a->count) {
+        // Very different sizes: look the values of the small one up in
+        // the rest of the large one
+        const TodoBitmapContainer *small = a->count < b->count ? a : b;
+        const TodoBitmapContainer *large = a->count < b->count ? b : a;
+        uint32_t from = 0;
+
+        for (uint32_t i = 0; i < small->count && from < large->count; i++) {
+            uint32_t at;
+
+            if (find_value(large->values + from, large->count - from, small->values[i], &at)) {
+                out->values[out->count++] = small->values[i];
+            }
+            from += at;
+        }
+        return 1;
+    }
+    for (uint32_t i = 0, j = 0; i < a->count && j < b->count;) {
+        if (a->values[i] < b->values[j]) {
+            i++;
+        } else if (a->values[i] > b->values[j]) {
+            j++;
+        } else {
+            out->values[out->count++] = a->values[i];
+            i++;
+            j++;
+        }
+    }
+    return 1;
+}
+
+static int or_container(TodoBitmapContainer *out, const TodoBitmapContainer *a, const TodoBitmapContainer *b) {
+    if (!a->dense && !b->dense && a->count + b->count <= BITMAP_ARRAY_MAX) {
+        uint32_t i = 0, j = 0;
+
+        if (!start_array(out, a->key, a->count + b->count)) return 0;
+        while (i < a->count || j < b->count) {
+            if (j == b->count || (i < a->count && a->values[i] < b->values[j])) {
+                out->values[out->count++] = a->values[i++];
+            } else if (i == a->count || b->values[j] < a->values[i]) {
+                out->values[out->count++] = b->values[j++];
+            } else {
+                out->values[out->count++] = a->values[i];
+                i++;
+                j++;
+            }
+        }
+        return 1;
+    }
+
+    // Start from a copy of the map, or of either array spread out as one
+    if (b->dense && !a->dense) {
+        const TodoBitmapContainer *swap = a;
+        a = b;
+        b = swap;
+    }
+    if (!start_map(out, a->key, a)) return 0;
+    if (b->dense) {
+        for (uint32_t word = 0; word < BITMAP_WORDS; word++) {
+            out->bits[word] |= b->bits[word];
+        }
+    } else {
+        for (uint32_t i = 0; i < b->count; i++) {
+            out->bits[b->values[i] >> 6] |= 1ull << (b->values[i] & 63);
+        }
+    }
+    return finish_map(out);
+}
+
+static int andnot_container(TodoBitmapContainer *out, const TodoBitmapContainer *a, const TodoBitmapContainer *b) {
+    if (a->dense) {
+        if (!start_map(out, a->key, a)) return 0;
+        if (b->dense) {
+            for (uint32_t word = 0; word < BITMAP_WORDS; word++) {
+                out->bits[word] &= ~b->bits[word];
+            }
+        } else {
+            for (uint32_t i = 0; i < b->count; i++) {
+                out->bits[b->values[i] >> 6] &= ~(1ull << (b->values[i] & 63));
+            }
+        }
+        return finish_map(out);
+    }
+
+    if (!start_array(out, a->key, a->count)) return 0;
+    if (b->dense) {
+        for (uint32_t i = 0; i < a->count; i++) {
+            uint16_t value = a->values[i];
+            if (!((b->bits[value >> 6] >> (value & 63)) & 1)) out->values[out->count++] = value;
+        }
+        return 1;
+    }
+    for (uint32_t i = 0, j = 0; i < a->count;) {
+        if (j == b->count || a->values[i] < b->values[j]) {
+            out->values[out->count++] = a->values[i++];
+        } else if (a->values[i] > b->values[j]) {
+            j++;
+        } else {
+            i++;
+            j++;
+        }
+    }
+    return 1;
+}
+
+enum {
+    OP_AND,
+    OP_OR,
+    OP_ANDNOT
+};
+
+// Walk the keys of both inputs in step. A key only one side has is kept
+// for OR, and for ANDNOT when it is a's; matching keys combine.
+static int combine(TodoBitmap *out, const TodoBitmap *a, const TodoBitmap *b, int op) {
+    TodoBitmap result;
+    uint32_t i = 0, j = 0;
+    int ok = 1;
+
+    bitmap_free(out);
+    bitmap_init(&result);
+    while (ok && (op == OP_OR ? i < a->count || j < b->count :
+                  op == OP_AND ? i < a->count && j < b->count : i < a->count)) {
+        const TodoBitmapContainer *left = i < a->count ? &a->containers[i] : NULL;
+        const TodoBitmapContainer *right = j < b->count ? &b->containers[j] : NULL;
+        TodoBitmapContainer built;
+
+        memset(&built, 0, sizeof(built));
+        if (right == NULL || (left != NULL && left->key < right->key)) {
+            i++;
+            if (op == OP_AND) continue;
+            ok = copy_container(&built, left);
+        } else if (left == NULL || right->key < left->key) {
+            j++;
+            if (op != OP_OR) continue;
+            ok = copy_container(&built, right);
+        } else {
+            i++;
+            j++;
+            ok = op == OP_AND ? and_container(&built, left, right) :
+                 op == OP_OR ? or_container(&built, left, right) : andnot_container(&built, left, right);
+        }
+        if (!ok) {
+            free_container(&built);
+            break;
+        }
+        ok = append_container(&result, &built);
+    }
+    if (!ok) {
+        bitmap_free(&result);
+        return 0;
+    }
+    *out = result;
+    return 1;
+}
+
+int bitmap_and(TodoBitmap *out, const TodoBitmap *a, const TodoBitmap *b) {
+    return combine(out, a, b, OP_AND);
+}
+
+int bitmap_or(TodoBitmap *out, const TodoBitmap *a, const TodoBitmap *b) {
+    return combine(out, a, b, OP_OR);
+}
+
+int bitmap_andnot(TodoBitmap *out, const TodoBitmap *a, const TodoBitmap *b) {
+    return combine(out, a, b, OP_ANDNOT);
+}
+
+size_t bitmap_values(const TodoBitmap *bitmap, uint32_t *out, size_t max) {
+    size_t n = 0;
+
+    for (uint32_t i = 0; i < bitmap->count && n < max; i++) {
+        const TodoBitmapContainer *container = &bitmap->containers[i];
+        uint32_t high = (uint32_t)container->key << 16;
+
+        if (!container->dense) {
+            for (uint32_t j = 0; j < container->count && n < max; j++) {
+                out[n++] = high | container->values[j];
+            }
+            continue;
+        }
+        for (uint32_t word = 0; word < BITMAP_WORDS && n < max; word++) {
+            for (uint64_t bits = container->bits[word]; bits != 0 && n < max; bits &= bits - 1) {
+                out[n++] = high | (word * 64 + (uint32_t)lowest_bit(bits));
+            }
+        }
+    }
+    return n;
+}
+
+size_t bitmap_memory(const TodoBitmap *bitmap) {
+    size_t bytes = bitmap->capacity * sizeof(TodoBitmapContainer);
+
+    for (uint32_t i = 0; i < bitmap->count; i++) {
+        const TodoBitmapContainer *container = &bitmap->containers[i];
+        bytes += container->dense ? BITMAP_WORDS * sizeof(uint64_t) : container->capacity * sizeof(uint16_t);
+    }
+    return bytes;
+}
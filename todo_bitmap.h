@@ -0,0 +1,62 @@
+#ifndef TODO_BITMAP_H
+#define TODO_BITMAP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compressed bitmap of 32-bit values, in the manner of a roaring bitmap.
+//
+// Values are grouped by their upper 16 bits into containers, kept sorted
+// by that key. A container of up to BITMAP_ARRAY_MAX values holds their
+// low 16 bits as a sorted array; a fuller one is a plain 65536-bit map.
+// Sparse sets cost two bytes a value and dense ones an eighth of a byte,
+// whatever the range of the values. Set operations go container by
+// container: merging two arrays, combining 1024 words, or probing a map
+// for each value of an array. An intersection only visits the keys both
+// sides have, so it costs no more than the smaller input.
+//
+// Operations write to an output bitmap that must not be one of their
+// inputs; whatever it held is freed first, and it is left empty when
+// memory runs out.
+
+#define BITMAP_ARRAY_MAX 4096
+#define BITMAP_WORDS 1024           // 64-bit words of a full container
+
+typedef struct {
+    uint16_t key;           // Upper 16 bits of its values
+    uint16_t dense;         // bits is in use rather than values
+    uint32_t count;
+    uint32_t capacity;      // Entries allocated in values
+    uint16_t *values;       // Sorted low 16 bits
+    uint64_t *bits;         // BITMAP_WORDS words
+} TodoBitmapContainer;
+
+typedef struct {
+    TodoBitmapContainer *containers;
+    uint32_t count;
+    uint32_t capacity;
+} TodoBitmap;
+
+void bitmap_init(TodoBitmap *bitmap);
+// Leaves the bitmap empty and ready for reuse
+void bitmap_free(TodoBitmap *bitmap);
+
+// Return 0 when out of memory, with the bitmap unchanged
+int bitmap_add(TodoBitmap *bitmap, uint32_t value);
+int bitmap_copy(TodoBitmap *out, const TodoBitmap *from);
+void bitmap_remove(TodoBitmap *bitmap, uint32_t value);
+int bitmap_contains(const TodoBitmap *bitmap, uint32_t value);
+uint64_t bitmap_count(const TodoBitmap *bitmap);
+
+// out = a AND b, a OR b, a AND NOT b; 0 when out of memory
+int bitmap_and(TodoBitmap *out, const TodoBitmap *a, const TodoBitmap *b);
+int bitmap_or(TodoBitmap *out, const TodoBitmap *a, const TodoBitmap *b);
+int bitmap_andnot(TodoBitmap *out, const TodoBitmap *a, const TodoBitmap *b);
+
+// Store up to max values in ascending order; returns how many
+size_t bitmap_values(const TodoBitmap *bitmap, uint32_t *out, size_t max);
+
+// Bytes allocated
+size_t bitmap_memory(const TodoBitmap *bitmap);
+
+#endif
@@ -0,0 +1,1447 @@
+#include "todo_core.h"
+#include "todo_format.h"
+#include "todo_sort.h"
+#include "todo_tags.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Assembly functions
+int asm_add(int a, int b) {
+    int result;
+#if defined(_MSC_VER) && defined(_M_IX86)
+    __asm {
+        mov eax, a
+        add eax, b
+        mov result, eax
+    }
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __asm__ (
+        "movl %1, %%eax\n\t"
+        "addl %2, %%eax\n\t"
+        "movl %%eax, %0\n\t"
+        : "=r" (result)
+        : "r" (a), "r" (b)
+        : "%eax"
+    );
+#else
+    result = a + b;
+#endif
+    return result;
+}
+
+int asm_subtract(int a, int b) {
+    int result;
+#if defined(_MSC_VER) && defined(_M_IX86)
+    __asm {
+        mov eax, a
+        sub eax, b
+        mov result, eax
+    }
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __asm__ (
+        "movl %1, %%eax\n\t"
+        "subl %2, %%eax\n\t"
+        "movl %%eax, %0\n\t"
+        : "=r" (result)
+        : "r" (a), "r" (b)
+        : "%eax"
+    );
+#else
+    result = a - b;
+#endif
+    return result;
+}
+
+int asm_increment(int a) {
+    int result;
+#if defined(_MSC_VER) && defined(_M_IX86)
+    __asm {
+        mov eax, a
+        inc eax
+        mov result, eax
+    }
+#elif defined(__GNUC__) && (defined(__i386__) || defined(__x86_64__))
+    __asm__ (
+        "movl %1, %%eax\n\t"
+        "incl %%eax\n\t"
+        "movl %%eax, %0\n\t"
+        : "=r" (result)
+        : "r" (a)
+        : "%eax"
+    );
+#else
+    result = a + 1;
+#endif
+    return result;
+}
+
+// Check if a task is overdue (strictly after deadline date)
+int is_overdue(int32_t deadline_day, int32_t today) {
+    return deadline_day != DATE_NONE && today > deadline_day;
+}
+
+// Compare function for sorting tasks
+int compare_tasks(const void *a, const void *b) {
+    const Task *taskA = (const Task *)a;
+    const Task *taskB = (const Task *)b;
+
+    if (taskA->completed && !taskB->completed) return 1;
+    if (!taskA->completed && taskB->completed) return -1;
+
+    if (taskA->deadline_day > taskB->deadline_day) return 1;
+    if (taskA->deadline_day < taskB->deadline_day) return -1;
+
+    return 0;
+}
+
+// Task at a row of a folder that has been materialized
+Task *store_task(const TodoStore *store, const Folder *folder, int row) {
+    return (Task *)slots_get(&store->tasks, folder->rows[row]);
+}
+
+// A task by its handle, or NULL once it has been deleted
+Task *store_find_task(const TodoStore *store, uint32_t id) {
+    return (Task *)slots_get(&store->tasks, id);
+}
+
+// Recurrence rule of a repeating task, NULL for any other
+const TodoRecurrence *store_task_rule(const TodoStore *store, const Task *task) {
+    return (const TodoRecurrence *)slots_get(&store->rules, task->rule);
+}
+
+// Full re-sort. Folders are kept in order incrementally, so this is only
+// needed to repair data read from disk in the wrong order. The rows are
+// radix sorted by packed key, so tasks with equal keys keep their order.
+void sort_tasks(TodoStore *store, Folder *folder) {
+    TodoSortOrder order = sort_folder_order();
+    uint64_t *keys = (uint64_t *)malloc((size_t)(folder->task_count > 0 ? folder->task_count : 1) * sizeof(uint64_t));
+
+    if (keys == NULL) return;
+    for (int i = 0; i < folder->task_count; i++) {
+        keys[i] = sort_key(&order, store_task(store, folder, i));
+    }
+    sort_radix(keys, folder->rows, (size_t)folder->task_count);
+    free(keys);
+}
+
+int tasks_in_order(const TodoStore *store, const Folder *folder) {
+    for (int i = 1; i < folder->task_count; i++) {
+        if (compare_tasks(store_task(store, folder, i - 1), store_task(store, folder, i)) > 0) return 0;
+    }
+    return 1;
+}
+
+// Index at which a task with this key belongs: after every task that sorts
+// before or equal to it, so tasks with equal keys keep insertion order.
+int task_insert_position(const TodoStore *store, const Folder *folder, const Task *task) {
+    int low = 0;
+    int high = folder->task_count;
+
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (compare_tasks(store_task(store, folder, mid), task) <= 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// First index whose task does not sort before this key
+static int task_lower_bound(const TodoStore *store, const Folder *folder, const Task *task) {
+    int low = 0;
+    int high = folder->task_count;
+
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        if (compare_tasks(store_task(store, folder, mid), task) < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Position for a task with this key when the caller would like it at hint:
+// the hint if the folder stays ordered, otherwise after the equal keys.
+// Undo uses this to put a task back exactly where it was.
+int task_place(const TodoStore *store, const Folder *folder, const Task *task, int hint) {
+    int high = task_insert_position(store, folder, task);
+
+    if (hint >= 0 && hint <= high && hint >= task_lower_bound(store, folder, task)) {
+        return hint;
+    }
+    return high;
+}
+
+// Row of a task in a folder, or -1. Selections hold on to handles and look
+// their row up again after the folder changes. The task's key narrows the
+// search to the rows that share it.
+int store_task_row(const TodoStore *store, int index, uint32_t id) {
+    const Folder *folder;
+    const Task *task = store_find_task(store, id);
+
+    if (index < 0 || index >= store->folder_count || task == NULL) return -1;
+    folder = &store->folders[index];
+    if (!folder->loaded) return -1;
+    for (int i = task_lower_bound(store, folder, task); i < folder->task_count; i++) {
+        if (folder->rows[i] == id) return i;
+        if (compare_tasks(store_task(store, folder, i), task) != 0) break;
+    }
+    return -1;
+}
+
+// Move the task at row from to row to, shifting the handles in between
+static void move_task(Folder *folder, int from, int to) {
+    uint32_t moved;
+
+    if (from == to) return;
+    moved = folder->rows[from];
+    if (from < to) {
+        memmove(&folder->rows[from], &folder->rows[from + 1], (size_t)(to - from) * sizeof(uint32_t));
+    } else {
+        memmove(&folder->rows[to + 1], &folder->rows[to], (size_t)(from - to) * sizeof(uint32_t));
+    }
+    folder->rows[to] = moved;
+}
+
+// Binary search over every task but index. With upper set, the first one
+// sorting after the task there; otherwise the first not sorting before it.
+static int search_others(const TodoStore *store, const Folder *folder, int index, int upper) {
+    const Task *task = store_task(store, folder, index);
+    int low = 0;
+    int high = folder->task_count - 1;
+
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        int actual = mid < index ? mid : mid + 1;
+        int order = compare_tasks(store_task(store, folder, actual), task);
+        if (order < 0 || (upper && order == 0)) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Restore order after the task at index changed its key, placing it at
+// hint if that is valid (see task_place). Only the handles between its old
+// and new position are shifted. Returns the new index.
+static int reposition_task(const TodoStore *store, Folder *folder, int index, int hint) {
+    int position = search_others(store, folder, index, 1);
+
+    if (hint >= 0 && hint < position && hint >= search_others(store, folder, index, 0)) {
+        position = hint;
+    }
+    move_task(folder, index, position);
+    return position;
+}
+
+static void notify(TodoStore *store, int kind, int folder, int task, int position,
+                   uint32_t folder_id, uint32_t task_id) {
+    TodoStoreChange change;
+
+    change.kind = kind;
+    change.folder = folder;
+    change.task = task;
+    change.position = position;
+    change.folder_id = folder_id;
+    change.task_id = task_id;
+    for (int i = 0; i < store->listener_count; i++) {
+        store->listeners[i](store->listener_contexts[i], &change);
+    }
+}
+
+// Room for at least needed entries, growing geometrically
+static int grow(void **items, int *capacity, int needed, size_t size) {
+    int grown = *capacity ? *capacity : 8;
+    void *resized;
+
+    if (needed <= *capacity) return 1;
+    while (grown < needed) grown *= 2;
+    resized = realloc(*items, (size_t)grown * size);
+    if (resized == NULL) return 0;
+    *items = resized;
+    *capacity = grown;
+    return 1;
+}
+
+// Give a task in folder its rule, if it has one, and list it with the
+// folder's other repeating tasks. Returns 0 when out of memory.
+static int attach_rule(TodoStore *store, Folder *folder, Task *task, const TodoRecurrence *repeat) {
+    TodoRecurrence *rule;
+
+    if (repeat == NULL || repeat->unit == RECUR_NONE) return 1;
+    if (!grow((void **)&folder->recurring, &folder->recurring_capacity, folder->recurring_count + 1,
+              sizeof(uint32_t))) {
+        return 0;
+    }
+    rule = (TodoRecurrence *)slots_alloc(&store->rules, &task->rule);
+    if (rule == NULL) return 0;
+    *rule = *repeat;
+    folder->recurring[folder->recurring_count++] = task->id;
+    return 1;
+}
+
+static void detach_rule(TodoStore *store, Folder *folder, Task *task) {
+    if (task->rule == 0) return;
+    slots_release(&store->rules, task->rule);
+    task->rule = 0;
+    for (int i = 0; i < folder->recurring_count; i++) {
+        if (folder->recurring[i] == task->id) {
+            folder->recurring[i] = folder->recurring[--folder->recurring_count];
+            return;
+        }
+    }
+}
+
+// Store management
+void store_init(TodoStore *store) {
+    memset(store, 0, sizeof(*store));
+    store->current_folder = -1;
+    store->next_folder_id = 1;
+    slots_init(&store->tasks, sizeof(Task));
+    slots_init(&store->rules, sizeof(TodoRecurrence));
+}
+
+// Close the backing file and empty the store, keeping its listeners
+static void clear_store(TodoStore *store) {
+    TodoStoreListener listeners[STORE_MAX_LISTENERS];
+    void *contexts[STORE_MAX_LISTENERS];
+    int count = store->listener_count;
+
+    memcpy(listeners, store->listeners, sizeof(listeners));
+    memcpy(contexts, store->listener_contexts, sizeof(contexts));
+    todofmt_close(store->backing);
+    strpool_free(&store->strings);
+    for (int i = 0; i < store->folder_count; i++) {
+        free(store->folders[i].rows);
+        free(store->folders[i].recurring);
+    }
+    free(store->folders);
+    slots_free(&store->tasks);
+    slots_free(&store->rules);
+    store_init(store);
+    memcpy(store->listeners, listeners, sizeof(listeners));
+    memcpy(store->listener_contexts, contexts, sizeof(contexts));
+    store->listener_count = count;
+}
+
+// Text of a folder name or task description. The pointer is only valid
+// until the store next changes.
+const char *store_text(const TodoStore *store, TodoString string) {
+    return strpool_text(&store->strings, string);
+}
+
+// Intern a task's tags, refusing any not in canonical form
+static int intern_tags(TodoStore *store, const char *tags, size_t length, TodoString *out) {
+    out->offset = 0;
+    out->length = 0;
+    if (tags == NULL || length == 0) return 1;
+    if (!tags_valid(tags, length)) return 0;
+    return strpool_intern(&store->strings, tags, length, out);
+}
+
+// Intern text read from a data file; on failure the text is left empty
+static TodoString intern_stored(TodoStore *store, const char *text, uint32_t length) {
+    TodoString string;
+
+    if (text == NULL || !strpool_intern(&store->strings, text, length, &string)) {
+        string.offset = 0;
+        string.length = 0;
+    }
+    return string;
+}
+
+// Free the first count tasks of a folder with their text and rules
+static void free_tasks(TodoStore *store, Folder *folder, int count) {
+    for (int i = 0; i < count; i++) {
+        Task *task = store_task(store, folder, i);
+
+        strpool_release(&store->strings, task->description);
+        strpool_release(&store->strings, task->tags);
+        slots_release(&store->rules, task->rule);
+        slots_release(&store->tasks, folder->rows[i]);
+    }
+}
+
+// Drop a folder's tasks and their text, keeping the folder itself
+static void release_tasks(TodoStore *store, Folder *folder) {
+    if (folder->loaded) free_tasks(store, folder, folder->task_count);
+    free(folder->rows);
+    folder->rows = NULL;
+    folder->row_capacity = 0;
+    free(folder->recurring);
+    folder->recurring = NULL;
+    folder->recurring_count = 0;
+    folder->recurring_capacity = 0;
+}
+
+// Rebuild the string pool from the handles still in use, dropping the
+// space of released strings. Handles change; ids and order do not.
+void store_compact_strings(TodoStore *store) {
+    TodoStringPool compacted;
+
+    // Sized up front, so interning below cannot fail half way
+    strpool_init(&compacted);
+    if (!strpool_reserve(&compacted, store->strings.live, store->strings.slot_count)) return;
+
+    for (int i = 0; i < store->folder_count; i++) {
+        Folder *folder = &store->folders[i];
+
+        strpool_intern(&compacted, store_text(store, folder->name), folder->name.length, &folder->name);
+        for (int j = 0; j < folder->task_count && folder->loaded; j++) {
+            Task *task = store_task(store, folder, j);
+            strpool_intern(&compacted, store_text(store, task->description),
+                           task->description.length, &task->description);
+            strpool_intern(&compacted, store_text(store, task->tags), task->tags.length, &task->tags);
+        }
+    }
+    strpool_free(&store->strings);
+    store->strings = compacted;
+}
+
+// Deletions leave their text behind in the pool; compact once that is
+// most of it. Listeners have seen the change by now.
+static void compact_if_wasteful(TodoStore *store) {
+    if (strpool_wasteful(&store->strings)) {
+        store_compact_strings(store);
+    }
+}
+
+int store_listen(TodoStore *store, TodoStoreListener listener, void *context) {
+    if (store->listener_count >= STORE_MAX_LISTENERS) return 0;
+    store->listeners[store->listener_count] = listener;
+    store->listener_contexts[store->listener_count] = context;
+    store->listener_count++;
+    return 1;
+}
+
+void store_unlisten(TodoStore *store, TodoStoreListener listener, void *context) {
+    for (int i = 0; i < store->listener_count; i++) {
+        if (store->listeners[i] == listener && store->listener_contexts[i] == context) {
+            for (int j = i + 1; j < store->listener_count; j++) {
+                store->listeners[j - 1] = store->listeners[j];
+                store->listener_contexts[j - 1] = store->listener_contexts[j];
+            }
+            store->listener_count--;
+            return;
+        }
+    }
+}
+
+// Keep a folder whose tasks cannot be read, empty
+static void quarantine(TodoStore *store, Folder *folder) {
+    folder->task_count = 0;
+    folder->loaded = 1;
+    folder->source_index = -1;
+    store->quarantined++;
+}
+
+// Replace the store contents with the directory of a freshly opened data
+// file. Only names and counts are copied; tasks stay in the mapping until
+// the folder is materialized. Every folder section is checksummed here
+// unless todofmt_verify() already did so in parallel, and damaged ones are
+// quarantined. The store takes ownership of the file. Folders that do not
+// fit in memory are left out.
+void store_attach(TodoStore *store, TodoDataFile *file) {
+    const TodoFileHeader *header = todofmt_header(file);
+    uint32_t count = header->folder_count;
+
+    clear_store(store);
+    if (count > INT32_MAX / 2 || !grow((void **)&store->folders, &store->folder_capacity, (int)count,
+                                       sizeof(Folder))) {
+        count = 0;
+    }
+    store->next_folder_id = header->next_folder_id ? header->next_folder_id : 1;
+    store->journal_seq = header->journal_seq;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const TodoFolderEntry *entry = todofmt_folder_entry(file, i);
+        Folder *folder = &store->folders[i];
+
+        memset(folder, 0, sizeof(*folder));
+        folder->name = intern_stored(store, todofmt_folder_name(file, entry), entry->name_length);
+        folder->task_count = entry->task_count > SLOTS_MAX ? (int)SLOTS_MAX : (int)entry->task_count;
+        folder->id = entry->id;
+        folder->loaded = 0;
+        folder->source_index = (int)i;
+        if (!todofmt_section_ok(file, i)) {
+            quarantine(store, folder);
+        }
+        if (folder->id >= store->next_folder_id) {
+            store->next_folder_id = folder->id + 1;
+        }
+    }
+
+    // Files written before folders carried ids
+    for (uint32_t i = 0; i < count; i++) {
+        if (store->folders[i].id == 0) {
+            store->folders[i].id = store->next_folder_id++;
+        }
+    }
+
+    store->folder_count = (int)count;
+    store->current_folder = header->current_folder;
+    if (store->current_folder < -1 || store->current_folder >= store->folder_count) {
+        store->current_folder = -1;
+    }
+    store->backing = file;
+    notify(store, STORE_RESET, -1, -1, -1, 0, 0);
+}
+
+// Switch to a newer data file holding the same folders, such as a
+// compacted checkpoint. Folders are matched to directory slots by id;
+// folders missing from the new file must already be materialized.
+void store_rebind(TodoStore *store, TodoDataFile *file) {
+    uint32_t count = file ? todofmt_header(file)->folder_count : 0;
+
+    for (int i = 0; i < store->folder_count; i++) {
+        Folder *folder = &store->folders[i];
+        folder->source_index = -1;
+        for (uint32_t j = 0; j < count; j++) {
+            if (todofmt_folder_entry(file, j)->id == folder->id) {
+                folder->source_index = (int)j;
+                break;
+            }
+        }
+    }
+    todofmt_close(store->backing);
+    store->backing = file;
+}
+
+void store_release(TodoStore *store) {
+    clear_store(store);
+    notify(store, STORE_RESET, -1, -1, -1, 0, 0);
+}
+
+// Give a folder being materialized its rows and a slot for each task.
+// Returns 0, with nothing allocated, when memory runs out.
+static int allocate_tasks(TodoStore *store, Folder *folder) {
+    int count = 0;
+
+    if (!grow((void **)&folder->rows, &folder->row_capacity, folder->task_count, sizeof(uint32_t))) return 0;
+    for (; count < folder->task_count; count++) {
+        if (slots_alloc(&store->tasks, &folder->rows[count]) == NULL) break;
+    }
+    if (count == folder->task_count) return 1;
+
+    while (count > 0) slots_release(&store->tasks, folder->rows[--count]);
+    free(folder->rows);
+    folder->rows = NULL;
+    folder->row_capacity = 0;
+    return 0;
+}
+
+// Attach the rules saved with a folder being materialized. When memory runs
+// out its tasks are freed again and the folder stays unloaded.
+static int attach_saved_rules(TodoStore *store, Folder *folder, const TodoRuleRecord *rules, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        if (rules[i].task >= (uint32_t)folder->task_count) continue;
+        if (!attach_rule(store, folder, store_task(store, folder, (int)rules[i].task), &rules[i].rule)) {
+            free_tasks(store, folder, folder->task_count);
+            release_tasks(store, folder);
+            return 0;
+        }
+    }
+    return 1;
+}
+
+// Give the tasks of a folder being materialized their saved sequences, or
+// ones in row order for files from before sequences were saved
+static void assign_sequences(TodoStore *store, Folder *folder, const uint32_t *saved) {
+    for (int i = 0; i < folder->task_count; i++) {
+        Task *task = store_task(store, folder, i);
+
+        task->sequence = saved ? saved[i] : store->next_sequence;
+        if (task->sequence >= store->next_sequence && task->sequence < UINT32_MAX) {
+            store->next_sequence = task->sequence + 1;
+        }
+    }
+}
+
+// Copy a folder's tasks out of the mapped file, decoding columnar sections.
+// A folder that does not fit in memory stays unloaded.
+int store_materialize(TodoStore *store, int index) {
+    Folder *folder;
+    const TodoFolderEntry *entry;
+    const TodoTaskRecord *records;
+    const TodoTagRecord *tags;
+
+    if (index < 0 || index >= store->folder_count) return 0;
+    folder = &store->folders[index];
+    if (folder->loaded) return 1;
+
+    if (store->backing == NULL || folder->source_index < 0 ||
+        (entry = todofmt_folder_entry(store->backing, (uint32_t)folder->source_index)) == NULL) {
+        folder->task_count = 0;
+        folder->loaded = 1;
+        notify(store, STORE_FOLDER_LOADED, index, -1, -1, folder->id, 0);
+        return 0;
+    }
+    if (!todofmt_section_ok(store->backing, (uint32_t)folder->source_index)) {
+        quarantine(store, folder);
+        notify(store, STORE_FOLDER_LOADED, index, -1, -1, folder->id, 0);
+        return 0;
+    }
+
+    if (entry->encoding == TODOFMT_COLUMNAR) {
+        TodoSectionColumns columns;
+        const char *text;
+
+        if (!todofmt_decode_columns(store->backing, entry, &columns)) {
+            todofmt_free_columns(&columns);
+            quarantine(store, folder);
+            notify(store, STORE_FOLDER_LOADED, index, -1, -1, folder->id, 0);
+            return 0;
+        }
+        if (!allocate_tasks(store, folder)) {
+            todofmt_free_columns(&columns);
+            return 0;
+        }
+        text = columns.text;
+        for (int i = 0; i < folder->task_count; i++) {
+            Task *task = store_task(store, folder, i);
+
+            task->description = intern_stored(store, text, columns.lengths[i]);
+            task->deadline_day = columns.deadlines[i];
+            task->completed = columns.completed[i];
+            task->priority = columns.priorities[i];
+            task->id = folder->rows[i];
+            if (columns.tag_sets != NULL) {
+                task->tags = intern_stored(store, columns.tag_sets + columns.tag_offsets[i], columns.tag_lengths[i]);
+            }
+            text += columns.lengths[i];
+        }
+        assign_sequences(store, folder, columns.sequences);
+        if (!attach_saved_rules(store, folder, columns.rules, columns.rule_count)) {
+            todofmt_free_columns(&columns);
+            return 0;
+        }
+        todofmt_free_columns(&columns);
+    } else {
+        if (!allocate_tasks(store, folder)) return 0;
+        records = todofmt_task_records(store->backing, entry);
+        tags = todofmt_task_tags(store->backing, entry);
+        for (int i = 0; i < folder->task_count; i++) {
+            Task *task = store_task(store, folder, i);
+
+            task->description = intern_stored(store, todofmt_task_text(store->backing, entry, &records[i]),
+                                              records[i].text_length);
+            task->deadline_day = records[i].deadline_day;
+            task->completed = records[i].flags & TODOFMT_TASK_COMPLETED;
+            task->priority = (records[i].flags >> TODOFMT_PRIORITY_SHIFT) & 3;
+            task->id = folder->rows[i];
+            if (tags != NULL) {
+                task->tags = intern_stored(store, todofmt_tag_text(store->backing, entry, &tags[i]),
+                                           tags[i].text_length);
+            }
+        }
+        assign_sequences(store, folder, todofmt_task_sequences(store->backing, entry));
+        if (!attach_saved_rules(store, folder, todofmt_task_rules(store->backing, entry), entry->rule_count)) {
+            return 0;
+        }
+    }
+
+    // Saved folders are already in order; converted ones may not be
+    if (!tasks_in_order(store, folder)) {
+        sort_tasks(store, folder);
+    }
+    folder->loaded = 1;
+    notify(store, STORE_FOLDER_LOADED, index, -1, -1, folder->id, 0);
+    return 1;
+}
+
+int store_find_folder(const TodoStore *store, uint32_t id) {
+    for (int i = 0; i < store->folder_count; i++) {
+        if (store->folders[i].id == id) return i;
+    }
+    return -1;
+}
+
+// A run of the same id is looked up once; past the first id, the folder
+// ids are radix sorted once and the rest found by binary search, so a
+// batch over many folders does not scan them all for every entry
+void store_find_folders(const TodoStore *store, const uint32_t *ids, int count, int *indices) {
+    uint64_t *keys = NULL;
+    uint32_t *items = NULL;
+    int sorted = 0;         // 1 once sorted, -1 when there was no memory to
+
+    for (int i = 0; i < count; i++) {
+        size_t low = 0, high = (size_t)store->folder_count;
+
+        if (i > 0 && ids[i] == ids[i - 1]) {
+            indices[i] = indices[i - 1];
+            continue;
+        }
+        if (i > 0 && !sorted) {
+            keys = (uint64_t *)malloc((size_t)(store->folder_count + 1) * sizeof(uint64_t));
+            items = (uint32_t *)malloc((size_t)(store->folder_count + 1) * sizeof(uint32_t));
+            sorted = keys != NULL && items != NULL;
+            for (int f = 0; sorted && f < store->folder_count; f++) {
+                keys[f] = store->folders[f].id;
+                items[f] = (uint32_t)f;
+            }
+            sorted = sorted && sort_radix(keys, items, (size_t)store->folder_count);
+            if (!sorted) {
+                // Out of memory: scan for each id instead
+                free(keys);
+                free(items);
+                keys = NULL;
+                items = NULL;
+                sorted = -1;
+            }
+        }
+        if (sorted <= 0) {
+            indices[i] = store_find_folder(store, ids[i]);
+            continue;
+        }
+        while (low < high) {
+            size_t middle = low + (high - low) / 2;
+
+            if (keys[middle] < ids[i]) {
+                low = middle + 1;
+            } else {
+                high = middle;
+            }
+        }
+        indices[i] = low < (size_t)store->folder_count && keys[low] == ids[i] ? (int)items[low] : -1;
+    }
+    free(keys);
+    free(items);
+}
+
+// Returns the new folder's index, or -1 when out of memory. An id of 0
+// assigns the next free one.
+int store_create_folder(TodoStore *store, uint32_t id, const char *name) {
+    return store_insert_folder(store, store->folder_count, id, name);
+}
+
+// Create a folder at position, shifting the folders after it. Used to put
+// a deleted folder back where it was.
+int store_insert_folder(TodoStore *store, int position, uint32_t id, const char *name) {
+    Folder *folder;
+    TodoString text;
+
+    if (!grow((void **)&store->folders, &store->folder_capacity, store->folder_count + 1, sizeof(Folder))) {
+        return -1;
+    }
+    if (!strpool_intern(&store->strings, name, strlen(name), &text)) return -1;
+    if (position < 0 || position > store->folder_count) position = store->folder_count;
+
+    memmove(&store->folders[position + 1], &store->folders[position],
+            (size_t)(store->folder_count - position) * sizeof(Folder));
+    folder = &store->folders[position];
+    memset(folder, 0, sizeof(*folder));
+    folder->name = text;
+    folder->id = id ? id : store->next_folder_id;
+    folder->loaded = 1;
+    folder->source_index = -1;
+    if (folder->id >= store->next_folder_id) {
+        store->next_folder_id = folder->id + 1;
+    }
+
+    store->folder_count = asm_increment(store->folder_count);
+    if (store->current_folder >= position) {
+        store->current_folder = asm_increment(store->current_folder);
+    }
+    notify(store, STORE_FOLDER_ADDED, position, -1, -1, folder->id, 0);
+    return position;
+}
+
+// Frees the folder's tasks, then closes the gap in the folder array, which
+// only holds small headers
+int store_delete_folder(TodoStore *store, int index) {
+    uint32_t id;
+
+    if (index < 0 || index >= store->folder_count) return 0;
+    id = store->folders[index].id;
+    strpool_release(&store->strings, store->folders[index].name);
+    release_tasks(store, &store->folders[index]);
+
+    memmove(&store->folders[index], &store->folders[index + 1],
+            (size_t)(store->folder_count - index - 1) * sizeof(Folder));
+    store->folder_count = asm_subtract(store->folder_count, 1);
+
+    if (store->current_folder == index) {
+        store->current_folder = -1;
+    } else if (store->current_folder > index) {
+        store->current_folder = asm_subtract(store->current_folder, 1);
+    }
+    notify(store, STORE_FOLDER_REMOVED, index, -1, -1, id, 0);
+    compact_if_wasteful(store);
+    return 1;
+}
+
+// Insert a task at its sorted position, after any with the same key
+int store_add_task(TodoStore *store, int index, const char *description, int32_t deadline_day) {
+    return store_insert_task(store, index, -1, description, deadline_day, 0, PRIORITY_NONE, NULL, NULL);
+}
+
+// A task being added in bulk, with its place in the input
+typedef struct {
+    Task *task;
+    int order;
+} NewTask;
+
+// Task order, then input order
+static int compare_new_tasks(const void *a, const void *b) {
+    const NewTask *taskA = (const NewTask *)a;
+    const NewTask *taskB = (const NewTask *)b;
+    int order = compare_tasks(taskA->task, taskB->task);
+
+    if (order != 0) return order;
+    return (taskA->order > taskB->order) - (taskA->order < taskB->order);
+}
+
+static int input_valid(const TodoTaskInput *input) {
+    return input->priority >= PRIORITY_NONE && input->priority <= PRIORITY_HIGH && date_valid(input->deadline_day) &&
+           recur_valid(&input->repeat) &&
+           (input->tags == NULL || input->tags_length == 0 || tags_valid(input->tags, input->tags_length));
+}
+
+// Add many tasks at once: they are sorted among themselves and merged into
+// the folder in one pass instead of one binary-search insert each. Ends up
+// exactly as adding them one by one in input order would. If any input is
+// invalid nothing is added; otherwise adds as many as memory allows, from
+// the front. Returns how many were added.
+int store_add_tasks(TodoStore *store, int index, const TodoTaskInput *tasks, int count) {
+    Folder *folder;
+    NewTask *added;
+    int kept = 0;
+    int old, next;
+
+    if (index < 0 || index >= store->folder_count || count <= 0) return 0;
+    folder = &store->folders[index];
+    if (!folder->loaded) return 0;
+    if (count > INT32_MAX / 2 - folder->task_count) count = INT32_MAX / 2 - folder->task_count;
+    for (int i = 0; i < count; i++) {
+        if (!input_valid(&tasks[i])) return 0;
+    }
+    if (!grow((void **)&folder->rows, &folder->row_capacity, folder->task_count + count, sizeof(uint32_t))) {
+        return 0;
+    }
+
+    added = (NewTask *)malloc((size_t)count * sizeof(NewTask));
+    if (added == NULL) return 0;
+    for (; kept < count; kept++) {
+        uint32_t id;
+        Task *task = (Task *)slots_alloc(&store->tasks, &id);
+
+        if (task == NULL) break;
+        if (!strpool_intern(&store->strings, tasks[kept].description, tasks[kept].length, &task->description)) {
+            slots_release(&store->tasks, id);
+            break;
+        }
+        if (!intern_tags(store, tasks[kept].tags, tasks[kept].tags_length, &task->tags)) {
+            strpool_release(&store->strings, task->description);
+            slots_release(&store->tasks, id);
+            break;
+        }
+        task->deadline_day = tasks[kept].deadline_day;
+        task->completed = tasks[kept].completed ? 1 : 0;
+        task->priority = tasks[kept].priority;
+        task->sequence = store->next_sequence;
+        task->id = id;
+        if (!attach_rule(store, folder, task, &tasks[kept].repeat)) {
+            strpool_release(&store->strings, task->description);
+            strpool_release(&store->strings, task->tags);
+            slots_release(&store->tasks, id);
+            break;
+        }
+        added[kept].task = task;
+        added[kept].order = kept;
+        store->next_sequence++;
+    }
+    qsort(added, (size_t)kept, sizeof(NewTask), compare_new_tasks);
+
+    // Merge from the back; on equal keys the existing task stays first
+    old = folder->task_count - 1;
+    next = kept - 1;
+    for (int slot = folder->task_count + kept - 1; next >= 0; slot--) {
+        if (old >= 0 && compare_tasks(store_task(store, folder, old), added[next].task) > 0) {
+            folder->rows[slot] = folder->rows[old--];
+        } else {
+            folder->rows[slot] = added[next--].task->id;
+        }
+    }
+    folder->task_count += kept;
+
+    // In ascending row order, each notification sees the rows before it in
+    // their final place
+    next = 0;
+    for (int row = 0; row < folder->task_count && next < kept; row++) {
+        if (folder->rows[row] == added[next].task->id) {
+            notify(store, STORE_TASK_ADDED, index, -1, row, folder->id, added[next].task->id);
+            next++;
+        }
+    }
+    free(added);
+    return kept;
+}
+
+// Insert a task at hint if that keeps the folder ordered (see task_place).
+// repeat may be NULL for a task that does not repeat.
+int store_insert_task(TodoStore *store, int index, int hint, const char *description,
+                      int32_t deadline_day, int completed, int priority, const char *tags,
+                      const TodoRecurrence *repeat) {
+    Folder *folder;
+    Task *task;
+    uint32_t id;
+    int position;
+
+    if (index < 0 || index >= store->folder_count) return 0;
+    folder = &store->folders[index];
+    if (!folder->loaded || folder->task_count >= INT32_MAX / 2) return 0;
+    if (repeat != NULL && !recur_valid(repeat)) return 0;
+    if (priority < PRIORITY_NONE || priority > PRIORITY_HIGH || !date_valid(deadline_day)) return 0;
+    if (!grow((void **)&folder->rows, &folder->row_capacity, folder->task_count + 1, sizeof(uint32_t))) return 0;
+
+    task = (Task *)slots_alloc(&store->tasks, &id);
+    if (task == NULL) return 0;
+    if (!strpool_intern(&store->strings, description, strlen(description), &task->description)) {
+        slots_release(&store->tasks, id);
+        return 0;
+    }
+    if (!intern_tags(store, tags, tags ? strlen(tags) : 0, &task->tags)) {
+        strpool_release(&store->strings, task->description);
+        slots_release(&store->tasks, id);
+        return 0;
+    }
+    task->deadline_day = deadline_day;
+    task->completed = completed ? 1 : 0;
+    task->priority = priority;
+    task->sequence = store->next_sequence++;
+    task->id = id;
+    if (!attach_rule(store, folder, task, repeat)) {
+        strpool_release(&store->strings, task->description);
+        strpool_release(&store->strings, task->tags);
+        slots_release(&store->tasks, id);
+        return 0;
+    }
+
+    position = task_place(store, folder, task, hint);
+    memmove(&folder->rows[position + 1], &folder->rows[position],
+            (size_t)(folder->task_count - position) * sizeof(uint32_t));
+    folder->rows[position] = id;
+    folder->task_count = asm_increment(folder->task_count);
+    notify(store, STORE_TASK_ADDED, index, -1, position, folder->id, id);
+    return 1;
+}
+
+// A repeating task moves on to its next occurrence rather than being
+// marked completed, so the row count never grows with its history
+int store_complete_task(TodoStore *store, int index, int task) {
+    Folder *folder;
+    Task *completed;
+    const TodoRecurrence *rule;
+    int32_t next;
+
+    if (index < 0 || index >= store->folder_count) return 0;
+    folder = &store->folders[index];
+    if (!folder->loaded || task < 0 || task >= folder->task_count) return 0;
+
+    completed = store_task(store, folder, task);
+    rule = store_task_rule(store, completed);
+    if (!completed->completed) {
+        next = rule ? recur_next(rule, completed->deadline_day) : DATE_NONE;
+        if (next != DATE_NONE) {
+            completed->deadline_day = next;
+        } else {
+            completed->completed = 1;
+        }
+        notify(store, STORE_TASK_MOVED, index, task, reposition_task(store, folder, task, -1), folder->id,
+               completed->id);
+    }
+    return 1;
+}
+
+// Undo a completion, moving the task back to hint if that is valid. An open
+// repeating task goes back to its previous occurrence.
+int store_reopen_task(TodoStore *store, int index, int task, int hint) {
+    Folder *folder;
+    Task *reopened;
+    const TodoRecurrence *rule;
+    int32_t previous;
+
+    if (index < 0 || index >= store->folder_count) return 0;
+    folder = &store->folders[index];
+    if (!folder->loaded || task < 0 || task >= folder->task_count) return 0;
+
+    reopened = store_task(store, folder, task);
+    rule = store_task_rule(store, reopened);
+    previous = rule && !reopened->completed ? recur_previous(rule, reopened->deadline_day) : DATE_NONE;
+    if (reopened->completed || previous != DATE_NONE) {
+        if (reopened->completed) {
+            reopened->completed = 0;
+        } else {
+            reopened->deadline_day = previous;
+        }
+        notify(store, STORE_TASK_MOVED, index, task, reposition_task(store, folder, task, hint), folder->id,
+               reopened->id);
+    }
+    return 1;
+}
+
+// The task's slot goes on the free list; the rows after it move up by one
+// handle each
+int store_delete_task(TodoStore *store, int index, int task) {
+    Folder *folder;
+    uint32_t id;
+
+    if (index < 0 || index >= store->folder_count) return 0;
+    folder = &store->folders[index];
+    if (!folder->loaded || task < 0 || task >= folder->task_count) return 0;
+
+    id = folder->rows[task];
+    strpool_release(&store->strings, store_task(store, folder, task)->description);
+    strpool_release(&store->strings, store_task(store, folder, task)->tags);
+    detach_rule(store, folder, store_task(store, folder, task));
+    slots_release(&store->tasks, id);
+    memmove(&folder->rows[task], &folder->rows[task + 1],
+            (size_t)(folder->task_count - task - 1) * sizeof(uint32_t));
+    folder->task_count = asm_subtract(folder->task_count, 1);
+    notify(store, STORE_TASK_REMOVED, index, task, -1, folder->id, id);
+    compact_if_wasteful(store);
+    return 1;
+}
+
+// Tags do not affect the order, so the task stays where it is
+int store_tag_task(TodoStore *store, int index, int task, const char *tags) {
+    Folder *folder;
+    Task *tagged;
+    TodoString text;
+
+    if (index < 0 || index >= store->folder_count) return 0;
+    folder = &store->folders[index];
+    if (!folder->loaded || task < 0 || task >= folder->task_count) return 0;
+    if (!intern_tags(store, tags, strlen(tags), &text)) return 0;
+
+    tagged = store_task(store, folder, task);
+    strpool_release(&store->strings, tagged->tags);
+    tagged->tags = text;
+    notify(store, STORE_TASK_MOVED, index, task, task, folder->id, tagged->id);
+    compact_if_wasteful(store);
+    return 1;
+}
+
+// A change of store_apply_batch() while it is applied
+typedef struct {
+    const TodoBatchChange *change;
+    Task *task;             // Its target, or the task it adds once made
+    int row;                // Row before the batch, -1 for an add
+    int order;              // Place in the batch, for tasks with equal keys
+    int32_t deadline_day;   // Key once applied
+    int completed;
+    int placed;             // Takes a new row: added, or its key changes
+    TodoString tags;        // STORE_BATCH_TAG: interned before anything changes
+} BatchItem;
+
+// Flags per task slot while a batch is applied
+enum {
+    BATCH_TARGET = 1,       // Changed by the batch
+    BATCH_REMOVED = 2,      // Leaves its old row
+    BATCH_PLACED = 4,       // Gets a new row
+    BATCH_HINTED = 8        // Placed at its hint
+};
+
+// Folder, then old row with adds last, then batch order
+static int compare_batch_rows(const void *a, const void *b) {
+    const BatchItem *itemA = *(const BatchItem *const *)a;
+    const BatchItem *itemB = *(const BatchItem *const *)b;
+    int rowA = itemA->row >= 0 ? itemA->row : INT32_MAX;
+    int rowB = itemB->row >= 0 ? itemB->row : INT32_MAX;
+
+    if (itemA->change->folder != itemB->change->folder) return itemA->change->folder < itemB->change->folder ? -1 : 1;
+    if (rowA != rowB) return rowA < rowB ? -1 : 1;
+    return (itemA->order > itemB->order) - (itemA->order < itemB->order);
+}
+
+// New key, then batch order
+static int compare_batch_keys(const void *a, const void *b) {
+    const BatchItem *itemA = *(const BatchItem *const *)a;
+    const BatchItem *itemB = *(const BatchItem *const *)b;
+    int order = compare_tasks(itemA->task, itemB->task);
+
+    if (order != 0) return order;
+    return (itemA->order > itemB->order) - (itemA->order < itemB->order);
+}
+
+// New key, then hint
+static int compare_batch_hints(const void *a, const void *b) {
+    const BatchItem *itemA = *(const BatchItem *const *)a;
+    const BatchItem *itemB = *(const BatchItem *const *)b;
+    int order = compare_tasks(itemA->task, itemB->task);
+
+    if (order != 0) return order;
+    return (itemA->change->hint > itemB->change->hint) - (itemA->change->hint < itemB->change->hint);
+}
+
+// Check a change against the store before anything is touched, and work out
+// the key it leaves its task with, by the rules of store_complete_task() and
+// store_reopen_task()
+static int check_batch_change(const TodoStore *store, BatchItem *item, uint8_t *marks) {
+    const TodoBatchChange *change = item->change;
+    const Folder *folder;
+    const TodoRecurrence *rule;
+    int32_t moved;
+
+    if (change->folder < 0 || change->folder >= store->folder_count || !store->folders[change->folder].loaded) {
+        return 0;
+    }
+    if (change->kind == STORE_BATCH_ADD) {
+        const TodoTaskInput *input = &change->task;
+
+        if (input->priority < PRIORITY_NONE || input->priority > PRIORITY_HIGH || !date_valid(input->deadline_day) ||
+            !recur_valid(&input->repeat)) {
+            return 0;
+        }
+        if (input->tags != NULL && input->tags_length > 0 && !tags_valid(input->tags, input->tags_length)) return 0;
+        item->deadline_day = input->deadline_day;
+        item->completed = input->completed ? 1 : 0;
+        item->placed = 1;
+        return 1;
+    }
+
+    folder = &store->folders[change->folder];
+    item->row = change->row;
+    if (item->row < 0 || item->row >= folder->task_count || folder->rows[item->row] != change->task_id) {
+        item->row = store_task_row(store, change->folder, change->task_id);
+    }
+    if (item->row < 0 || (marks[SLOTS_INDEX(change->task_id)] & BATCH_TARGET)) return 0;
+    marks[SLOTS_INDEX(change->task_id)] = BATCH_TARGET;
+    item->task = store_find_task(store, change->task_id);
+    item->deadline_day = item->task->deadline_day;
+    item->completed = item->task->completed;
+    rule = store_task_rule(store, item->task);
+
+    switch (change->kind) {
+        case STORE_BATCH_COMPLETE:
+            if (item->completed) return 1;
+            moved = rule ? recur_next(rule, item->deadline_day) : DATE_NONE;
+            if (moved != DATE_NONE) {
+                item->deadline_day = moved;
+            } else {
+                item->completed = 1;
+            }
+            item->placed = 1;
+            return 1;
+        case STORE_BATCH_REOPEN:
+            moved = rule && !item->completed ? recur_previous(rule, item->deadline_day) : DATE_NONE;
+            if (item->completed) {
+                item->completed = 0;
+            } else if (moved != DATE_NONE) {
+                item->deadline_day = moved;
+            } else {
+                return 1;
+            }
+            item->placed = 1;
+            return 1;
+        case STORE_BATCH_DELETE:
+            return 1;
+        case STORE_BATCH_TAG:
+            return change->tags != NULL && (change->tags[0] == '\0' || tags_valid(change->tags, strlen(change->tags)));
+    }
+    return 0;
+}
+
+// Give up the tasks and tags made for the first count changes
+static void unmake_batch(TodoStore *store, BatchItem *items, int count) {
+    for (int i = 0; i < count; i++) {
+        if (items[i].change->kind == STORE_BATCH_ADD) {
+            Task *task = items[i].task;
+
+            strpool_release(&store->strings, task->description);
+            strpool_release(&store->strings, task->tags);
+            detach_rule(store, &store->folders[items[i].change->folder], task);
+            slots_release(&store->tasks, task->id);
+        } else if (items[i].change->kind == STORE_BATCH_TAG) {
+            strpool_release(&store->strings, items[i].tags);
+        }
+    }
+}
+
+// Make the task an add asks for, and the text it needs. Returns 0 when out
+// of memory, with nothing left behind.
+static int make_batch_task(TodoStore *store, BatchItem *item, uint32_t sequence) {
+    const TodoTaskInput *input = &item->change->task;
+    uint32_t id;
+    Task *task = (Task *)slots_alloc(&store->tasks, &id);
+
+    if (task == NULL) return 0;
+    if (!strpool_intern(&store->strings, input->description, input->length, &task->description)) {
+        slots_release(&store->tasks, id);
+        return 0;
+    }
+    if (!intern_tags(store, input->tags, input->tags_length, &task->tags)) {
+        strpool_release(&store->strings, task->description);
+        slots_release(&store->tasks, id);
+        return 0;
+    }
+    task->deadline_day = item->deadline_day;
+    task->completed = item->completed;
+    task->priority = input->priority;
+    task->sequence = sequence;
+    task->id = id;
+    task->rule = 0;
+    if (!attach_rule(store, &store->folders[item->change->folder], task, &input->repeat)) {
+        strpool_release(&store->strings, task->description);
+        strpool_release(&store->strings, task->tags);
+        slots_release(&store->tasks, id);
+        return 0;
+    }
+    item->task = task;
+    return 1;
+}
+
+// Within each run of equal keys, put the placed tasks that asked for a row
+// in that run there, and the rest of the run in merged order around them.
+// hinted is sorted by key, then hint; spare holds a run.
+static void place_batch_hints(TodoStore *store, Folder *folder, BatchItem **hinted, int count,
+                              uint8_t *marks, uint32_t *spare) {
+    int first = 0;
+
+    while (first < count) {
+        const Task *key = hinted[first]->task;
+        int low = task_lower_bound(store, folder, key);
+        int high = task_insert_position(store, folder, key);
+        int end = first;
+        int wanted = 0;
+        int next, taken;
+
+        while (end < count && compare_tasks(hinted[end]->task, key) == 0) end++;
+        for (int i = first; i < end; i++) {
+            int hint = hinted[i]->change->hint;
+
+            if (hint < low || hint >= high || (wanted > 0 && hint == hinted[first + wanted - 1]->change->hint)) {
+                continue;
+            }
+            marks[SLOTS_INDEX(hinted[i]->task->id)] |= BATCH_HINTED;
+            hinted[first + wanted++] = hinted[i];
+        }
+        if (wanted > 0) {
+            memcpy(spare, &folder->rows[low], (size_t)(high - low) * sizeof(uint32_t));
+            next = first;
+            taken = 0;
+            for (int row = low; row < high; row++) {
+                if (next < first + wanted && hinted[next]->change->hint == row) {
+                    folder->rows[row] = hinted[next++]->task->id;
+                    continue;
+                }
+                while (marks[SLOTS_INDEX(spare[taken])] & BATCH_HINTED) taken++;
+                folder->rows[row] = spare[taken++];
+            }
+        }
+        first = end;
+    }
+}
+
+// Put one folder's share of a batch in place: close the gaps left by the
+// tasks that go or move, then merge the placed tasks back in one pass.
+// items are the folder's changes in old row order.
+static void commit_batch_folder(TodoStore *store, Folder *folder, BatchItem **items, int count,
+                                BatchItem **placed, uint8_t *marks, uint32_t *spare) {
+    int placed_count = 0;
+    int hinted_count = 0;
+    int removed = 0;
+    int kept, old, next;
+
+    for (int i = 0; i < count; i++) {
+        BatchItem *item = items[i];
+        int kind = item->change->kind;
+        uint32_t slot = SLOTS_INDEX(item->task->id);
+
+        if (kind == STORE_BATCH_DELETE || (item->placed && kind != STORE_BATCH_ADD)) {
+            marks[slot] |= BATCH_REMOVED;
+            removed++;
+        }
+        if (item->placed) {
+            marks[slot] |= BATCH_PLACED;
+            item->task->deadline_day = item->deadline_day;
+            item->task->completed = item->completed;
+            placed[placed_count++] = item;
+        }
+        if (kind == STORE_BATCH_TAG) {
+            strpool_release(&store->strings, item->task->tags);
+            item->task->tags = item->tags;
+        }
+    }
+
+    // The rows between the ones that go move down a block at a time
+    kept = folder->task_count;
+    if (removed > 0) {
+        int from = 0;
+
+        kept = 0;
+        for (int i = 0; i <= count; i++) {
+            int row = i < count ? items[i]->row : folder->task_count;
+
+            if (i < count && (row < 0 || !(marks[SLOTS_INDEX(items[i]->task->id)] & BATCH_REMOVED))) continue;
+            if (kept != from) memmove(&folder->rows[kept], &folder->rows[from], (size_t)(row - from) * sizeof(uint32_t));
+            kept += row - from;
+            from = row + 1;
+        }
+    }
+
+    // Merge from the back, finding where each placed task goes by binary
+    // search and moving the rows after it up a block at a time; on equal
+    // keys the tasks already there stay first
+    qsort(placed, (size_t)placed_count, sizeof(BatchItem *), compare_batch_keys);
+    old = kept;
+    for (next = placed_count - 1; next >= 0; next--) {
+        int low = 0;
+        int high = old;
+
+        while (low < high) {
+            int mid = low + (high - low) / 2;
+            if (compare_tasks(store_task(store, folder, mid), placed[next]->task) <= 0) {
+                low = mid + 1;
+            } else {
+                high = mid;
+            }
+        }
+        memmove(&folder->rows[low + next + 1], &folder->rows[low], (size_t)(old - low) * sizeof(uint32_t));
+        folder->rows[low + next] = placed[next]->task->id;
+        old = low;
+    }
+    folder->task_count = kept + placed_count;
+
+    for (int i = 0; i < placed_count; i++) {
+        if (placed[i]->change->hint >= 0) placed[hinted_count++] = placed[i];
+    }
+    qsort(placed, (size_t)hinted_count, sizeof(BatchItem *), compare_batch_hints);
+    place_batch_hints(store, folder, placed, hinted_count, marks, spare);
+
+    for (int i = 0; i < count; i++) {
+        if (items[i]->change->kind == STORE_BATCH_DELETE) {
+            Task *task = items[i]->task;
+
+            strpool_release(&store->strings, task->description);
+            strpool_release(&store->strings, task->tags);
+            detach_rule(store, folder, task);
+            slots_release(&store->tasks, task->id);
+        }
+    }
+}
+
+// Tell the listeners about one folder's share of a batch, now that every
+// folder is in its final state. Tasks leave their old rows from the last
+// up, so each index is right as it is read, then take their new rows from
+// the first down.
+static void notify_batch_folder(TodoStore *store, int index, BatchItem **items, int count, const uint8_t *marks) {
+    const Folder *folder = &store->folders[index];
+    int placed = 0;
+
+    for (int i = count - 1; i >= 0; i--) {
+        if (items[i]->row >= 0 && (items[i]->change->kind == STORE_BATCH_DELETE || items[i]->placed)) {
+            notify(store, STORE_TASK_REMOVED, index, items[i]->row, -1, folder->id, items[i]->change->task_id);
+        }
+        placed += items[i]->placed;
+    }
+    for (int row = 0; row < folder->task_count && placed > 0; row++) {
+        if (marks[SLOTS_INDEX(folder->rows[row])] & BATCH_PLACED) {
+            notify(store, STORE_TASK_ADDED, index, -1, row, folder->id, folder->rows[row]);
+            placed--;
+        }
+    }
+    for (int i = 0; i < count; i++) {
+        if (items[i]->change->kind == STORE_BATCH_TAG) {
+            int row = store_task_row(store, index, items[i]->task->id);
+            notify(store, STORE_TASK_MOVED, index, row, row, folder->id, items[i]->task->id);
+        }
+    }
+}
+
+// Everything that can fail is checked or allocated before the first task
+// changes; after that each touched folder is put back in order once, with
+// one merge, and the string pool is compacted at most once.
+int store_apply_batch(TodoStore *store, const TodoBatchChange *changes, int count) {
+    BatchItem *items = NULL;
+    BatchItem **sorted = NULL;
+    BatchItem **placed = NULL;
+    uint8_t *marks = NULL;
+    uint32_t *spare = NULL;
+    uint32_t sequence;
+    int adds = 0;
+    int made = 0;
+    int run = 1;
+    int ok = 0;
+
+    if (count <= 0) return count == 0;
+    if (count > INT32_MAX / 2) return 0;
+    for (int i = 0; i < count; i++) adds += changes[i].kind == STORE_BATCH_ADD;
+
+    items = (BatchItem *)calloc((size_t)count, sizeof(BatchItem));
+    sorted = (BatchItem **)malloc((size_t)count * sizeof(BatchItem *));
+    placed = (BatchItem **)malloc((size_t)count * sizeof(BatchItem *));
+    marks = (uint8_t *)calloc((size_t)store->tasks.used + (size_t)adds + 1, 1);
+    if (items == NULL || sorted == NULL || placed == NULL || marks == NULL) goto done;
+
+    for (int i = 0; i < count; i++) {
+        items[i].change = &changes[i];
+        items[i].row = -1;
+        items[i].order = i;
+        if (!check_batch_change(store, &items[i], marks)) goto done;
+        sorted[i] = &items[i];
+    }
+    qsort(sorted, (size_t)count, sizeof(BatchItem *), compare_batch_rows);
+
+    // Room for each folder's new rows, and for the longest of them
+    for (int first = 0, end; first < count; first = end) {
+        Folder *folder = &store->folders[sorted[first]->change->folder];
+        int added = 0;
+
+        for (end = first; end < count && sorted[end]->change->folder == sorted[first]->change->folder; end++) {
+            added += sorted[end]->change->kind == STORE_BATCH_ADD;
+        }
+        if (added > INT32_MAX / 2 - folder->task_count ||
+            !grow((void **)&folder->rows, &folder->row_capacity, folder->task_count + added, sizeof(uint32_t))) {
+            goto done;
+        }
+        if (folder->task_count + added > run) run = folder->task_count + added;
+    }
+    spare = (uint32_t *)malloc((size_t)run * sizeof(uint32_t));
+    if (spare == NULL) goto done;
+
+    sequence = store->next_sequence;
+    for (; made < count; made++) {
+        BatchItem *item = &items[made];
+
+        if (item->change->kind == STORE_BATCH_ADD) {
+            if (!make_batch_task(store, item, sequence++)) goto done;
+        } else if (item->change->kind == STORE_BATCH_TAG) {
+            if (!intern_tags(store, item->change->tags, strlen(item->change->tags), &item->tags)) goto done;
+        }
+    }
+    store->next_sequence = sequence;
+
+    // Nothing below can fail
+    for (int first = 0, end; first < count; first = end) {
+        int index = sorted[first]->change->folder;
+
+        for (end = first; end < count && sorted[end]->change->folder == index; end++) {}
+        commit_batch_folder(store, &store->folders[index], &sorted[first], end - first, placed, marks, spare);
+    }
+    for (int first = 0, end; first < count; first = end) {
+        int index = sorted[first]->change->folder;
+
+        for (end = first; end < count && sorted[end]->change->folder == index; end++) {}
+        notify_batch_folder(store, index, &sorted[first], end - first, marks);
+    }
+    compact_if_wasteful(store);
+    ok = 1;
+
+done:
+    if (!ok) unmake_batch(store, items, made);
+    free(items);
+    free(sorted);
+    free(placed);
+    free(marks);
+    free(spare);
+    return ok;
+}
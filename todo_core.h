@@ -0,0 +1,199 @@
+#ifndef TODO_CORE_H
+#define TODO_CORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "todo_date.h"
+#include "todo_recur.h"
+#include "todo_slots.h"
+#include "todo_strings.h"
+
+enum {
+    PRIORITY_NONE = 0,
+    PRIORITY_LOW,
+    PRIORITY_MEDIUM,
+    PRIORITY_HIGH
+};
+
+// Data structures. Text lives in the store's string pool; use store_text().
+// A repeating task is a single row due on its next open occurrence; its
+// rule is kept apart (store_task_rule()), so other tasks pay nothing for it.
+typedef struct {
+    TodoString description;
+    TodoString tags;        // Canonical tag names (see todo_tags.h), empty if none
+    int32_t deadline_day;   // Days since 1970-01-01, DATE_NONE if unset
+    int completed;
+    int priority;           // PRIORITY_*
+    uint32_t sequence;      // Creation order, increasing within a folder
+    uint32_t id;            // Slot map handle, stable while the task exists; not saved
+    uint32_t rule;          // Handle of its rule in the store's rules, 0 if it does not repeat
+} Task;
+
+// A folder lists its tasks as handles in display order; the tasks
+// themselves stay put in the store's slot map. Use store_task() for a row.
+// Repeating tasks are also listed, in no particular order, in recurring, so
+// occurrences can be expanded without scanning every row.
+typedef struct {
+    TodoString name;
+    uint32_t *rows;
+    int task_count;
+    int row_capacity;
+    uint32_t *recurring;
+    int recurring_count;
+    int recurring_capacity;
+    uint32_t id;        // Stable identity used by the data file and journal
+    int loaded;         // 0 while the tasks still live only in the data file
+    int source_index;   // Directory slot in the backing file, -1 if none
+} Folder;
+
+typedef struct TodoDataFile TodoDataFile;
+
+// One task for store_add_tasks(); the description need not be terminated
+typedef struct {
+    const char *description;
+    size_t length;
+    int32_t deadline_day;
+    int completed;
+    int priority;           // PRIORITY_*
+    const char *tags;       // Canonical tags, NULL for none
+    size_t tags_length;
+    TodoRecurrence repeat;  // unit RECUR_NONE for a one-off task
+} TodoTaskInput;
+
+// Kinds of change for store_apply_batch()
+enum {
+    STORE_BATCH_ADD = 1,
+    STORE_BATCH_COMPLETE,
+    STORE_BATCH_REOPEN,
+    STORE_BATCH_DELETE,
+    STORE_BATCH_TAG
+};
+
+// One change in a batch. Every kind but STORE_BATCH_ADD names an existing
+// task of the folder by its handle.
+typedef struct {
+    int kind;               // STORE_BATCH_*
+    int folder;             // Index of a loaded folder
+    uint32_t task_id;
+    int row;                // Where task_id is thought to be; looked up if it is not there
+    int hint;               // Add or reopen: row wanted (see task_place), -1 for none
+    const char *tags;       // STORE_BATCH_TAG: canonical tags, "" for none
+    TodoTaskInput task;     // STORE_BATCH_ADD
+} TodoBatchChange;
+
+// Change notifications, so views and indexes can follow the store instead
+// of rescanning it. Sent after the change has been applied. A batch sends
+// them once every folder it touches is final, and reports a task that
+// changes row as removed from the old one and added at the new one.
+enum {
+    STORE_RESET = 1,        // Contents replaced wholesale (load, release)
+    STORE_FOLDER_ADDED,     // folder
+    STORE_FOLDER_REMOVED,   // folder: the index it had
+    STORE_FOLDER_LOADED,    // folder: tasks were copied out of the data file
+    STORE_TASK_ADDED,       // folder, position
+    STORE_TASK_MOVED,       // folder, task -> position; the task also changed
+    STORE_TASK_REMOVED      // folder, task
+};
+
+typedef struct {
+    int kind;
+    int folder;
+    int task;       // Index before the change
+    int position;   // Index after the change
+    uint32_t folder_id;
+    uint32_t task_id;
+} TodoStoreChange;
+
+typedef void (*TodoStoreListener)(void *context, const TodoStoreChange *change);
+
+#define STORE_MAX_LISTENERS 8
+
+// Everything the application keeps in memory. Folders are listed from the
+// data file's directory up front, but their tasks are only copied out of the
+// mapped file when store_materialize() is called for them. A folder whose
+// section fails its checksum is quarantined: it keeps its name, loses its
+// tasks and is counted in quarantined.
+//
+// There is no fixed limit on folders or tasks. Both arrays grow as needed,
+// so Folder pointers are only valid until the next folder is added; Task
+// pointers stay valid until that task is deleted. Deleting a task frees
+// its slot and closes the gap in its folder's handle array, never moving
+// other tasks.
+typedef struct {
+    Folder *folders;
+    int folder_count;
+    int folder_capacity;
+    int current_folder;
+    uint32_t next_folder_id;
+    uint32_t next_sequence; // Above the sequence of every task loaded or added so far
+    uint64_t journal_seq;   // Last journal record applied to this store
+    TodoSlotMap tasks;      // Every loaded task, addressed by Task.id
+    TodoSlotMap rules;      // A TodoRecurrence per repeating task, addressed by Task.rule
+    int quarantined;        // Folders whose tasks could not be read back
+    TodoDataFile *backing;
+    TodoStringPool strings; // Names and descriptions of every folder and loaded task
+    TodoStoreListener listeners[STORE_MAX_LISTENERS];  // Kept across loads
+    void *listener_contexts[STORE_MAX_LISTENERS];
+    int listener_count;
+} TodoStore;
+
+// Assembly functions
+int asm_add(int a, int b);
+int asm_subtract(int a, int b);
+int asm_increment(int a);
+
+// Date helpers
+int is_overdue(int32_t deadline_day, int32_t today);
+
+// Sorting. Folders are kept open first, then by deadline (see todo_sort.h
+// for other orders).
+int compare_tasks(const void *a, const void *b);
+void sort_tasks(TodoStore *store, Folder *folder);
+int tasks_in_order(const TodoStore *store, const Folder *folder);
+int task_insert_position(const TodoStore *store, const Folder *folder, const Task *task);
+int task_place(const TodoStore *store, const Folder *folder, const Task *task, int hint);
+
+// Store management
+void store_init(TodoStore *store);
+void store_attach(TodoStore *store, TodoDataFile *file);
+void store_rebind(TodoStore *store, TodoDataFile *file);
+void store_release(TodoStore *store);
+int store_materialize(TodoStore *store, int index);
+int store_find_folder(const TodoStore *store, uint32_t id);
+// The index of each of count folder ids, -1 for one that is not found
+void store_find_folders(const TodoStore *store, const uint32_t *ids, int count, int *indices);
+Task *store_task(const TodoStore *store, const Folder *folder, int row);
+Task *store_find_task(const TodoStore *store, uint32_t id);
+const TodoRecurrence *store_task_rule(const TodoStore *store, const Task *task);
+int store_task_row(const TodoStore *store, int index, uint32_t id);
+const char *store_text(const TodoStore *store, TodoString string);
+void store_compact_strings(TodoStore *store);
+// Listeners are called in the order they were added
+int store_listen(TodoStore *store, TodoStoreListener listener, void *context);
+void store_unlisten(TodoStore *store, TodoStoreListener listener, void *context);
+
+// Mutations (shared by the UI and journal replay). Tasks with a deadline
+// date_valid() refuses are not added, as the file could not hold them.
+int store_create_folder(TodoStore *store, uint32_t id, const char *name);
+int store_insert_folder(TodoStore *store, int position, uint32_t id, const char *name);
+int store_delete_folder(TodoStore *store, int index);
+int store_add_task(TodoStore *store, int index, const char *description, int32_t deadline_day);
+int store_insert_task(TodoStore *store, int index, int hint, const char *description,
+                      int32_t deadline_day, int completed, int priority, const char *tags,
+                      const TodoRecurrence *repeat);
+int store_add_tasks(TodoStore *store, int index, const TodoTaskInput *tasks, int count);
+// Completing a repeating task advances it to its next occurrence; it is only
+// marked completed once its rule has none left. Reopening steps it back.
+int store_complete_task(TodoStore *store, int index, int task);
+int store_reopen_task(TodoStore *store, int index, int task, int hint);
+int store_delete_task(TodoStore *store, int index, int task);
+// Replace a task's tags, which must be canonical ("" for none)
+int store_tag_task(TodoStore *store, int index, int task, const char *tags);
+// Apply many changes across folders as one: either all of them or, if any
+// is invalid or memory runs out, none (returns 0). A task may be changed
+// once per batch. Ends up as applying them in order would, except that
+// tasks given new rows go after the tasks already there with the same key,
+// in batch order, unless their hint keeps the folder ordered.
+int store_apply_batch(TodoStore *store, const TodoBatchChange *changes, int count);
+
+#endif
@@ -0,0 +1,165 @@
+#include "todo_date.h"
+
+#include <time.h>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define DATE_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+static const unsigned char month_days[13] = {
+    0, 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31
+};
+
+int date_is_leap_year(int year) {
+    return (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+}
+
+int date_days_in_month(int year, int month) {
+    return month_days[month] + (month == 2 && date_is_leap_year(year));
+}
+
+// Civil date to day number (Howard Hinnant's days_from_civil)
+int32_t date_from_civil(int year, int month, int day) {
+    int era, year_of_era, day_of_year, day_of_era;
+
+    year -= month <= 2;
+    era = (year >= 0 ? year : year - 399) / 400;
+    year_of_era = year - era * 400;
+    day_of_year = (153 * (month + (month > 2 ? -3 : 9)) + 2) / 5 + day - 1;
+    day_of_era = year_of_era * 365 + year_of_era / 4 - year_of_era / 100 + day_of_year;
+    return (int32_t)era * 146097 + day_of_era - 719468;
+}
+
+void date_to_civil(int32_t day_number, int *year, int *month, int *day) {
+    int32_t z = day_number + 719468;
+    int32_t era = (z >= 0 ? z : z - 146096) / 146097;
+    int day_of_era = (int)(z - era * 146097);
+    int year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+    int day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+    int shifted_month = (5 * day_of_year + 2) / 153;
+
+    *day = day_of_year - (153 * shifted_month + 2) / 5 + 1;
+    *month = shifted_month < 10 ? shifted_month + 3 : shifted_month - 9;
+    *year = (int)(year_of_era + era * 400) + (*month <= 2);
+}
+
+int date_valid(int32_t day_number) {
+    return day_number == DATE_NONE || (day_number >= DATE_FIRST_DAY && day_number <= DATE_LAST_DAY);
+}
+
+// Range and calendar checks shared by the scalar and SSE2 paths
+static int finish_date(int year, int month, int day, int32_t *day_number) {
+    if (year < DATE_MIN_YEAR || year > DATE_MAX_YEAR ||
+        month < 1 || month > 12 ||
+        day < 1 || day > date_days_in_month(year, month)) {
+        return 0;
+    }
+    *day_number = date_from_civil(year, month, day);
+    return 1;
+}
+
+#define DIGIT(p) ((unsigned)(p) - '0')
+
+int date_parse_fixed(const char *text, int32_t *day_number) {
+    const unsigned char *s = (const unsigned char *)text;
+    unsigned y0 = DIGIT(s[0]), y1 = DIGIT(s[1]), y2 = DIGIT(s[2]), y3 = DIGIT(s[3]);
+    unsigned m0 = DIGIT(s[5]), m1 = DIGIT(s[6]);
+    unsigned d0 = DIGIT(s[8]), d1 = DIGIT(s[9]);
+
+    // Any byte outside '0'..'9' wraps to a value above 9
+    unsigned bad = (y0 > 9) | (y1 > 9) | (y2 > 9) | (y3 > 9) |
+                   (m0 > 9) | (m1 > 9) | (d0 > 9) | (d1 > 9) |
+                   (s[4] != '-') | (s[7] != '-');
+    if (bad) return 0;
+
+    return finish_date((int)(y0 * 1000 + y1 * 100 + y2 * 10 + y3),
+                       (int)(m0 * 10 + m1), (int)(d0 * 10 + d1), day_number);
+}
+
+int date_parse(const char *text, int32_t *day_number) {
+    // Exactly ten characters, without reading past a shorter string
+    for (int i = 0; i < 10; i++) {
+        if (text[i] == '\0') return 0;
+    }
+    if (text[10] != '\0') return 0;
+    return date_parse_fixed(text, day_number);
+}
+
+void date_format(int32_t day_number, char out[DATE_TEXT_LENGTH]) {
+    int year, month, day;
+
+    if (day_number == DATE_NONE) {
+        out[0] = '\0';
+        return;
+    }
+    date_to_civil(day_number, &year, &month, &day);
+    out[0] = (char)('0' + year / 1000 % 10);
+    out[1] = (char)('0' + year / 100 % 10);
+    out[2] = (char)('0' + year / 10 % 10);
+    out[3] = (char)('0' + year % 10);
+    out[4] = '-';
+    out[5] = (char)('0' + month / 10);
+    out[6] = (char)('0' + month % 10);
+    out[7] = '-';
+    out[8] = (char)('0' + day / 10);
+    out[9] = (char)('0' + day % 10);
+    out[10] = '\0';
+}
+
+int32_t date_today(void) {
+    time_t now = time(NULL);
+    struct tm *local = localtime(&now);
+
+    if (local == NULL) {
+        return (int32_t)(now / 86400);
+    }
+    return date_from_civil(local->tm_year + 1900, local->tm_mon + 1, local->tm_mday);
+}
+
+size_t date_parse_column(const char *column, size_t stride, size_t count,
+                         int32_t *days, uint8_t *valid) {
+    size_t valid_count = 0;
+    size_t i = 0;
+
+#ifdef DATE_USE_SSE2
+    // Check all ten format bytes of a field with one 16-byte load. Loads
+    // stay inside the column while 16 bytes remain from the field start.
+    const __m128i zero_char = _mm_set1_epi8('0');
+    const __m128i nine = _mm_set1_epi8(9);
+    const __m128i dash = _mm_set1_epi8('-');
+    const __m128i zero = _mm_setzero_si128();
+    const int digit_bits = 0x36F;   // Positions 0-3, 5-6, 8-9
+    const int dash_bits = 0x090;    // Positions 4 and 7
+
+    for (; i < count && (count - 1 - i) * stride + 10 >= 16; i++) {
+        const char *field = column + i * stride;
+        __m128i bytes = _mm_loadu_si128((const __m128i *)field);
+        __m128i digits = _mm_sub_epi8(bytes, zero_char);
+        int digit_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_subs_epu8(digits, nine), zero));
+        int dash_mask = _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, dash));
+        int32_t day = DATE_NONE;
+        int ok = (digit_mask & digit_bits) == digit_bits && (dash_mask & dash_bits) == dash_bits;
+
+        if (ok) {
+            const unsigned char *s = (const unsigned char *)field;
+            ok = finish_date((int)(DIGIT(s[0]) * 1000 + DIGIT(s[1]) * 100 + DIGIT(s[2]) * 10 + DIGIT(s[3])),
+                             (int)(DIGIT(s[5]) * 10 + DIGIT(s[6])),
+                             (int)(DIGIT(s[8]) * 10 + DIGIT(s[9])), &day);
+        }
+        days[i] = ok ? day : DATE_NONE;
+        valid[i] = (uint8_t)ok;
+        valid_count += (size_t)ok;
+    }
+#endif
+
+    for (; i < count; i++) {
+        int32_t day = DATE_NONE;
+        int ok = date_parse_fixed(column + i * stride, &day);
+
+        days[i] = ok ? day : DATE_NONE;
+        valid[i] = (uint8_t)ok;
+        valid_count += (size_t)ok;
+    }
+    return valid_count;
+}
@@ -0,0 +1,47 @@
+#ifndef TODO_DATE_H
+#define TODO_DATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Date engine. Deadlines are stored as a day number (days since
+// 1970-01-01 in the proleptic Gregorian calendar) and only turned back into
+// YYYY-MM-DD text for display. Parsing reads fixed positions, so there is
+// no sscanf, strlen or mktime on the hot path.
+
+#define DATE_NONE INT32_MIN     // No deadline; sorts before every real date
+#define DATE_TEXT_LENGTH 11     // "YYYY-MM-DD" plus terminator
+#define DATE_MIN_YEAR 1000
+#define DATE_MAX_YEAR 9999
+#define DATE_FIRST_DAY (-354285)    // 1000-01-01
+#define DATE_LAST_DAY 2932896       // 9999-12-31
+
+int date_is_leap_year(int year);
+int date_days_in_month(int year, int month);
+int32_t date_from_civil(int year, int month, int day);
+void date_to_civil(int32_t day_number, int *year, int *month, int *day);
+// DATE_NONE or a day from DATE_FIRST_DAY to DATE_LAST_DAY; day numbers read
+// from a file are checked with this before anything converts them
+int date_valid(int32_t day_number);
+
+// Parse a NUL-terminated "YYYY-MM-DD" string. Returns 1 and stores the day
+// number if the text is well formed and names a real calendar day.
+int date_parse(const char *text, int32_t *day_number);
+
+// Parse exactly ten bytes at text; the caller handles any terminator
+int date_parse_fixed(const char *text, int32_t *day_number);
+
+// Write "YYYY-MM-DD" (or an empty string for DATE_NONE) into out
+void date_format(int32_t day_number, char out[DATE_TEXT_LENGTH]);
+
+// Today's local date as a day number
+int32_t date_today(void);
+
+// Validate and convert count ten-byte fields laid out stride bytes apart,
+// as in a fixed-width import column. valid[i] is set to 1 or 0 and
+// days[i] to the day number or DATE_NONE. Uses SSE2 where available.
+// Returns the number of valid fields.
+size_t date_parse_column(const char *column, size_t stride, size_t count,
+                         int32_t *days, uint8_t *valid);
+
+#endif
@@ -0,0 +1,88 @@
+#include "todo_due.h"
+
+#include <time.h>
+
+// Completed tasks map to DUE_DONE; otherwise the state is 1 plus one for
+// "today" and two for "overdue". No branches, so the loop vectorizes.
+static uint8_t classify(int32_t deadline, int completed, int32_t today) {
+    unsigned overdue = (unsigned)(deadline < today) & (unsigned)(deadline != DATE_NONE);
+    unsigned due_today = (unsigned)(deadline == today);
+    unsigned open = (unsigned)(completed == 0);
+    return (uint8_t)((DUE_UPCOMING + due_today + 2 * overdue) * open);
+}
+
+void due_classify(const int32_t *deadlines, const uint8_t *completed, size_t count,
+                  int32_t today, uint8_t *states) {
+    for (size_t i = 0; i < count; i++) {
+        states[i] = classify(deadlines[i], completed[i], today);
+    }
+}
+
+void due_classify_tasks(const Task *tasks, int count, int32_t today, uint8_t *states) {
+    for (int i = 0; i < count; i++) {
+        states[i] = classify(tasks[i].deadline_day, tasks[i].completed, today);
+    }
+}
+
+int due_state(const Task *task, int32_t today) {
+    return classify(task->deadline_day, task->completed, today);
+}
+
+// First incomplete task whose deadline is not below day
+static int lower_bound_open(const TodoStore *store, const Folder *folder, int32_t day) {
+    int low = 0;
+    int high = folder->task_count;
+
+    while (low < high) {
+        int mid = low + (high - low) / 2;
+        const Task *task = store_task(store, folder, mid);
+        if (!task->completed && task->deadline_day < day) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+int due_changed_rows(const TodoStore *store, const Folder *folder, int32_t old_today, int32_t new_today,
+                     int *first, int *last) {
+    int32_t low_day = old_today < new_today ? old_today : new_today;
+    int32_t high_day = old_today < new_today ? new_today : old_today;
+
+    if (old_today == new_today) return 0;
+
+    *first = lower_bound_open(store, folder, low_day);
+    *last = high_day == INT32_MAX ? folder->task_count : lower_bound_open(store, folder, high_day + 1);
+    return *first < *last;
+}
+
+// Undated tasks sort first among the incomplete ones, so skip past them
+int32_t due_next_deadline(const TodoStore *store, const Folder *folder) {
+    int row = lower_bound_open(store, folder, DATE_NONE + 1);
+    const Task *task;
+
+    if (row >= folder->task_count) return DATE_NONE;
+    task = store_task(store, folder, row);
+    return task->completed ? DATE_NONE : task->deadline_day;
+}
+
+long due_ms_until_midnight(void) {
+    time_t now = time(NULL);
+    struct tm *local = localtime(&now);
+    struct tm midnight;
+    double seconds;
+
+    if (local == NULL) {
+        return 60L * 1000;   // Try again in a minute
+    }
+    midnight = *local;
+    midnight.tm_mday += 1;
+    midnight.tm_hour = 0;
+    midnight.tm_min = 0;
+    midnight.tm_sec = 0;
+    midnight.tm_isdst = -1; // Let mktime handle DST changes
+    seconds = difftime(mktime(&midnight), now);
+    if (seconds < 1) seconds = 1;
+    return (long)(seconds * 1000);
+}
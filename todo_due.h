@@ -0,0 +1,43 @@
+#ifndef TODO_DUE_H
+#define TODO_DUE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "todo_core.h"
+
+// Batch due-state classification. Every task in a folder is classified
+// against a single "today" snapshot in one branch-free pass, and when the
+// date rolls over only the tasks whose state actually changed are found
+// again: because folders are ordered by deadline, those form one
+// contiguous run of rows.
+
+enum {
+    DUE_DONE = 0,       // Completed
+    DUE_UPCOMING,       // Deadline after today, or no deadline
+    DUE_TODAY,
+    DUE_OVERDUE
+};
+
+// Classify count tasks given as a deadline column and a completion column
+void due_classify(const int32_t *deadlines, const uint8_t *completed, size_t count,
+                  int32_t today, uint8_t *states);
+
+// Same, reading the fields straight out of a task array
+void due_classify_tasks(const Task *tasks, int count, int32_t today, uint8_t *states);
+
+int due_state(const Task *task, int32_t today);
+
+// Rows of an ordered folder whose state differs between old_today and
+// new_today: the incomplete tasks with a deadline in [old_today, new_today].
+// Returns 0 if there are none, otherwise sets [*first, *last).
+int due_changed_rows(const TodoStore *store, const Folder *folder, int32_t old_today, int32_t new_today,
+                     int *first, int *last);
+
+// Earliest deadline of an incomplete task in an ordered folder, DATE_NONE
+// if no incomplete task has one
+int32_t due_next_deadline(const TodoStore *store, const Folder *folder);
+
+// Milliseconds from now until the next local midnight
+long due_ms_until_midnight(void);
+
+#endif
@@ -0,0 +1,287 @@
+#ifndef TODO_FORMAT_H
+#define TODO_FORMAT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "todo_core.h"
+
+// On-disk layout of todo_data.dat (version 9):
+//
+//   TodoFileHeader      72 bytes at offset 0
+//   TodoFolderEntry[]   folder directory at header.directory_offset
+//   names               UTF-8 folder names at header.names_offset
+//   folder sections     one per folder at entry.section_offset, in one of
+//                       two encodings (entry.encoding):
+//                         plain: TodoTaskRecord[], then a uint32_t
+//                         creation sequence per task, then a
+//                         TodoTagRecord per task, then a
+//                         TodoRuleRecord for each repeating task, then
+//                         the text of its tasks and tags, all read in
+//                         place
+//                         columnar: column blocks, see below
+//   metadata mirror     a copy of the header, directory and names
+//   TodoFileTrailer     16 bytes at the end, locating the mirror
+//
+// Integers are little-endian and every structure has a fixed size, so the
+// file is mapped and plain records are read in place. Offsets in the header are
+// relative to the header itself, so the mirror reads the same way as the
+// original. The header, directory and names are covered by one CRC32C and
+// each folder section by its own, kept in its directory entry: a damaged
+// section costs only that folder's tasks, and a damaged first page falls
+// back to the mirror.
+//
+// A columnar section is a run of blocks, each a TodoColumnHeader and its
+// bytes, so a reader can skip columns it does not need: deadlines as
+// zigzag varints of the difference from the previous task (tasks are
+// sorted by deadline, so these are mostly one byte), completion flags one
+// bit per task, description lengths as varints, creation sequences as
+// zigzag varint deltas, a priority byte per task (only when some task has
+// one), the rule records as they are (only when the folder has repeating
+// tasks), the folder's distinct tag sets as NUL-terminated strings and a
+// varint per task naming its set (only when some task has tags), then the
+// descriptions back to back in TODOFMT_TEXT_BLOCK pieces, each compressed
+// with lz_compress() or stored as is if that does not help. It trades reading in place for a
+// file several times smaller, which pays off where the disk is slow, such
+// as a network home directory.
+//
+// A repeating task is stored once, as its next open occurrence plus a rule
+// record naming its row; occurrences after that are never written.
+// Version 8 files are the same without tags, version 7 files also without
+// priorities and sequences, version 6 files also without rules; all are
+// read as they are, tasks without sequences taking them in row order.
+//
+// Version 1 files (a raw dump of Task structs with no header), version 3
+// files (fixed 100-byte text fields), version 4 files (one shared strings
+// section, no checksums) and version 5 files (plain sections only) are
+// upgraded once by todofmt_upgrade_legacy().
+
+#define TODOFMT_MAGIC "TODODAT"
+#define TODOFMT_TRAILER_MAGIC "TODOEND"
+#define TODOFMT_VERSION 9
+#define TODOFMT_MIN_VERSION 6       // Oldest version read without upgrading
+#define TODOFMT_TEXT_BLOCK (64 * 1024)
+
+enum {
+    TODOFMT_OK = 0,
+    TODOFMT_ERR_MISSING,    // File does not exist
+    TODOFMT_ERR_IO,         // Open, map or write failed
+    TODOFMT_ERR_LEGACY,     // Version 1, 3, 4 or 5 file that needs upgrading
+    TODOFMT_ERR_VERSION,    // Written by a newer version
+    TODOFMT_ERR_CORRUPT     // Neither copy of the header and directory is intact
+};
+
+// Section encodings
+enum {
+    TODOFMT_PLAIN = 0,
+    TODOFMT_COLUMNAR
+};
+
+// Columns of a columnar section, and how each block is coded
+enum {
+    TODOFMT_COLUMN_DEADLINES = 1,
+    TODOFMT_COLUMN_COMPLETED,
+    TODOFMT_COLUMN_LENGTHS,
+    TODOFMT_COLUMN_TEXT,
+    TODOFMT_COLUMN_RULES,
+    TODOFMT_COLUMN_SEQUENCES,
+    TODOFMT_COLUMN_PRIORITIES,
+    TODOFMT_COLUMN_TAG_SETS,
+    TODOFMT_COLUMN_TAGS
+};
+
+enum {
+    TODOFMT_CODEC_RAW = 0,
+    TODOFMT_CODEC_DELTA_VARINT,
+    TODOFMT_CODEC_VARINT,
+    TODOFMT_CODEC_BITS,
+    TODOFMT_CODEC_LZ
+};
+
+// What todofmt_section_ok() found in a folder section
+enum {
+    TODOFMT_SECTION_UNCHECKED = 0,
+    TODOFMT_SECTION_OK,
+    TODOFMT_SECTION_DAMAGED
+};
+
+typedef struct {
+    char magic[8];
+    uint32_t version;
+    uint32_t header_size;
+    uint32_t folder_count;
+    int32_t current_folder;
+    uint64_t directory_offset;
+    uint32_t folder_entry_size;
+    uint32_t task_record_size;
+    uint32_t next_folder_id;
+    uint32_t names_size;
+    uint64_t journal_seq;       // Last journal record folded into this file
+    uint64_t names_offset;
+    uint32_t metadata_size;     // Header, directory and names
+    uint32_t metadata_crc;      // CRC32C of those with this field zero
+} TodoFileHeader;
+
+typedef struct {
+    uint32_t name_offset;       // Relative to the names section
+    uint32_t name_length;
+    uint32_t task_count;
+    uint32_t id;
+    uint64_t section_offset;
+    uint32_t section_size;
+    uint32_t section_crc;       // CRC32C of the whole section
+    uint32_t encoding;          // TODOFMT_PLAIN or TODOFMT_COLUMNAR
+    uint32_t rule_count;        // Repeating tasks; always 0 before version 7
+} TodoFolderEntry;
+
+typedef struct {
+    uint32_t text_offset;       // Relative to the text of its section
+    uint32_t text_length;
+    int32_t deadline_day;
+    int32_t flags;              // TODOFMT_TASK_COMPLETED, priority
+} TodoTaskRecord;
+
+#define TODOFMT_TASK_COMPLETED 0x1
+#define TODOFMT_PRIORITY_SHIFT 8        // Bits 8 and 9 hold the priority
+
+// A task's canonical tags (see todo_tags.h), in the text of its section
+typedef struct {
+    uint32_t text_offset;
+    uint32_t text_length;       // 0 for a task without tags
+} TodoTagRecord;
+
+// The rule of a repeating task; task is its row, and rules are in row order
+typedef struct {
+    uint32_t task;
+    TodoRecurrence rule;
+} TodoRuleRecord;
+
+typedef struct {
+    uint64_t mirror_offset;
+    char magic[8];
+} TodoFileTrailer;
+
+typedef struct {
+    uint32_t column;            // TODOFMT_COLUMN_*
+    uint32_t codec;             // TODOFMT_CODEC_*
+    uint32_t stored_size;       // Bytes that follow this header
+    uint32_t decoded_size;
+} TodoColumnHeader;
+
+// A decoded columnar section. Descriptions are back to back in text, in
+// task order, with lengths[i] bytes each. Task i's tags are the
+// tag_lengths[i] bytes at tag_sets + tag_offsets[i].
+typedef struct {
+    uint32_t count;
+    int32_t *deadlines;
+    uint8_t *completed;
+    uint8_t *priorities;        // All PRIORITY_NONE when the section has none
+    uint32_t *sequences;        // NULL before version 8
+    uint32_t *lengths;
+    char *text;
+    size_t text_size;
+    TodoRuleRecord *rules;
+    uint32_t rule_count;
+    char *tag_sets;             // These three are NULL when no task has tags
+    uint32_t *tag_offsets;
+    uint32_t *tag_lengths;
+} TodoSectionColumns;
+
+// The deadlines, completion flags and repeat rules of a folder section, in
+// row order: what an agenda or the reminders need from a folder that is
+// not loaded
+typedef struct {
+    uint32_t count;
+    int32_t *deadlines;
+    uint8_t *completed;
+    TodoRuleRecord *rules;
+    uint32_t rule_count;
+} TodoSectionDeadlines;
+
+// The same, as an agenda searches it again and again: a plain section's
+// records are read in place and only a columnar one's columns decoded.
+// Exactly one of records and deadlines is set.
+typedef struct {
+    const TodoTaskRecord *records;
+    const int32_t *deadlines;
+    const uint8_t *completed;       // With deadlines
+    const TodoRuleRecord *rules;
+    uint32_t count;
+    uint32_t rule_count;
+    int in_order;                   // Open tasks first, then by deadline, as a loaded folder's rows are
+} TodoDeadlineView;
+
+// Compile-time layout checks
+typedef char todofmt_header_size_check[sizeof(TodoFileHeader) == 72 ? 1 : -1];
+typedef char todofmt_entry_size_check[sizeof(TodoFolderEntry) == 40 ? 1 : -1];
+typedef char todofmt_record_size_check[sizeof(TodoTaskRecord) == 16 ? 1 : -1];
+typedef char todofmt_tag_size_check[sizeof(TodoTagRecord) == 8 ? 1 : -1];
+typedef char todofmt_rule_size_check[sizeof(TodoRuleRecord) == 16 ? 1 : -1];
+typedef char todofmt_trailer_size_check[sizeof(TodoFileTrailer) == 16 ? 1 : -1];
+typedef char todofmt_column_size_check[sizeof(TodoColumnHeader) == 16 ? 1 : -1];
+
+// CRC32C (Castagnoli), using the SSE4.2 or ARMv8 CRC instructions on three
+// interleaved streams where the processor has them, and eight bytes per
+// table step where it does not. Pass 0 to start and the previous result to
+// continue.
+uint32_t todofmt_crc32c(uint32_t crc, const void *data, size_t size);
+
+// Mapped file access. todofmt_open_memory() reads a file already in
+// memory instead, which must be 8-byte aligned (as malloc() returns) and
+// outlive the TodoDataFile; it is checked the same way.
+int todofmt_open(const char *path, TodoDataFile **out);
+int todofmt_open_memory(const void *data, size_t size, TodoDataFile **out);
+void todofmt_close(TodoDataFile *file);
+const TodoFileHeader *todofmt_header(const TodoDataFile *file);
+const TodoFolderEntry *todofmt_folder_entry(const TodoDataFile *file, uint32_t index);
+const char *todofmt_folder_name(const TodoDataFile *file, const TodoFolderEntry *entry);
+
+// Plain sections are read in place
+const TodoTaskRecord *todofmt_task_records(const TodoDataFile *file, const TodoFolderEntry *entry);
+const TodoRuleRecord *todofmt_task_rules(const TodoDataFile *file, const TodoFolderEntry *entry);
+// NULL for a file from before version 8
+const uint32_t *todofmt_task_sequences(const TodoDataFile *file, const TodoFolderEntry *entry);
+const char *todofmt_task_text(const TodoDataFile *file, const TodoFolderEntry *entry,
+                              const TodoTaskRecord *record);
+// NULL for a file from before version 9
+const TodoTagRecord *todofmt_task_tags(const TodoDataFile *file, const TodoFolderEntry *entry);
+const char *todofmt_tag_text(const TodoDataFile *file, const TodoFolderEntry *entry,
+                             const TodoTagRecord *record);
+
+// Columnar sections are decoded into new arrays. Returns 0 if the section
+// does not decode; the columns are then empty.
+int todofmt_decode_columns(const TodoDataFile *file, const TodoFolderEntry *entry, TodoSectionColumns *out);
+void todofmt_free_columns(TodoSectionColumns *columns);
+
+// Read the deadlines of the folder section at index without loading its
+// tasks: in place from a plain section, and from a columnar one only the
+// deadline, completion and rule columns, with no text decompressed.
+// Returns 0 when the section is damaged or out of memory.
+int todofmt_section_deadlines(TodoDataFile *file, uint32_t index, TodoSectionDeadlines *out);
+void todofmt_free_deadlines(TodoSectionDeadlines *deadlines);
+// The deadlines of the section at index, built on first use and kept with
+// the file until it is closed, so a saved or reopened file starts afresh.
+// Returns NULL when the section is damaged or out of memory.
+const TodoDeadlineView *todofmt_deadline_view(TodoDataFile *file, uint32_t index);
+int32_t todofmt_view_deadline(const TodoDeadlineView *view, uint32_t row);
+int todofmt_view_completed(const TodoDeadlineView *view, uint32_t row);
+
+// Section checks. Opening a file only checks the header and directory;
+// todofmt_section_ok() checks one folder section the first time it is
+// asked, and todofmt_verify() checks all that are left on up to threads
+// threads, the caller's included. The result is the number of damaged
+// sections. todofmt_save_damaged() appends each damaged section, after its
+// directory entry, to path so that nothing is thrown away.
+int todofmt_section_ok(TodoDataFile *file, uint32_t index);
+int todofmt_verify(TodoDataFile *file, int threads);
+int todofmt_damaged_count(const TodoDataFile *file);
+int todofmt_save_damaged(const TodoDataFile *file, const char *path);
+
+// Writing, with every folder section in the given encoding
+int todofmt_write(const char *path, const TodoStore *store, int encoding);
+int todofmt_replace(const char *from, const char *to);
+
+// Version 1, 3, 4 and 5 conversion
+int todofmt_convert_legacy(const char *legacy_path, const char *out_path);
+int todofmt_upgrade_legacy(const char *path);
+
+#endif
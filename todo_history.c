@@ -0,0 +1,770 @@
+#include "todo_history.h"
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+typedef struct {
+    int op;
+    uint32_t folder_id;
+    int task_index;
+    char *text[2];
+    int inverse_start;      // Forward entries: first inverse entry undoing this one
+} HistoryEntry;
+
+struct TodoHistoryCommand {
+    HistoryEntry *forward;
+    int forward_count;
+    int forward_capacity;
+    HistoryEntry *inverse;  // Grouped per forward entry, each group in apply order
+    int inverse_count;
+    int inverse_capacity;
+    int batch;              // Entries apply as one, in each direction
+    int prepared;           // Seen by history_prepare()
+    size_t bytes;
+};
+
+// A list as a snapshot kept it
+typedef struct {
+    uint32_t folder_id;
+    int missing;            // The list did not exist yet
+    HistoryEntry *tasks;    // Entries putting its tasks back, in row order
+    int task_count;
+    int task_capacity;
+    size_t bytes;
+    int references;         // Snapshots holding it
+} ListImage;
+
+typedef struct {
+    int step;               // The state after commands[0..step)
+    ListImage **lists;      // Lists changed since, as they were then
+    int list_count;
+    int list_capacity;
+} HistorySnapshot;
+
+struct TodoHistory {
+    TodoHistoryCommand **commands;  // Oldest first
+    int count;
+    int capacity;
+    int undo_count;                 // commands[0..undo_count) can be undone
+    size_t bytes;
+    size_t budget;
+    HistorySnapshot *snapshots;     // Oldest first
+    int snapshot_count;
+    int snapshot_capacity;
+    size_t snapshot_bytes;
+};
+
+static char *copy_text(const char *text, size_t *bytes) {
+    size_t length;
+    char *copy;
+
+    if (text == NULL) return NULL;
+    length = strlen(text) + 1;
+    copy = (char *)malloc(length);
+    if (copy != NULL) {
+        memcpy(copy, text, length);
+        *bytes += length;
+    }
+    return copy;
+}
+
+static int append_entry(HistoryEntry **entries, int *count, int *capacity, size_t *bytes,
+                        int op, uint32_t folder_id, int task_index,
+                        const char *text, const char *deadline) {
+    HistoryEntry *entry;
+
+    if (*count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 4;
+        HistoryEntry *grown = (HistoryEntry *)realloc(*entries, (size_t)new_capacity * sizeof(HistoryEntry));
+        if (grown == NULL) return 0;
+        *bytes += (size_t)(new_capacity - *capacity) * sizeof(HistoryEntry);
+        *entries = grown;
+        *capacity = new_capacity;
+    }
+    entry = &(*entries)[*count];
+    entry->op = op;
+    entry->folder_id = folder_id;
+    entry->task_index = task_index;
+    entry->text[0] = copy_text(text, bytes);
+    entry->text[1] = copy_text(deadline, bytes);
+    entry->inverse_start = 0;
+    if ((text != NULL && entry->text[0] == NULL) || (deadline != NULL && entry->text[1] == NULL)) {
+        free(entry->text[0]);
+        free(entry->text[1]);
+        return 0;
+    }
+    (*count)++;
+    return 1;
+}
+
+static int add_inverse(TodoHistoryCommand *command, int op, uint32_t folder_id, int task_index,
+                       const char *text, const char *deadline) {
+    return append_entry(&command->inverse, &command->inverse_count, &command->inverse_capacity,
+                        &command->bytes, op, folder_id, task_index, text, deadline);
+}
+
+static const TodoRecurrence no_rule;
+
+// An entry putting a task back at the position it had, with its priority,
+// its tags and its rule if it repeats
+static int restore_entry(HistoryEntry **entries, int *count, int *capacity, size_t *bytes, const TodoStore *store,
+                         uint32_t folder_id, const Task *task, int position) {
+    const TodoRecurrence *rule = store_task_rule(store, task);
+    char schedule[JOURNAL_SCHEDULE_LENGTH];
+
+    journal_format_schedule(task->deadline_day, rule ? rule : &no_rule, task->priority,
+                            store_text(store, task->tags), schedule);
+    return append_entry(entries, count, capacity, bytes, task->completed ? JOURNAL_RESTORE_TASK : JOURNAL_ADD_TASK,
+                        folder_id, position, store_text(store, task->description), schedule);
+}
+
+static int restore_task(TodoHistoryCommand *command, const TodoStore *store, uint32_t folder_id,
+                        const Task *task, int position) {
+    return restore_entry(&command->inverse, &command->inverse_count, &command->inverse_capacity, &command->bytes,
+                         store, folder_id, task, position);
+}
+
+// Inverse entries for entry, whose folder is at index, against the current
+// store. Tasks with the same description, deadline and state are
+// interchangeable, so inverses may locate their target by content;
+// positions are passed along so that the order within equal deadlines
+// comes back too.
+static int add_inverses(TodoHistoryCommand *command, TodoStore *store, const TodoJournalEntry *entry, int index) {
+    const Folder *folder;
+    const Task *task;
+    const TodoRecurrence *rule;
+    int32_t day;
+    char deadline[DATE_TEXT_LENGTH];
+
+    if (entry->op == JOURNAL_CREATE_LIST) {
+        uint32_t id = entry->folder_id ? entry->folder_id : store->next_folder_id;
+        return add_inverse(command, JOURNAL_DELETE_LIST, id, -1, NULL, NULL);
+    }
+
+    if (index < 0) return 0;
+    store_materialize(store, index);
+    folder = &store->folders[index];
+    if (!folder->loaded) return 0;
+
+    switch (entry->op) {
+        case JOURNAL_DELETE_LIST:
+            // Recreate the list in place, then append its tasks in order
+            if (!add_inverse(command, JOURNAL_CREATE_LIST, folder->id, index, store_text(store, folder->name), NULL)) return 0;
+            for (int i = 0; i < folder->task_count; i++) {
+                if (!restore_task(command, store, folder->id, store_task(store, folder, i), i)) return 0;
+            }
+            return 1;
+
+        case JOURNAL_ADD_TASK:
+        case JOURNAL_RESTORE_TASK: {
+            Task added;
+
+            memset(&added, 0, sizeof(added));
+            added.deadline_day = journal_entry_deadline(entry);
+            added.completed = entry->op == JOURNAL_RESTORE_TASK;
+            date_format(added.deadline_day, deadline);
+            return add_inverse(command, JOURNAL_DELETE_TASK, folder->id,
+                               task_place(store, folder, &added, entry->task_index),
+                               entry->text[0] ? entry->text[0] : "", deadline);
+        }
+
+        case JOURNAL_COMPLETE_TASK:
+        case JOURNAL_REOPEN_TASK:
+        case JOURNAL_DELETE_TASK:
+            index = journal_locate_task(store, folder, entry);
+            if (index < 0) return 0;
+            task = store_task(store, folder, index);
+            rule = store_task_rule(store, task);
+            // The inverse finds the task by the deadline it is about to
+            // have, which moves for an open repeating task
+            day = task->deadline_day;
+            if (rule != NULL && !task->completed && entry->op != JOURNAL_DELETE_TASK) {
+                day = entry->op == JOURNAL_COMPLETE_TASK ? recur_next(rule, day) : recur_previous(rule, day);
+                if (day == DATE_NONE && entry->op == JOURNAL_REOPEN_TASK) return 1;
+                if (day == DATE_NONE) day = task->deadline_day;
+            }
+            date_format(day, deadline);
+            if (entry->op == JOURNAL_COMPLETE_TASK) {
+                return add_inverse(command, JOURNAL_REOPEN_TASK, folder->id, index, store_text(store, task->description), deadline);
+            }
+            if (entry->op == JOURNAL_REOPEN_TASK) {
+                return add_inverse(command, JOURNAL_COMPLETE_TASK, folder->id, -1, store_text(store, task->description), deadline);
+            }
+            return restore_task(command, store, folder->id, task, index);
+
+        case JOURNAL_TAG_TASK: {
+            char schedule[JOURNAL_SCHEDULE_LENGTH];
+
+            index = journal_locate_task(store, folder, entry);
+            if (index < 0) return 0;
+            task = store_task(store, folder, index);
+            journal_format_schedule(task->deadline_day, &no_rule, PRIORITY_NONE, store_text(store, task->tags),
+                                    schedule);
+            return add_inverse(command, JOURNAL_TAG_TASK, folder->id, index, store_text(store, task->description),
+                               schedule);
+        }
+    }
+    return 0;
+}
+
+static int add_command_entry(TodoHistoryCommand **command, TodoStore *store, const TodoJournalEntry *entry,
+                             int index) {
+    TodoHistoryCommand *target = *command;
+    int inverse_start, forward_count;
+
+    if (target == NULL) {
+        target = (TodoHistoryCommand *)calloc(1, sizeof(TodoHistoryCommand));
+        if (target == NULL) return 0;
+        target->bytes = sizeof(TodoHistoryCommand);
+    }
+
+    inverse_start = target->inverse_count;
+    forward_count = target->forward_count;
+    if (!add_inverses(target, store, entry, index) ||
+        !append_entry(&target->forward, &target->forward_count, &target->forward_capacity, &target->bytes,
+                      entry->op, entry->folder_id, entry->task_index, entry->text[0], entry->text[1])) {
+        // Roll the command back to where it was
+        while (target->inverse_count > inverse_start) {
+            HistoryEntry *dropped = &target->inverse[--target->inverse_count];
+            for (int i = 0; i < 2; i++) {
+                if (dropped->text[i]) target->bytes -= strlen(dropped->text[i]) + 1;
+                free(dropped->text[i]);
+            }
+        }
+        target->forward_count = forward_count;
+        if (*command == NULL) history_free_command(target);
+        return 0;
+    }
+    target->forward[target->forward_count - 1].inverse_start = inverse_start;
+    *command = target;
+    return 1;
+}
+
+int history_add(TodoHistoryCommand **command, TodoStore *store, const TodoJournalEntry *entry) {
+    return add_command_entry(command, store, entry, store_find_folder(store, entry->folder_id));
+}
+
+int history_add_batch(TodoHistoryCommand **command, TodoStore *store, const TodoJournalEntry *entries, int count) {
+    uint32_t *ids;
+    int *folders;
+    int ok = 0;
+
+    if (*command != NULL || count <= 0) return 0;
+    ids = (uint32_t *)malloc((size_t)count * sizeof(uint32_t));
+    folders = (int *)malloc((size_t)count * sizeof(int));
+    if (ids == NULL || folders == NULL) goto done;
+
+    // A batch never adds or removes lists, so each entry's list is looked
+    // up once, before any inverse is worked out
+    for (int i = 0; i < count; i++) ids[i] = entries[i].folder_id;
+    store_find_folders(store, ids, count, folders);
+    for (int i = 0; i < count; i++) {
+        if (!add_command_entry(command, store, &entries[i], folders[i])) {
+            history_free_command(*command);
+            *command = NULL;
+            goto done;
+        }
+    }
+    (*command)->batch = 1;
+    ok = 1;
+
+done:
+    free(ids);
+    free(folders);
+    return ok;
+}
+
+// An added, reopened or retagged task is found again by its row, which
+// only the applied batch knows: the inverse worked out beforehand has the
+// row the task would have had on its own.
+void history_place_batch(TodoHistoryCommand *command, const int *rows) {
+    for (int i = 0; i < command->forward_count; i++) {
+        int op = command->forward[i].op;
+        int start = command->forward[i].inverse_start;
+        int end = i + 1 < command->forward_count ? command->forward[i + 1].inverse_start : command->inverse_count;
+
+        if (rows[i] < 0 || end - start != 1) continue;
+        if (op == JOURNAL_ADD_TASK || op == JOURNAL_RESTORE_TASK || op == JOURNAL_REOPEN_TASK ||
+            op == JOURNAL_TAG_TASK) {
+            command->inverse[start].task_index = rows[i];
+        }
+    }
+}
+
+static void free_entries(HistoryEntry *entries, int count) {
+    for (int i = 0; i < count; i++) {
+        free(entries[i].text[0]);
+        free(entries[i].text[1]);
+    }
+    free(entries);
+}
+
+void history_free_command(TodoHistoryCommand *command) {
+    if (command == NULL) return;
+    free_entries(command->forward, command->forward_count);
+    free_entries(command->inverse, command->inverse_count);
+    free(command);
+}
+
+TodoHistory *history_create(size_t budget) {
+    TodoHistory *history = (TodoHistory *)calloc(1, sizeof(TodoHistory));
+
+    if (history != NULL) {
+        history->budget = budget;
+    }
+    return history;
+}
+
+static void release_list(TodoHistory *history, ListImage *list) {
+    if (--list->references > 0) return;
+    history->snapshot_bytes -= list->bytes;
+    free_entries(list->tasks, list->task_count);
+    free(list);
+}
+
+static void drop_snapshot(TodoHistory *history, int index) {
+    HistorySnapshot *snapshot = &history->snapshots[index];
+
+    for (int i = 0; i < snapshot->list_count; i++) {
+        release_list(history, snapshot->lists[i]);
+    }
+    history->snapshot_bytes -= (size_t)snapshot->list_capacity * sizeof(ListImage *);
+    free(snapshot->lists);
+    memmove(&history->snapshots[index], &history->snapshots[index + 1],
+            (size_t)(history->snapshot_count - index - 1) * sizeof(HistorySnapshot));
+    history->snapshot_count--;
+}
+
+// Drop the snapshots of states after step; -1 drops them all
+static void drop_snapshots_after(TodoHistory *history, int step) {
+    while (history->snapshot_count > 0 && history->snapshots[history->snapshot_count - 1].step > step) {
+        drop_snapshot(history, history->snapshot_count - 1);
+    }
+}
+
+// Drop the command at index. Dropping the oldest shifts the snapshots'
+// steps; dropping any other loses the states after it.
+static void drop_command(TodoHistory *history, int index) {
+    history->bytes -= history->commands[index]->bytes;
+    history_free_command(history->commands[index]);
+    memmove(&history->commands[index], &history->commands[index + 1],
+            (size_t)(history->count - index - 1) * sizeof(TodoHistoryCommand *));
+    history->count--;
+    if (index < history->undo_count) history->undo_count--;
+
+    if (index > 0) {
+        drop_snapshots_after(history, index);
+        return;
+    }
+    while (history->snapshot_count > 0 && history->snapshots[0].step == 0) {
+        drop_snapshot(history, 0);
+    }
+    for (int i = 0; i < history->snapshot_count; i++) {
+        history->snapshots[i].step--;
+    }
+}
+
+// Forget the oldest snapshots while they take more than half the budget,
+// then the oldest commands until the budget holds, keeping the newest
+static void enforce_budget(TodoHistory *history) {
+    while (history->snapshot_count > 0 && history->snapshot_bytes > history->budget / 2) {
+        drop_snapshot(history, 0);
+    }
+    while (history->bytes + history->snapshot_bytes > history->budget && history->count > 1) {
+        drop_command(history, 0);
+    }
+}
+
+void history_clear(TodoHistory *history) {
+    drop_snapshots_after(history, -1);
+    while (history->count > 0) {
+        drop_command(history, history->count - 1);
+    }
+}
+
+void history_destroy(TodoHistory *history) {
+    if (history == NULL) return;
+    history_clear(history);
+    free(history->commands);
+    free(history->snapshots);
+    free(history);
+}
+
+void history_set_budget(TodoHistory *history, size_t budget) {
+    history->budget = budget;
+    enforce_budget(history);
+}
+
+// A copy of the list as it is now, or NULL if it does not fit in limit bytes
+static ListImage *capture_list(TodoStore *store, uint32_t folder_id, size_t limit) {
+    ListImage *list = (ListImage *)calloc(1, sizeof(ListImage));
+    int index = store_find_folder(store, folder_id);
+    const Folder *folder;
+
+    if (list == NULL) return NULL;
+    list->folder_id = folder_id;
+    list->bytes = sizeof(ListImage);
+    if (index < 0) {
+        list->missing = 1;
+        return list;
+    }
+    store_materialize(store, index);
+    folder = &store->folders[index];
+    if (!folder->loaded || (size_t)folder->task_count * sizeof(HistoryEntry) > limit) goto fail;
+    for (int i = 0; i < folder->task_count; i++) {
+        if (!restore_entry(&list->tasks, &list->task_count, &list->task_capacity, &list->bytes, store, folder_id,
+                           store_task(store, folder, i), i) ||
+            list->bytes > limit) {
+            goto fail;
+        }
+    }
+    return list;
+
+fail:
+    free_entries(list->tasks, list->task_count);
+    free(list);
+    return NULL;
+}
+
+static int snapshot_keeps(const HistorySnapshot *snapshot, uint32_t folder_id) {
+    for (int i = 0; i < snapshot->list_count; i++) {
+        if (snapshot->lists[i]->folder_id == folder_id) return 1;
+    }
+    return 0;
+}
+
+// Give the snapshots that still share the list with the store a copy of it,
+// one copy for all of them. Those that cannot get one are dropped.
+static void keep_list(TodoHistory *history, TodoStore *store, uint32_t folder_id) {
+    ListImage *list = NULL;
+    int captured = 0;
+
+    for (int s = 0; s < history->snapshot_count; s++) {
+        HistorySnapshot *snapshot = &history->snapshots[s];
+
+        if (snapshot_keeps(snapshot, folder_id)) continue;
+        if (!captured) {
+            list = capture_list(store, folder_id, history->budget / 2);
+            captured = 1;
+            if (list != NULL) history->snapshot_bytes += list->bytes;
+        }
+        if (list != NULL && snapshot->list_count == snapshot->list_capacity) {
+            int capacity = snapshot->list_capacity ? snapshot->list_capacity * 2 : 8;
+            ListImage **grown = (ListImage **)realloc(snapshot->lists, (size_t)capacity * sizeof(ListImage *));
+
+            if (grown != NULL) {
+                history->snapshot_bytes += (size_t)(capacity - snapshot->list_capacity) * sizeof(ListImage *);
+                snapshot->lists = grown;
+                snapshot->list_capacity = capacity;
+            }
+        }
+        if (list == NULL || snapshot->list_count == snapshot->list_capacity) {
+            drop_snapshot(history, s--);
+            continue;
+        }
+        snapshot->lists[snapshot->list_count++] = list;
+        list->references++;
+    }
+    if (list != NULL && list->references == 0) {
+        list->references = 1;
+        release_list(history, list);
+    }
+    while (history->snapshot_count > 0 && history->snapshot_bytes > history->budget / 2) {
+        drop_snapshot(history, 0);
+    }
+}
+
+void history_prepare(TodoHistory *history, TodoStore *store, TodoHistoryCommand *command) {
+    if (command == NULL) {
+        drop_snapshots_after(history, -1);
+        return;
+    }
+    for (int i = 0; i < command->forward_count; i++) {
+        const HistoryEntry *entry = &command->forward[i];
+
+        // A new list's id is known from its inverse
+        keep_list(history, store, entry->op == JOURNAL_CREATE_LIST ? command->inverse[entry->inverse_start].folder_id
+                                                                   : entry->folder_id);
+    }
+    command->prepared = 1;
+}
+
+// Every HISTORY_SNAPSHOT_INTERVAL steps, start sharing the state after the
+// newest one
+static void start_snapshot(TodoHistory *history) {
+    int last = history->snapshot_count > 0 ? history->snapshots[history->snapshot_count - 1].step : 0;
+    HistorySnapshot *snapshot;
+
+    if (history->count - last < HISTORY_SNAPSHOT_INTERVAL) return;
+    if (history->snapshot_count == history->snapshot_capacity) {
+        int capacity = history->snapshot_capacity ? history->snapshot_capacity * 2 : 8;
+        HistorySnapshot *grown = (HistorySnapshot *)realloc(history->snapshots,
+                                                            (size_t)capacity * sizeof(HistorySnapshot));
+        if (grown == NULL) return;
+        history->snapshots = grown;
+        history->snapshot_capacity = capacity;
+    }
+    snapshot = &history->snapshots[history->snapshot_count++];
+    memset(snapshot, 0, sizeof(*snapshot));
+    snapshot->step = history->count;
+}
+
+void history_push(TodoHistory *history, TodoHistoryCommand *command) {
+    if (command == NULL) return;
+
+    // A change the snapshots did not see makes them wrong
+    if (!command->prepared) drop_snapshots_after(history, -1);
+    while (history->count > history->undo_count) {
+        drop_command(history, history->count - 1);
+    }
+    if (history->count == history->capacity) {
+        int capacity = history->capacity ? history->capacity * 2 : 16;
+        TodoHistoryCommand **grown = (TodoHistoryCommand **)realloc(history->commands,
+                                                                    (size_t)capacity * sizeof(TodoHistoryCommand *));
+        if (grown == NULL) {
+            history_free_command(command);
+            return;
+        }
+        history->commands = grown;
+        history->capacity = capacity;
+    }
+    history->commands[history->count++] = command;
+    history->undo_count = history->count;
+    history->bytes += command->bytes;
+    start_snapshot(history);
+    enforce_budget(history);
+}
+
+int history_can_undo(const TodoHistory *history) {
+    return history->undo_count > 0;
+}
+
+int history_can_redo(const TodoHistory *history) {
+    return history->undo_count < history->count;
+}
+
+int history_undo_count(const TodoHistory *history) {
+    return history->undo_count;
+}
+
+static void load_entry(const HistoryEntry *stored, TodoJournalEntry *entry) {
+    entry->op = stored->op;
+    entry->folder_id = stored->folder_id;
+    entry->task_index = stored->task_index;
+    entry->text[0] = stored->text[0];
+    entry->text[1] = stored->text[1];
+}
+
+static int apply_entry(const HistoryEntry *stored, TodoHistoryApply apply, void *context) {
+    TodoJournalEntry entry;
+
+    load_entry(stored, &entry);
+    return apply(context, &entry, 1);
+}
+
+// A batch's entries, in the order given, in one call
+static int apply_batch(const HistoryEntry *const *order, int count, TodoHistoryApply apply, void *context) {
+    TodoJournalEntry *entries = (TodoJournalEntry *)malloc((size_t)(count > 0 ? count : 1) * sizeof(TodoJournalEntry));
+    int ok;
+
+    if (entries == NULL) return 0;
+    for (int i = 0; i < count; i++) {
+        load_entry(order[i], &entries[i]);
+    }
+    ok = apply(context, entries, count);
+    free(entries);
+    return ok;
+}
+
+// Undo forward entry i as one change: a deleted list is recreated on its
+// own, then its tasks go back in one batch, or the list goes again
+static int apply_inverse(const TodoHistoryCommand *command, int i, TodoHistoryApply apply, void *context) {
+    int start = command->forward[i].inverse_start;
+    int end = i + 1 < command->forward_count ? command->forward[i + 1].inverse_start : command->inverse_count;
+    const HistoryEntry **order;
+    int created = 0;
+    int ok;
+
+    if (end - start <= 1) return end == start || apply_entry(&command->inverse[start], apply, context);
+    if (command->inverse[start].op == JOURNAL_CREATE_LIST) {
+        if (!apply_entry(&command->inverse[start], apply, context)) return 0;
+        created = 1;
+        start++;
+    }
+    order = (const HistoryEntry **)malloc((size_t)(end - start) * sizeof(HistoryEntry *));
+    ok = order != NULL;
+    for (int j = start; ok && j < end; j++) {
+        order[j - start] = &command->inverse[j];
+    }
+    ok = ok && apply_batch(order, end - start, apply, context);
+    free(order);
+    if (!ok && created) apply_entry(&command->forward[i], apply, context);
+    return ok;
+}
+
+// Inverses are applied newest entry first. A failure puts back what was
+// already undone and leaves the step in place so it can be retried.
+int history_undo(TodoHistory *history, TodoHistoryApply apply, void *context) {
+    const TodoHistoryCommand *command;
+
+    if (!history_can_undo(history)) return 0;
+    command = history->commands[history->undo_count - 1];
+
+    if (command->batch) {
+        const HistoryEntry **order = (const HistoryEntry **)malloc((size_t)(command->inverse_count + 1) *
+                                                                   sizeof(HistoryEntry *));
+        int count = 0;
+        int ok;
+
+        if (order == NULL) return 0;
+        for (int i = command->forward_count - 1; i >= 0; i--) {
+            int end = i + 1 < command->forward_count ? command->forward[i + 1].inverse_start : command->inverse_count;
+            for (int j = command->forward[i].inverse_start; j < end; j++) {
+                order[count++] = &command->inverse[j];
+            }
+        }
+        ok = apply_batch(order, count, apply, context);
+        free(order);
+        if (!ok) return 0;
+    } else {
+        for (int i = command->forward_count - 1; i >= 0; i--) {
+            if (apply_inverse(command, i, apply, context)) continue;
+            while (++i < command->forward_count) {
+                apply_entry(&command->forward[i], apply, context);
+            }
+            return 0;
+        }
+    }
+    history->undo_count--;
+    drop_snapshots_after(history, history->undo_count);
+    return 1;
+}
+
+int history_redo(TodoHistory *history, TodoHistoryApply apply, void *context) {
+    const TodoHistoryCommand *command;
+
+    if (!history_can_redo(history)) return 0;
+    command = history->commands[history->undo_count];
+
+    if (command->batch) {
+        const HistoryEntry **order = (const HistoryEntry **)malloc((size_t)(command->forward_count + 1) *
+                                                                   sizeof(HistoryEntry *));
+        int ok;
+
+        if (order == NULL) return 0;
+        for (int i = 0; i < command->forward_count; i++) {
+            order[i] = &command->forward[i];
+        }
+        ok = apply_batch(order, command->forward_count, apply, context);
+        free(order);
+        if (!ok) return 0;
+    } else {
+        for (int i = 0; i < command->forward_count; i++) {
+            if (apply_entry(&command->forward[i], apply, context)) continue;
+            while (--i >= 0) {
+                apply_inverse(command, i, apply, context);
+            }
+            return 0;
+        }
+    }
+    history->undo_count++;
+    return 1;
+}
+
+// Whether putting the snapshot's lists back costs less than replaying the
+// steps since it. It cannot be used once a list it kept is gone, or if it
+// kept one that did not exist yet.
+static int snapshot_pays(const TodoHistory *history, const TodoStore *store, const HistorySnapshot *snapshot) {
+    size_t restore = 0, replay = 0;
+
+    for (int i = 0; i < snapshot->list_count; i++) {
+        const ListImage *list = snapshot->lists[i];
+        int index = store_find_folder(store, list->folder_id);
+
+        if (list->missing || index < 0) return 0;
+        restore += (size_t)list->task_count + (size_t)store->folders[index].task_count;
+    }
+    for (int c = snapshot->step; c < history->undo_count; c++) {
+        replay += (size_t)history->commands[c]->inverse_count;
+    }
+    return restore < replay;
+}
+
+// One batch deleting the tasks of every list the snapshot kept and putting
+// its copies back
+static int restore_snapshot(TodoStore *store, const HistorySnapshot *snapshot, TodoHistoryApply apply,
+                            void *context) {
+    TodoJournalEntry *entries = NULL;
+    char (*deadlines)[DATE_TEXT_LENGTH] = NULL;
+    size_t capacity = 1;
+    int count = 0;
+    int ok = 0;
+
+    for (int i = 0; i < snapshot->list_count; i++) {
+        int index = store_find_folder(store, snapshot->lists[i]->folder_id);
+
+        store_materialize(store, index);
+        if (!store->folders[index].loaded) return 0;
+        capacity += (size_t)store->folders[index].task_count + (size_t)snapshot->lists[i]->task_count;
+    }
+    entries = (TodoJournalEntry *)malloc(capacity * sizeof(TodoJournalEntry));
+    deadlines = (char (*)[DATE_TEXT_LENGTH])malloc(capacity * DATE_TEXT_LENGTH);
+    if (entries == NULL || deadlines == NULL || capacity > INT_MAX) goto done;
+
+    for (int i = 0; i < snapshot->list_count; i++) {
+        const ListImage *list = snapshot->lists[i];
+        const Folder *folder = &store->folders[store_find_folder(store, list->folder_id)];
+
+        for (int row = 0; row < folder->task_count; row++) {
+            const Task *task = store_task(store, folder, row);
+
+            date_format(task->deadline_day, deadlines[count]);
+            entries[count].op = JOURNAL_DELETE_TASK;
+            entries[count].folder_id = list->folder_id;
+            entries[count].task_index = row;
+            entries[count].text[0] = store_text(store, task->description);
+            entries[count].text[1] = deadlines[count];
+            count++;
+        }
+        for (int t = 0; t < list->task_count; t++) {
+            load_entry(&list->tasks[t], &entries[count++]);
+        }
+    }
+    ok = apply(context, entries, count);
+
+done:
+    free(entries);
+    free(deadlines);
+    return ok;
+}
+
+int history_undo_many(TodoHistory *history, TodoStore *store, int steps, TodoHistoryApply apply, void *context) {
+    int target = history->undo_count - (steps < history->undo_count ? steps : history->undo_count);
+
+    while (history->undo_count > target) {
+        int s;
+
+        // The oldest snapshot in range skips the most steps
+        for (s = 0; s < history->snapshot_count; s++) {
+            const HistorySnapshot *snapshot = &history->snapshots[s];
+
+            if (snapshot->step >= target && snapshot->step < history->undo_count &&
+                snapshot_pays(history, store, snapshot)) {
+                break;
+            }
+        }
+        if (s == history->snapshot_count) {
+            if (!history_undo(history, apply, context)) return 0;
+            continue;
+        }
+        if (!restore_snapshot(store, &history->snapshots[s], apply, context)) return 0;
+        history->undo_count = history->snapshots[s].step;
+        drop_snapshots_after(history, history->undo_count);
+    }
+    return 1;
+}
+
+size_t history_memory(const TodoHistory *history) {
+    return history->bytes + history->snapshot_bytes;
+}
@@ -0,0 +1,77 @@
+#ifndef TODO_HISTORY_H
+#define TODO_HISTORY_H
+
+#include <stddef.h>
+#include "todo_core.h"
+#include "todo_journal.h"
+
+// Undo/redo history.
+//
+// A command is a list of journal entries together with their inverses,
+// which are worked out from the store just before each entry is applied:
+// adding a task is undone by deleting it, completing by reopening, and
+// deleting a list by recreating it in place with its tasks. Undo and redo
+// replay those entries through the caller's apply function, normally the
+// journal, so they are as durable as any other change and cost the size
+// of the change. Inverses capture only what the change destroys, never a
+// copy of the store. Once the commands take more than the memory budget,
+// the oldest are forgotten.
+//
+// Every HISTORY_SNAPSHOT_INTERVAL steps the history starts a snapshot. It
+// shares every list with the store until a change is about to touch one,
+// and only then keeps a copy of that list as it was. Undoing many steps at
+// once puts the lists a snapshot kept back in one batch instead of
+// replaying every step since. Snapshots may use half the memory budget;
+// the oldest go first.
+
+#define HISTORY_DEFAULT_BUDGET (1024 * 1024)
+#define HISTORY_SNAPSHOT_INTERVAL 64
+
+typedef struct TodoHistory TodoHistory;
+typedef struct TodoHistoryCommand TodoHistoryCommand;
+
+// Apply entries to the store; returns 0 on failure. count is 1 except for
+// a batch (see history_add_batch()), whose entries must apply as one.
+typedef int (*TodoHistoryApply)(void *context, const TodoJournalEntry *entries, int count);
+
+TodoHistory *history_create(size_t budget);
+void history_destroy(TodoHistory *history);
+void history_clear(TodoHistory *history);
+void history_set_budget(TodoHistory *history, size_t budget);
+
+// Append entry to *command (created on first use), computing its inverse
+// against the store as it is now. Call before applying the entry; the
+// folder it touches is materialized.
+int history_add(TodoHistoryCommand **command, TodoStore *store, const TodoJournalEntry *entry);
+// Start *command as a batch of task operations to be applied together
+// (journal_apply_batch()); inverses are computed against the store before
+// any of them applies, and undo and redo also apply them as one batch.
+int history_add_batch(TodoHistoryCommand **command, TodoStore *store, const TodoJournalEntry *entries, int count);
+// Once the batch has applied, rows[i] is the row the task of its i-th
+// entry ended up in, or -1 if it has none
+void history_place_batch(TodoHistoryCommand *command, const int *rows);
+void history_free_command(TodoHistoryCommand *command);
+
+// Call after building a command and before applying it, so the snapshots
+// keep the lists it changes. command may be NULL for a change the history
+// does not record, which drops the snapshots.
+void history_prepare(TodoHistory *history, TodoStore *store, TodoHistoryCommand *command);
+// Make an applied command the newest undo step; the redo steps are dropped.
+// The history takes ownership of the command.
+void history_push(TodoHistory *history, TodoHistoryCommand *command);
+
+int history_can_undo(const TodoHistory *history);
+int history_can_redo(const TodoHistory *history);
+int history_undo(TodoHistory *history, TodoHistoryApply apply, void *context);
+int history_redo(TodoHistory *history, TodoHistoryApply apply, void *context);
+// Steps that can be undone
+int history_undo_count(const TodoHistory *history);
+// Undo the newest steps steps, from a snapshot where that is cheaper than
+// replaying them; steps that create or delete a list are replayed. Stops
+// at the first step that fails.
+int history_undo_many(TodoHistory *history, TodoStore *store, int steps, TodoHistoryApply apply, void *context);
+
+// Bytes held by the recorded commands and the snapshots
+size_t history_memory(const TodoHistory *history);
+
+#endif
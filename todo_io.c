@@ -0,0 +1,1089 @@
+#include "todo_io.h"
+#include "todo_tags.h"
+#include "todo_thread.h"
+
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+
+// What a CSV column or JSON key holds
+enum {
+    FIELD_NONE = -1,
+    FIELD_LIST,
+    FIELD_DESCRIPTION,
+    FIELD_DEADLINE,
+    FIELD_COMPLETED,
+    FIELD_REPEAT,
+    FIELD_PRIORITY,
+    FIELD_TAGS,
+    FIELD_COUNT
+};
+
+enum {
+    JOB_FREE,
+    JOB_QUEUED,
+    JOB_DONE
+};
+
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+} Span;
+
+// A parsed record; fields point into the job's text after unescaping
+typedef struct {
+    Span fields[FIELD_COUNT];
+    uint64_t line;
+    int32_t deadline_day;
+    TodoRecurrence repeat;
+    uint8_t completed;
+    uint8_t priority;
+    uint8_t error;
+} ImportRow;
+
+// One chunk of the file on its way through parsing
+typedef struct {
+    char *text;             // IO_CHUNK_SIZE + 1 bytes
+    size_t start;           // Where records begin (after a BOM or header)
+    size_t size;
+    uint64_t first_line;
+    int error;              // Set for a chunk that stands for one bad record
+    ImportRow *rows;
+    size_t row_count;
+    size_t row_capacity;
+    char *dates;            // Ten-byte deadline fields for date_parse_column
+    int32_t *days;
+    uint8_t *valid;
+    size_t date_capacity;
+    int failed;             // Ran out of memory while parsing
+    int state;              // Shared with the workers, under the lock
+    int busy;               // Handed out and not yet applied; reader only
+} ImportJob;
+
+typedef struct {
+    TodoStore *store;
+    const TodoImportOptions *options;
+    TodoImportReport *report;
+    signed char columns[IO_MAX_COLUMNS];    // CSV column roles
+    int column_count;
+    ImportJob *jobs;
+    int job_count;
+    TodoMutex lock;
+    TodoCond work;
+    TodoCond done;
+    TodoThread threads[IO_MAX_THREADS];
+    int thread_count;
+    uint64_t queued;        // Jobs handed to the workers so far
+    uint64_t taken;         // Jobs a worker has started on
+    int stopping;
+    int status;
+} Importer;
+
+// Apply-time scratch: one entry per row of a chunk
+typedef struct {
+    int folder;
+    int row;
+} Placement;
+
+int io_format_from_path(const char *path) {
+    const char *dot = strrchr(path, '.');
+
+    if (dot == NULL) return 0;
+    if (strcmp(dot, ".csv") == 0 || strcmp(dot, ".CSV") == 0) return IO_CSV;
+    if (strcmp(dot, ".jsonl") == 0 || strcmp(dot, ".ndjson") == 0 || strcmp(dot, ".json") == 0) return IO_JSONL;
+    return 0;
+}
+
+const char *io_row_error_text(int error) {
+    switch (error) {
+        case IO_ROW_MALFORMED: return "malformed record";
+        case IO_ROW_TOO_LONG: return "record too long";
+        case IO_ROW_ENCODING: return "text is not valid UTF-8";
+        case IO_ROW_NO_DESCRIPTION: return "missing description";
+        case IO_ROW_NO_LIST: return "missing list name";
+        case IO_ROW_DEADLINE: return "invalid deadline, expected YYYY-MM-DD";
+        case IO_ROW_COMPLETED: return "invalid completed value";
+        case IO_ROW_FULL: return "no room for the task or its list";
+        case IO_ROW_NO_MEMORY: return "out of memory";
+        case IO_ROW_REPEAT: return "invalid repeat rule, or no deadline to repeat from";
+        case IO_ROW_PRIORITY: return "invalid priority";
+        case IO_ROW_TAGS: return "invalid tags";
+    }
+    return "unknown error";
+}
+
+static size_t count_lines(const char *text, size_t from, size_t to) {
+    size_t lines = 0;
+    const char *end = text + to;
+
+    for (const char *p = text + from; (p = memchr(p, '\n', (size_t)(end - p))) != NULL; p++) {
+        lines++;
+    }
+    return lines;
+}
+
+// End of the last complete record in [from, size): just past its newline,
+// or from if there is none. CSV newlines inside quotes do not count.
+static size_t last_record_end(int format, const char *text, size_t from, size_t size) {
+    size_t cut = from;
+
+    if (format == IO_JSONL) {
+        for (size_t i = size; i > from; i--) {
+            if (text[i - 1] == '\n') return i;
+        }
+        return from;
+    }
+
+    for (size_t i = from, quoted = 0; i < size; i++) {
+        if (text[i] == '"') {
+            quoted ^= 1;
+        } else if (text[i] == '\n' && !quoted) {
+            cut = i + 1;
+        }
+    }
+    return cut;
+}
+
+// CSV (RFC 4180)
+
+// Parse one record starting at *pos, unescaping quoted fields in place.
+// Fields past max are parsed and dropped. Returns the field count, or -1
+// for a malformed record; either way *pos ends up past the record.
+static int csv_record(char *text, size_t size, size_t *pos, uint64_t *line, Span *fields, int max) {
+    size_t p = *pos;
+    int count = 0;
+
+    for (;;) {
+        size_t begin = p;
+        size_t end;
+
+        if (p < size && text[p] == '"') {
+            size_t w = ++p;
+            begin = p;
+            for (;;) {
+                if (p >= size) {
+                    *pos = p;
+                    return -1;  // Unterminated
+                }
+                if (text[p] == '"') {
+                    if (p + 1 < size && text[p + 1] == '"') {
+                        text[w++] = '"';
+                        p += 2;
+                        continue;
+                    }
+                    p++;
+                    break;
+                }
+                if (text[p] == '\n') (*line)++;
+                text[w++] = text[p++];
+            }
+            end = w;
+        } else {
+            while (p < size && text[p] != ',' && text[p] != '\n' && text[p] != '\r') p++;
+            end = p;
+        }
+        if (count < max) {
+            fields[count].offset = (uint32_t)begin;
+            fields[count].length = (uint32_t)(end - begin);
+        }
+        count++;
+
+        if (p < size && text[p] == ',') {
+            p++;
+            continue;
+        }
+        if (p < size && text[p] == '\r') p++;
+        if (p >= size || text[p] == '\n') {
+            if (p < size) {
+                p++;
+                (*line)++;
+            }
+            *pos = p;
+            return count;
+        }
+
+        // Text after a closing quote: skip the rest of the line
+        while (p < size && text[p] != '\n') p++;
+        if (p < size) {
+            p++;
+            (*line)++;
+        }
+        *pos = p;
+        return -1;
+    }
+}
+
+static int name_is(const char *text, size_t length, const char *name) {
+    size_t n = strlen(name);
+
+    if (length != n) return 0;
+    for (size_t i = 0; i < n; i++) {
+        if (tolower((unsigned char)text[i]) != name[i]) return 0;
+    }
+    return 1;
+}
+
+static int field_role(const char *text, size_t length) {
+    while (length > 0 && (*text == ' ' || *text == '\t')) {
+        text++;
+        length--;
+    }
+    while (length > 0 && (text[length - 1] == ' ' || text[length - 1] == '\t')) length--;
+
+    if (name_is(text, length, "list") || name_is(text, length, "folder")) return FIELD_LIST;
+    if (name_is(text, length, "description") || name_is(text, length, "task")) return FIELD_DESCRIPTION;
+    if (name_is(text, length, "deadline") || name_is(text, length, "due")) return FIELD_DEADLINE;
+    if (name_is(text, length, "completed") || name_is(text, length, "done")) return FIELD_COMPLETED;
+    if (name_is(text, length, "repeat") || name_is(text, length, "recurrence")) return FIELD_REPEAT;
+    if (name_is(text, length, "priority")) return FIELD_PRIORITY;
+    if (name_is(text, length, "tags")) return FIELD_TAGS;
+    return FIELD_NONE;
+}
+
+static int read_header(Importer *importer, ImportJob *job, uint64_t *line) {
+    Span fields[IO_MAX_COLUMNS];
+    int count = csv_record(job->text, job->size, &job->start, line, fields, IO_MAX_COLUMNS);
+    int described = 0;
+
+    if (count <= 0) return 0;
+    if (count > IO_MAX_COLUMNS) count = IO_MAX_COLUMNS;
+    for (int i = 0; i < count; i++) {
+        importer->columns[i] = (signed char)field_role(job->text + fields[i].offset, fields[i].length);
+        if (importer->columns[i] == FIELD_DESCRIPTION) described = 1;
+    }
+    importer->column_count = count;
+    return described;
+}
+
+// JSON Lines
+
+static void skip_space(const char *text, size_t *p, size_t end) {
+    while (*p < end && (text[*p] == ' ' || text[*p] == '\t' || text[*p] == '\r')) (*p)++;
+}
+
+static int hex4(const char *text, size_t p, size_t end, uint32_t *value) {
+    *value = 0;
+    if (end - p < 4) return 0;
+    for (int i = 0; i < 4; i++) {
+        char c = text[p + i];
+        int digit = c >= '0' && c <= '9' ? c - '0' :
+                    c >= 'a' && c <= 'f' ? c - 'a' + 10 :
+                    c >= 'A' && c <= 'F' ? c - 'A' + 10 : -1;
+        if (digit < 0) return 0;
+        *value = *value * 16 + (uint32_t)digit;
+    }
+    return 1;
+}
+
+static size_t put_utf8(char *out, uint32_t code) {
+    if (code < 0x80) {
+        out[0] = (char)code;
+        return 1;
+    }
+    if (code < 0x800) {
+        out[0] = (char)(0xC0 | (code >> 6));
+        out[1] = (char)(0x80 | (code & 0x3F));
+        return 2;
+    }
+    if (code < 0x10000) {
+        out[0] = (char)(0xE0 | (code >> 12));
+        out[1] = (char)(0x80 | ((code >> 6) & 0x3F));
+        out[2] = (char)(0x80 | (code & 0x3F));
+        return 3;
+    }
+    out[0] = (char)(0xF0 | (code >> 18));
+    out[1] = (char)(0x80 | ((code >> 12) & 0x3F));
+    out[2] = (char)(0x80 | ((code >> 6) & 0x3F));
+    out[3] = (char)(0x80 | (code & 0x3F));
+    return 4;
+}
+
+// Decode the string at *p in place; an escape never decodes to more bytes
+// than it takes. Lone surrogates become U+FFFD.
+static int json_string(char *text, size_t *p, size_t end, Span *out) {
+    size_t r = *p + 1;
+    size_t w = r;
+
+    if (*p >= end || text[*p] != '"') return 0;
+    out->offset = (uint32_t)w;
+    for (;;) {
+        unsigned char c;
+
+        if (r >= end) return 0;
+        c = (unsigned char)text[r];
+        if (c == '"') break;
+        if (c < 0x20) return 0;
+        if (c != '\\') {
+            text[w++] = text[r++];
+            continue;
+        }
+        if (r + 1 >= end) return 0;
+        switch (text[r + 1]) {
+            case '"': text[w++] = '"'; r += 2; break;
+            case '\\': text[w++] = '\\'; r += 2; break;
+            case '/': text[w++] = '/'; r += 2; break;
+            case 'b': text[w++] = '\b'; r += 2; break;
+            case 'f': text[w++] = '\f'; r += 2; break;
+            case 'n': text[w++] = '\n'; r += 2; break;
+            case 'r': text[w++] = '\r'; r += 2; break;
+            case 't': text[w++] = '\t'; r += 2; break;
+            case 'u': {
+                uint32_t code, low;
+
+                if (!hex4(text, r + 2, end, &code)) return 0;
+                r += 6;
+                if (code >= 0xD800 && code <= 0xDBFF && r + 1 < end && text[r] == '\\' && text[r + 1] == 'u' &&
+                    hex4(text, r + 2, end, &low) && low >= 0xDC00 && low <= 0xDFFF) {
+                    code = 0x10000 + ((code - 0xD800) << 10) + (low - 0xDC00);
+                    r += 6;
+                } else if (code >= 0xD800 && code <= 0xDFFF) {
+                    code = 0xFFFD;
+                }
+                w += put_utf8(text + w, code);
+                break;
+            }
+            default:
+                return 0;
+        }
+    }
+    out->length = (uint32_t)(w - out->offset);
+    *p = r + 1;
+    return 1;
+}
+
+// A bare number or literal; null reads as empty
+static int json_token(const char *text, size_t *p, size_t end, Span *out) {
+    size_t begin = *p;
+
+    while (*p < end && (isalnum((unsigned char)text[*p]) || text[*p] == '-' || text[*p] == '+' || text[*p] == '.')) {
+        (*p)++;
+    }
+    if (*p == begin) return 0;
+    out->offset = (uint32_t)begin;
+    out->length = (uint32_t)(*p - begin);
+    if (out->length == 4 && memcmp(text + begin, "null", 4) == 0) out->length = 0;
+    return 1;
+}
+
+// Skip any value, nested ones included
+static int json_skip(char *text, size_t *p, size_t end) {
+    Span ignored;
+    int depth = 0;
+
+    do {
+        skip_space(text, p, end);
+        if (*p >= end) return 0;
+        if (text[*p] == '"') {
+            if (!json_string(text, p, end, &ignored)) return 0;
+        } else if (text[*p] == '{' || text[*p] == '[') {
+            depth++;
+            (*p)++;
+        } else if (text[*p] == '}' || text[*p] == ']') {
+            if (depth == 0) return 0;
+            depth--;
+            (*p)++;
+        } else if (text[*p] == ',' || text[*p] == ':') {
+            if (depth == 0) return 0;
+            (*p)++;
+        } else if (!json_token(text, p, end, &ignored)) {
+            return 0;
+        }
+    } while (depth > 0);
+    return 1;
+}
+
+static int json_record(char *text, size_t begin, size_t end, ImportRow *row) {
+    size_t p = begin;
+
+    skip_space(text, &p, end);
+    if (p >= end || text[p] != '{') return 0;
+    p++;
+    skip_space(text, &p, end);
+    if (p < end && text[p] == '}') {
+        p++;
+    } else {
+        for (;;) {
+            Span key;
+            int role;
+
+            skip_space(text, &p, end);
+            if (!json_string(text, &p, end, &key)) return 0;
+            skip_space(text, &p, end);
+            if (p >= end || text[p] != ':') return 0;
+            p++;
+            skip_space(text, &p, end);
+
+            role = field_role(text + key.offset, key.length);
+            if (role == FIELD_NONE) {
+                if (!json_skip(text, &p, end)) return 0;
+            } else if (p < end && text[p] == '"') {
+                if (!json_string(text, &p, end, &row->fields[role])) return 0;
+            } else if (!json_token(text, &p, end, &row->fields[role])) {
+                return 0;
+            }
+
+            skip_space(text, &p, end);
+            if (p < end && text[p] == ',') {
+                p++;
+                continue;
+            }
+            if (p < end && text[p] == '}') {
+                p++;
+                break;
+            }
+            return 0;
+        }
+    }
+    skip_space(text, &p, end);
+    return p == end;
+}
+
+// Parsing and validation, on a worker or the caller's thread
+
+static ImportRow *new_row(ImportJob *job, uint64_t line) {
+    ImportRow *row;
+
+    if (job->row_count == job->row_capacity) {
+        size_t capacity = job->row_capacity ? job->row_capacity * 2 : 1024;
+        ImportRow *rows = (ImportRow *)realloc(job->rows, capacity * sizeof(ImportRow));
+        if (rows == NULL) {
+            job->failed = 1;
+            return NULL;
+        }
+        job->rows = rows;
+        job->row_capacity = capacity;
+    }
+    row = &job->rows[job->row_count++];
+    memset(row, 0, sizeof(*row));
+    row->line = line;
+    return row;
+}
+
+static int parse_completed(const char *text, size_t length, uint8_t *completed) {
+    static const char *yes[] = { "1", "true", "yes", "y", "x", "done" };
+    static const char *no[] = { "0", "false", "no", "n" };
+
+    *completed = 0;
+    if (length == 0) return 1;
+    for (size_t i = 0; i < sizeof(yes) / sizeof(yes[0]); i++) {
+        if (name_is(text, length, yes[i])) {
+            *completed = 1;
+            return 1;
+        }
+    }
+    for (size_t i = 0; i < sizeof(no) / sizeof(no[0]); i++) {
+        if (name_is(text, length, no[i])) return 1;
+    }
+    return 0;
+}
+
+// Priority names, in PRIORITY_* order; empty means none
+static const char *priority_names[] = { "none", "low", "medium", "high" };
+
+static int parse_priority(const char *text, size_t length, uint8_t *priority) {
+    *priority = PRIORITY_NONE;
+    if (length == 0) return 1;
+    if (length == 1 && text[0] >= '0' + PRIORITY_NONE && text[0] <= '0' + PRIORITY_HIGH) {
+        *priority = (uint8_t)(text[0] - '0');
+        return 1;
+    }
+    for (int i = PRIORITY_NONE; i <= PRIORITY_HIGH; i++) {
+        if (name_is(text, length, priority_names[i])) {
+            *priority = (uint8_t)i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Field checks, then every well-formed deadline of the chunk in one batch
+static void validate_rows(const Importer *importer, ImportJob *job) {
+    size_t dated = 0;
+
+    if (job->date_capacity < job->row_count) {
+        char *dates = (char *)realloc(job->dates, job->row_count * 10);
+        int32_t *days = (int32_t *)realloc(job->days, job->row_count * sizeof(int32_t));
+        uint8_t *valid = (uint8_t *)realloc(job->valid, job->row_count);
+
+        if (dates) job->dates = dates;
+        if (days) job->days = days;
+        if (valid) job->valid = valid;
+        if (!dates || !days || !valid) {
+            job->failed = 1;
+            return;
+        }
+        job->date_capacity = job->row_count;
+    }
+
+    for (size_t i = 0; i < job->row_count; i++) {
+        ImportRow *row = &job->rows[i];
+        const Span *list = &row->fields[FIELD_LIST];
+        const Span *description = &row->fields[FIELD_DESCRIPTION];
+        const Span *deadline = &row->fields[FIELD_DEADLINE];
+        const Span *completed = &row->fields[FIELD_COMPLETED];
+        const Span *priority = &row->fields[FIELD_PRIORITY];
+
+        if (row->error) continue;
+        if (description->length == 0) {
+            row->error = IO_ROW_NO_DESCRIPTION;
+        } else if (list->length == 0 && importer->options->default_list == NULL) {
+            row->error = IO_ROW_NO_LIST;
+        } else if (!utf8_valid(job->text + description->offset, description->length) ||
+                   !utf8_valid(job->text + list->offset, list->length)) {
+            row->error = IO_ROW_ENCODING;
+        } else if (!parse_completed(job->text + completed->offset, completed->length, &row->completed)) {
+            row->error = IO_ROW_COMPLETED;
+        } else if (!parse_priority(job->text + priority->offset, priority->length, &row->priority)) {
+            row->error = IO_ROW_PRIORITY;
+        } else if (deadline->length == 0) {
+            row->deadline_day = DATE_NONE;
+        } else if (deadline->length == 10) {
+            memcpy(job->dates + dated * 10, job->text + deadline->offset, 10);
+            dated++;
+        } else {
+            row->error = IO_ROW_DEADLINE;
+        }
+    }
+
+    date_parse_column(job->dates, 10, dated, job->days, job->valid);
+    dated = 0;
+    for (size_t i = 0; i < job->row_count; i++) {
+        ImportRow *row = &job->rows[i];
+
+        if (row->error || row->fields[FIELD_DEADLINE].length != 10) continue;
+        if (job->valid[dated]) {
+            row->deadline_day = job->days[dated];
+        } else {
+            row->error = IO_ROW_DEADLINE;
+        }
+        dated++;
+    }
+
+    // Rules are checked against the deadline, which is their first occurrence
+    for (size_t i = 0; i < job->row_count; i++) {
+        ImportRow *row = &job->rows[i];
+        const Span *repeat = &row->fields[FIELD_REPEAT];
+        char rule[RECUR_TEXT_LENGTH];
+
+        memset(&row->repeat, 0, sizeof(row->repeat));
+        if (row->error || repeat->length == 0) continue;
+        if (repeat->length >= sizeof(rule)) {
+            row->error = IO_ROW_REPEAT;
+            continue;
+        }
+        memcpy(rule, job->text + repeat->offset, repeat->length);
+        rule[repeat->length] = '\0';
+        if (!recur_parse(rule, row->deadline_day, &row->repeat)) row->error = IO_ROW_REPEAT;
+    }
+
+    // The canonical form is never longer than what was typed, so it replaces
+    // the field in place
+    for (size_t i = 0; i < job->row_count; i++) {
+        ImportRow *row = &job->rows[i];
+        Span *tags = &row->fields[FIELD_TAGS];
+        char typed[4 * TAGS_TEXT_LENGTH];
+        char canonical[TAGS_TEXT_LENGTH];
+
+        if (row->error || tags->length == 0) continue;
+        if (tags->length >= sizeof(typed)) {
+            row->error = IO_ROW_TAGS;
+            continue;
+        }
+        memcpy(typed, job->text + tags->offset, tags->length);
+        typed[tags->length] = '\0';
+        if (!tags_normalize(typed, canonical)) {
+            row->error = IO_ROW_TAGS;
+            continue;
+        }
+        tags->length = (uint32_t)strlen(canonical);
+        memcpy(job->text + tags->offset, canonical, tags->length);
+    }
+}
+
+static void parse_job(const Importer *importer, ImportJob *job) {
+    uint64_t line = job->first_line;
+    size_t p = job->start;
+
+    job->row_count = 0;
+    job->failed = 0;
+    if (job->error) {
+        ImportRow *row = new_row(job, line);
+        if (row) row->error = (uint8_t)job->error;
+        return;
+    }
+
+    while (p < job->size) {
+        ImportRow *row;
+        uint64_t row_line = line;
+
+        // Blank lines are not records
+        if (job->text[p] == '\n' || (job->text[p] == '\r' && p + 1 < job->size && job->text[p + 1] == '\n')) {
+            p += job->text[p] == '\r' ? 2 : 1;
+            line++;
+            continue;
+        }
+        if ((row = new_row(job, row_line)) == NULL) return;
+
+        if (importer->options->format == IO_JSONL) {
+            const char *newline = memchr(job->text + p, '\n', job->size - p);
+            size_t end = newline ? (size_t)(newline - job->text) : job->size;
+
+            if (!json_record(job->text, p, end, row)) row->error = IO_ROW_MALFORMED;
+            p = newline ? end + 1 : end;
+            line++;
+        } else {
+            Span fields[IO_MAX_COLUMNS];
+            int count = csv_record(job->text, job->size, &p, &line, fields, importer->column_count);
+
+            if (count < 0) {
+                row->error = IO_ROW_MALFORMED;
+            } else {
+                if (count > importer->column_count) count = importer->column_count;
+                for (int i = 0; i < count; i++) {
+                    int role = importer->columns[i];
+                    if (role != FIELD_NONE) row->fields[role] = fields[i];
+                }
+            }
+        }
+    }
+    validate_rows(importer, job);
+}
+
+static void worker_loop(void *arg) {
+    Importer *importer = (Importer *)arg;
+
+    todo_mutex_lock(&importer->lock);
+    for (;;) {
+        ImportJob *job;
+
+        while (!importer->stopping && importer->taken == importer->queued) {
+            todo_cond_wait(&importer->work, &importer->lock, TODO_WAIT_FOREVER);
+        }
+        if (importer->taken == importer->queued) break;
+        job = &importer->jobs[importer->taken++ % (uint64_t)importer->job_count];
+        todo_mutex_unlock(&importer->lock);
+
+        parse_job(importer, job);
+
+        todo_mutex_lock(&importer->lock);
+        job->state = JOB_DONE;
+        todo_cond_broadcast(&importer->done);
+    }
+    todo_mutex_unlock(&importer->lock);
+}
+
+// Applying parsed chunks, on the caller's thread
+
+static int compare_placements(const void *a, const void *b) {
+    const Placement *x = (const Placement *)a;
+    const Placement *y = (const Placement *)b;
+
+    if (x->folder != y->folder) return (x->folder > y->folder) - (x->folder < y->folder);
+    return (x->row > y->row) - (x->row < y->row);
+}
+
+static int find_list(TodoStore *store, const char *name, size_t length) {
+    for (int i = 0; i < store->folder_count; i++) {
+        const Folder *folder = &store->folders[i];
+        if (folder->name.length == length && memcmp(store_text(store, folder->name), name, length) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+// Index of the named list, created if needed, or -1 when out of memory
+static int resolve_list(Importer *importer, const char *name, size_t length) {
+    TodoStore *store = importer->store;
+    int index = find_list(store, name, length);
+    char *copy;
+
+    if (index >= 0) {
+        store_materialize(store, index);
+        return store->folders[index].loaded ? index : -1;
+    }
+    copy = (char *)malloc(length + 1);
+    if (copy == NULL) return -1;
+    memcpy(copy, name, length);
+    copy[length] = '\0';
+    index = store_create_folder(store, 0, copy);
+    free(copy);
+    if (index >= 0) importer->report->lists_created++;
+    return index;
+}
+
+static void apply_job(Importer *importer, ImportJob *job) {
+    TodoStore *store = importer->store;
+    TodoImportReport *report = importer->report;
+    Placement *placements = NULL;
+    TodoTaskInput *inputs = NULL;
+    size_t placed = 0;
+    const char *last_name = NULL;
+    size_t last_length = 0;
+    int last_folder = -1;
+
+    if (job->failed) importer->status = IO_ERR_MEMORY;
+
+    if (store != NULL && job->row_count > 0) {
+        placements = (Placement *)malloc(job->row_count * sizeof(Placement));
+        inputs = (TodoTaskInput *)malloc(job->row_count * sizeof(TodoTaskInput));
+        if (placements == NULL || inputs == NULL) importer->status = IO_ERR_MEMORY;
+    }
+
+    // Group the chunk's rows by list, keeping file order within each
+    for (size_t i = 0; placements && inputs && i < job->row_count; i++) {
+        ImportRow *row = &job->rows[i];
+        const Span *list = &row->fields[FIELD_LIST];
+        const char *name = job->text + list->offset;
+        size_t length = list->length;
+        int folder;
+
+        if (row->error) continue;
+        if (length == 0) {
+            name = importer->options->default_list;
+            length = strlen(name);
+        }
+        // Consecutive rows usually share a list
+        if (last_name != NULL && length == last_length && memcmp(name, last_name, length) == 0) {
+            folder = last_folder;
+        } else {
+            folder = resolve_list(importer, name, length);
+            last_name = name;
+            last_length = length;
+            last_folder = folder;
+        }
+        if (folder < 0) {
+            row->error = IO_ROW_FULL;
+            continue;
+        }
+        placements[placed].folder = folder;
+        placements[placed].row = (int)i;
+        placed++;
+    }
+    if (placements && inputs) {
+        qsort(placements, placed, sizeof(Placement), compare_placements);
+    }
+
+    for (size_t first = 0; first < placed; ) {
+        size_t last = first;
+        int added;
+
+        while (last < placed && placements[last].folder == placements[first].folder) {
+            const ImportRow *row = &job->rows[placements[last].row];
+            TodoTaskInput *input = &inputs[last - first];
+
+            memset(input, 0, sizeof(*input));
+            input->description = job->text + row->fields[FIELD_DESCRIPTION].offset;
+            input->length = row->fields[FIELD_DESCRIPTION].length;
+            input->deadline_day = row->deadline_day;
+            input->completed = row->completed;
+            input->priority = row->priority;
+            input->tags = job->text + row->fields[FIELD_TAGS].offset;
+            input->tags_length = row->fields[FIELD_TAGS].length;
+            input->repeat = row->repeat;
+            last++;
+        }
+        added = store_add_tasks(store, placements[first].folder, inputs, (int)(last - first));
+        for (size_t i = first + (size_t)added; i < last; i++) {
+            job->rows[placements[i].row].error = IO_ROW_FULL;
+        }
+        first = last;
+    }
+    free(placements);
+    free(inputs);
+
+    // Report in file order
+    for (size_t i = 0; i < job->row_count; i++) {
+        const ImportRow *row = &job->rows[i];
+
+        report->rows++;
+        if (row->error) {
+            report->rejected++;
+            if (importer->options->on_error) {
+                importer->options->on_error(importer->options->context, row->line, row->error);
+            }
+        } else {
+            report->imported++;
+        }
+    }
+}
+
+static void wait_for_job(Importer *importer, ImportJob *job) {
+    if (importer->thread_count == 0) return;
+    todo_mutex_lock(&importer->lock);
+    while (job->state != JOB_DONE) {
+        todo_cond_wait(&importer->done, &importer->lock, TODO_WAIT_FOREVER);
+    }
+    todo_mutex_unlock(&importer->lock);
+}
+
+static void dispatch_job(Importer *importer, ImportJob *job) {
+    job->busy = 1;
+    if (importer->thread_count == 0) {
+        parse_job(importer, job);
+        job->state = JOB_DONE;
+        return;
+    }
+    todo_mutex_lock(&importer->lock);
+    job->state = JOB_QUEUED;
+    importer->queued++;
+    todo_cond_signal(&importer->work);
+    todo_mutex_unlock(&importer->lock);
+}
+
+static void free_jobs(Importer *importer) {
+    for (int i = 0; importer->jobs && i < importer->job_count; i++) {
+        ImportJob *job = &importer->jobs[i];
+        free(job->text);
+        free(job->rows);
+        free(job->dates);
+        free(job->days);
+        free(job->valid);
+    }
+    free(importer->jobs);
+}
+
+// Read from the file until the buffer is full or the file ends
+static size_t fill(FILE *in, char *buffer, size_t size, int *eof) {
+    size_t got = size ? fread(buffer, 1, size, in) : 0;
+
+    if (got < size) *eof = 1;
+    return got;
+}
+
+static void read_chunks(Importer *importer, FILE *in) {
+    char *carry = (char *)malloc(IO_CHUNK_SIZE);
+    size_t carry_size = 0;
+    uint64_t line = 1;
+    int eof = 0;
+    int first = 1;
+    uint64_t sequence = 0;
+
+    if (carry == NULL) {
+        importer->status = IO_ERR_MEMORY;
+        return;
+    }
+
+    while (importer->status == IO_OK && (!eof || carry_size > 0)) {
+        ImportJob *job = &importer->jobs[sequence++ % (uint64_t)importer->job_count];
+        size_t cut;
+
+        if (job->busy) {
+            wait_for_job(importer, job);
+            apply_job(importer, job);
+            job->busy = 0;
+        }
+
+        memcpy(job->text, carry, carry_size);
+        job->size = carry_size + fill(in, job->text + carry_size, IO_CHUNK_SIZE - carry_size, &eof);
+        importer->report->bytes += job->size - carry_size;
+        job->start = 0;
+        job->error = 0;
+        carry_size = 0;
+        if (ferror(in)) {
+            importer->status = IO_ERR_READ;
+            break;
+        }
+
+        if (first) {
+            first = 0;
+            if (job->size >= 3 && memcmp(job->text, "\xEF\xBB\xBF", 3) == 0) job->start = 3;
+            if (importer->options->format == IO_CSV &&
+                (last_record_end(IO_CSV, job->text, job->start, job->size) == job->start && !eof)) {
+                importer->status = IO_ERR_HEADER;
+                break;
+            }
+            if (importer->options->format == IO_CSV && !read_header(importer, job, &line)) {
+                importer->status = IO_ERR_HEADER;
+                break;
+            }
+        }
+
+        cut = eof ? job->size : last_record_end(importer->options->format, job->text, job->start, job->size);
+        job->first_line = line;
+        if (cut == job->start && !eof && job->size == IO_CHUNK_SIZE) {
+            // One record fills the whole buffer: report it and drop input up
+            // to the next newline
+            const char *newline = NULL;
+
+            job->error = IO_ROW_TOO_LONG;
+            while (newline == NULL) {
+                newline = memchr(job->text + job->start, '\n', job->size - job->start);
+                if (newline == NULL) {
+                    if (eof) break;
+                    job->start = 0;
+                    job->size = fill(in, job->text, IO_CHUNK_SIZE, &eof);
+                    importer->report->bytes += job->size;
+                }
+            }
+            if (newline != NULL) {
+                cut = (size_t)(newline - job->text) + 1;
+                carry_size = job->size - cut;
+                memcpy(carry, job->text + cut, carry_size);
+            }
+            line++;
+            job->start = job->size = 0;
+        } else {
+            carry_size = job->size - cut;
+            memcpy(carry, job->text + cut, carry_size);
+            job->size = cut;
+            line += count_lines(job->text, job->start, cut);
+        }
+        dispatch_job(importer, job);
+    }
+
+    // Apply what is still in flight, oldest first
+    for (int i = 0; i < importer->job_count; i++) {
+        ImportJob *job = &importer->jobs[sequence++ % (uint64_t)importer->job_count];
+
+        if (!job->busy) continue;
+        wait_for_job(importer, job);
+        apply_job(importer, job);
+        job->busy = 0;
+    }
+    free(carry);
+}
+
+int io_import(TodoStore *store, FILE *in, const TodoImportOptions *options, TodoImportReport *report) {
+    Importer importer;
+    int threads = options->threads < 0 ? 0 : options->threads > IO_MAX_THREADS ? IO_MAX_THREADS : options->threads;
+
+    memset(report, 0, sizeof(*report));
+    memset(&importer, 0, sizeof(importer));
+    importer.store = store;
+    importer.options = options;
+    importer.report = report;
+
+    // Two chunks per worker keep them busy while the reader waits on the oldest
+    importer.job_count = threads ? threads * 2 : 1;
+    importer.jobs = (ImportJob *)calloc((size_t)importer.job_count, sizeof(ImportJob));
+    if (importer.jobs == NULL) return IO_ERR_MEMORY;
+    for (int i = 0; i < importer.job_count; i++) {
+        importer.jobs[i].text = (char *)malloc(IO_CHUNK_SIZE + 1);
+        if (importer.jobs[i].text == NULL) {
+            free_jobs(&importer);
+            return IO_ERR_MEMORY;
+        }
+    }
+
+    todo_mutex_init(&importer.lock);
+    todo_cond_init(&importer.work);
+    todo_cond_init(&importer.done);
+    for (int i = 0; i < threads; i++) {
+        if (!todo_thread_start(&importer.threads[i], worker_loop, &importer)) break;
+        importer.thread_count++;
+    }
+
+    read_chunks(&importer, in);
+
+    todo_mutex_lock(&importer.lock);
+    importer.stopping = 1;
+    todo_cond_broadcast(&importer.work);
+    todo_mutex_unlock(&importer.lock);
+    for (int i = 0; i < importer.thread_count; i++) {
+        todo_thread_join(&importer.threads[i]);
+    }
+    todo_cond_destroy(&importer.done);
+    todo_cond_destroy(&importer.work);
+    todo_mutex_destroy(&importer.lock);
+    free_jobs(&importer);
+    return importer.status;
+}
+
+// Export
+
+static void write_csv_field(FILE *out, const char *text, size_t length) {
+    int quote = length > 0 && (text[0] == ' ' || text[length - 1] == ' ');
+
+    for (size_t i = 0; i < length && !quote; i++) {
+        quote = text[i] == ',' || text[i] == '"' || text[i] == '\n' || text[i] == '\r';
+    }
+    if (!quote) {
+        fwrite(text, 1, length, out);
+        return;
+    }
+    fputc('"', out);
+    for (size_t i = 0; i < length; ) {
+        const char *mark = memchr(text + i, '"', length - i);
+        size_t run = mark ? (size_t)(mark - text) + 1 - i : length - i;
+
+        fwrite(text + i, 1, run, out);
+        if (mark) fputc('"', out);
+        i += run;
+    }
+    fputc('"', out);
+}
+
+static void write_json_string(FILE *out, const char *text, size_t length) {
+    size_t run = 0;
+
+    fputc('"', out);
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = (unsigned char)text[i];
+
+        if (c >= 0x20 && c != '"' && c != '\\') continue;
+        fwrite(text + run, 1, i - run, out);
+        run = i + 1;
+        switch (c) {
+            case '"': fputs("\\\"", out); break;
+            case '\\': fputs("\\\\", out); break;
+            case '\n': fputs("\\n", out); break;
+            case '\r': fputs("\\r", out); break;
+            case '\t': fputs("\\t", out); break;
+            default: fprintf(out, "\\u%04x", c); break;
+        }
+    }
+    fwrite(text + run, 1, length - run, out);
+    fputc('"', out);
+}
+
+int io_export(TodoStore *store, FILE *out, int format, uint64_t *rows) {
+    *rows = 0;
+    if (format == IO_CSV) fputs("list,description,deadline,completed,repeat,priority,tags\n", out);
+
+    for (int i = 0; i < store->folder_count; i++) {
+        const Folder *folder = &store->folders[i];
+        const char *name;
+
+        store_materialize(store, i);
+        if (!folder->loaded) return IO_ERR_MEMORY;
+        name = store_text(store, folder->name);
+        for (int t = 0; t < folder->task_count; t++) {
+            const Task *task = store_task(store, folder, t);
+            const char *description = store_text(store, task->description);
+            const TodoRecurrence *rule = store_task_rule(store, task);
+            const char *tags = store_text(store, task->tags);
+            char deadline[DATE_TEXT_LENGTH] = "";
+            char repeat[RECUR_TEXT_LENGTH] = "";
+
+            if (task->deadline_day != DATE_NONE) date_format(task->deadline_day, deadline);
+            if (rule != NULL) recur_format(rule, task->deadline_day, repeat);
+            if (format == IO_CSV) {
+                write_csv_field(out, name, folder->name.length);
+                fputc(',', out);
+                write_csv_field(out, description, task->description.length);
+                // Canonical tags need no quoting
+                fprintf(out, ",%s,%d,%s,%s,%s\n", deadline, task->completed ? 1 : 0, repeat,
+                        task->priority ? priority_names[task->priority & 3] : "", tags);
+            } else {
+                fputs("{\"list\":", out);
+                write_json_string(out, name, folder->name.length);
+                fputs(",\"description\":", out);
+                write_json_string(out, description, task->description.length);
+                if (deadline[0]) {
+                    fprintf(out, ",\"deadline\":\"%s\"", deadline);
+                } else {
+                    fputs(",\"deadline\":null", out);
+                }
+                fprintf(out, ",\"completed\":%s", task->completed ? "true" : "false");
+                if (repeat[0]) fprintf(out, ",\"repeat\":\"%s\"", repeat);
+                if (task->priority) fprintf(out, ",\"priority\":\"%s\"", priority_names[task->priority & 3]);
+                if (tags[0]) fprintf(out, ",\"tags\":\"%s\"", tags);
+                fputs("}\n", out);
+            }
+            (*rows)++;
+        }
+        if (ferror(out)) return IO_ERR_WRITE;
+    }
+    return fflush(out) == 0 && !ferror(out) ? IO_OK : IO_ERR_WRITE;
+}
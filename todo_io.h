@@ -0,0 +1,91 @@
+#ifndef TODO_IO_H
+#define TODO_IO_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "todo_core.h"
+
+// Streaming import and export of tasks as CSV or JSON Lines.
+//
+// One row is one task: list name, description, deadline (YYYY-MM-DD or
+// empty), whether it is completed and, optionally, the rule of a repeating
+// task as recur_parse() reads it, its priority (none, low, medium, high
+// or 0 to 3) and its tags (names separated by spaces, as tags_normalize()
+// reads them). CSV files start with a header naming the columns list,
+// description, deadline, completed, repeat, priority and tags in any order;
+// other columns are ignored. JSON Lines files hold one object per line with
+// the same keys. Text is UTF-8.
+//
+// Import reads IO_CHUNK_SIZE bytes at a time. Each chunk is cut after its
+// last complete record and parsed in place; its deadlines are validated
+// together with date_parse_column(), and its rows are added to their lists
+// with one store_add_tasks() call per list instead of a sorted insert per
+// row. Bad rows are reported through a callback and skipped. Memory use
+// depends on the chunk size and thread count, never on the file size. With
+// threads > 0, chunks are parsed on worker threads while the caller's
+// thread reads ahead and applies parsed chunks in file order.
+
+#define IO_CHUNK_SIZE (1024 * 1024)
+#define IO_MAX_THREADS 16
+#define IO_MAX_COLUMNS 64
+
+enum {
+    IO_CSV = 1,
+    IO_JSONL
+};
+
+enum {
+    IO_OK = 0,
+    IO_ERR_READ,
+    IO_ERR_WRITE,
+    IO_ERR_HEADER,      // CSV header without a description column
+    IO_ERR_MEMORY
+};
+
+// Why a row was skipped
+enum {
+    IO_ROW_MALFORMED = 1,   // Stray quote, bad JSON
+    IO_ROW_TOO_LONG,        // Record longer than IO_CHUNK_SIZE
+    IO_ROW_ENCODING,        // Not valid UTF-8
+    IO_ROW_NO_DESCRIPTION,
+    IO_ROW_NO_LIST,
+    IO_ROW_DEADLINE,
+    IO_ROW_COMPLETED,
+    IO_ROW_FULL,            // No room for the task or its list
+    IO_ROW_NO_MEMORY,
+    IO_ROW_REPEAT,
+    IO_ROW_PRIORITY,
+    IO_ROW_TAGS
+};
+
+// line is where the record starts, counting from 1
+typedef void (*TodoIoRowError)(void *context, uint64_t line, int error);
+
+typedef struct {
+    int format;
+    int threads;                // Parser threads; 0 parses on the caller's thread
+    const char *default_list;   // For rows without a list; NULL rejects them
+    TodoIoRowError on_error;
+    void *context;
+} TodoImportOptions;
+
+typedef struct {
+    uint64_t bytes;
+    uint64_t rows;
+    uint64_t imported;
+    uint64_t rejected;
+    uint64_t lists_created;
+} TodoImportReport;
+
+// IO_CSV or IO_JSONL from a file name, 0 if the extension is unknown
+int io_format_from_path(const char *path);
+const char *io_row_error_text(int error);
+
+// Read tasks into the store, creating lists as needed. store may be NULL
+// to only validate the file.
+int io_import(TodoStore *store, FILE *in, const TodoImportOptions *options, TodoImportReport *report);
+
+// Write every task of every list, materializing folders one at a time
+int io_export(TodoStore *store, FILE *out, int format, uint64_t *rows);
+
+#endif
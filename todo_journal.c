@@ -0,0 +1,1207 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "todo_journal.h"
+#include "todo_format.h"
+#include "todo_thread.h"
+#include "todo_trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define journal_fileno _fileno
+#else
+#include <unistd.h>
+#define journal_fileno fileno
+#endif
+
+#define JOURNAL_PATH_LENGTH 260
+
+struct TodoJournal {
+    char data_path[JOURNAL_PATH_LENGTH];
+    char log_path[JOURNAL_PATH_LENGTH];
+    char segment_path[JOURNAL_PATH_LENGTH];
+    char compact_path[JOURNAL_PATH_LENGTH];
+    TodoClock clock;
+    void *clock_context;
+    int encoding;           // Of the sections compaction writes
+
+    // Everything below is shared with the threads and guarded by lock.
+    TodoMutex lock;
+
+    // Log writer. The UI thread encodes records into pending; the writer
+    // thread moves them to batch and owns log, log_size and batch while it
+    // runs. writer_running is only touched by the UI thread.
+    TodoThread writer;
+    int writer_running;
+    TodoCond wake;          // Signals the writer
+    TodoCond drained;       // Signalled after every write attempt
+    FILE *log;
+    uint64_t log_size;
+    unsigned char *pending;
+    size_t pending_size;
+    size_t pending_capacity;
+    unsigned char *batch;
+    size_t batch_size;
+    size_t batch_capacity;
+    uint64_t first_queued;  // Clock time of the oldest and newest pending record
+    uint64_t last_queued;
+    uint64_t retry_at;      // No write before this after a failure
+    uint64_t attempts;
+    int write_status;       // Result of the last write attempt
+    int flush_now;          // Write without waiting for a pause
+    int holding;            // The newest pending records wait for their change to apply
+    int checkpoint_requested;
+    int rewrite_requested;  // Compact even with an empty log
+    int stopping;
+
+    // Background compaction, started by the writer once the log has been
+    // rotated. The UI thread installs the result in journal_poll().
+    TodoThread worker;
+    int compacting;
+    int worker_done;
+    int worker_status;
+};
+
+// CRC-32 (IEEE 802.3), four bits at a time: the checksum of version 0
+// records, only ever read now
+static const uint32_t crc_nibble_table[16] = {
+    0x00000000, 0x1DB71064, 0x3B6E20C8, 0x26D930AC,
+    0x76DC4190, 0x6B6B51F4, 0x4DB26158, 0x5005713C,
+    0xEDB88320, 0xF00F9344, 0xD6D6A3E8, 0xCB61B38C,
+    0x9B64C2B0, 0x86D3D2D4, 0xA00AE278, 0xBDBDF21C
+};
+
+static uint32_t legacy_crc32(const void *data, size_t size) {
+    const unsigned char *bytes = (const unsigned char *)data;
+    uint32_t crc = 0xFFFFFFFFu;
+
+    for (size_t i = 0; i < size; i++) {
+        crc ^= bytes[i];
+        crc = (crc >> 4) ^ crc_nibble_table[crc & 0x0F];
+        crc = (crc >> 4) ^ crc_nibble_table[crc & 0x0F];
+    }
+    return crc ^ 0xFFFFFFFFu;
+}
+
+static int sync_log(FILE *file) {
+    if (fflush(file) != 0) return 0;
+#ifdef _WIN32
+    return _commit(journal_fileno(file)) == 0;
+#else
+    return fsync(journal_fileno(file)) == 0;
+#endif
+}
+
+static int truncate_log(FILE *file, uint64_t size) {
+    fflush(file);
+#ifdef _WIN32
+    if (_chsize_s(journal_fileno(file), (long long)size) != 0) return 0;
+#else
+    if (ftruncate(journal_fileno(file), (off_t)size) != 0) return 0;
+#endif
+    return fseek(file, 0, SEEK_END) == 0;
+}
+
+// Deadlines are journaled as YYYY-MM-DD text, followed by the rule of a
+// repeating task (see recur_format_schedule()); an empty one means none.
+// A priority comes first as "!N ", then the tags as "#name " each.
+static void entry_schedule(const TodoJournalEntry *entry, int32_t *deadline, TodoRecurrence *rule,
+                           int *priority, char tags[TAGS_TEXT_LENGTH]) {
+    const char *text = entry->text[1];
+    const char *names;
+
+    *priority = PRIORITY_NONE;
+    tags[0] = '\0';
+    if (text != NULL && text[0] == '!' && text[1] >= '0' + PRIORITY_NONE && text[1] <= '0' + PRIORITY_HIGH &&
+        text[2] == ' ') {
+        *priority = text[1] - '0';
+        text += 3;
+    }
+    if (text != NULL && text[0] == '#') {
+        char typed[JOURNAL_SCHEDULE_LENGTH];
+        size_t length;
+
+        names = text;
+        while (text[0] == '#') {
+            while (*text != '\0' && *text != ' ') text++;
+            while (*text == ' ') text++;
+        }
+        length = (size_t)(text - names);
+        if (length < sizeof(typed)) {
+            memcpy(typed, names, length);
+            typed[length] = '\0';
+            if (!tags_normalize(typed, tags)) tags[0] = '\0';
+        }
+    }
+    if (text == NULL || !recur_parse_schedule(text, deadline, rule)) {
+        *deadline = DATE_NONE;
+        memset(rule, 0, sizeof(*rule));
+    }
+}
+
+int32_t journal_entry_deadline(const TodoJournalEntry *entry) {
+    TodoRecurrence rule;
+    char tags[TAGS_TEXT_LENGTH];
+    int32_t day;
+    int priority;
+
+    entry_schedule(entry, &day, &rule, &priority, tags);
+    return day;
+}
+
+void journal_entry_repeat(const TodoJournalEntry *entry, TodoRecurrence *rule) {
+    char tags[TAGS_TEXT_LENGTH];
+    int32_t day;
+    int priority;
+
+    entry_schedule(entry, &day, rule, &priority, tags);
+}
+
+int journal_entry_priority(const TodoJournalEntry *entry) {
+    TodoRecurrence rule;
+    char tags[TAGS_TEXT_LENGTH];
+    int32_t day;
+    int priority;
+
+    entry_schedule(entry, &day, &rule, &priority, tags);
+    return priority;
+}
+
+void journal_entry_tags(const TodoJournalEntry *entry, char out[TAGS_TEXT_LENGTH]) {
+    TodoRecurrence rule;
+    int32_t day;
+    int priority;
+
+    entry_schedule(entry, &day, &rule, &priority, out);
+}
+
+void journal_format_schedule(int32_t deadline_day, const TodoRecurrence *rule, int priority, const char *tags,
+                             char out[JOURNAL_SCHEDULE_LENGTH]) {
+    int at = 0;
+
+    if (priority > PRIORITY_NONE && priority <= PRIORITY_HIGH) {
+        out[at++] = '!';
+        out[at++] = (char)('0' + priority);
+        out[at++] = ' ';
+    }
+    // Canonical names hold no spaces, so each ends at the next one
+    while (tags != NULL && *tags != '\0') {
+        out[at++] = '#';
+        while (*tags != '\0' && *tags != ' ') out[at++] = *tags++;
+        out[at++] = ' ';
+        if (*tags == ' ') tags++;
+    }
+    recur_format_schedule(deadline_day, rule, out + at);
+}
+
+// Find a task by the index recorded in the journal, falling back to a
+// search by content if the folder order has changed since.
+static int task_matches(const TodoStore *store, const Task *task, const TodoJournalEntry *entry,
+                        const char *description, size_t length, int32_t deadline) {
+    return task->description.length == length &&
+           memcmp(store_text(store, task->description), description, length) == 0 &&
+           task->deadline_day == deadline &&
+           (entry->op != JOURNAL_COMPLETE_TASK || !task->completed) &&
+           (entry->op != JOURNAL_REOPEN_TASK || task->completed || task->rule != 0);
+}
+
+// Tasks whose slot is set in taken (which may be NULL) are already claimed
+// by an earlier entry of the same batch
+static int locate_task(const TodoStore *store, const Folder *folder, const TodoJournalEntry *entry,
+                       const uint8_t *taken) {
+    const char *description = entry->text[0] ? entry->text[0] : "";
+    size_t length = utf8_fit(description, strlen(description), STRPOOL_MAX_LENGTH);
+    int32_t deadline = journal_entry_deadline(entry);
+    int index = entry->task_index;
+
+    if (!folder->loaded) return -1;
+    // Reopening undoes the latest completion of such a task, and a
+    // completed task is placed after those with the same key: take the last
+    // match. task_index is where the task goes back to.
+    if (entry->op == JOURNAL_REOPEN_TASK) {
+        for (int i = folder->task_count - 1; i >= 0; i--) {
+            if (taken && taken[SLOTS_INDEX(folder->rows[i])]) continue;
+            if (task_matches(store, store_task(store, folder, i), entry, description, length, deadline)) return i;
+        }
+        return -1;
+    }
+
+    if (index >= 0 && index < folder->task_count) {
+        const Task *key = store_task(store, folder, index);
+        int low = index;
+        int high = index + 1;
+
+        if (!(taken && taken[SLOTS_INDEX(folder->rows[index])]) &&
+            task_matches(store, key, entry, description, length, deadline)) {
+            return index;
+        }
+        // Undo puts tasks back within their run of equal keys, not always
+        // at the same row: look in the run of the row first, which keeps the
+        // task's state
+        while (low > 0 && compare_tasks(store_task(store, folder, low - 1), key) == 0) low--;
+        while (high < folder->task_count && compare_tasks(store_task(store, folder, high), key) == 0) high++;
+        for (int i = low; i < high; i++) {
+            if (taken && taken[SLOTS_INDEX(folder->rows[i])]) continue;
+            if (task_matches(store, store_task(store, folder, i), entry, description, length, deadline)) return i;
+        }
+    }
+    for (int i = 0; i < folder->task_count; i++) {
+        if (taken && taken[SLOTS_INDEX(folder->rows[i])]) continue;
+        if (task_matches(store, store_task(store, folder, i), entry, description, length, deadline)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+int journal_locate_task(const TodoStore *store, const Folder *folder, const TodoJournalEntry *entry) {
+    return locate_task(store, folder, entry, NULL);
+}
+
+// Apply one operation to the store, materializing the folder it touches
+int journal_apply(TodoStore *store, const TodoJournalEntry *entry) {
+    TodoRecurrence rule;
+    char tags[TAGS_TEXT_LENGTH];
+    int32_t deadline;
+    int priority;
+    int index;
+
+    if (entry->op == JOURNAL_CREATE_LIST) {
+        return store_insert_folder(store, entry->task_index, entry->folder_id,
+                                   entry->text[0] ? entry->text[0] : "") >= 0;
+    }
+
+    index = store_find_folder(store, entry->folder_id);
+    if (index < 0) return 0;
+
+    switch (entry->op) {
+        case JOURNAL_DELETE_LIST:
+            return store_delete_folder(store, index);
+        case JOURNAL_ADD_TASK:
+        case JOURNAL_RESTORE_TASK:
+            entry_schedule(entry, &deadline, &rule, &priority, tags);
+            store_materialize(store, index);
+            return store_insert_task(store, index, entry->task_index, entry->text[0] ? entry->text[0] : "",
+                                     deadline, entry->op == JOURNAL_RESTORE_TASK, priority, tags, &rule);
+        case JOURNAL_COMPLETE_TASK:
+            store_materialize(store, index);
+            return store_complete_task(store, index, journal_locate_task(store, &store->folders[index], entry));
+        case JOURNAL_REOPEN_TASK:
+            store_materialize(store, index);
+            return store_reopen_task(store, index, journal_locate_task(store, &store->folders[index], entry),
+                                     entry->task_index);
+        case JOURNAL_DELETE_TASK:
+            store_materialize(store, index);
+            return store_delete_task(store, index, journal_locate_task(store, &store->folders[index], entry));
+        case JOURNAL_TAG_TASK:
+            journal_entry_tags(entry, tags);
+            store_materialize(store, index);
+            return store_tag_task(store, index, journal_locate_task(store, &store->folders[index], entry), tags);
+    }
+    return 0;
+}
+
+// Append canonical tags to a batch's tag text, returning their offset
+static int keep_tags(char **text, size_t *size, size_t *capacity, const char *tags, size_t *offset) {
+    size_t length = strlen(tags) + 1;
+
+    if (*size + length > *capacity) {
+        size_t grown = *capacity ? *capacity : 1024;
+        char *resized;
+
+        while (grown < *size + length) grown *= 2;
+        resized = (char *)realloc(*text, grown);
+        if (resized == NULL) return 0;
+        *text = resized;
+        *capacity = grown;
+    }
+    memcpy(*text + *size, tags, length);
+    *offset = *size;
+    *size += length;
+    return 1;
+}
+
+int journal_apply_batch(TodoStore *store, const TodoJournalEntry *entries, int count) {
+    TodoBatchChange *changes;
+    size_t *tag_offsets;
+    uint32_t *folder_ids = NULL;
+    int *folders = NULL;
+    uint8_t *taken = NULL;
+    char *tag_text = NULL;
+    size_t tag_size = 0, tag_capacity = 0;
+    int ok = 0;
+    int i;
+
+    if (count <= 0) return count == 0;
+    changes = (TodoBatchChange *)calloc((size_t)count, sizeof(TodoBatchChange));
+    tag_offsets = (size_t *)malloc((size_t)count * sizeof(size_t));
+    folder_ids = (uint32_t *)malloc((size_t)count * sizeof(uint32_t));
+    folders = (int *)malloc((size_t)count * sizeof(int));
+    if (changes == NULL || tag_offsets == NULL || folder_ids == NULL || folders == NULL) goto done;
+
+    // Load every folder first, so the tasks all have their slots
+    for (i = 0; i < count; i++) folder_ids[i] = entries[i].folder_id;
+    store_find_folders(store, folder_ids, count, folders);
+    for (i = 0; i < count; i++) {
+        changes[i].folder = folders[i];
+        if (changes[i].folder < 0) goto done;
+        store_materialize(store, changes[i].folder);
+    }
+    taken = (uint8_t *)calloc((size_t)store->tasks.used + 1, 1);
+    if (taken == NULL) goto done;
+
+    // Entries that name their task's row claim it first; a reopen, whose
+    // task_index is where its task goes, takes a match among the rest
+    for (int pass = 0; pass < 2; pass++) {
+        for (i = 0; i < count; i++) {
+            const TodoJournalEntry *entry = &entries[i];
+            TodoBatchChange *change = &changes[i];
+            char tags[TAGS_TEXT_LENGTH];
+            int row;
+
+            if ((entry->op == JOURNAL_REOPEN_TASK) != pass) continue;
+            change->hint = -1;
+            tag_offsets[i] = SIZE_MAX;
+            if (entry->op == JOURNAL_ADD_TASK || entry->op == JOURNAL_RESTORE_TASK) {
+                change->kind = STORE_BATCH_ADD;
+                change->hint = entry->task_index;
+                change->task.description = entry->text[0] ? entry->text[0] : "";
+                change->task.length = strlen(change->task.description);
+                change->task.completed = entry->op == JOURNAL_RESTORE_TASK;
+                entry_schedule(entry, &change->task.deadline_day, &change->task.repeat, &change->task.priority, tags);
+                if (!keep_tags(&tag_text, &tag_size, &tag_capacity, tags, &tag_offsets[i])) goto done;
+                continue;
+            }
+
+            row = locate_task(store, &store->folders[change->folder], entry, taken);
+            if (row < 0) goto done;
+            change->task_id = store->folders[change->folder].rows[row];
+            change->row = row;
+            taken[SLOTS_INDEX(change->task_id)] = 1;
+            switch (entry->op) {
+                case JOURNAL_COMPLETE_TASK:
+                    change->kind = STORE_BATCH_COMPLETE;
+                    break;
+                case JOURNAL_REOPEN_TASK:
+                    change->kind = STORE_BATCH_REOPEN;
+                    change->hint = entry->task_index;
+                    break;
+                case JOURNAL_DELETE_TASK:
+                    change->kind = STORE_BATCH_DELETE;
+                    break;
+                case JOURNAL_TAG_TASK:
+                    change->kind = STORE_BATCH_TAG;
+                    journal_entry_tags(entry, tags);
+                    if (!keep_tags(&tag_text, &tag_size, &tag_capacity, tags, &tag_offsets[i])) goto done;
+                    break;
+                default:
+                    goto done;  // Lists are not changed in a batch
+            }
+        }
+    }
+
+    // The tag text has stopped moving
+    for (i = 0; i < count; i++) {
+        if (tag_offsets[i] == SIZE_MAX) continue;
+        if (changes[i].kind == STORE_BATCH_ADD) {
+            changes[i].task.tags = tag_text + tag_offsets[i];
+            changes[i].task.tags_length = strlen(changes[i].task.tags);
+        } else {
+            changes[i].tags = tag_text + tag_offsets[i];
+        }
+    }
+    ok = store_apply_batch(store, changes, count);
+
+done:
+    free(changes);
+    free(tag_offsets);
+    free(folder_ids);
+    free(folders);
+    free(taken);
+    free(tag_text);
+    return ok;
+}
+
+uint32_t journal_record_checksum(const void *record, size_t size) {
+    uint32_t op;
+
+    if (size < sizeof(TodoJournalRecord)) return 0;
+    memcpy(&op, (const unsigned char *)record + offsetof(TodoJournalRecord, op), sizeof(op));
+    return op >> 24 == 0 ? legacy_crc32(record, size) : todofmt_crc32c(0, record, size);
+}
+
+// Read the next record into buffer, which holds the largest one, with the
+// version taken off its op. Returns 0 at the end of the file or at a torn
+// or corrupt record, or one from a newer version.
+static int read_record(FILE *file, unsigned char *buffer, TodoJournalRecord *record) {
+    uint32_t checksum;
+    size_t payload;
+
+    if (fread(buffer, sizeof(*record), 1, file) != 1) return 0;
+    memcpy(record, buffer, sizeof(*record));
+    payload = (size_t)record->text_length[0] + record->text_length[1];
+    if (record->size != sizeof(*record) + payload) return 0;
+    if (record->op >> 24 > JOURNAL_RECORD_VERSION) return 0;
+    if (payload > 0 && fread(buffer + sizeof(*record), payload, 1, file) != 1) return 0;
+
+    checksum = record->checksum;
+    memset(buffer + offsetof(TodoJournalRecord, checksum), 0, sizeof(record->checksum));
+    record->op &= JOURNAL_OP_MASK;
+    return journal_record_checksum(buffer, record->size) == checksum;
+}
+
+// Copy a record's text out of buffer into out, terminating each part
+static void record_text(const unsigned char *buffer, const TodoJournalRecord *record, char *out) {
+    memcpy(out, buffer + sizeof(*record), record->text_length[0]);
+    out[record->text_length[0]] = '\0';
+    memcpy(out + record->text_length[0] + 1, buffer + sizeof(*record) + record->text_length[0],
+           record->text_length[1]);
+    out[record->text_length[0] + 1 + record->text_length[1]] = '\0';
+}
+
+static void record_entry(const TodoJournalRecord *record, char *text, TodoJournalEntry *entry) {
+    entry->op = (int)record->op;
+    entry->folder_id = record->folder_id;
+    entry->task_index = record->task_index;
+    entry->text[0] = text;
+    entry->text[1] = text + record->text_length[0] + 1;
+}
+
+// The records of a batch whose header was just read, applied as one.
+// Their text is copied out as they are read, into one growing block that
+// only gets as large as what the file holds. Returns 0 if one of them is
+// torn, -1 if out of memory, otherwise 1 with *applied set.
+static int replay_batch(FILE *file, unsigned char *buffer, TodoStore *store, const TodoJournalRecord *header,
+                        uint64_t *size, long *applied) {
+    TodoJournalRecord *records = NULL;
+    size_t *offsets = NULL;
+    TodoJournalEntry *entries = NULL;
+    char *text = NULL;
+    size_t text_size = 0, text_capacity = 0;
+    int capacity = 0;
+    int count = 0;
+    int status = -1;
+
+    *size = 0;
+    *applied = 0;
+    for (; count < header->task_index; count++) {
+        TodoJournalRecord record;
+        size_t needed;
+
+        if (!read_record(file, buffer, &record)) {
+            status = 0;
+            goto done;
+        }
+        needed = text_size + record.text_length[0] + record.text_length[1] + 2;
+        if (count == capacity) {
+            int grown = capacity ? capacity * 2 : 64;
+            TodoJournalRecord *more_records = (TodoJournalRecord *)realloc(records, (size_t)grown * sizeof(*records));
+            size_t *more_offsets;
+
+            if (more_records == NULL) goto done;
+            records = more_records;
+            more_offsets = (size_t *)realloc(offsets, (size_t)grown * sizeof(size_t));
+            if (more_offsets == NULL) goto done;
+            offsets = more_offsets;
+            capacity = grown;
+        }
+        if (needed > text_capacity) {
+            size_t grown = text_capacity ? text_capacity : 4096;
+            char *resized;
+
+            while (grown < needed) grown *= 2;
+            resized = (char *)realloc(text, grown);
+            if (resized == NULL) goto done;
+            text = resized;
+            text_capacity = grown;
+        }
+        record_text(buffer, &record, text + text_size);
+        records[count] = record;
+        offsets[count] = text_size;
+        text_size = needed;
+        *size += record.size;
+    }
+
+    status = 1;
+    if (count == 0 || header->seq <= store->journal_seq) goto done;  // Already in the checkpoint
+    entries = (TodoJournalEntry *)malloc((size_t)count * sizeof(TodoJournalEntry));
+    if (entries == NULL) {
+        status = -1;
+        goto done;
+    }
+    for (int i = 0; i < count; i++) {
+        record_entry(&records[i], text + offsets[i], &entries[i]);
+    }
+    if (journal_apply_batch(store, entries, count)) *applied = count;
+    store->journal_seq = records[count - 1].seq;
+
+done:
+    free(records);
+    free(offsets);
+    free(entries);
+    free(text);
+    return status;
+}
+
+// Apply every intact record newer than store->journal_seq. Replay stops at
+// the first torn or corrupt record, or at a batch with one; valid_size
+// receives its offset so the tail can be cut off before appending. Returns
+// the number of records applied, or -1 if the file exists but cannot be
+// read.
+long journal_replay(const char *path, TodoStore *store, uint64_t *valid_size) {
+    unsigned char *buffer;
+    char *text;
+    long applied = 0;
+    uint64_t offset = 0;
+    FILE *file = fopen(path, "rb");
+
+    if (valid_size) *valid_size = 0;
+    if (file == NULL) {
+        return 0;
+    }
+    buffer = (unsigned char *)malloc(sizeof(TodoJournalRecord) + 2 * JOURNAL_MAX_TEXT);
+    text = (char *)malloc(2 * (JOURNAL_MAX_TEXT + 1));
+    if (buffer == NULL || text == NULL) {
+        free(buffer);
+        free(text);
+        fclose(file);
+        return -1;
+    }
+
+    for (;;) {
+        TodoJournalRecord record;
+        TodoJournalEntry entry;
+
+        if (!read_record(file, buffer, &record)) break;
+        if (record.op == JOURNAL_BATCH) {
+            uint64_t size;
+            long batch;
+            int status = replay_batch(file, buffer, store, &record, &size, &batch);
+
+            if (status < 0) applied = -1;
+            if (status <= 0) break;
+            offset += record.size + size;
+            applied += batch;
+            continue;
+        }
+
+        offset += record.size;
+        if (record.seq <= store->journal_seq) {
+            continue;   // Already folded into the checkpoint
+        }
+
+        record_text(buffer, &record, text);
+        record_entry(&record, text, &entry);
+        if (journal_apply(store, &entry)) {
+            applied++;
+        }
+        store->journal_seq = record.seq;
+    }
+
+    if (ferror(file)) {
+        applied = -1;
+    }
+    free(buffer);
+    free(text);
+    fclose(file);
+    if (valid_size) *valid_size = offset;
+    return applied;
+}
+
+// Fold a rotated journal segment into the checkpoint at data_path and write
+// the result to out_path in the given section encoding. Folders the segment
+// never touches are copied straight from the old mapping without being
+// decoded, unless their encoding changes.
+int journal_compact(const char *data_path, const char *segment_path, const char *out_path, int encoding) {
+    TodoStore *store = (TodoStore *)malloc(sizeof(TodoStore));
+    TodoDataFile *file = NULL;
+    int status;
+
+    if (store == NULL) return TODOFMT_ERR_IO;
+    store_init(store);
+
+    status = todofmt_open(data_path, &file);
+    if (status == TODOFMT_OK) {
+        store_attach(store, file);
+    } else if (status != TODOFMT_ERR_MISSING) {
+        free(store);
+        return status;
+    }
+
+    // Quarantined folders are written back empty, so keep their damaged
+    // sections first
+    if (store->quarantined > 0) {
+        char damaged_path[JOURNAL_PATH_LENGTH];
+
+        snprintf(damaged_path, sizeof(damaged_path), "%s.damaged", data_path);
+        if (todofmt_save_damaged(file, damaged_path) != TODOFMT_OK) {
+            store_release(store);
+            free(store);
+            return TODOFMT_ERR_IO;
+        }
+    }
+
+    if (journal_replay(segment_path, store, NULL) < 0) {
+        status = TODOFMT_ERR_IO;
+    } else {
+        status = todofmt_write(out_path, store, encoding);
+    }
+
+    store_release(store);
+    free(store);
+    if (status != TODOFMT_OK) {
+        remove(out_path);
+    }
+    return status;
+}
+
+static void compaction_worker(void *arg) {
+    TodoJournal *journal = (TodoJournal *)arg;
+    uint64_t started = TRACE_BEGIN();
+    int status = journal_compact(journal->data_path, journal->segment_path, journal->compact_path,
+                                 journal->encoding);
+
+    // The old file may still be mapped by the store; todofmt_replace()
+    // copes with that, and the store is rebound on the UI thread
+    if (status == TODOFMT_OK) {
+        status = todofmt_replace(journal->compact_path, journal->data_path);
+        if (status == TODOFMT_OK) {
+            remove(journal->segment_path);
+        } else {
+            remove(journal->compact_path);
+        }
+    }
+    trace_end(TRACE_COMPACT, started, 0);
+
+    todo_mutex_lock(&journal->lock);
+    journal->worker_status = status;
+    journal->worker_done = 1;
+    todo_mutex_unlock(&journal->lock);
+}
+
+// Switch the store to a finished checkpoint
+static void finish_compaction(TodoJournal *journal, TodoStore *store) {
+    TodoDataFile *file = NULL;
+    int status;
+
+    todo_thread_join(&journal->worker);
+    todo_mutex_lock(&journal->lock);
+    journal->compacting = 0;
+    status = journal->worker_status;
+    todo_cond_signal(&journal->wake);   // A checkpoint may be waiting on this one
+    todo_mutex_unlock(&journal->lock);
+
+    // On failure the segment stays and is retried on the next checkpoint
+    if (status == TODOFMT_OK && todofmt_open(journal->data_path, &file) == TODOFMT_OK) {
+        store_rebind(store, file);
+    }
+}
+
+static void wait_for_compaction(TodoJournal *journal, TodoStore *store) {
+    int compacting;
+
+    todo_mutex_lock(&journal->lock);
+    compacting = journal->compacting;
+    todo_mutex_unlock(&journal->lock);
+    if (compacting) {
+        finish_compaction(journal, store);
+    }
+}
+
+// Open the log for appending. valid_size cuts off a torn tail found by
+// replay; JOURNAL_KEEP_SIZE leaves the file as it is.
+#define JOURNAL_KEEP_SIZE UINT64_MAX
+
+static int open_log(TodoJournal *journal, uint64_t valid_size) {
+    long end;
+
+    journal->log = fopen(journal->log_path, "r+b");
+    if (journal->log == NULL) {
+        journal->log = fopen(journal->log_path, "w+b");
+        valid_size = 0;
+    }
+    if (journal->log == NULL) {
+        return 0;
+    }
+
+    if (valid_size == JOURNAL_KEEP_SIZE) {
+        if (fseek(journal->log, 0, SEEK_END) != 0 || (end = ftell(journal->log)) < 0) {
+            fclose(journal->log);
+            journal->log = NULL;
+            return 0;
+        }
+        valid_size = (uint64_t)end;
+    } else if (!truncate_log(journal->log, valid_size)) {
+        fclose(journal->log);
+        journal->log = NULL;
+        return 0;
+    }
+    journal->log_size = valid_size;
+    return 1;
+}
+
+static void close_log(TodoJournal *journal) {
+    if (journal->log) {
+        fclose(journal->log);
+        journal->log = NULL;
+    }
+    journal->log_size = 0;
+}
+
+// Called by the writer with the lock held
+static int start_compaction(TodoJournal *journal) {
+    journal->worker_done = 0;
+    journal->worker_status = TODOFMT_ERR_IO;
+    journal->compacting = todo_thread_start(&journal->worker, compaction_worker, journal);
+    return journal->compacting;
+}
+
+// Append everything queued to the log with one write and one flush to
+// disk. Called by the writer with the lock held; the lock is dropped for
+// the I/O so the UI thread can keep queueing.
+static void write_queued(TodoJournal *journal) {
+    uint64_t started;
+    int ok;
+
+    if (journal->batch_size == 0) {
+        unsigned char *buffer = journal->batch;
+        size_t capacity = journal->batch_capacity;
+
+        journal->batch = journal->pending;
+        journal->batch_size = journal->pending_size;
+        journal->batch_capacity = journal->pending_capacity;
+        journal->pending = buffer;
+        journal->pending_size = 0;
+        journal->pending_capacity = capacity;
+    }
+    // Otherwise a failed batch is retried first and pending waits its turn
+
+    todo_mutex_unlock(&journal->lock);
+    started = TRACE_BEGIN();
+    ok = journal->log != NULL &&
+         fwrite(journal->batch, journal->batch_size, 1, journal->log) == 1 &&
+         sync_log(journal->log);
+    if (!ok && journal->log != NULL) {
+        // Cut off the partial batch so later appends stay reachable
+        truncate_log(journal->log, journal->log_size);
+    }
+    trace_end(TRACE_JOURNAL_WRITE, started, journal->batch_size);
+    todo_mutex_lock(&journal->lock);
+
+    journal->attempts++;
+    if (ok) {
+        journal->log_size += journal->batch_size;
+        journal->batch_size = 0;
+        journal->write_status = TODOFMT_OK;
+        if (journal->log_size >= JOURNAL_COMPACT_BYTES) {
+            journal->checkpoint_requested = 1;
+        }
+    } else {
+        journal->write_status = TODOFMT_ERR_IO;
+        journal->retry_at = journal->clock(journal->clock_context) + JOURNAL_RETRY_MS;
+    }
+    if (journal->pending_size == 0 && journal->batch_size == 0) {
+        journal->flush_now = 0;
+    }
+    todo_cond_signal(&journal->drained);
+}
+
+// Move the log aside as the segment and start folding it into a new
+// checkpoint, unless a segment from an interrupted compaction is still
+// waiting, in which case that one is compacted. Called by the writer with
+// the lock held and nothing queued.
+static void rotate_log(TodoJournal *journal) {
+    FILE *segment;
+    int ok = 1;
+
+    journal->checkpoint_requested = 0;
+    todo_mutex_unlock(&journal->lock);
+    segment = fopen(journal->segment_path, "rb");
+    if (segment != NULL) {
+        fclose(segment);
+    } else if (journal->log_size == 0) {
+        ok = journal->rewrite_requested;    // Nothing to fold in
+    } else {
+        close_log(journal);
+        if (todofmt_replace(journal->log_path, journal->segment_path) != TODOFMT_OK) {
+            open_log(journal, JOURNAL_KEEP_SIZE);
+            ok = 0;
+        } else {
+            ok = open_log(journal, 0);
+        }
+    }
+    todo_mutex_lock(&journal->lock);
+    if (ok) {
+        journal->rewrite_requested = 0;
+        start_compaction(journal);
+    }
+}
+
+// When the queued records are due: once edits have paused for
+// JOURNAL_QUIET_MS, or JOURNAL_MAX_DELAY_MS after the first of them
+static uint64_t write_due(const TodoJournal *journal) {
+    uint64_t due = journal->retry_at;
+
+    if (journal->pending_size > 0 && !journal->flush_now && !journal->stopping) {
+        uint64_t quiet = journal->last_queued + JOURNAL_QUIET_MS;
+        uint64_t limit = journal->first_queued + JOURNAL_MAX_DELAY_MS;
+        uint64_t pause = quiet < limit ? quiet : limit;
+        if (pause > due) due = pause;
+    }
+    return due;
+}
+
+static void writer_loop(void *arg) {
+    TodoJournal *journal = (TodoJournal *)arg;
+
+    todo_mutex_lock(&journal->lock);
+    for (;;) {
+        uint64_t now = journal->clock(journal->clock_context);
+        int queued = journal->pending_size > 0 || journal->batch_size > 0;
+        uint64_t due = queued && !journal->holding ? write_due(journal) : TODO_WAIT_FOREVER;
+
+        if (queued && now >= due) {
+            write_queued(journal);
+        } else if (!queued && journal->checkpoint_requested && !journal->compacting && !journal->stopping) {
+            rotate_log(journal);
+        } else if (journal->stopping) {
+            break;  // Anything still queued failed to write on the last try
+        } else {
+            todo_cond_wait(&journal->wake, &journal->lock, due == TODO_WAIT_FOREVER ? due : due - now);
+        }
+    }
+    todo_mutex_unlock(&journal->lock);
+}
+
+static int start_writer(TodoJournal *journal) {
+    journal->stopping = 0;
+    journal->writer_running = todo_thread_start(&journal->writer, writer_loop, journal);
+    return journal->writer_running;
+}
+
+// Write whatever is queued, once more if it has been failing, and stop
+static void stop_writer(TodoJournal *journal) {
+    if (!journal->writer_running) return;
+    todo_mutex_lock(&journal->lock);
+    journal->stopping = 1;
+    journal->retry_at = 0;
+    todo_cond_signal(&journal->wake);
+    todo_mutex_unlock(&journal->lock);
+    todo_thread_join(&journal->writer);
+    journal->writer_running = 0;
+}
+
+// Journal files sit next to the data file: todo_data.dat gives
+// todo_data.jnl and todo_data.jnl.1
+TodoJournal *journal_create(const char *data_path) {
+    TodoJournal *journal = (TodoJournal *)calloc(1, sizeof(TodoJournal));
+    size_t stem = strlen(data_path);
+
+    if (journal == NULL) return NULL;
+    if (stem > 4 && strcmp(data_path + stem - 4, ".dat") == 0) {
+        stem -= 4;
+    }
+    if (snprintf(journal->data_path, JOURNAL_PATH_LENGTH, "%s", data_path) >= JOURNAL_PATH_LENGTH ||
+        snprintf(journal->log_path, JOURNAL_PATH_LENGTH, "%.*s.jnl", (int)stem, data_path) >= JOURNAL_PATH_LENGTH ||
+        snprintf(journal->segment_path, JOURNAL_PATH_LENGTH, "%s.1", journal->log_path) >= JOURNAL_PATH_LENGTH ||
+        snprintf(journal->compact_path, JOURNAL_PATH_LENGTH, "%s.compact", data_path) >= JOURNAL_PATH_LENGTH) {
+        free(journal);
+        return NULL;
+    }
+    journal->clock = todo_clock_ms;
+    todo_mutex_init(&journal->lock);
+    todo_cond_init(&journal->wake);
+    todo_cond_init(&journal->drained);
+    return journal;
+}
+
+// Time source for the write delays. Set it before the first load.
+void journal_set_clock(TodoJournal *journal, TodoClock clock, void *context) {
+    journal->clock = clock;
+    journal->clock_context = context;
+}
+
+// Section encoding for checkpoints from now on; call it before
+// journal_load(). Sections in another encoding are converted at the next
+// compaction.
+void journal_set_encoding(TodoJournal *journal, int encoding) {
+    journal->encoding = encoding;
+}
+
+// Make the writer look at the clock again, after a fake clock has moved
+void journal_wake(TodoJournal *journal) {
+    todo_mutex_lock(&journal->lock);
+    todo_cond_signal(&journal->wake);
+    todo_mutex_unlock(&journal->lock);
+}
+
+// Write whatever is queued and let a running compaction finish. Nothing
+// else is written: the journal already holds every change, so an exit
+// with nothing queued touches no file.
+void journal_destroy(TodoJournal *journal, TodoStore *store) {
+    if (journal == NULL) return;
+    stop_writer(journal);
+    wait_for_compaction(journal, store);
+    close_log(journal);
+    todo_cond_destroy(&journal->wake);
+    todo_cond_destroy(&journal->drained);
+    todo_mutex_destroy(&journal->lock);
+    free(journal->pending);
+    free(journal->batch);
+    free(journal);
+}
+
+// Rebuild the store from the checkpoint plus both journal files and start
+// the writer on the log. Returns TODOFMT_OK when any saved data was found.
+int journal_load(TodoJournal *journal, TodoStore *store) {
+    TodoDataFile *file = NULL;
+    uint64_t valid_size = 0;
+    long segment_records, log_records;
+    int status;
+
+    stop_writer(journal);
+    wait_for_compaction(journal, store);
+    close_log(journal);
+    journal->pending_size = 0;
+    journal->batch_size = 0;
+    journal->checkpoint_requested = 0;
+    journal->rewrite_requested = 0;
+    journal->write_status = TODOFMT_OK;
+    journal->retry_at = 0;
+
+    status = todofmt_open(journal->data_path, &file);
+    if (status == TODOFMT_ERR_LEGACY && todofmt_upgrade_legacy(journal->data_path) == TODOFMT_OK) {
+        status = todofmt_open(journal->data_path, &file);
+    }
+    if (status == TODOFMT_OK) {
+        // Checksum the folder sections on every core before listing them
+        todofmt_verify(file, todo_cpu_count());
+        store_attach(store, file);
+    } else if (status == TODOFMT_ERR_MISSING) {
+        store_release(store);
+    } else {
+        return status;
+    }
+
+    segment_records = journal_replay(journal->segment_path, store, NULL);
+    log_records = journal_replay(journal->log_path, store, &valid_size);
+    journal->rewrite_requested = store->quarantined > 0;
+    if (!open_log(journal, valid_size) || !start_writer(journal)) {
+        close_log(journal);
+        return TODOFMT_ERR_IO;
+    }
+
+    // Leftovers from the last session are folded in the background, and
+    // damaged sections are moved aside by the same compaction
+    if (segment_records != 0 || log_records > 0 || store->quarantined > 0) {
+        journal_checkpoint(journal, store);
+    }
+    if (status == TODOFMT_ERR_MISSING && log_records <= 0 && segment_records <= 0) {
+        return TODOFMT_ERR_MISSING;
+    }
+    return TODOFMT_OK;
+}
+
+// Size of the record for entry. Text is cut where the string pool would
+// cut it, so replay rebuilds the same text.
+static size_t record_size(const TodoJournalEntry *entry, size_t length[2]) {
+    for (int i = 0; i < 2; i++) {
+        length[i] = entry->text[i] ? utf8_fit(entry->text[i], strlen(entry->text[i]), JOURNAL_MAX_TEXT) : 0;
+    }
+    return sizeof(TodoJournalRecord) + length[0] + length[1];
+}
+
+// Encode entry as record seq into buffer, returning the bytes written
+static size_t encode_record(unsigned char *buffer, uint64_t seq, const TodoJournalEntry *entry) {
+    TodoJournalRecord record;
+    size_t length[2];
+
+    memset(&record, 0, sizeof(record));
+    record.size = (uint32_t)record_size(entry, length);
+    record.seq = seq;
+    record.op = (uint32_t)entry->op | (uint32_t)JOURNAL_RECORD_VERSION << 24;
+    record.folder_id = entry->folder_id;
+    record.task_index = entry->task_index;
+    record.text_length[0] = (uint16_t)length[0];
+    record.text_length[1] = (uint16_t)length[1];
+
+    memcpy(buffer, &record, sizeof(record));
+    if (length[0]) memcpy(buffer + sizeof(record), entry->text[0], length[0]);
+    if (length[1]) memcpy(buffer + sizeof(record) + length[0], entry->text[1], length[1]);
+    record.checksum = todofmt_crc32c(0, buffer, record.size);
+    memcpy(buffer + offsetof(TodoJournalRecord, checksum), &record.checksum, sizeof(record.checksum));
+    return record.size;
+}
+
+// Records queued for a change that is still being applied, and what the
+// queue looked like before them
+typedef struct {
+    size_t size;
+    uint64_t seq;
+    uint64_t first_queued;
+    uint64_t last_queued;
+} HeldRecords;
+
+// Queue the records for count entries, numbered on from the store's last
+// one, behind a batch header if batch is set. They go to the writer
+// together, so one write holds all of them, but not before
+// release_records() is told their change applied.
+static int queue_records(TodoJournal *journal, TodoStore *store, const TodoJournalEntry *entries, int count,
+                         int batch, HeldRecords *held) {
+    TodoJournalEntry header;
+    unsigned char *buffer;
+    size_t length[2];
+    size_t size = 0;
+    uint64_t seq = store->journal_seq;
+    uint64_t now;
+
+    if (!journal->writer_running) return 0;
+    header.op = JOURNAL_BATCH;
+    header.folder_id = 0;
+    header.task_index = count;
+    header.text[0] = NULL;
+    header.text[1] = NULL;
+    if (batch) size += record_size(&header, length);
+    for (int i = 0; i < count; i++) {
+        size += record_size(&entries[i], length);
+    }
+
+    now = journal->clock(journal->clock_context);
+    todo_mutex_lock(&journal->lock);
+    if (journal->pending_size + size > journal->pending_capacity) {
+        size_t capacity = journal->pending_capacity ? journal->pending_capacity : 4096;
+
+        while (capacity < journal->pending_size + size) capacity *= 2;
+        buffer = (unsigned char *)realloc(journal->pending, capacity);
+        if (buffer == NULL) {
+            todo_mutex_unlock(&journal->lock);
+            return 0;
+        }
+        journal->pending = buffer;
+        journal->pending_capacity = capacity;
+    }
+
+    buffer = journal->pending + journal->pending_size;
+    if (batch) buffer += encode_record(buffer, ++seq, &header);
+    for (int i = 0; i < count; i++) {
+        buffer += encode_record(buffer, ++seq, &entries[i]);
+    }
+
+    held->size = size;
+    held->seq = store->journal_seq;
+    held->first_queued = journal->first_queued;
+    held->last_queued = journal->last_queued;
+    if (journal->pending_size == 0) journal->first_queued = now;
+    journal->last_queued = now;
+    journal->pending_size += size;
+    journal->holding = 1;
+    todo_mutex_unlock(&journal->lock);
+
+    store->journal_seq = seq;
+    return 1;
+}
+
+// Hand the held records to the writer once their change has applied, or
+// take them back off the end of the queue if it did not
+static int release_records(TodoJournal *journal, TodoStore *store, const HeldRecords *held, int applied) {
+    todo_mutex_lock(&journal->lock);
+    if (!applied) {
+        journal->pending_size -= held->size;
+        journal->first_queued = held->first_queued;
+        journal->last_queued = held->last_queued;
+        store->journal_seq = held->seq;
+    }
+    journal->holding = 0;
+    todo_cond_signal(&journal->wake);
+    todo_mutex_unlock(&journal->lock);
+    return applied;
+}
+
+// Apply one operation and queue its record for the writer. The record is
+// encoded before the change applies, while the texts it names are still
+// in the store, but only written if the change applied. Returns 0 without
+// touching the store if there is no open journal, no memory for the
+// record or the change does not apply; write failures are reported later
+// by journal_status().
+int journal_record(TodoJournal *journal, TodoStore *store, const TodoJournalEntry *entry) {
+    HeldRecords held;
+
+    if (!queue_records(journal, store, entry, 1, 0, &held)) return 0;
+    return release_records(journal, store, &held, journal_apply(store, entry));
+}
+
+int journal_record_batch(TodoJournal *journal, TodoStore *store, const TodoJournalEntry *entries, int count) {
+    HeldRecords held;
+
+    if (count <= 0) return count == 0;
+    if (!queue_records(journal, store, entries, count, 1, &held)) return 0;
+    return release_records(journal, store, &held, journal_apply_batch(store, entries, count));
+}
+
+// Block until everything queued so far has been written, or a write has
+// failed. Returns the write status.
+int journal_sync(TodoJournal *journal) {
+    int status;
+
+    todo_mutex_lock(&journal->lock);
+    if (journal->writer_running) {
+        uint64_t attempts = journal->attempts;
+
+        if (journal->pending_size > 0 || journal->batch_size > 0) {
+            journal->flush_now = 1;
+            journal->retry_at = 0;
+            todo_cond_signal(&journal->wake);
+        }
+        while ((journal->pending_size > 0 || journal->batch_size > 0) &&
+               (journal->write_status == TODOFMT_OK || journal->attempts == attempts)) {
+            todo_cond_wait(&journal->drained, &journal->lock, TODO_WAIT_FOREVER);
+        }
+    }
+    status = journal->write_status;
+    todo_mutex_unlock(&journal->lock);
+    return status;
+}
+
+// TODOFMT_OK unless the last attempt to write queued records failed; they
+// stay queued and are retried
+int journal_status(TodoJournal *journal) {
+    int status;
+
+    todo_mutex_lock(&journal->lock);
+    status = journal->write_status;
+    todo_mutex_unlock(&journal->lock);
+    return status;
+}
+
+// Ask the writer to fold the journal into a new checkpoint once everything
+// queued is written. Never blocks.
+int journal_checkpoint(TodoJournal *journal, TodoStore *store) {
+    journal_poll(journal, store);
+    if (!journal->writer_running) return 0;
+
+    todo_mutex_lock(&journal->lock);
+    journal->checkpoint_requested = 1;
+    if (journal->pending_size > 0 || journal->batch_size > 0) {
+        journal->flush_now = 1;
+    }
+    todo_cond_signal(&journal->wake);
+    todo_mutex_unlock(&journal->lock);
+    return 1;
+}
+
+// Install a checkpoint the worker has finished. Never blocks.
+void journal_poll(TodoJournal *journal, TodoStore *store) {
+    int done;
+
+    todo_mutex_lock(&journal->lock);
+    done = journal->compacting && journal->worker_done;
+    todo_mutex_unlock(&journal->lock);
+    if (done) {
+        finish_compaction(journal, store);
+    }
+}
@@ -0,0 +1,126 @@
+#ifndef TODO_JOURNAL_H
+#define TODO_JOURNAL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "todo_core.h"
+#include "todo_tags.h"
+#include "todo_thread.h"
+
+// Operation journal.
+//
+// Every mutation becomes one small checksummed record in todo_data.jnl, so
+// saving costs the size of the change instead of a rewrite of
+// todo_data.dat. On startup the journal is replayed on top of the last
+// checkpoint. Once it grows past JOURNAL_COMPACT_BYTES it is rotated to
+// todo_data.jnl.1 and a background thread folds that segment into a new
+// checkpoint, written to a temporary file, flushed and renamed into place.
+// Records carry increasing sequence numbers and the checkpoint header
+// stores the last one it contains, so a crash at any point during
+// compaction replays each record at most once.
+//
+// The UI thread never touches the disk after loading. A change is applied
+// at once and its record queued; a writer thread appends the queue with
+// one write and one flush once edits pause for JOURNAL_QUIET_MS, or at
+// most JOURNAL_MAX_DELAY_MS after the first queued edit. A burst of edits
+// costs one flush, and a crash loses at most that window. Failed writes
+// stay queued and are retried every JOURNAL_RETRY_MS.
+//
+// Loading checksums the checkpoint's folder sections on every core. Folders
+// whose section is damaged come up empty (TodoStore.quarantined), and the
+// next compaction appends the damaged bytes to todo_data.dat.damaged before
+// writing a checkpoint without them.
+
+#define JOURNAL_COMPACT_BYTES (64 * 1024)
+#define JOURNAL_MAX_TEXT STRPOOL_MAX_LENGTH
+#define JOURNAL_QUIET_MS 250
+#define JOURNAL_MAX_DELAY_MS 2000
+#define JOURNAL_RETRY_MS 5000
+#define JOURNAL_SCHEDULE_LENGTH (RECUR_SCHEDULE_LENGTH + 3 + 2 * TAGS_TEXT_LENGTH)
+
+enum {
+    JOURNAL_CREATE_LIST = 1,
+    JOURNAL_DELETE_LIST,
+    JOURNAL_ADD_TASK,
+    JOURNAL_COMPLETE_TASK,
+    JOURNAL_DELETE_TASK,
+    JOURNAL_REOPEN_TASK,
+    JOURNAL_RESTORE_TASK,   // Add a task that is already completed
+    JOURNAL_TAG_TASK,       // Replace a task's tags with those in text[1]
+    JOURNAL_BATCH           // Header: the next task_index records apply as one
+};
+
+// Records are written as version JOURNAL_RECORD_VERSION, kept in the top
+// byte of op, and checksummed with CRC32C (todofmt_crc32c()). Version 0
+// records, checksummed with CRC-32, are still replayed; the checkpoint
+// that follows loading them leaves none behind.
+#define JOURNAL_RECORD_VERSION 1
+#define JOURNAL_OP_MASK 0x00FFFFFFu
+
+// On-disk record header, followed by text_length[0] + text_length[1] bytes
+typedef struct {
+    uint32_t size;          // Whole record including this header
+    uint32_t checksum;      // Of the record with this field zeroed; see journal_record_checksum()
+    uint64_t seq;
+    uint32_t op;            // JOURNAL_*, with the record version in the top byte
+    uint32_t folder_id;
+    int32_t task_index;
+    uint16_t text_length[2];
+} TodoJournalRecord;
+
+typedef char journal_record_size_check[sizeof(TodoJournalRecord) == 32 ? 1 : -1];
+
+// One operation. text[0] is the list name or task description, text[1] the
+// deadline and, for a repeating task, its rule (see recur_format_schedule()).
+// Adding a task with a priority puts "!N " (N a PRIORITY_* value) first,
+// then each of its tags as "#name ". Complete/reopen/delete/tag carry both
+// so replay can verify the target. task_index is the task's position for
+// complete, delete and tag; for the other ops it is where to put the list
+// or task back (used by undo), or -1 for the default place. In a batch,
+// positions are those before the batch.
+typedef struct {
+    int op;
+    uint32_t folder_id;
+    int task_index;
+    const char *text[2];
+} TodoJournalEntry;
+
+typedef struct TodoJournal TodoJournal;
+
+TodoJournal *journal_create(const char *data_path);
+void journal_destroy(TodoJournal *journal, TodoStore *store);
+int journal_load(TodoJournal *journal, TodoStore *store);
+int journal_record(TodoJournal *journal, TodoStore *store, const TodoJournalEntry *entry);
+// Task operations across any folders, applied all or nothing with
+// store_apply_batch(). The records are queued together and replay applies
+// them only if every one of them made it to disk.
+int journal_record_batch(TodoJournal *journal, TodoStore *store, const TodoJournalEntry *entries, int count);
+int journal_checkpoint(TodoJournal *journal, TodoStore *store);
+void journal_poll(TodoJournal *journal, TodoStore *store);
+int journal_sync(TodoJournal *journal);
+int journal_status(TodoJournal *journal);
+void journal_set_clock(TodoJournal *journal, TodoClock clock, void *context);
+void journal_set_encoding(TodoJournal *journal, int encoding);
+void journal_wake(TodoJournal *journal);
+
+// Building blocks, usable without a TodoJournal
+int journal_apply(TodoStore *store, const TodoJournalEntry *entry);
+// Each entry's target is found before any of them applies; fails if one
+// is missing
+int journal_apply_batch(TodoStore *store, const TodoJournalEntry *entries, int count);
+long journal_replay(const char *path, TodoStore *store, uint64_t *valid_size);
+int journal_compact(const char *data_path, const char *segment_path, const char *out_path, int encoding);
+// The checksum a record's version calls for, of size bytes with the
+// checksum field zeroed
+uint32_t journal_record_checksum(const void *record, size_t size);
+int32_t journal_entry_deadline(const TodoJournalEntry *entry);
+void journal_entry_repeat(const TodoJournalEntry *entry, TodoRecurrence *rule);
+int journal_entry_priority(const TodoJournalEntry *entry);
+// Canonical tags; "" when there are none
+void journal_entry_tags(const TodoJournalEntry *entry, char out[TAGS_TEXT_LENGTH]);
+// tags must be canonical, or NULL for none
+void journal_format_schedule(int32_t deadline_day, const TodoRecurrence *rule, int priority, const char *tags,
+                             char out[JOURNAL_SCHEDULE_LENGTH]);
+int journal_locate_task(const TodoStore *store, const Folder *folder, const TodoJournalEntry *entry);
+
+#endif
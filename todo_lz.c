@@ -0,0 +1,141 @@
+#include "todo_lz.h"
+
+#include <string.h>
+
+#define HASH_BITS 14
+#define SKIP_SHIFT 6    // Probe less often the longer nothing matches
+
+static uint32_t hash4(const unsigned char *p) {
+    uint32_t value;
+
+    memcpy(&value, p, sizeof(value));
+    return (value * 2654435761u) >> (32 - HASH_BITS);
+}
+
+size_t lz_bound(size_t size) {
+    return size + size / 255 + 16;
+}
+
+static unsigned char *put_length(unsigned char *op, size_t length) {
+    while (length >= 255) {
+        *op++ = 255;
+        length -= 255;
+    }
+    *op++ = (unsigned char)length;
+    return op;
+}
+
+// Write one sequence; match is 0 for the final, literal-only one. Returns
+// NULL if it does not fit.
+static unsigned char *emit(unsigned char *op, const unsigned char *op_end, const unsigned char *literals,
+                           size_t literal_length, size_t distance, size_t match) {
+    size_t need = 1 + literal_length + literal_length / 255 + 1;
+    unsigned char *token;
+
+    if (match) need += 2 + (match - LZ_MIN_MATCH) / 255 + 1;
+    if ((size_t)(op_end - op) < need) return NULL;
+
+    token = op++;
+    *token = (unsigned char)((literal_length >= 15 ? 15 : literal_length) << 4);
+    if (literal_length >= 15) op = put_length(op, literal_length - 15);
+    memcpy(op, literals, literal_length);
+    op += literal_length;
+
+    if (match) {
+        size_t extra = match - LZ_MIN_MATCH;
+
+        *token |= (unsigned char)(extra >= 15 ? 15 : extra);
+        op[0] = (unsigned char)(distance & 0xFF);
+        op[1] = (unsigned char)(distance >> 8);
+        op += 2;
+        if (extra >= 15) op = put_length(op, extra - 15);
+    }
+    return op;
+}
+
+size_t lz_compress(const void *src, size_t size, void *dst, size_t capacity) {
+    uint32_t table[1 << HASH_BITS];     // Last position + 1 seen with each hash
+    const unsigned char *in = (const unsigned char *)src;
+    const unsigned char *end = in + size;
+    const unsigned char *limit = size >= LZ_MIN_MATCH ? end - LZ_MIN_MATCH : in;
+    const unsigned char *ip = in;
+    const unsigned char *anchor = in;
+    unsigned char *out = (unsigned char *)dst;
+    unsigned char *op = out;
+    const unsigned char *op_end = out + capacity;
+
+    memset(table, 0, sizeof(table));
+    while (ip <= limit && size >= LZ_MIN_MATCH) {
+        uint32_t hash = hash4(ip);
+        uint32_t candidate = table[hash];
+        size_t position = (size_t)(ip - in);
+
+        table[hash] = (uint32_t)position + 1;
+        if (candidate != 0 && position - (candidate - 1) <= LZ_WINDOW &&
+            memcmp(in + candidate - 1, ip, LZ_MIN_MATCH) == 0) {
+            const unsigned char *match = in + candidate - 1;
+            size_t length = LZ_MIN_MATCH;
+
+            while (ip + length < end && match[length] == ip[length]) length++;
+            op = emit(op, op_end, anchor, (size_t)(ip - anchor), (size_t)(ip - match), length);
+            if (op == NULL) return 0;
+            ip += length;
+            anchor = ip;
+        } else {
+            ip += 1 + ((size_t)(ip - anchor) >> SKIP_SHIFT);
+        }
+    }
+
+    op = emit(op, op_end, anchor, (size_t)(end - anchor), 0, 0);
+    return op ? (size_t)(op - out) : 0;
+}
+
+// Add up length bytes until one is below 255
+static int get_length(const unsigned char **ip, const unsigned char *ip_end, size_t *length) {
+    unsigned char byte;
+
+    do {
+        if (*ip >= ip_end) return 0;
+        byte = *(*ip)++;
+        *length += byte;
+    } while (byte == 255);
+    return 1;
+}
+
+int lz_decompress(const void *src, size_t size, void *dst, size_t decoded_size) {
+    const unsigned char *ip = (const unsigned char *)src;
+    const unsigned char *ip_end = ip + size;
+    unsigned char *out = (unsigned char *)dst;
+    unsigned char *op = out;
+    unsigned char *op_end = out + decoded_size;
+
+    while (ip < ip_end) {
+        unsigned token = *ip++;
+        size_t literal_length = token >> 4;
+        size_t distance, match;
+
+        if (literal_length == 15 && !get_length(&ip, ip_end, &literal_length)) return 0;
+        if (literal_length > (size_t)(ip_end - ip) || literal_length > (size_t)(op_end - op)) return 0;
+        memcpy(op, ip, literal_length);
+        op += literal_length;
+        ip += literal_length;
+        if (ip == ip_end) break;    // The final sequence has no match
+
+        if (ip_end - ip < 2) return 0;
+        distance = (size_t)ip[0] | ((size_t)ip[1] << 8);
+        ip += 2;
+        match = token & 15;
+        if (match == 15 && !get_length(&ip, ip_end, &match)) return 0;
+        match += LZ_MIN_MATCH;
+        if (distance == 0 || distance > (size_t)(op - out) || match > (size_t)(op_end - op)) return 0;
+
+        // Overlapping copies repeat the last distance bytes
+        if (distance >= match) {
+            memcpy(op, op - distance, match);
+        } else {
+            for (size_t i = 0; i < match; i++) op[i] = op[i - distance];
+        }
+        op += match;
+    }
+    return op == op_end;
+}
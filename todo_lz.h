@@ -0,0 +1,34 @@
+#ifndef TODO_LZ_H
+#define TODO_LZ_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Byte-oriented LZ77 block codec in the style of LZ4, used for the text
+// column of the data file.
+//
+// A block is a run of sequences. Each starts with a token byte: the high
+// four bits count literals and the low four bits a match length minus
+// LZ_MIN_MATCH, where 15 means more length bytes follow (each adds up to
+// 255, the first one below 255 ends it). The literals come next, then the
+// match as a two-byte little-endian distance back into the output (1 to
+// LZ_WINDOW). The last sequence has literals only. Compression is greedy
+// with a single hash probe, which keeps it at memory-copy speeds;
+// decompression checks every length and distance against both buffers, so
+// damaged input fails instead of reading or writing out of bounds.
+
+#define LZ_MIN_MATCH 4
+#define LZ_WINDOW 65535
+
+// Largest compressed size of size bytes
+size_t lz_bound(size_t size);
+
+// Compress into dst; returns the compressed size, or 0 if it does not fit
+// in capacity
+size_t lz_compress(const void *src, size_t size, void *dst, size_t capacity);
+
+// Decompress a whole block; returns 1 only if it decodes to exactly
+// decoded_size bytes
+int lz_decompress(const void *src, size_t size, void *dst, size_t decoded_size);
+
+#endif
@@ -1,14 +1,27 @@
 #include <windows.h>
 #include <commctrl.h>
+#include <io.h>
 #include <time.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
-#pragma comment(lib, "comctl32.lib")
+#include "todo_core.h"
+#include "todo_format.h"
+#include "todo_journal.h"
+#include "todo_batch.h"
+#include "todo_due.h"
+#include "todo_view.h"
+#include "todo_search.h"
+#include "todo_sort.h"
+#include "todo_tags.h"
+#include "todo_query.h"
+#include "todo_history.h"
+#include "todo_remind.h"
+#include "todo_stats.h"
+#include "todo_trace.h"
 
-#define MAX_TASKS 50
-#define MAX_LENGTH 100
-#define MAX_FOLDERS 20
+#pragma comment(lib, "comctl32.lib")
 
 // Control IDs
 #define IDC_LISTBOX_FOLDERS 1001
@@ -24,24 +37,91 @@
 #define IDC_EDIT_TASK_DESC 1011
 #define IDC_EDIT_DEADLINE 1012
 #define IDC_STATIC_CURRENT 1013
+#define IDC_EDIT_SEARCH 1014
+#define IDC_BTN_UNDO 1015
+#define IDC_BTN_REDO 1016
+#define IDC_EDIT_REPEAT 1017
+#define IDC_COMBO_SORT 1018
+#define IDC_COMBO_PRIORITY 1019
+#define IDC_EDIT_TAGS 1020
+#define IDC_BTN_TAG_TASK 1021
+#define IDC_BTN_MOVE_TASKS 1022
+#define IDC_BTN_CLEAR_DONE 1023
+#define IDC_BTN_SAVE_QUERY 1024
 
-// Data structures
-typedef struct {
-    char description[MAX_LENGTH];
-    char deadline[20];
-    int completed;
-    time_t deadline_time;
-} Task;
+#define IDT_JOURNAL 1
+#define IDT_MIDNIGHT 2
+#define IDT_LOAD 3
+
+// Posted by the reminder worker: lParam is a copy of the TodoReminder, which
+// the window frees
+#define WM_APP_REMINDER (WM_APP + 1)
+
+// Time per timer tick spent loading the lists that are not loaded yet, and
+// the time between those ticks
+#define LOAD_SLICE_MS 20
+#define LOAD_INTERVAL_MS 50
+
+// A batch touching more tasks than this refills the task list rather than
+// editing it row by row
+#define BATCH_REFILL_TASKS 32
+
+#define WINDOW_TITLE "To-Do List Manager (C + Assembly)"
+#define DATA_FILE "todo_data.dat"
+#define TRACE_FILE "todo_trace.json"
+#define QUERIES_FILE "todo_queries.txt"
+#define QUERIES_TEMP_FILE "todo_queries.txt.tmp"
+#define QUERY_LINE_LENGTH 4096   // Longer saved queries are skipped on load
+
+TodoStore store;
+TodoJournal *journal;
+int columnar_sections;   // Checkpoints use TODOFMT_COLUMNAR
+int32_t today;   // Snapshot every task row is classified against
+TodoView folder_view;
+TodoView task_view;
+TodoSearchIndex *search;
+TodoTagIndex *tag_index;
+TodoQueryIndex *query_index;
+TodoHistory *history;
+TodoReminders *reminders;
+TodoStats *stats;   // Folder row counts and the title's overall ones
+int showing_reminder;   // A reminder box is open
+int missed_reminders;   // Reminders that came in while it was
+const int reminder_days[] = {1, 0};     // Remind a day ahead and on the day itself
+
+// Task list filter and order; while either is set, rows map to tasks
+// through filter_rows. Search text starting with a tag is a tag filter
+// (tag_filter) when it parses as one, and text naming a field is a query
+// (filter_query).
+int filtering;
+int task_order;     // SORT_PRESET_*; SORT_PRESET_DEADLINE is the folder order
+char *filter_text;
+TodoTagFilter *tag_filter;
+TodoBitmap tag_matches;
+TodoQuery *filter_query;
+TodoQueryResult query_matches;
+int *filter_rows;
+int filter_count;
+int filter_capacity;
 
+// Saved queries, listed after the folders as smart lists and kept in
+// QUERIES_FILE, one "name<TAB>query" per line. While one is on screen
+// store.current_folder is -1 and the task list rows are smart_tasks.
 typedef struct {
-    char name[MAX_LENGTH];
-    Task tasks[MAX_TASKS];
-    int task_count;
-} Folder;
+    char *name;
+    char *text;
+    TodoQuery *query;
+} SmartList;
 
-Folder folders[MAX_FOLDERS];
-int folder_count = 0;
-int current_folder = -1;
+SmartList *smart_lists;
+int smart_count;
+int smart_capacity;
+int current_smart = -1;
+TodoQueryResult smart_tasks;
+
+// Handle of the selected task, so the selection follows it when its row
+// moves; 0 if none
+uint32_t selected_task;
 
 // Global window handles
 HWND hwndMain;
@@ -49,371 +129,1089 @@ HWND hwndFolderList;
 HWND hwndTaskList;
 HWND hwndCurrentLabel;
 
-// Assembly functions
-int asm_add(int a, int b) {
-    int result;
-#if defined(_MSC_VER)
-    __asm {
-        mov eax, a
-        add eax, b
-        mov result, eax
-    }
-#elif defined(__GNUC__)
-    __asm__ (
-        "movl %1, %%eax\n\t"
-        "addl %2, %%eax\n\t"
-        "movl %%eax, %0\n\t"
-        : "=r" (result)
-        : "r" (a), "r" (b)
-        : "%eax"
-    );
-#else
-    result = a + b;
-#endif
-    return result;
+int journal_failing;    // A write error has been reported and not yet cleared
+
+// File I/O functions
+// Every change is already queued for the journal, so saving only asks for
+// it to be folded into todo_data.dat. That happens on background threads;
+// the window never waits for the disk.
+void save_data() {
+    if (!journal_checkpoint(journal, &store)) {
+        MessageBox(hwndMain, "Error: Could not save data to file!", "Save Error", MB_OK | MB_ICONERROR);
+    }
 }
 
-int asm_subtract(int a, int b) {
-    int result;
-#if defined(_MSC_VER)
-    __asm {
-        mov eax, a
-        sub eax, b
-        mov result, eax
-    }
-#elif defined(__GNUC__)
-    __asm__ (
-        "movl %1, %%eax\n\t"
-        "subl %2, %%eax\n\t"
-        "movl %%eax, %0\n\t"
-        : "=r" (result)
-        : "r" (a), "r" (b)
-        : "%eax"
-    );
-#else
-    result = a - b;
-#endif
-    return result;
+// Report journal write errors once, from the timer
+void CheckJournal() {
+    int failing;
+
+    journal_poll(journal, &store);
+    failing = journal_status(journal) != TODOFMT_OK;
+    if (failing && !journal_failing) {
+        journal_failing = 1;
+        MessageBox(hwndMain, "Error: Changes could not be written to 'todo_data.jnl'.\n\n"
+                   "They are kept in memory and will be retried.", "Save Error", MB_OK | MB_ICONERROR);
+    }
+    journal_failing = failing;
+}
+
+// Lists are loaded on first selection, but smart lists need every task:
+// load the rest a slice at a time from the timer while one is on screen.
+// Returns 0 once every list is loaded.
+int LoadRemainingFolders() {
+    uint64_t started = todo_clock_ms(NULL);
+
+    for (int i = 0; i < store.folder_count; i++) {
+        if (store.folders[i].loaded) continue;
+        if (todo_clock_ms(NULL) - started >= LOAD_SLICE_MS) return 1;
+        store_materialize(&store, i);
+    }
+    return 0;
+}
+
+int FoldersPending() {
+    for (int i = 0; i < store.folder_count; i++) {
+        if (!store.folders[i].loaded) return 1;
+    }
+    return 0;
 }
 
-int asm_increment(int a) {
+int load_data() {
+    uint64_t started = TRACE_BEGIN();
+    int loaded = 0;
+
+    // Checkpoint plus journal replay; version 1.0 files are converted once
+    if (journal_load(journal, &store) == TODOFMT_OK) {
+        store_materialize(&store, store.current_folder);
+        loaded = 1;
+    }
+
+    // Lists whose part of the file failed its checksum load empty
+    if (store.quarantined > 0) {
+        char msg[256];
+        sprintf(msg, "%d list(s) in 'todo_data.dat' are damaged and were loaded empty.\n\n"
+                "Their damaged contents are kept in 'todo_data.dat.damaged'.", store.quarantined);
+        MessageBox(hwndMain, msg, "Load Warning", MB_OK | MB_ICONWARNING);
+    }
+    trace_end(TRACE_LOAD, started, (uint64_t)store.folder_count);
+    return loaded; // 0: no saved data
+}
+
+// Text handling. The store keeps UTF-8; the edit boxes, listboxes and
+// labels that show user text are Unicode controls and take UTF-16.
+
+// UTF-8 to UTF-16; wide holds count characters and invalid bytes become U+FFFD
+void Widen(const char *text, WCHAR *wide, int count) {
+    if (MultiByteToWideChar(CP_UTF8, 0, text, -1, wide, count) == 0) {
+        wide[0] = 0;
+    }
+}
+
+// Widen into a new buffer; the caller frees it
+WCHAR *WidenCopy(const char *text) {
+    int count = MultiByteToWideChar(CP_UTF8, 0, text, -1, NULL, 0);
+    WCHAR *wide = (WCHAR *)malloc((count > 0 ? count : 1) * sizeof(WCHAR));
+
+    if (wide != NULL) Widen(text, wide, count > 0 ? count : 1);
+    return wide;
+}
+
+// A copy the caller frees, or NULL when out of memory
+char *CopyText(const char *text) {
+    size_t size = strlen(text) + 1;
+    char *copy = (char *)malloc(size);
+
+    if (copy != NULL) memcpy(copy, text, size);
+    return copy;
+}
+
+// Contents of an edit box as UTF-8, however long; the caller frees it.
+// Returns NULL if it is empty.
+char *GetEditText(int id) {
+    HWND edit = GetDlgItem(hwndMain, id);
+    int length = GetWindowTextLengthW(edit);
+    WCHAR *wide;
+    char *text = NULL;
+    int size;
+
+    if (length <= 0) return NULL;
+    wide = (WCHAR *)malloc((length + 1) * sizeof(WCHAR));
+    if (wide == NULL) return NULL;
+    length = GetWindowTextW(edit, wide, length + 1);
+    size = WideCharToMultiByte(CP_UTF8, 0, wide, length + 1, NULL, 0, NULL, NULL);
+    if (length > 0 && size > 0 && (text = (char *)malloc(size)) != NULL) {
+        WideCharToMultiByte(CP_UTF8, 0, wide, length + 1, text, size, NULL, NULL);
+    }
+    free(wide);
+    return text;
+}
+
+// MessageBox for text that may hold user content
+int MessageBoxText(const char *text, const char *caption, UINT type) {
+    WCHAR *wide = WidenCopy(text);
+    WCHAR wide_caption[64];
     int result;
-#if defined(_MSC_VER)
-    __asm {
-        mov eax, a
-        inc eax
-        mov result, eax
-    }
-#elif defined(__GNUC__)
-    __asm__ (
-        "movl %1, %%eax\n\t"
-        "incl %%eax\n\t"
-        "movl %%eax, %0\n\t"
-        : "=r" (result)
-        : "r" (a)
-        : "%eax"
-    );
-#else
-    result = a + 1;
-#endif
+
+    Widen(caption, wide_caption, 64);
+    result = MessageBoxW(hwndMain, wide ? wide : L"", wide_caption, type);
+    free(wide);
     return result;
 }
 
-// Simplified date validation function
-int validate_date(const char *date_str, int *year, int *month, int *day) {
-    // Check format first
-    if (strlen(date_str) != 10 || date_str[4] != '-' || date_str[7] != '-') {
-        return 0;
+// Queue operations for the journal and apply them to the store; more than
+// one go in as a batch
+int ApplyEntries(void *context, const TodoJournalEntry *entries, int count) {
+    int ok;
+
+    if (count == 1) {
+        ok = journal_record(journal, &store, entries);
+    } else {
+        ok = journal_record_batch(journal, &store, entries, count);
     }
-    
-    // Parse the date
-    if (sscanf(date_str, "%d-%d-%d", year, month, day) != 3) {
+    if (!ok) {
+        MessageBox(hwndMain, "Error: Could not record the change!", "Save Error", MB_OK | MB_ICONERROR);
         return 0;
     }
-    
-    // Validate year (must be 4 digits)
-    if (*year < 1000 || *year > 9999) {
-        return 0;
+    if (count > BATCH_REFILL_TASKS) view_mark_stale(&task_view);
+    return 1;
+}
+
+// Apply a change made by the user and make it the newest undo step
+int RecordChange(int op, uint32_t folder_id, int task_index, const char *text, const char *deadline) {
+    TodoJournalEntry entry;
+    TodoHistoryCommand *command = NULL;
+
+    entry.op = op;
+    entry.folder_id = folder_id;
+    entry.task_index = task_index;
+    entry.text[0] = text;
+    entry.text[1] = deadline;
+
+    // The inverse has to be worked out before the change is applied
+    if (!history_add(&command, &store, &entry)) {
+        // Out of memory: the change still goes through but cannot be undone
+        history_free_command(command);
+        command = NULL;
     }
-    
-    // Validate month (1-12)
-    if (*month < 1 || *month > 12) {
+    history_prepare(history, &store, command);
+    if (!ApplyEntries(NULL, &entry, 1)) {
+        history_free_command(command);
         return 0;
     }
-    
-    // Validate day (1-31)
-    if (*day < 1 || *day > 31) {
+    history_push(history, command);
+    return 1;
+}
+
+// GUI Update functions
+// Both listboxes mirror a TodoView. Store changes are forwarded to the views
+// as they happen, and RefreshLists() applies only the rows that changed.
+
+// View model callbacks
+// The smart lists' rows follow the folders'
+void FormatFolderRow(void *context, int row, char *text) {
+    if (row >= store.folder_count) {
+        const char *name = smart_lists[row - store.folder_count].name;
+        int shown = (int)utf8_fit(name, strlen(name), VIEW_TEXT_LENGTH - 16);
+
+        snprintf(text, VIEW_TEXT_LENGTH, "%.*s (smart list)", shown, name);
+        return;
+    }
+    view_format_folder(&store, &store.folders[row], stats ? stats_folder(stats, row) : NULL, text);
+}
+
+// Do task list rows map to tasks through filter_rows?
+int RowsMapped() {
+    return filtering || task_order != SORT_PRESET_DEADLINE;
+}
+
+// Task index shown on a task list row
+int TaskAtRow(int row) {
+    return RowsMapped() ? filter_rows[row] : row;
+}
+
+void FormatTaskRow(void *context, int row, char *text) {
+    const Task *task = current_smart >= 0 ? store_find_task(&store, smart_tasks.tasks[row])
+                                          : store_task(&store, &store.folders[store.current_folder], TaskAtRow(row));
+    view_format_task(&store, task, due_state(task, today), text);
+}
+
+int MeasureRow(void *context, const char *text) {
+    HWND list = (HWND)context;
+    HDC hdc = GetDC(list);
+    WCHAR wide[VIEW_TEXT_LENGTH];
+    SIZE size;
+
+    Widen(text, wide, VIEW_TEXT_LENGTH);
+    GetTextExtentPoint32W(hdc, wide, (int)wcslen(wide), &size);
+    ReleaseDC(list, hdc);
+    return size.cx;
+}
+
+// Does a task of the list on screen pass the search box? Tag filters and
+// plain text are checked on the task alone; a query is run over the list,
+// whose index has already seen the change.
+int TaskPassesFilter(const Folder *folder, const Task *task) {
+    if (!filtering) return 1;
+    if (filter_query != NULL) {
+        query_run(query_index, filter_query, folder->id, today, &query_matches);  // Empty when out of memory
+        for (size_t i = 0; i < query_matches.count; i++) {
+            if (query_matches.tasks[i] == task->id) return 1;
+        }
         return 0;
     }
-    
-    return 1; // Valid date
+    if (tag_filter != NULL) {
+        return tags_filter_matches(tag_filter, store_text(&store, task->tags), task->tags.length, task->completed);
+    }
+    return search_text_matches(store_text(&store, task->description), task->description.length, filter_text,
+                               SEARCH_SUBSTRING);
 }
 
-// Parse date string to time_t
-time_t parse_date(const char *date_str) {
-    struct tm tm = {0};
-    int year, month, day;
-    
-    if (validate_date(date_str, &year, &month, &day)) {
-        tm.tm_year = year - 1900;
-        tm.tm_mon = month - 1;
-        tm.tm_mday = day;
-        tm.tm_hour = 0;   // Start of day for accurate date comparison
-        tm.tm_min = 0;
-        tm.tm_sec = 0;
-        tm.tm_isdst = -1; // Let system determine DST
-        return mktime(&tm);
+// Row a task of the list on screen belongs on. filter_rows is in the chosen
+// order with ties in folder order, as sort_rows() leaves them.
+int MappedRowFor(const Folder *folder, int task) {
+    TodoSortOrder order = sort_preset(task_order);
+    int sorted = task_order != SORT_PRESET_DEADLINE;
+    uint64_t key = sorted ? sort_key(&order, store_task(&store, folder, task)) : 0;
+    int low = 0, high = filter_count;
+
+    while (low < high) {
+        int middle = (low + high) / 2;
+        uint64_t other = sorted ? sort_key(&order, store_task(&store, folder, filter_rows[middle])) : 0;
+
+        if (other < key || (other == key && filter_rows[middle] < task)) {
+            low = middle + 1;
+        } else {
+            high = middle;
+        }
     }
-    return 0;
+    return low;
 }
 
-// Check if a task is overdue (strictly after deadline date)
-int is_overdue(time_t deadline_time) {
-    if (deadline_time == 0) return 0;
-    
-    time_t now = time(NULL);
-    
-    // Convert both times to date structures
-    struct tm *now_tm = localtime(&now);
-    if (!now_tm) return 0;
-    
-    // Store current date components
-    int now_year = now_tm->tm_year;
-    int now_month = now_tm->tm_mon;
-    int now_day = now_tm->tm_mday;
-    
-    // Get deadline date components
-    struct tm *deadline_tm = localtime(&deadline_time);
-    if (!deadline_tm) return 0;
-    
-    int deadline_year = deadline_tm->tm_year;
-    int deadline_month = deadline_tm->tm_mon;
-    int deadline_day = deadline_tm->tm_mday;
-    
-    // Compare dates: current date must be STRICTLY greater than deadline
-    // Year comparison
-    if (now_year > deadline_year) return 1;
-    if (now_year < deadline_year) return 0;
-    
-    // Month comparison (same year)
-    if (now_month > deadline_month) return 1;
-    if (now_month < deadline_month) return 0;
-    
-    // Day comparison (same year and month)
-    if (now_day > deadline_day) return 1;
-    
-    return 0;  // Same day or future date - not overdue
+// Map a task change in the list on screen through filter_rows: the task
+// indexes it moves past shift by one, and only the changed task's row is
+// inserted, removed, moved or updated
+void FollowMappedTask(const TodoStoreChange *change) {
+    Folder *current = &store.folders[store.current_folder];
+    int from = -1;      // The task's row before the change, if it had one
+    int first, last, shift;
+
+    if (task_view.stale) return;    // Filtered again when it is rebuilt
+
+    if (change->kind != STORE_TASK_ADDED) {
+        for (int row = 0; row < filter_count && from < 0; row++) {
+            if (filter_rows[row] == change->task) from = row;
+        }
+        if (from >= 0) {
+            memmove(&filter_rows[from], &filter_rows[from + 1], (size_t)(filter_count - from - 1) * sizeof(int));
+            filter_count--;
+        }
+    }
+
+    // Tasks between the old and the new index move up or down one
+    if (change->kind == STORE_TASK_ADDED) {
+        first = change->position;
+        last = current->task_count;
+        shift = 1;
+    } else if (change->kind == STORE_TASK_REMOVED) {
+        first = change->task + 1;
+        last = current->task_count + 1;
+        shift = -1;
+    } else if (change->task < change->position) {
+        first = change->task + 1;
+        last = change->position;
+        shift = -1;
+    } else {
+        first = change->position;
+        last = change->task - 1;
+        shift = 1;
+    }
+    for (int row = 0; row < filter_count; row++) {
+        if (filter_rows[row] >= first && filter_rows[row] <= last) filter_rows[row] += shift;
+    }
+
+    if (change->kind != STORE_TASK_REMOVED &&
+        TaskPassesFilter(current, store_task(&store, current, change->position))) {
+        int to;
+
+        if (filter_count == filter_capacity) {
+            int capacity = filter_capacity ? filter_capacity * 2 : 64;
+            int *grown = (int *)realloc(filter_rows, (size_t)capacity * sizeof(int));
+
+            if (grown == NULL) {
+                view_mark_stale(&task_view);
+                return;
+            }
+            filter_rows = grown;
+            filter_capacity = capacity;
+        }
+        to = MappedRowFor(current, change->position);
+        memmove(&filter_rows[to + 1], &filter_rows[to], (size_t)(filter_count - to) * sizeof(int));
+        filter_rows[to] = change->position;
+        filter_count++;
+        if (from < 0) {
+            view_insert(&task_view, to);
+        } else if (from == to) {
+            view_update(&task_view, to);
+        } else {
+            view_move(&task_view, from, to);
+        }
+    } else if (from >= 0) {
+        view_remove(&task_view, from);
+    }
 }
 
-// Compare function for sorting tasks
-int compare_tasks(const void *a, const void *b) {
-    const Task *taskA = (const Task *)a;
-    const Task *taskB = (const Task *)b;
-    
-    if (taskA->completed && !taskB->completed) return 1;
-    if (!taskA->completed && taskB->completed) return -1;
-    
-    if (taskA->deadline_time > taskB->deadline_time) return 1;
-    if (taskA->deadline_time < taskB->deadline_time) return -1;
+void OnStoreChange(void *context, const TodoStoreChange *change) {
+    if (change->kind == STORE_RESET) {
+        selected_task = 0;  // Handles from before a load may be reused
+        current_smart = -1; // The load picks the list on screen
+    }
+    view_follow_folders(&folder_view, change);
+    if (current_smart >= 0) {
+        // Any task may start or stop matching; the query is run again
+        if (change->kind != STORE_FOLDER_ADDED) view_mark_stale(&task_view);
+    } else if (change->kind == STORE_FOLDER_REMOVED && store.current_folder == -1) {
+        // The list on screen was deleted
+        view_mark_stale(&task_view);
+    } else if (!RowsMapped()) {
+        view_follow_tasks(&task_view, change, store.current_folder);
+    } else if (change->folder == store.current_folder && (change->kind == STORE_TASK_ADDED ||
+               change->kind == STORE_TASK_MOVED || change->kind == STORE_TASK_REMOVED)) {
+        FollowMappedTask(change);
+    } else if (change->kind == STORE_RESET || change->folder == store.current_folder) {
+        // A load, or the list on screen was loaded: filter and sort it again
+        view_mark_stale(&task_view);
+    }
+}
+
+static int compare_ids(const void *a, const void *b) {
+    uint32_t x = *(const uint32_t *)a;
+    uint32_t y = *(const uint32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Fill filter_rows with the current folder's matching tasks, looked up in
+// the query, tag or search index, in the chosen order
+void ApplyFilter() {
+    Folder *current = &store.folders[store.current_folder];
+    size_t max = (size_t)current->task_count + 1;   // Tasks plus the folder name
+    TodoSearchHit *hits = (TodoSearchHit *)malloc(max * sizeof(TodoSearchHit));
+    uint32_t *ids = (uint32_t *)malloc(max * sizeof(uint32_t));
+    size_t hit_count, id_count = 0;
+
+    filter_count = 0;
+    if (current->task_count > filter_capacity) {
+        int *grown = (int *)realloc(filter_rows, (size_t)current->task_count * sizeof(int));
+        if (grown != NULL) {
+            filter_rows = grown;
+            filter_capacity = current->task_count;
+        }
+    }
+    if (hits == NULL || ids == NULL || current->task_count > filter_capacity) {
+        free(hits);
+        free(ids);
+        return;
+    }
+
+    if (filtering && filter_query != NULL) {
+        // Matches come in slot order; sorted by handle they can be looked up
+        query_run(query_index, filter_query, current->id, today, &query_matches);  // Empty when out of memory
+        qsort(query_matches.tasks, query_matches.count, sizeof(uint32_t), compare_ids);
+        for (int i = 0; i < current->task_count; i++) {
+            if (bsearch(&current->rows[i], query_matches.tasks, query_matches.count, sizeof(uint32_t), compare_ids)) {
+                filter_rows[filter_count++] = i;
+            }
+        }
+    } else if (filtering && tag_filter != NULL) {
+        // A task matches if its slot is in the combined tag bitmaps
+        if (!tags_filter(tag_index, tag_filter, current->id, &tag_matches)) bitmap_free(&tag_matches);
+        for (int i = 0; i < current->task_count; i++) {
+            if (bitmap_contains(&tag_matches, SLOTS_INDEX(current->rows[i]))) filter_rows[filter_count++] = i;
+        }
+    } else {
+        if (filtering) {
+            hit_count = search_query(search, filter_text, SEARCH_SUBSTRING, current->id, hits, max);
+            for (size_t i = 0; i < hit_count; i++) {
+                if (hits[i].task_id != 0) ids[id_count++] = hits[i].task_id;
+            }
+            qsort(ids, id_count, sizeof(uint32_t), compare_ids);
+        }
+        for (int i = 0; i < current->task_count; i++) {
+            if (!filtering || bsearch(&current->rows[i], ids, id_count, sizeof(uint32_t), compare_ids)) {
+                filter_rows[filter_count++] = i;
+            }
+        }
+    }
+    if (task_order != SORT_PRESET_DEADLINE) {
+        TodoSortOrder order = sort_preset(task_order);
+        sort_rows(&store, current, &order, filter_rows, filter_count);
+    }
+    free(hits);
+    free(ids);
+}
+
+// Fill smart_tasks with the tasks of every list that the smart list on
+// screen matches, in the chosen order
+void ApplySmartList() {
+    TodoSortOrder order = task_order == SORT_PRESET_DEADLINE ? sort_folder_order() : sort_preset(task_order);
+    uint64_t *keys;
+
+    smart_tasks.count = 0;
+    if (query_index == NULL || !query_run(query_index, smart_lists[current_smart].query, 0, today, &smart_tasks)) {
+        return;
+    }
+    keys = (uint64_t *)malloc((smart_tasks.count + 1) * sizeof(uint64_t));
+    if (keys == NULL) return;   // Left in slot order
+    for (size_t i = 0; i < smart_tasks.count; i++) {
+        keys[i] = sort_key(&order, store_find_task(&store, smart_tasks.tasks[i]));
+    }
+    sort_radix(keys, smart_tasks.tasks, smart_tasks.count);
+    free(keys);
+}
+
+// Row of the selected task in the task list, or -1 once it is gone
+int SelectedRow() {
+    if (current_smart >= 0) {
+        for (size_t row = 0; row < smart_tasks.count; row++) {
+            if (smart_tasks.tasks[row] == selected_task) return (int)row;
+        }
+        return -1;
+    }
+
+    int task = store_task_row(&store, store.current_folder, selected_task);
+
+    if (task < 0 || !RowsMapped()) return task;
+    for (int row = 0; row < filter_count; row++) {
+        if (filter_rows[row] == task) return row;
+    }
+    return -1;
+}
+
+// Task indexes of the selected task list rows, in row order, or NULL if
+// none is selected
+int *SelectedTasks(int *count) {
+    int selected = (int)SendMessage(hwndTaskList, LB_GETSELCOUNT, 0, 0);
+    int *tasks;
+
+    *count = 0;
+    if (selected <= 0 || store.current_folder < 0) return NULL;
+    tasks = (int *)malloc((size_t)selected * sizeof(int));
+    if (tasks == NULL) return NULL;
+    *count = (int)SendMessage(hwndTaskList, LB_GETSELITEMS, selected, (LPARAM)tasks);
+    if (*count <= 0) {
+        free(tasks);
+        *count = 0;
+        return NULL;
+    }
+    for (int i = 0; i < *count; i++) {
+        tasks[i] = TaskAtRow(tasks[i]);
+    }
+    return tasks;
+}
+
+// The task list selection changed; the first selected task is the one
+// followed
+void SelectTask() {
+    int row;
+
+    selected_task = 0;
+    if (SendMessage(hwndTaskList, LB_GETSELITEMS, 1, (LPARAM)&row) != 1) {
+        return;
+    }
+    if (current_smart >= 0) {
+        selected_task = smart_tasks.tasks[row];
+        return;
+    }
+    if (store.current_folder < 0) return;
+    selected_task = store.folders[store.current_folder].rows[TaskAtRow(row)];
+}
+
+// Bring a listbox in line with its view. The listboxes hold no text: a
+// row is drawn from its view when it comes into sight (DrawRow), so only
+// the row count and the rows that changed are passed on.
+void ApplyView(HWND list, TodoView *view) {
+    if (view->rebuilt) {
+        SendMessage(list, LB_RESETCONTENT, 0, 0);
+        SendMessage(list, LB_SETCOUNT, view->count, 0);
+    } else {
+        for (int i = 0; i < view->op_count; i++) {
+            const TodoViewOp *op = &view->ops[i];
+            RECT rect;
+
+            switch (op->op) {
+                case VIEW_OP_INSERT:
+                    SendMessage(list, LB_INSERTSTRING, op->row, 0);
+                    break;
+                case VIEW_OP_REMOVE:
+                    SendMessage(list, LB_DELETESTRING, op->row, 0);
+                    break;
+                case VIEW_OP_UPDATE:
+                    // The row keeps its selection; it is only drawn again
+                    if (SendMessage(list, LB_GETITEMRECT, op->row, (LPARAM)&rect) != LB_ERR) {
+                        InvalidateRect(list, &rect, FALSE);
+                    }
+                    break;
+            }
+        }
+    }
+
+    // Set horizontal extent (add padding)
+    SendMessage(list, LB_SETHORIZONTALEXTENT, view->max_width + 20, 0);
+    view_clear_ops(view);
+}
+
+// WM_DRAWITEM for both listboxes; the row is formatted now if it has not
+// been shown before
+void DrawRow(const DRAWITEMSTRUCT *item) {
+    TodoView *view = item->hwndItem == hwndTaskList ? &task_view : &folder_view;
+    int selected = (item->itemState & ODS_SELECTED) != 0;
+    WCHAR wide[VIEW_TEXT_LENGTH];
+
+    if (item->itemID != (UINT)-1) {
+        Widen(view_row_text(view, (int)item->itemID), wide, VIEW_TEXT_LENGTH);
+        FillRect(item->hDC, &item->rcItem, GetSysColorBrush(selected ? COLOR_HIGHLIGHT : COLOR_WINDOW));
+        SetBkMode(item->hDC, TRANSPARENT);
+        SetTextColor(item->hDC, GetSysColor(selected ? COLOR_HIGHLIGHTTEXT : COLOR_WINDOWTEXT));
+        TextOutW(item->hDC, item->rcItem.left + 2, item->rcItem.top, wide, (int)wcslen(wide));
+    }
+    if (item->itemState & ODS_FOCUS) {
+        DrawFocusRect(item->hDC, &item->rcItem);
+    }
+    // A row measured for the first time may be the widest yet
+    if (SendMessage(item->hwndItem, LB_GETHORIZONTALEXTENT, 0, 0) < view->max_width + 20) {
+        SendMessage(item->hwndItem, LB_SETHORIZONTALEXTENT, view->max_width + 20, 0);
+    }
+}
+
+void UpdateCurrentLabel() {
+    if (current_smart >= 0) {
+        const char *name = smart_lists[current_smart].name;
+        char label[128];
+        WCHAR wide[128];
+        int shown = (int)utf8_fit(name, strlen(name), 50);
+
+        snprintf(label, sizeof(label), "Smart List: %.*s%s (%d tasks%s)", shown, name,
+                 name[shown] != 0 ? "..." : "", (int)smart_tasks.count, FoldersPending() ? ", loading lists" : "");
+        Widen(label, wide, 128);
+        SetWindowTextW(hwndCurrentLabel, wide);
+        return;
+    }
+    if (store.current_folder == -1 || store.current_folder >= store.folder_count) {
+        SetWindowText(hwndCurrentLabel, "No list selected");
+        return;
+    }
+
+    Folder *current = &store.folders[store.current_folder];
+    const char *name = store_text(&store, current->name);
     
-    return 0;
+    // Update current list label with truncation if too long
+    char label[128];
+    WCHAR wide[128];
+    int shown = (int)utf8_fit(name, current->name.length, 50);
+    if (shown < (int)current->name.length) {
+        sprintf(label, "Current List: %.*s... (%d tasks)", shown, name, current->task_count);
+    } else {
+        sprintf(label, "Current List: %s (%d tasks)", name, current->task_count);
+    }
+    Widen(label, wide, 128);
+    SetWindowTextW(hwndCurrentLabel, wide);
 }
 
-void sort_tasks(Folder *folder) {
-    for (int i = 0; i < folder->task_count; i++) {
-        folder->tasks[i].deadline_time = parse_date(folder->tasks[i].deadline);
+// Overdue and due today across every list, once every list is counted
+void UpdateTitle() {
+    static char shown[128];
+    const TodoFolderStats *total = stats ? stats_total(stats) : NULL;
+    char title[128];
+    HWND window = GetParent(hwndCurrentLabel);
+
+    if (total == NULL || !total->loaded || (total->overdue == 0 && total->due_today == 0)) {
+        snprintf(title, sizeof(title), "%s", WINDOW_TITLE);
+    } else {
+        snprintf(title, sizeof(title), "%s - %d overdue, %d due today", WINDOW_TITLE, total->overdue,
+                 total->due_today);
     }
-    qsort(folder->tasks, folder->task_count, sizeof(Task), compare_tasks);
+    if (strcmp(title, shown) == 0) return;
+    strcpy(shown, title);
+    SetWindowText(window, title);
 }
 
-// File I/O functions
-void save_data() {
-    FILE *file = fopen("todo_data.dat", "wb");
-    if (file == NULL) {
-        MessageBox(hwndMain, "Error: Could not save data to file!", "Save Error", MB_OK | MB_ICONERROR);
+// Rebuild views that went stale (a load or a folder switch) and apply the
+// queued row changes of the others
+void RefreshLists() {
+    int has_folder = store.current_folder >= 0 && store.current_folder < store.folder_count;
+
+    uint64_t started = TRACE_BEGIN();
+
+    if (folder_view.stale) {
+        view_rebuild(&folder_view, store.folder_count + smart_count);
+    }
+    ApplyView(hwndFolderList, &folder_view);
+    trace_end(TRACE_REFRESH_FOLDERS, started, (uint64_t)folder_view.count);
+
+    started = TRACE_BEGIN();
+    if (task_view.stale) {
+        int count = 0;
+        if (current_smart >= 0) {
+            ApplySmartList();
+            count = (int)smart_tasks.count;
+        } else if (has_folder && RowsMapped()) {
+            ApplyFilter();
+            count = filter_count;
+        } else if (has_folder) {
+            count = store.folders[store.current_folder].task_count;
+        }
+        view_rebuild(&task_view, count);
+    }
+    ApplyView(hwndTaskList, &task_view);
+    // Rows keep their selection as others come and go; a lone selected
+    // task is followed to its new row
+    if (selected_task != 0 && SendMessage(hwndTaskList, LB_GETSELCOUNT, 0, 0) <= 1) {
+        int row = SelectedRow();
+
+        SendMessage(hwndTaskList, LB_SETSEL, FALSE, -1);
+        if (row >= 0) SendMessage(hwndTaskList, LB_SETSEL, TRUE, row);
+        if (row < 0) selected_task = 0;
+    }
+    trace_end(TRACE_REFRESH_TASKS, started, (uint64_t)task_view.count);
+
+    if (has_folder) {
+        SendMessage(hwndFolderList, LB_SETCURSEL, store.current_folder, 0);
+    } else if (current_smart >= 0) {
+        SendMessage(hwndFolderList, LB_SETCURSEL, store.folder_count + current_smart, 0);
+    }
+    UpdateCurrentLabel();
+    UpdateTitle();
+}
+
+// Show the tasks of every list that a smart list matches. Queries only see
+// the lists that are loaded, so the matches in those are shown at once and
+// the others are added as the load timer brings them in.
+void SwitchSmartList(int smart) {
+    current_smart = smart;
+    store.current_folder = -1;
+    selected_task = 0;
+    if (FoldersPending()) SetTimer(hwndMain, IDT_LOAD, LOAD_INTERVAL_MS, NULL);
+    view_mark_stale(&task_view);
+    RefreshLists();
+}
+
+// Show another folder's tasks, or a smart list's for the rows after them
+void SwitchFolder(int index) {
+    if (index >= store.folder_count) {
+        SwitchSmartList(index - store.folder_count);
+        return;
+    }
+    current_smart = -1;
+    store.current_folder = index;
+    selected_task = 0;
+    // Tasks are read from the data file on first selection
+    store_materialize(&store, index);
+    view_update(&folder_view, index);
+    view_mark_stale(&task_view);
+    RefreshLists();
+}
+
+// With Shift held, every step is undone at once
+void UndoChange() {
+    if (!history_can_undo(history)) {
+        MessageBox(hwndMain, "Nothing to undo.", "Undo", MB_OK | MB_ICONINFORMATION);
         return;
     }
+    if (GetKeyState(VK_SHIFT) < 0) {
+        history_undo_many(history, &store, history_undo_count(history), ApplyEntries, NULL);
+    } else {
+        history_undo(history, ApplyEntries, NULL);
+    }
+    RefreshLists();
+}
+
+void RedoChange() {
+    if (!history_can_redo(history)) {
+        MessageBox(hwndMain, "Nothing to redo.", "Redo", MB_OK | MB_ICONINFORMATION);
+        return;
+    }
+    history_redo(history, ApplyEntries, NULL);
+    RefreshLists();
+}
+
+// The search box changed
+void UpdateFilter() {
+    free(filter_text);
+    filter_text = GetEditText(IDC_EDIT_SEARCH);
+    filtering = filter_text != NULL && search != NULL;
+    tags_free_filter(tag_filter);
+    tag_filter = NULL;
+    query_free(filter_query);
+    filter_query = NULL;
+    // Text that does not parse as a query or a tag filter is searched for
+    // as it is
+    if (filtering && query_index != NULL && query_is_query(filter_text)) {
+        query_compile(filter_text, &filter_query);
+    }
+    if (filtering && filter_query == NULL && tag_index != NULL && tags_is_filter(filter_text)) {
+        tags_parse(filter_text, &tag_filter);
+    }
+    view_mark_stale(&task_view);
+    RefreshLists();
+}
+
+// The sort order changed
+void UpdateOrder() {
+    int preset = (int)SendDlgItemMessage(hwndMain, IDC_COMBO_SORT, CB_GETCURSEL, 0, 0);
+
+    task_order = preset >= 0 && preset < SORT_PRESET_COUNT ? preset : SORT_PRESET_DEADLINE;
+    view_mark_stale(&task_view);
+    RefreshLists();
+}
+
+// Arm the timer for the next local midnight. It is re-armed every time it
+// fires, so clock drift or a sleeping machine cannot accumulate.
+void ScheduleRollover(HWND hwnd) {
+    SetTimer(hwnd, IDT_MIDNIGHT, (UINT)due_ms_until_midnight() + 500, NULL);
+}
+
+// Move the snapshot to the current date. Only incomplete tasks due between
+// the old and new day change state, so just those rows are redrawn, and
+// the counts are moved the same way. Sorted or filtered rows are found
+// through filter_rows; neither the order nor the search text reads the date.
+// A query may, so a list filtered by one is filtered again.
+void RollOverDay() {
+    int32_t old_today = today;
+    int first, last;
+    int changed = 0;
+
+    today = date_today();
+    if (today == old_today) return;
+
+    if (store.current_folder >= 0 && store.current_folder < store.folder_count &&
+        due_changed_rows(&store, &store.folders[store.current_folder], old_today, today, &first, &last)) {
+        if (!RowsMapped()) {
+            for (int i = first; i < last; i++) {
+                view_update(&task_view, i);
+            }
+        } else {
+            for (int row = 0; row < filter_count; row++) {
+                if (filter_rows[row] >= first && filter_rows[row] < last) view_update(&task_view, row);
+            }
+        }
+        changed = 1;
+    }
+    if (current_smart >= 0 || (filtering && filter_query != NULL)) {
+        // Queries read "today" when they run
+        view_mark_stale(&task_view);
+        changed = 1;
+    }
+    if (stats && stats_set_today(stats, today)) {
+        for (int i = 0; i < store.folder_count; i++) {
+            view_update(&folder_view, i);
+        }
+        changed = 1;
+    }
+    if (changed) RefreshLists();
+}
+
+// Runs on the reminder worker; the window shows it
+void OnReminder(void *context, const TodoReminder *reminder) {
+    TodoReminder *copy = (TodoReminder *)malloc(sizeof(TodoReminder));
+
+    if (copy == NULL) return;
+    *copy = *reminder;
+    if (!PostMessage(hwndMain, WM_APP_REMINDER, 0, (LPARAM)copy)) free(copy);
+}
+
+// The task a reminder is for. One scheduled while its folder was not
+// loaded names a row of the folder's section; the folder is loaded now,
+// and since loading may reorder a section, a task with the deadline is
+// looked for if that row has another.
+const Task *ReminderTask(const TodoReminder *reminder, int folder) {
+    const Folder *current = &store.folders[folder];
+
+    if (reminder->task_id != 0) return store_find_task(&store, reminder->task_id);
+    if (!store_materialize(&store, folder)) return NULL;
+    if (reminder->row < current->task_count) {
+        const Task *task = store_task(&store, current, reminder->row);
+
+        if (!task->completed && task->deadline_day == reminder->deadline) return task;
+    }
+    for (int row = 0; row < current->task_count; row++) {
+        const Task *task = store_task(&store, current, row);
+
+        if (!task->completed && task->deadline_day == reminder->deadline) return task;
+    }
+    return NULL;
+}
+
+// One box at a time; reminders that arrive while it is open are counted
+// and mentioned once it closes
+void ShowReminder(const TodoReminder *reminder) {
+    int folder = store_find_folder(&store, reminder->folder_id);
+    const Task *task = folder >= 0 ? ReminderTask(reminder, folder) : NULL;
+    char message[STRPOOL_MAX_LENGTH + 256];
+    char when[32];
+    int days;
+
+    if (task == NULL || task->completed || task->deadline_day == DATE_NONE) return;
+    if (showing_reminder) {
+        missed_reminders++;
+        return;
+    }
+
+    days = task->deadline_day - date_today();
+    if (days < 0) {
+        snprintf(when, sizeof(when), "was due %d day(s) ago", -days);
+    } else if (days == 0) {
+        snprintf(when, sizeof(when), "is due today");
+    } else if (days == 1) {
+        snprintf(when, sizeof(when), "is due tomorrow");
+    } else {
+        snprintf(when, sizeof(when), "is due in %d days", days);
+    }
+    snprintf(message, sizeof(message), "'%s' in '%s' %s.", store_text(&store, task->description),
+             store_text(&store, store.folders[folder].name), when);
+
+    showing_reminder = 1;
+    MessageBoxText(message, "Reminder", MB_OK | MB_ICONINFORMATION);
+    if (missed_reminders > 0) {
+        snprintf(message, sizeof(message), "%d more task(s) came due while this was open.", missed_reminders);
+        missed_reminders = 0;
+        MessageBox(hwndMain, message, "Reminder", MB_OK | MB_ICONINFORMATION);
+    }
+    showing_reminder = 0;
+}
+
+void CreateNewList() {
+    char *name = GetEditText(IDC_EDIT_LIST_NAME);
+    if (name == NULL) {
+        MessageBox(hwndMain, "Please enter a list name!", "Input Error", MB_OK | MB_ICONWARNING);
+        return;
+    }
+
+    int recorded = RecordChange(JOURNAL_CREATE_LIST, store.next_folder_id, -1, name, NULL);
+    free(name);
+    if (!recorded) {
+        return;
+    }
+    
+    SetDlgItemTextW(hwndMain, IDC_EDIT_LIST_NAME, L"");
+    SwitchFolder(store.folder_count - 1);
+    
+    MessageBox(hwndMain, "List created successfully!", "Success", MB_OK | MB_ICONINFORMATION);
+}
+
+// Smart lists. They are a way of looking at the lists rather than data,
+// so they are saved on their own, as they change, and are not undone.
+
+// Append a smart list; returns 0, changing nothing, if the query does not
+// compile or memory runs out
+int AddSmartList(const char *name, const char *text) {
+    SmartList smart = {NULL, NULL, NULL};
+
+    if (smart_count == smart_capacity) {
+        int capacity = smart_capacity ? smart_capacity * 2 : 8;
+        SmartList *grown = (SmartList *)realloc(smart_lists, (size_t)capacity * sizeof(SmartList));
+        if (grown == NULL) return 0;
+        smart_lists = grown;
+        smart_capacity = capacity;
+    }
+    if (query_compile(text, &smart.query) != QUERY_OK) return 0;
+    smart.name = CopyText(name);
+    smart.text = CopyText(text);
+    if (smart.name == NULL || smart.text == NULL) {
+        free(smart.name);
+        free(smart.text);
+        query_free(smart.query);
+        return 0;
+    }
+    // Tabs and line breaks would split the saved line
+    for (char *c = smart.name; *c; c++) {
+        if (*c == '\t' || *c == '\r' || *c == '\n') *c = ' ';
+    }
+    for (char *c = smart.text; *c; c++) {
+        if (*c == '\t' || *c == '\r' || *c == '\n') *c = ' ';
+    }
+    smart_lists[smart_count++] = smart;
+    return 1;
+}
 
-    fwrite(&folder_count, sizeof(int), 1, file);
-    for (int i = 0; i < folder_count; i++) {
-        fwrite(folders[i].name, sizeof(char), MAX_LENGTH, file);
-        fwrite(&folders[i].task_count, sizeof(int), 1, file);
-        for (int j = 0; j < folders[i].task_count; j++) {
-            fwrite(&folders[i].tasks[j], sizeof(Task), 1, file);
-        }
+void FreeSmartLists() {
+    for (int i = 0; i < smart_count; i++) {
+        free(smart_lists[i].name);
+        free(smart_lists[i].text);
+        query_free(smart_lists[i].query);
     }
-    fwrite(&current_folder, sizeof(int), 1, file);
-    
-    fclose(file);
-    MessageBox(hwndMain, "Data saved successfully to 'todo_data.dat'!", "Save Complete", MB_OK | MB_ICONINFORMATION);
+    free(smart_lists);
+    smart_lists = NULL;
+    smart_count = smart_capacity = 0;
 }
 
-int load_data() {
-    FILE *file = fopen("todo_data.dat", "rb");
-    if (file == NULL) {
-        return 0; // No saved data
-    }
+// Lines that do not hold a name, a tab and a query are skipped
+void LoadSmartLists() {
+    FILE *file = fopen(QUERIES_FILE, "rb");
+    char *line = (char *)malloc(QUERY_LINE_LENGTH);
 
-    fread(&folder_count, sizeof(int), 1, file);
-    for (int i = 0; i < folder_count; i++) {
-        fread(folders[i].name, sizeof(char), MAX_LENGTH, file);
-        fread(&folders[i].task_count, sizeof(int), 1, file);
-        for (int j = 0; j < folders[i].task_count; j++) {
-            fread(&folders[i].tasks[j], sizeof(Task), 1, file);
+    while (file != NULL && line != NULL && fgets(line, QUERY_LINE_LENGTH, file) != NULL) {
+        size_t length = strlen(line);
+        char *tab = strchr(line, '\t');
+
+        if (length > 0 && line[length - 1] == '\n') {
+            line[--length] = 0;
+        } else if (!feof(file)) {
+            // Too long: skip the rest of it
+            int c;
+            while ((c = fgetc(file)) != EOF && c != '\n') {}
+            continue;
         }
+        if (length > 0 && line[length - 1] == '\r') line[--length] = 0;
+        if (tab == NULL || tab == line || tab[1] == 0) continue;
+        *tab = 0;
+        AddSmartList(line, tab + 1);
     }
-    fread(&current_folder, sizeof(int), 1, file);
-    
-    fclose(file);
-    return 1;
+    free(line);
+    if (file != NULL) fclose(file);
 }
 
-// GUI Update functions
-void UpdateFolderList() {
-    SendMessage(hwndFolderList, LB_RESETCONTENT, 0, 0);
-    
-    // Set horizontal extent for scrolling if text is too long
-    int maxWidth = 0;
-    
-    for (int i = 0; i < folder_count; i++) {
-        char display[MAX_LENGTH + 20];
-        sprintf(display, "%s (%d tasks)", folders[i].name, folders[i].task_count);
-        SendMessage(hwndFolderList, LB_ADDSTRING, 0, (LPARAM)display);
-        
-        // Calculate text width for horizontal scrolling
-        HDC hdc = GetDC(hwndFolderList);
-        SIZE size;
-        GetTextExtentPoint32(hdc, display, strlen(display), &size);
-        if (size.cx > maxWidth) maxWidth = size.cx;
-        ReleaseDC(hwndFolderList, hdc);
+// Written beside the old file and moved over it once on disk, so a failed
+// or interrupted save leaves the previous smart lists in place
+int SaveSmartLists() {
+    FILE *file = fopen(QUERIES_TEMP_FILE, "wb");
+    int ok = file != NULL;
+
+    for (int i = 0; ok && i < smart_count; i++) {
+        ok = fprintf(file, "%s\t%s\n", smart_lists[i].name, smart_lists[i].text) >= 0;
     }
-    
-    // Set horizontal extent (add padding)
-    SendMessage(hwndFolderList, LB_SETHORIZONTALEXTENT, maxWidth + 20, 0);
-    
-    if (current_folder >= 0 && current_folder < folder_count) {
-        SendMessage(hwndFolderList, LB_SETCURSEL, current_folder, 0);
+    if (ok && (fflush(file) != 0 || _commit(_fileno(file)) != 0)) ok = 0;
+    if (file != NULL && fclose(file) != 0) ok = 0;
+    if (ok && !MoveFileExA(QUERIES_TEMP_FILE, QUERIES_FILE, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH)) {
+        ok = 0;
     }
+    if (!ok) {
+        if (file != NULL) DeleteFileA(QUERIES_TEMP_FILE);
+        MessageBox(hwndMain, "Error: Could not save the smart lists to '" QUERIES_FILE "'!", "Save Error",
+                   MB_OK | MB_ICONERROR);
+    }
+    return ok;
 }
 
-void UpdateTaskList() {
-    SendMessage(hwndTaskList, LB_RESETCONTENT, 0, 0);
-    
-    if (current_folder == -1 || current_folder >= folder_count) {
-        SetWindowText(hwndCurrentLabel, "No list selected");
-        return;
-    }
+// Save the query in the search box as a smart list named in the list name
+// box, and show it
+void SaveQuery() {
+    char *text = GetEditText(IDC_EDIT_SEARCH);
+    char *name = GetEditText(IDC_EDIT_LIST_NAME);
+    TodoQuery *query = NULL;
+    int compiled = text != NULL ? query_compile(text, &query) : QUERY_ERR_SYNTAX;
 
-    Folder *current = &folders[current_folder];
-    sort_tasks(current);
-    
-    // Update current list label with truncation if too long
-    char label[MAX_LENGTH + 50];
-    if (strlen(current->name) > 50) {
-        char truncated[54];
-        strncpy(truncated, current->name, 50);
-        truncated[50] = '\0';
-        sprintf(label, "Current List: %s... (%d tasks)", truncated, current->task_count);
+    query_free(query);
+    if (compiled == QUERY_ERR_SYNTAX) {
+        MessageBox(hwndMain,
+            "Invalid query!\n\n"
+            "Type the query in the search box and its name in the list name box.\n"
+            "Terms next to each other must all match; 'or', 'not' and parentheses\n"
+            "combine them:\n"
+            "- done, open, overdue, repeats, #tag\n"
+            "- folder:NAME, folder~TEXT, text~TEXT\n"
+            "- due < today+7, due = 2025-12-31, due = none\n"
+            "- priority >= medium\n\n"
+            "Example: folder:\"Ops\" and due < today+7 and not done and text~\"deploy\"",
+            "Query Validation Error", MB_OK | MB_ICONERROR);
+    } else if (name == NULL) {
+        MessageBox(hwndMain, "Please enter a name for the smart list!", "Input Error", MB_OK | MB_ICONWARNING);
+    } else if (compiled != QUERY_OK || !AddSmartList(name, text)) {
+        MessageBox(hwndMain, "Error: Not enough memory for the smart list!", "Error", MB_OK | MB_ICONERROR);
     } else {
-        sprintf(label, "Current List: %s (%d tasks)", current->name, current->task_count);
-    }
-    SetWindowText(hwndCurrentLabel, label);
-
-    // Set horizontal extent for scrolling
-    int maxWidth = 0;
-    
-    // Get current time once for all comparisons
-    time_t now = time(NULL);
-    
-    for (int i = 0; i < current->task_count; i++) {
-        char display[MAX_LENGTH + 50];
-        char status = current->tasks[i].completed ? 'X' : ' ';
-        char overdue_tag[15] = "";
-        
-        // Check if task is overdue (not completed and deadline has passed)
-        if (!current->tasks[i].completed && current->tasks[i].deadline_time > 0) {
-            if (is_overdue(current->tasks[i].deadline_time)) {
-                strcpy(overdue_tag, " [OVERDUE]");
-            }
-        }
-        
-        sprintf(display, "[%c] %s (Due: %s)%s", status, 
-                current->tasks[i].description, current->tasks[i].deadline, overdue_tag);
-        SendMessage(hwndTaskList, LB_ADDSTRING, 0, (LPARAM)display);
-        
-        // Calculate text width for horizontal scrolling
-        HDC hdc = GetDC(hwndTaskList);
-        SIZE size;
-        GetTextExtentPoint32(hdc, display, strlen(display), &size);
-        if (size.cx > maxWidth) maxWidth = size.cx;
-        ReleaseDC(hwndTaskList, hdc);
+        SaveSmartLists();
+        SetDlgItemTextW(hwndMain, IDC_EDIT_LIST_NAME, L"");
+        SetDlgItemTextW(hwndMain, IDC_EDIT_SEARCH, L"");
+        view_mark_stale(&folder_view);
+        SwitchSmartList(smart_count - 1);
     }
-    
-    // Set horizontal extent (add padding)
-    SendMessage(hwndTaskList, LB_SETHORIZONTALEXTENT, maxWidth + 20, 0);
+    free(text);
+    free(name);
 }
 
-void CreateNewList() {
-    char name[MAX_LENGTH];
-    if (GetDlgItemText(hwndMain, IDC_EDIT_LIST_NAME, name, MAX_LENGTH) == 0) {
-        MessageBox(hwndMain, "Please enter a list name!", "Input Error", MB_OK | MB_ICONWARNING);
-        return;
-    }
+// The tasks it shows stay where they are
+void DeleteSmartList() {
+    SmartList *smart = &smart_lists[current_smart];
+    char *msg = (char *)malloc(strlen(smart->name) + 48);
+    int answer = IDNO;
 
-    if (folder_count >= MAX_FOLDERS) {
-        MessageBox(hwndMain, "Maximum number of lists reached!", "Limit Reached", MB_OK | MB_ICONWARNING);
+    if (msg != NULL) {
+        sprintf(msg, "Delete smart list '%s'?", smart->name);
+        answer = MessageBoxText(msg, "Confirm Delete", MB_YESNO | MB_ICONQUESTION);
+        free(msg);
+    }
+    if (answer != IDYES) {
         return;
     }
 
-    strcpy(folders[folder_count].name, name);
-    folders[folder_count].task_count = 0;
-    folder_count = asm_increment(folder_count);
-    
-    current_folder = folder_count - 1;
-    
-    SetDlgItemText(hwndMain, IDC_EDIT_LIST_NAME, "");
-    UpdateFolderList();
-    UpdateTaskList();
-    
-    MessageBox(hwndMain, "List created successfully!", "Success", MB_OK | MB_ICONINFORMATION);
+    free(smart->name);
+    free(smart->text);
+    query_free(smart->query);
+    memmove(smart, smart + 1, (size_t)(smart_count - current_smart - 1) * sizeof(SmartList));
+    smart_count--;
+    current_smart = -1;
+    SaveSmartLists();
+    view_mark_stale(&folder_view);
+    view_mark_stale(&task_view);
+    RefreshLists();
 }
 
 void DeleteCurrentList() {
-    if (current_folder == -1) {
+    if (current_smart >= 0) {
+        DeleteSmartList();
+        return;
+    }
+    if (store.current_folder == -1) {
         MessageBox(hwndMain, "Please select a list first!", "No Selection", MB_OK | MB_ICONWARNING);
         return;
     }
 
-    char msg[MAX_LENGTH + 50];
-    sprintf(msg, "Delete list '%s'?", folders[current_folder].name);
-    if (MessageBox(hwndMain, msg, "Confirm Delete", MB_YESNO | MB_ICONQUESTION) != IDYES) {
+    const Folder *current = &store.folders[store.current_folder];
+    char *msg = (char *)malloc(current->name.length + 32);
+    int answer = IDNO;
+    if (msg != NULL) {
+        sprintf(msg, "Delete list '%s'?", store_text(&store, current->name));
+        answer = MessageBoxText(msg, "Confirm Delete", MB_YESNO | MB_ICONQUESTION);
+        free(msg);
+    }
+    if (answer != IDYES) {
         return;
     }
 
-    for (int i = current_folder; i < folder_count - 1; i++) {
-        folders[i] = folders[i + 1];
+    if (!RecordChange(JOURNAL_DELETE_LIST, store.folders[store.current_folder].id, -1, NULL, NULL)) {
+        return;
     }
-    folder_count = asm_subtract(folder_count, 1);
-    current_folder = -1;
-    
-    UpdateFolderList();
-    UpdateTaskList();
+    // The deleted folder was current, so the store already cleared it
+    view_mark_stale(&task_view);
+    RefreshLists();
+}
+
+// Canonical form of the tags box; reports and returns 0 if it has a bad name
+int ReadTags(char tags[TAGS_TEXT_LENGTH]) {
+    char *text = GetEditText(IDC_EDIT_TAGS);
+    int ok = tags_normalize(text != NULL ? text : "", tags);
+
+    free(text);
+    if (!ok) {
+        MessageBox(hwndMain,
+            "Invalid tags!\n\n"
+            "Separate tags with spaces or commas, with or without a leading #.\n"
+            "A tag is letters, digits, '-' and '_', and all of a task's\n"
+            "tags together must be under 256 characters.\n\n"
+            "Example: #work #urgent",
+            "Tags Validation Error", MB_OK | MB_ICONERROR);
+    }
+    return ok;
 }
 
 void AddNewTask() {
-    if (current_folder == -1) {
+    if (store.current_folder == -1) {
         MessageBox(hwndMain, "Please select a list first!", "No Selection", MB_OK | MB_ICONWARNING);
         return;
     }
 
-    Folder *current = &folders[current_folder];
-    if (current->task_count >= MAX_TASKS) {
-        MessageBox(hwndMain, "Task list is full!", "Limit Reached", MB_OK | MB_ICONWARNING);
-        return;
-    }
+    Folder *current = &store.folders[store.current_folder];
 
-    char desc[MAX_LENGTH], deadline[20];
-    if (GetDlgItemText(hwndMain, IDC_EDIT_TASK_DESC, desc, MAX_LENGTH) == 0) {
+    char deadline[20];
+    if (GetWindowTextLengthW(GetDlgItem(hwndMain, IDC_EDIT_TASK_DESC)) == 0) {
         MessageBox(hwndMain, "Please enter a task description!", "Input Error", MB_OK | MB_ICONWARNING);
         return;
     }
@@ -422,9 +1220,13 @@ void AddNewTask() {
         return;
     }
 
-    // Simplified date validation
-    int year, month, day;
-    if (!validate_date(deadline, &year, &month, &day)) {
+    int32_t deadline_day;
+    TodoRecurrence repeat;
+    char rule[RECUR_TEXT_LENGTH];
+    char schedule[JOURNAL_SCHEDULE_LENGTH];
+    char tags[TAGS_TEXT_LENGTH];
+    int priority;
+    if (!date_parse(deadline, &deadline_day)) {
         char error_msg[200];
         sprintf(error_msg, 
             "Invalid date format!\n\n"
@@ -432,78 +1234,369 @@ void AddNewTask() {
             "- Format: YYYY-MM-DD\n"
             "- Year: 1000-9999 (4 digits)\n"
             "- Month: 1-12\n"
-            "- Day: 1-31\n\n"
+            "- Day: must exist in that month\n\n"
             "Example: 2025-12-31");
         MessageBox(hwndMain, error_msg, "Date Validation Error", MB_OK | MB_ICONERROR);
         return;
     }
 
-    strcpy(current->tasks[current->task_count].description, desc);
-    strcpy(current->tasks[current->task_count].deadline, deadline);
-    current->tasks[current->task_count].completed = 0;
-    current->tasks[current->task_count].deadline_time = parse_date(deadline);
-    current->task_count = asm_increment(current->task_count);
-    
-    sort_tasks(current);
+    GetDlgItemText(hwndMain, IDC_EDIT_REPEAT, rule, RECUR_TEXT_LENGTH);
+    if (!recur_parse(rule, deadline_day, &repeat)) {
+        MessageBox(hwndMain,
+            "Invalid repeat rule!\n\n"
+            "Leave it empty for a one-off task, or use:\n"
+            "- daily, weekly or monthly\n"
+            "- every N days, every N weeks or every N months\n"
+            "- optionally followed by: until YYYY-MM-DD\n\n"
+            "The deadline is the first occurrence.\n"
+            "Example: every 2 weeks until 2025-12-31",
+            "Repeat Validation Error", MB_OK | MB_ICONERROR);
+        return;
+    }
+    priority = (int)SendDlgItemMessage(hwndMain, IDC_COMBO_PRIORITY, CB_GETCURSEL, 0, 0);
+    if (priority < PRIORITY_NONE || priority > PRIORITY_HIGH) priority = PRIORITY_NONE;
+    if (!ReadTags(tags)) return;
+    journal_format_schedule(deadline_day, &repeat, priority, tags, schedule);
+
+    char *desc = GetEditText(IDC_EDIT_TASK_DESC);
+    int recorded = desc != NULL && RecordChange(JOURNAL_ADD_TASK, current->id, -1, desc, schedule);
+    free(desc);
+    if (!recorded) {
+        return;
+    }
     
-    SetDlgItemText(hwndMain, IDC_EDIT_TASK_DESC, "");
+    SetDlgItemTextW(hwndMain, IDC_EDIT_TASK_DESC, L"");
     SetDlgItemText(hwndMain, IDC_EDIT_DEADLINE, "");
-    UpdateFolderList();
-    UpdateTaskList();
+    SetDlgItemText(hwndMain, IDC_EDIT_REPEAT, "");
+    SendDlgItemMessage(hwndMain, IDC_COMBO_PRIORITY, CB_SETCURSEL, PRIORITY_NONE, 0);
+    SetDlgItemTextW(hwndMain, IDC_EDIT_TAGS, L"");
+    RefreshLists();
     
     MessageBox(hwndMain, "Task added successfully!", "Success", MB_OK | MB_ICONINFORMATION);
 }
 
-void CompleteSelectedTask() {
-    if (current_folder == -1) {
+// A batch of changes to several tasks; reports and returns NULL when out of
+// memory
+TodoBatch *BeginBatch() {
+    TodoBatch *batch = batch_begin(&store);
+
+    if (batch == NULL) {
+        MessageBox(hwndMain, "Error: Not enough memory for the changes!", "Error", MB_OK | MB_ICONERROR);
+    }
+    return batch;
+}
+
+// Apply a batch as a single undo step, unless queueing one of its changes
+// failed. Returns 0 if nothing was applied.
+int RecordBatch(TodoBatch *batch, int queued) {
+    if (!queued) {
+        batch_abort(batch);
+        MessageBox(hwndMain, "Error: Could not queue the changes!", "Error", MB_OK | MB_ICONERROR);
+        return 0;
+    }
+    if (batch_count(batch) == 0) {
+        batch_abort(batch);
+        return 1;
+    }
+    return batch_commit(batch, history, ApplyEntries, NULL);
+}
+
+// Task indexes of the selection; reports and returns NULL if there is none
+int *RequireSelection(int *count) {
+    int *tasks;
+
+    if (store.current_folder == -1) {
         MessageBox(hwndMain, "Please select a list first!", "No Selection", MB_OK | MB_ICONWARNING);
-        return;
+        return NULL;
+    }
+    tasks = SelectedTasks(count);
+    if (tasks == NULL) {
+        MessageBox(hwndMain, "Please select a task!", "No Selection", MB_OK | MB_ICONWARNING);
     }
+    return tasks;
+}
 
-    int sel = SendMessage(hwndTaskList, LB_GETCURSEL, 0, 0);
-    if (sel == LB_ERR) {
+// Change every selected task of the smart list on screen, each in its own
+// list, as a single undo step: kind is STORE_BATCH_COMPLETE,
+// STORE_BATCH_DELETE or STORE_BATCH_TAG (with tags), or 0 for a move to the
+// folder at target. Returns the number of tasks selected, 0 if nothing was
+// applied.
+int ChangeSmartSelection(int kind, const char *tags, int target) {
+    int selected = (int)SendMessage(hwndTaskList, LB_GETSELCOUNT, 0, 0);
+    int *rows;
+    int count;
+    TodoBatch *batch;
+    int queued;
+
+    if (selected <= 0) {
         MessageBox(hwndMain, "Please select a task!", "No Selection", MB_OK | MB_ICONWARNING);
+        return 0;
+    }
+    rows = (int *)malloc((size_t)selected * sizeof(int));
+    if (rows == NULL) return 0;
+    count = (int)SendMessage(hwndTaskList, LB_GETSELITEMS, selected, (LPARAM)rows);
+    batch = count > 0 ? BeginBatch() : NULL;
+    queued = batch != NULL;
+    for (int i = 0; queued && i < count; i++) {
+        uint32_t handle = smart_tasks.tasks[rows[i]];
+        int index = store_find_folder(&store, query_task_folder(query_index, handle));
+        int task = index >= 0 ? store_task_row(&store, index, handle) : -1;
+
+        if (task < 0) {
+            queued = 0;
+        } else if (kind == STORE_BATCH_COMPLETE) {
+            queued = batch_complete_task(batch, index, task);
+        } else if (kind == STORE_BATCH_DELETE) {
+            queued = batch_delete_task(batch, index, task);
+        } else if (kind == STORE_BATCH_TAG) {
+            queued = batch_tag_task(batch, index, task, tags);
+        } else if (index != target) {
+            queued = batch_move_task(batch, index, task, target);
+        }
+    }
+    free(rows);
+    if (batch == NULL || !RecordBatch(batch, queued)) {
+        return 0;
+    }
+    RefreshLists();
+    return count;
+}
+
+void CompleteSelectedTask() {
+    if (current_smart >= 0) {
+        int count = ChangeSmartSelection(STORE_BATCH_COMPLETE, NULL, -1);
+        char message[64];
+
+        if (count > 0) {
+            snprintf(message, sizeof(message), "%d task%s marked as complete!", count, count == 1 ? "" : "s");
+            MessageBox(hwndMain, message, "Success", MB_OK | MB_ICONINFORMATION);
+        }
+        return;
+    }
+
+    int count;
+    int *tasks = RequireSelection(&count);
+    if (tasks == NULL) {
+        return;
+    }
+
+    Folder *current = &store.folders[store.current_folder];
+    if (count > 1) {
+        TodoBatch *batch = BeginBatch();
+        int queued = batch != NULL;
+        char message[64];
+
+        for (int i = 0; queued && i < count; i++) {
+            queued = batch_complete_task(batch, store.current_folder, tasks[i]);
+        }
+        free(tasks);
+        if (batch == NULL || !RecordBatch(batch, queued)) {
+            return;
+        }
+        RefreshLists();
+        snprintf(message, sizeof(message), "%d tasks marked as complete!", count);
+        MessageBox(hwndMain, message, "Success", MB_OK | MB_ICONINFORMATION);
         return;
     }
 
-    folders[current_folder].tasks[sel].completed = 1;
-    sort_tasks(&folders[current_folder]);
-    UpdateFolderList();
-    UpdateTaskList();
+    int task = tasks[0];
+    free(tasks);
+    const Task *selected = store_task(&store, current, task);
+    const TodoRecurrence *rule = store_task_rule(&store, selected);
+    int32_t next = rule && !selected->completed ? recur_next(rule, selected->deadline_day) : DATE_NONE;
+    char deadline[DATE_TEXT_LENGTH];
+    date_format(selected->deadline_day, deadline);
+    if (!RecordChange(JOURNAL_COMPLETE_TASK, current->id, task,
+                      store_text(&store, selected->description), deadline)) {
+        return;
+    }
+    RefreshLists();
     
+    if (next != DATE_NONE) {
+        char message[64];
+        date_format(next, deadline);
+        snprintf(message, sizeof(message), "Occurrence done! Next one is due %s.", deadline);
+        MessageBox(hwndMain, message, "Success", MB_OK | MB_ICONINFORMATION);
+        return;
+    }
     MessageBox(hwndMain, "Task marked as complete!", "Success", MB_OK | MB_ICONINFORMATION);
 }
 
+// Replace the selected tasks' tags with those in the tags box
+void TagSelectedTask() {
+    static const TodoRecurrence no_rule;
+
+    char tags[TAGS_TEXT_LENGTH];
+    char schedule[JOURNAL_SCHEDULE_LENGTH];
+    if (current_smart >= 0) {
+        if (ReadTags(tags) && ChangeSmartSelection(STORE_BATCH_TAG, tags, -1)) {
+            SetDlgItemTextW(hwndMain, IDC_EDIT_TAGS, L"");
+        }
+        return;
+    }
+
+    int count;
+    int *tasks = RequireSelection(&count);
+    if (tasks == NULL) {
+        return;
+    }
+    if (!ReadTags(tags)) {
+        free(tasks);
+        return;
+    }
+
+    Folder *current = &store.folders[store.current_folder];
+    if (count > 1) {
+        TodoBatch *batch = BeginBatch();
+        int queued = batch != NULL;
+
+        for (int i = 0; queued && i < count; i++) {
+            queued = batch_tag_task(batch, store.current_folder, tasks[i], tags);
+        }
+        free(tasks);
+        if (batch == NULL || !RecordBatch(batch, queued)) {
+            return;
+        }
+        SetDlgItemTextW(hwndMain, IDC_EDIT_TAGS, L"");
+        RefreshLists();
+        return;
+    }
+
+    int task = tasks[0];
+    free(tasks);
+    const Task *selected = store_task(&store, current, task);
+    // Only the deadline and the tags of the schedule are read back
+    journal_format_schedule(selected->deadline_day, &no_rule, PRIORITY_NONE, tags, schedule);
+    if (!RecordChange(JOURNAL_TAG_TASK, current->id, task, store_text(&store, selected->description), schedule)) {
+        return;
+    }
+    SetDlgItemTextW(hwndMain, IDC_EDIT_TAGS, L"");
+    RefreshLists();
+}
+
 void DeleteSelectedTask() {
-    if (current_folder == -1) {
-        MessageBox(hwndMain, "Please select a list first!", "No Selection", MB_OK | MB_ICONWARNING);
+    if (current_smart >= 0) {
+        ChangeSmartSelection(STORE_BATCH_DELETE, NULL, -1);
         return;
     }
 
-    int sel = SendMessage(hwndTaskList, LB_GETCURSEL, 0, 0);
-    if (sel == LB_ERR) {
-        MessageBox(hwndMain, "Please select a task!", "No Selection", MB_OK | MB_ICONWARNING);
+    int count;
+    int *tasks = RequireSelection(&count);
+    if (tasks == NULL) {
         return;
     }
 
-    Folder *current = &folders[current_folder];
-    
-    for (int i = sel; i < current->task_count - 1; i++) {
-        current->tasks[i] = current->tasks[i + 1];
+    Folder *current = &store.folders[store.current_folder];
+    if (count > 1) {
+        TodoBatch *batch = BeginBatch();
+        int queued = batch != NULL;
+
+        for (int i = 0; queued && i < count; i++) {
+            queued = batch_delete_task(batch, store.current_folder, tasks[i]);
+        }
+        free(tasks);
+        if (batch != NULL && RecordBatch(batch, queued)) {
+            RefreshLists();
+        }
+        return;
+    }
+
+    int task = tasks[0];
+    free(tasks);
+    const Task *selected = store_task(&store, current, task);
+    char deadline[DATE_TEXT_LENGTH];
+    date_format(selected->deadline_day, deadline);
+    if (!RecordChange(JOURNAL_DELETE_TASK, current->id, task,
+                      store_text(&store, selected->description), deadline)) {
+        return;
     }
-    current->task_count = asm_subtract(current->task_count, 1);
     
-    UpdateFolderList();
-    UpdateTaskList();
+    RefreshLists();
+}
+
+// Move the selected tasks to the list named in the list name box
+void MoveSelectedTasks() {
+    int count;
+    int *tasks = NULL;
+    if (current_smart < 0 && (tasks = RequireSelection(&count)) == NULL) {
+        return;
+    }
+
+    char *name = GetEditText(IDC_EDIT_LIST_NAME);
+    int target = -1;
+    for (int i = 0; name != NULL && i < store.folder_count; i++) {
+        if (strcmp(store_text(&store, store.folders[i].name), name) == 0) {
+            target = i;
+            break;
+        }
+    }
+    free(name);
+    if (target < 0 || target == store.current_folder) {
+        free(tasks);
+        MessageBox(hwndMain, "Please enter the name of another list to move the tasks to!", "Input Error",
+                   MB_OK | MB_ICONWARNING);
+        return;
+    }
+    store_materialize(&store, target);
+    if (current_smart >= 0) {
+        if (ChangeSmartSelection(0, NULL, target)) SetDlgItemTextW(hwndMain, IDC_EDIT_LIST_NAME, L"");
+        return;
+    }
+
+    TodoBatch *batch = BeginBatch();
+    int queued = batch != NULL;
+    for (int i = 0; queued && i < count; i++) {
+        queued = batch_move_task(batch, store.current_folder, tasks[i], target);
+    }
+    free(tasks);
+    if (batch == NULL || !RecordBatch(batch, queued)) {
+        return;
+    }
+    SetDlgItemTextW(hwndMain, IDC_EDIT_LIST_NAME, L"");
+    RefreshLists();
+}
+
+// Delete every completed task of the current list
+void ClearCompletedTasks() {
+    if (store.current_folder == -1) {
+        MessageBox(hwndMain, "Please select a list first!", "No Selection", MB_OK | MB_ICONWARNING);
+        return;
+    }
+
+    Folder *current = &store.folders[store.current_folder];
+    int completed = 0;
+    for (int i = 0; i < current->task_count; i++) {
+        completed += store_task(&store, current, i)->completed;
+    }
+    if (completed == 0) {
+        MessageBox(hwndMain, "No completed tasks in this list.", "Clear Done", MB_OK | MB_ICONINFORMATION);
+        return;
+    }
+
+    char message[64];
+    snprintf(message, sizeof(message), "Delete %d completed task%s?", completed, completed == 1 ? "" : "s");
+    if (MessageBox(hwndMain, message, "Confirm Delete", MB_YESNO | MB_ICONQUESTION) != IDYES) {
+        return;
+    }
+
+    TodoBatch *batch = BeginBatch();
+    int queued = batch != NULL;
+    // Completed tasks sort after the open ones
+    for (int i = current->task_count - completed; queued && i < current->task_count; i++) {
+        queued = batch_delete_task(batch, store.current_folder, i);
+    }
+    if (batch != NULL && RecordBatch(batch, queued)) {
+        RefreshLists();
+    }
 }
 
 void LoadDataWithWarning() {
     // Show warning dialog
     int result = MessageBox(hwndMain,
-        "WARNING: Loading saved data will OVERWRITE all current unsaved lists and tasks!\n\n"
+        "WARNING: Loading will discard the lists in memory and re-read them from 'todo_data.dat'!\n\n"
         "Are you sure you want to continue?\n\n"
-        "Click 'Yes' to load saved data (current data will be lost)\n"
-        "Click 'No' to keep current data",
+        "Click 'Yes' to reload saved data\n"
+        "Click 'No' to keep the current view",
         "Load Data Warning",
         MB_YESNO | MB_ICONWARNING | MB_DEFBUTTON2);
     
@@ -513,8 +1606,9 @@ void LoadDataWithWarning() {
     
     // Proceed with loading
     if (load_data()) {
-        UpdateFolderList();
-        UpdateTaskList();
+        // Undo steps refer to the lists that were just discarded
+        history_clear(history);
+        RefreshLists();
         MessageBox(hwndMain, "Data loaded successfully from 'todo_data.dat'!", "Load Complete", MB_OK | MB_ICONINFORMATION);
     } else {
         MessageBox(hwndMain, "No saved data file found.", "Load Data", MB_OK | MB_ICONINFORMATION);
@@ -549,15 +1643,31 @@ void ResizeControls(HWND hwnd) {
     HWND hwndBtnDeleteList = GetDlgItem(hwnd, IDC_BTN_DELETE_LIST);
     HWND hwndBtnSave = GetDlgItem(hwnd, IDC_BTN_SAVE);
     HWND hwndBtnLoad = GetDlgItem(hwnd, IDC_BTN_LOAD);
+    HWND hwndBtnUndo = GetDlgItem(hwnd, IDC_BTN_UNDO);
+    HWND hwndBtnRedo = GetDlgItem(hwnd, IDC_BTN_REDO);
+    HWND hwndBtnSaveQuery = GetDlgItem(hwnd, IDC_BTN_SAVE_QUERY);
     
     HWND hwndLabelTasks = GetDlgItem(hwnd, 2003);
+    HWND hwndLabelSort = GetDlgItem(hwnd, 2008);
+    HWND hwndComboSort = GetDlgItem(hwnd, IDC_COMBO_SORT);
+    HWND hwndLabelSearch = GetDlgItem(hwnd, 2006);
+    HWND hwndEditSearch = GetDlgItem(hwnd, IDC_EDIT_SEARCH);
     HWND hwndLabelTaskDesc = GetDlgItem(hwnd, 2004);
     HWND hwndLabelDeadline = GetDlgItem(hwnd, 2005);
     HWND hwndEditTaskDesc = GetDlgItem(hwnd, IDC_EDIT_TASK_DESC);
     HWND hwndEditDeadline = GetDlgItem(hwnd, IDC_EDIT_DEADLINE);
+    HWND hwndLabelRepeat = GetDlgItem(hwnd, 2007);
+    HWND hwndEditRepeat = GetDlgItem(hwnd, IDC_EDIT_REPEAT);
+    HWND hwndLabelPriority = GetDlgItem(hwnd, 2009);
+    HWND hwndComboPriority = GetDlgItem(hwnd, IDC_COMBO_PRIORITY);
+    HWND hwndLabelTags = GetDlgItem(hwnd, 2010);
+    HWND hwndEditTags = GetDlgItem(hwnd, IDC_EDIT_TAGS);
     HWND hwndBtnAddTask = GetDlgItem(hwnd, IDC_BTN_ADD_TASK);
     HWND hwndBtnComplete = GetDlgItem(hwnd, IDC_BTN_COMPLETE_TASK);
     HWND hwndBtnDeleteTask = GetDlgItem(hwnd, IDC_BTN_DELETE_TASK);
+    HWND hwndBtnTagTask = GetDlgItem(hwnd, IDC_BTN_TAG_TASK);
+    HWND hwndBtnMoveTasks = GetDlgItem(hwnd, IDC_BTN_MOVE_TASKS);
+    HWND hwndBtnClearDone = GetDlgItem(hwnd, IDC_BTN_CLEAR_DONE);
     
     // === TOP SECTION ===
     // Current list label at top (with text wrapping)
@@ -571,7 +1681,7 @@ void ResizeControls(HWND hwnd) {
     leftY += 20;
     
     // Lists listbox
-    int listBoxHeight = height - 320;
+    int listBoxHeight = height - 355;
     SetWindowPos(hwndFolderList, NULL, 10, leftY, leftPanelWidth, listBoxHeight, SWP_NOZORDER);
     leftY += listBoxHeight + 10;
     
@@ -591,13 +1701,30 @@ void ResizeControls(HWND hwnd) {
     // Save/Load buttons
     SetWindowPos(hwndBtnSave, NULL, 10, leftY, leftPanelWidth / 2 - 5, 30, SWP_NOZORDER);
     SetWindowPos(hwndBtnLoad, NULL, leftPanelWidth / 2 + 15, leftY, leftPanelWidth / 2 - 5, 30, SWP_NOZORDER);
+    leftY += 35;
+    
+    // Undo/Redo buttons
+    SetWindowPos(hwndBtnUndo, NULL, 10, leftY, leftPanelWidth / 2 - 5, 30, SWP_NOZORDER);
+    SetWindowPos(hwndBtnRedo, NULL, leftPanelWidth / 2 + 15, leftY, leftPanelWidth / 2 - 5, 30, SWP_NOZORDER);
+    leftY += 35;
+
+    // Save Query button
+    SetWindowPos(hwndBtnSaveQuery, NULL, 10, leftY, leftPanelWidth, 30, SWP_NOZORDER);
     
     // === RIGHT PANEL (Tasks) ===
     int rightY = 40;
     
-    // "Tasks:" label
-    SetWindowPos(hwndLabelTasks, NULL, rightPanelX, rightY, rightPanelWidth, 18, SWP_NOZORDER);
-    rightY += 20;
+    // "Tasks:" label, then the sort order, with the search box on the right
+    // of the same row
+    int searchWidth = rightPanelWidth / 2;
+    int sortWidth = 120;
+    int tasksWidth = rightPanelWidth - searchWidth - sortWidth - 105;
+    SetWindowPos(hwndLabelTasks, NULL, rightPanelX, rightY, tasksWidth, 18, SWP_NOZORDER);
+    SetWindowPos(hwndLabelSort, NULL, rightPanelX + tasksWidth + 5, rightY, 35, 18, SWP_NOZORDER);
+    SetWindowPos(hwndComboSort, NULL, rightPanelX + tasksWidth + 40, rightY - 3, sortWidth, 200, SWP_NOZORDER);
+    SetWindowPos(hwndLabelSearch, NULL, rightPanelX + rightPanelWidth - searchWidth - 55, rightY, 50, 18, SWP_NOZORDER);
+    SetWindowPos(hwndEditSearch, NULL, rightPanelX + rightPanelWidth - searchWidth, rightY - 3, searchWidth, 22, SWP_NOZORDER);
+    rightY += 22;
     
     // Tasks listbox
     int taskBoxHeight = height - 290;
@@ -612,19 +1739,32 @@ void ResizeControls(HWND hwnd) {
     SetWindowPos(hwndEditTaskDesc, NULL, rightPanelX, rightY, rightPanelWidth, 25, SWP_NOZORDER);
     rightY += 30;
     
-    // "Deadline (YYYY-MM-DD):" label
-    SetWindowPos(hwndLabelDeadline, NULL, rightPanelX, rightY, rightPanelWidth, 18, SWP_NOZORDER);
+    // "Deadline (YYYY-MM-DD):", "Repeat:", "Tags:" and "Priority:" labels
+    // side by side
+    int priorityWidth = 90;
+    int fieldWidth = (rightPanelWidth - priorityWidth - 30) / 3;
+    int priorityX = rightPanelX + rightPanelWidth - priorityWidth;
+    SetWindowPos(hwndLabelDeadline, NULL, rightPanelX, rightY, fieldWidth, 18, SWP_NOZORDER);
+    SetWindowPos(hwndLabelRepeat, NULL, rightPanelX + fieldWidth + 10, rightY, fieldWidth, 18, SWP_NOZORDER);
+    SetWindowPos(hwndLabelTags, NULL, rightPanelX + (fieldWidth + 10) * 2, rightY, fieldWidth, 18, SWP_NOZORDER);
+    SetWindowPos(hwndLabelPriority, NULL, priorityX, rightY, priorityWidth, 18, SWP_NOZORDER);
     rightY += 20;
     
-    // Deadline input - full width like task description
-    SetWindowPos(hwndEditDeadline, NULL, rightPanelX, rightY, rightPanelWidth, 25, SWP_NOZORDER);
+    // Deadline, repeat and tags inputs share the width left by the priority
+    SetWindowPos(hwndEditDeadline, NULL, rightPanelX, rightY, fieldWidth, 25, SWP_NOZORDER);
+    SetWindowPos(hwndEditRepeat, NULL, rightPanelX + fieldWidth + 10, rightY, fieldWidth, 25, SWP_NOZORDER);
+    SetWindowPos(hwndEditTags, NULL, rightPanelX + (fieldWidth + 10) * 2, rightY, fieldWidth, 25, SWP_NOZORDER);
+    SetWindowPos(hwndComboPriority, NULL, priorityX, rightY, priorityWidth, 120, SWP_NOZORDER);
     rightY += 30;
     
     // Task action buttons
-    int buttonWidth = (rightPanelWidth - 20) / 3;
+    int buttonWidth = (rightPanelWidth - 50) / 6;
     SetWindowPos(hwndBtnAddTask, NULL, rightPanelX, rightY, buttonWidth, 30, SWP_NOZORDER);
     SetWindowPos(hwndBtnComplete, NULL, rightPanelX + buttonWidth + 10, rightY, buttonWidth, 30, SWP_NOZORDER);
     SetWindowPos(hwndBtnDeleteTask, NULL, rightPanelX + (buttonWidth + 10) * 2, rightY, buttonWidth, 30, SWP_NOZORDER);
+    SetWindowPos(hwndBtnTagTask, NULL, rightPanelX + (buttonWidth + 10) * 3, rightY, buttonWidth, 30, SWP_NOZORDER);
+    SetWindowPos(hwndBtnMoveTasks, NULL, rightPanelX + (buttonWidth + 10) * 4, rightY, buttonWidth, 30, SWP_NOZORDER);
+    SetWindowPos(hwndBtnClearDone, NULL, rightPanelX + (buttonWidth + 10) * 5, rightY, buttonWidth, 30, SWP_NOZORDER);
 }
 
 // Window Procedure
@@ -632,8 +1772,8 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
     switch (uMsg) {
         case WM_CREATE: {
             // Create current label with word ellipsis style
-            hwndCurrentLabel = CreateWindowEx(
-                0, "STATIC", "No list selected",
+            hwndCurrentLabel = CreateWindowExW(
+                0, L"STATIC", L"No list selected",
                 WS_VISIBLE | WS_CHILD | SS_LEFT | SS_ENDELLIPSIS,
                 10, 10, 760, 20,
                 hwnd, (HMENU)IDC_STATIC_CURRENT, NULL, NULL
@@ -649,9 +1789,9 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             );
             
             // Folder listbox with horizontal scroll
-            hwndFolderList = CreateWindowEx(
-                WS_EX_CLIENTEDGE, "LISTBOX", "",
-                WS_CHILD | WS_VISIBLE | WS_VSCROLL | WS_HSCROLL | LBS_NOTIFY,
+            hwndFolderList = CreateWindowExW(
+                WS_EX_CLIENTEDGE, L"LISTBOX", L"",
+                WS_CHILD | WS_VISIBLE | WS_VSCROLL | WS_HSCROLL | LBS_NOTIFY | LBS_OWNERDRAWFIXED | LBS_NODATA,
                 10, 60, 200, 200,
                 hwnd, (HMENU)IDC_LISTBOX_FOLDERS, NULL, NULL
             );
@@ -665,8 +1805,8 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             );
             
             // New list name input
-            CreateWindowEx(
-                WS_EX_CLIENTEDGE, "EDIT", "",
+            CreateWindowExW(
+                WS_EX_CLIENTEDGE, L"EDIT", L"",
                 WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL,
                 10, 290, 200, 25,
                 hwnd, (HMENU)IDC_EDIT_LIST_NAME, NULL, NULL
@@ -699,20 +1839,75 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
                 115, 360, 95, 30,
                 hwnd, (HMENU)IDC_BTN_LOAD, NULL, NULL
             );
+            
+            // Undo/Redo buttons
+            CreateWindowEx(
+                0, "BUTTON", "Undo",
+                WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                10, 400, 95, 30,
+                hwnd, (HMENU)IDC_BTN_UNDO, NULL, NULL
+            );
+            CreateWindowEx(
+                0, "BUTTON", "Redo",
+                WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                115, 400, 95, 30,
+                hwnd, (HMENU)IDC_BTN_REDO, NULL, NULL
+            );
+
+            // Save the search box query as a smart list
+            CreateWindowEx(
+                0, "BUTTON", "Save Query",
+                WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                10, 440, 200, 30,
+                hwnd, (HMENU)IDC_BTN_SAVE_QUERY, NULL, NULL
+            );
 
             // === RIGHT PANEL ===
             // "Tasks:" label
             CreateWindowEx(
                 0, "STATIC", "Tasks:",
                 WS_VISIBLE | WS_CHILD | SS_LEFT,
-                230, 40, 540, 18,
+                230, 40, 45, 18,
                 hwnd, (HMENU)2003, NULL, NULL
             );
+
+            // Order of the task list
+            CreateWindowEx(
+                0, "STATIC", "Sort:",
+                WS_VISIBLE | WS_CHILD | SS_LEFT,
+                280, 40, 35, 18,
+                hwnd, (HMENU)2008, NULL, NULL
+            );
+            CreateWindowEx(
+                0, "COMBOBOX", "",
+                WS_CHILD | WS_VISIBLE | WS_VSCROLL | CBS_DROPDOWNLIST,
+                315, 37, 120, 200,
+                hwnd, (HMENU)IDC_COMBO_SORT, NULL, NULL
+            );
+            for (int i = 0; i < SORT_PRESET_COUNT; i++) {
+                SendDlgItemMessage(hwnd, IDC_COMBO_SORT, CB_ADDSTRING, 0, (LPARAM)sort_preset_name(i));
+            }
+            SendDlgItemMessage(hwnd, IDC_COMBO_SORT, CB_SETCURSEL, SORT_PRESET_DEADLINE, 0);
+
+            // Search box filtering the task list
+            CreateWindowEx(
+                0, "STATIC", "Search:",
+                WS_VISIBLE | WS_CHILD | SS_LEFT,
+                445, 40, 50, 18,
+                hwnd, (HMENU)2006, NULL, NULL
+            );
+            CreateWindowExW(
+                WS_EX_CLIENTEDGE, L"EDIT", L"",
+                WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL,
+                500, 37, 270, 22,
+                hwnd, (HMENU)IDC_EDIT_SEARCH, NULL, NULL
+            );
             
             // Task listbox with horizontal scroll
-            hwndTaskList = CreateWindowEx(
-                WS_EX_CLIENTEDGE, "LISTBOX", "",
-                WS_CHILD | WS_VISIBLE | WS_VSCROLL | WS_HSCROLL | LBS_NOTIFY,
+            hwndTaskList = CreateWindowExW(
+                WS_EX_CLIENTEDGE, L"LISTBOX", L"",
+                WS_CHILD | WS_VISIBLE | WS_VSCROLL | WS_HSCROLL | LBS_NOTIFY | LBS_EXTENDEDSEL | LBS_OWNERDRAWFIXED |
+                LBS_NODATA,
                 230, 60, 540, 400,
                 hwnd, (HMENU)IDC_LISTBOX_TASKS, NULL, NULL
             );
@@ -726,8 +1921,8 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             );
             
             // Task description input
-            CreateWindowEx(
-                WS_EX_CLIENTEDGE, "EDIT", "",
+            CreateWindowExW(
+                WS_EX_CLIENTEDGE, L"EDIT", L"",
                 WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL,
                 230, 490, 540, 25,
                 hwnd, (HMENU)IDC_EDIT_TASK_DESC, NULL, NULL
@@ -737,42 +1932,129 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             CreateWindowEx(
                 0, "STATIC", "Deadline (YYYY-MM-DD):",
                 WS_VISIBLE | WS_CHILD | SS_LEFT,
-                230, 520, 540, 18,
+                230, 520, 140, 18,
                 hwnd, (HMENU)2005, NULL, NULL
             );
             
-            // Deadline input - full width
+            // Deadline input - left
             CreateWindowEx(
                 WS_EX_CLIENTEDGE, "EDIT", "",
                 WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL,
-                230, 540, 540, 25,
+                230, 540, 140, 25,
                 hwnd, (HMENU)IDC_EDIT_DEADLINE, NULL, NULL
             );
 
+            // "Repeat:" label
+            CreateWindowEx(
+                0, "STATIC", "Repeat (e.g. weekly, every 2 weeks):",
+                WS_VISIBLE | WS_CHILD | SS_LEFT,
+                380, 520, 140, 18,
+                hwnd, (HMENU)2007, NULL, NULL
+            );
+
+            // Repeat input - next to the deadline, empty for a one-off task
+            CreateWindowEx(
+                WS_EX_CLIENTEDGE, "EDIT", "",
+                WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL,
+                380, 540, 140, 25,
+                hwnd, (HMENU)IDC_EDIT_REPEAT, NULL, NULL
+            );
+
+            // "Tags:" label and input; the tags of a new task, or the
+            // new tags of the selected one
+            CreateWindowEx(
+                0, "STATIC", "Tags (e.g. #work #urgent):",
+                WS_VISIBLE | WS_CHILD | SS_LEFT,
+                530, 520, 140, 18,
+                hwnd, (HMENU)2010, NULL, NULL
+            );
+            CreateWindowExW(
+                WS_EX_CLIENTEDGE, L"EDIT", L"",
+                WS_CHILD | WS_VISIBLE | ES_AUTOHSCROLL,
+                530, 540, 140, 25,
+                hwnd, (HMENU)IDC_EDIT_TAGS, NULL, NULL
+            );
+
+            // Priority of a new task, in PRIORITY_* order
+            CreateWindowEx(
+                0, "STATIC", "Priority:",
+                WS_VISIBLE | WS_CHILD | SS_LEFT,
+                680, 520, 90, 18,
+                hwnd, (HMENU)2009, NULL, NULL
+            );
+            CreateWindowEx(
+                0, "COMBOBOX", "",
+                WS_CHILD | WS_VISIBLE | WS_VSCROLL | CBS_DROPDOWNLIST,
+                680, 540, 90, 120,
+                hwnd, (HMENU)IDC_COMBO_PRIORITY, NULL, NULL
+            );
+            SendDlgItemMessage(hwnd, IDC_COMBO_PRIORITY, CB_ADDSTRING, 0, (LPARAM)"None");
+            SendDlgItemMessage(hwnd, IDC_COMBO_PRIORITY, CB_ADDSTRING, 0, (LPARAM)"Low");
+            SendDlgItemMessage(hwnd, IDC_COMBO_PRIORITY, CB_ADDSTRING, 0, (LPARAM)"Medium");
+            SendDlgItemMessage(hwnd, IDC_COMBO_PRIORITY, CB_ADDSTRING, 0, (LPARAM)"High");
+            SendDlgItemMessage(hwnd, IDC_COMBO_PRIORITY, CB_SETCURSEL, PRIORITY_NONE, 0);
+
             // Task action buttons
             CreateWindowEx(
                 0, "BUTTON", "Add Task",
                 WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
-                230, 575, 120, 30,
+                230, 575, 85, 30,
                 hwnd, (HMENU)IDC_BTN_ADD_TASK, NULL, NULL
             );
             CreateWindowEx(
                 0, "BUTTON", "Complete Task",
                 WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
-                360, 575, 120, 30,
+                320, 575, 85, 30,
                 hwnd, (HMENU)IDC_BTN_COMPLETE_TASK, NULL, NULL
             );
             CreateWindowEx(
                 0, "BUTTON", "Delete Task",
                 WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
-                490, 575, 120, 30,
+                410, 575, 85, 30,
                 hwnd, (HMENU)IDC_BTN_DELETE_TASK, NULL, NULL
             );
+            CreateWindowEx(
+                0, "BUTTON", "Set Tags",
+                WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                500, 575, 85, 30,
+                hwnd, (HMENU)IDC_BTN_TAG_TASK, NULL, NULL
+            );
+            CreateWindowEx(
+                0, "BUTTON", "Move Tasks",
+                WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                590, 575, 85, 30,
+                hwnd, (HMENU)IDC_BTN_MOVE_TASKS, NULL, NULL
+            );
+            CreateWindowEx(
+                0, "BUTTON", "Clear Done",
+                WS_VISIBLE | WS_CHILD | BS_PUSHBUTTON,
+                680, 575, 85, 30,
+                hwnd, (HMENU)IDC_BTN_CLEAR_DONE, NULL, NULL
+            );
+
+            // Views follow the store from here on
+            view_init(&folder_view, FormatFolderRow, MeasureRow, hwndFolderList);
+            view_init(&task_view, FormatTaskRow, MeasureRow, hwndTaskList);
+            today = date_today();
+            stats = stats_create(&store, today);    // Before the views format rows from it
+            search = search_create(&store);
+            tag_index = tags_create(&store);
+            query_index = query_create(&store);
+            store_listen(&store, OnStoreChange, NULL);  // After the query index, which a filter runs on
+            history = history_create(HISTORY_DEFAULT_BUDGET);
 
             // Load data at startup
+            journal = journal_create(DATA_FILE);
+            if (journal && columnar_sections) journal_set_encoding(journal, TODOFMT_COLUMNAR);
             load_data();
-            UpdateFolderList();
-            UpdateTaskList();
+            LoadSmartLists();
+            reminders = remind_create(OnReminder, NULL);
+            if (reminders && remind_follow(reminders, &store, reminder_days, 2, REMIND_DEFAULT_MINUTE)) {
+                remind_start(reminders);
+            }
+            SetTimer(hwnd, IDT_JOURNAL, 1000, NULL);
+            ScheduleRollover(hwnd);
+            RefreshLists();
             
             break;
         }
@@ -782,6 +2064,22 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
             break;
         }
 
+        // Both listboxes are owner-drawn, one line of the window's font a row
+        case WM_MEASUREITEM: {
+            MEASUREITEMSTRUCT *measure = (MEASUREITEMSTRUCT *)lParam;
+            HDC hdc = GetDC(hwnd);
+            TEXTMETRIC metrics;
+
+            GetTextMetrics(hdc, &metrics);
+            ReleaseDC(hwnd, hdc);
+            measure->itemHeight = metrics.tmHeight;
+            return TRUE;
+        }
+
+        case WM_DRAWITEM:
+            DrawRow((const DRAWITEMSTRUCT *)lParam);
+            return TRUE;
+
         case WM_GETMINMAXINFO: {
             MINMAXINFO *mmi = (MINMAXINFO*)lParam;
             mmi->ptMinTrackSize.x = 600;
@@ -792,38 +2090,132 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
         case WM_COMMAND: {
             switch (LOWORD(wParam)) {
                 case IDC_BTN_CREATE_LIST:
-                    CreateNewList();
+                    TRACE_CALL(TRACE_CREATE_LIST, CreateNewList());
                     break;
                 case IDC_BTN_DELETE_LIST:
-                    DeleteCurrentList();
+                    TRACE_CALL(TRACE_DELETE_LIST, DeleteCurrentList());
                     break;
                 case IDC_BTN_ADD_TASK:
-                    AddNewTask();
+                    TRACE_CALL(TRACE_ADD_TASK, AddNewTask());
                     break;
                 case IDC_BTN_COMPLETE_TASK:
-                    CompleteSelectedTask();
+                    TRACE_CALL(TRACE_COMPLETE_TASK, CompleteSelectedTask());
                     break;
                 case IDC_BTN_DELETE_TASK:
-                    DeleteSelectedTask();
+                    TRACE_CALL(TRACE_DELETE_TASK, DeleteSelectedTask());
+                    break;
+                case IDC_BTN_TAG_TASK:
+                    TRACE_CALL(TRACE_TAG_TASK, TagSelectedTask());
+                    break;
+                case IDC_BTN_MOVE_TASKS:
+                    TRACE_CALL(TRACE_MOVE_TASKS, MoveSelectedTasks());
+                    break;
+                case IDC_BTN_CLEAR_DONE:
+                    TRACE_CALL(TRACE_CLEAR_DONE, ClearCompletedTasks());
                     break;
                 case IDC_BTN_SAVE:
-                    save_data();
+                    TRACE_CALL(TRACE_SAVE, save_data());
                     break;
                 case IDC_BTN_LOAD:
                     LoadDataWithWarning();
                     break;
+                case IDC_BTN_UNDO:
+                    TRACE_CALL(TRACE_UNDO, UndoChange());
+                    break;
+                case IDC_BTN_REDO:
+                    TRACE_CALL(TRACE_REDO, RedoChange());
+                    break;
+                case IDC_BTN_SAVE_QUERY:
+                    TRACE_CALL(TRACE_SAVE_QUERY, SaveQuery());
+                    break;
+                case IDC_EDIT_SEARCH:
+                    if (HIWORD(wParam) == EN_CHANGE) {
+                        TRACE_CALL(TRACE_FILTER, UpdateFilter());
+                    }
+                    break;
+                case IDC_COMBO_SORT:
+                    if (HIWORD(wParam) == CBN_SELCHANGE) {
+                        TRACE_CALL(TRACE_SORT, UpdateOrder());
+                    }
+                    break;
                 case IDC_LISTBOX_FOLDERS:
                     if (HIWORD(wParam) == LBN_SELCHANGE) {
-                        current_folder = SendMessage(hwndFolderList, LB_GETCURSEL, 0, 0);
-                        UpdateTaskList();
+                        TRACE_CALL(TRACE_SWITCH_FOLDER,
+                                   SwitchFolder(SendMessage(hwndFolderList, LB_GETCURSEL, 0, 0)));
+                    }
+                    break;
+                case IDC_LISTBOX_TASKS:
+                    if (HIWORD(wParam) == LBN_SELCHANGE) {
+                        SelectTask();
                     }
                     break;
             }
             break;
         }
 
+        case WM_TIMER: {
+            // Swap in a checkpoint once background compaction finishes
+            if (wParam == IDT_JOURNAL) {
+                CheckJournal();
+            } else if (wParam == IDT_MIDNIGHT) {
+                RollOverDay();
+                ScheduleRollover(hwnd);
+            } else if (wParam == IDT_LOAD) {
+                // Only a smart list on screen waits for the rest of the lists
+                if (current_smart < 0 || !LoadRemainingFolders()) KillTimer(hwnd, IDT_LOAD);
+                RefreshLists();
+            }
+            break;
+        }
+
+        case WM_TIMECHANGE:
+            // The user changed the clock or time zone
+            RollOverDay();
+            ScheduleRollover(hwnd);
+            if (reminders) remind_wake(reminders);
+            break;
+
+        case WM_APP_REMINDER:
+            ShowReminder((const TodoReminder *)lParam);
+            free((void *)lParam);
+            return 0;
+
         case WM_DESTROY:
-            save_data(); // Auto-save on exit
+            // Writes only what is still queued; with nothing changed since
+            // the last write, exiting touches no file
+            KillTimer(hwnd, IDT_JOURNAL);
+            KillTimer(hwnd, IDT_MIDNIGHT);
+            KillTimer(hwnd, IDT_LOAD);
+            remind_destroy(reminders);
+            reminders = NULL;
+            journal_destroy(journal, &store);
+            journal = NULL;
+            if (trace_flags) {
+                trace_write_chrome(TRACE_FILE);
+                trace_disable();
+            }
+            view_free(&folder_view);
+            view_free(&task_view);
+            search_destroy(search);
+            search = NULL;
+            tags_destroy(tag_index);
+            tag_index = NULL;
+            query_destroy(query_index);
+            query_index = NULL;
+            stats_destroy(stats);
+            stats = NULL;
+            tags_free_filter(tag_filter);
+            tag_filter = NULL;
+            bitmap_free(&tag_matches);
+            query_free(filter_query);
+            filter_query = NULL;
+            query_result_free(&query_matches);
+            query_result_free(&smart_tasks);
+            FreeSmartLists();
+            history_destroy(history);
+            history = NULL;
+            free(filter_text);
+            filter_text = NULL;
             PostQuitMessage(0);
             return 0;
     }
@@ -833,6 +2225,19 @@ LRESULT CALLBACK WindowProc(HWND hwnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 // WinMain entry point
 int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine, int nCmdShow) {
     const char CLASS_NAME[] = "TodoManagerWindowClass";
+    const char *trace = getenv("TODO_TRACE");
+    const char *columnar = getenv("TODO_COLUMNAR");
+
+    // TODO_TRACE=1 keeps latency histograms, TODO_TRACE=events also keeps
+    // a timeline; both are written to todo_trace.json on exit
+    if (trace != NULL && *trace != '\0' && strcmp(trace, "0") != 0) {
+        trace_enable(strcmp(trace, "events") == 0 ? TRACE_HISTOGRAMS | TRACE_EVENTS : TRACE_HISTOGRAMS,
+                     TRACE_DEFAULT_EVENTS);
+    }
+
+    // TODO_COLUMNAR=1 writes the data file in the compressed columnar
+    // encoding from the next checkpoint on
+    columnar_sections = columnar != NULL && *columnar != '\0' && strcmp(columnar, "0") != 0;
 
     WNDCLASS wc = {0};
     wc.lpfnWndProc = WindowProc;
@@ -846,7 +2251,7 @@ int WINAPI WinMain(HINSTANCE hInstance, HINSTANCE hPrevInstance, LPSTR lpCmdLine
     hwndMain = CreateWindowEx(
         0,
         CLASS_NAME,
-        "To-Do List Manager (C + Assembly)",
+        WINDOW_TITLE,
         WS_OVERLAPPEDWINDOW,
         CW_USEDEFAULT, CW_USEDEFAULT, 800, 660,
         NULL, NULL, hInstance, NULL
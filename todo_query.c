@@ -0,0 +1,1175 @@
+#include "todo_query.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include "todo_date.h"
+#include "todo_tags.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define QUERY_USE_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#define QUERY_MAX_DEPTH 32      // Nested parentheses and negations
+#define QUERY_MAX_TERMS 1024    // Terms and operators of one query
+#define QUERY_LANES 64          // Slots per evaluation block; columns grow in whole blocks
+#define QUERY_MAX_OFFSET 999999 // Days either side of today
+#define QUERY_MAX_TABLE 65536   // Largest folder id looked up in a table rather than compared one by one
+
+// Steps, and the nodes of the tree they are compiled from
+enum {
+    OP_DONE = 1,
+    OP_REPEATS,
+    OP_UNDATED,
+    OP_DUE,             // Deadline from lo to hi
+    OP_PRIORITY,        // Priority from lo to hi
+    OP_FOLDER,          // In a folder named text
+    OP_TEXT,            // Description contains text
+    OP_TAG,             // Carries the tag text
+    OP_NOT,
+    OP_AND,
+    OP_OR
+};
+
+// Step flags
+#define STEP_LO_TODAY 1     // lo is days from today
+#define STEP_HI_TODAY 2
+#define STEP_FUSED 4        // OP_TEXT, OP_TAG: test only the slots of the mask on top and replace it
+#define STEP_NEGATE 8       // With STEP_FUSED: keep the slots that fail the test
+#define STEP_CONTAINS 16    // OP_FOLDER: names containing text rather than equal to it
+
+// Comparisons
+enum {
+    CMP_EQ = 1,
+    CMP_NE,
+    CMP_LT,
+    CMP_LE,
+    CMP_GT,
+    CMP_GE,
+    CMP_CONTAINS
+};
+
+typedef struct {
+    uint8_t op;
+    uint8_t flags;
+    int32_t lo;
+    int32_t hi;
+    uint32_t text_offset;   // Folded value in the query's strings
+    uint32_t text_length;
+} QueryStep;
+
+struct TodoQuery {
+    QueryStep *steps;       // Postfix
+    int count;
+    int depth;              // Deepest the evaluation stack gets
+    char *strings;
+    size_t strings_size;
+};
+
+// Column bits of a slot's state
+#define SLOT_LIVE 1
+#define SLOT_DONE 2
+#define SLOT_REPEATS 4
+#define SLOT_PRIORITY_SHIFT 3   // Two bits
+
+struct TodoQueryIndex {
+    TodoStore *store;
+    int32_t *deadlines;         // By task slot index
+    uint32_t *folders;          // Folder id
+    uint32_t *handles;
+    uint32_t *letters;          // letters_of() the description
+    uint32_t *tag_bits;         // tag_bits_of() the tags
+    uint8_t *states;            // SLOT_*; 0 for a slot holding no indexed task
+    uint32_t slot_capacity;     // A multiple of QUERY_LANES
+    uint32_t slot_end;          // Above every slot indexed since the last rebuild
+};
+
+static unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+static int is_name_byte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           c == '-' || c == '_' || c >= 0x80;
+}
+
+static int lowest_bit(uint64_t word) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(word);
+#else
+    int bit = 0;
+
+    while (!(word & 1)) {
+        word >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+// A bit for each of the letters a-z, in either case, and digits that
+// appear in text. Text containing a needle has all of the needle's bits,
+// so most descriptions fail a text test on their bits alone.
+static uint32_t letters_of(const char *text, size_t length) {
+    uint32_t letters = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = fold((unsigned char)text[i]);
+
+        if (c >= 'a' && c <= 'z') letters |= 1u << (c - 'a');
+        if (c >= '0' && c <= '9') letters |= 1u << (26 + (c - '0') % 6);
+    }
+    return letters;
+}
+
+// A bit per tag name, picked by its hash; canonical tags are names
+// separated by single spaces
+static uint32_t tag_bits_of(const char *tags, size_t length) {
+    uint32_t bits = 0;
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i <= length; i++) {
+        if (i == length || tags[i] == ' ') {
+            if (i > 0) bits |= 1u << (hash & 31);
+            hash = 2166136261u;
+            continue;
+        }
+        hash = (hash ^ (unsigned char)tags[i]) * 16777619u;
+    }
+    return bits;
+}
+
+// Does text contain a needle that is already folded? Candidates are found
+// by the first byte in either case before anything is folded.
+static int contains_folded(const char *text, size_t length, const char *needle, size_t needle_length) {
+    unsigned char first = (unsigned char)needle[0];
+    unsigned char upper = (first >= 'a' && first <= 'z') ? (unsigned char)(first - 'a' + 'A') : first;
+
+    for (size_t i = 0; i + needle_length <= length; i++) {
+        unsigned char c = (unsigned char)text[i];
+        size_t k = 1;
+
+        if (c != first && c != upper) continue;
+        while (k < needle_length && fold((unsigned char)text[i + k]) == (unsigned char)needle[k]) k++;
+        if (k == needle_length) return 1;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Columns
+
+static int reserve_slot(TodoQueryIndex *index, uint32_t slot) {
+    size_t capacity = index->slot_capacity ? index->slot_capacity : 1024;
+    uint32_t old = index->slot_capacity;
+    void *grown;
+
+    if (slot < index->slot_capacity) return 1;
+    while (capacity <= slot) capacity *= 2;
+    if (capacity > UINT32_MAX) return 0;
+    // Each column keeps what it had if a later one cannot grow
+    if ((grown = realloc(index->deadlines, capacity * sizeof(int32_t))) == NULL) return 0;
+    index->deadlines = (int32_t *)grown;
+    if ((grown = realloc(index->folders, capacity * sizeof(uint32_t))) == NULL) return 0;
+    index->folders = (uint32_t *)grown;
+    if ((grown = realloc(index->handles, capacity * sizeof(uint32_t))) == NULL) return 0;
+    index->handles = (uint32_t *)grown;
+    if ((grown = realloc(index->letters, capacity * sizeof(uint32_t))) == NULL) return 0;
+    index->letters = (uint32_t *)grown;
+    if ((grown = realloc(index->tag_bits, capacity * sizeof(uint32_t))) == NULL) return 0;
+    index->tag_bits = (uint32_t *)grown;
+    if ((grown = realloc(index->states, capacity)) == NULL) return 0;
+    index->states = (uint8_t *)grown;
+    index->slot_capacity = (uint32_t)capacity;
+    memset(index->deadlines + old, 0, (capacity - old) * sizeof(int32_t));
+    memset(index->folders + old, 0, (capacity - old) * sizeof(uint32_t));
+    memset(index->handles + old, 0, (capacity - old) * sizeof(uint32_t));
+    memset(index->letters + old, 0, (capacity - old) * sizeof(uint32_t));
+    memset(index->tag_bits + old, 0, (capacity - old) * sizeof(uint32_t));
+    memset(index->states + old, 0, capacity - old);
+    return 1;
+}
+
+static void index_task(TodoQueryIndex *index, uint32_t folder_id, const Task *task) {
+    uint32_t slot = SLOTS_INDEX(task->id);
+
+    if (!reserve_slot(index, slot)) return;
+    index->deadlines[slot] = task->deadline_day;
+    index->folders[slot] = folder_id;
+    index->handles[slot] = task->id;
+    index->letters[slot] = letters_of(store_text(index->store, task->description), task->description.length);
+    index->tag_bits[slot] = tag_bits_of(store_text(index->store, task->tags), task->tags.length);
+    index->states[slot] = (uint8_t)(SLOT_LIVE | (task->completed ? SLOT_DONE : 0) | (task->rule ? SLOT_REPEATS : 0) |
+                                    ((task->priority & 3) << SLOT_PRIORITY_SHIFT));
+    if (slot >= index->slot_end) index->slot_end = slot + 1;
+}
+
+static void unindex_slot(TodoQueryIndex *index, uint32_t slot) {
+    if (slot < index->slot_end) index->states[slot] = 0;
+}
+
+static void index_folder_tasks(TodoQueryIndex *index, const Folder *folder) {
+    for (int i = 0; i < folder->task_count; i++) {
+        index_task(index, folder->id, store_task(index->store, folder, i));
+    }
+}
+
+static void rebuild_index(TodoQueryIndex *index) {
+    if (index->states) memset(index->states, 0, index->slot_end);
+    index->slot_end = 0;
+    for (int i = 0; i < index->store->folder_count; i++) {
+        if (index->store->folders[i].loaded) {
+            index_folder_tasks(index, &index->store->folders[i]);
+        }
+    }
+}
+
+TodoQueryIndex *query_create(TodoStore *store) {
+    TodoQueryIndex *index = (TodoQueryIndex *)calloc(1, sizeof(TodoQueryIndex));
+
+    if (index == NULL) return NULL;
+    index->store = store;
+    if (!store_listen(store, query_on_change, index)) {
+        free(index);
+        return NULL;
+    }
+    rebuild_index(index);
+    return index;
+}
+
+void query_destroy(TodoQueryIndex *index) {
+    if (index == NULL) return;
+    store_unlisten(index->store, query_on_change, index);
+    free(index->deadlines);
+    free(index->folders);
+    free(index->handles);
+    free(index->letters);
+    free(index->tag_bits);
+    free(index->states);
+    free(index);
+}
+
+void query_on_change(void *context, const TodoStoreChange *change) {
+    TodoQueryIndex *index = (TodoQueryIndex *)context;
+    const TodoStore *store = index->store;
+
+    switch (change->kind) {
+        case STORE_RESET:
+            rebuild_index(index);
+            break;
+        case STORE_FOLDER_LOADED:
+            index_folder_tasks(index, &store->folders[change->folder]);
+            break;
+        case STORE_FOLDER_REMOVED:
+            for (uint32_t slot = 0; slot < index->slot_end; slot++) {
+                if (index->folders[slot] == change->folder_id) index->states[slot] = 0;
+            }
+            break;
+        case STORE_TASK_ADDED:
+        case STORE_TASK_MOVED:
+            // Every column is rewritten, so a changed task needs no unindexing
+            index_task(index, change->folder_id, store_task(store, &store->folders[change->folder], change->position));
+            break;
+        case STORE_TASK_REMOVED:
+            unindex_slot(index, SLOTS_INDEX(change->task_id));
+            break;
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Syntax
+
+// A parsed term or operator; leaves carry the step they compile to
+typedef struct {
+    uint8_t op;
+    int left;
+    int right;
+    QueryStep step;
+} QueryNode;
+
+typedef struct {
+    const char *cursor;
+    TodoQuery *query;
+    QueryNode *nodes;
+    int node_count;
+    int depth;
+    int stack;
+    int error;
+} Parser;
+
+static void skip_spaces(Parser *parser) {
+    while (*parser->cursor == ' ' || *parser->cursor == '\t' || *parser->cursor == ',') parser->cursor++;
+}
+
+// Length of the word at the cursor
+static size_t word_length(const char *text) {
+    size_t length = 0;
+
+    while (text[length] != '\0' && is_name_byte((unsigned char)text[length])) length++;
+    return length;
+}
+
+static int is_keyword(const char *text, size_t length, const char *keyword) {
+    if (strlen(keyword) != length) return 0;
+    for (size_t i = 0; i < length; i++) {
+        if (fold((unsigned char)text[i]) != (unsigned char)keyword[i]) return 0;
+    }
+    return 1;
+}
+
+static int is_field(const char *text, size_t length) {
+    return is_keyword(text, length, "due") || is_keyword(text, length, "priority") ||
+           is_keyword(text, length, "folder") || is_keyword(text, length, "list") ||
+           is_keyword(text, length, "text");
+}
+
+static int node(Parser *parser, int op, int left, int right) {
+    QueryNode *entry;
+
+    if (parser->error) return -1;
+    if (parser->node_count == QUERY_MAX_TERMS) {
+        parser->error = QUERY_ERR_SYNTAX;
+        return -1;
+    }
+    entry = &parser->nodes[parser->node_count];
+    memset(entry, 0, sizeof(*entry));
+    entry->op = (uint8_t)op;
+    entry->left = left;
+    entry->right = right;
+    entry->step.op = (uint8_t)op;
+    return parser->node_count++;
+}
+
+static int leaf(Parser *parser, int op, int flags, int32_t lo, int32_t hi) {
+    int at = node(parser, op, -1, -1);
+
+    if (at >= 0) {
+        parser->nodes[at].step.flags = (uint8_t)flags;
+        parser->nodes[at].step.lo = lo;
+        parser->nodes[at].step.hi = hi;
+    }
+    return at;
+}
+
+// A leaf testing a value, kept folded in the query's strings, which hold
+// at most the text itself
+static int text_leaf(Parser *parser, int op, int flags, const char *value, size_t length) {
+    TodoQuery *query = parser->query;
+    int at = leaf(parser, op, flags, 0, 0);
+
+    if (at < 0) return -1;
+    parser->nodes[at].step.text_offset = (uint32_t)query->strings_size;
+    parser->nodes[at].step.text_length = (uint32_t)length;
+    for (size_t i = 0; i < length; i++) {
+        query->strings[query->strings_size++] = (char)fold((unsigned char)value[i]);
+    }
+    return at;
+}
+
+static int read_comparison(Parser *parser) {
+    const char *text = parser->cursor;
+    int cmp = 0;
+    int length = 1;
+
+    if (text[0] == '<' || text[0] == '>' || text[0] == '!' || text[0] == '=') {
+        if (text[1] == '=') length = 2;
+        if (text[0] == '<') cmp = length == 2 ? CMP_LE : CMP_LT;
+        if (text[0] == '>') cmp = length == 2 ? CMP_GE : CMP_GT;
+        if (text[0] == '!') cmp = length == 2 ? CMP_NE : 0;
+        if (text[0] == '=') cmp = CMP_EQ;
+    } else if (text[0] == ':') {
+        cmp = CMP_EQ;
+    } else if (text[0] == '~') {
+        cmp = CMP_CONTAINS;
+    }
+    if (cmp != 0) parser->cursor += length;
+    return cmp;
+}
+
+// A quoted value or the run of text up to a space, parenthesis or operator
+static int read_value(Parser *parser, const char **value, size_t *length) {
+    const char *text;
+
+    skip_spaces(parser);
+    text = parser->cursor;
+    if (*text == '"') {
+        const char *end = strchr(text + 1, '"');
+
+        if (end == NULL) return 0;
+        *value = text + 1;
+        *length = (size_t)(end - text - 1);
+        parser->cursor = end + 1;
+    } else {
+        size_t at = 0;
+
+        while (text[at] != '\0' && text[at] != ' ' && text[at] != '\t' && text[at] != ',' && text[at] != '(' &&
+               text[at] != ')' && text[at] != '|' && text[at] != '&' && text[at] != '"') {
+            at++;
+        }
+        *value = text;
+        *length = at;
+        parser->cursor += at;
+    }
+    return *length > 0;
+}
+
+// A day, with *relative set if it counts from today; DATE_NONE for none
+static int read_day(const char *value, size_t length, int32_t *day, int *relative) {
+    static const struct {
+        const char *name;
+        int32_t offset;
+    } names[] = { { "today", 0 }, { "tomorrow", 1 }, { "yesterday", -1 } };
+    size_t word = 0;
+
+    *relative = 0;
+    if (is_keyword(value, length, "none")) {
+        *day = DATE_NONE;
+        return 1;
+    }
+    if (length == 10 && date_parse_fixed(value, day)) return 1;
+    while (word < length && value[word] != '+' && value[word] != '-') word++;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); i++) {
+        int32_t offset = 0;
+        size_t at = word + 1;
+
+        if (!is_keyword(value, word, names[i].name)) continue;
+        if (word < length) {
+            if (at == length) return 0;
+            for (; at < length; at++) {
+                if (value[at] < '0' || value[at] > '9' || offset > QUERY_MAX_OFFSET / 10) return 0;
+                offset = offset * 10 + (value[at] - '0');
+            }
+            if (value[word] == '-') offset = -offset;
+        }
+        *day = names[i].offset + offset;
+        *relative = 1;
+        return 1;
+    }
+    return 0;
+}
+
+static int read_priority(const char *value, size_t length, int32_t *priority) {
+    static const char *names[] = { "none", "low", "medium", "high" };
+
+    for (int32_t i = PRIORITY_NONE; i <= PRIORITY_HIGH; i++) {
+        if (is_keyword(value, length, names[i]) || (length == 1 && value[0] == '0' + i)) {
+            *priority = i;
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// A leaf for a range test, negated for !=; first and last bound the
+// values compared
+static int range_term(Parser *parser, int op, int cmp, int32_t value, int relative, int32_t first, int32_t last) {
+    int at_value = relative ? STEP_LO_TODAY | STEP_HI_TODAY : 0;
+
+    // A bound past first or last leaves the range empty or is clamped when
+    // the query runs
+    switch (cmp) {
+        case CMP_EQ:
+            return leaf(parser, op, at_value, value, value);
+        case CMP_NE:
+            return node(parser, OP_NOT, leaf(parser, op, at_value, value, value), -1);
+        case CMP_LT:
+            return leaf(parser, op, at_value & STEP_HI_TODAY, first, value - 1);
+        case CMP_LE:
+            return leaf(parser, op, at_value & STEP_HI_TODAY, first, value);
+        case CMP_GT:
+            return leaf(parser, op, at_value & STEP_LO_TODAY, value + 1, last);
+        case CMP_GE:
+            return leaf(parser, op, at_value & STEP_LO_TODAY, value, last);
+    }
+    parser->error = QUERY_ERR_SYNTAX;
+    return -1;
+}
+
+// field OP value, with the field name at the cursor
+static int parse_field(Parser *parser, size_t length) {
+    const char *field = parser->cursor;
+    const char *value;
+    size_t value_length;
+    int cmp;
+
+    parser->cursor += length;
+    skip_spaces(parser);
+    cmp = read_comparison(parser);
+    if (cmp == 0 || !read_value(parser, &value, &value_length)) {
+        parser->error = QUERY_ERR_SYNTAX;
+        return -1;
+    }
+
+    if (is_keyword(field, length, "due")) {
+        int32_t day;
+        int relative;
+
+        if (!read_day(value, value_length, &day, &relative) || cmp == CMP_CONTAINS) {
+            parser->error = QUERY_ERR_SYNTAX;
+            return -1;
+        }
+        if (day == DATE_NONE) {
+            if (cmp == CMP_EQ) return leaf(parser, OP_UNDATED, 0, 0, 0);
+            if (cmp == CMP_NE) return node(parser, OP_NOT, leaf(parser, OP_UNDATED, 0, 0, 0), -1);
+            parser->error = QUERY_ERR_SYNTAX;
+            return -1;
+        }
+        return range_term(parser, OP_DUE, cmp, day, relative, DATE_FIRST_DAY, DATE_LAST_DAY);
+    }
+    if (is_keyword(field, length, "priority")) {
+        int32_t priority;
+
+        if (!read_priority(value, value_length, &priority)) {
+            parser->error = QUERY_ERR_SYNTAX;
+            return -1;
+        }
+        return range_term(parser, OP_PRIORITY, cmp, priority, 0, PRIORITY_NONE, PRIORITY_HIGH);
+    }
+    if (is_keyword(field, length, "folder") || is_keyword(field, length, "list")) {
+        if (cmp != CMP_EQ && cmp != CMP_CONTAINS) {
+            parser->error = QUERY_ERR_SYNTAX;
+            return -1;
+        }
+        return text_leaf(parser, OP_FOLDER, cmp == CMP_CONTAINS ? STEP_CONTAINS : 0, value, value_length);
+    }
+    if (cmp != CMP_EQ && cmp != CMP_CONTAINS) {
+        parser->error = QUERY_ERR_SYNTAX;
+        return -1;
+    }
+    return text_leaf(parser, OP_TEXT, 0, value, value_length);
+}
+
+static int parse_or(Parser *parser);
+
+// Can a term or negation start here?
+static int starts_operand(Parser *parser) {
+    const char *text = parser->cursor;
+    size_t length;
+
+    if (*text == '#' || *text == '@' || *text == '(' || *text == '-' || *text == '!') return 1;
+    length = word_length(text);
+    return length > 0 && !is_keyword(text, length, "or") && !is_keyword(text, length, "and");
+}
+
+static int parse_unary(Parser *parser) {
+    const char *text;
+    size_t length;
+    int result = -1;
+
+    skip_spaces(parser);
+    text = parser->cursor;
+    length = word_length(text);
+    if (parser->error) return -1;
+    if (++parser->depth > QUERY_MAX_DEPTH) {
+        parser->error = QUERY_ERR_SYNTAX;
+        return -1;
+    }
+
+    if (*text == '-' || *text == '!' || is_keyword(text, length, "not")) {
+        parser->cursor += (*text == '-' || *text == '!') ? 1 : 3;
+        result = node(parser, OP_NOT, parse_unary(parser), -1);
+    } else if (*text == '(') {
+        parser->cursor++;
+        result = parse_or(parser);
+        skip_spaces(parser);
+        if (*parser->cursor != ')') {
+            parser->error = QUERY_ERR_SYNTAX;
+        } else {
+            parser->cursor++;
+        }
+    } else if (*text == '#' || *text == '@') {
+        length = word_length(text + 1);
+        if (length == 0 || length >= TAGS_TEXT_LENGTH) {
+            parser->error = QUERY_ERR_SYNTAX;
+        } else {
+            parser->cursor += 1 + length;
+            result = text_leaf(parser, OP_TAG, 0, text + 1, length);
+        }
+    } else if (is_keyword(text, length, "done")) {
+        parser->cursor += length;
+        result = leaf(parser, OP_DONE, 0, 0, 0);
+    } else if (is_keyword(text, length, "open")) {
+        parser->cursor += length;
+        result = node(parser, OP_NOT, leaf(parser, OP_DONE, 0, 0, 0), -1);
+    } else if (is_keyword(text, length, "overdue")) {
+        // Open and due before today
+        parser->cursor += length;
+        result = node(parser, OP_AND, node(parser, OP_NOT, leaf(parser, OP_DONE, 0, 0, 0), -1),
+                      leaf(parser, OP_DUE, STEP_HI_TODAY, DATE_FIRST_DAY, -1));
+    } else if (is_keyword(text, length, "repeats")) {
+        parser->cursor += length;
+        result = leaf(parser, OP_REPEATS, 0, 0, 0);
+    } else if (length > 0 && is_field(text, length)) {
+        result = parse_field(parser, length);
+    } else {
+        parser->error = QUERY_ERR_SYNTAX;
+    }
+    parser->depth--;
+    return parser->error ? -1 : result;
+}
+
+static int parse_and(Parser *parser) {
+    int result = parse_unary(parser);
+
+    for (;;) {
+        size_t length;
+
+        skip_spaces(parser);
+        if (parser->error) return -1;
+        length = word_length(parser->cursor);
+        if (*parser->cursor == '&') {
+            parser->cursor++;
+        } else if (is_keyword(parser->cursor, length, "and")) {
+            parser->cursor += length;
+        } else if (!starts_operand(parser)) {
+            return result;
+        }
+        result = node(parser, OP_AND, result, parse_unary(parser));
+    }
+}
+
+static int parse_or(Parser *parser) {
+    int result = parse_and(parser);
+
+    for (;;) {
+        size_t length;
+
+        skip_spaces(parser);
+        if (parser->error) return -1;
+        length = word_length(parser->cursor);
+        if (*parser->cursor == '|') {
+            parser->cursor++;
+        } else if (is_keyword(parser->cursor, length, "or")) {
+            parser->cursor += length;
+        } else {
+            return result;
+        }
+        result = node(parser, OP_OR, result, parse_and(parser));
+    }
+}
+
+// ---------------------------------------------------------------------------
+// Compiling
+
+static void emit(Parser *parser, const QueryStep *step, int pushes) {
+    TodoQuery *query = parser->query;
+
+    query->steps[query->count++] = *step;
+    parser->stack += pushes;
+    if (parser->stack > query->depth) query->depth = parser->stack;
+}
+
+static void emit_op(Parser *parser, int op) {
+    QueryStep step;
+
+    memset(&step, 0, sizeof(step));
+    step.op = (uint8_t)op;
+    emit(parser, &step, op == OP_NOT ? 0 : -1);
+}
+
+// Does the node need the task itself rather than its columns?
+static int reads_task(const Parser *parser, int at) {
+    const QueryNode *entry = &parser->nodes[at];
+
+    if (entry->op == OP_NOT) entry = &parser->nodes[entry->left];
+    return entry->op == OP_TEXT || entry->op == OP_TAG;
+}
+
+static void compile_node(Parser *parser, int at);
+
+// The operands of a run of ands, column tests first. A test reading the
+// task that follows another operand is fused into the and, so it only
+// sees the slots still matching.
+static void compile_and(Parser *parser, int at, int task_pass, int *emitted) {
+    const QueryNode *entry = &parser->nodes[at];
+
+    if (entry->op == OP_AND) {
+        compile_and(parser, entry->left, task_pass, emitted);
+        compile_and(parser, entry->right, task_pass, emitted);
+        return;
+    }
+    if (reads_task(parser, at) != task_pass) return;
+    if (task_pass && *emitted) {
+        QueryStep step;
+
+        if (entry->op == OP_NOT) {
+            step = parser->nodes[entry->left].step;
+            step.flags |= STEP_NEGATE;
+        } else {
+            step = entry->step;
+        }
+        step.flags |= STEP_FUSED;
+        emit(parser, &step, 0);
+    } else {
+        compile_node(parser, at);
+        if (*emitted) emit_op(parser, OP_AND);
+    }
+    (*emitted)++;
+}
+
+static void compile_node(Parser *parser, int at) {
+    const QueryNode *entry = &parser->nodes[at];
+    int emitted = 0;
+
+    switch (entry->op) {
+        case OP_AND:
+            compile_and(parser, at, 0, &emitted);
+            compile_and(parser, at, 1, &emitted);
+            break;
+        case OP_OR:
+            compile_node(parser, entry->left);
+            compile_node(parser, entry->right);
+            emit_op(parser, OP_OR);
+            break;
+        case OP_NOT:
+            compile_node(parser, entry->left);
+            emit_op(parser, OP_NOT);
+            break;
+        default:
+            emit(parser, &entry->step, 1);
+            break;
+    }
+}
+
+int query_is_query(const char *text) {
+    for (size_t at = 0; text[at] != '\0'; at++) {
+        size_t length;
+        const char *after;
+
+        if (at > 0 && is_name_byte((unsigned char)text[at - 1])) continue;
+        length = word_length(text + at);
+        if (length == 0 || !is_field(text + at, length)) continue;
+        after = text + at + length;
+        while (*after == ' ' || *after == '\t') after++;
+        if (*after != '\0' && strchr(":=<>!~", *after) != NULL) return 1;
+    }
+    return 0;
+}
+
+int query_compile(const char *text, TodoQuery **out) {
+    Parser parser;
+    TodoQuery *query = (TodoQuery *)calloc(1, sizeof(TodoQuery));
+    size_t length = strlen(text);
+    int root;
+
+    *out = NULL;
+    if (query == NULL) return QUERY_ERR_MEMORY;
+    memset(&parser, 0, sizeof(parser));
+    parser.nodes = (QueryNode *)malloc(QUERY_MAX_TERMS * sizeof(QueryNode));
+    query->strings = (char *)malloc(length + 1);
+    if (parser.nodes == NULL || query->strings == NULL) {
+        free(parser.nodes);
+        query_free(query);
+        return QUERY_ERR_MEMORY;
+    }
+
+    parser.cursor = text;
+    parser.query = query;
+    parser.error = QUERY_OK;
+    root = parse_or(&parser);
+    skip_spaces(&parser);
+    if (parser.error == QUERY_OK && *parser.cursor != '\0') parser.error = QUERY_ERR_SYNTAX;
+    if (parser.error == QUERY_OK) {
+        // Fusing only ever drops steps, so the nodes bound the program
+        query->steps = (QueryStep *)malloc((size_t)parser.node_count * sizeof(QueryStep));
+        if (query->steps == NULL) parser.error = QUERY_ERR_MEMORY;
+    }
+    if (parser.error == QUERY_OK) compile_node(&parser, root);
+    free(parser.nodes);
+    if (parser.error != QUERY_OK) {
+        query_free(query);
+        return parser.error;
+    }
+    *out = query;
+    return QUERY_OK;
+}
+
+void query_free(TodoQuery *query) {
+    if (query == NULL) return;
+    free(query->steps);
+    free(query->strings);
+    free(query);
+}
+
+int query_length(const TodoQuery *query) {
+    return query->count;
+}
+
+// ---------------------------------------------------------------------------
+// Evaluation
+
+// A step with today and the folder names resolved
+typedef struct {
+    uint8_t op;
+    uint8_t flags;
+    uint8_t empty;          // The range holds nothing
+    int32_t lo;
+    int32_t hi;
+    const char *text;
+    size_t length;
+    uint32_t first_folder;  // OP_FOLDER: the ids of the folders named, in the run's folder ids
+    uint32_t folder_count;
+    const uint8_t *table;   // OP_FOLDER naming several folders: a byte per folder id, set for those named
+    uint32_t bits;          // OP_TEXT: letters_of() the text; OP_TAG: tag_bits_of() the name
+} RunStep;
+
+// The folders the steps of a run name
+typedef struct {
+    uint32_t *ids;
+    uint32_t id_count;
+    uint32_t id_capacity;
+    uint8_t *tables;
+    uint32_t table_size;    // Above every folder id
+} RunFolders;
+
+// Lane i of each mask is slot base + i; the columns hold QUERY_LANES
+// values from the pointer passed. The SSE2 paths test 16 lanes at a time
+// and gather their results with one movemask.
+#ifdef QUERY_USE_SSE2
+// Sixteen 32-bit comparison results, all ones or zeros, as sixteen bits
+static uint64_t pack_lanes(__m128i a, __m128i b, __m128i c, __m128i d) {
+    return (uint64_t)(uint32_t)_mm_movemask_epi8(_mm_packs_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d)));
+}
+
+// Lanes whose value - low, unsigned, is above width; SSE2 only compares
+// signed, so both sides are biased by 2^31
+static __m128i outside(const int32_t *values, __m128i low, __m128i width) {
+    __m128i offset = _mm_sub_epi32(_mm_loadu_si128((const __m128i *)values), low);
+
+    return _mm_cmpgt_epi32(_mm_xor_si128(offset, _mm_set1_epi32(INT32_MIN)), width);
+}
+#endif
+
+static uint64_t state_mask(const uint8_t *states, uint8_t bits) {
+    uint64_t mask = 0;
+#ifdef QUERY_USE_SSE2
+    const __m128i wanted = _mm_set1_epi8((char)bits);
+
+    for (int i = 0; i < QUERY_LANES; i += 16) {
+        __m128i clear = _mm_cmpeq_epi8(_mm_and_si128(_mm_loadu_si128((const __m128i *)(states + i)), wanted),
+                                       _mm_setzero_si128());
+
+        mask |= (uint64_t)(~_mm_movemask_epi8(clear) & 0xFFFF) << i;
+    }
+#else
+    for (int i = 0; i < QUERY_LANES; i++) {
+        mask |= (uint64_t)((states[i] & bits) != 0) << i;
+    }
+#endif
+    return mask;
+}
+
+static uint64_t range_mask(const int32_t *values, int32_t lo, int32_t hi) {
+    uint32_t width = (uint32_t)hi - (uint32_t)lo;
+    uint64_t mask = 0;
+#ifdef QUERY_USE_SSE2
+    const __m128i low = _mm_set1_epi32(lo);
+    const __m128i high = _mm_set1_epi32((int32_t)(width ^ 0x80000000u));
+
+    for (int i = 0; i < QUERY_LANES; i += 16) {
+        mask |= (~pack_lanes(outside(values + i, low, high), outside(values + i + 4, low, high),
+                             outside(values + i + 8, low, high), outside(values + i + 12, low, high)) & 0xFFFF)
+                << i;
+    }
+#else
+    for (int i = 0; i < QUERY_LANES; i++) {
+        mask |= (uint64_t)((uint32_t)values[i] - (uint32_t)lo <= width) << i;
+    }
+#endif
+    return mask;
+}
+
+static uint64_t priority_mask(const uint8_t *states, int32_t lo, int32_t hi) {
+    uint64_t mask = 0;
+#ifdef QUERY_USE_SSE2
+    const __m128i low = _mm_set1_epi8((char)lo);
+    const __m128i high = _mm_set1_epi8((char)hi);
+
+    for (int i = 0; i < QUERY_LANES; i += 16) {
+        // The shift crosses bytes, but only bits from the same byte survive the and
+        __m128i priority = _mm_and_si128(_mm_srli_epi16(_mm_loadu_si128((const __m128i *)(states + i)),
+                                                        SLOT_PRIORITY_SHIFT), _mm_set1_epi8(3));
+        __m128i out = _mm_or_si128(_mm_cmplt_epi8(priority, low), _mm_cmpgt_epi8(priority, high));
+
+        mask |= (uint64_t)(~_mm_movemask_epi8(out) & 0xFFFF) << i;
+    }
+#else
+    uint32_t width = (uint32_t)(hi - lo);
+
+    for (int i = 0; i < QUERY_LANES; i++) {
+        uint32_t priority = (uint32_t)(states[i] >> SLOT_PRIORITY_SHIFT) & 3;
+
+        mask |= (uint64_t)(priority - (uint32_t)lo <= width) << i;
+    }
+#endif
+    return mask;
+}
+
+static uint64_t equal_mask(const uint32_t *values, uint32_t value) {
+    uint64_t mask = 0;
+#ifdef QUERY_USE_SSE2
+    const __m128i wanted = _mm_set1_epi32((int32_t)value);
+
+    for (int i = 0; i < QUERY_LANES; i += 16) {
+        const __m128i *at = (const __m128i *)(values + i);
+
+        mask |= pack_lanes(_mm_cmpeq_epi32(_mm_loadu_si128(at), wanted),
+                           _mm_cmpeq_epi32(_mm_loadu_si128(at + 1), wanted),
+                           _mm_cmpeq_epi32(_mm_loadu_si128(at + 2), wanted),
+                           _mm_cmpeq_epi32(_mm_loadu_si128(at + 3), wanted))
+                << i;
+    }
+#else
+    for (int i = 0; i < QUERY_LANES; i++) {
+        mask |= (uint64_t)(values[i] == value) << i;
+    }
+#endif
+    return mask;
+}
+
+// Lanes whose bits include all of wanted
+static uint64_t bits_mask(const uint32_t *values, uint32_t wanted) {
+    uint64_t mask = 0;
+#ifdef QUERY_USE_SSE2
+    const __m128i bits = _mm_set1_epi32((int32_t)wanted);
+
+    for (int i = 0; i < QUERY_LANES; i += 16) {
+        const __m128i *at = (const __m128i *)(values + i);
+
+        mask |= pack_lanes(_mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128(at), bits), bits),
+                           _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128(at + 1), bits), bits),
+                           _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128(at + 2), bits), bits),
+                           _mm_cmpeq_epi32(_mm_and_si128(_mm_loadu_si128(at + 3), bits), bits))
+                << i;
+    }
+#else
+    for (int i = 0; i < QUERY_LANES; i++) {
+        mask |= (uint64_t)((values[i] & wanted) == wanted) << i;
+    }
+#endif
+    return mask;
+}
+
+// Lanes whose folder id is marked in a table of one byte per id
+static uint64_t table_mask(const uint32_t *values, const uint8_t *table, uint32_t size) {
+    uint64_t mask = 0;
+
+    for (int i = 0; i < QUERY_LANES; i++) {
+        mask |= (uint64_t)(values[i] < size && table[values[i]]) << i;
+    }
+    return mask;
+}
+
+// The lanes whose task passes a text or tag test
+static uint64_t task_mask(const TodoQueryIndex *index, const RunStep *step, uint32_t base, uint64_t lanes) {
+    const TodoStore *store = index->store;
+    uint64_t mask = 0;
+
+    // Only tasks with the bits of the text or tag are looked at
+    lanes &= bits_mask((step->op == OP_TEXT ? index->letters : index->tag_bits) + base, step->bits);
+    while (lanes != 0) {
+        int lane = lowest_bit(lanes);
+        const Task *task = store_find_task(store, index->handles[base + (uint32_t)lane]);
+        int match;
+
+        lanes &= lanes - 1;
+        if (task == NULL) continue;
+        if (step->op == OP_TEXT) {
+            match = contains_folded(store_text(store, task->description), task->description.length, step->text,
+                                    step->length);
+        } else {
+            match = tags_contains(store_text(store, task->tags), task->tags.length, step->text, step->length);
+        }
+        if (match) mask |= (uint64_t)1 << lane;
+    }
+    return mask;
+}
+
+static int result_push(TodoQueryResult *out, uint32_t task) {
+    if (out->count == out->capacity) {
+        size_t capacity = out->capacity ? out->capacity * 2 : 256;
+        uint32_t *tasks = (uint32_t *)realloc(out->tasks, capacity * sizeof(uint32_t));
+
+        if (tasks == NULL) return 0;
+        out->tasks = tasks;
+        out->capacity = capacity;
+    }
+    out->tasks[out->count++] = task;
+    return 1;
+}
+
+static int folder_named(const RunStep *step, const char *name, size_t length) {
+    if (!(step->flags & STEP_CONTAINS) && length != step->length) return 0;
+    return contains_folded(name, length, step->text, step->length);
+}
+
+// Resolve today and folder names. A step naming several folders gets a
+// table when the folder ids are small enough, so it costs one pass however
+// many it names.
+static int resolve_steps(const TodoQueryIndex *index, const TodoQuery *query, int32_t today, RunStep *steps,
+                         RunFolders *folders) {
+    const TodoStore *store = index->store;
+    uint32_t tables = 0;
+
+    for (int i = 0; i < query->count; i++) {
+        const QueryStep *from = &query->steps[i];
+        RunStep *step = &steps[i];
+
+        memset(step, 0, sizeof(*step));
+        step->op = from->op;
+        step->flags = from->flags;
+        step->lo = (from->flags & STEP_LO_TODAY) ? today + from->lo : from->lo;
+        step->hi = (from->flags & STEP_HI_TODAY) ? today + from->hi : from->hi;
+        step->text = query->strings + from->text_offset;
+        step->length = from->text_length;
+        if (step->op == OP_DUE) {
+            if (step->lo < DATE_FIRST_DAY) step->lo = DATE_FIRST_DAY;
+            if (step->hi > DATE_LAST_DAY) step->hi = DATE_LAST_DAY;
+        }
+        step->empty = step->lo > step->hi;
+        if (step->op == OP_TEXT) step->bits = letters_of(step->text, step->length);
+        if (step->op == OP_TAG) step->bits = tag_bits_of(step->text, step->length);
+        if (step->op != OP_FOLDER) continue;
+
+        step->first_folder = folders->id_count;
+        for (int f = 0; f < store->folder_count; f++) {
+            const Folder *folder = &store->folders[f];
+
+            if (!folder_named(step, store_text(store, folder->name), folder->name.length)) continue;
+            if (folders->id_count == folders->id_capacity) {
+                uint32_t capacity = folders->id_capacity ? folders->id_capacity * 2 : 16;
+                uint32_t *grown = (uint32_t *)realloc(folders->ids, capacity * sizeof(uint32_t));
+
+                if (grown == NULL) return 0;
+                folders->ids = grown;
+                folders->id_capacity = capacity;
+            }
+            folders->ids[folders->id_count++] = folder->id;
+            step->folder_count++;
+        }
+        tables += step->folder_count > 1;
+    }
+
+    for (int f = 0; f < store->folder_count; f++) {
+        if (store->folders[f].id >= folders->table_size) folders->table_size = store->folders[f].id + 1;
+    }
+    if (tables == 0 || folders->table_size > QUERY_MAX_TABLE) return 1;
+    folders->tables = (uint8_t *)calloc(tables, folders->table_size);
+    if (folders->tables == NULL) return 0;
+    tables = 0;
+    for (int i = 0; i < query->count; i++) {
+        RunStep *step = &steps[i];
+        uint8_t *table;
+
+        if (step->op != OP_FOLDER || step->folder_count < 2) continue;
+        table = folders->tables + (size_t)tables++ * folders->table_size;
+        for (uint32_t f = 0; f < step->folder_count; f++) {
+            table[folders->ids[step->first_folder + f]] = 1;
+        }
+        step->table = table;
+    }
+    return 1;
+}
+
+int query_run(const TodoQueryIndex *index, const TodoQuery *query, uint32_t folder_id, int32_t today,
+              TodoQueryResult *out) {
+    RunStep *steps = (RunStep *)malloc(((size_t)query->count + 1) * sizeof(RunStep));
+    uint64_t *stack = (uint64_t *)malloc(((size_t)query->depth + 1) * sizeof(uint64_t));
+    RunFolders folders;
+    int ok = 0;
+
+    memset(&folders, 0, sizeof(folders));
+    out->count = 0;
+    if (steps == NULL || stack == NULL || !resolve_steps(index, query, today, steps, &folders)) goto done;
+
+    for (uint32_t base = 0; base < index->slot_end; base += QUERY_LANES) {
+        uint64_t live = state_mask(index->states + base, SLOT_LIVE);
+        uint64_t matches;
+        int top = 0;
+
+        if (folder_id != 0 && live != 0) live &= equal_mask(index->folders + base, folder_id);
+        if (live == 0) continue;
+
+        for (int i = 0; i < query->count; i++) {
+            const RunStep *step = &steps[i];
+            uint64_t mask = 0;
+
+            switch (step->op) {
+                case OP_DONE:
+                    mask = state_mask(index->states + base, SLOT_DONE);
+                    break;
+                case OP_REPEATS:
+                    mask = state_mask(index->states + base, SLOT_REPEATS);
+                    break;
+                case OP_UNDATED:
+                    mask = range_mask(index->deadlines + base, DATE_NONE, DATE_NONE);
+                    break;
+                case OP_DUE:
+                    if (!step->empty) mask = range_mask(index->deadlines + base, step->lo, step->hi);
+                    break;
+                case OP_PRIORITY:
+                    if (!step->empty) mask = priority_mask(index->states + base, step->lo, step->hi);
+                    break;
+                case OP_FOLDER:
+                    if (step->table != NULL) {
+                        mask = table_mask(index->folders + base, step->table, folders.table_size);
+                        break;
+                    }
+                    for (uint32_t f = 0; f < step->folder_count; f++) {
+                        mask |= equal_mask(index->folders + base, folders.ids[step->first_folder + f]);
+                    }
+                    break;
+                case OP_TEXT:
+                case OP_TAG:
+                    if (step->flags & STEP_FUSED) {
+                        uint64_t lanes = stack[top - 1] & live;
+                        uint64_t hits = task_mask(index, step, base, lanes);
+
+                        stack[top - 1] = (step->flags & STEP_NEGATE) ? lanes & ~hits : hits;
+                        continue;
+                    }
+                    mask = task_mask(index, step, base, live);
+                    break;
+                case OP_NOT:
+                    stack[top - 1] = ~stack[top - 1];
+                    continue;
+                case OP_AND:
+                    top--;
+                    stack[top - 1] &= stack[top];
+                    continue;
+                case OP_OR:
+                    top--;
+                    stack[top - 1] |= stack[top];
+                    continue;
+            }
+            stack[top++] = mask;
+        }
+
+        matches = stack[0] & live;
+        while (matches != 0) {
+            if (!result_push(out, index->handles[base + (uint32_t)lowest_bit(matches)])) goto done;
+            matches &= matches - 1;
+        }
+    }
+    ok = 1;
+
+done:
+    if (!ok) out->count = 0;
+    free(steps);
+    free(stack);
+    free(folders.ids);
+    free(folders.tables);
+    return ok;
+}
+
+void query_result_free(TodoQueryResult *result) {
+    free(result->tasks);
+    memset(result, 0, sizeof(*result));
+}
+
+uint32_t query_task_folder(const TodoQueryIndex *index, uint32_t task) {
+    uint32_t slot = SLOTS_INDEX(task);
+
+    if (slot >= index->slot_end || !index->states[slot] || index->handles[slot] != task) return 0;
+    return index->folders[slot];
+}
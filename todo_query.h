@@ -0,0 +1,82 @@
+#ifndef TODO_QUERY_H
+#define TODO_QUERY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "todo_core.h"
+
+// Task queries.
+//
+// A query such as folder:"Ops" and due < today+7 and not done and
+// text~"deploy" is compiled once into a flat postfix program. The query
+// index keeps a column per task field (deadline, folder, state and
+// priority, handle, and 32-bit signatures of the description's letters and
+// of the tags) over the slot indexes of the task handles and follows the
+// store through its change notifications; tasks are indexed when their
+// folder is materialized. query_run() evaluates the program over the
+// columns 64 slots at a time, with SSE2 where available: each step turns a
+// column into a 64-bit mask of the slots it matches and combines masks
+// with and, or and not, so no task is visited node by node. Tests that
+// need a task's text (text~ and tags) are fused into the and before them
+// and only look at the slots still matching whose signature allows a
+// match; the compiler puts the column tests of an and first.
+//
+// Syntax, keywords case-insensitive:
+//   done, open, overdue, repeats     the task's state
+//   #name or @name                   it carries that tag
+//   folder:NAME (or list:NAME)       it is in a list of that name; folder~TEXT
+//                                    for lists whose name contains TEXT
+//   text~TEXT (or text:TEXT)         its description contains TEXT
+//   due OP DAY                       OP is one of : = != < <= > >=; DAY is
+//                                    YYYY-MM-DD, today, tomorrow, yesterday,
+//                                    today+N, today-N or none
+//   priority OP LEVEL                LEVEL is none, low, medium, high or 0-3
+// Values holding spaces are quoted. Terms next to each other must all
+// match; "or" (or '|') binds more loosely and "not" (or '-', '!') more
+// tightly; "and" and '&' may be written out, and parentheses group. Text
+// comparisons ignore ASCII case. A task without a deadline only matches
+// due = none and due != DAY. "today" is read when the query runs, so a
+// saved query follows the calendar.
+
+enum {
+    QUERY_OK = 0,
+    QUERY_ERR_SYNTAX,
+    QUERY_ERR_MEMORY
+};
+
+typedef struct TodoQuery TodoQuery;
+typedef struct TodoQueryIndex TodoQueryIndex;
+
+// Handles of matching tasks, grown by query_run() and reusable across runs
+typedef struct {
+    uint32_t *tasks;
+    size_t count;
+    size_t capacity;
+} TodoQueryResult;
+
+// Does the search text look like a query rather than words to find? It
+// does when it names a field, as in due<today.
+int query_is_query(const char *text);
+int query_compile(const char *text, TodoQuery **out);
+void query_free(TodoQuery *query);
+// Steps in the compiled program
+int query_length(const TodoQuery *query);
+
+// Index everything the store holds now and follow it from then on
+TodoQueryIndex *query_create(TodoStore *store);
+void query_destroy(TodoQueryIndex *index);
+
+// TodoStoreListener; registered by query_create
+void query_on_change(void *index, const TodoStoreChange *change);
+
+// Handles of the tasks matching a query, in slot order, limited to one
+// folder or, with folder_id 0, to every materialized folder; today is what
+// "today" stands for. Returns 0, with out empty, when out of memory.
+int query_run(const TodoQueryIndex *index, const TodoQuery *query, uint32_t folder_id, int32_t today,
+              TodoQueryResult *out);
+void query_result_free(TodoQueryResult *result);
+
+// Id of the folder holding an indexed task, 0 if the task is not indexed
+uint32_t query_task_folder(const TodoQueryIndex *index, uint32_t task);
+
+#endif
@@ -0,0 +1,271 @@
+#include "todo_recur.h"
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+static const char *const unit_names[] = { "", "day", "week", "month" };
+static const char *const unit_adverbs[] = { "", "daily", "weekly", "monthly" };
+
+static int32_t first_day(void) {
+    return DATE_FIRST_DAY;
+}
+
+static int32_t last_day(void) {
+    return DATE_LAST_DAY;
+}
+
+int recur_valid(const TodoRecurrence *rule) {
+    if (rule->unit == RECUR_NONE) return 1;
+    if (rule->unit > RECUR_MONTHLY) return 0;
+    if (rule->interval < 1 || rule->interval > RECUR_MAX_INTERVAL) return 0;
+    if (rule->start < first_day() || rule->start > last_day()) return 0;
+    if (rule->until == DATE_NONE) return 1;
+    return rule->until >= rule->start && rule->until <= last_day();
+}
+
+// Occurrence k of a monthly rule, DATE_NONE past DATE_MAX_YEAR
+static int32_t month_occurrence(const TodoRecurrence *rule, int64_t k) {
+    int year, month, day;
+    int64_t months;
+
+    date_to_civil(rule->start, &year, &month, &day);
+    months = (int64_t)year * 12 + (month - 1) + k * rule->interval;
+    if (months / 12 > DATE_MAX_YEAR) return DATE_NONE;
+    year = (int)(months / 12);
+    month = (int)(months % 12) + 1;
+    if (day > date_days_in_month(year, month)) {
+        day = date_days_in_month(year, month);
+    }
+    return date_from_civil(year, month, day);
+}
+
+// Whole months from the start month to the month of day
+static int64_t months_since_start(const TodoRecurrence *rule, int32_t day) {
+    int start_year, start_month, year, month, unused;
+
+    date_to_civil(rule->start, &start_year, &start_month, &unused);
+    date_to_civil(day, &year, &month, &unused);
+    return ((int64_t)year * 12 + month) - ((int64_t)start_year * 12 + start_month);
+}
+
+static int64_t step_days(const TodoRecurrence *rule) {
+    return (int64_t)rule->interval * (rule->unit == RECUR_WEEKLY ? 7 : 1);
+}
+
+// Drop candidates past the end of the rule or the calendar
+static int32_t bounded(const TodoRecurrence *rule, int64_t day) {
+    if (day > last_day()) return DATE_NONE;
+    if (rule->until != DATE_NONE && day > rule->until) return DATE_NONE;
+    return (int32_t)day;
+}
+
+int32_t recur_next(const TodoRecurrence *rule, int32_t day) {
+    int64_t k;
+    int32_t candidate;
+
+    if (rule->unit == RECUR_NONE) return DATE_NONE;
+    if (day < rule->start) return bounded(rule, rule->start);
+
+    if (rule->unit != RECUR_MONTHLY) {
+        k = ((int64_t)day - rule->start) / step_days(rule) + 1;
+        return bounded(rule, rule->start + k * step_days(rule));
+    }
+
+    // The occurrence in month k is on or before day only if it is in
+    // the same month as day; k + 1 is always in a later month
+    k = months_since_start(rule, day) / rule->interval;
+    candidate = month_occurrence(rule, k);
+    if (candidate != DATE_NONE && candidate <= day) {
+        candidate = month_occurrence(rule, k + 1);
+    }
+    return candidate == DATE_NONE ? DATE_NONE : bounded(rule, candidate);
+}
+
+int32_t recur_first(const TodoRecurrence *rule, int32_t day) {
+    if (rule->unit == RECUR_NONE) return DATE_NONE;
+    if (day <= rule->start) return bounded(rule, rule->start);
+    return recur_next(rule, day - 1);
+}
+
+int32_t recur_previous(const TodoRecurrence *rule, int32_t day) {
+    int64_t k;
+    int32_t candidate;
+
+    // Nothing falls after until, so the day after it answers for later days
+    if (rule->until != DATE_NONE && day > rule->until) day = rule->until + 1;
+    if (rule->unit == RECUR_NONE || day <= rule->start) return DATE_NONE;
+
+    if (rule->unit != RECUR_MONTHLY) {
+        k = ((int64_t)day - 1 - rule->start) / step_days(rule);
+        return (int32_t)(rule->start + k * step_days(rule));
+    }
+
+    k = months_since_start(rule, day) / rule->interval;
+    candidate = month_occurrence(rule, k);
+    if (candidate == DATE_NONE || candidate >= day) {
+        candidate = month_occurrence(rule, k - 1);
+    }
+    return candidate;
+}
+
+size_t recur_expand(const TodoRecurrence *rule, int32_t from, int32_t to, int32_t *days, size_t max) {
+    size_t count = 0;
+    int32_t day = recur_first(rule, from);
+
+    while (day != DATE_NONE && day < to && count < max) {
+        days[count++] = day;
+        day = recur_next(rule, day);
+    }
+    return count;
+}
+
+// Copy the next space-separated word into word, lowercased. Returns 0 at
+// the end of the text or for a word too long to be part of a rule.
+static int next_word(const char **text, char word[16]) {
+    const char *s = *text;
+    size_t length = 0;
+
+    while (*s == ' ') s++;
+    *text = s;
+    if (*s == '\0') return 0;
+    while (*s != '\0' && *s != ' ') {
+        if (length == 15) return 0;
+        word[length++] = (char)tolower((unsigned char)*s);
+        s++;
+    }
+    word[length] = '\0';
+    *text = s;
+    return 1;
+}
+
+static int parse_unit(const char *word, int plural) {
+    for (int unit = RECUR_DAILY; unit <= RECUR_MONTHLY; unit++) {
+        size_t length = strlen(unit_names[unit]);
+
+        if (strncmp(word, unit_names[unit], length) != 0) continue;
+        if (word[length] == '\0' && !plural) return unit;
+        if (word[length] == 's' && word[length + 1] == '\0') return unit;
+    }
+    return RECUR_NONE;
+}
+
+static int parse_interval(const char *word, uint16_t *interval) {
+    unsigned value = 0;
+
+    if (*word == '\0') return 0;
+    for (; *word != '\0'; word++) {
+        if (*word < '0' || *word > '9') return 0;
+        value = value * 10 + (unsigned)(*word - '0');
+        if (value > RECUR_MAX_INTERVAL) return 0;
+    }
+    if (value == 0) return 0;
+    *interval = (uint16_t)value;
+    return 1;
+}
+
+int recur_parse(const char *text, int32_t deadline_day, TodoRecurrence *rule) {
+    TodoRecurrence parsed;
+    char word[16];
+    int has_from = 0, has_until = 0;
+
+    memset(&parsed, 0, sizeof(parsed));
+    parsed.until = DATE_NONE;
+    if (!next_word(&text, word)) {
+        // Blank, or a single overlong word
+        if (*text != '\0') return 0;
+        *rule = parsed;
+        return 1;
+    }
+    if (deadline_day == DATE_NONE) return 0;
+
+    parsed.interval = 1;
+    for (int unit = RECUR_DAILY; unit <= RECUR_MONTHLY; unit++) {
+        if (strcmp(word, unit_adverbs[unit]) == 0) parsed.unit = (uint8_t)unit;
+    }
+    if (parsed.unit == RECUR_NONE) {
+        if (strcmp(word, "every") != 0 || !next_word(&text, word)) return 0;
+        if (parse_interval(word, &parsed.interval)) {
+            if (!next_word(&text, word)) return 0;
+            parsed.unit = (uint8_t)parse_unit(word, parsed.interval != 1);
+        } else {
+            parsed.unit = (uint8_t)parse_unit(word, 0);
+        }
+        if (parsed.unit == RECUR_NONE) return 0;
+    }
+
+    parsed.start = deadline_day;
+    while (next_word(&text, word)) {
+        int32_t *target;
+
+        if (strcmp(word, "from") == 0 && !has_from) {
+            target = &parsed.start;
+            has_from = 1;
+        } else if (strcmp(word, "until") == 0 && !has_until) {
+            target = &parsed.until;
+            has_until = 1;
+        } else {
+            return 0;
+        }
+        if (!next_word(&text, word) || !date_parse(word, target)) return 0;
+    }
+    if (*text != '\0') return 0;
+
+    // The deadline has to be one of the occurrences
+    if (!recur_valid(&parsed) || deadline_day < parsed.start) return 0;
+    if (recur_first(&parsed, deadline_day) != deadline_day) return 0;
+    *rule = parsed;
+    return 1;
+}
+
+void recur_format(const TodoRecurrence *rule, int32_t deadline_day, char out[RECUR_TEXT_LENGTH]) {
+    char date[DATE_TEXT_LENGTH];
+    size_t length;
+
+    if (rule->unit == RECUR_NONE || rule->unit > RECUR_MONTHLY) {
+        out[0] = '\0';
+        return;
+    }
+    if (rule->interval == 1) {
+        snprintf(out, RECUR_TEXT_LENGTH, "%s", unit_adverbs[rule->unit]);
+    } else {
+        snprintf(out, RECUR_TEXT_LENGTH, "every %u %ss", (unsigned)rule->interval, unit_names[rule->unit]);
+    }
+    length = strlen(out);
+    if (rule->start != deadline_day) {
+        date_format(rule->start, date);
+        snprintf(out + length, RECUR_TEXT_LENGTH - length, " from %s", date);
+        length = strlen(out);
+    }
+    if (rule->until != DATE_NONE) {
+        date_format(rule->until, date);
+        snprintf(out + length, RECUR_TEXT_LENGTH - length, " until %s", date);
+    }
+}
+
+int recur_parse_schedule(const char *text, int32_t *deadline_day, TodoRecurrence *rule) {
+    int32_t deadline = DATE_NONE;
+
+    while (*text == ' ') text++;
+    if (*text != '\0' && *text != ' ') {
+        // Exactly ten characters, then the end or a space
+        for (int i = 0; i < 10; i++) {
+            if (text[i] == '\0') return 0;
+        }
+        if ((text[10] != '\0' && text[10] != ' ') || !date_parse_fixed(text, &deadline)) return 0;
+        text += 10;
+    }
+    if (!recur_parse(text, deadline, rule)) return 0;
+    *deadline_day = deadline;
+    return 1;
+}
+
+void recur_format_schedule(int32_t deadline_day, const TodoRecurrence *rule, char out[RECUR_SCHEDULE_LENGTH]) {
+    date_format(deadline_day, out);
+    if (rule->unit != RECUR_NONE) {
+        size_t length = strlen(out);
+
+        out[length++] = ' ';
+        recur_format(rule, deadline_day, out + length);
+    }
+}
@@ -0,0 +1,67 @@
+#ifndef TODO_RECUR_H
+#define TODO_RECUR_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "todo_date.h"
+
+// Recurrence rules. A repeating task is stored once, with its rule and the
+// deadline of its next open occurrence; the occurrences after that are
+// never stored, only computed for the range a caller asks about.
+//
+// Occurrence k falls k * interval days, weeks or months after start.
+// Monthly rules keep the day of the month of start and clamp it to shorter
+// months, so a rule starting on January 31 falls on February 28 (29 in a
+// leap year), then March 31. Occurrences stop after until, if set, and
+// after DATE_MAX_YEAR.
+//
+// As text, a rule is "daily", "weekly", "monthly" or "every N days",
+// "every N weeks", "every N months", optionally followed by
+// "from YYYY-MM-DD" and "until YYYY-MM-DD". A schedule is a deadline
+// followed by an optional rule, which is how the journal records it.
+
+enum {
+    RECUR_NONE = 0,
+    RECUR_DAILY,
+    RECUR_WEEKLY,
+    RECUR_MONTHLY
+};
+
+#define RECUR_MAX_INTERVAL 999
+#define RECUR_TEXT_LENGTH 64        // Longest rule text plus terminator
+#define RECUR_SCHEDULE_LENGTH (DATE_TEXT_LENGTH + RECUR_TEXT_LENGTH)
+
+typedef struct {
+    uint8_t unit;           // RECUR_*; RECUR_NONE for a task that does not repeat
+    uint8_t reserved;
+    uint16_t interval;      // At least 1
+    int32_t start;          // First occurrence
+    int32_t until;          // Last day an occurrence may fall on, DATE_NONE if open-ended
+} TodoRecurrence;
+
+// Is this a well-formed rule (or RECUR_NONE)?
+int recur_valid(const TodoRecurrence *rule);
+
+// First occurrence on or after day, DATE_NONE if there is none
+int32_t recur_first(const TodoRecurrence *rule, int32_t day);
+// First occurrence after day, DATE_NONE if there is none
+int32_t recur_next(const TodoRecurrence *rule, int32_t day);
+// Last occurrence before day, DATE_NONE if there is none
+int32_t recur_previous(const TodoRecurrence *rule, int32_t day);
+
+// Occurrences in [from, to), at most max of them; returns how many
+size_t recur_expand(const TodoRecurrence *rule, int32_t from, int32_t to, int32_t *days, size_t max);
+
+// Parse a rule for a task due on deadline_day; blank text means no rule.
+// The deadline must be one of the rule's occurrences. Returns 0 if the text
+// is not a rule.
+int recur_parse(const char *text, int32_t deadline_day, TodoRecurrence *rule);
+// Text of a rule; "from" is only written when start is not deadline_day.
+// Empty for RECUR_NONE.
+void recur_format(const TodoRecurrence *rule, int32_t deadline_day, char out[RECUR_TEXT_LENGTH]);
+
+// Schedules: a deadline (possibly empty) and then a rule
+int recur_parse_schedule(const char *text, int32_t *deadline_day, TodoRecurrence *rule);
+void recur_format_schedule(int32_t deadline_day, const TodoRecurrence *rule, char out[RECUR_SCHEDULE_LENGTH]);
+
+#endif
@@ -0,0 +1,680 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "todo_remind.h"
+#include "todo_format.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define WHEEL_BITS 6
+#define WHEEL_SLOTS (1 << WHEEL_BITS)
+#define DUE_BUCKET (REMIND_LEVELS * WHEEL_SLOTS)    // Reminders already due
+#define NO_BUCKET 0xFFFF
+#define MS_PER_DAY (24 * 60 * 60 * 1000LL)
+
+// How a reminder scheduled by remind_follow() is chained
+enum {
+    FOLLOW_NONE = 0,
+    FOLLOW_TASK,            // On its task's chain
+    FOLLOW_SECTION          // On its folder's section chain: the folder is not loaded
+};
+
+// A pending reminder. Bucket lists and the per-task and per-section chains
+// link entries by their slot map handle.
+typedef struct {
+    TodoReminder reminder;
+    uint32_t next;
+    uint32_t prev;
+    uint32_t task_next;     // Next reminder on the same chain
+    uint32_t task_prev;     // Previous one on a section chain, which can be long
+    uint16_t bucket;
+    uint8_t followed;       // FOLLOW_*
+} RemindEntry;
+
+// Reminders of a folder that is not loaded, read from its data file section
+typedef struct {
+    uint32_t folder_id;
+    uint32_t head;
+} SectionChain;
+
+struct TodoReminders {
+    TodoSlotMap entries;
+    uint32_t heads[DUE_BUCKET + 1];
+    uint64_t occupied[REMIND_LEVELS];   // Non-empty slots of each level
+    uint64_t now;                       // Tick the wheel has been advanced to
+
+    TodoReminderFired fired;
+    void *context;
+    TodoClock clock;
+    void *clock_context;
+
+    // Following a store
+    TodoStore *store;
+    int days_before[REMIND_MAX_OFFSETS];
+    int offset_count;
+    int minute_of_day;
+    uint32_t *task_heads;       // First reminder of each task, by slot index
+    uint32_t task_heads_capacity;
+    SectionChain *sections;
+    uint32_t section_count;
+    uint32_t section_capacity;
+
+    TodoMutex lock;
+    TodoCond wake;
+    TodoThread worker;
+    int worker_running;
+    int stopping;
+    uint64_t sleep_until;       // Clock time the sleeping worker wakes at, 0 while awake
+};
+
+static int highest_bit(uint64_t value) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1) bit++;
+    return bit;
+#endif
+}
+
+static int lowest_bit(uint64_t value) {
+#if defined(__GNUC__)
+    return __builtin_ctzll(value);
+#else
+    int bit = 0;
+    while (!(value & 1)) {
+        value >>= 1;
+        bit++;
+    }
+    return bit;
+#endif
+}
+
+// First tick at or after when, so nothing fires early
+static uint64_t tick_of(uint64_t when) {
+    return when / REMIND_TICK_MS + (when % REMIND_TICK_MS != 0);
+}
+
+// First tick covered by slot of level, given the wheel's time
+static uint64_t slot_start(uint64_t now, int level, int slot) {
+    int shift = WHEEL_BITS * (level + 1);
+
+    return (now >> shift << shift) | ((uint64_t)slot << (WHEEL_BITS * level));
+}
+
+static RemindEntry *entry_at(const TodoReminders *reminders, uint32_t handle) {
+    return (RemindEntry *)slots_get(&reminders->entries, handle);
+}
+
+// Put an entry on the lowest level whose slots tell its tick apart from
+// the wheel's: every entry on level L then agrees with now above digit L
+// and is ahead of it in digit L. Entries already due go on DUE_BUCKET.
+static void place(TodoReminders *reminders, uint32_t handle, RemindEntry *entry) {
+    uint64_t tick = tick_of(entry->reminder.when);
+    int bucket = DUE_BUCKET;
+    RemindEntry *head;
+
+    if (tick > reminders->now) {
+        int level = highest_bit(tick ^ reminders->now) / WHEEL_BITS;
+        int slot = (int)(tick >> (WHEEL_BITS * level)) & (WHEEL_SLOTS - 1);
+
+        bucket = level * WHEEL_SLOTS + slot;
+        reminders->occupied[level] |= (uint64_t)1 << slot;
+    }
+    entry->bucket = (uint16_t)bucket;
+    entry->prev = 0;
+    entry->next = reminders->heads[bucket];
+    head = entry_at(reminders, entry->next);
+    if (head != NULL) head->prev = handle;
+    reminders->heads[bucket] = handle;
+}
+
+static void unlink_entry(TodoReminders *reminders, RemindEntry *entry) {
+    RemindEntry *prev = entry_at(reminders, entry->prev);
+    RemindEntry *next = entry_at(reminders, entry->next);
+    int bucket = entry->bucket;
+
+    if (bucket == NO_BUCKET) return;
+    if (prev != NULL) {
+        prev->next = entry->next;
+    } else {
+        reminders->heads[bucket] = entry->next;
+    }
+    if (next != NULL) next->prev = entry->prev;
+    if (bucket != DUE_BUCKET && reminders->heads[bucket] == 0) {
+        reminders->occupied[bucket / WHEEL_SLOTS] &= ~((uint64_t)1 << (bucket % WHEEL_SLOTS));
+    }
+    entry->bucket = NO_BUCKET;
+}
+
+static SectionChain *find_section(TodoReminders *reminders, uint32_t folder_id) {
+    for (uint32_t i = 0; i < reminders->section_count; i++) {
+        if (reminders->sections[i].folder_id == folder_id) return &reminders->sections[i];
+    }
+    return NULL;
+}
+
+// Take a followed entry off its chain. Task chains are at most
+// REMIND_MAX_OFFSETS long; section chains are linked both ways.
+static void unchain_entry(TodoReminders *reminders, uint32_t handle, RemindEntry *entry) {
+    uint32_t index = SLOTS_INDEX(entry->reminder.task_id);
+    uint32_t *link;
+
+    if (entry->followed == FOLLOW_SECTION) {
+        RemindEntry *prev = entry_at(reminders, entry->task_prev);
+        RemindEntry *next = entry_at(reminders, entry->task_next);
+        SectionChain *chain = find_section(reminders, entry->reminder.folder_id);
+
+        if (prev != NULL) {
+            prev->task_next = entry->task_next;
+        } else if (chain != NULL) {
+            chain->head = entry->task_next;
+        }
+        if (next != NULL) next->task_prev = entry->task_prev;
+        return;
+    }
+    if (entry->followed != FOLLOW_TASK || index >= reminders->task_heads_capacity) return;
+    for (link = &reminders->task_heads[index]; *link != 0; link = &entry_at(reminders, *link)->task_next) {
+        if (*link == handle) {
+            *link = entry->task_next;
+            return;
+        }
+    }
+}
+
+static void remove_entry(TodoReminders *reminders, uint32_t handle) {
+    RemindEntry *entry = entry_at(reminders, handle);
+
+    if (entry == NULL) return;
+    unlink_entry(reminders, entry);
+    unchain_entry(reminders, handle, entry);
+    slots_release(&reminders->entries, handle);
+}
+
+static int in_range(const TodoReminders *reminders, uint64_t when) {
+    int bits = WHEEL_BITS * REMIND_LEVELS;
+
+    return tick_of(when) >> bits == reminders->now >> bits;
+}
+
+static uint32_t add_entry(TodoReminders *reminders, const TodoReminder *reminder, int followed) {
+    RemindEntry *entry;
+    uint32_t handle;
+
+    if (!in_range(reminders, reminder->when)) return 0;
+    entry = (RemindEntry *)slots_alloc(&reminders->entries, &handle);
+    if (entry == NULL) return 0;
+    entry->reminder = *reminder;
+    entry->followed = (uint8_t)followed;
+    place(reminders, handle, entry);
+    // Wake the worker if this is due before it would wake anyway
+    if (reminders->sleep_until != 0 && reminder->when < reminders->sleep_until) {
+        todo_cond_signal(&reminders->wake);
+    }
+    return handle;
+}
+
+// The earliest reminder is in the lowest non-empty slot of the lowest
+// non-empty level: everything on level L is ahead of now in digit L, while
+// everything below it still shares that digit with now
+static uint64_t next_tick(const TodoReminders *reminders) {
+    if (reminders->heads[DUE_BUCKET] != 0) return reminders->now;
+    for (int level = 0; level < REMIND_LEVELS; level++) {
+        if (reminders->occupied[level] != 0) {
+            return slot_start(reminders->now, level, lowest_bit(reminders->occupied[level]));
+        }
+    }
+    return UINT64_MAX;
+}
+
+// Advance the wheel towards target and take up to max due reminders off it
+static size_t collect_due(TodoReminders *reminders, uint64_t target, TodoReminder *batch, size_t max) {
+    size_t count = 0;
+
+    for (;;) {
+        uint64_t tick;
+        int level, slot;
+        uint32_t handle;
+
+        while (count < max && reminders->heads[DUE_BUCKET] != 0) {
+            handle = reminders->heads[DUE_BUCKET];
+            batch[count++] = entry_at(reminders, handle)->reminder;
+            remove_entry(reminders, handle);
+        }
+        if (count == max) break;
+
+        tick = next_tick(reminders);
+        if (tick > target) {
+            // Nothing starts before target, so skipping ahead keeps every
+            // entry where place() would put it
+            if (target > reminders->now) reminders->now = target;
+            break;
+        }
+
+        // Reach the slot and move its entries down, or onto the due list
+        for (level = 0; reminders->occupied[level] == 0; level++) {
+        }
+        slot = lowest_bit(reminders->occupied[level]);
+        reminders->now = tick;
+        handle = reminders->heads[level * WHEEL_SLOTS + slot];
+        reminders->heads[level * WHEEL_SLOTS + slot] = 0;
+        reminders->occupied[level] &= ~((uint64_t)1 << slot);
+        while (handle != 0) {
+            RemindEntry *entry = entry_at(reminders, handle);
+            uint32_t next = entry->next;
+
+            place(reminders, handle, entry);
+            handle = next;
+        }
+    }
+    return count;
+}
+
+TodoReminders *remind_create(TodoReminderFired fired, void *context) {
+    TodoReminders *reminders = (TodoReminders *)calloc(1, sizeof(TodoReminders));
+
+    if (reminders == NULL) return NULL;
+    slots_init(&reminders->entries, sizeof(RemindEntry));
+    reminders->fired = fired;
+    reminders->context = context;
+    reminders->clock = remind_local_clock_ms;
+    reminders->now = remind_local_clock_ms(NULL) / REMIND_TICK_MS;
+    reminders->minute_of_day = REMIND_DEFAULT_MINUTE;
+    todo_mutex_init(&reminders->lock);
+    todo_cond_init(&reminders->wake);
+    return reminders;
+}
+
+static void forget_store(TodoReminders *reminders);
+
+void remind_destroy(TodoReminders *reminders) {
+    if (reminders == NULL) return;
+    remind_stop(reminders);
+    forget_store(reminders);
+    slots_free(&reminders->entries);
+    free(reminders->task_heads);
+    free(reminders->sections);
+    todo_cond_destroy(&reminders->wake);
+    todo_mutex_destroy(&reminders->lock);
+    free(reminders);
+}
+
+void remind_set_clock(TodoReminders *reminders, TodoClock clock, void *context) {
+    todo_mutex_lock(&reminders->lock);
+    reminders->clock = clock;
+    reminders->clock_context = context;
+    if (reminders->entries.live == 0) {
+        reminders->now = clock(context) / REMIND_TICK_MS;
+    }
+    todo_mutex_unlock(&reminders->lock);
+}
+
+uint64_t remind_local_clock_ms(void *context) {
+    time_t now = time(NULL);
+    struct tm local;
+    int64_t seconds;
+
+    (void)context;
+
+#ifdef _WIN32
+    // The Windows CRT keeps a buffer per thread
+    struct tm *result = localtime(&now);
+
+    if (result == NULL) return (uint64_t)now * 1000;
+    local = *result;
+#else
+    if (localtime_r(&now, &local) == NULL) return (uint64_t)now * 1000;
+#endif
+    seconds = (int64_t)date_from_civil(local.tm_year + 1900, local.tm_mon + 1, local.tm_mday) * 86400 +
+              local.tm_hour * 3600 + local.tm_min * 60 + local.tm_sec;
+    return seconds > 0 ? (uint64_t)seconds * 1000 : 0;
+}
+
+uint32_t remind_add(TodoReminders *reminders, const TodoReminder *reminder) {
+    uint32_t handle;
+
+    todo_mutex_lock(&reminders->lock);
+    handle = add_entry(reminders, reminder, FOLLOW_NONE);
+    todo_mutex_unlock(&reminders->lock);
+    return handle;
+}
+
+int remind_cancel(TodoReminders *reminders, uint32_t handle) {
+    int found;
+
+    todo_mutex_lock(&reminders->lock);
+    found = entry_at(reminders, handle) != NULL;
+    remove_entry(reminders, handle);
+    todo_mutex_unlock(&reminders->lock);
+    return found;
+}
+
+int remind_move(TodoReminders *reminders, uint32_t handle, uint64_t when) {
+    RemindEntry *entry;
+    int moved = 0;
+
+    todo_mutex_lock(&reminders->lock);
+    entry = entry_at(reminders, handle);
+    if (entry != NULL && in_range(reminders, when)) {
+        unlink_entry(reminders, entry);
+        entry->reminder.when = when;
+        place(reminders, handle, entry);
+        if (reminders->sleep_until != 0 && when < reminders->sleep_until) {
+            todo_cond_signal(&reminders->wake);
+        }
+        moved = 1;
+    }
+    todo_mutex_unlock(&reminders->lock);
+    return moved;
+}
+
+// Store following. The listener runs on the store's thread with the
+// engine locked for each change.
+
+static void cancel_task(TodoReminders *reminders, uint32_t task_id) {
+    uint32_t index = SLOTS_INDEX(task_id);
+    uint32_t handle;
+
+    if (index >= reminders->task_heads_capacity) return;
+    handle = reminders->task_heads[index];
+    reminders->task_heads[index] = 0;
+    while (handle != 0) {
+        RemindEntry *entry = entry_at(reminders, handle);
+        uint32_t next = entry->task_next;
+
+        unlink_entry(reminders, entry);
+        slots_release(&reminders->entries, handle);
+        handle = next;
+    }
+}
+
+static int reserve_task_heads(TodoReminders *reminders, uint32_t index) {
+    uint32_t capacity = reminders->task_heads_capacity ? reminders->task_heads_capacity : 1024;
+    uint32_t *grown;
+
+    if (index < reminders->task_heads_capacity) return 1;
+    while (capacity <= index) capacity *= 2;
+    grown = (uint32_t *)realloc(reminders->task_heads, capacity * sizeof(uint32_t));
+    if (grown == NULL) return 0;
+    memset(grown + reminders->task_heads_capacity, 0,
+           (capacity - reminders->task_heads_capacity) * sizeof(uint32_t));
+    reminders->task_heads = grown;
+    reminders->task_heads_capacity = capacity;
+    return 1;
+}
+
+// Add the reminders a deadline calls for at the head of a chain
+static void schedule_deadline(TodoReminders *reminders, TodoReminder *reminder, uint64_t now, int followed,
+                              uint32_t *head) {
+    for (int i = 0; i < reminders->offset_count; i++) {
+        int64_t day = (int64_t)reminder->deadline - reminders->days_before[i];
+        int64_t when = day * MS_PER_DAY + reminders->minute_of_day * 60000LL;
+        RemindEntry *first = entry_at(reminders, *head);
+        uint32_t handle;
+
+        if (when <= 0 || (uint64_t)when <= now) continue;
+        reminder->when = (uint64_t)when;
+        reminder->days_before = reminders->days_before[i];
+        handle = add_entry(reminders, reminder, followed);
+        if (handle == 0) continue;
+        entry_at(reminders, handle)->task_next = *head;
+        if (followed == FOLLOW_SECTION && first != NULL) first->task_prev = handle;
+        *head = handle;
+    }
+}
+
+// Replace the reminders of one task with those its current deadline calls
+// for; completed tasks and tasks without a deadline get none
+static void schedule_task(TodoReminders *reminders, uint32_t folder_id, uint32_t task_id) {
+    const Task *task = store_find_task(reminders->store, task_id);
+    TodoReminder reminder;
+
+    cancel_task(reminders, task_id);
+    if (task == NULL || task->completed || task->deadline_day == DATE_NONE) return;
+    if (!reserve_task_heads(reminders, SLOTS_INDEX(task_id))) return;
+
+    memset(&reminder, 0, sizeof(reminder));
+    reminder.folder_id = folder_id;
+    reminder.task_id = task_id;
+    reminder.deadline = task->deadline_day;
+    schedule_deadline(reminders, &reminder, reminders->clock(reminders->clock_context), FOLLOW_TASK,
+                      &reminders->task_heads[SLOTS_INDEX(task_id)]);
+}
+
+static void cancel_section(TodoReminders *reminders, uint32_t folder_id) {
+    SectionChain *chain = find_section(reminders, folder_id);
+    uint32_t handle;
+
+    if (chain == NULL) return;
+    handle = chain->head;
+    while (handle != 0) {
+        RemindEntry *entry = entry_at(reminders, handle);
+        uint32_t next = entry->task_next;
+
+        unlink_entry(reminders, entry);
+        slots_release(&reminders->entries, handle);
+        handle = next;
+    }
+    *chain = reminders->sections[--reminders->section_count];
+}
+
+// A folder that is not loaded is scheduled from the deadline and completion
+// columns of its section, row by row, without loading its tasks
+static void schedule_section(TodoReminders *reminders, const Folder *folder) {
+    TodoStore *store = reminders->store;
+    TodoSectionDeadlines section;
+    TodoReminder reminder;
+    SectionChain *chain;
+    uint64_t now;
+
+    if (store->backing == NULL || folder->source_index < 0) return;
+    if (reminders->section_count == reminders->section_capacity) {
+        uint32_t capacity = reminders->section_capacity ? reminders->section_capacity * 2 : 16;
+        SectionChain *grown = (SectionChain *)realloc(reminders->sections, capacity * sizeof(SectionChain));
+
+        if (grown == NULL) return;
+        reminders->sections = grown;
+        reminders->section_capacity = capacity;
+    }
+    if (!todofmt_section_deadlines(store->backing, (uint32_t)folder->source_index, &section)) return;
+
+    chain = &reminders->sections[reminders->section_count++];
+    chain->folder_id = folder->id;
+    chain->head = 0;
+    now = reminders->clock(reminders->clock_context);
+    memset(&reminder, 0, sizeof(reminder));
+    reminder.folder_id = folder->id;
+    for (uint32_t row = 0; row < section.count; row++) {
+        if (section.completed[row] || section.deadlines[row] == DATE_NONE) continue;
+        reminder.row = (int32_t)row;
+        reminder.deadline = section.deadlines[row];
+        schedule_deadline(reminders, &reminder, now, FOLLOW_SECTION, &chain->head);
+    }
+    todofmt_free_deadlines(&section);
+}
+
+static void schedule_folder(TodoReminders *reminders, const Folder *folder) {
+    if (!folder->loaded) {
+        schedule_section(reminders, folder);
+        return;
+    }
+    for (int i = 0; i < folder->task_count; i++) {
+        schedule_task(reminders, folder->id, folder->rows[i]);
+    }
+}
+
+// Cancel the reminders of every followed task and section, or of one
+// folder's
+static void cancel_followed(TodoReminders *reminders, uint32_t folder_id) {
+    for (uint32_t i = 0; i < reminders->task_heads_capacity; i++) {
+        RemindEntry *first = entry_at(reminders, reminders->task_heads[i]);
+
+        if (first != NULL && (folder_id == 0 || first->reminder.folder_id == folder_id)) {
+            cancel_task(reminders, first->reminder.task_id);
+        }
+    }
+    if (folder_id != 0) {
+        cancel_section(reminders, folder_id);
+    } else {
+        while (reminders->section_count > 0) cancel_section(reminders, reminders->sections[0].folder_id);
+    }
+}
+
+static void on_store_change(void *context, const TodoStoreChange *change) {
+    TodoReminders *reminders = (TodoReminders *)context;
+    TodoStore *store = reminders->store;
+
+    todo_mutex_lock(&reminders->lock);
+    switch (change->kind) {
+        case STORE_RESET:
+            cancel_followed(reminders, 0);
+            for (int i = 0; i < store->folder_count; i++) {
+                schedule_folder(reminders, &store->folders[i]);
+            }
+            break;
+        case STORE_FOLDER_LOADED:
+            // The tasks' own reminders replace the section's
+            cancel_section(reminders, change->folder_id);
+            schedule_folder(reminders, &store->folders[change->folder]);
+            break;
+        case STORE_FOLDER_REMOVED:
+            cancel_followed(reminders, change->folder_id);
+            break;
+        case STORE_TASK_ADDED:
+        case STORE_TASK_MOVED:
+            schedule_task(reminders, change->folder_id, change->task_id);
+            break;
+        case STORE_TASK_REMOVED:
+            cancel_task(reminders, change->task_id);
+            break;
+    }
+    todo_mutex_unlock(&reminders->lock);
+}
+
+static void forget_store(TodoReminders *reminders) {
+    if (reminders->store == NULL) return;
+    store_unlisten(reminders->store, on_store_change, reminders);
+    todo_mutex_lock(&reminders->lock);
+    cancel_followed(reminders, 0);
+    reminders->store = NULL;
+    todo_mutex_unlock(&reminders->lock);
+}
+
+int remind_follow(TodoReminders *reminders, TodoStore *store, const int *days_before, int count,
+                  int minute_of_day) {
+    TodoStoreChange reset;
+
+    if (count < 0 || count > REMIND_MAX_OFFSETS || minute_of_day < 0 || minute_of_day >= 24 * 60) return 0;
+    for (int i = 0; i < count; i++) {
+        if (days_before[i] < 0) return 0;
+    }
+    forget_store(reminders);
+    if (!store_listen(store, on_store_change, reminders)) return 0;
+
+    todo_mutex_lock(&reminders->lock);
+    reminders->store = store;
+    memcpy(reminders->days_before, days_before, (size_t)count * sizeof(int));
+    reminders->offset_count = count;
+    reminders->minute_of_day = minute_of_day;
+    todo_mutex_unlock(&reminders->lock);
+
+    memset(&reset, 0, sizeof(reset));
+    reset.kind = STORE_RESET;
+    on_store_change(reminders, &reset);
+    return 1;
+}
+
+size_t remind_run(TodoReminders *reminders, uint64_t now) {
+    TodoReminder batch[REMIND_BATCH];
+    size_t total = 0;
+    size_t count;
+
+    do {
+        todo_mutex_lock(&reminders->lock);
+        count = collect_due(reminders, now / REMIND_TICK_MS, batch, REMIND_BATCH);
+        todo_mutex_unlock(&reminders->lock);
+        for (size_t i = 0; i < count; i++) {
+            reminders->fired(reminders->context, &batch[i]);
+        }
+        total += count;
+    } while (count == REMIND_BATCH);
+    return total;
+}
+
+uint64_t remind_next_due(TodoReminders *reminders) {
+    uint64_t tick;
+
+    todo_mutex_lock(&reminders->lock);
+    tick = next_tick(reminders);
+    todo_mutex_unlock(&reminders->lock);
+    return tick == UINT64_MAX ? tick : tick * REMIND_TICK_MS;
+}
+
+size_t remind_pending(TodoReminders *reminders) {
+    size_t pending;
+
+    todo_mutex_lock(&reminders->lock);
+    pending = reminders->entries.live;
+    todo_mutex_unlock(&reminders->lock);
+    return pending;
+}
+
+// Fire what is due, then sleep until the next reminder. The wait is capped
+// so a wall clock that jumps (a time zone change, a resumed laptop) is
+// noticed within REMIND_MAX_WAIT_MS.
+static void worker_loop(void *arg) {
+    TodoReminders *reminders = (TodoReminders *)arg;
+    TodoReminder batch[REMIND_BATCH];
+
+    todo_mutex_lock(&reminders->lock);
+    while (!reminders->stopping) {
+        uint64_t now = reminders->clock(reminders->clock_context);
+        size_t count = collect_due(reminders, now / REMIND_TICK_MS, batch, REMIND_BATCH);
+        uint64_t next, wait;
+
+        if (count > 0) {
+            todo_mutex_unlock(&reminders->lock);
+            for (size_t i = 0; i < count; i++) {
+                reminders->fired(reminders->context, &batch[i]);
+            }
+            todo_mutex_lock(&reminders->lock);
+            continue;
+        }
+
+        next = next_tick(reminders);
+        wait = REMIND_MAX_WAIT_MS;
+        if (next != UINT64_MAX && next * REMIND_TICK_MS - now < wait) {
+            wait = next * REMIND_TICK_MS - now;
+        }
+        reminders->sleep_until = now + wait;
+        todo_cond_wait(&reminders->wake, &reminders->lock, wait);
+        reminders->sleep_until = 0;
+    }
+    todo_mutex_unlock(&reminders->lock);
+}
+
+int remind_start(TodoReminders *reminders) {
+    if (reminders->worker_running) return 1;
+    reminders->stopping = 0;
+    reminders->worker_running = todo_thread_start(&reminders->worker, worker_loop, reminders);
+    return reminders->worker_running;
+}
+
+void remind_stop(TodoReminders *reminders) {
+    if (!reminders->worker_running) return;
+    todo_mutex_lock(&reminders->lock);
+    reminders->stopping = 1;
+    todo_cond_signal(&reminders->wake);
+    todo_mutex_unlock(&reminders->lock);
+    todo_thread_join(&reminders->worker);
+    reminders->worker_running = 0;
+}
+
+void remind_wake(TodoReminders *reminders) {
+    todo_mutex_lock(&reminders->lock);
+    todo_cond_signal(&reminders->wake);
+    todo_mutex_unlock(&reminders->lock);
+}
@@ -0,0 +1,92 @@
+#ifndef TODO_REMIND_H
+#define TODO_REMIND_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "todo_core.h"
+#include "todo_thread.h"
+
+// Deadline reminders.
+//
+// Pending reminders sit in a hierarchical timing wheel: REMIND_LEVELS
+// levels of 64 slots, a slot on level L spanning 64^L ticks of
+// REMIND_TICK_MS. A reminder goes on the lowest level whose slot span
+// separates it from the wheel's current time, so adding, cancelling and
+// moving one are O(1) list operations. Each level keeps a bitmap of its
+// non-empty slots; the earliest reminder is always in the lowest non-empty
+// slot of the lowest non-empty level, so the next wake-up is found in a
+// few instructions and the worker thread sleeps until then instead of
+// ticking. Reaching a slot on a higher level moves its reminders down,
+// at most REMIND_LEVELS times each over their lifetime.
+//
+// remind_follow() keeps one reminder per configured offset for every open
+// task with a deadline, following the store's change notifications:
+// adding, completing, rescheduling or deleting a task moves only that
+// task's reminders. A folder that is not materialized is scheduled from the
+// deadline and completion columns of its data file section, without
+// loading it; those reminders name the task by its row in the section, and
+// are replaced by the tasks' own when the folder loads. Reminders whose
+// time has already passed when they are scheduled are skipped.
+//
+// Fired reminders are passed to a callback on the worker thread, or on
+// the caller's thread from remind_run(); the callback must not call back
+// into the engine. Times are milliseconds on the engine's clock, by
+// default remind_local_clock_ms(). Everything but the callback and
+// remind_run() is called from the thread that owns the store.
+
+#define REMIND_TICK_MS 1000
+#define REMIND_LEVELS 8
+#define REMIND_MAX_OFFSETS 4
+#define REMIND_DEFAULT_MINUTE (9 * 60)      // 09:00 on the day a reminder is for
+#define REMIND_MAX_WAIT_MS (15 * 60 * 1000) // Look at the clock again at least this often
+#define REMIND_BATCH 256                    // Reminders fired per pass of the worker
+
+typedef struct {
+    uint64_t when;          // Milliseconds on the engine's clock
+    uint32_t folder_id;
+    uint32_t task_id;       // 0 for a task of a folder that was not loaded
+    int32_t row;            // Its row in the folder's data file section then
+    int32_t deadline;       // The task's deadline when it was scheduled
+    int days_before;        // 0 for the reminder on the deadline itself
+} TodoReminder;
+
+typedef void (*TodoReminderFired)(void *context, const TodoReminder *reminder);
+
+typedef struct TodoReminders TodoReminders;
+
+TodoReminders *remind_create(TodoReminderFired fired, void *context);
+// Stops the worker and the store notifications
+void remind_destroy(TodoReminders *reminders);
+
+// Time source; set it before scheduling anything
+void remind_set_clock(TodoReminders *reminders, TodoClock clock, void *context);
+// Milliseconds since 1970-01-01 00:00 local time; the context is unused
+uint64_t remind_local_clock_ms(void *context);
+
+// Low level: schedule one reminder and get a handle to it (0 when out of
+// memory), then cancel it or move it to another time
+uint32_t remind_add(TodoReminders *reminders, const TodoReminder *reminder);
+int remind_cancel(TodoReminders *reminders, uint32_t handle);
+int remind_move(TodoReminders *reminders, uint32_t handle, uint64_t when);
+
+// Schedule reminders for the store's tasks, days_before[i] days before
+// each deadline at minute_of_day (0 to 1439), and keep them in step with
+// the store. Only one store can be followed at a time.
+int remind_follow(TodoReminders *reminders, TodoStore *store, const int *days_before, int count,
+                  int minute_of_day);
+
+// Fire every reminder due at now on the caller's thread; returns how many
+size_t remind_run(TodoReminders *reminders, uint64_t now);
+// When the next reminder is due, UINT64_MAX if none is pending. Never
+// later than the true time, but may be earlier when that reminder is still
+// on an upper level.
+uint64_t remind_next_due(TodoReminders *reminders);
+size_t remind_pending(TodoReminders *reminders);
+
+// Fire reminders on a worker thread that sleeps until the next one is due
+int remind_start(TodoReminders *reminders);
+void remind_stop(TodoReminders *reminders);
+// Make the worker look at the clock again, after a fake clock has moved
+void remind_wake(TodoReminders *reminders);
+
+#endif
@@ -0,0 +1,583 @@
+#include "todo_search.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define WORD_START '\001'       // Pseudo-byte before each word in prefix grams
+#define PAIR '\002'             // Pseudo-byte before every two bytes, for two-byte queries
+#define NO_DOC 0                // Slot value in the id maps; doc ids start at 1
+#define PURGE_MIN_DEAD 1024
+#define MAX_QUERY 256           // Longer queries are cut to this many bytes
+
+typedef struct {
+    uint32_t text_offset;
+    uint16_t text_length;
+    uint8_t alive;
+    uint8_t is_folder;
+    uint32_t folder_id;
+    uint32_t task_id;
+    uint32_t letters;       // letters_of() the text
+} SearchDoc;
+
+// Hash table slot; gram is the three bytes plus one, 0 for an empty slot
+typedef struct {
+    uint32_t gram;
+    uint32_t count;
+    uint32_t capacity;
+    uint32_t *docs;
+} SearchPosting;
+
+struct TodoSearchIndex {
+    TodoStore *store;
+    SearchDoc *docs;            // docs[0] is unused so that 0 means "none"
+    uint32_t doc_count;
+    uint32_t doc_capacity;
+    uint32_t dead_docs;
+    char *text;                 // Folded text of every document, back to back
+    size_t text_size;
+    size_t text_capacity;
+    SearchPosting *slots;
+    uint32_t slot_count;        // Power of two
+    uint32_t used_slots;
+    uint32_t *task_docs;        // Task slot index -> doc id
+    uint32_t task_docs_capacity;
+    uint32_t *folder_docs;      // Folder id -> doc id
+    uint32_t folder_docs_capacity;
+    SearchPosting *folder_lists;    // Folder id -> its documents, name included
+    uint32_t folder_lists_capacity;
+};
+
+static unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+static int is_word_byte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || c >= 0x80;
+}
+
+// A bit for each of the letters a-z and digits that share six bits; a
+// document holds every letter of a query it matches
+static uint32_t letters_of(const unsigned char *folded, size_t length) {
+    uint32_t letters = 0;
+
+    for (size_t i = 0; i < length; i++) {
+        unsigned char c = folded[i];
+
+        if (c >= 'a' && c <= 'z') letters |= 1u << (c - 'a');
+        if (c >= '0' && c <= '9') letters |= 1u << (26 + (c - '0') % 6);
+    }
+    return letters;
+}
+
+static uint32_t pack_gram(unsigned char a, unsigned char b, unsigned char c) {
+    return (((uint32_t)a << 16) | ((uint32_t)b << 8) | c) + 1;
+}
+
+static int grow(void **items, uint32_t *capacity, size_t needed, size_t size) {
+    size_t new_capacity = *capacity ? *capacity : 256;
+    void *grown;
+
+    if (needed <= *capacity) return 1;
+    while (new_capacity < needed) new_capacity *= 2;
+    if (new_capacity > UINT32_MAX) return 0;
+    grown = realloc(*items, new_capacity * size);
+    if (grown == NULL) return 0;
+    *items = grown;
+    *capacity = (uint32_t)new_capacity;
+    return 1;
+}
+
+// Grow an id -> doc map so that id is a valid slot, zero-filling new slots
+static int grow_map(uint32_t **map, uint32_t *capacity, uint32_t id) {
+    uint32_t old = *capacity;
+
+    if (!grow((void **)map, capacity, (size_t)id + 1, sizeof(uint32_t))) return 0;
+    memset(*map + old, 0, (size_t)(*capacity - old) * sizeof(uint32_t));
+    return 1;
+}
+
+static uint32_t hash_gram(uint32_t gram, uint32_t slot_count) {
+    return (gram * 0x9E3779B1u) >> 8 & (slot_count - 1);
+}
+
+static SearchPosting *find_posting(const TodoSearchIndex *index, uint32_t gram) {
+    uint32_t slot;
+
+    if (index->slot_count == 0) return NULL;
+    slot = hash_gram(gram, index->slot_count);
+    while (index->slots[slot].gram != 0) {
+        if (index->slots[slot].gram == gram) return &index->slots[slot];
+        slot = (slot + 1) & (index->slot_count - 1);
+    }
+    return NULL;
+}
+
+static int rehash(TodoSearchIndex *index, uint32_t slot_count) {
+    SearchPosting *old = index->slots;
+    uint32_t old_count = index->slot_count;
+    SearchPosting *slots = (SearchPosting *)calloc(slot_count, sizeof(SearchPosting));
+
+    if (slots == NULL) return 0;
+    for (uint32_t i = 0; i < old_count; i++) {
+        uint32_t slot;
+
+        if (old[i].gram == 0) continue;
+        slot = hash_gram(old[i].gram, slot_count);
+        while (slots[slot].gram != 0) slot = (slot + 1) & (slot_count - 1);
+        slots[slot] = old[i];
+    }
+    free(old);
+    index->slots = slots;
+    index->slot_count = slot_count;
+    return 1;
+}
+
+// Documents are added in increasing order; a repeated one is a no-op
+static int append_doc(SearchPosting *posting, uint32_t doc) {
+    if (posting->count > 0 && posting->docs[posting->count - 1] == doc) return 1;
+    if (posting->count == posting->capacity) {
+        uint32_t capacity = posting->capacity ? posting->capacity * 2 : 4;
+        uint32_t *docs = (uint32_t *)realloc(posting->docs, capacity * sizeof(uint32_t));
+        if (docs == NULL) return 0;
+        posting->docs = docs;
+        posting->capacity = capacity;
+    }
+    posting->docs[posting->count++] = doc;
+    return 1;
+}
+
+// The document list of a folder, grown so that folder_id has one
+static SearchPosting *folder_list(TodoSearchIndex *index, uint32_t folder_id) {
+    uint32_t old = index->folder_lists_capacity;
+
+    if (!grow((void **)&index->folder_lists, &index->folder_lists_capacity, (size_t)folder_id + 1,
+              sizeof(SearchPosting))) {
+        return NULL;
+    }
+    memset(index->folder_lists + old, 0, (size_t)(index->folder_lists_capacity - old) * sizeof(SearchPosting));
+    return &index->folder_lists[folder_id];
+}
+
+static int add_posting(TodoSearchIndex *index, uint32_t gram, uint32_t doc) {
+    SearchPosting *posting = find_posting(index, gram);
+
+    if (posting == NULL) {
+        uint32_t slot;
+
+        // Keep the table at most half full
+        if ((index->used_slots + 1) * 2 > index->slot_count &&
+            !rehash(index, index->slot_count ? index->slot_count * 2 : 4096)) {
+            return 0;
+        }
+        slot = hash_gram(gram, index->slot_count);
+        while (index->slots[slot].gram != 0) slot = (slot + 1) & (index->slot_count - 1);
+        posting = &index->slots[slot];
+        posting->gram = gram;
+        index->used_slots++;
+    }
+    return append_doc(posting, doc);
+}
+
+static uint32_t add_document(TodoSearchIndex *index, const char *text, int is_folder,
+                             uint32_t folder_id, uint32_t task_id) {
+    size_t length = strlen(text);
+    SearchPosting *list = folder_list(index, folder_id);
+    uint32_t doc;
+    unsigned char *folded;
+
+    if (length > UINT16_MAX) length = UINT16_MAX;
+    if (list == NULL) return NO_DOC;
+    if (index->doc_count == 0) index->doc_count = 1;    // Reserve doc 0
+    if (!grow((void **)&index->docs, &index->doc_capacity, (size_t)index->doc_count + 1, sizeof(SearchDoc))) {
+        return NO_DOC;
+    }
+    if (index->text_size + length > index->text_capacity) {
+        size_t capacity = index->text_capacity ? index->text_capacity : 4096;
+        char *grown;
+
+        while (capacity < index->text_size + length) capacity *= 2;
+        grown = (char *)realloc(index->text, capacity);
+        if (grown == NULL) return NO_DOC;
+        index->text = grown;
+        index->text_capacity = capacity;
+    }
+
+    if (!append_doc(list, index->doc_count)) return NO_DOC;
+    doc = index->doc_count++;
+    folded = (unsigned char *)index->text + index->text_size;
+    for (size_t i = 0; i < length; i++) {
+        folded[i] = fold((unsigned char)text[i]);
+    }
+    index->docs[doc].text_offset = (uint32_t)index->text_size;
+    index->docs[doc].text_length = (uint16_t)length;
+    index->docs[doc].alive = 1;
+    index->docs[doc].is_folder = (uint8_t)is_folder;
+    index->docs[doc].folder_id = folder_id;
+    index->docs[doc].task_id = task_id;
+    index->docs[doc].letters = letters_of(folded, length);
+    index->text_size += length;
+
+    for (size_t i = 0; i < length; i++) {
+        int word_start = is_word_byte(folded[i]) && (i == 0 || !is_word_byte(folded[i - 1]));
+
+        if (i + 2 < length && !add_posting(index, pack_gram(folded[i], folded[i + 1], folded[i + 2]), doc)) {
+            break;
+        }
+        if (i + 1 < length && !add_posting(index, pack_gram(PAIR, folded[i], folded[i + 1]), doc)) {
+            break;
+        }
+        if (word_start && i + 1 < length &&
+            !add_posting(index, pack_gram(WORD_START, folded[i], folded[i + 1]), doc)) {
+            break;
+        }
+    }
+    return doc;
+}
+
+static void kill_document(TodoSearchIndex *index, uint32_t doc) {
+    if (doc == NO_DOC || !index->docs[doc].alive) return;
+    index->docs[doc].alive = 0;
+    index->dead_docs++;
+}
+
+// Tasks are mapped by the slot index of their handle, which stays small
+// however often slots are reused
+static void index_task(TodoSearchIndex *index, uint32_t folder_id, const Task *task) {
+    uint32_t doc;
+
+    if (!grow_map(&index->task_docs, &index->task_docs_capacity, SLOTS_INDEX(task->id))) return;
+    doc = add_document(index, store_text(index->store, task->description), 0, folder_id, task->id);
+    index->task_docs[SLOTS_INDEX(task->id)] = doc;
+}
+
+static void index_folder_tasks(TodoSearchIndex *index, const Folder *folder) {
+    for (int i = 0; i < folder->task_count; i++) {
+        index_task(index, folder->id, store_task(index->store, folder, i));
+    }
+}
+
+static void index_folder(TodoSearchIndex *index, const Folder *folder) {
+    if (!grow_map(&index->folder_docs, &index->folder_docs_capacity, folder->id)) return;
+    index->folder_docs[folder->id] = add_document(index, store_text(index->store, folder->name), 1, folder->id, 0);
+    if (folder->loaded) {
+        index_folder_tasks(index, folder);
+    }
+}
+
+static void clear_index(TodoSearchIndex *index) {
+    for (uint32_t i = 0; i < index->slot_count; i++) {
+        free(index->slots[i].docs);
+    }
+    free(index->slots);
+    index->slots = NULL;
+    index->slot_count = 0;
+    for (uint32_t i = 0; i < index->folder_lists_capacity; i++) {
+        index->folder_lists[i].count = 0;
+    }
+    index->used_slots = 0;
+    index->doc_count = 0;
+    index->dead_docs = 0;
+    index->text_size = 0;
+    if (index->task_docs) memset(index->task_docs, 0, index->task_docs_capacity * sizeof(uint32_t));
+    if (index->folder_docs) memset(index->folder_docs, 0, index->folder_docs_capacity * sizeof(uint32_t));
+}
+
+static void rebuild_index(TodoSearchIndex *index) {
+    clear_index(index);
+    for (int i = 0; i < index->store->folder_count; i++) {
+        index_folder(index, &index->store->folders[i]);
+    }
+}
+
+// Drop dead documents once they outnumber the live ones
+static void maybe_purge(TodoSearchIndex *index) {
+    uint32_t live = index->doc_count - 1 - index->dead_docs;
+
+    if (index->dead_docs >= PURGE_MIN_DEAD && index->dead_docs > live) {
+        rebuild_index(index);
+    }
+}
+
+TodoSearchIndex *search_create(TodoStore *store) {
+    TodoSearchIndex *index = (TodoSearchIndex *)calloc(1, sizeof(TodoSearchIndex));
+
+    if (index == NULL) return NULL;
+    index->store = store;
+    if (!store_listen(store, search_on_change, index)) {
+        free(index);
+        return NULL;
+    }
+    rebuild_index(index);
+    return index;
+}
+
+void search_destroy(TodoSearchIndex *index) {
+    if (index == NULL) return;
+    store_unlisten(index->store, search_on_change, index);
+    clear_index(index);
+    free(index->docs);
+    free(index->text);
+    free(index->task_docs);
+    free(index->folder_docs);
+    for (uint32_t i = 0; i < index->folder_lists_capacity; i++) {
+        free(index->folder_lists[i].docs);
+    }
+    free(index->folder_lists);
+    free(index);
+}
+
+void search_on_change(void *context, const TodoStoreChange *change) {
+    TodoSearchIndex *index = (TodoSearchIndex *)context;
+    const TodoStore *store = index->store;
+
+    switch (change->kind) {
+        case STORE_RESET:
+            rebuild_index(index);
+            break;
+        case STORE_FOLDER_ADDED:
+            index_folder(index, &store->folders[change->folder]);
+            break;
+        case STORE_FOLDER_LOADED:
+            index_folder_tasks(index, &store->folders[change->folder]);
+            break;
+        case STORE_FOLDER_REMOVED:
+            if (change->folder_id < index->folder_docs_capacity) {
+                kill_document(index, index->folder_docs[change->folder_id]);
+                index->folder_docs[change->folder_id] = NO_DOC;
+            }
+            if (change->folder_id < index->folder_lists_capacity) {
+                SearchPosting *list = &index->folder_lists[change->folder_id];
+
+                for (uint32_t i = 0; i < list->count; i++) {
+                    kill_document(index, list->docs[i]);
+                }
+                list->count = 0;
+            }
+            maybe_purge(index);
+            break;
+        case STORE_TASK_ADDED:
+            index_task(index, change->folder_id, store_task(store, &store->folders[change->folder], change->position));
+            break;
+        case STORE_TASK_REMOVED:
+            if (SLOTS_INDEX(change->task_id) < index->task_docs_capacity) {
+                kill_document(index, index->task_docs[SLOTS_INDEX(change->task_id)]);
+                index->task_docs[SLOTS_INDEX(change->task_id)] = NO_DOC;
+            }
+            maybe_purge(index);
+            break;
+    }
+}
+
+// Does folded text contain query at any position (or at a word start)?
+static int text_matches(const unsigned char *text, size_t length,
+                        const unsigned char *query, size_t query_length, int mode) {
+    if (query_length > length) return 0;
+    for (size_t i = 0; i + query_length <= length; i++) {
+        if (text[i] != query[0]) continue;
+        if (mode == SEARCH_PREFIX &&
+            (!is_word_byte(text[i]) || (i > 0 && is_word_byte(text[i - 1])))) {
+            continue;
+        }
+        if (memcmp(text + i, query, query_length) == 0) return 1;
+    }
+    return 0;
+}
+
+typedef struct {
+    unsigned char text[MAX_QUERY];  // Folded
+    size_t length;
+    int mode;
+    uint32_t letters;               // letters_of() the text
+    int exact;                      // Being on the gram lists is a match
+} SearchQuery;
+
+static int accept(const TodoSearchIndex *index, uint32_t doc, const SearchQuery *query) {
+    const SearchDoc *entry = &index->docs[doc];
+
+    if (!entry->alive || (entry->letters & query->letters) != query->letters) return 0;
+    if (query->exact) return 1;
+    return text_matches((const unsigned char *)index->text + entry->text_offset,
+                        entry->text_length, query->text, query->length, query->mode);
+}
+
+// Track the two shortest posting lists seen so far
+static void keep_shortest(const SearchPosting *posting, const SearchPosting **shortest,
+                          const SearchPosting **second) {
+    if (posting == *shortest || posting == *second) return;
+    if (*shortest == NULL || posting->count < (*shortest)->count) {
+        *second = *shortest;
+        *shortest = posting;
+    } else if (*second == NULL || posting->count < (*second)->count) {
+        *second = posting;
+    }
+}
+
+// First position at or after from whose doc is not below doc
+static uint32_t gallop(const uint32_t *docs, uint32_t count, uint32_t from, uint32_t doc) {
+    uint32_t step = 1;
+    uint32_t low = from;
+    uint32_t high = from;
+
+    while (high < count && docs[high] < doc) {
+        low = high + 1;
+        high += step;
+        step *= 2;
+    }
+    if (high > count) high = count;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        if (docs[mid] < doc) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+// Part of a sorted document list still to be walked
+typedef struct {
+    const uint32_t *docs;
+    uint32_t count;
+    uint32_t cursor;
+} SearchRun;
+
+static void add_run(SearchRun *runs, int *run_count, const SearchPosting *posting) {
+    runs[*run_count].docs = posting->docs;
+    runs[*run_count].count = posting->count;
+    runs[*run_count].cursor = 0;
+    (*run_count)++;
+}
+
+// Keep only the documents from first to last
+static void clip_run(SearchRun *run, uint32_t first, uint32_t last) {
+    uint32_t low = gallop(run->docs, run->count, 0, first);
+    uint32_t high = gallop(run->docs, run->count, low, last + 1);
+
+    run->docs += low;
+    run->count = high - low;
+}
+
+size_t search_query(const TodoSearchIndex *index, const char *query, int mode,
+                    uint32_t folder_id, TodoSearchHit *hits, size_t max_hits) {
+    SearchQuery search;
+    const unsigned char *folded = search.text;
+    size_t length = 0;
+    const SearchPosting *shortest = NULL;
+    const SearchPosting *second = NULL;
+    SearchRun runs[3];
+    int run_count = 0;
+    size_t found = 0;
+
+    while (query[length] != '\0' && length < sizeof(search.text)) {
+        search.text[length] = fold((unsigned char)query[length]);
+        length++;
+    }
+    if (length == 0 || max_hits == 0) return 0;
+    search.length = length;
+    search.mode = mode;
+    search.letters = letters_of(folded, length);
+    // One gram covering the whole query, or a lone letter the signature
+    // holds, needs no look at the text
+    search.exact = mode == SEARCH_SUBSTRING ? length <= 3 && (length > 1 || (folded[0] >= 'a' && folded[0] <= 'z'))
+                                            : length == 2;
+
+    // Pick the gram with the fewest documents; any missing gram means no hits
+    for (size_t i = 0; i + 2 < length || (i == 0 && length == 2); i++) {
+        uint32_t gram = length == 2 ? pack_gram(mode == SEARCH_PREFIX ? WORD_START : PAIR, folded[0], folded[1])
+                      : mode == SEARCH_PREFIX && i == 0 ? pack_gram(WORD_START, folded[0], folded[1])
+                      : pack_gram(folded[i], folded[i + 1], folded[i + 2]);
+        const SearchPosting *posting = find_posting(index, gram);
+
+        if (posting == NULL) return 0;
+        keep_shortest(posting, &shortest, &second);
+
+        // Prefix queries also need the plain gram at the start
+        if (mode == SEARCH_PREFIX && i == 0 && length >= 3) {
+            posting = find_posting(index, pack_gram(folded[0], folded[1], folded[2]));
+            if (posting == NULL) return 0;
+            keep_shortest(posting, &shortest, &second);
+        }
+    }
+    if (shortest != NULL) add_run(runs, &run_count, shortest);
+    if (second != NULL) add_run(runs, &run_count, second);
+
+    // A folder's own list narrows the candidates like a gram does. Its
+    // documents mostly sit together, so the gram lists are first cut to the
+    // stretch between its first and last document.
+    if (folder_id != 0) {
+        const SearchPosting *list;
+
+        if (folder_id >= index->folder_lists_capacity || index->folder_lists[folder_id].count == 0) return 0;
+        list = &index->folder_lists[folder_id];
+        for (int i = 0; i < run_count; i++) {
+            clip_run(&runs[i], list->docs[0], list->docs[list->count - 1]);
+        }
+        add_run(runs, &run_count, list);
+    }
+    for (int i = 1; i < run_count; i++) {
+        for (int j = i; j > 0 && runs[j].count < runs[j - 1].count; j--) {
+            SearchRun swap = runs[j];
+            runs[j] = runs[j - 1];
+            runs[j - 1] = swap;
+        }
+    }
+
+    if (run_count > 0) {
+        // Walk the shortest run; the others are sorted too, so candidates
+        // they lack are skipped before touching their text
+        for (uint32_t i = 0; i < runs[0].count && found < max_hits; i++) {
+            uint32_t doc = runs[0].docs[i];
+            int missing = 0;
+
+            for (int j = 1; j < run_count && !missing; j++) {
+                runs[j].cursor = gallop(runs[j].docs, runs[j].count, runs[j].cursor, doc);
+                if (runs[j].cursor == runs[j].count) return found;
+                missing = runs[j].docs[runs[j].cursor] != doc;
+            }
+            if (!missing && accept(index, doc, &search)) {
+                hits[found].folder_id = index->docs[doc].folder_id;
+                hits[found].task_id = index->docs[doc].task_id;
+                found++;
+            }
+        }
+        return found;
+    }
+
+    // Too short for a gram and not limited to a folder: scan the documents
+    for (uint32_t doc = 1; doc < index->doc_count && found < max_hits; doc++) {
+        if (accept(index, doc, &search)) {
+            hits[found].folder_id = index->docs[doc].folder_id;
+            hits[found].task_id = index->docs[doc].task_id;
+            found++;
+        }
+    }
+    return found;
+}
+
+int search_text_matches(const char *text, size_t length, const char *query, int mode) {
+    unsigned char folded[MAX_QUERY];
+    size_t query_length = 0;
+
+    while (query[query_length] != '\0' && query_length < sizeof(folded)) {
+        folded[query_length] = fold((unsigned char)query[query_length]);
+        query_length++;
+    }
+    if (query_length == 0) return 0;
+    if (length > UINT16_MAX) length = UINT16_MAX;   // All a document holds
+    for (size_t i = 0; i + query_length <= length; i++) {
+        size_t j = 0;
+
+        if (mode == SEARCH_PREFIX && (!is_word_byte(fold((unsigned char)text[i])) ||
+                                      (i > 0 && is_word_byte(fold((unsigned char)text[i - 1]))))) {
+            continue;
+        }
+        while (j < query_length && fold((unsigned char)text[i + j]) == folded[j]) j++;
+        if (j == query_length) return 1;
+    }
+    return 0;
+}
+
+size_t search_document_count(const TodoSearchIndex *index) {
+    return index->doc_count ? index->doc_count - 1 - index->dead_docs : 0;
+}
@@ -0,0 +1,62 @@
+#ifndef TODO_SEARCH_H
+#define TODO_SEARCH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "todo_core.h"
+
+// Trigram index over task descriptions and folder names.
+//
+// Each description or name is a document; every three-byte sequence of its
+// case-folded text has a posting list of the documents containing it, plus
+// one gram per two-byte sequence and one per word start, so queries of two
+// bytes or more need no scan. A query walks the shortest posting list
+// among its grams, skips documents missing from the next shortest, and
+// checks the text of the rest; a query of two or three bytes is answered by
+// its gram alone. Each document also has a bit per letter it contains,
+// which answers one-letter queries and rules out documents before their
+// text is read. Postings are appended in document order, so they stay
+// sorted without any sorting. The index follows the store through its change
+// notifications: deleted documents are dropped from the results at once
+// and purged from the postings once they outnumber the live ones.
+//
+// Each folder also keeps the list of its documents. A query limited to one
+// folder first cuts the gram lists to the stretch of documents the folder
+// spans, then walks whichever list is shortest, so other folders'
+// documents are skipped without being looked at.
+//
+// Tasks are indexed when their folder is materialized. Matching is
+// case-insensitive for ASCII; other bytes must match exactly.
+
+enum {
+    SEARCH_SUBSTRING = 0,   // The text contains the query anywhere
+    SEARCH_PREFIX           // Some word of the text starts with the query
+};
+
+typedef struct {
+    uint32_t folder_id;
+    uint32_t task_id;       // 0 when the folder name matched
+} TodoSearchHit;
+
+typedef struct TodoSearchIndex TodoSearchIndex;
+
+// Index everything the store holds now and follow it from then on
+TodoSearchIndex *search_create(TodoStore *store);
+void search_destroy(TodoSearchIndex *index);
+
+// TodoStoreListener; registered by search_create
+void search_on_change(void *index, const TodoStoreChange *change);
+
+// Collect up to max_hits matches in index order, optionally limited to one
+// folder (folder_id 0 searches everything). Returns the number stored.
+size_t search_query(const TodoSearchIndex *index, const char *query, int mode,
+                    uint32_t folder_id, TodoSearchHit *hits, size_t max_hits);
+
+// Would search_query() find this text? For checking one changed document
+// without the index.
+int search_text_matches(const char *text, size_t length, const char *query, int mode);
+
+// Documents currently searchable
+size_t search_document_count(const TodoSearchIndex *index);
+
+#endif
@@ -0,0 +1,93 @@
+#include "todo_slots.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define SLOT_LIVE UINT32_MAX
+
+// Precedes every item. next is SLOT_LIVE while the slot holds an item,
+// otherwise the free list link in the same form as free_head.
+typedef struct {
+    uint32_t generation;
+    uint32_t next;
+} SlotHeader;
+
+static SlotHeader *slot_at(const TodoSlotMap *map, uint32_t index) {
+    return (SlotHeader *)(map->chunks[index >> SLOTS_CHUNK_BITS] +
+                          (size_t)(index & (SLOTS_CHUNK - 1)) * map->slot_size);
+}
+
+void slots_init(TodoSlotMap *map, size_t item_size) {
+    memset(map, 0, sizeof(*map));
+    map->slot_size = sizeof(SlotHeader) + (item_size + 7) / 8 * 8;
+}
+
+void slots_free(TodoSlotMap *map) {
+    size_t slot_size = map->slot_size;
+
+    for (uint32_t i = 0; i < map->chunk_count; i++) {
+        free(map->chunks[i]);
+    }
+    free(map->chunks);
+    memset(map, 0, sizeof(*map));
+    map->slot_size = slot_size;
+}
+
+static int add_chunk(TodoSlotMap *map) {
+    if (map->chunk_count == map->chunk_capacity) {
+        uint32_t capacity = map->chunk_capacity ? map->chunk_capacity * 2 : 16;
+        unsigned char **grown = (unsigned char **)realloc(map->chunks, capacity * sizeof(unsigned char *));
+
+        if (grown == NULL) return 0;
+        map->chunks = grown;
+        map->chunk_capacity = capacity;
+    }
+    map->chunks[map->chunk_count] = (unsigned char *)malloc(SLOTS_CHUNK * map->slot_size);
+    if (map->chunks[map->chunk_count] == NULL) return 0;
+    map->chunk_count++;
+    return 1;
+}
+
+void *slots_alloc(TodoSlotMap *map, uint32_t *handle) {
+    SlotHeader *slot;
+    uint32_t index;
+
+    if (map->free_head != 0) {
+        index = map->free_head - 1;
+        slot = slot_at(map, index);
+        map->free_head = slot->next;
+    } else {
+        if (map->used == SLOTS_MAX) return NULL;
+        if (map->used == map->chunk_count * SLOTS_CHUNK && !add_chunk(map)) return NULL;
+        index = map->used++;
+        slot = slot_at(map, index);
+        slot->generation = 1;
+    }
+
+    slot->next = SLOT_LIVE;
+    memset(slot + 1, 0, map->slot_size - sizeof(SlotHeader));
+    map->live++;
+    *handle = slot->generation << SLOTS_INDEX_BITS | index;
+    return slot + 1;
+}
+
+void slots_release(TodoSlotMap *map, uint32_t handle) {
+    SlotHeader *slot;
+
+    if (slots_get(map, handle) == NULL) return;
+    slot = slot_at(map, SLOTS_INDEX(handle));
+    slot->generation = slot->generation == 255 ? 1 : slot->generation + 1;
+    slot->next = map->free_head;
+    map->free_head = SLOTS_INDEX(handle) + 1;
+    map->live--;
+}
+
+void *slots_get(const TodoSlotMap *map, uint32_t handle) {
+    uint32_t index = SLOTS_INDEX(handle);
+    SlotHeader *slot;
+
+    if (index >= map->used) return NULL;
+    slot = slot_at(map, index);
+    if (slot->next != SLOT_LIVE || slot->generation != handle >> SLOTS_INDEX_BITS) return NULL;
+    return slot + 1;
+}
@@ -0,0 +1,47 @@
+#ifndef TODO_SLOTS_H
+#define TODO_SLOTS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Slot map: a pool of fixed-size items addressed by generation-checked
+// handles.
+//
+// Items live in chunks of SLOTS_CHUNK that are allocated as the map grows
+// and never move, so a pointer to an item stays valid until that item is
+// released. A released slot becomes a tombstone at the head of a free list
+// and is handed out again first, with its generation bumped: handles to
+// the old item stop resolving rather than finding the new one. Allocating
+// and releasing are O(1) and never copy other items.
+//
+// A handle holds the slot index in its low SLOTS_INDEX_BITS bits and the
+// generation above them. Generations run from 1 to 255, so 0 is never a
+// handle; a slot reused 255 times lets a handle that old resolve again.
+
+#define SLOTS_CHUNK_BITS 10
+#define SLOTS_CHUNK (1u << SLOTS_CHUNK_BITS)
+#define SLOTS_INDEX_BITS 24
+#define SLOTS_MAX (1u << SLOTS_INDEX_BITS)
+#define SLOTS_INDEX(handle) ((handle) & (SLOTS_MAX - 1))
+
+typedef struct {
+    unsigned char **chunks;
+    uint32_t chunk_count;
+    uint32_t chunk_capacity;
+    size_t slot_size;       // Header plus item, a multiple of 8
+    uint32_t used;          // Slots handed out at least once
+    uint32_t live;
+    uint32_t free_head;     // Index + 1 of the newest tombstone, 0 if none
+} TodoSlotMap;
+
+void slots_init(TodoSlotMap *map, size_t item_size);
+void slots_free(TodoSlotMap *map);
+
+// A zeroed item and its handle, or NULL when out of memory or full
+void *slots_alloc(TodoSlotMap *map, uint32_t *handle);
+void slots_release(TodoSlotMap *map, uint32_t handle);
+
+// The item, or NULL if the handle is stale or was never handed out
+void *slots_get(const TodoSlotMap *map, uint32_t handle);
+
+#endif
@@ -0,0 +1,188 @@
+#include "todo_sort.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DEADLINE_BITS 22
+#define DEADLINE_LAST ((1u << DEADLINE_BITS) - 1)
+
+static const char *preset_names[SORT_PRESET_COUNT] = {
+    "Deadline", "Priority", "Newest first", "Oldest first"
+};
+
+TodoSortOrder sort_preset(int preset) {
+    TodoSortOrder order;
+
+    memset(&order, 0, sizeof(order));
+    switch (preset) {
+        case SORT_PRESET_PRIORITY:
+            order.count = 4;
+            order.keys[0] = SORT_OPEN_FIRST;
+            order.keys[1] = SORT_PRIORITY;
+            order.keys[2] = SORT_DEADLINE;
+            order.keys[3] = SORT_OLDEST;
+            break;
+        case SORT_PRESET_NEWEST:
+            order.count = 1;
+            order.keys[0] = SORT_NEWEST;
+            break;
+        case SORT_PRESET_OLDEST:
+            order.count = 1;
+            order.keys[0] = SORT_OLDEST;
+            break;
+        default:
+            order = sort_folder_order();
+            break;
+    }
+    return order;
+}
+
+const char *sort_preset_name(int preset) {
+    return preset >= 0 && preset < SORT_PRESET_COUNT ? preset_names[preset] : "";
+}
+
+TodoSortOrder sort_folder_order(void) {
+    TodoSortOrder order;
+
+    memset(&order, 0, sizeof(order));
+    order.count = 2;
+    order.keys[0] = SORT_OPEN_FIRST;
+    order.keys[1] = SORT_DEADLINE;
+    return order;
+}
+
+// Bits a criterion takes in the key, 0 for an unknown one
+static int field_width(int key) {
+    switch (key) {
+        case SORT_OPEN_FIRST: return 1;
+        case SORT_PRIORITY: return 2;
+        case SORT_DEADLINE: return DEADLINE_BITS;
+        case SORT_OLDEST:
+        case SORT_NEWEST: return 32;
+    }
+    return 0;
+}
+
+int sort_order_valid(const TodoSortOrder *order) {
+    int bits = 0;
+
+    if (order->count < 0 || order->count > SORT_MAX_KEYS) return 0;
+    for (int i = 0; i < order->count; i++) {
+        if (field_width(order->keys[i]) == 0) return 0;
+        bits += field_width(order->keys[i]);
+    }
+    return bits <= 64;
+}
+
+// Days from the first representable date, 0 for no deadline. Days outside
+// the calendar range are clamped to its ends.
+static uint64_t deadline_field(int32_t day) {
+    int64_t offset;
+
+    if (day == DATE_NONE) return 0;
+    offset = (int64_t)day - DATE_FIRST_DAY + 1;
+    if (offset < 1) return 1;
+    if (offset > DEADLINE_LAST) return DEADLINE_LAST;
+    return (uint64_t)offset;
+}
+
+uint64_t sort_key(const TodoSortOrder *order, const Task *task) {
+    uint64_t key = 0;
+
+    for (int i = 0; i < order->count; i++) {
+        uint64_t field = 0;
+
+        switch (order->keys[i]) {
+            case SORT_OPEN_FIRST: field = task->completed != 0; break;
+            case SORT_PRIORITY: field = (uint64_t)(PRIORITY_HIGH - task->priority) & 3; break;
+            case SORT_DEADLINE: field = deadline_field(task->deadline_day); break;
+            case SORT_OLDEST: field = task->sequence; break;
+            case SORT_NEWEST: field = UINT32_MAX - task->sequence; break;
+        }
+        key = (key << field_width(order->keys[i])) | field;
+    }
+    return key;
+}
+
+// One counting pass gives the histograms of all eight digits. A digit that
+// every key shares would leave the order as it is, so its pass is skipped;
+// narrow keys never pay for their zero upper bytes.
+int sort_radix(uint64_t *keys, uint32_t *items, size_t count) {
+    size_t (*counts)[256];
+    uint64_t *key_buffer;
+    uint32_t *item_buffer;
+    uint64_t *from_keys = keys;
+    uint32_t *from_items = items;
+
+    if (count < 2) return 1;
+    counts = (size_t (*)[256])calloc(8, sizeof(*counts));
+    key_buffer = (uint64_t *)malloc(count * sizeof(uint64_t));
+    item_buffer = (uint32_t *)malloc(count * sizeof(uint32_t));
+    if (counts == NULL || key_buffer == NULL || item_buffer == NULL) {
+        free(counts);
+        free(key_buffer);
+        free(item_buffer);
+        return 0;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t key = keys[i];
+
+        for (int digit = 0; digit < 8; digit++) {
+            counts[digit][(key >> (digit * 8)) & 0xFF]++;
+        }
+    }
+
+    for (int digit = 0; digit < 8; digit++) {
+        int shift = digit * 8;
+        size_t *offsets = counts[digit];
+        uint64_t *to_keys = from_keys == keys ? key_buffer : keys;
+        uint32_t *to_items = from_items == items ? item_buffer : items;
+        size_t total = 0;
+
+        if (offsets[(from_keys[0] >> shift) & 0xFF] == count) continue;
+        for (int value = 0; value < 256; value++) {
+            size_t n = offsets[value];
+            offsets[value] = total;
+            total += n;
+        }
+        for (size_t i = 0; i < count; i++) {
+            size_t at = offsets[(from_keys[i] >> shift) & 0xFF]++;
+            to_keys[at] = from_keys[i];
+            to_items[at] = from_items[i];
+        }
+        from_keys = to_keys;
+        from_items = to_items;
+    }
+
+    if (from_keys != keys) {
+        memcpy(keys, from_keys, count * sizeof(uint64_t));
+        memcpy(items, from_items, count * sizeof(uint32_t));
+    }
+    free(counts);
+    free(key_buffer);
+    free(item_buffer);
+    return 1;
+}
+
+int sort_rows(const TodoStore *store, const Folder *folder, const TodoSortOrder *order, int *rows, int count) {
+    uint64_t *keys;
+    uint32_t *items;
+    int ok;
+
+    if (!sort_order_valid(order) || count < 0) return 0;
+    keys = (uint64_t *)malloc((size_t)(count > 0 ? count : 1) * sizeof(uint64_t));
+    items = (uint32_t *)malloc((size_t)(count > 0 ? count : 1) * sizeof(uint32_t));
+    ok = keys != NULL && items != NULL;
+    for (int i = 0; i < count && ok; i++) {
+        keys[i] = sort_key(order, store_task(store, folder, rows[i]));
+        items[i] = (uint32_t)rows[i];
+    }
+    ok = ok && sort_radix(keys, items, (size_t)count);
+    for (int i = 0; i < count && ok; i++) {
+        rows[i] = (int)items[i];
+    }
+    free(keys);
+    free(items);
+    return ok;
+}
@@ -0,0 +1,66 @@
+#ifndef TODO_SORT_H
+#define TODO_SORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "todo_core.h"
+
+// Multi-key task orders.
+//
+// An order is a list of up to SORT_MAX_KEYS criteria, most significant
+// first. Each task's criteria are packed into one 64-bit integer, the
+// fields laid out from the top bits down so that comparing two keys as
+// integers compares the tasks by every criterion in turn. Sorting then
+// needs no comparator: sort_radix() is a stable LSD radix sort on 8-bit
+// digits that skips the digits every key shares, so an order of a few
+// narrow fields costs three or four passes over the rows. A new criterion
+// only needs a field width and a line in sort_key().
+//
+// Field widths: open first 1 bit, priority 2, deadline 22 (days since
+// DATE_MIN_YEAR-01-01, tasks without one first), creation order 32.
+
+enum {
+    SORT_OPEN_FIRST = 1,    // Incomplete tasks before completed ones
+    SORT_PRIORITY,          // Highest priority first
+    SORT_DEADLINE,          // Earliest deadline first, tasks without one before any
+    SORT_OLDEST,            // Creation order
+    SORT_NEWEST             // Reverse creation order
+};
+
+// Orders offered in the GUI
+enum {
+    SORT_PRESET_DEADLINE = 0,   // The folder order itself
+    SORT_PRESET_PRIORITY,
+    SORT_PRESET_NEWEST,
+    SORT_PRESET_OLDEST,
+    SORT_PRESET_COUNT
+};
+
+#define SORT_MAX_KEYS 4
+
+typedef struct {
+    int count;
+    int keys[SORT_MAX_KEYS];    // SORT_*, most significant first
+} TodoSortOrder;
+
+TodoSortOrder sort_preset(int preset);
+const char *sort_preset_name(int preset);
+
+// The order folders are kept in: open first, then by deadline
+TodoSortOrder sort_folder_order(void);
+
+// Are the keys known and do their fields fit in 64 bits?
+int sort_order_valid(const TodoSortOrder *order);
+uint64_t sort_key(const TodoSortOrder *order, const Task *task);
+
+// Sort count keys ascending, carrying items along; equal keys keep their
+// order. Returns 0, with nothing moved, when out of memory.
+int sort_radix(uint64_t *keys, uint32_t *items, size_t count);
+
+// Reorder count row indexes of a materialized folder, such as the rows a
+// filter kept, into the given order; rows that tie keep their order.
+// Returns 0, with rows unchanged, when out of memory or the order is not
+// valid.
+int sort_rows(const TodoStore *store, const Folder *folder, const TodoSortOrder *order, int *rows, int count);
+
+#endif
@@ -0,0 +1,357 @@
+#include "todo_stats.h"
+#include "todo_due.h"
+#include "todo_format.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define STATE_NONE 0xFF     // Slot not counted
+
+typedef struct {
+    TodoFolderStats counts;
+    int materialized;           // Counted task by task rather than from its section
+} FolderCounts;
+
+struct TodoStats {
+    TodoStore *store;
+    int32_t today;
+    FolderCounts *folders;      // Parallel to the store's folders
+    int folder_count;
+    uint32_t folder_capacity;
+    uint8_t *states;            // DUE_* each task was counted as, by slot index
+    uint32_t state_capacity;
+    TodoFolderStats total;
+    int unloaded;               // Folders with only their task count
+    int total_next_stale;       // total.next_deadline must be found again
+    int stale;                  // Ran out of memory: count again on the next change
+};
+
+static int grow(void **items, uint32_t *capacity, size_t needed, size_t size) {
+    size_t new_capacity = *capacity ? *capacity : 16;
+    void *grown;
+
+    if (needed <= *capacity) return 1;
+    while (new_capacity < needed) new_capacity *= 2;
+    if (new_capacity > UINT32_MAX) return 0;
+    grown = realloc(*items, new_capacity * size);
+    if (grown == NULL) return 0;
+    *items = grown;
+    *capacity = (uint32_t)new_capacity;
+    return 1;
+}
+
+static void add_state(TodoFolderStats *counts, int state, int sign) {
+    counts->open += sign * (state != DUE_DONE);
+    counts->completed += sign * (state == DUE_DONE);
+    counts->overdue += sign * (state == DUE_OVERDUE);
+    counts->due_today += sign * (state == DUE_TODAY);
+}
+
+static void empty_counts(TodoFolderStats *counts) {
+    memset(counts, 0, sizeof(*counts));
+    counts->next_deadline = DATE_NONE;
+}
+
+// Count a task in its folder's bucket for its state, taking it out of the
+// one it was counted in before if any
+static void set_state(TodoStats *stats, int index, uint32_t slot, int state) {
+    uint32_t old = stats->state_capacity;
+
+    if (!grow((void **)&stats->states, &stats->state_capacity, (size_t)slot + 1, 1)) {
+        stats->stale = 1;
+        return;
+    }
+    memset(stats->states + old, STATE_NONE, stats->state_capacity - old);
+    if (stats->states[slot] != STATE_NONE) {
+        add_state(&stats->folders[index].counts, stats->states[slot], -1);
+        add_state(&stats->total, stats->states[slot], -1);
+    }
+    if (state != STATE_NONE) {
+        add_state(&stats->folders[index].counts, state, 1);
+        add_state(&stats->total, state, 1);
+    }
+    stats->states[slot] = (uint8_t)state;
+}
+
+static void count_task(TodoStats *stats, int index, const Task *task) {
+    set_state(stats, index, SLOTS_INDEX(task->id), due_state(task, stats->today));
+}
+
+// A task new to the counts, whose slot may still hold the state of a task
+// in a deleted folder
+static void count_new_task(TodoStats *stats, int index, const Task *task) {
+    uint32_t slot = SLOTS_INDEX(task->id);
+
+    if (slot < stats->state_capacity) stats->states[slot] = STATE_NONE;
+    count_task(stats, index, task);
+}
+
+static void uncount_slot(TodoStats *stats, int index, uint32_t slot) {
+    if (slot < stats->state_capacity) set_state(stats, index, slot, STATE_NONE);
+}
+
+// Take the task count from the store, which also has it for a folder that
+// is not loaded
+static void sync_tasks(TodoStats *stats, int index) {
+    int tasks = stats->store->folders[index].task_count;
+
+    stats->total.tasks += tasks - stats->folders[index].counts.tasks;
+    stats->folders[index].counts.tasks = tasks;
+}
+
+static void set_next(TodoStats *stats, int index, int32_t next) {
+    TodoFolderStats *counts = &stats->folders[index].counts;
+
+    if (next == counts->next_deadline) return;
+    if (next != DATE_NONE && (stats->total.next_deadline == DATE_NONE || next < stats->total.next_deadline)) {
+        stats->total.next_deadline = next;
+    } else if (counts->next_deadline == stats->total.next_deadline) {
+        stats->total_next_stale = 1;    // It may have been the earliest
+    }
+    counts->next_deadline = next;
+}
+
+static void update_next(TodoStats *stats, int index) {
+    set_next(stats, index, due_next_deadline(stats->store, &stats->store->folders[index]));
+}
+
+// Take a folder's state counts out of the total and clear them
+static void clear_states(TodoStats *stats, int index) {
+    TodoFolderStats *counts = &stats->folders[index].counts;
+
+    stats->total.open -= counts->open;
+    stats->total.completed -= counts->completed;
+    stats->total.overdue -= counts->overdue;
+    stats->total.due_today -= counts->due_today;
+    counts->open = counts->completed = counts->overdue = counts->due_today = 0;
+}
+
+// Count a folder that is not loaded from the deadline and completion
+// columns of its section, without loading it. A damaged section, or one
+// out of memory, leaves only the task count until the folder loads; then
+// this returns 0.
+static int count_section(TodoStats *stats, int index) {
+    const Folder *folder = &stats->store->folders[index];
+    FolderCounts *entry = &stats->folders[index];
+    TodoSectionDeadlines section;
+    int32_t next = DATE_NONE;
+    uint8_t *states;
+    int counted;
+
+    if (stats->store->backing == NULL || folder->source_index < 0) return 0;
+    if (!todofmt_section_deadlines(stats->store->backing, (uint32_t)folder->source_index, &section)) return 0;
+    states = (uint8_t *)malloc(section.count > 0 ? section.count : 1);
+    counted = states != NULL;
+    if (counted) {
+        due_classify(section.deadlines, section.completed, section.count, stats->today, states);
+        for (uint32_t i = 0; i < section.count; i++) {
+            add_state(&entry->counts, states[i], 1);
+            add_state(&stats->total, states[i], 1);
+            if (states[i] != DUE_DONE && section.deadlines[i] != DATE_NONE &&
+                (next == DATE_NONE || section.deadlines[i] < next)) {
+                next = section.deadlines[i];
+            }
+        }
+        if (!entry->counts.loaded) stats->unloaded--;
+        entry->counts.loaded = 1;
+        set_next(stats, index, next);
+        free(states);
+    }
+    todofmt_free_deadlines(&section);
+    return counted;
+}
+
+static void count_folder(TodoStats *stats, int index) {
+    const Folder *folder = &stats->store->folders[index];
+    FolderCounts *entry = &stats->folders[index];
+
+    if (entry->materialized) return;
+    // Counts read from the section make way for the tasks' own
+    clear_states(stats, index);
+    if (!entry->counts.loaded) stats->unloaded--;
+    entry->counts.loaded = 1;
+    entry->materialized = 1;
+    for (int i = 0; i < folder->task_count; i++) {
+        count_new_task(stats, index, store_task(stats->store, folder, i));
+    }
+    sync_tasks(stats, index);
+    update_next(stats, index);
+}
+
+// A folder the store has just added at index, counted from its section
+// if it is not loaded
+static void insert_folder(TodoStats *stats, int index) {
+    if (!grow((void **)&stats->folders, &stats->folder_capacity, (size_t)stats->folder_count + 1,
+              sizeof(FolderCounts))) {
+        stats->stale = 1;
+        return;
+    }
+    memmove(&stats->folders[index + 1], &stats->folders[index],
+            (size_t)(stats->folder_count - index) * sizeof(FolderCounts));
+    stats->folder_count++;
+    empty_counts(&stats->folders[index].counts);
+    stats->folders[index].materialized = 0;
+    stats->unloaded++;
+    sync_tasks(stats, index);
+    if (!stats->store->folders[index].loaded) count_section(stats, index);
+}
+
+// The folder's tasks are gone from the store without a notification each,
+// so their counts come off in one go. Their slots keep a stale state until
+// they are reused, and count_new_task() ignores it.
+static void remove_folder(TodoStats *stats, int index) {
+    TodoFolderStats *counts = &stats->folders[index].counts;
+
+    stats->total.tasks -= counts->tasks;
+    stats->total.open -= counts->open;
+    stats->total.completed -= counts->completed;
+    stats->total.overdue -= counts->overdue;
+    stats->total.due_today -= counts->due_today;
+    if (!counts->loaded) stats->unloaded--;
+    if (counts->next_deadline != DATE_NONE && counts->next_deadline == stats->total.next_deadline) {
+        stats->total_next_stale = 1;
+    }
+    memmove(&stats->folders[index], &stats->folders[index + 1],
+            (size_t)(stats->folder_count - index - 1) * sizeof(FolderCounts));
+    stats->folder_count--;
+}
+
+static void rebuild(TodoStats *stats) {
+    const TodoStore *store = stats->store;
+
+    stats->stale = 0;
+    stats->folder_count = 0;
+    stats->unloaded = 0;
+    stats->total_next_stale = 0;
+    empty_counts(&stats->total);
+    if (stats->states) memset(stats->states, STATE_NONE, stats->state_capacity);
+    for (int i = 0; i < store->folder_count && !stats->stale; i++) {
+        insert_folder(stats, i);
+        if (store->folders[i].loaded) count_folder(stats, i);
+    }
+}
+
+TodoStats *stats_create(TodoStore *store, int32_t today) {
+    TodoStats *stats = (TodoStats *)calloc(1, sizeof(TodoStats));
+
+    if (stats == NULL) return NULL;
+    stats->store = store;
+    stats->today = today;
+    if (!store_listen(store, stats_on_change, stats)) {
+        free(stats);
+        return NULL;
+    }
+    rebuild(stats);
+    return stats;
+}
+
+void stats_destroy(TodoStats *stats) {
+    if (stats == NULL) return;
+    store_unlisten(stats->store, stats_on_change, stats);
+    free(stats->folders);
+    free(stats->states);
+    free(stats);
+}
+
+void stats_on_change(void *context, const TodoStoreChange *change) {
+    TodoStats *stats = (TodoStats *)context;
+    const TodoStore *store = stats->store;
+
+    if (stats->stale || change->kind == STORE_RESET) {
+        rebuild(stats);
+        return;
+    }
+    switch (change->kind) {
+        case STORE_FOLDER_ADDED:
+            insert_folder(stats, change->folder);
+            if (!stats->stale && store->folders[change->folder].loaded) count_folder(stats, change->folder);
+            break;
+        case STORE_FOLDER_REMOVED:
+            remove_folder(stats, change->folder);
+            break;
+        case STORE_FOLDER_LOADED:
+            count_folder(stats, change->folder);
+            break;
+        case STORE_TASK_ADDED:
+            count_new_task(stats, change->folder, store_task(store, &store->folders[change->folder], change->position));
+            sync_tasks(stats, change->folder);
+            update_next(stats, change->folder);
+            break;
+        case STORE_TASK_MOVED:
+            count_task(stats, change->folder, store_task(store, &store->folders[change->folder], change->position));
+            sync_tasks(stats, change->folder);
+            update_next(stats, change->folder);
+            break;
+        case STORE_TASK_REMOVED:
+            uncount_slot(stats, change->folder, SLOTS_INDEX(change->task_id));
+            sync_tasks(stats, change->folder);
+            update_next(stats, change->folder);
+            break;
+    }
+}
+
+// Only incomplete tasks due between the two days change state, and in an
+// ordered folder those are one run of rows. Folders counted from their
+// section are counted from it again.
+int stats_set_today(TodoStats *stats, int32_t today) {
+    const TodoStore *store = stats->store;
+    int32_t old_today = stats->today;
+    int changed = 0;
+
+    if (today == old_today) return 0;
+    stats->today = today;
+    if (stats->stale) {
+        rebuild(stats);
+        return 1;
+    }
+    for (int i = 0; i < stats->folder_count; i++) {
+        const Folder *folder = &store->folders[i];
+        int first, last;
+
+        if (!stats->folders[i].materialized) {
+            TodoFolderStats before = stats->folders[i].counts;
+
+            if (!before.loaded) continue;
+            clear_states(stats, i);
+            if (!count_section(stats, i)) {
+                stats->folders[i].counts.loaded = 0;
+                stats->unloaded++;
+            }
+            changed |= before.overdue != stats->folders[i].counts.overdue ||
+                       before.due_today != stats->folders[i].counts.due_today;
+            continue;
+        }
+        if (!due_changed_rows(store, folder, old_today, today, &first, &last)) continue;
+        for (int row = first; row < last; row++) {
+            const Task *task = store_task(store, folder, row);
+            int state = due_state(task, today);
+
+            if (stats->states[SLOTS_INDEX(task->id)] == state) continue;
+            set_state(stats, i, SLOTS_INDEX(task->id), state);
+            changed = 1;
+        }
+    }
+    return changed;
+}
+
+const TodoFolderStats *stats_folder(const TodoStats *stats, int index) {
+    if (index < 0 || index >= stats->folder_count) return NULL;
+    return &stats->folders[index].counts;
+}
+
+const TodoFolderStats *stats_total(TodoStats *stats) {
+    if (stats->stale) rebuild(stats);
+    if (stats->total_next_stale) {
+        stats->total.next_deadline = DATE_NONE;
+        for (int i = 0; i < stats->folder_count; i++) {
+            int32_t next = stats->folders[i].counts.next_deadline;
+
+            if (next != DATE_NONE && (stats->total.next_deadline == DATE_NONE || next < stats->total.next_deadline)) {
+                stats->total.next_deadline = next;
+            }
+        }
+        stats->total_next_stale = 0;
+    }
+    stats->total.loaded = stats->unloaded == 0;
+    return &stats->total;
+}
@@ -0,0 +1,51 @@
+#ifndef TODO_STATS_H
+#define TODO_STATS_H
+
+#include <stdint.h>
+#include "todo_core.h"
+
+// Per-folder and overall task counts: open, completed, overdue, due today
+// and the earliest open deadline.
+//
+// The counts follow the store through its change notifications, one task
+// at a time, so reading them never looks at a task. Each task's due state
+// (todo_due.h) is remembered by slot, so a task that is completed, edited
+// or deleted comes out of the bucket it was counted in. The earliest open
+// deadline is read off the folder's order with a binary search after each
+// change to the folder. When the day changes only the rows
+// due_changed_rows() names are counted again.
+//
+// A folder that is not materialized yet is counted from the deadline and
+// completion columns of its section in the data file, without loading its
+// tasks, and counted again from there when the day changes. A damaged
+// section contributes only its task count until the folder loads.
+// Register the counts before anything that formats rows from them, since
+// listeners are called in the order they were added.
+
+typedef struct {
+    int tasks;
+    int open;               // Including the overdue and due today
+    int completed;
+    int overdue;
+    int due_today;
+    int32_t next_deadline;  // Earliest deadline of an open task, DATE_NONE if none
+    int loaded;             // The counts above cover every task (overall: every folder's do)
+} TodoFolderStats;
+
+typedef struct TodoStats TodoStats;
+
+// Count everything the store holds now, as of today, and follow it
+TodoStats *stats_create(TodoStore *store, int32_t today);
+void stats_destroy(TodoStats *stats);
+
+// TodoStoreListener; registered by stats_create
+void stats_on_change(void *stats, const TodoStoreChange *change);
+
+// Move to another day. Returns 1 if any count changed.
+int stats_set_today(TodoStats *stats, int32_t today);
+
+// NULL for an index out of range
+const TodoFolderStats *stats_folder(const TodoStats *stats, int index);
+const TodoFolderStats *stats_total(TodoStats *stats);
+
+#endif
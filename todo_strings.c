@@ -0,0 +1,243 @@
+#include "todo_strings.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define STRPOOL_COMPACT_MIN (64 * 1024)     // Dead bytes tolerated regardless of ratio
+
+// FNV-1a
+static uint32_t hash_bytes(const char *text, size_t length) {
+    uint32_t hash = 2166136261u;
+
+    for (size_t i = 0; i < length; i++) {
+        hash ^= (unsigned char)text[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+void strpool_init(TodoStringPool *pool) {
+    memset(pool, 0, sizeof(*pool));
+}
+
+void strpool_free(TodoStringPool *pool) {
+    free(pool->bytes);
+    free(pool->slots);
+    strpool_init(pool);
+}
+
+// Resize the table to fit the live strings plus room for more, dropping
+// deleted slots
+static int rehash(TodoStringPool *pool, size_t room) {
+    size_t live = 0;
+    size_t count = 16;
+    TodoStringSlot *slots;
+
+    for (uint32_t i = 0; i < pool->slot_count; i++) {
+        if (pool->slots[i].refs) live++;
+    }
+    while (count < (live + room + 1) * 2) count *= 2;
+    if (count > UINT32_MAX / 4) return 0;
+
+    slots = (TodoStringSlot *)calloc(count, sizeof(TodoStringSlot));
+    if (slots == NULL) return 0;
+    for (uint32_t i = 0; i < pool->slot_count; i++) {
+        const TodoStringSlot *slot = &pool->slots[i];
+        uint32_t j;
+
+        if (slot->refs == 0) continue;
+        for (j = slot->hash & (count - 1); slots[j].length; j = (j + 1) & (count - 1)) {
+        }
+        slots[j] = *slot;
+    }
+    free(pool->slots);
+    pool->slots = slots;
+    pool->slot_count = (uint32_t)count;
+    pool->used_slots = (uint32_t)live;
+    return 1;
+}
+
+static int reserve_bytes(TodoStringPool *pool, size_t needed) {
+    size_t capacity = pool->capacity ? pool->capacity : 4096;
+    char *grown;
+
+    if (needed > UINT32_MAX) return 0;
+    if (needed <= pool->capacity) return 1;
+    while (capacity < needed) capacity *= 2;
+    if (capacity > UINT32_MAX) capacity = UINT32_MAX;
+    grown = (char *)realloc(pool->bytes, capacity);
+    if (grown == NULL) return 0;
+    pool->bytes = grown;
+    pool->capacity = (uint32_t)capacity;
+    return 1;
+}
+
+int strpool_reserve(TodoStringPool *pool, size_t bytes, size_t count) {
+    if (!reserve_bytes(pool, (size_t)pool->size + bytes)) return 0;
+    if ((pool->used_slots + count + 1) * 4 > (size_t)pool->slot_count * 3) {
+        return rehash(pool, count);
+    }
+    return 1;
+}
+
+// Copy a string to the end of the arena, NUL-terminated
+static int append(TodoStringPool *pool, const char *text, size_t length, uint32_t *offset) {
+    size_t needed = (size_t)pool->size + length + 1;
+
+    if (needed > pool->capacity) {
+        size_t inside = (size_t)-1;
+
+        // The source may be a string of this pool, which is about to move
+        if (pool->bytes && text >= pool->bytes && text < pool->bytes + pool->size) {
+            inside = (size_t)(text - pool->bytes);
+        }
+        if (!reserve_bytes(pool, needed)) return 0;
+        if (inside != (size_t)-1) text = pool->bytes + inside;
+    }
+
+    memmove(pool->bytes + pool->size, text, length);
+    pool->bytes[pool->size + length] = '\0';
+    *offset = pool->size;
+    pool->size = (uint32_t)needed;
+    return 1;
+}
+
+int strpool_intern(TodoStringPool *pool, const char *text, size_t length, TodoString *out) {
+    TodoStringSlot *slot = NULL;
+    uint32_t hash;
+    uint32_t offset;
+
+    length = utf8_fit(text, length, STRPOOL_MAX_LENGTH);
+    out->offset = 0;
+    out->length = 0;
+    if (length == 0) return 1;
+
+    hash = hash_bytes(text, length);
+    if (pool->slot_count) {
+        uint32_t mask = pool->slot_count - 1;
+
+        for (uint32_t i = hash & mask; pool->slots[i].length; i = (i + 1) & mask) {
+            TodoStringSlot *candidate = &pool->slots[i];
+
+            if (candidate->hash == hash && candidate->length == length &&
+                memcmp(pool->bytes + candidate->offset, text, length) == 0) {
+                // A released copy is still in the arena until compaction
+                if (candidate->refs++ == 0) pool->live += (uint32_t)length + 1;
+                *out = (TodoString){ candidate->offset, candidate->length };
+                return 1;
+            }
+        }
+    }
+
+    if ((pool->used_slots + 1) * 4 > (size_t)pool->slot_count * 3 && !rehash(pool, 1)) return 0;
+    if (!append(pool, text, length, &offset)) return 0;
+
+    for (uint32_t i = hash & (pool->slot_count - 1); ; i = (i + 1) & (pool->slot_count - 1)) {
+        if (pool->slots[i].length == 0) {
+            slot = &pool->slots[i];
+            break;
+        }
+    }
+    slot->offset = offset;
+    slot->length = (uint32_t)length;
+    slot->hash = hash;
+    slot->refs = 1;
+    pool->used_slots++;
+    pool->live += (uint32_t)length + 1;
+    *out = (TodoString){ offset, (uint32_t)length };
+    return 1;
+}
+
+void strpool_release(TodoStringPool *pool, TodoString string) {
+    uint32_t mask;
+
+    if (string.length == 0 || pool->slot_count == 0) return;
+    mask = pool->slot_count - 1;
+    for (uint32_t i = hash_bytes(pool->bytes + string.offset, string.length) & mask;
+         pool->slots[i].length; i = (i + 1) & mask) {
+        TodoStringSlot *slot = &pool->slots[i];
+
+        if (slot->offset == string.offset && slot->length == string.length && slot->refs) {
+            if (--slot->refs == 0) pool->live -= string.length + 1;
+            return;
+        }
+    }
+}
+
+int strpool_find(const TodoStringPool *pool, const char *text, size_t length, TodoString *out) {
+    uint32_t hash;
+    uint32_t mask;
+
+    length = utf8_fit(text, length, STRPOOL_MAX_LENGTH);
+    out->offset = 0;
+    out->length = 0;
+    if (length == 0) return 1;
+    if (pool->slot_count == 0) return 0;
+
+    hash = hash_bytes(text, length);
+    mask = pool->slot_count - 1;
+    for (uint32_t i = hash & mask; pool->slots[i].length; i = (i + 1) & mask) {
+        const TodoStringSlot *slot = &pool->slots[i];
+
+        if (slot->refs && slot->hash == hash && slot->length == length &&
+            memcmp(pool->bytes + slot->offset, text, length) == 0) {
+            *out = (TodoString){ slot->offset, slot->length };
+            return 1;
+        }
+    }
+    return 0;
+}
+
+const char *strpool_text(const TodoStringPool *pool, TodoString string) {
+    return string.length ? pool->bytes + string.offset : "";
+}
+
+// Released strings take more of the arena than live ones
+int strpool_wasteful(const TodoStringPool *pool) {
+    uint32_t dead = pool->size - pool->live;
+    return dead >= STRPOOL_COMPACT_MIN && dead > pool->live;
+}
+
+// Longest prefix of at most max bytes that does not end inside a character
+size_t utf8_fit(const char *text, size_t length, size_t max) {
+    if (length <= max) return length;
+    while (max > 0 && ((unsigned char)text[max] & 0xC0) == 0x80) max--;
+    return max;
+}
+
+// Well-formed UTF-8: no overlong forms, surrogates or values past U+10FFFF
+int utf8_valid(const char *text, size_t length) {
+    const unsigned char *bytes = (const unsigned char *)text;
+    size_t i = 0;
+
+    while (i < length) {
+        unsigned char c = bytes[i];
+        size_t extra;
+        uint32_t low = 0x80, high = 0xBF;
+
+        if (c < 0x80) {
+            i++;
+            continue;
+        }
+        if (c >= 0xC2 && c <= 0xDF) {
+            extra = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            extra = 2;
+            if (c == 0xE0) low = 0xA0;
+            if (c == 0xED) high = 0x9F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            extra = 3;
+            if (c == 0xF0) low = 0x90;
+            if (c == 0xF4) high = 0x8F;
+        } else {
+            return 0;
+        }
+        if (length - i <= extra) return 0;
+        if (bytes[i + 1] < low || bytes[i + 1] > high) return 0;
+        for (size_t j = 2; j <= extra; j++) {
+            if ((bytes[i + j] & 0xC0) != 0x80) return 0;
+        }
+        i += extra + 1;
+    }
+    return 1;
+}
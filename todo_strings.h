@@ -0,0 +1,66 @@
+#ifndef TODO_STRINGS_H
+#define TODO_STRINGS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Interned UTF-8 string pool.
+//
+// Every list name and task description lives once in a growing arena and
+// records refer to it by an 8-byte offset+length handle. Equal strings
+// share one copy with a reference count. Released strings leave dead bytes
+// behind; the owner rebuilds the pool from its live handles once they
+// outweigh the live ones (see strpool_wasteful). Strings are stored
+// NUL-terminated, so strpool_text() can be used as a C string.
+//
+// Pointers returned by strpool_text() move when the arena grows, so they
+// are only valid until the next intern.
+
+// Longest string kept, in bytes; limited by the journal's 16-bit lengths
+#define STRPOOL_MAX_LENGTH 65535
+
+typedef struct {
+    uint32_t offset;
+    uint32_t length;    // 0 is the empty string, which uses no space
+} TodoString;
+
+typedef struct {
+    uint32_t offset;
+    uint32_t length;
+    uint32_t hash;
+    uint32_t refs;      // 0 with a length is a deleted slot
+} TodoStringSlot;
+
+typedef struct {
+    char *bytes;
+    uint32_t size;
+    uint32_t capacity;
+    uint32_t live;              // Arena bytes held by referenced strings
+    TodoStringSlot *slots;      // Open addressing, power-of-two size
+    uint32_t slot_count;
+    uint32_t used_slots;        // Including deleted ones
+} TodoStringPool;
+
+void strpool_init(TodoStringPool *pool);
+void strpool_free(TodoStringPool *pool);
+
+// Make room for count strings taking bytes in all (terminators included),
+// after which interning that much cannot fail
+int strpool_reserve(TodoStringPool *pool, size_t bytes, size_t count);
+
+// Add a reference to the string, copying it in if it is new. text may
+// point into the pool itself. Returns 0 when out of memory.
+int strpool_intern(TodoStringPool *pool, const char *text, size_t length, TodoString *out);
+void strpool_release(TodoStringPool *pool, TodoString string);
+
+// Handle of a string already in the pool, without adding a reference
+int strpool_find(const TodoStringPool *pool, const char *text, size_t length, TodoString *out);
+
+const char *strpool_text(const TodoStringPool *pool, TodoString string);
+int strpool_wasteful(const TodoStringPool *pool);
+
+// UTF-8 helpers
+size_t utf8_fit(const char *text, size_t length, size_t max);
+int utf8_valid(const char *text, size_t length);
+
+#endif
@@ -0,0 +1,859 @@
+#include "todo_tags.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define FILTER_MAX_DEPTH 32     // Nested parentheses and negations
+
+enum {
+    OP_TAG = 1,
+    OP_DONE,
+    OP_OPEN,
+    OP_NOT,
+    OP_AND,
+    OP_OR,
+    OP_ANDNOT           // a AND NOT b, from "a -b"
+};
+
+typedef struct {
+    uint8_t op;
+    uint16_t name_offset;   // OP_TAG: canonical name in the filter's names
+    uint16_t name_length;
+} FilterOp;
+
+struct TodoTagFilter {
+    FilterOp *ops;          // Postfix
+    int count;
+    int capacity;
+    char *names;
+    size_t names_size;
+};
+
+// A tag in use, named in the index's pool
+typedef struct {
+    TodoString name;
+    TodoBitmap tasks;
+} TagEntry;
+
+typedef struct {
+    uint32_t folder_id;
+    TodoBitmap tasks;
+} TagFolder;
+
+// What the index recorded about a task, so it can be taken out again after
+// the store has already changed it
+typedef struct {
+    TodoString tags;        // In the index's pool
+    uint32_t folder_id;
+    uint8_t indexed;
+    uint8_t completed;
+} TagSlot;
+
+struct TodoTagIndex {
+    TodoStore *store;
+    TodoStringPool strings;     // Tag names and the tags of each task
+    TagEntry *entries;          // Sorted by name
+    uint32_t entry_count;
+    uint32_t entry_capacity;
+    TagFolder *folders;         // Sorted by folder id
+    uint32_t folder_count;
+    uint32_t folder_capacity;
+    TagSlot *slots;             // By task slot index
+    uint32_t slot_capacity;
+    TodoBitmap all;
+    TodoBitmap done;
+};
+
+static const TodoBitmap empty_bitmap = {NULL, 0, 0};
+
+// ---------------------------------------------------------------------------
+// Syntax
+
+static unsigned char fold(unsigned char c) {
+    return (c >= 'A' && c <= 'Z') ? (unsigned char)(c - 'A' + 'a') : c;
+}
+
+static int is_name_byte(unsigned char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') ||
+           c == '-' || c == '_' || c >= 0x80;
+}
+
+// Lowercase name bytes forming valid UTF-8
+static int name_valid(const unsigned char *name, size_t length) {
+    size_t i = 0;
+
+    if (length == 0) return 0;
+    while (i < length) {
+        unsigned char c = name[i];
+        size_t follow;
+        unsigned char low = 0x80, high = 0xBF;
+
+        if (c < 0x80) {
+            if (!is_name_byte(c) || (c >= 'A' && c <= 'Z')) return 0;
+            i++;
+            continue;
+        }
+        if (c >= 0xC2 && c <= 0xDF) {
+            follow = 1;
+        } else if (c >= 0xE0 && c <= 0xEF) {
+            follow = 2;
+            if (c == 0xE0) low = 0xA0;
+            if (c == 0xED) high = 0x9F;
+        } else if (c >= 0xF0 && c <= 0xF4) {
+            follow = 3;
+            if (c == 0xF0) low = 0x90;
+            if (c == 0xF4) high = 0x8F;
+        } else {
+            return 0;
+        }
+        if (length - i <= follow) return 0;
+        if (name[i + 1] < low || name[i + 1] > high) return 0;
+        for (size_t k = 2; k <= follow; k++) {
+            if (name[i + k] < 0x80 || name[i + k] > 0xBF) return 0;
+        }
+        i += follow + 1;
+    }
+    return 1;
+}
+
+// Byte order, a name before any longer name it starts
+static int compare_names(const char *a, size_t a_length, const char *b, size_t b_length) {
+    int order = memcmp(a, b, a_length < b_length ? a_length : b_length);
+
+    if (order != 0) return order;
+    return (a_length > b_length) - (a_length < b_length);
+}
+
+// Length of the name starting at tags[at], up to the next space
+static size_t name_at(const char *tags, size_t length, size_t at) {
+    size_t end = at;
+
+    while (end < length && tags[end] != ' ') end++;
+    return end - at;
+}
+
+int tags_normalize(const char *text, char out[TAGS_TEXT_LENGTH]) {
+    size_t size = 0;
+    const char *cursor = text;
+
+    out[0] = '\0';
+    for (;;) {
+        char name[TAGS_TEXT_LENGTH];
+        size_t length = 0;
+        size_t at = 0;
+        int order = 1;
+
+        while (*cursor == ' ' || *cursor == '\t' || *cursor == ',') cursor++;
+        if (*cursor == '\0') break;
+        if (*cursor == '#' || *cursor == '@') cursor++;
+        while (*cursor != '\0' && *cursor != ' ' && *cursor != '\t' && *cursor != ',') {
+            if (length == sizeof(name)) return 0;
+            name[length++] = (char)fold((unsigned char)*cursor++);
+        }
+        if (length == 0) continue;      // A lone '#'
+        if (!name_valid((const unsigned char *)name, length)) return 0;
+
+        // Insert in order unless already there
+        while (at < size) {
+            size_t existing = name_at(out, size, at);
+
+            order = compare_names(name, length, out + at, existing);
+            if (order <= 0) break;
+            at += existing + 1;
+        }
+        if (at < size && order == 0) continue;
+        if (size + length + (size ? 1 : 0) >= TAGS_TEXT_LENGTH) return 0;
+        if (at < size) {
+            memmove(out + at + length + 1, out + at, size - at);
+            out[at + length] = ' ';
+            size += length + 1;
+        } else {
+            if (size > 0) out[size++] = ' ';
+            at = size;
+            size += length;
+        }
+        memcpy(out + at, name, length);
+        out[size] = '\0';
+    }
+    return 1;
+}
+
+int tags_valid(const char *tags, size_t length) {
+    size_t at = 0;
+    size_t previous = 0;
+    size_t previous_length = 0;
+
+    if (length >= TAGS_TEXT_LENGTH) return 0;
+    while (at < length) {
+        size_t name_length = name_at(tags, length, at);
+
+        if (!name_valid((const unsigned char *)tags + at, name_length)) return 0;
+        if (at > 0 && compare_names(tags + previous, previous_length, tags + at, name_length) >= 0) return 0;
+        previous = at;
+        previous_length = name_length;
+        at += name_length;
+        if (at < length) {
+            at++;       // The space
+            if (at == length) return 0;
+        }
+    }
+    return 1;
+}
+
+int tags_contains(const char *tags, size_t length, const char *name, size_t name_length) {
+    size_t at = 0;
+
+    while (at < length) {
+        size_t existing = name_at(tags, length, at);
+
+        if (existing == name_length && memcmp(tags + at, name, name_length) == 0) return 1;
+        at += existing + 1;
+    }
+    return 0;
+}
+
+// ---------------------------------------------------------------------------
+// Index
+
+static int grow(void **items, uint32_t *capacity, size_t needed, size_t size) {
+    size_t new_capacity = *capacity ? *capacity : 16;
+    void *grown;
+
+    if (needed <= *capacity) return 1;
+    while (new_capacity < needed) new_capacity *= 2;
+    if (new_capacity > UINT32_MAX) return 0;
+    grown = realloc(*items, new_capacity * size);
+    if (grown == NULL) return 0;
+    *items = grown;
+    *capacity = (uint32_t)new_capacity;
+    return 1;
+}
+
+// Position of the entry for a name, or where it would go
+static uint32_t find_entry(const TodoTagIndex *index, const char *name, size_t length, int *found) {
+    uint32_t low = 0, high = index->entry_count;
+
+    *found = 0;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+        const TagEntry *entry = &index->entries[mid];
+        int order = compare_names(strpool_text(&index->strings, entry->name), entry->name.length, name, length);
+
+        if (order == 0) {
+            *found = 1;
+            return mid;
+        }
+        if (order < 0) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static uint32_t find_folder(const TodoTagIndex *index, uint32_t folder_id, int *found) {
+    uint32_t low = 0, high = index->folder_count;
+
+    *found = 0;
+    while (low < high) {
+        uint32_t mid = low + (high - low) / 2;
+
+        if (index->folders[mid].folder_id == folder_id) {
+            *found = 1;
+            return mid;
+        }
+        if (index->folders[mid].folder_id < folder_id) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+    return low;
+}
+
+static TodoBitmap *folder_tasks(TodoTagIndex *index, uint32_t folder_id, int create) {
+    int found;
+    uint32_t at = find_folder(index, folder_id, &found);
+
+    if (found) return &index->folders[at].tasks;
+    if (!create || !grow((void **)&index->folders, &index->folder_capacity, (size_t)index->folder_count + 1,
+                         sizeof(TagFolder))) {
+        return NULL;
+    }
+    memmove(&index->folders[at + 1], &index->folders[at], (index->folder_count - at) * sizeof(TagFolder));
+    index->folders[at].folder_id = folder_id;
+    bitmap_init(&index->folders[at].tasks);
+    index->folder_count++;
+    return &index->folders[at].tasks;
+}
+
+static void drop_folder(TodoTagIndex *index, uint32_t folder_id) {
+    int found;
+    uint32_t at = find_folder(index, folder_id, &found);
+
+    if (!found) return;
+    bitmap_free(&index->folders[at].tasks);
+    memmove(&index->folders[at], &index->folders[at + 1], (index->folder_count - at - 1) * sizeof(TagFolder));
+    index->folder_count--;
+}
+
+static void tag_slot(TodoTagIndex *index, const char *name, size_t length, uint32_t slot) {
+    int found;
+    uint32_t at = find_entry(index, name, length, &found);
+    TagEntry *entry;
+
+    if (!found) {
+        TodoString text;
+
+        if (!grow((void **)&index->entries, &index->entry_capacity, (size_t)index->entry_count + 1,
+                  sizeof(TagEntry)) ||
+            !strpool_intern(&index->strings, name, length, &text)) {
+            return;
+        }
+        memmove(&index->entries[at + 1], &index->entries[at], (index->entry_count - at) * sizeof(TagEntry));
+        index->entries[at].name = text;
+        bitmap_init(&index->entries[at].tasks);
+        index->entry_count++;
+    }
+    entry = &index->entries[at];
+    bitmap_add(&entry->tasks, slot);
+}
+
+static void untag_slot(TodoTagIndex *index, const char *name, size_t length, uint32_t slot) {
+    int found;
+    uint32_t at = find_entry(index, name, length, &found);
+    TagEntry *entry;
+
+    if (!found) return;
+    entry = &index->entries[at];
+    bitmap_remove(&entry->tasks, slot);
+    if (entry->tasks.count > 0) return;
+    strpool_release(&index->strings, entry->name);
+    bitmap_free(&entry->tasks);
+    memmove(&index->entries[at], &index->entries[at + 1], (index->entry_count - at - 1) * sizeof(TagEntry));
+    index->entry_count--;
+}
+
+static void index_task(TodoTagIndex *index, uint32_t folder_id, const Task *task) {
+    uint32_t slot = SLOTS_INDEX(task->id);
+    uint32_t old = index->slot_capacity;
+    TagSlot *entry;
+    TodoBitmap *folder = folder_tasks(index, folder_id, 1);
+    size_t at = 0;
+
+    if (folder == NULL || !grow((void **)&index->slots, &index->slot_capacity, (size_t)slot + 1, sizeof(TagSlot))) {
+        return;
+    }
+    memset(index->slots + old, 0, (index->slot_capacity - old) * sizeof(TagSlot));
+    entry = &index->slots[slot];
+    entry->folder_id = folder_id;
+    entry->completed = (uint8_t)(task->completed != 0);
+    entry->indexed = 1;
+    bitmap_add(&index->all, slot);
+    bitmap_add(folder, slot);
+    if (task->completed) bitmap_add(&index->done, slot);
+
+    if (!strpool_intern(&index->strings, store_text(index->store, task->tags), task->tags.length, &entry->tags)) {
+        entry->tags.offset = 0;
+        entry->tags.length = 0;
+    }
+    while (at < entry->tags.length) {
+        // The pool may move while a tag name is interned
+        char name[TAGS_TEXT_LENGTH];
+        size_t length = name_at(strpool_text(&index->strings, entry->tags), entry->tags.length, at);
+
+        memcpy(name, strpool_text(&index->strings, entry->tags) + at, length);
+        tag_slot(index, name, length, slot);
+        entry = &index->slots[slot];
+        at += length + 1;
+    }
+}
+
+static void unindex_slot(TodoTagIndex *index, uint32_t slot) {
+    TagSlot *entry;
+    TodoBitmap *folder;
+    size_t at = 0;
+
+    if (slot >= index->slot_capacity || !index->slots[slot].indexed) return;
+    entry = &index->slots[slot];
+    folder = folder_tasks(index, entry->folder_id, 0);
+    bitmap_remove(&index->all, slot);
+    bitmap_remove(&index->done, slot);
+    if (folder != NULL) bitmap_remove(folder, slot);
+    while (at < entry->tags.length) {
+        const char *tags = strpool_text(&index->strings, entry->tags);
+        size_t length = name_at(tags, entry->tags.length, at);
+
+        untag_slot(index, tags + at, length, slot);
+        at += length + 1;
+    }
+    strpool_release(&index->strings, entry->tags);
+    memset(entry, 0, sizeof(*entry));
+}
+
+static void index_folder_tasks(TodoTagIndex *index, const Folder *folder) {
+    for (int i = 0; i < folder->task_count; i++) {
+        index_task(index, folder->id, store_task(index->store, folder, i));
+    }
+}
+
+static void clear_index(TodoTagIndex *index) {
+    for (uint32_t i = 0; i < index->entry_count; i++) {
+        bitmap_free(&index->entries[i].tasks);
+    }
+    for (uint32_t i = 0; i < index->folder_count; i++) {
+        bitmap_free(&index->folders[i].tasks);
+    }
+    index->entry_count = 0;
+    index->folder_count = 0;
+    if (index->slots) memset(index->slots, 0, index->slot_capacity * sizeof(TagSlot));
+    bitmap_free(&index->all);
+    bitmap_free(&index->done);
+    strpool_free(&index->strings);
+}
+
+static void rebuild_index(TodoTagIndex *index) {
+    clear_index(index);
+    for (int i = 0; i < index->store->folder_count; i++) {
+        if (index->store->folders[i].loaded) {
+            index_folder_tasks(index, &index->store->folders[i]);
+        }
+    }
+}
+
+// Rebuilding is the index's way of compacting its string pool
+static void maybe_compact(TodoTagIndex *index) {
+    if (strpool_wasteful(&index->strings)) {
+        rebuild_index(index);
+    }
+}
+
+TodoTagIndex *tags_create(TodoStore *store) {
+    TodoTagIndex *index = (TodoTagIndex *)calloc(1, sizeof(TodoTagIndex));
+
+    if (index == NULL) return NULL;
+    index->store = store;
+    strpool_init(&index->strings);
+    if (!store_listen(store, tags_on_change, index)) {
+        free(index);
+        return NULL;
+    }
+    rebuild_index(index);
+    return index;
+}
+
+void tags_destroy(TodoTagIndex *index) {
+    if (index == NULL) return;
+    store_unlisten(index->store, tags_on_change, index);
+    clear_index(index);
+    free(index->entries);
+    free(index->folders);
+    free(index->slots);
+    free(index);
+}
+
+void tags_on_change(void *context, const TodoStoreChange *change) {
+    TodoTagIndex *index = (TodoTagIndex *)context;
+    const TodoStore *store = index->store;
+    const TodoBitmap *folder;
+    uint32_t *slots;
+    size_t count;
+
+    switch (change->kind) {
+        case STORE_RESET:
+            rebuild_index(index);
+            break;
+        case STORE_FOLDER_LOADED:
+            index_folder_tasks(index, &store->folders[change->folder]);
+            break;
+        case STORE_FOLDER_REMOVED:
+            folder = folder_tasks(index, change->folder_id, 0);
+            if (folder == NULL) break;
+            count = (size_t)bitmap_count(folder);
+            slots = (uint32_t *)malloc((count ? count : 1) * sizeof(uint32_t));
+            if (slots == NULL) {
+                rebuild_index(index);
+                break;
+            }
+            count = bitmap_values(folder, slots, count);
+            for (size_t i = 0; i < count; i++) {
+                unindex_slot(index, slots[i]);
+            }
+            free(slots);
+            drop_folder(index, change->folder_id);
+            maybe_compact(index);
+            break;
+        case STORE_TASK_ADDED:
+            index_task(index, change->folder_id, store_task(store, &store->folders[change->folder], change->position));
+            break;
+        case STORE_TASK_MOVED:
+            // Completed or retagged: take out what was recorded, put back what is there now
+            unindex_slot(index, SLOTS_INDEX(change->task_id));
+            index_task(index, change->folder_id, store_task(store, &store->folders[change->folder], change->position));
+            maybe_compact(index);
+            break;
+        case STORE_TASK_REMOVED:
+            unindex_slot(index, SLOTS_INDEX(change->task_id));
+            maybe_compact(index);
+            break;
+    }
+}
+
+const TodoBitmap *tags_tasks(const TodoTagIndex *index, const char *name) {
+    int found;
+    uint32_t at = find_entry(index, name, strlen(name), &found);
+
+    return found ? &index->entries[at].tasks : NULL;
+}
+
+size_t tags_count(const TodoTagIndex *index) {
+    return index->entry_count;
+}
+
+// ---------------------------------------------------------------------------
+// Filters
+
+typedef struct {
+    const char *cursor;
+    TodoTagFilter *filter;
+    int depth;
+    int error;
+} Parser;
+
+static void skip_spaces(Parser *parser) {
+    while (*parser->cursor == ' ' || *parser->cursor == '\t' || *parser->cursor == ',') parser->cursor++;
+}
+
+// Length of the word at the cursor
+static size_t word_length(const char *text) {
+    size_t length = 0;
+
+    while (text[length] != '\0' && is_name_byte((unsigned char)text[length])) length++;
+    return length;
+}
+
+static int is_keyword(const char *text, size_t length, const char *keyword) {
+    if (strlen(keyword) != length) return 0;
+    for (size_t i = 0; i < length; i++) {
+        if (fold((unsigned char)text[i]) != (unsigned char)keyword[i]) return 0;
+    }
+    return 1;
+}
+
+static void emit(Parser *parser, int op, const char *name, size_t length) {
+    TodoTagFilter *filter = parser->filter;
+    FilterOp *slot;
+
+    if (parser->error) return;
+    // "x NOT AND" is "x ANDNOT", which never builds the complement
+    if (op == OP_AND && filter->count > 0 && filter->ops[filter->count - 1].op == OP_NOT) {
+        filter->ops[filter->count - 1].op = OP_ANDNOT;
+        return;
+    }
+    if (filter->count == filter->capacity) {
+        int capacity = filter->capacity ? filter->capacity * 2 : 16;
+        FilterOp *ops = (FilterOp *)realloc(filter->ops, (size_t)capacity * sizeof(FilterOp));
+
+        if (ops == NULL) {
+            parser->error = TAGS_ERR_MEMORY;
+            return;
+        }
+        filter->ops = ops;
+        filter->capacity = capacity;
+    }
+    slot = &filter->ops[filter->count++];
+    slot->op = (uint8_t)op;
+    slot->name_offset = 0;
+    slot->name_length = 0;
+    if (op == OP_TAG) {
+        // Names are folded copies of parts of the text, which fits in names
+        slot->name_offset = (uint16_t)filter->names_size;
+        slot->name_length = (uint16_t)length;
+        for (size_t i = 0; i < length; i++) {
+            filter->names[filter->names_size++] = (char)fold((unsigned char)name[i]);
+        }
+    }
+}
+
+static void parse_or(Parser *parser);
+
+// Can a term or negation start here?
+static int starts_operand(Parser *parser) {
+    const char *text = parser->cursor;
+    size_t length;
+
+    if (*text == '#' || *text == '@' || *text == '(' || *text == '-' || *text == '!') return 1;
+    length = word_length(text);
+    return length > 0 && !is_keyword(text, length, "or") && !is_keyword(text, length, "and");
+}
+
+static void parse_unary(Parser *parser) {
+    const char *text;
+    size_t length;
+
+    skip_spaces(parser);
+    text = parser->cursor;
+    length = word_length(text);
+    if (parser->error) return;
+    if (++parser->depth > FILTER_MAX_DEPTH) {
+        parser->error = TAGS_ERR_SYNTAX;
+        return;
+    }
+
+    if (*text == '-' || *text == '!' || is_keyword(text, length, "not")) {
+        parser->cursor += (*text == '-' || *text == '!') ? 1 : 3;
+        parse_unary(parser);
+        emit(parser, OP_NOT, NULL, 0);
+    } else if (*text == '(') {
+        parser->cursor++;
+        parse_or(parser);
+        skip_spaces(parser);
+        if (*parser->cursor != ')') {
+            parser->error = TAGS_ERR_SYNTAX;
+        } else {
+            parser->cursor++;
+        }
+    } else if (*text == '#' || *text == '@') {
+        length = word_length(text + 1);
+        if (length == 0 || length >= TAGS_TEXT_LENGTH) {
+            parser->error = TAGS_ERR_SYNTAX;
+        } else {
+            parser->cursor += 1 + length;
+            emit(parser, OP_TAG, text + 1, length);
+        }
+    } else if (is_keyword(text, length, "done")) {
+        parser->cursor += length;
+        emit(parser, OP_DONE, NULL, 0);
+    } else if (is_keyword(text, length, "open")) {
+        parser->cursor += length;
+        emit(parser, OP_OPEN, NULL, 0);
+    } else {
+        parser->error = TAGS_ERR_SYNTAX;
+    }
+    parser->depth--;
+}
+
+static void parse_and(Parser *parser) {
+    parse_unary(parser);
+    for (;;) {
+        size_t length;
+
+        skip_spaces(parser);
+        if (parser->error) return;
+        length = word_length(parser->cursor);
+        if (*parser->cursor == '&') {
+            parser->cursor++;
+        } else if (is_keyword(parser->cursor, length, "and")) {
+            parser->cursor += length;
+        } else if (!starts_operand(parser)) {
+            return;
+        }
+        parse_unary(parser);
+        emit(parser, OP_AND, NULL, 0);
+    }
+}
+
+static void parse_or(Parser *parser) {
+    parse_and(parser);
+    for (;;) {
+        size_t length;
+
+        skip_spaces(parser);
+        if (parser->error) return;
+        length = word_length(parser->cursor);
+        if (*parser->cursor == '|') {
+            parser->cursor++;
+        } else if (is_keyword(parser->cursor, length, "or")) {
+            parser->cursor += length;
+        } else {
+            return;
+        }
+        parse_and(parser);
+        emit(parser, OP_OR, NULL, 0);
+    }
+}
+
+int tags_is_filter(const char *text) {
+    while (*text == ' ' || *text == '\t' || *text == '(' || *text == '-' || *text == '!') text++;
+    return *text == '#' || *text == '@';
+}
+
+int tags_parse(const char *text, TodoTagFilter **out) {
+    Parser parser;
+    TodoTagFilter *filter = (TodoTagFilter *)calloc(1, sizeof(TodoTagFilter));
+    size_t length = strlen(text);
+
+    *out = NULL;
+    if (filter == NULL) return TAGS_ERR_MEMORY;
+    if (length > UINT16_MAX) {
+        free(filter);
+        return TAGS_ERR_SYNTAX;
+    }
+    filter->names = (char *)malloc(length + 1);
+    if (filter->names == NULL) {
+        free(filter);
+        return TAGS_ERR_MEMORY;
+    }
+
+    parser.cursor = text;
+    parser.filter = filter;
+    parser.depth = 0;
+    parser.error = TAGS_OK;
+    parse_or(&parser);
+    skip_spaces(&parser);
+    if (parser.error == TAGS_OK && *parser.cursor != '\0') parser.error = TAGS_ERR_SYNTAX;
+    if (parser.error != TAGS_OK) {
+        tags_free_filter(filter);
+        return parser.error;
+    }
+    *out = filter;
+    return TAGS_OK;
+}
+
+void tags_free_filter(TodoTagFilter *filter) {
+    if (filter == NULL) return;
+    free(filter->ops);
+    free(filter->names);
+    free(filter);
+}
+
+// An evaluation stack entry: one of the index's bitmaps or one computed here
+typedef struct {
+    const TodoBitmap *bitmap;
+    TodoBitmap owned;
+} Operand;
+
+static void set_owned(Operand *operand, TodoBitmap *result) {
+    bitmap_free(&operand->owned);
+    operand->owned = *result;
+    operand->bitmap = &operand->owned;
+}
+
+// Push one of the index's bitmaps, cut down to the folder's tasks when
+// filtering one folder, so that every step after costs what the folder
+// holds rather than what the store does
+static int push_leaf(Operand *stack, int *top, const TodoBitmap *bitmap, const TodoBitmap *universe, int scoped) {
+    TodoBitmap result;
+
+    if (!scoped) {
+        stack[(*top)++].bitmap = bitmap;
+        return 1;
+    }
+    bitmap_init(&result);
+    if (!bitmap_and(&result, universe, bitmap)) return 0;
+    set_owned(&stack[(*top)++], &result);
+    return 1;
+}
+
+int tags_filter(const TodoTagIndex *index, const TodoTagFilter *filter, uint32_t folder_id, TodoBitmap *out) {
+    const TodoBitmap *universe = &index->all;
+    Operand *stack;
+    int top = 0;
+    int ok = 1;
+
+    bitmap_free(out);
+    if (folder_id != 0) {
+        int found;
+        uint32_t at = find_folder(index, folder_id, &found);
+
+        universe = found ? &index->folders[at].tasks : &empty_bitmap;
+    }
+    if (filter->count == 0) return 1;
+    stack = (Operand *)calloc((size_t)filter->count, sizeof(Operand));
+    if (stack == NULL) return 0;
+
+    for (int i = 0; ok && i < filter->count; i++) {
+        const FilterOp *op = &filter->ops[i];
+        TodoBitmap result;
+
+        bitmap_init(&result);
+        switch (op->op) {
+            case OP_TAG: {
+                char name[TAGS_TEXT_LENGTH];
+                const TodoBitmap *tasks;
+
+                memcpy(name, filter->names + op->name_offset, op->name_length);
+                name[op->name_length] = '\0';
+                tasks = tags_tasks(index, name);
+                ok = push_leaf(stack, &top, tasks ? tasks : &empty_bitmap, universe, folder_id != 0);
+                break;
+            }
+            case OP_DONE:
+                ok = push_leaf(stack, &top, &index->done, universe, folder_id != 0);
+                break;
+            case OP_OPEN:
+                ok = bitmap_andnot(&result, universe, &index->done);
+                set_owned(&stack[top++], &result);
+                break;
+            case OP_NOT:
+                ok = bitmap_andnot(&result, universe, stack[top - 1].bitmap);
+                set_owned(&stack[top - 1], &result);
+                break;
+            case OP_AND:
+            case OP_OR:
+            case OP_ANDNOT:
+                if (op->op == OP_AND) {
+                    ok = bitmap_and(&result, stack[top - 2].bitmap, stack[top - 1].bitmap);
+                } else if (op->op == OP_OR) {
+                    ok = bitmap_or(&result, stack[top - 2].bitmap, stack[top - 1].bitmap);
+                } else {
+                    ok = bitmap_andnot(&result, stack[top - 2].bitmap, stack[top - 1].bitmap);
+                }
+                bitmap_free(&stack[--top].owned);
+                set_owned(&stack[top - 1], &result);
+                break;
+        }
+    }
+    if (ok) ok = bitmap_and(out, stack[0].bitmap, universe);
+    for (int i = 0; i < filter->count; i++) {
+        bitmap_free(&stack[i].owned);
+    }
+    free(stack);
+    return ok;
+}
+
+int tags_filter_matches(const TodoTagFilter *filter, const char *tags, size_t length, int completed) {
+    unsigned char *stack;
+    int top = 0;
+    int matches;
+
+    if (filter->count == 0) return 1;
+    stack = (unsigned char *)malloc((size_t)filter->count);
+    if (stack == NULL) return 0;
+
+    for (int i = 0; i < filter->count; i++) {
+        const FilterOp *op = &filter->ops[i];
+
+        switch (op->op) {
+            case OP_TAG:
+                stack[top++] = (unsigned char)tags_contains(tags, length, filter->names + op->name_offset,
+                                                            op->name_length);
+                break;
+            case OP_DONE:
+                stack[top++] = completed != 0;
+                break;
+            case OP_OPEN:
+                stack[top++] = completed == 0;
+                break;
+            case OP_NOT:
+                stack[top - 1] = !stack[top - 1];
+                break;
+            case OP_AND:
+                top--;
+                stack[top - 1] = stack[top - 1] && stack[top];
+                break;
+            case OP_OR:
+                top--;
+                stack[top - 1] = stack[top - 1] || stack[top];
+                break;
+            case OP_ANDNOT:
+                top--;
+                stack[top - 1] = stack[top - 1] && !stack[top];
+                break;
+        }
+    }
+    matches = stack[0];
+    free(stack);
+    return matches;
+}
@@ -0,0 +1,77 @@
+#ifndef TODO_TAGS_H
+#define TODO_TAGS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "todo_bitmap.h"
+#include "todo_core.h"
+
+// Task tags and tag filters.
+//
+// A task's tags are kept as one canonical string: lowercase names in
+// ascending byte order, each once, separated by single spaces. Names are
+// ASCII letters and digits, '-', '_' and any other UTF-8 character, so
+// equal tag sets are equal strings and share one copy in the string pool.
+//
+// The tag index keeps a compressed bitmap (todo_bitmap.h) of the tasks
+// carrying each tag, one of the tasks of each folder, one of the completed
+// tasks and one of every task, all over the slot indexes of the task
+// handles. A filter such as "#work -#waiting (#urgent or @today) open"
+// combines those bitmaps container by container instead of looking at any
+// task. The index follows the store through its change notifications;
+// tasks are indexed when their folder is materialized.
+//
+// Filter syntax: terms are #name or @name (the same tag) and the keywords
+// done and open. Terms next to each other must all match; "or" (or '|')
+// binds more loosely and "not" (or '-', '!') more tightly; "and" and '&'
+// may be written out, and parentheses group. Keywords are case-insensitive.
+
+#define TAGS_TEXT_LENGTH 256        // Canonical tags of one task, with the terminator
+
+enum {
+    TAGS_OK = 0,
+    TAGS_ERR_SYNTAX,
+    TAGS_ERR_MEMORY
+};
+
+// Canonical form of tags typed by a user: names separated by spaces, tabs
+// or commas, each with an optional leading '#' or '@'. Returns 0 when a
+// name has a character tags cannot hold or the result does not fit.
+int tags_normalize(const char *text, char out[TAGS_TEXT_LENGTH]);
+// Is this already in canonical form? The empty string is.
+int tags_valid(const char *tags, size_t length);
+int tags_contains(const char *tags, size_t length, const char *name, size_t name_length);
+
+typedef struct TodoTagIndex TodoTagIndex;
+typedef struct TodoTagFilter TodoTagFilter;
+
+// Index everything the store holds now and follow it from then on
+TodoTagIndex *tags_create(TodoStore *store);
+void tags_destroy(TodoTagIndex *index);
+
+// TodoStoreListener; registered by tags_create
+void tags_on_change(void *index, const TodoStoreChange *change);
+
+// Tasks carrying a canonical tag name, NULL when none does
+const TodoBitmap *tags_tasks(const TodoTagIndex *index, const char *name);
+// Distinct tags in use
+size_t tags_count(const TodoTagIndex *index);
+
+// Does the search text look like a filter rather than words to find?
+int tags_is_filter(const char *text);
+int tags_parse(const char *text, TodoTagFilter **out);
+void tags_free_filter(TodoTagFilter *filter);
+
+// Slot indexes (SLOTS_INDEX) of the tasks matching a filter, limited to one
+// folder or, with folder_id 0, to every materialized folder. For one
+// folder each tag is first cut down to that folder's tasks, so the cost
+// follows the folder's size rather than the store's. Returns 0, with out
+// empty, when out of memory.
+int tags_filter(const TodoTagIndex *index, const TodoTagFilter *filter, uint32_t folder_id, TodoBitmap *out);
+
+// Does one task, given its canonical tags and whether it is completed,
+// match the filter? Needs no index, so a changed task can be checked alone.
+// Returns 0 when out of memory.
+int tags_filter_matches(const TodoTagFilter *filter, const char *tags, size_t length, int completed);
+
+#endif
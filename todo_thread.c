@@ -0,0 +1,159 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "todo_thread.h"
+
+#include <time.h>
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+static DWORD WINAPI thread_entry(LPVOID param) {
+    TodoThread *thread = (TodoThread *)param;
+    thread->func(thread->arg);
+    return 0;
+}
+#else
+static void *thread_entry(void *param) {
+    TodoThread *thread = (TodoThread *)param;
+    thread->func(thread->arg);
+    return NULL;
+}
+#endif
+
+// The TodoThread must stay at the same address until it is joined
+int todo_thread_start(TodoThread *thread, TodoThreadFunc func, void *arg) {
+    thread->func = func;
+    thread->arg = arg;
+#ifdef _WIN32
+    thread->handle = CreateThread(NULL, 0, thread_entry, thread, 0, NULL);
+    return thread->handle != NULL;
+#else
+    return pthread_create(&thread->handle, NULL, thread_entry, thread) == 0;
+#endif
+}
+
+void todo_thread_join(TodoThread *thread) {
+#ifdef _WIN32
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+#else
+    pthread_join(thread->handle, NULL);
+#endif
+}
+
+void todo_mutex_init(TodoMutex *mutex) {
+#ifdef _WIN32
+    InitializeCriticalSection(&mutex->cs);
+#else
+    pthread_mutex_init(&mutex->mutex, NULL);
+#endif
+}
+
+void todo_mutex_destroy(TodoMutex *mutex) {
+#ifdef _WIN32
+    DeleteCriticalSection(&mutex->cs);
+#else
+    pthread_mutex_destroy(&mutex->mutex);
+#endif
+}
+
+void todo_mutex_lock(TodoMutex *mutex) {
+#ifdef _WIN32
+    EnterCriticalSection(&mutex->cs);
+#else
+    pthread_mutex_lock(&mutex->mutex);
+#endif
+}
+
+void todo_mutex_unlock(TodoMutex *mutex) {
+#ifdef _WIN32
+    LeaveCriticalSection(&mutex->cs);
+#else
+    pthread_mutex_unlock(&mutex->mutex);
+#endif
+}
+
+void todo_cond_init(TodoCond *cond) {
+#ifdef _WIN32
+    InitializeConditionVariable(&cond->cv);
+#else
+    pthread_cond_init(&cond->cond, NULL);
+#endif
+}
+
+void todo_cond_destroy(TodoCond *cond) {
+#ifdef _WIN32
+    (void)cond;
+#else
+    pthread_cond_destroy(&cond->cond);
+#endif
+}
+
+// Wait for a signal or until timeout_ms passes; wakeups may be spurious
+void todo_cond_wait(TodoCond *cond, TodoMutex *mutex, uint64_t timeout_ms) {
+#ifdef _WIN32
+    DWORD wait = timeout_ms >= INFINITE ? INFINITE : (DWORD)timeout_ms;
+    SleepConditionVariableCS(&cond->cv, &mutex->cs, wait);
+#else
+    struct timespec until;
+
+    if (timeout_ms == TODO_WAIT_FOREVER) {
+        pthread_cond_wait(&cond->cond, &mutex->mutex);
+        return;
+    }
+    if (timeout_ms > 24ull * 3600 * 1000) timeout_ms = 24ull * 3600 * 1000;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec += (time_t)(timeout_ms / 1000);
+    until.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+    if (until.tv_nsec >= 1000000000L) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+    pthread_cond_timedwait(&cond->cond, &mutex->mutex, &until);
+#endif
+}
+
+void todo_cond_signal(TodoCond *cond) {
+#ifdef _WIN32
+    WakeConditionVariable(&cond->cv);
+#else
+    pthread_cond_signal(&cond->cond);
+#endif
+}
+
+void todo_cond_broadcast(TodoCond *cond) {
+#ifdef _WIN32
+    WakeAllConditionVariable(&cond->cv);
+#else
+    pthread_cond_broadcast(&cond->cond);
+#endif
+}
+
+uint64_t todo_clock_ms(void *context) {
+#ifdef _WIN32
+    (void)context;
+    return GetTickCount64();
+#else
+    struct timespec now;
+
+    (void)context;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000 + (uint64_t)now.tv_nsec / 1000000;
+#endif
+}
+
+int todo_cpu_count(void) {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (int)info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+
+    return count > 0 ? (int)count : 1;
+#endif
+}
@@ -0,0 +1,69 @@
+#ifndef TODO_THREAD_H
+#define TODO_THREAD_H
+
+// Minimal thread and lock wrappers so background work in the core builds
+// against both Win32 and pthreads.
+
+#include <stdint.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+typedef void (*TodoThreadFunc)(void *arg);
+
+typedef struct {
+#ifdef _WIN32
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    TodoThreadFunc func;
+    void *arg;
+} TodoThread;
+
+typedef struct {
+#ifdef _WIN32
+    CRITICAL_SECTION cs;
+#else
+    pthread_mutex_t mutex;
+#endif
+} TodoMutex;
+
+typedef struct {
+#ifdef _WIN32
+    CONDITION_VARIABLE cv;
+#else
+    pthread_cond_t cond;
+#endif
+} TodoCond;
+
+#define TODO_WAIT_FOREVER UINT64_MAX
+
+// Milliseconds from some fixed point; workers take one of these so tests
+// can substitute a fake clock
+typedef uint64_t (*TodoClock)(void *context);
+
+int todo_thread_start(TodoThread *thread, TodoThreadFunc func, void *arg);
+void todo_thread_join(TodoThread *thread);
+
+void todo_mutex_init(TodoMutex *mutex);
+void todo_mutex_destroy(TodoMutex *mutex);
+void todo_mutex_lock(TodoMutex *mutex);
+void todo_mutex_unlock(TodoMutex *mutex);
+
+void todo_cond_init(TodoCond *cond);
+void todo_cond_destroy(TodoCond *cond);
+void todo_cond_wait(TodoCond *cond, TodoMutex *mutex, uint64_t timeout_ms);
+void todo_cond_signal(TodoCond *cond);
+void todo_cond_broadcast(TodoCond *cond);
+
+// Monotonic wall time; the context is unused
+uint64_t todo_clock_ms(void *context);
+
+// Processors available to this process, at least 1
+int todo_cpu_count(void);
+
+#endif
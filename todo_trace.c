@@ -0,0 +1,300 @@
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include "todo_trace.h"
+#include "todo_thread.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define SUB_BITS 4
+#define SUB_COUNT (1 << SUB_BITS)
+#define BUCKET_COUNT ((64 - SUB_BITS + 1) * SUB_COUNT)
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t buckets[BUCKET_COUNT];
+} TraceHistogram;
+
+typedef struct {
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint64_t value;
+    uint32_t op;
+} TraceEvent;
+
+// Which Chrome trace row an operation is drawn on
+enum {
+    LANE_UI = 1,
+    LANE_WRITER,
+    LANE_WORKER
+};
+
+static const struct {
+    const char *name;
+    int lane;
+} ops[TRACE_OP_COUNT] = {
+    { "create_list", LANE_UI },
+    { "delete_list", LANE_UI },
+    { "add_task", LANE_UI },
+    { "complete_task", LANE_UI },
+    { "delete_task", LANE_UI },
+    { "tag_task", LANE_UI },
+    { "move_tasks", LANE_UI },
+    { "clear_done", LANE_UI },
+    { "undo", LANE_UI },
+    { "redo", LANE_UI },
+    { "switch_folder", LANE_UI },
+    { "save_query", LANE_UI },
+    { "filter", LANE_UI },
+    { "sort", LANE_UI },
+    { "refresh_folders", LANE_UI },
+    { "refresh_tasks", LANE_UI },
+    { "save_data", LANE_UI },
+    { "load_data", LANE_UI },
+    { "journal_write", LANE_WRITER },
+    { "compact", LANE_WORKER },
+};
+
+int trace_flags;
+
+static TodoMutex lock;
+static int lock_ready;
+static TraceHistogram histograms[TRACE_OP_COUNT];
+static TraceEvent *ring;
+static size_t ring_capacity;
+static uint64_t ring_written;   // Events ever recorded; the ring keeps the last ones
+static uint64_t epoch_ns;       // Chrome timestamps are relative to this
+
+uint64_t trace_now_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (frequency.QuadPart == 0) QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)(counter.QuadPart / frequency.QuadPart) * 1000000000u +
+           (uint64_t)(counter.QuadPart % frequency.QuadPart) * 1000000000u / (uint64_t)frequency.QuadPart;
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+
+static int highest_bit(uint64_t value) {
+#if defined(__GNUC__)
+    return 63 - __builtin_clzll(value);
+#else
+    int bit = 0;
+    while (value >>= 1) bit++;
+    return bit;
+#endif
+}
+
+// Values below SUB_COUNT get a bucket each; above that, every power of two
+// is split into SUB_COUNT equal buckets
+static int bucket_of(uint64_t value) {
+    int shift;
+
+    if (value < SUB_COUNT) return (int)value;
+    shift = highest_bit(value) - SUB_BITS;
+    return (shift + 1) * SUB_COUNT + (int)((value >> shift) - SUB_COUNT);
+}
+
+// Largest value that falls in a bucket
+static uint64_t bucket_high(int bucket) {
+    int shift;
+
+    if (bucket < SUB_COUNT) return (uint64_t)bucket;
+    shift = bucket / SUB_COUNT - 1;
+    return (((uint64_t)(SUB_COUNT + bucket % SUB_COUNT) + 1) << shift) - 1;
+}
+
+static void clear_locked(void) {
+    memset(histograms, 0, sizeof(histograms));
+    ring_written = 0;
+    epoch_ns = trace_now_ns();
+}
+
+int trace_enable(int flags, size_t events) {
+    int ok = 1;
+
+    if (!lock_ready) {
+        todo_mutex_init(&lock);
+        lock_ready = 1;
+    }
+    trace_disable();
+
+    todo_mutex_lock(&lock);
+    if ((flags & TRACE_EVENTS) && events > 0) {
+        ring = (TraceEvent *)malloc(events * sizeof(TraceEvent));
+        if (ring != NULL) {
+            ring_capacity = events;
+        } else {
+            ok = 0;
+        }
+    }
+    clear_locked();
+    todo_mutex_unlock(&lock);
+
+    trace_flags = flags;
+    return ok;
+}
+
+void trace_disable(void) {
+    trace_flags = 0;
+    if (!lock_ready) return;
+    todo_mutex_lock(&lock);
+    free(ring);
+    ring = NULL;
+    ring_capacity = 0;
+    todo_mutex_unlock(&lock);
+}
+
+void trace_reset(void) {
+    if (!lock_ready) return;
+    todo_mutex_lock(&lock);
+    clear_locked();
+    todo_mutex_unlock(&lock);
+}
+
+void trace_end(int op, uint64_t started, uint64_t value) {
+    uint64_t duration;
+    TraceHistogram *histogram;
+
+    if (started == 0 || op < 0 || op >= TRACE_OP_COUNT) return;
+    duration = trace_now_ns() - started;
+    histogram = &histograms[op];
+
+    todo_mutex_lock(&lock);
+    if (histogram->count == 0 || duration < histogram->min_ns) histogram->min_ns = duration;
+    if (duration > histogram->max_ns) histogram->max_ns = duration;
+    histogram->count++;
+    histogram->total_ns += duration;
+    histogram->buckets[bucket_of(duration)]++;
+    if (ring != NULL) {
+        TraceEvent *event = &ring[ring_written % ring_capacity];
+        event->start_ns = started;
+        event->duration_ns = duration;
+        event->value = value;
+        event->op = (uint32_t)op;
+        ring_written++;
+    }
+    todo_mutex_unlock(&lock);
+}
+
+const char *trace_name(int op) {
+    return op >= 0 && op < TRACE_OP_COUNT ? ops[op].name : "unknown";
+}
+
+// Smallest bucket bound covering the fraction of calls; callers hold the lock
+static uint64_t percentile_locked(const TraceHistogram *histogram, double fraction) {
+    uint64_t wanted, seen = 0;
+
+    if (histogram->count == 0) return 0;
+    wanted = (uint64_t)(fraction * (double)histogram->count + 0.999999);
+    if (wanted < 1) wanted = 1;
+    if (wanted > histogram->count) wanted = histogram->count;
+    for (int i = 0; i < BUCKET_COUNT; i++) {
+        seen += histogram->buckets[i];
+        if (seen >= wanted) {
+            uint64_t high = bucket_high(i);
+            return high < histogram->max_ns ? high : histogram->max_ns;
+        }
+    }
+    return histogram->max_ns;
+}
+
+uint64_t trace_percentile(int op, double fraction) {
+    uint64_t value;
+
+    if (op < 0 || op >= TRACE_OP_COUNT || !lock_ready) return 0;
+    todo_mutex_lock(&lock);
+    value = percentile_locked(&histograms[op], fraction);
+    todo_mutex_unlock(&lock);
+    return value;
+}
+
+void trace_stats(int op, TraceStats *stats) {
+    const TraceHistogram *histogram;
+
+    memset(stats, 0, sizeof(*stats));
+    if (op < 0 || op >= TRACE_OP_COUNT || !lock_ready) return;
+    histogram = &histograms[op];
+    todo_mutex_lock(&lock);
+    stats->count = histogram->count;
+    stats->total_ns = histogram->total_ns;
+    stats->min_ns = histogram->min_ns;
+    stats->max_ns = histogram->max_ns;
+    stats->p50_ns = percentile_locked(histogram, 0.50);
+    stats->p90_ns = percentile_locked(histogram, 0.90);
+    stats->p99_ns = percentile_locked(histogram, 0.99);
+    stats->p999_ns = percentile_locked(histogram, 0.999);
+    todo_mutex_unlock(&lock);
+}
+
+static double to_us(uint64_t ns) {
+    return (double)ns / 1000.0;
+}
+
+int trace_write_chrome(const char *path) {
+    static const char *lane_names[] = { "", "UI", "Journal writer", "Compaction" };
+    FILE *out = fopen(path, "w");
+    uint64_t first;
+    int comma = 0;
+
+    if (out == NULL) return 0;
+    if (!lock_ready) {
+        todo_mutex_init(&lock);
+        lock_ready = 1;
+    }
+
+    todo_mutex_lock(&lock);
+    fprintf(out, "{\"displayTimeUnit\": \"ms\",\n\"traceEvents\": [\n");
+    for (int lane = LANE_UI; lane <= LANE_WORKER; lane++) {
+        fprintf(out, "%s{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": %d, "
+                "\"args\": {\"name\": \"%s\"}}", comma ? ",\n" : "", lane, lane_names[lane]);
+        comma = 1;
+    }
+
+    // Oldest surviving event first
+    first = ring_written > ring_capacity ? ring_written - ring_capacity : 0;
+    for (uint64_t i = first; ring != NULL && i < ring_written; i++) {
+        const TraceEvent *event = &ring[i % ring_capacity];
+        double start = event->start_ns >= epoch_ns ? to_us(event->start_ns - epoch_ns) : 0.0;
+
+        fprintf(out, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+                "\"ts\": %.3f, \"dur\": %.3f, \"args\": {\"value\": %llu}}",
+                ops[event->op].name, ops[event->op].lane, start, to_us(event->duration_ns),
+                (unsigned long long)event->value);
+    }
+
+    fprintf(out, "\n],\n\"droppedEvents\": %llu,\n\"latency\": {",
+            (unsigned long long)(first));
+    comma = 0;
+    for (int op = 0; op < TRACE_OP_COUNT; op++) {
+        const TraceHistogram *histogram = &histograms[op];
+
+        if (histogram->count == 0) continue;
+        fprintf(out, "%s\n  \"%s\": {\"count\": %llu, \"mean_us\": %.3f, \"min_us\": %.3f, "
+                "\"p50_us\": %.3f, \"p90_us\": %.3f, \"p99_us\": %.3f, \"p999_us\": %.3f, \"max_us\": %.3f}",
+                comma ? "," : "", ops[op].name, (unsigned long long)histogram->count,
+                to_us(histogram->total_ns) / (double)histogram->count, to_us(histogram->min_ns),
+                to_us(percentile_locked(histogram, 0.50)), to_us(percentile_locked(histogram, 0.90)),
+                to_us(percentile_locked(histogram, 0.99)), to_us(percentile_locked(histogram, 0.999)),
+                to_us(histogram->max_ns));
+        comma = 1;
+    }
+    fprintf(out, "\n}}\n");
+    todo_mutex_unlock(&lock);
+
+    return fclose(out) == 0;
+}
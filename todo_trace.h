@@ -0,0 +1,97 @@
+#ifndef TODO_TRACE_H
+#define TODO_TRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Latency tracing.
+//
+// Each traced operation feeds a log-linear histogram (16 sub-buckets per
+// power of two, so any percentile is within about 6% of the true value)
+// plus a count, total and extremes. Optionally every call is also kept in a
+// fixed ring of recent events, which trace_write_chrome() dumps as Chrome
+// trace-event JSON (chrome://tracing, Perfetto) with the histogram
+// summaries alongside.
+//
+// Tracing is off until trace_enable(). While off, TRACE_BEGIN() is one load
+// and a branch and trace_end() returns at once. Safe to call from any
+// thread; enable and disable it while no other thread is tracing.
+
+enum {
+    // UI thread
+    TRACE_CREATE_LIST,
+    TRACE_DELETE_LIST,
+    TRACE_ADD_TASK,
+    TRACE_COMPLETE_TASK,
+    TRACE_DELETE_TASK,
+    TRACE_TAG_TASK,
+    TRACE_MOVE_TASKS,
+    TRACE_CLEAR_DONE,
+    TRACE_UNDO,
+    TRACE_REDO,
+    TRACE_SWITCH_FOLDER,
+    TRACE_SAVE_QUERY,
+    TRACE_FILTER,
+    TRACE_SORT,
+    TRACE_REFRESH_FOLDERS,
+    TRACE_REFRESH_TASKS,
+    TRACE_SAVE,
+    TRACE_LOAD,
+    // Journal writer thread
+    TRACE_JOURNAL_WRITE,
+    // Compaction worker
+    TRACE_COMPACT,
+    TRACE_OP_COUNT
+};
+
+enum {
+    TRACE_HISTOGRAMS = 1,
+    TRACE_EVENTS = 2
+};
+
+#define TRACE_DEFAULT_EVENTS 65536
+
+typedef struct {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t min_ns;
+    uint64_t max_ns;
+    uint64_t p50_ns;
+    uint64_t p90_ns;
+    uint64_t p99_ns;
+    uint64_t p999_ns;
+} TraceStats;
+
+extern int trace_flags;
+
+// Start time for trace_end(), or 0 while tracing is off
+#define TRACE_BEGIN() (trace_flags ? trace_now_ns() : 0)
+
+// Time one statement
+#define TRACE_CALL(op, call) do { \
+        uint64_t trace_started_ = TRACE_BEGIN(); \
+        call; \
+        trace_end((op), trace_started_, 0); \
+    } while (0)
+
+// flags is a mix of TRACE_HISTOGRAMS and TRACE_EVENTS; events is the ring
+// size. Clears earlier data. Returns 0 if the ring could not be allocated,
+// in which case only histograms are kept.
+int trace_enable(int flags, size_t events);
+void trace_disable(void);
+void trace_reset(void);
+
+uint64_t trace_now_ns(void);
+
+// Account one operation that started at started; value is an optional
+// size (bytes written, rows shown) kept with the event
+void trace_end(int op, uint64_t started, uint64_t value);
+
+const char *trace_name(int op);
+void trace_stats(int op, TraceStats *stats);
+uint64_t trace_percentile(int op, double fraction);
+
+// Write the recorded events and histogram summaries. Returns 0 on I/O error.
+int trace_write_chrome(const char *path);
+
+#endif
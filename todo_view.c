@@ -0,0 +1,325 @@
+#include "todo_view.h"
+#include "todo_due.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Tag text for each DUE_* state
+static const char *const due_tags[] = { "", "", " [DUE TODAY]", " [OVERDUE]" };
+// Mark for each PRIORITY_* level, before the description
+static const char *const priority_marks[] = { "", "! ", "!! ", "!!! " };
+
+// Room on a row for the tags, which stop at the last name that fits, and
+// for the text itself, cut on a character boundary
+#define VIEW_TAGS_ROOM 96
+#define VIEW_TEXT_ROOM (VIEW_TEXT_LENGTH - 64 - RECUR_TEXT_LENGTH - VIEW_TAGS_ROOM)
+
+// " #a #b" for canonical tags "a b"
+static void format_tags(const char *tags, char out[VIEW_TAGS_ROOM]) {
+    size_t at = 0;
+
+    while (*tags != '\0') {
+        size_t length = strcspn(tags, " ");
+
+        if (at + length + 3 > VIEW_TAGS_ROOM) break;
+        out[at++] = ' ';
+        out[at++] = '#';
+        memcpy(out + at, tags, length);
+        at += length;
+        tags += length;
+        if (*tags == ' ') tags++;
+    }
+    out[at] = '\0';
+}
+
+void view_format_task(const TodoStore *store, const Task *task, int due_state, char *text) {
+    char deadline[DATE_TEXT_LENGTH];
+    char repeat[RECUR_TEXT_LENGTH + 2] = "";
+    char tags[VIEW_TAGS_ROOM];
+    char status = task->completed ? 'X' : ' ';
+    const char *description = store_text(store, task->description);
+    const TodoRecurrence *rule = store_task_rule(store, task);
+
+    date_format(task->deadline_day, deadline);
+    format_tags(store_text(store, task->tags), tags);
+    if (rule != NULL) {
+        repeat[0] = ',';
+        repeat[1] = ' ';
+        recur_format(rule, task->deadline_day, repeat + 2);
+    }
+    snprintf(text, VIEW_TEXT_LENGTH, "[%c] %s%.*s%s (Due: %s%s)%s", status, priority_marks[task->priority & 3],
+             (int)utf8_fit(description, task->description.length, VIEW_TEXT_ROOM), description, tags,
+             deadline, repeat, due_tags[due_state]);
+}
+
+// "Work (12 tasks, 25% done, 2 overdue, 1 due today)", leaving out the
+// parts that are zero
+void view_format_folder(const TodoStore *store, const Folder *folder, const TodoFolderStats *stats, char *text) {
+    const char *name = store_text(store, folder->name);
+    char counts[64] = "";
+    int at = 0;
+
+    if (stats != NULL && stats->loaded) {
+        if (stats->completed > 0) {
+            at += snprintf(counts + at, sizeof(counts) - at, ", %d%% done",
+                           (int)((int64_t)stats->completed * 100 / stats->tasks));
+        }
+        if (stats->overdue > 0) at += snprintf(counts + at, sizeof(counts) - at, ", %d overdue", stats->overdue);
+        if (stats->due_today > 0) snprintf(counts + at, sizeof(counts) - at, ", %d due today", stats->due_today);
+    }
+    snprintf(text, VIEW_TEXT_LENGTH, "%.*s (%d tasks%s)",
+             (int)utf8_fit(name, folder->name.length, VIEW_TEXT_ROOM), name, folder->task_count, counts);
+}
+
+void view_init(TodoView *view, TodoViewFormat format, TodoViewMeasure measure, void *context) {
+    memset(view, 0, sizeof(*view));
+    strpool_init(&view->strings);
+    view->format = format;
+    view->measure = measure;
+    view->context = context;
+}
+
+void view_free(TodoView *view) {
+    free(view->rows);
+    free(view->ops);
+    strpool_free(&view->strings);
+    view_init(view, view->format, view->measure, view->context);
+}
+
+static int grow(void **items, int *capacity, int needed, size_t size) {
+    int new_capacity = *capacity ? *capacity : 64;
+    void *grown;
+
+    if (needed <= *capacity) return 1;
+    while (new_capacity < needed) new_capacity *= 2;
+    grown = realloc(*items, (size_t)new_capacity * size);
+    if (grown == NULL) return 0;
+    *items = grown;
+    *capacity = new_capacity;
+    return 1;
+}
+
+// Running maximum of the formatted rows' widths
+static void width_added(TodoView *view, int width) {
+    if (width > view->max_width) {
+        view->max_width = width;
+        view->max_rows = 1;
+    } else if (width == view->max_width) {
+        view->max_rows++;
+    }
+}
+
+static void width_removed(TodoView *view, int width) {
+    if (width == VIEW_UNFORMATTED || width != view->max_width || --view->max_rows > 0) return;
+
+    // The widest row went away: rescan the cached widths, nothing is re-measured
+    view->max_width = 0;
+    view->max_rows = 0;
+    for (int i = 0; i < view->count; i++) {
+        width_added(view, view->rows[i].width);
+    }
+}
+
+// Rebuild the pool from the rows' text once released rows take up most of it
+static void compact_strings(TodoView *view) {
+    TodoStringPool compacted;
+
+    if (!strpool_wasteful(&view->strings)) return;
+    strpool_init(&compacted);
+    if (!strpool_reserve(&compacted, view->strings.live, view->strings.slot_count)) return;
+    for (int i = 0; i < view->count; i++) {
+        TodoViewRow *row = &view->rows[i];
+
+        if (row->width == VIEW_UNFORMATTED) continue;
+        strpool_intern(&compacted, strpool_text(&view->strings, row->text), row->text.length, &row->text);
+    }
+    strpool_free(&view->strings);
+    view->strings = compacted;
+}
+
+static void forget_row(TodoView *view, TodoViewRow *row) {
+    int width = row->width;
+
+    if (width == VIEW_UNFORMATTED) return;
+    strpool_release(&view->strings, row->text);
+    row->width = VIEW_UNFORMATTED;  // Left out of a rescan for the widest row
+    width_removed(view, width);
+}
+
+// Format a row into the pool. Out of memory, the row is left unformatted
+// and 0 returned.
+static int format_row(TodoView *view, int row, TodoViewRow *out) {
+    char text[VIEW_TEXT_LENGTH];
+    int width;
+
+    view->format(view->context, row, text);
+    width = view->measure ? view->measure(view->context, text) : (int)strlen(text);
+    if (!strpool_intern(&view->strings, text, strlen(text), &out->text)) return 0;
+    out->width = width < 0 ? 0 : width;
+    width_added(view, out->width);
+    return 1;
+}
+
+static int queue_op(TodoView *view, int op, int row) {
+    TodoViewOp *entry;
+
+    // A rebuilt view is applied in full, so it needs no ops until then
+    if (view->rebuilt) return 1;
+    if (!grow((void **)&view->ops, &view->op_capacity, view->op_count + 1, sizeof(TodoViewOp))) {
+        view->stale = 1;
+        return 0;
+    }
+    entry = &view->ops[view->op_count++];
+    entry->op = op;
+    entry->row = row;
+    return 1;
+}
+
+int view_rebuild(TodoView *view, int count) {
+    view->count = 0;
+    view->op_count = 0;
+    view->max_width = 0;
+    view->max_rows = 0;
+    view->rebuilt = 1;
+    view->stale = 1;
+    strpool_free(&view->strings);
+    strpool_init(&view->strings);
+    if (!grow((void **)&view->rows, &view->capacity, count, sizeof(TodoViewRow))) return 0;
+
+    for (int i = 0; i < count; i++) {
+        view->rows[i].width = VIEW_UNFORMATTED;
+    }
+    view->count = count;
+    view->stale = 0;
+    return 1;
+}
+
+const char *view_row_text(TodoView *view, int row) {
+    if (row < 0 || row >= view->count) return "";
+    if (view->rows[row].width == VIEW_UNFORMATTED && !format_row(view, row, &view->rows[row])) return "";
+    return strpool_text(&view->strings, view->rows[row].text);
+}
+
+void view_mark_stale(TodoView *view) {
+    view->stale = 1;
+    view->op_count = 0;
+}
+
+int view_insert(TodoView *view, int row) {
+    if (view->stale || row < 0 || row > view->count) return 0;
+    if (!grow((void **)&view->rows, &view->capacity, view->count + 1, sizeof(TodoViewRow))) {
+        view->stale = 1;
+        return 0;
+    }
+
+    memmove(&view->rows[row + 1], &view->rows[row], (size_t)(view->count - row) * sizeof(TodoViewRow));
+    view->count++;
+    view->rows[row].width = VIEW_UNFORMATTED;
+    return queue_op(view, VIEW_OP_INSERT, row);
+}
+
+int view_remove(TodoView *view, int row) {
+    TodoViewRow removed;
+
+    if (view->stale || row < 0 || row >= view->count) return 0;
+
+    removed = view->rows[row];
+    memmove(&view->rows[row], &view->rows[row + 1], (size_t)(view->count - row - 1) * sizeof(TodoViewRow));
+    view->count--;
+    forget_row(view, &removed);
+    compact_strings(view);
+    return queue_op(view, VIEW_OP_REMOVE, row);
+}
+
+int view_update(TodoView *view, int row) {
+    TodoViewRow fresh;
+    TodoViewRow *cached;
+
+    if (view->stale || row < 0 || row >= view->count) return 0;
+    cached = &view->rows[row];
+    if (cached->width == VIEW_UNFORMATTED) return 1;    // Formatted fresh when it is shown
+
+    if (!format_row(view, row, &fresh)) {
+        forget_row(view, cached);
+    } else if (fresh.text.offset == cached->text.offset && fresh.text.length == cached->text.length) {
+        // Nothing visible changed
+        strpool_release(&view->strings, fresh.text);
+        width_removed(view, fresh.width);
+        return 1;
+    } else {
+        TodoViewRow old = *cached;
+
+        *cached = fresh;
+        forget_row(view, &old);
+        compact_strings(view);
+    }
+    return queue_op(view, VIEW_OP_UPDATE, row);
+}
+
+// The cached rows in between shift by one slot; the moved row is
+// formatted again when it is next shown, and the listbox sees one remove
+// and one insert.
+int view_move(TodoView *view, int from, int to) {
+    TodoViewRow moved;
+
+    if (view->stale || from < 0 || from >= view->count || to < 0 || to >= view->count) return 0;
+    if (from == to) return view_update(view, to);
+
+    moved = view->rows[from];
+    if (from < to) {
+        memmove(&view->rows[from], &view->rows[from + 1], (size_t)(to - from) * sizeof(TodoViewRow));
+    } else {
+        memmove(&view->rows[to + 1], &view->rows[to], (size_t)(from - to) * sizeof(TodoViewRow));
+    }
+    view->rows[to].width = VIEW_UNFORMATTED;
+    forget_row(view, &moved);
+    compact_strings(view);
+
+    return queue_op(view, VIEW_OP_REMOVE, from) && queue_op(view, VIEW_OP_INSERT, to);
+}
+
+void view_clear_ops(TodoView *view) {
+    view->op_count = 0;
+    view->rebuilt = 0;
+}
+
+void view_follow_tasks(TodoView *view, const TodoStoreChange *change, int folder) {
+    if (change->kind == STORE_RESET) {
+        view_mark_stale(view);
+        return;
+    }
+    if (change->folder != folder) return;
+
+    switch (change->kind) {
+        case STORE_TASK_ADDED:
+            view_insert(view, change->position);
+            break;
+        case STORE_TASK_MOVED:
+            view_move(view, change->task, change->position);
+            break;
+        case STORE_TASK_REMOVED:
+            view_remove(view, change->task);
+            break;
+    }
+}
+
+void view_follow_folders(TodoView *view, const TodoStoreChange *change) {
+    switch (change->kind) {
+        case STORE_RESET:
+            view_mark_stale(view);
+            break;
+        case STORE_FOLDER_ADDED:
+            view_insert(view, change->folder);
+            break;
+        case STORE_FOLDER_REMOVED:
+            view_remove(view, change->folder);
+            break;
+        case STORE_FOLDER_LOADED:
+        case STORE_TASK_ADDED:
+        case STORE_TASK_MOVED:
+        case STORE_TASK_REMOVED:
+            view_update(view, change->folder);  // Task counts
+            break;
+    }
+}
@@ -0,0 +1,92 @@
+#ifndef TODO_VIEW_H
+#define TODO_VIEW_H
+
+#include "todo_core.h"
+#include "todo_stats.h"
+#include "todo_strings.h"
+
+// Platform-neutral list view model. A row is formatted the first time its
+// text is asked for (view_row_text(), as the listbox draws it), so a
+// rebuild formats nothing and a long list only ever formats the rows that
+// have been on screen. Formatted text is kept once in the view's string
+// pool behind an 8-byte handle per row. Mutations touch at most one row
+// and queue a minimal list of insert/remove/update operations, which the
+// GUI applies to its listbox instead of clearing and refilling it; an
+// update of a row that was never formatted, or that formats to the same
+// text, queues nothing. The widest formatted row is tracked as rows come
+// and go, so the horizontal extent never needs a full re-measure.
+
+#define VIEW_TEXT_LENGTH 512     // Longer text is cut short on its row
+#define VIEW_UNFORMATTED (-1)    // Width of a row not formatted yet
+
+enum {
+    VIEW_OP_INSERT = 1,
+    VIEW_OP_REMOVE,
+    VIEW_OP_UPDATE      // Replace the text of an existing row
+};
+
+typedef struct {
+    TodoString text;        // In the view's pool, once formatted
+    int width;              // VIEW_UNFORMATTED until then
+} TodoViewRow;
+
+typedef struct {
+    int op;
+    int row;                // Row index at the time the op is applied
+} TodoViewOp;
+
+// Fill text (VIEW_TEXT_LENGTH bytes) for a row of the underlying data
+typedef void (*TodoViewFormat)(void *context, int row, char *text);
+// Display width of a row's text; NULL counts characters
+typedef int (*TodoViewMeasure)(void *context, const char *text);
+
+typedef struct {
+    TodoViewRow *rows;
+    TodoStringPool strings;
+    int count;
+    int capacity;
+    TodoViewOp *ops;        // Pending changes, oldest first
+    int op_count;
+    int op_capacity;
+    int rebuilt;            // Rows were replaced wholesale; ops are empty
+    int stale;              // Rows no longer match the data until rebuilt
+    int max_width;          // Of the formatted rows
+    int max_rows;           // Formatted rows currently at max_width
+    TodoViewFormat format;
+    TodoViewMeasure measure;
+    void *context;
+} TodoView;
+
+void view_init(TodoView *view, TodoViewFormat format, TodoViewMeasure measure, void *context);
+void view_free(TodoView *view);
+
+// Replace every row with count unformatted ones
+int view_rebuild(TodoView *view, int count);
+// A row's text, formatted and measured now if it was not yet; valid until
+// the view next changes
+const char *view_row_text(TodoView *view, int row);
+// Ignore changes until the next rebuild, e.g. while a store is reloaded
+void view_mark_stale(TodoView *view);
+
+// Follow a change in the underlying data. Each formats at most one row.
+int view_insert(TodoView *view, int row);
+int view_remove(TodoView *view, int row);
+int view_update(TodoView *view, int row);
+int view_move(TodoView *view, int from, int to);
+
+// Forget queued ops once they have been applied
+void view_clear_ops(TodoView *view);
+
+// Row text shared by the GUI, benchmarks and tests
+void view_format_task(const TodoStore *store, const Task *task, int due_state, char *text);
+// stats may be NULL; without it, or before the folder is loaded, a folder
+// row shows only its task count
+void view_format_folder(const TodoStore *store, const Folder *folder, const TodoFolderStats *stats, char *text);
+
+// Forward store change notifications for one folder's tasks into a view.
+// Switching to another folder is a rebuild.
+void view_follow_tasks(TodoView *view, const TodoStoreChange *change, int folder);
+// Forward folder changes (including task counts) into a folder list view
+void view_follow_folders(TodoView *view, const TodoStoreChange *change);
+
+#endif
@@ -0,0 +1,1387 @@
+// Headless benchmark of the core data paths.
+//
+// Generates a synthetic set of tasks and times date parsing and formatting,
+// task ordering, due-state classification, list row formatting, the text
+// codec, data file round-trips in both section encodings and tag filters on
+// it, for each requested size. Results are printed as JSON so runs can be compared across
+// versions. Needs no Win32:
+//
+//   gcc -std=c99 -O2 -pthread -I. -o todo_bench tools/todo_bench.c todo_core.c todo_format.c
+//       todo_slots.c todo_sort.c todo_recur.c todo_lz.c todo_thread.c todo_date.c todo_due.c todo_view.c todo_strings.c
+//       todo_tags.c todo_bitmap.c todo_stats.c todo_journal.c todo_trace.c todo_history.c todo_batch.c
+//       todo_query.c todo_search.c todo_agenda.c
+//   ./todo_bench --tasks 1000,100000,10000000 --folders 50 --completed 0.3
+//
+// Every measurement is repeated and the fastest and median times reported.
+// The save/load round-trip goes through a real TodoStore holding every task;
+// its "items" field says how many it loaded back. Benchmarks that produce
+// bytes also report "bytes": the file size, or the compressed text size.
+// The sort benchmarks come in pairs: the radix sort on packed keys, and a
+// "_qsort" run of the comparator sort it replaced, on the same folders, and
+// the tag filter is paired with a "_scan" that tests every task's tags.
+// "verify_data" reads the plain file into memory and checks all of it on
+// every core, the way the journal checks a file it opens; "read_data" only
+// reads it, so the difference is what the checks cost. "folder_rows" formats
+// the folder list and the overall counts from the counts that follow the
+// store, paired with a "_scan" that counts every task for them; "next_day"
+// moves those counts to tomorrow. "batch_complete" completes up to 1000 open
+// tasks in each folder as one undo step, and "complete_each" the same tasks
+// one change and one undo step at a time, with the counts following along;
+// neither writes a journal. "batch_many_folders" completes the one task in
+// each of up to 65536 folders as one undo step, so a batch that looks up
+// its folders one scan at a time shows. "view_rebuild" shows the first
+// list's task view and "view_edit" completes its tasks one at a time with the view following;
+// both draw the rows in sight and report the rows they formatted and, as
+// "bytes", what the view holds. "query" runs a compiled query over every list on the
+// query index's columns, and "query_scan" tests the same conditions task
+// by task, skipping the lists whose name does not match. "search" types a
+// word into the search box of every list a letter at a time; its "items"
+// are the searches run. "agenda" opens the columnar file and pages through
+// the next two weeks of open tasks without loading any list;
+// "agenda_again" pages through them a second time from the plain file,
+// as the next refresh of the agenda would.
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <ctype.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#ifdef _WIN32
+#include <windows.h>
+#endif
+
+#include "todo_agenda.h"
+#include "todo_batch.h"
+#include "todo_core.h"
+#include "todo_date.h"
+#include "todo_due.h"
+#include "todo_format.h"
+#include "todo_history.h"
+#include "todo_journal.h"
+#include "todo_lz.h"
+#include "todo_query.h"
+#include "todo_search.h"
+#include "todo_sort.h"
+#include "todo_stats.h"
+#include "todo_tags.h"
+#include "todo_thread.h"
+#include "todo_view.h"
+
+#define MAX_SIZES 16
+#define MAX_REPEAT 100
+
+enum {
+    DEADLINES_UNIFORM,      // Spread over a year either side of today
+    DEADLINES_CLUSTERED,    // Mostly within two weeks of today
+    DEADLINES_PAST          // All before today
+};
+
+static const char *deadline_names[] = { "uniform", "clustered", "past" };
+
+typedef struct {
+    size_t sizes[MAX_SIZES];
+    int size_count;
+    int folders;
+    double completed;       // Fraction of tasks already done
+    double undated;         // Fraction of tasks without a deadline
+    int deadlines;
+    int repeat;
+    uint64_t seed;
+    const char *dir;        // Where the round-trip data files go
+    const char *out;        // NULL for stdout
+} BenchConfig;
+
+// One synthetic run. Folder f holds tasks [starts[f], starts[f + 1]), in
+// random order; descriptions live in holder's string pool.
+typedef struct {
+    size_t count;
+    int folders;
+    int32_t today;
+    Task *tasks;
+    Task *work;             // Scratch copy for sorting
+    uint64_t *keys;         // Sort keys and the handles they carry
+    uint32_t *items;
+    size_t *starts;
+    char *date_text;        // count fields of DATE_TEXT_LENGTH bytes
+    int32_t *days;
+    uint8_t *valid;
+    uint8_t *states;
+    TodoStore *holder;
+} Dataset;
+
+typedef struct {
+    const char *name;
+    size_t items;
+    uint64_t bytes;         // 0 if the benchmark has no output size
+    uint64_t formatted;     // Rows formatted, for the view benchmarks
+    uint64_t min_ns;
+    uint64_t median_ns;
+} BenchResult;
+
+typedef uint64_t (*BenchFunc)(Dataset *data, const BenchConfig *config, size_t *items);
+
+static volatile uint64_t sink;     // Keeps results alive past the optimizer
+static uint64_t output_bytes;      // Set by benchmarks that write something
+static uint64_t output_formatted;  // Set by the view benchmarks
+
+static uint64_t now_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER frequency, counter;
+
+    QueryPerformanceFrequency(&frequency);
+    QueryPerformanceCounter(&counter);
+    return (uint64_t)((double)counter.QuadPart * 1e9 / (double)frequency.QuadPart);
+#else
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint64_t)now.tv_sec * 1000000000u + (uint64_t)now.tv_nsec;
+#endif
+}
+
+// xorshift64*, so a seed always gives the same dataset
+static uint64_t next_random(uint64_t *state) {
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * 2685821657736338717ull;
+}
+
+static double random_unit(uint64_t *state) {
+    return (double)(next_random(state) >> 11) / (double)(1ull << 53);
+}
+
+static int32_t random_deadline(uint64_t *state, const BenchConfig *config, int32_t today) {
+    uint64_t r = next_random(state);
+
+    switch (config->deadlines) {
+    case DEADLINES_CLUSTERED:
+        // Nine in ten within two weeks, the rest within a year
+        if (r % 10) return today - 14 + (int32_t)((r >> 8) % 29);
+        return today - 365 + (int32_t)((r >> 8) % 731);
+    case DEADLINES_PAST:
+        return today - 1 - (int32_t)(r % 730);
+    default:
+        return today - 365 + (int32_t)(r % 731);
+    }
+}
+
+static const char *verbs[] = {
+    "Call", "Email", "Review", "Buy", "Fix", "Plan", "Book", "Pay",
+    "Clean", "Write", "Read", "Send", "Check", "Update", "Prepare", "Cancel"
+};
+static const char *nouns[] = {
+    "dentist", "report", "groceries", "car", "budget", "flights", "rent", "garage",
+    "invoice", "notes", "contract", "slides", "backup", "passport", "presents", "insurance"
+};
+// Canonical tag sets; a quarter of the tasks have none
+static const char *tag_sets[] = {
+    "", "", "home", "work", "urgent work", "errand home", "waiting work", "errand urgent"
+};
+
+static void free_dataset(Dataset *data) {
+    free(data->tasks);
+    free(data->work);
+    free(data->keys);
+    free(data->items);
+    free(data->starts);
+    free(data->date_text);
+    free(data->days);
+    free(data->valid);
+    free(data->states);
+    if (data->holder) {
+        store_release(data->holder);
+        free(data->holder);
+    }
+    memset(data, 0, sizeof(*data));
+}
+
+static int make_dataset(Dataset *data, size_t count, const BenchConfig *config) {
+    uint64_t state = config->seed ? config->seed : 1;
+    char text[64];
+
+    memset(data, 0, sizeof(*data));
+    data->count = count;
+    data->folders = config->folders;
+    data->today = date_from_civil(2026, 6, 15);
+    data->tasks = (Task *)malloc(count * sizeof(Task));
+    data->work = (Task *)malloc(count * sizeof(Task));
+    data->keys = (uint64_t *)malloc(count * sizeof(uint64_t));
+    data->items = (uint32_t *)malloc(count * sizeof(uint32_t));
+    data->starts = (size_t *)malloc((config->folders + 1) * sizeof(size_t));
+    data->date_text = (char *)malloc(count * DATE_TEXT_LENGTH);
+    data->days = (int32_t *)malloc(count * sizeof(int32_t));
+    data->valid = (uint8_t *)malloc(count);
+    data->states = (uint8_t *)malloc(count);
+    data->holder = (TodoStore *)malloc(sizeof(TodoStore));
+    if (!data->tasks || !data->work || !data->keys || !data->items || !data->starts || !data->date_text ||
+        !data->days || !data->valid || !data->states || !data->holder) {
+        free(data->holder);
+        data->holder = NULL;
+        free_dataset(data);
+        return 0;
+    }
+    store_init(data->holder);
+
+    for (int f = 0; f <= config->folders; f++) {
+        data->starts[f] = count * (size_t)f / (size_t)config->folders;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        Task *task = &data->tasks[i];
+        uint64_t r = next_random(&state);
+        int32_t deadline = random_deadline(&state, config, data->today);
+
+        // Repeats like a real list, so the pool sees shared strings
+        snprintf(text, sizeof(text), "%s %s %u", verbs[r & 15], nouns[(r >> 4) & 15],
+                 (unsigned)((r >> 8) % 1000));
+        if (!strpool_intern(&data->holder->strings, text, strlen(text), &task->description) ||
+            !strpool_intern(&data->holder->strings, tag_sets[(r >> 24) & 7], strlen(tag_sets[(r >> 24) & 7]),
+                            &task->tags)) {
+            free_dataset(data);
+            return 0;
+        }
+        task->deadline_day = random_unit(&state) < config->undated ? DATE_NONE : deadline;
+        task->completed = random_unit(&state) < config->completed;
+        task->priority = (int)((r >> 20) & 3);
+        task->sequence = (uint32_t)i;
+        task->id = (uint32_t)i + 1;
+        task->rule = 0;
+
+        // The parse benchmarks get a date for every task
+        date_format(deadline, &data->date_text[i * DATE_TEXT_LENGTH]);
+    }
+    return 1;
+}
+
+// Benchmarks. Each times one pass over the dataset and reports how many
+// items it handled.
+
+static uint64_t bench_date_parse(Dataset *data, const BenchConfig *config, size_t *items) {
+    uint64_t start, total = 0;
+
+    (void)config;
+    start = now_ns();
+    for (size_t i = 0; i < data->count; i++) {
+        int32_t day;
+        if (date_parse(&data->date_text[i * DATE_TEXT_LENGTH], &day)) total += (uint32_t)day;
+    }
+    sink = total;
+    *items = data->count;
+    return now_ns() - start;
+}
+
+static uint64_t bench_date_parse_column(Dataset *data, const BenchConfig *config, size_t *items) {
+    uint64_t start = now_ns();
+
+    (void)config;
+    sink = date_parse_column(data->date_text, DATE_TEXT_LENGTH, data->count, data->days, data->valid);
+    *items = data->count;
+    return now_ns() - start;
+}
+
+static uint64_t bench_date_format(Dataset *data, const BenchConfig *config, size_t *items) {
+    char text[DATE_TEXT_LENGTH];
+    uint64_t start, total = 0;
+
+    (void)config;
+    start = now_ns();
+    for (size_t i = 0; i < data->count; i++) {
+        date_format(data->tasks[i].deadline_day, text);
+        total += (unsigned char)text[9];
+    }
+    sink = total;
+    *items = data->count;
+    return now_ns() - start;
+}
+
+// Packed keys and a radix sort per folder, carrying the task handles, as
+// sort_tasks() and sort_rows() do
+static uint64_t sort_radix_folders(Dataset *data, const TodoSortOrder *order, size_t *items) {
+    uint64_t start = now_ns();
+
+    for (int f = 0; f < data->folders; f++) {
+        size_t first = data->starts[f];
+        size_t count = data->starts[f + 1] - first;
+
+        for (size_t i = first; i < first + count; i++) {
+            data->keys[i] = sort_key(order, &data->tasks[i]);
+            data->items[i] = data->tasks[i].id;
+        }
+        sort_radix(&data->keys[first], &data->items[first], count);
+    }
+    sink = data->items[0];
+    *items = data->count;
+    return now_ns() - start;
+}
+
+// The comparator sort it replaced, on copies of the tasks
+static uint64_t sort_qsort_folders(Dataset *data, int (*compare)(const void *, const void *), size_t *items) {
+    uint64_t start;
+
+    memcpy(data->work, data->tasks, data->count * sizeof(Task));
+    start = now_ns();
+    for (int f = 0; f < data->folders; f++) {
+        size_t first = data->starts[f];
+        qsort(&data->work[first], data->starts[f + 1] - first, sizeof(Task), compare);
+    }
+    sink = data->work[0].id;
+    *items = data->count;
+    return now_ns() - start;
+}
+
+// Open first, priority, deadline, then creation order, one branch per key
+static int compare_priority(const void *a, const void *b) {
+    const Task *taskA = (const Task *)a;
+    const Task *taskB = (const Task *)b;
+
+    if (taskA->completed != taskB->completed) return taskA->completed ? 1 : -1;
+    if (taskA->priority != taskB->priority) return taskA->priority > taskB->priority ? -1 : 1;
+    if (taskA->deadline_day != taskB->deadline_day) return taskA->deadline_day < taskB->deadline_day ? -1 : 1;
+    return (taskA->sequence > taskB->sequence) - (taskA->sequence < taskB->sequence);
+}
+
+// What sort_tasks() does to one folder, on folders of any size
+static uint64_t bench_sort_tasks(Dataset *data, const BenchConfig *config, size_t *items) {
+    TodoSortOrder order = sort_folder_order();
+
+    (void)config;
+    return sort_radix_folders(data, &order, items);
+}
+
+static uint64_t bench_sort_tasks_qsort(Dataset *data, const BenchConfig *config, size_t *items) {
+    (void)config;
+    return sort_qsort_folders(data, compare_tasks, items);
+}
+
+// The "Priority" list order, through sort_rows()' path
+static uint64_t bench_sort_priority(Dataset *data, const BenchConfig *config, size_t *items) {
+    TodoSortOrder order = sort_preset(SORT_PRESET_PRIORITY);
+
+    (void)config;
+    return sort_radix_folders(data, &order, items);
+}
+
+static uint64_t bench_sort_priority_qsort(Dataset *data, const BenchConfig *config, size_t *items) {
+    (void)config;
+    return sort_qsort_folders(data, compare_priority, items);
+}
+
+static uint64_t bench_is_overdue(Dataset *data, const BenchConfig *config, size_t *items) {
+    uint64_t start, total = 0;
+
+    (void)config;
+    start = now_ns();
+    for (size_t i = 0; i < data->count; i++) {
+        total += (uint64_t)is_overdue(data->tasks[i].deadline_day, data->today);
+    }
+    sink = total;
+    *items = data->count;
+    return now_ns() - start;
+}
+
+static uint64_t bench_due_classify(Dataset *data, const BenchConfig *config, size_t *items) {
+    uint64_t start = now_ns();
+
+    (void)config;
+    for (int f = 0; f < data->folders; f++) {
+        size_t first = data->starts[f];
+        due_classify_tasks(&data->tasks[first], (int)(data->starts[f + 1] - first), data->today,
+                           &data->states[first]);
+    }
+    sink = data->states[data->count - 1];
+    *items = data->count;
+    return now_ns() - start;
+}
+
+// Row text as the task listbox shows it
+static uint64_t bench_format_rows(Dataset *data, const BenchConfig *config, size_t *items) {
+    char text[VIEW_TEXT_LENGTH];
+    uint64_t start, total = 0;
+
+    (void)config;
+    due_classify_tasks(data->tasks, (int)data->count, data->today, data->states);
+    start = now_ns();
+    for (size_t i = 0; i < data->count; i++) {
+        view_format_task(data->holder, &data->tasks[i], data->states[i], text);
+        total += strlen(text);
+    }
+    sink = total;
+    *items = data->count;
+    return now_ns() - start;
+}
+
+// Rows the task list shows at a time
+#define BENCH_VISIBLE_ROWS 40
+
+// The first folder's task list, as the GUI drives it
+typedef struct {
+    TodoStore *store;
+    TodoView view;
+    int32_t today;
+    uint64_t formatted;
+} ViewBench;
+
+static void format_view_row(void *context, int row, char *text) {
+    ViewBench *bench = (ViewBench *)context;
+    const Task *task = store_task(bench->store, &bench->store->folders[0], row);
+
+    view_format_task(bench->store, task, due_state(task, bench->today), text);
+    bench->formatted++;
+}
+
+static void follow_view(void *context, const TodoStoreChange *change) {
+    view_follow_tasks(&((ViewBench *)context)->view, change, 0);
+}
+
+// Apply the queued ops and draw the rows in sight, which formats those
+// not drawn before
+static void draw_view(ViewBench *bench) {
+    view_clear_ops(&bench->view);
+    for (int i = 0; i < BENCH_VISIBLE_ROWS && i < bench->view.count; i++) {
+        sink += (unsigned char)view_row_text(&bench->view, i)[0];
+    }
+}
+
+// Memory the view holds for its rows and their text
+static uint64_t view_bytes(const TodoView *view) {
+    return (uint64_t)view->capacity * sizeof(TodoViewRow) + view->strings.capacity +
+           (uint64_t)view->strings.slot_count * sizeof(TodoStringSlot);
+}
+
+// Fill a store with the dataset, in folder order; returns the tasks stored
+static size_t fill_store(TodoStore *store, const Dataset *data) {
+    TodoTaskInput *inputs = (TodoTaskInput *)malloc((data->count ? data->count : 1) * sizeof(TodoTaskInput));
+    size_t stored = 0;
+
+    for (int f = 0; inputs && f < data->folders; f++) {
+        size_t count = data->starts[f + 1] - data->starts[f];
+        char name[32];
+        int index;
+
+        snprintf(name, sizeof(name), "List %d", f + 1);
+        index = store_create_folder(store, 0, name);
+        if (index < 0) break;
+        for (size_t i = 0; i < count; i++) {
+            const Task *task = &data->tasks[data->starts[f] + i];
+
+            inputs[i].description = store_text(data->holder, task->description);
+            inputs[i].length = task->description.length;
+            inputs[i].deadline_day = task->deadline_day;
+            inputs[i].completed = task->completed;
+            inputs[i].priority = task->priority;
+            inputs[i].tags = store_text(data->holder, task->tags);
+            inputs[i].tags_length = task->tags.length;
+            memset(&inputs[i].repeat, 0, sizeof(inputs[i].repeat));
+        }
+        stored += (size_t)store_add_tasks(store, index, inputs, (int)count);
+    }
+    free(inputs);
+    return stored;
+}
+
+static void bench_path(const BenchConfig *config, int encoding, char *path, size_t size) {
+    snprintf(path, size, "%s/todo_bench%s.dat", config->dir, encoding == TODOFMT_COLUMNAR ? "_columnar" : "");
+}
+
+static uint64_t save_file(Dataset *data, const BenchConfig *config, int encoding, size_t *items) {
+    static TodoStore store;
+    char path[1024];
+    uint64_t start, elapsed;
+    FILE *file;
+
+    bench_path(config, encoding, path, sizeof(path));
+    store_init(&store);
+    *items = fill_store(&store, data);
+    start = now_ns();
+    if (todofmt_write(path, &store, encoding) != TODOFMT_OK) {
+        fprintf(stderr, "todo_bench: could not write %s\n", path);
+    }
+    elapsed = now_ns() - start;
+    store_release(&store);
+
+    if ((file = fopen(path, "rb")) != NULL) {
+        if (fseek(file, 0, SEEK_END) == 0) output_bytes = (uint64_t)ftell(file);
+        fclose(file);
+    }
+    return elapsed;
+}
+
+// Open, list and materialize every folder of the file save_file wrote
+static uint64_t load_file(const BenchConfig *config, int encoding, size_t *items) {
+    static TodoStore store;
+    TodoDataFile *file;
+    char path[1024];
+    uint64_t start, elapsed;
+    size_t loaded = 0;
+
+    bench_path(config, encoding, path, sizeof(path));
+    store_init(&store);
+    start = now_ns();
+    if (todofmt_open(path, &file) == TODOFMT_OK) {
+        store_attach(&store, file);
+        for (int i = 0; i < store.folder_count; i++) {
+            store_materialize(&store, i);
+            loaded += (size_t)store.folders[i].task_count;
+        }
+    } else {
+        fprintf(stderr, "todo_bench: could not open %s\n", path);
+    }
+    elapsed = now_ns() - start;
+    store_release(&store);
+    *items = loaded;
+    return elapsed;
+}
+
+static uint64_t bench_save_data(Dataset *data, const BenchConfig *config, size_t *items) {
+    return save_file(data, config, TODOFMT_PLAIN, items);
+}
+
+static uint64_t bench_load_data(Dataset *data, const BenchConfig *config, size_t *items) {
+    (void)data;
+    return load_file(config, TODOFMT_PLAIN, items);
+}
+
+static uint64_t bench_save_columnar(Dataset *data, const BenchConfig *config, size_t *items) {
+    return save_file(data, config, TODOFMT_COLUMNAR, items);
+}
+
+static uint64_t bench_load_columnar(Dataset *data, const BenchConfig *config, size_t *items) {
+    (void)data;
+    return load_file(config, TODOFMT_COLUMNAR, items);
+}
+
+// Read the plain file save_file wrote into memory, and with check set also
+// open it from there and check every section on one thread
+static uint64_t read_file(const BenchConfig *config, int check, size_t *items) {
+    char path[1024];
+    uint64_t start, elapsed;
+    unsigned char *buffer = NULL;
+    size_t size = 0, tasks = 0;
+    FILE *file;
+    long length;
+
+    bench_path(config, TODOFMT_PLAIN, path, sizeof(path));
+    start = now_ns();
+    if ((file = fopen(path, "rb")) != NULL) {
+        if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0 &&
+            (buffer = (unsigned char *)malloc((size_t)length)) != NULL) {
+            size = fread(buffer, 1, (size_t)length, file);
+        }
+        fclose(file);
+    }
+    if (buffer == NULL) {
+        fprintf(stderr, "todo_bench: could not read %s\n", path);
+    } else if (check) {
+        TodoDataFile *data;
+
+        if (todofmt_open_memory(buffer, size, &data) == TODOFMT_OK) {
+            if (todofmt_verify(data, todo_cpu_count()) != 0) fprintf(stderr, "todo_bench: %s is damaged\n", path);
+            for (uint32_t i = 0; i < todofmt_header(data)->folder_count; i++) {
+                tasks += todofmt_folder_entry(data, i)->task_count;
+            }
+            todofmt_close(data);
+        } else {
+            fprintf(stderr, "todo_bench: could not open %s\n", path);
+        }
+    } else {
+        sink += buffer[size / 2];
+    }
+    elapsed = now_ns() - start;
+    free(buffer);
+    output_bytes = size;
+    *items = tasks;
+    return elapsed;
+}
+
+static uint64_t bench_read_data(Dataset *data, const BenchConfig *config, size_t *items) {
+    uint64_t elapsed = read_file(config, 0, items);
+
+    *items = data->count;
+    return elapsed;
+}
+
+static uint64_t bench_verify_data(Dataset *data, const BenchConfig *config, size_t *items) {
+    (void)data;
+    return read_file(config, 1, items);
+}
+
+// The same filter, from the tag index and by testing every task
+#define BENCH_TAG_FILTER "#work -#urgent open"
+
+static uint64_t bench_tag_filter(Dataset *data, const BenchConfig *config, size_t *items) {
+    static TodoStore store;
+    TodoTagIndex *index;
+    TodoTagFilter *filter = NULL;
+    TodoBitmap matches;
+    uint64_t start, elapsed, total = 0;
+
+    (void)config;
+    store_init(&store);
+    bitmap_init(&matches);
+    *items = fill_store(&store, data);
+    index = tags_create(&store);
+    tags_parse(BENCH_TAG_FILTER, &filter);
+    start = now_ns();
+    for (int f = 0; index && filter && f < store.folder_count; f++) {
+        if (tags_filter(index, filter, store.folders[f].id, &matches)) total += bitmap_count(&matches);
+    }
+    elapsed = now_ns() - start;
+    sink = total;
+    bitmap_free(&matches);
+    tags_free_filter(filter);
+    tags_destroy(index);
+    store_release(&store);
+    return elapsed;
+}
+
+static uint64_t bench_tag_filter_scan(Dataset *data, const BenchConfig *config, size_t *items) {
+    static TodoStore store;
+    uint64_t start, elapsed, total = 0;
+
+    (void)config;
+    store_init(&store);
+    *items = fill_store(&store, data);
+    start = now_ns();
+    for (int f = 0; f < store.folder_count; f++) {
+        const Folder *folder = &store.folders[f];
+
+        for (int i = 0; i < folder->task_count; i++) {
+            const Task *task = store_task(&store, folder, i);
+            const char *tags = store_text(&store, task->tags);
+
+            total += !task->completed && tags_contains(tags, task->tags.length, "work", 4) &&
+                     !tags_contains(tags, task->tags.length, "urgent", 6);
+        }
+    }
+    elapsed = now_ns() - start;
+    sink = total;
+    store_release(&store);
+    return elapsed;
+}
+
+// The folder list and the title's counts, from the kept counts and by
+// counting every task
+static uint64_t bench_folder_rows(Dataset *data, const BenchConfig *config, size_t *items) {
+    static TodoStore store;
+    TodoStats *stats;
+    char text[VIEW_TEXT_LENGTH];
+    uint64_t start, elapsed, total = 0;
+
+    (void)config;
+    store_init(&store);
+    *items = fill_store(&store, data);
+    stats = stats_create(&store, data->today);
+    start = now_ns();
+    for (int f = 0; stats && f < store.folder_count; f++) {
+        view_format_folder(&store, &store.folders[f], stats_folder(stats, f), text);
+        total += strlen(text);
+    }
+    if (stats) total += (uint64_t)stats_total(stats)->overdue;
+    elapsed = now_ns() - start;
+    sink = total;
+    stats_destroy(stats);
+    store_release(&store);
+    return elapsed;
+}
+
+static uint64_t bench_folder_rows_scan(Dataset *data, const BenchConfig *config, size_t *items) {
+    static TodoStore store;
+    char text[VIEW_TEXT_LENGTH];
+    uint64_t start, elapsed, total = 0;
+    int overdue = 0;
+
+    (void)config;
+    store_init(&store);
+    *items = fill_store(&store, data);
+    start = now_ns();
+    for (int f = 0; f < store.folder_count; f++) {
+        const Folder *folder = &store.folders[f];
+        TodoFolderStats counts;
+
+        memset(&counts, 0, sizeof(counts));
+        counts.tasks = folder->task_count;
+        counts.loaded = 1;
+        for (int i = 0; i < folder->task_count; i++) {
+            int state = due_state(store_task(&store, folder, i), data->today);
+
+            counts.open += state != DUE_DONE;
+            counts.completed += state == DUE_DONE;
+            counts.overdue += state == DUE_OVERDUE;
+            counts.due_today += state == DUE_TODAY;
+        }
+        overdue += counts.overdue;
+        view_format_folder(&store, folder, &counts, text);
+        total += strlen(text);
+    }
+    total += (uint64_t)overdue;
+    elapsed = now_ns() - start;
+    sink = total;
+    store_release(&store);
+    return elapsed;
+}
+
+static uint64_t bench_next_day(Dataset *data, const BenchConfig *config, size_t *items) {
+    static TodoStore store;
+    TodoStats *stats;
+    uint64_t start, elapsed;
+
+    (void)config;
+    store_init(&store);
+    *items = fill_store(&store, data);
+    stats = stats_create(&store, data->today);
+    start = now_ns();
+    if (stats) sink = (uint64_t)stats_set_today(stats, data->today + 1);
+    elapsed = now_ns() - start;
+    stats_destroy(stats);
+    store_release(&store);
+    return elapsed;
+}
+
+// Completing up to this many open tasks per folder, as one batch and one
+// change at a time
+#define BENCH_BATCH_TASKS 1000
+
+static uint64_t bench_batch_complete(Dataset *data, const BenchConfig *config, size_t *items) {
+    static TodoStore store;
+    TodoHistory *history;
+    TodoStats *stats;
+    TodoBatch *batch;
+    uint64_t start, elapsed;
+    size_t queued = 0;
+    int ok = 1;
+
+    (void)config;
+    store_init(&store);
+    fill_store(&store, data);
+    history = history_create(HISTORY_DEFAULT_BUDGET);
+    stats = stats_create(&store, data->today);
+    start = now_ns();
+    batch = batch_begin(&store);
+    for (int f = 0; batch && ok && f < store.folder_count; f++) {
+        const Folder *folder = &store.folders[f];
+
+        for (int i = 0; ok && i < folder->task_count && i < BENCH_BATCH_TASKS; i++) {
+            if (store_task(&store, folder, i)->completed) break;
+            ok = batch_complete_task(batch, f, i);
+            queued++;
+        }
+    }
+    if (batch && ok && batch_commit(batch, history, NULL, NULL)) {
+        *items = queued;
+    } else {
+        if (batch && !ok) batch_abort(batch);
+        *items = 0;
+    }
+    elapsed = now_ns() - start;
+    stats_destroy(stats);
+    history_destroy(history);
+    store_release(&store);
+    return elapsed;
+}
+
+// One open task in each of up to this many folders, completed as one batch
+#define BENCH_SPREAD_FOLDERS 65536
+
+static uint64_t bench_batch_many_folders(Dataset *data, const BenchConfig *config, size_t *items) {
+    static TodoStore store;
+    TodoHistory *history;
+    TodoBatch *batch;
+    uint64_t start, elapsed;
+    int folders = data->count < BENCH_SPREAD_FOLDERS ? (int)data->count : BENCH_SPREAD_FOLDERS;
+    int ok = 1;
+
+    (void)config;
+    store_init(&store);
+    for (int f = 0; f < folders; f++) {
+        const Task *task = &data->tasks[f];
+        char name[32];
+        int index;
+
+        snprintf(name, sizeof(name), "List %d", f + 1);
+        index = store_create_folder(&store, 0, name);
+        if (index < 0 || !store_insert_task(&store, index, -1, store_text(data->holder, task->description),
+                                            task->deadline_day, 0, task->priority, "", NULL)) {
+            break;
+        }
+    }
+    history = history_create(HISTORY_DEFAULT_BUDGET);
+    start = now_ns();
+    batch = batch_begin(&store);
+    for (int f = 0; batch && ok && f < store.folder_count; f++) {
+        ok = store.folders[f].task_count > 0 && batch_complete_task(batch, f, 0);
+    }
+    if (batch && ok && batch_commit(batch, history, NULL, NULL)) {
+        *items = (size_t)store.folder_count;
+    } else {
+        if (batch && !ok) batch_abort(batch);
+        *items = 0;
+    }
+    elapsed = now_ns() - start;
+    history_destroy(history);
+    store_release(&store);
+    return elapsed;
+}
+
+// Open tasks come first, and a completed one moves behind them, so the first
+// row is always the next one to complete
+static uint64_t bench_complete_each(Dataset *data, const BenchConfig *config, size_t *items) {
+    static TodoStore store;
+    TodoHistory *history;
+    TodoStats *stats;
+    uint64_t start, elapsed;
+    size_t completed = 0;
+
+    (void)config;
+    store_init(&store);
+    fill_store(&store, data);
+    history = history_create(HISTORY_DEFAULT_BUDGET);
+    stats = stats_create(&store, data->today);
+    start = now_ns();
+    for (int f = 0; f < store.folder_count; f++) {
+        const Folder *folder = &store.folders[f];
+
+        for (int i = 0; i < folder->task_count && i < BENCH_BATCH_TASKS; i++) {
+            const Task *task = store_task(&store, folder, 0);
+            char deadline[DATE_TEXT_LENGTH];
+            TodoJournalEntry entry;
+            TodoHistoryCommand *command = NULL;
+
+            if (task->completed) break;
+            date_format(task->deadline_day, deadline);
+            entry.op = JOURNAL_COMPLETE_TASK;
+            entry.folder_id = folder->id;
+            entry.task_index = 0;
+            entry.text[0] = store_text(&store, task->description);
+            entry.text[1] = deadline;
+            if (!history_add(&command, &store, &entry) || !journal_apply(&store, &entry)) {
+                history_free_command(command);
+                break;
+            }
+            history_push(history, command);
+            completed++;
+        }
+    }
+    elapsed = now_ns() - start;
+    *items = completed;
+    stats_destroy(stats);
+    history_destroy(history);
+    store_release(&store);
+    return elapsed;
+}
+
+// Showing the first list: a rebuild, then drawing the rows in sight
+static uint64_t bench_view_rebuild(Dataset *data, const BenchConfig *config, size_t *items) {
+    static TodoStore store;
+    ViewBench bench;
+    uint64_t start, elapsed;
+
+    (void)config;
+    store_init(&store);
+    fill_store(&store, data);
+    bench.store = &store;
+    bench.today = data->today;
+    bench.formatted = 0;
+    view_init(&bench.view, format_view_row, NULL, &bench);
+    start = now_ns();
+    view_rebuild(&bench.view, store.folders[0].task_count);
+    draw_view(&bench);
+    elapsed = now_ns() - start;
+    *items = (size_t)bench.view.count;
+    output_bytes = view_bytes(&bench.view);
+    output_formatted = bench.formatted;
+    view_free(&bench.view);
+    store_release(&store);
+    return elapsed;
+}
+
+// Completing the first list's tasks one at a time with the view following
+// and the rows in sight drawn after each; "rows_formatted" stays a few per
+// edit however long the list is
+static uint64_t bench_view_edit(Dataset *data, const BenchConfig *config, size_t *items) {
+    static TodoStore store;
+    ViewBench bench;
+    uint64_t start, elapsed;
+    size_t completed = 0;
+
+    (void)config;
+    store_init(&store);
+    fill_store(&store, data);
+    bench.store = &store;
+    bench.today = data->today;
+    view_init(&bench.view, format_view_row, NULL, &bench);
+    view_rebuild(&bench.view, store.folders[0].task_count);
+    draw_view(&bench);
+    store_listen(&store, follow_view, &bench);
+    bench.formatted = 0;
+    start = now_ns();
+    for (int i = 0; i < store.folders[0].task_count && i < BENCH_BATCH_TASKS; i++) {
+        if (store_task(&store, &store.folders[0], 0)->completed || !store_complete_task(&store, 0, 0)) break;
+        draw_view(&bench);
+        completed++;
+    }
+    elapsed = now_ns() - start;
+    *items = completed;
+    output_bytes = view_bytes(&bench.view);
+    output_formatted = bench.formatted;
+    view_free(&bench.view);
+    store_release(&store);
+    return elapsed;
+}
+
+// A query over every list, compiled and run on the query index's columns,
+// and the same test made task by task
+#define BENCH_QUERY "folder~\"List 1\" and due < today+7 and not done and text~\"report\""
+
+static uint64_t bench_query(Dataset *data, const BenchConfig *config, size_t *items) {
+    static TodoStore store;
+    TodoQueryIndex *index;
+    TodoQuery *query = NULL;
+    TodoQueryResult matches = { NULL, 0, 0 };
+    uint64_t start, elapsed;
+
+    (void)config;
+    store_init(&store);
+    *items = fill_store(&store, data);
+    index = query_create(&store);
+    query_compile(BENCH_QUERY, &query);
+    start = now_ns();
+    if (index && query && query_run(index, query, 0, data->today, &matches)) sink = matches.count;
+    elapsed = now_ns() - start;
+    query_result_free(&matches);
+    query_free(query);
+    query_destroy(index);
+    store_release(&store);
+    return elapsed;
+}
+
+#define BENCH_SEARCH "report"
+
+// Type BENCH_SEARCH into the search box of every list, one letter at a
+// time, the way the task list filter asks for matches
+static uint64_t bench_search(Dataset *data, const BenchConfig *config, size_t *items) {
+    static TodoStore store;
+    TodoSearchIndex *index;
+    TodoSearchHit *hits;
+    size_t max_hits = 1;
+    uint64_t start, elapsed, total = 0;
+    char typed[sizeof(BENCH_SEARCH)];
+
+    (void)config;
+    store_init(&store);
+    fill_store(&store, data);
+    index = search_create(&store);
+    for (int f = 0; f < store.folder_count; f++) {
+        if ((size_t)store.folders[f].task_count + 1 > max_hits) max_hits = (size_t)store.folders[f].task_count + 1;
+    }
+    hits = (TodoSearchHit *)malloc(max_hits * sizeof(TodoSearchHit));
+    *items = 0;
+    start = now_ns();
+    for (int f = 0; index && hits && f < store.folder_count; f++) {
+        for (size_t length = 1; length < sizeof(typed); length++) {
+            memcpy(typed, BENCH_SEARCH, length);
+            typed[length] = '\0';
+            total += search_query(index, typed, SEARCH_SUBSTRING, store.folders[f].id, hits, max_hits);
+            (*items)++;
+        }
+    }
+    elapsed = now_ns() - start;
+    sink = total;
+    free(hits);
+    search_destroy(index);
+    store_release(&store);
+    return elapsed;
+}
+
+// Page through the agenda from the section deadlines of a data file,
+// without loading any list, count times in a row and time the last
+static uint64_t page_agenda(Dataset *data, const BenchConfig *config, int encoding, int count, size_t *items) {
+    static TodoStore store;
+    static TodoAgendaItem page[100];
+    TodoAgendaQuery query = agenda_upcoming(data->today, 14);
+    TodoDataFile *file;
+    TodoAgenda agenda;
+    char path[1024];
+    uint64_t start = 0, elapsed, total = 0;
+    size_t got;
+
+    bench_path(config, encoding, path, sizeof(path));
+    store_init(&store);
+    if (todofmt_open(path, &file) != TODOFMT_OK) {
+        fprintf(stderr, "todo_bench: could not open %s\n", path);
+        *items = 0;
+        return 0;
+    }
+    store_attach(&store, file);
+    for (int run = 0; run < count; run++) {
+        *items = 0;
+        start = now_ns();
+        if (agenda_begin(&agenda, &store, &query)) {
+            while ((got = agenda_next_page(&agenda, page, 100)) > 0) {
+                *items += got;
+                total += (uint64_t)page[got - 1].deadline;
+            }
+            agenda_end(&agenda);
+        }
+    }
+    elapsed = now_ns() - start;
+    sink = total;
+    store_release(&store);
+    return elapsed;
+}
+
+// The agenda from the file save_columnar wrote, opened afresh
+static uint64_t bench_agenda(Dataset *data, const BenchConfig *config, size_t *items) {
+    return page_agenda(data, config, TODOFMT_COLUMNAR, 1, items);
+}
+
+// The agenda from the file save_data wrote, the second time round
+static uint64_t bench_agenda_again(Dataset *data, const BenchConfig *config, size_t *items) {
+    return page_agenda(data, config, TODOFMT_PLAIN, 2, items);
+}
+
+static int contains_nocase(const char *text, size_t length, const char *word) {
+    size_t word_length = strlen(word);
+
+    for (size_t i = 0; i + word_length <= length; i++) {
+        size_t k = 0;
+
+        while (k < word_length && tolower((unsigned char)text[i + k]) == word[k]) k++;
+        if (k == word_length) return 1;
+    }
+    return 0;
+}
+
+static uint64_t bench_query_scan(Dataset *data, const BenchConfig *config, size_t *items) {
+    static TodoStore store;
+    uint64_t start, elapsed, total = 0;
+
+    (void)config;
+    store_init(&store);
+    *items = fill_store(&store, data);
+    start = now_ns();
+    for (int f = 0; f < store.folder_count; f++) {
+        const Folder *folder = &store.folders[f];
+
+        if (!contains_nocase(store_text(&store, folder->name), folder->name.length, "list 1")) continue;
+        for (int i = 0; i < folder->task_count; i++) {
+            const Task *task = store_task(&store, folder, i);
+
+            total += task->deadline_day != DATE_NONE && task->deadline_day < data->today + 7 && !task->completed &&
+                     contains_nocase(store_text(&store, task->description), task->description.length, "report");
+        }
+    }
+    elapsed = now_ns() - start;
+    sink = total;
+    store_release(&store);
+    return elapsed;
+}
+
+// Every description back to back, as the text column holds them, plus room
+// to compress it in TODOFMT_TEXT_BLOCK pieces
+typedef struct {
+    char *text;
+    size_t size;
+    unsigned char *packed;
+    size_t *piece_sizes;
+    size_t pieces;
+} TextColumn;
+
+static int make_text_column(const Dataset *data, TextColumn *column) {
+    size_t at = 0;
+
+    memset(column, 0, sizeof(*column));
+    for (size_t i = 0; i < data->count; i++) column->size += data->tasks[i].description.length;
+    column->pieces = (column->size + TODOFMT_TEXT_BLOCK - 1) / TODOFMT_TEXT_BLOCK;
+    column->text = (char *)malloc(column->size + 1);
+    column->packed = (unsigned char *)malloc((column->pieces + 1) * lz_bound(TODOFMT_TEXT_BLOCK));
+    column->piece_sizes = (size_t *)malloc((column->pieces + 1) * sizeof(size_t));
+    if (!column->text || !column->packed || !column->piece_sizes) return 0;
+
+    for (size_t i = 0; i < data->count; i++) {
+        TodoString description = data->tasks[i].description;
+
+        memcpy(column->text + at, store_text(data->holder, description), description.length);
+        at += description.length;
+    }
+    return 1;
+}
+
+static void free_text_column(TextColumn *column) {
+    free(column->text);
+    free(column->packed);
+    free(column->piece_sizes);
+}
+
+static uint64_t compress_pieces(TextColumn *column) {
+    uint64_t total = 0;
+
+    for (size_t p = 0; p < column->pieces; p++) {
+        size_t offset = p * TODOFMT_TEXT_BLOCK;
+        size_t piece = column->size - offset < TODOFMT_TEXT_BLOCK ? column->size - offset : TODOFMT_TEXT_BLOCK;
+
+        column->piece_sizes[p] = lz_compress(column->text + offset, piece,
+                                             column->packed + p * lz_bound(TODOFMT_TEXT_BLOCK),
+                                             lz_bound(TODOFMT_TEXT_BLOCK));
+        total += column->piece_sizes[p];
+    }
+    return total;
+}
+
+static uint64_t bench_lz_compress(Dataset *data, const BenchConfig *config, size_t *items) {
+    TextColumn column;
+    uint64_t start, elapsed = 0;
+
+    (void)config;
+    if (make_text_column(data, &column)) {
+        start = now_ns();
+        output_bytes = compress_pieces(&column);
+        elapsed = now_ns() - start;
+    }
+    *items = column.size;
+    free_text_column(&column);
+    return elapsed;
+}
+
+static uint64_t bench_lz_decompress(Dataset *data, const BenchConfig *config, size_t *items) {
+    TextColumn column;
+    uint64_t start, elapsed = 0;
+    int ok = 1;
+
+    (void)config;
+    if (make_text_column(data, &column)) {
+        output_bytes = compress_pieces(&column);
+        start = now_ns();
+        for (size_t p = 0; p < column.pieces; p++) {
+            size_t offset = p * TODOFMT_TEXT_BLOCK;
+            size_t piece = column.size - offset < TODOFMT_TEXT_BLOCK ? column.size - offset : TODOFMT_TEXT_BLOCK;
+
+            ok &= lz_decompress(column.packed + p * lz_bound(TODOFMT_TEXT_BLOCK), column.piece_sizes[p],
+                                column.text + offset, piece);
+        }
+        elapsed = now_ns() - start;
+        if (!ok) fprintf(stderr, "todo_bench: text column did not decompress\n");
+    }
+    *items = column.size;
+    free_text_column(&column);
+    return elapsed;
+}
+
+static const struct {
+    const char *name;
+    BenchFunc func;
+} benchmarks[] = {
+    { "date_parse", bench_date_parse },
+    { "date_parse_column", bench_date_parse_column },
+    { "date_format", bench_date_format },
+    { "sort_tasks", bench_sort_tasks },
+    { "sort_tasks_qsort", bench_sort_tasks_qsort },
+    { "sort_priority", bench_sort_priority },
+    { "sort_priority_qsort", bench_sort_priority_qsort },
+    { "is_overdue", bench_is_overdue },
+    { "due_classify_tasks", bench_due_classify },
+    { "format_rows", bench_format_rows },
+    { "save_data", bench_save_data },
+    { "load_data", bench_load_data },
+    { "lz_compress", bench_lz_compress },
+    { "lz_decompress", bench_lz_decompress },
+    { "save_columnar", bench_save_columnar },
+    { "load_columnar", bench_load_columnar },
+    { "read_data", bench_read_data },
+    { "verify_data", bench_verify_data },
+    { "tag_filter", bench_tag_filter },
+    { "tag_filter_scan", bench_tag_filter_scan },
+    { "folder_rows", bench_folder_rows },
+    { "folder_rows_scan", bench_folder_rows_scan },
+    { "next_day", bench_next_day },
+    { "batch_complete", bench_batch_complete },
+    { "complete_each", bench_complete_each },
+    { "batch_many_folders", bench_batch_many_folders },
+    { "view_rebuild", bench_view_rebuild },
+    { "view_edit", bench_view_edit },
+    { "query", bench_query },
+    { "query_scan", bench_query_scan },
+    { "search", bench_search },
+    { "agenda", bench_agenda },
+    { "agenda_again", bench_agenda_again },
+};
+
+#define BENCH_COUNT (sizeof(benchmarks) / sizeof(benchmarks[0]))
+
+static int compare_times(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a;
+    uint64_t y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+static void run_benchmarks(Dataset *data, const BenchConfig *config, BenchResult *results) {
+    for (size_t b = 0; b < BENCH_COUNT; b++) {
+        uint64_t times[MAX_REPEAT];
+        size_t items = 0;
+
+        output_bytes = 0;
+        output_formatted = 0;
+        for (int r = 0; r < config->repeat; r++) {
+            times[r] = benchmarks[b].func(data, config, &items);
+        }
+        qsort(times, (size_t)config->repeat, sizeof(uint64_t), compare_times);
+        results[b].name = benchmarks[b].name;
+        results[b].items = items;
+        results[b].bytes = output_bytes;
+        results[b].formatted = output_formatted;
+        results[b].min_ns = times[0];
+        results[b].median_ns = times[config->repeat / 2];
+    }
+}
+
+static void print_results(FILE *out, size_t count, const BenchResult *results, int last) {
+    fprintf(out, "    {\n      \"tasks\": %zu,\n      \"results\": [\n", count);
+    for (size_t b = 0; b < BENCH_COUNT; b++) {
+        const BenchResult *result = &results[b];
+        double per_item = result->items ? (double)result->median_ns / (double)result->items : 0.0;
+
+        fprintf(out, "        {\"name\": \"%s\", \"items\": %zu, ", result->name, result->items);
+        if (result->bytes) fprintf(out, "\"bytes\": %llu, ", (unsigned long long)result->bytes);
+        if (result->formatted) fprintf(out, "\"rows_formatted\": %llu, ", (unsigned long long)result->formatted);
+        fprintf(out, "\"min_ns\": %llu, \"median_ns\": %llu, \"ns_per_item\": %.2f}%s\n",
+                (unsigned long long)result->min_ns, (unsigned long long)result->median_ns,
+                per_item, b + 1 < BENCH_COUNT ? "," : "");
+    }
+    fprintf(out, "      ]\n    }%s\n", last ? "" : ",");
+}
+
+static int parse_sizes(const char *text, BenchConfig *config) {
+    config->size_count = 0;
+    while (*text) {
+        char *end;
+        unsigned long long size = strtoull(text, &end, 10);
+
+        if (end == text || size == 0 || config->size_count == MAX_SIZES) return 0;
+        // Allow 10k, 1m
+        if (*end == 'k' || *end == 'K') { size *= 1000; end++; }
+        else if (*end == 'm' || *end == 'M') { size *= 1000000; end++; }
+        config->sizes[config->size_count++] = (size_t)size;
+        if (*end == ',') end++;
+        else if (*end != '\0') return 0;
+        text = end;
+    }
+    return config->size_count > 0;
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: todo_bench [options]\n"
+            "  --tasks N[,N...]     dataset sizes, e.g. 1k,100k,10m (default 1k,10k,100k,1m)\n"
+            "  --folders N          lists the tasks are spread over (default 20)\n"
+            "  --completed R        fraction of completed tasks, 0-1 (default 0.3)\n"
+            "  --undated R          fraction of tasks without a deadline, 0-1 (default 0.1)\n"
+            "  --deadlines D        uniform, clustered or past (default uniform)\n"
+            "  --repeat N           runs per measurement, 1-%d (default 5)\n"
+            "  --seed N             dataset seed (default 1)\n"
+            "  --dir PATH           directory for the round-trip data files (default .)\n"
+            "  --out FILE           write the JSON here instead of stdout\n", MAX_REPEAT);
+}
+
+static int parse_args(int argc, char **argv, BenchConfig *config) {
+    static const size_t default_sizes[] = { 1000, 10000, 100000, 1000000 };
+
+    memset(config, 0, sizeof(*config));
+    memcpy(config->sizes, default_sizes, sizeof(default_sizes));
+    config->size_count = 4;
+    config->folders = 20;
+    config->completed = 0.3;
+    config->undated = 0.1;
+    config->deadlines = DEADLINES_UNIFORM;
+    config->repeat = 5;
+    config->seed = 1;
+    config->dir = ".";
+
+    for (int i = 1; i < argc; i++) {
+        const char *option = argv[i];
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (value == NULL) return 0;
+        i++;
+        if (strcmp(option, "--tasks") == 0) {
+            if (!parse_sizes(value, config)) return 0;
+        } else if (strcmp(option, "--folders") == 0) {
+            config->folders = atoi(value);
+            if (config->folders < 1) return 0;
+        } else if (strcmp(option, "--completed") == 0) {
+            config->completed = atof(value);
+            if (config->completed < 0 || config->completed > 1) return 0;
+        } else if (strcmp(option, "--undated") == 0) {
+            config->undated = atof(value);
+            if (config->undated < 0 || config->undated > 1) return 0;
+        } else if (strcmp(option, "--deadlines") == 0) {
+            int found = -1;
+            for (int d = 0; d < (int)(sizeof(deadline_names) / sizeof(deadline_names[0])); d++) {
+                if (strcmp(value, deadline_names[d]) == 0) found = d;
+            }
+            if (found < 0) return 0;
+            config->deadlines = found;
+        } else if (strcmp(option, "--repeat") == 0) {
+            config->repeat = atoi(value);
+            if (config->repeat < 1 || config->repeat > MAX_REPEAT) return 0;
+        } else if (strcmp(option, "--seed") == 0) {
+            config->seed = strtoull(value, NULL, 10);
+        } else if (strcmp(option, "--dir") == 0) {
+            config->dir = value;
+        } else if (strcmp(option, "--out") == 0) {
+            config->out = value;
+        } else {
+            return 0;
+        }
+    }
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    BenchConfig config;
+    BenchResult results[BENCH_COUNT];
+    FILE *out = stdout;
+    char path[1024];
+
+    if (!parse_args(argc, argv, &config)) {
+        usage();
+        return 2;
+    }
+    if (config.out && (out = fopen(config.out, "w")) == NULL) {
+        fprintf(stderr, "todo_bench: cannot write %s\n", config.out);
+        return 1;
+    }
+
+    fprintf(out, "{\n  \"benchmark\": \"todo_bench\",\n  \"format_version\": %d,\n", TODOFMT_VERSION);
+    fprintf(out, "  \"config\": {\"folders\": %d, \"completed\": %.3f, \"undated\": %.3f, "
+            "\"deadlines\": \"%s\", \"repeat\": %d, \"seed\": %llu},\n",
+            config.folders, config.completed, config.undated, deadline_names[config.deadlines],
+            config.repeat, (unsigned long long)config.seed);
+    fprintf(out, "  \"runs\": [\n");
+
+    for (int s = 0; s < config.size_count; s++) {
+        Dataset data;
+
+        fprintf(stderr, "todo_bench: %zu tasks\n", config.sizes[s]);
+        if (!make_dataset(&data, config.sizes[s], &config)) {
+            fprintf(stderr, "todo_bench: out of memory for %zu tasks\n", config.sizes[s]);
+            if (out != stdout) fclose(out);
+            return 1;
+        }
+        run_benchmarks(&data, &config, results);
+        print_results(out, data.count, results, s + 1 == config.size_count);
+        fflush(out);
+        free_dataset(&data);
+    }
+
+    fprintf(out, "  ]\n}\n");
+    if (out != stdout) fclose(out);
+    bench_path(&config, TODOFMT_PLAIN, path, sizeof(path));
+    remove(path);
+    bench_path(&config, TODOFMT_COLUMNAR, path, sizeof(path));
+    remove(path);
+    return 0;
+}
@@ -0,0 +1,498 @@
+// libFuzzer target for everything the program reads back from disk.
+//
+// The first input byte picks what the rest is fed to:
+//   0  a current data file: opened from memory, every section checked,
+//      every list loaded and its rows formatted, then written out in one
+//      of the two encodings and read back, which must succeed
+//   1  an older file through todofmt_convert_legacy()
+//   2  a journal replayed onto a small store, with a tag index following it
+// In the first and last the task counts follow the store as well, and must
+// match counting every task again.
+// Checksums in the input are recomputed before it is read, so mutations
+// reach the decoders instead of stopping at the first checksum mismatch.
+//
+//   clang -std=c99 -g -O1 -fsanitize=fuzzer,address,undefined -I. -o todo_fuzz tools/todo_fuzz.c
+//       todo_core.c todo_format.c todo_slots.c todo_sort.c todo_recur.c todo_lz.c todo_journal.c todo_thread.c
+//       todo_date.c todo_due.c todo_view.c todo_strings.c todo_trace.c todo_tags.c todo_bitmap.c
+//       todo_stats.c
+//   ./todo_fuzz -seed_inputs=... corpus/
+//
+// Built with -DTODO_FUZZ_MAIN instead of -fsanitize=fuzzer it has its own
+// main, for compilers without libFuzzer: "todo_fuzz --seed DIR" writes a
+// starting corpus, and "todo_fuzz FILE..." runs each file once, such as a
+// crash reproducer.
+//
+// Scratch files go in the current directory, named after the process.
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef _WIN32
+#include <process.h>
+#define getpid _getpid
+#else
+#include <unistd.h>
+#endif
+
+#include "todo_core.h"
+#include "todo_due.h"
+#include "todo_format.h"
+#include "todo_journal.h"
+#include "todo_stats.h"
+#include "todo_tags.h"
+#include "todo_view.h"
+
+enum {
+    FUZZ_DATA_FILE = 0,
+    FUZZ_LEGACY_FILE,
+    FUZZ_JOURNAL,
+    FUZZ_TARGETS
+};
+
+static char scratch_path[64];
+
+static const char *scratch(const char *suffix) {
+    snprintf(scratch_path, sizeof(scratch_path), "todo_fuzz_%d%s", (int)getpid(), suffix);
+    return scratch_path;
+}
+
+static int write_bytes(const char *path, const void *data, size_t size) {
+    FILE *file = fopen(path, "wb");
+    int ok;
+
+    if (file == NULL) return 0;
+    ok = fwrite(data, 1, size, file) == size;
+    return fclose(file) == 0 && ok;
+}
+
+// Recompute the section and metadata checksums of both copies of the
+// metadata. Anything out of bounds is left alone for the reader to reject.
+static void reseal_data(unsigned char *data, size_t size) {
+    uint64_t offsets[2] = { 0, UINT64_MAX };
+    TodoFileTrailer trailer;
+
+    if (size >= sizeof(trailer)) {
+        memcpy(&trailer, data + size - sizeof(trailer), sizeof(trailer));
+        offsets[1] = trailer.mirror_offset;
+    }
+    for (int copy = 0; copy < 2; copy++) {
+        uint64_t offset = offsets[copy];
+        TodoFileHeader header;
+        uint32_t crc;
+
+        if (offset > size || size - offset < sizeof(header)) continue;
+        memcpy(&header, data + offset, sizeof(header));
+        if (header.metadata_size < sizeof(header) || header.metadata_size > size - offset) continue;
+
+        // Section checksums live in the directory, which the metadata checksum covers
+        if (header.directory_offset <= header.metadata_size &&
+            header.folder_count <= (header.metadata_size - header.directory_offset) / sizeof(TodoFolderEntry)) {
+            for (uint32_t i = 0; i < header.folder_count; i++) {
+                unsigned char *at = data + offset + header.directory_offset + (size_t)i * sizeof(TodoFolderEntry);
+                TodoFolderEntry entry;
+
+                memcpy(&entry, at, sizeof(entry));
+                if (entry.section_offset > size || entry.section_size > size - entry.section_offset) continue;
+                entry.section_crc = todofmt_crc32c(0, data + entry.section_offset, entry.section_size);
+                memcpy(at, &entry, sizeof(entry));
+            }
+        }
+        memcpy(&header, data + offset, sizeof(header));
+        header.metadata_crc = 0;
+        crc = todofmt_crc32c(0, &header, sizeof(header));
+        crc = todofmt_crc32c(crc, data + offset + sizeof(header), header.metadata_size - sizeof(header));
+        memcpy(data + offset + offsetof(TodoFileHeader, metadata_crc), &crc, sizeof(crc));
+    }
+}
+
+static void reseal_journal(unsigned char *data, size_t size) {
+    size_t at = 0;
+
+    while (size - at >= sizeof(TodoJournalRecord)) {
+        TodoJournalRecord record;
+
+        memcpy(&record, data + at, sizeof(record));
+        if (record.size < sizeof(record) || record.size > size - at) break;
+        memset(data + at + offsetof(TodoJournalRecord, checksum), 0, sizeof(record.checksum));
+        record.checksum = journal_record_checksum(data + at, record.size);
+        memcpy(data + at + offsetof(TodoJournalRecord, checksum), &record.checksum, sizeof(record.checksum));
+        at += record.size;
+    }
+}
+
+// Load every list and format every row, as the window would
+static void touch_store(TodoStore *store, TodoStats *stats) {
+    char text[VIEW_TEXT_LENGTH];
+
+    for (int i = 0; i < store->folder_count; i++) {
+        Folder *folder = &store->folders[i];
+
+        store_materialize(store, i);
+        for (int row = 0; row < folder->task_count; row++) {
+            Task *task = store_task(store, folder, row);
+
+            view_format_task(store, task, due_state(task, date_today()), text);
+        }
+        view_format_folder(store, folder, stats ? stats_folder(stats, i) : NULL, text);
+    }
+}
+
+// Counting every task again must agree with the counts that followed the
+// store (once every list is loaded)
+static void check_stats(TodoStore *store, TodoStats *stats, int32_t today) {
+    TodoFolderStats total;
+
+    if (stats == NULL) return;
+    memset(&total, 0, sizeof(total));
+    total.next_deadline = DATE_NONE;
+    for (int i = 0; i < store->folder_count; i++) {
+        const Folder *folder = &store->folders[i];
+        const TodoFolderStats *counts = stats_folder(stats, i);
+        TodoFolderStats again;
+
+        memset(&again, 0, sizeof(again));
+        again.next_deadline = DATE_NONE;
+        for (int row = 0; row < folder->task_count; row++) {
+            const Task *task = store_task(store, folder, row);
+            int state = due_state(task, today);
+
+            again.open += state != DUE_DONE;
+            again.completed += state == DUE_DONE;
+            again.overdue += state == DUE_OVERDUE;
+            again.due_today += state == DUE_TODAY;
+            if (state != DUE_DONE && task->deadline_day != DATE_NONE &&
+                (again.next_deadline == DATE_NONE || task->deadline_day < again.next_deadline)) {
+                again.next_deadline = task->deadline_day;
+            }
+        }
+        if (counts == NULL || !counts->loaded || counts->tasks != folder->task_count || counts->open != again.open ||
+            counts->completed != again.completed || counts->overdue != again.overdue ||
+            counts->due_today != again.due_today || counts->next_deadline != again.next_deadline) {
+            abort();
+        }
+        total.tasks += folder->task_count;
+        total.overdue += again.overdue;
+        total.due_today += again.due_today;
+        if (again.next_deadline != DATE_NONE &&
+            (total.next_deadline == DATE_NONE || again.next_deadline < total.next_deadline)) {
+            total.next_deadline = again.next_deadline;
+        }
+    }
+    {
+        const TodoFolderStats *counts = stats_total(stats);
+
+        if (!counts->loaded || counts->tasks != total.tasks || counts->overdue != total.overdue ||
+            counts->due_today != total.due_today || counts->next_deadline != total.next_deadline) {
+            abort();
+        }
+    }
+}
+
+// Whatever a store holds must survive a write and a read back
+static void check_round_trip(TodoStore *store, int encoding) {
+    const char *path = scratch(".out");
+    TodoDataFile *file;
+    TodoStore *again;
+
+    if (todofmt_write(path, store, encoding) != TODOFMT_OK) return;     // Out of memory or disk
+    again = (TodoStore *)malloc(sizeof(TodoStore));
+    if (again == NULL) return;
+    store_init(again);
+    if (todofmt_open(path, &file) != TODOFMT_OK || todofmt_verify(file, 1) != 0) abort();
+    store_attach(again, file);
+    if (again->folder_count != store->folder_count) abort();
+    for (int i = 0; i < store->folder_count; i++) {
+        if (store->folders[i].loaded && (!store_materialize(again, i) ||
+                                         again->folders[i].task_count != store->folders[i].task_count)) {
+            abort();
+        }
+    }
+    store_release(again);
+    free(again);
+    remove(path);
+}
+
+static void fuzz_data_file(const unsigned char *data, size_t size) {
+    unsigned char *copy = (unsigned char *)malloc(size > 0 ? size : 1);     // 8-byte aligned
+    TodoStore *store = (TodoStore *)malloc(sizeof(TodoStore));
+    TodoDataFile *file;
+
+    if (copy == NULL || store == NULL) {
+        free(copy);
+        free(store);
+        return;
+    }
+    memcpy(copy, data, size);
+    reseal_data(copy, size);
+    store_init(store);
+    if (todofmt_open_memory(copy, size, &file) == TODOFMT_OK) {
+        int32_t today = date_today();
+        TodoTagIndex *tags;
+        TodoStats *stats;
+
+        todofmt_verify(file, 2);
+        store_attach(store, file);
+        tags = tags_create(store);
+        stats = stats_create(store, today);
+        touch_store(store, stats);
+        check_stats(store, stats, today);
+        check_round_trip(store, (size & 1) ? TODOFMT_COLUMNAR : TODOFMT_PLAIN);
+        stats_destroy(stats);
+        tags_destroy(tags);
+    }
+    store_release(store);
+    free(store);
+    free(copy);
+}
+
+static void fuzz_legacy_file(const unsigned char *data, size_t size) {
+    char legacy[64];
+    const char *converted;
+    TodoDataFile *file;
+
+    snprintf(legacy, sizeof(legacy), "%s", scratch(".old"));
+    converted = scratch(".new");
+    if (!write_bytes(legacy, data, size)) return;
+    if (todofmt_convert_legacy(legacy, converted) == TODOFMT_OK) {
+        if (todofmt_open(converted, &file) != TODOFMT_OK || todofmt_verify(file, 1) != 0) abort();
+        todofmt_close(file);
+    }
+    remove(legacy);
+    remove(scratch(".new"));
+}
+
+// Two lists to replay onto, one with a repeating and a tagged task
+static void fill_fixture(TodoStore *store) {
+    TodoRecurrence weekly;
+
+    store_create_folder(store, 1, "Home");
+    store_create_folder(store, 2, "Work");
+    recur_parse("weekly", date_from_civil(2026, 1, 5), &weekly);
+    store_insert_task(store, 0, -1, "Water plants", date_from_civil(2026, 1, 5), 0, PRIORITY_NONE, NULL, &weekly);
+    store_insert_task(store, 0, -1, "Pay rent", date_from_civil(2026, 1, 31), 1, PRIORITY_HIGH, NULL, NULL);
+    store_insert_task(store, 1, -1, "Send report", DATE_NONE, 0, PRIORITY_LOW, "urgent work", NULL);
+}
+
+static void fuzz_journal(const unsigned char *data, size_t size) {
+    unsigned char *copy = (unsigned char *)malloc(size > 0 ? size : 1);
+    TodoStore *store = (TodoStore *)malloc(sizeof(TodoStore));
+    const char *path = scratch(".jnl");
+
+    if (copy == NULL || store == NULL) {
+        free(copy);
+        free(store);
+        return;
+    }
+    memcpy(copy, data, size);
+    reseal_journal(copy, size);
+    if (write_bytes(path, copy, size)) {
+        int32_t today = date_from_civil(2026, 1, 20);
+        TodoTagIndex *tags;
+        TodoStats *stats;
+        uint64_t valid_size;
+
+        store_init(store);
+        fill_fixture(store);
+        tags = tags_create(store);
+        stats = stats_create(store, today);
+        journal_replay(path, store, &valid_size);
+        if (valid_size > size) abort();
+        touch_store(store, stats);
+        check_stats(store, stats, today);
+        // A later day, counted again only where it changes anything
+        today += 1 + (int32_t)(size % 40);
+        if (stats) stats_set_today(stats, today);
+        check_stats(store, stats, today);
+        check_round_trip(store, (size & 1) ? TODOFMT_COLUMNAR : TODOFMT_PLAIN);
+        stats_destroy(stats);
+        tags_destroy(tags);
+        store_release(store);
+    }
+    remove(path);
+    free(store);
+    free(copy);
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    if (size == 0) return 0;
+    switch (data[0] % FUZZ_TARGETS) {
+        case FUZZ_DATA_FILE:
+            fuzz_data_file(data + 1, size - 1);
+            break;
+        case FUZZ_LEGACY_FILE:
+            fuzz_legacy_file(data + 1, size - 1);
+            break;
+        case FUZZ_JOURNAL:
+            fuzz_journal(data + 1, size - 1);
+            break;
+    }
+    return 0;
+}
+
+#ifdef TODO_FUZZ_MAIN
+
+static unsigned char *read_file(const char *path, size_t *size) {
+    FILE *file = fopen(path, "rb");
+    unsigned char *data = NULL;
+    long length;
+
+    if (file == NULL) return NULL;
+    if (fseek(file, 0, SEEK_END) == 0 && (length = ftell(file)) >= 0 && fseek(file, 0, SEEK_SET) == 0 &&
+        (data = (unsigned char *)malloc((size_t)length + 1)) != NULL) {
+        *size = fread(data, 1, (size_t)length, file);
+    }
+    fclose(file);
+    return data;
+}
+
+// Write a seed: the target byte, then the contents of the file at from
+static int write_seed(const char *dir, const char *name, int target, const char *from) {
+    char path[1024];
+    size_t size = 0;
+    unsigned char *data = read_file(from, &size);
+    unsigned char *seed = data ? (unsigned char *)malloc(size + 1) : NULL;
+    int ok;
+
+    remove(from);
+    if (seed == NULL) {
+        free(data);
+        return 0;
+    }
+    seed[0] = (unsigned char)target;
+    memcpy(seed + 1, data, size);
+    snprintf(path, sizeof(path), "%s/%s", dir, name);
+    ok = write_bytes(path, seed, size + 1);
+    free(seed);
+    free(data);
+    return ok;
+}
+
+static size_t put_record(unsigned char *out, uint32_t version, uint64_t seq, int op, uint32_t folder_id,
+                         int task_index, const char *text0, const char *text1) {
+    TodoJournalRecord record;
+
+    memset(&record, 0, sizeof(record));
+    record.seq = seq;
+    record.op = (uint32_t)op | version << 24;
+    record.folder_id = folder_id;
+    record.task_index = task_index;
+    record.text_length[0] = (uint16_t)strlen(text0);
+    record.text_length[1] = (uint16_t)strlen(text1);
+    record.size = (uint32_t)(sizeof(record) + record.text_length[0] + record.text_length[1]);
+    memcpy(out + sizeof(record), text0, record.text_length[0]);
+    memcpy(out + sizeof(record) + record.text_length[0], text1, record.text_length[1]);
+    memcpy(out, &record, sizeof(record));
+    record.checksum = journal_record_checksum(out, record.size);
+    memcpy(out, &record, sizeof(record));
+    return record.size;
+}
+
+// Version 1: a count of lists, each a 100-byte name, a task count and
+// 136-byte tasks (description[100], deadline[20], completed), then the
+// current list
+static size_t put_version1(unsigned char *out) {
+    int32_t value = 1;
+    size_t at = 0;
+
+    memset(out, 0, 512);
+    memcpy(out + at, &value, 4);
+    at += 4;
+    memcpy(out + at, "Errands", 7);
+    at += 100;
+    memcpy(out + at, &value, 4);
+    at += 4;
+    memcpy(out + at, "Buy milk", 8);
+    memcpy(out + at + 100, "2025-03-01", 10);
+    at += 136;
+    value = 0;
+    memcpy(out + at, &value, 4);
+    return at + 4;
+}
+
+static int write_corpus(const char *dir) {
+    TodoStore *store = (TodoStore *)malloc(sizeof(TodoStore));
+    unsigned char *journal = (unsigned char *)malloc(4096);
+    const char *path = scratch(".seed");
+    const uint32_t version = JOURNAL_RECORD_VERSION;
+    char schedule[JOURNAL_SCHEDULE_LENGTH];
+    TodoRecurrence none;
+    size_t size = 0;
+    int ok = store != NULL && journal != NULL;
+
+    if (ok) {
+        store_init(store);
+        fill_fixture(store);
+        ok = todofmt_write(path, store, TODOFMT_PLAIN) == TODOFMT_OK && write_seed(dir, "plain", FUZZ_DATA_FILE, path) &&
+             todofmt_write(path, store, TODOFMT_COLUMNAR) == TODOFMT_OK &&
+             write_seed(dir, "columnar", FUZZ_DATA_FILE, path);
+        store_release(store);
+    }
+    if (ok) {
+        memset(&none, 0, sizeof(none));
+        size += put_record(journal + size, version, 1, JOURNAL_CREATE_LIST, 0, -1, "Trips", "");
+        journal_format_schedule(date_from_civil(2026, 2, 1), &none, PRIORITY_MEDIUM, "travel", schedule);
+        size += put_record(journal + size, version, 2, JOURNAL_ADD_TASK, 3, -1, "Book flights", schedule);
+        size += put_record(journal + size, version, 3, JOURNAL_COMPLETE_TASK, 1, 0, "Water plants", "2026-01-05");
+        size += put_record(journal + size, version, 4, JOURNAL_TAG_TASK, 2, 0, "Send report", "#work 2026-01-05");
+        size += put_record(journal + size, version, 5, JOURNAL_DELETE_TASK, 1, 1, "Pay rent", "2026-01-31");
+        ok = write_bytes(path, journal, size) && write_seed(dir, "journal", FUZZ_JOURNAL, path);
+    }
+    if (ok) {
+        // Records from before they carried a version
+        size = put_record(journal, 0, 1, JOURNAL_CREATE_LIST, 0, -1, "Trips", "");
+        size += put_record(journal + size, 0, 2, JOURNAL_COMPLETE_TASK, 1, 0, "Water plants", "2026-01-05");
+        ok = write_bytes(path, journal, size) && write_seed(dir, "journal_version0", FUZZ_JOURNAL, path);
+    }
+    if (ok) {
+        // A batch header, then the three records it covers
+        size = put_record(journal, version, 1, JOURNAL_BATCH, 0, 3, "", "");
+        size += put_record(journal + size, version, 2, JOURNAL_COMPLETE_TASK, 1, 0, "Water plants", "2026-01-05");
+        journal_format_schedule(DATE_NONE, &none, PRIORITY_NONE, "home", schedule);
+        size += put_record(journal + size, version, 3, JOURNAL_TAG_TASK, 2, 0, "Send report", schedule);
+        journal_format_schedule(date_from_civil(2026, 1, 31), &none, PRIORITY_HIGH, "", schedule);
+        size += put_record(journal + size, version, 4, JOURNAL_RESTORE_TASK, 2, -1, "Pay rent", schedule);
+        size += put_record(journal + size, version, 5, JOURNAL_DELETE_TASK, 1, 1, "Pay rent", "2026-01-31");
+        ok = write_bytes(path, journal, size) && write_seed(dir, "journal_batch", FUZZ_JOURNAL, path);
+    }
+    if (ok) {
+        size = put_version1(journal);
+        ok = write_bytes(path, journal, size) && write_seed(dir, "version1", FUZZ_LEGACY_FILE, path);
+    }
+    free(journal);
+    free(store);
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 3 && strcmp(argv[1], "--seed") == 0) {
+        if (!write_corpus(argv[2])) {
+            fprintf(stderr, "todo_fuzz: could not write the corpus to %s\n", argv[2]);
+            return 1;
+        }
+        return 0;
+    }
+    if (argc < 2) {
+        fprintf(stderr, "usage: todo_fuzz --seed DIR | todo_fuzz FILE...\n");
+        return 2;
+    }
+    for (int i = 1; i < argc; i++) {
+        size_t size = 0;
+        unsigned char *data = read_file(argv[i], &size);
+
+        if (data == NULL) {
+            fprintf(stderr, "todo_fuzz: cannot read %s\n", argv[i]);
+            return 1;
+        }
+        LLVMFuzzerTestOneInput(data, size);
+        free(data);
+    }
+    printf("todo_fuzz: %d input(s) ran\n", argc - 1);
+    return 0;
+}
+
+#endif
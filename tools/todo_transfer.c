@@ -0,0 +1,238 @@
+// Command-line import and export of todo_data.dat as CSV or JSON Lines.
+//
+//   todo_transfer import tasks.csv [--data todo_data.dat] [--threads N] [--list NAME]
+//                 [--encoding plain|columnar]
+//   todo_transfer export tasks.jsonl [--data todo_data.dat]
+//   todo_transfer check tasks.csv [--threads N]
+//
+// The format follows the file extension unless --format csv|jsonl is given;
+// "-" reads standard input or writes standard output. import loads the data
+// file plus its journal, adds the rows and writes a new checkpoint in place.
+// check only parses and validates. Run it while the application is closed.
+//
+//   gcc -std=c99 -O2 -pthread -I. -o todo_transfer tools/todo_transfer.c todo_io.c todo_core.c
+//       todo_format.c todo_slots.c todo_sort.c todo_recur.c todo_lz.c todo_journal.c todo_thread.c todo_trace.c todo_date.c todo_strings.c
+//       todo_tags.c todo_bitmap.c
+
+#ifndef _WIN32
+#define _POSIX_C_SOURCE 200809L
+#endif
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "todo_core.h"
+#include "todo_format.h"
+#include "todo_io.h"
+#include "todo_journal.h"
+#include "todo_thread.h"
+#include "todo_trace.h"
+
+#define MAX_REPORTED 100
+
+typedef struct {
+    const char *command;
+    const char *file;
+    const char *data;
+    const char *list;
+    int format;
+    int threads;
+    int encoding;
+} Options;
+
+static uint64_t errors_seen;
+
+static void report_row(void *context, uint64_t line, int error) {
+    (void)context;
+    if (errors_seen++ < MAX_REPORTED) {
+        fprintf(stderr, "line %llu: %s\n", (unsigned long long)line, io_row_error_text(error));
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr,
+            "usage: todo_transfer import|export|check FILE [options]\n"
+            "  --data PATH      data file (default todo_data.dat)\n"
+            "  --format F       csv or jsonl (default: from the file extension)\n"
+            "  --threads N      parser threads for import and check, 0-%d (default 0)\n"
+            "  --list NAME      list for rows that do not name one\n"
+            "  --encoding E     plain or columnar sections for the written file (default plain)\n", IO_MAX_THREADS);
+}
+
+static int parse_args(int argc, char **argv, Options *options) {
+    memset(options, 0, sizeof(*options));
+    options->data = "todo_data.dat";
+    if (argc < 3) return 0;
+    options->command = argv[1];
+    options->file = argv[2];
+
+    for (int i = 3; i < argc; i += 2) {
+        const char *value = i + 1 < argc ? argv[i + 1] : NULL;
+
+        if (value == NULL) return 0;
+        if (strcmp(argv[i], "--data") == 0) {
+            options->data = value;
+        } else if (strcmp(argv[i], "--format") == 0) {
+            options->format = strcmp(value, "csv") == 0 ? IO_CSV : strcmp(value, "jsonl") == 0 ? IO_JSONL : -1;
+            if (options->format < 0) return 0;
+        } else if (strcmp(argv[i], "--threads") == 0) {
+            options->threads = atoi(value);
+            if (options->threads < 0 || options->threads > IO_MAX_THREADS) return 0;
+        } else if (strcmp(argv[i], "--list") == 0) {
+            options->list = value;
+        } else if (strcmp(argv[i], "--encoding") == 0) {
+            options->encoding = strcmp(value, "plain") == 0 ? TODOFMT_PLAIN
+                              : strcmp(value, "columnar") == 0 ? TODOFMT_COLUMNAR : -1;
+            if (options->encoding < 0) return 0;
+        } else {
+            return 0;
+        }
+    }
+    if (options->format == 0) options->format = io_format_from_path(options->file);
+    if (options->format == 0) {
+        fprintf(stderr, "todo_transfer: cannot tell the format of %s; use --format\n", options->file);
+        return 0;
+    }
+    return strcmp(options->command, "import") == 0 || strcmp(options->command, "export") == 0 ||
+           strcmp(options->command, "check") == 0;
+}
+
+// The data file with both journal files replayed on top, as the
+// application would see it
+static int load_store(TodoStore *store, const char *data_path) {
+    char log_path[1024];
+    char segment_path[1024];
+    TodoDataFile *file;
+    int status = todofmt_open(data_path, &file);
+    const char *dot = strrchr(data_path, '.');
+    int stem = dot ? (int)(dot - data_path) : (int)strlen(data_path);
+
+    if (status == TODOFMT_ERR_LEGACY && todofmt_upgrade_legacy(data_path) == TODOFMT_OK) {
+        status = todofmt_open(data_path, &file);
+    }
+    if (status == TODOFMT_OK) {
+        todofmt_verify(file, todo_cpu_count());
+        store_attach(store, file);
+    } else if (status != TODOFMT_ERR_MISSING) {
+        fprintf(stderr, "todo_transfer: cannot read %s\n", data_path);
+        return 0;
+    }
+
+    if (store->quarantined > 0) {
+        fprintf(stderr, "todo_transfer: %d damaged list(s) in %s load empty\n", store->quarantined, data_path);
+    }
+
+    snprintf(log_path, sizeof(log_path), "%.*s.jnl", stem, data_path);
+    snprintf(segment_path, sizeof(segment_path), "%.*s.jnl.1", stem, data_path);
+    journal_replay(segment_path, store, NULL);
+    journal_replay(log_path, store, NULL);
+    return 1;
+}
+
+// Write the store as a new checkpoint. Its journal sequence number covers
+// everything replayed, so the old journal records are skipped from now on.
+// Quarantined lists are written back empty, so their damaged sections are
+// appended to <data>.damaged first, as the application does.
+static int save_store(TodoStore *store, const char *data_path, int encoding) {
+    char temp_path[1024];
+
+    if (store->quarantined > 0) {
+        snprintf(temp_path, sizeof(temp_path), "%s.damaged", data_path);
+        if (todofmt_save_damaged(store->backing, temp_path) != TODOFMT_OK) return 0;
+        fprintf(stderr, "damaged lists saved to %s\n", temp_path);
+    }
+    snprintf(temp_path, sizeof(temp_path), "%s.import", data_path);
+    if (todofmt_write(temp_path, store, encoding) != TODOFMT_OK) {
+        remove(temp_path);
+        return 0;
+    }
+    if (todofmt_replace(temp_path, data_path) != TODOFMT_OK) {
+        remove(temp_path);
+        return 0;
+    }
+    return 1;
+}
+
+static int run_import(const Options *options, TodoStore *store) {
+    TodoImportOptions import;
+    TodoImportReport report;
+    FILE *in = strcmp(options->file, "-") == 0 ? stdin : fopen(options->file, "rb");
+    uint64_t started;
+    double seconds;
+    int status;
+
+    if (in == NULL) {
+        fprintf(stderr, "todo_transfer: cannot open %s\n", options->file);
+        return 1;
+    }
+    memset(&import, 0, sizeof(import));
+    import.format = options->format;
+    import.threads = options->threads;
+    import.default_list = options->list;
+    import.on_error = report_row;
+
+    started = trace_now_ns();
+    status = io_import(store, in, &import, &report);
+    seconds = (double)(trace_now_ns() - started) / 1e9;
+    if (in != stdin) fclose(in);
+
+    if (errors_seen > MAX_REPORTED) {
+        fprintf(stderr, "... %llu more rejected rows\n", (unsigned long long)(errors_seen - MAX_REPORTED));
+    }
+    fprintf(stderr, "%llu rows, %llu imported, %llu rejected, %llu new lists; %.1f MB in %.3f s (%.0f MB/s)\n",
+            (unsigned long long)report.rows, (unsigned long long)report.imported,
+            (unsigned long long)report.rejected, (unsigned long long)report.lists_created,
+            (double)report.bytes / 1e6, seconds, seconds > 0 ? (double)report.bytes / 1e6 / seconds : 0.0);
+
+    switch (status) {
+        case IO_OK: return 0;
+        case IO_ERR_HEADER: fprintf(stderr, "todo_transfer: the CSV header needs a description column\n"); break;
+        case IO_ERR_MEMORY: fprintf(stderr, "todo_transfer: out of memory\n"); break;
+        default: fprintf(stderr, "todo_transfer: read error\n"); break;
+    }
+    return 1;
+}
+
+int main(int argc, char **argv) {
+    static TodoStore store;
+    Options options;
+    int result;
+
+    if (!parse_args(argc, argv, &options)) {
+        usage();
+        return 2;
+    }
+    store_init(&store);
+
+    if (strcmp(options.command, "check") == 0) {
+        return run_import(&options, NULL);
+    }
+    if (!load_store(&store, options.data)) return 1;
+
+    if (strcmp(options.command, "import") == 0) {
+        result = run_import(&options, &store);
+        if (result == 0 && !save_store(&store, options.data, options.encoding)) {
+            fprintf(stderr, "todo_transfer: could not write %s\n", options.data);
+            result = 1;
+        }
+    } else {
+        FILE *out = strcmp(options.file, "-") == 0 ? stdout : fopen(options.file, "wb");
+        uint64_t rows;
+
+        if (out == NULL) {
+            fprintf(stderr, "todo_transfer: cannot create %s\n", options.file);
+            store_release(&store);
+            return 1;
+        }
+        result = io_export(&store, out, options.format, &rows) == IO_OK ? 0 : 1;
+        if (out != stdout && fclose(out) != 0) result = 1;
+        if (result) {
+            fprintf(stderr, "todo_transfer: could not write %s\n", options.file);
+        } else {
+            fprintf(stderr, "%llu rows exported\n", (unsigned long long)rows);
+        }
+    }
+    store_release(&store);
+    return result;
+}